@@ -0,0 +1,1010 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2013, 2017, 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file cadet/gnunet-service-cadet_axolotl.c
+ * @brief Axolotl encryption of the payload of tunnels
+ * @author Bartlomiej Polot
+ * @author Christian Grothoff
+ *
+ * Skipped message keys are indexed by header key and message number,
+ * so that a late message costs one HMAC per distinct header key we
+ * still have skipped keys for, plus one lookup.  Key material that
+ * only depends on a header key (HMAC key, header IV) is derived once
+ * per header key instead of once per message.
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "cadet_protocol.h"
+#include "gnunet-service-cadet_axolotl.h"
+
+
+#define LOG(level, ...) GNUNET_log_from(level,"cadet-axo",__VA_ARGS__)
+
+/**
+ * Maximum number of skipped keys we keep in memory per tunnel.
+ */
+#define MAX_SKIPPED_KEYS 64
+
+/**
+ * Maximum number of keys (and thus ratchet steps) we are willing to
+ * skip before we decide this is either a bogus packet or a DoS-attempt.
+ */
+#define MAX_KEY_GAP 256
+
+
+/**
+ * Header key shared by skipped message keys.
+ */
+struct CadetTunnelSkippedHeaderKey
+{
+  /**
+   * DLL next.
+   */
+  struct CadetTunnelSkippedHeaderKey *next;
+
+  /**
+   * DLL prev.
+   */
+  struct CadetTunnelSkippedHeaderKey *prev;
+
+  /**
+   * The header key and the key material derived from it.
+   */
+  struct CadetTunnelHeaderKey key;
+
+  /**
+   * Number of skipped message keys using this header key.
+   */
+  unsigned int rc;
+};
+
+
+/**
+ * Struct to old keys for skipped messages while advancing the Axolotl ratchet.
+ */
+struct CadetTunnelSkippedKey
+{
+  /**
+   * DLL next.
+   */
+  struct CadetTunnelSkippedKey *next;
+
+  /**
+   * DLL prev.
+   */
+  struct CadetTunnelSkippedKey *prev;
+
+  /**
+   * When was this key stored (for timeout).
+   */
+  struct GNUNET_TIME_Absolute timestamp;
+
+  /**
+   * Header key.
+   */
+  struct CadetTunnelSkippedHeaderKey *hk;
+
+  /**
+   * Message key.
+   */
+  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+
+  /**
+   * Key number for a given HK.
+   */
+  unsigned int Kn;
+};
+
+
+/**
+ * Closure for #find_skipped_key_cb().
+ */
+struct SkippedKeyLookup
+{
+  /**
+   * Header key of the key we are looking for.
+   */
+  const struct CadetTunnelSkippedHeaderKey *hk;
+
+  /**
+   * Number of the key we are looking for.
+   */
+  unsigned int Kn;
+
+  /**
+   * Set to the key if we found it.
+   */
+  struct CadetTunnelSkippedKey *key;
+};
+
+
+/**
+ * Create a new Axolotl ephemeral (ratchet) key.
+ *
+ * @param ax key material to update
+ */
+void
+GCAX_new_ephemeral (struct CadetTunnelAxolotl *ax)
+{
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Creating new ephemeral ratchet key (DHRs)\n");
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CRYPTO_ecdhe_key_create2 (&ax->DHRs));
+}
+
+
+/**
+ * Get the key material derived from header key @a HK, deriving it
+ * unless @a cache already holds it.
+ *
+ * @param[in,out] cache derived key material, updated if needed
+ * @param HK header key
+ * @return @a cache
+ */
+static const struct CadetTunnelHeaderKey *
+get_header_key (struct CadetTunnelHeaderKey *cache,
+                const struct GNUNET_CRYPTO_SymmetricSessionKey *HK)
+{
+  static const char ctx[] = "cadet authentication key";
+  static const uint32_t iv = 0;
+
+  if ( (GNUNET_YES == cache->valid) &&
+       (0 == memcmp (&cache->HK,
+                     HK,
+                     sizeof (*HK))) )
+    return cache;
+  cache->HK = *HK;
+  GNUNET_CRYPTO_hmac_derive_key (&cache->auth_key,
+                                 HK,
+                                 &iv, sizeof (iv),
+                                 HK, sizeof (*HK),
+                                 ctx, sizeof (ctx),
+                                 NULL);
+  GNUNET_CRYPTO_symmetric_derive_iv (&cache->iv,
+                                     HK,
+                                     NULL, 0,
+                                     NULL);
+  cache->valid = GNUNET_YES;
+  return cache;
+}
+
+
+/**
+ * Calculate HMAC.
+ *
+ * @param plaintext Content to HMAC.
+ * @param size Size of @c plaintext.
+ * @param hk Header key to use.
+ * @param hmac[out] Destination to store the HMAC.
+ */
+static void
+t_hmac (const void *plaintext,
+        size_t size,
+        const struct CadetTunnelHeaderKey *hk,
+        struct GNUNET_ShortHashCode *hmac)
+{
+  struct GNUNET_HashCode hash;
+
+  /* Two step: GNUNET_ShortHash is only 256 bits,
+     GNUNET_HashCode is 512, so we truncate. */
+  GNUNET_CRYPTO_hmac (&hk->auth_key,
+                      plaintext,
+                      size,
+                      &hash);
+  GNUNET_memcpy (hmac,
+                 &hash,
+                 sizeof (*hmac));
+}
+
+
+/**
+ * Derive the key for HMAC-HASH with @a key.
+ *
+ * @param key Key to use.
+ * @param[out] auth_key Resulting HMAC key.
+ */
+static void
+t_ax_hmac_key (const struct GNUNET_CRYPTO_SymmetricSessionKey *key,
+               struct GNUNET_CRYPTO_AuthKey *auth_key)
+{
+  static const char ctx[] = "axolotl HMAC-HASH";
+
+  GNUNET_CRYPTO_hmac_derive_key (auth_key,
+                                 key,
+                                 ctx, sizeof (ctx),
+                                 NULL);
+}
+
+
+/**
+ * Perform a HMAC.
+ *
+ * @param key Key to use.
+ * @param[out] hash Resulting HMAC.
+ * @param source Source key material (data to HMAC).
+ * @param len Length of @a source.
+ */
+static void
+t_ax_hmac_hash (const struct GNUNET_CRYPTO_SymmetricSessionKey *key,
+                struct GNUNET_HashCode *hash,
+                const void *source,
+                unsigned int len)
+{
+  struct GNUNET_CRYPTO_AuthKey auth_key;
+
+  t_ax_hmac_key (key,
+                 &auth_key);
+  GNUNET_CRYPTO_hmac (&auth_key,
+                      source,
+                      len,
+                      hash);
+}
+
+
+/**
+ * Derive a symmetric encryption key from an HMAC-HASH.
+ *
+ * @param auth_key HMAC key, from #t_ax_hmac_key().
+ * @param[out] out Key to generate.
+ * @param source Source key material (data to HMAC).
+ * @param len Length of @a source.
+ */
+static void
+t_hmac_derive_key (const struct GNUNET_CRYPTO_AuthKey *auth_key,
+                   struct GNUNET_CRYPTO_SymmetricSessionKey *out,
+                   const void *source,
+                   unsigned int len)
+{
+  static const char ctx[] = "axolotl derive key";
+  struct GNUNET_HashCode h;
+
+  GNUNET_CRYPTO_hmac (auth_key,
+                      source,
+                      len,
+                      &h);
+  GNUNET_CRYPTO_kdf (out, sizeof (*out),
+                     ctx, sizeof (ctx),
+                     &h, sizeof (h),
+                     NULL);
+}
+
+
+/**
+ * Advance a chain key by one message: derive the message key
+ * (from "0") and the next chain key (from "1"), using the HMAC
+ * key derived from @a CK for both.
+ *
+ * @param[in,out] CK chain key to advance
+ * @param[out] MK message key for the current message
+ */
+static void
+t_ax_chain_step (struct GNUNET_CRYPTO_SymmetricSessionKey *CK,
+                 struct GNUNET_CRYPTO_SymmetricSessionKey *MK)
+{
+  struct GNUNET_CRYPTO_AuthKey auth_key;
+
+  t_ax_hmac_key (CK,
+                 &auth_key);
+  t_hmac_derive_key (&auth_key,
+                     MK,
+                     "0",
+                     1);
+  t_hmac_derive_key (&auth_key,
+                     CK,
+                     "1",
+                     1);
+}
+
+
+/**
+ * Encrypt data with the axolotl tunnel key.
+ *
+ * @param ax key material to use.
+ * @param dst Destination with @a size bytes for the encrypted data.
+ * @param src Source of the plaintext. Can overlap with @c dst, must contain @a size bytes
+ * @param size Size of the buffers at @a src and @a dst
+ */
+static void
+t_ax_encrypt (struct CadetTunnelAxolotl *ax,
+              void *dst,
+              const void *src,
+              size_t size)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  size_t out_size;
+
+  ax->ratchet_counter++;
+  if ( (GNUNET_YES == ax->ratchet_allowed) &&
+       ( (ratchet_messages <= ax->ratchet_counter) ||
+         (0 == GNUNET_TIME_absolute_get_remaining (ax->ratchet_expiration).rel_value_us)) )
+  {
+    ax->ratchet_flag = GNUNET_YES;
+  }
+  if (GNUNET_YES == ax->ratchet_flag)
+  {
+    /* Advance ratchet */
+    struct GNUNET_CRYPTO_SymmetricSessionKey keys[3];
+    struct GNUNET_HashCode dh;
+    struct GNUNET_HashCode hmac;
+    static const char ctx[] = "axolotl ratchet";
+
+    GCAX_new_ephemeral (ax);
+    ax->HKs = ax->NHKs;
+
+    /* RK, NHKs, CKs = KDF( HMAC-HASH(RK, DH(DHRs, DHRr)) ) */
+    GNUNET_CRYPTO_ecc_ecdh (&ax->DHRs,
+                            &ax->DHRr,
+                            &dh);
+    t_ax_hmac_hash (&ax->RK,
+                    &hmac,
+                    &dh,
+                    sizeof (dh));
+    GNUNET_CRYPTO_kdf (keys, sizeof (keys),
+                       ctx, sizeof (ctx),
+                       &hmac, sizeof (hmac),
+                       NULL);
+    ax->RK = keys[0];
+    ax->NHKs = keys[1];
+    ax->CKs = keys[2];
+
+    ax->PNs = ax->Ns;
+    ax->Ns = 0;
+    ax->ratchet_flag = GNUNET_NO;
+    ax->ratchet_allowed = GNUNET_NO;
+    ax->ratchet_counter = 0;
+    ax->ratchet_expiration
+      = GNUNET_TIME_absolute_add (GNUNET_TIME_absolute_get(),
+                                  ratchet_time);
+  }
+
+  t_ax_chain_step (&ax->CKs,
+                   &MK);
+  GNUNET_CRYPTO_symmetric_derive_iv (&iv,
+                                     &MK,
+                                     NULL, 0,
+                                     NULL);
+
+  out_size = GNUNET_CRYPTO_symmetric_encrypt (src,
+                                              size,
+                                              &MK,
+                                              &iv,
+                                              dst);
+  GNUNET_assert (size == out_size);
+}
+
+
+/**
+ * Decrypt data with the axolotl tunnel key.
+ *
+ * @param ax key material to use.
+ * @param dst Destination for the decrypted data, must contain @a size bytes.
+ * @param src Source of the ciphertext. Can overlap with @c dst, must contain @a size bytes.
+ * @param size Size of the @a src and @a dst buffers
+ */
+static void
+t_ax_decrypt (struct CadetTunnelAxolotl *ax,
+              void *dst,
+              const void *src,
+              size_t size)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  size_t out_size;
+
+  t_ax_chain_step (&ax->CKr,
+                   &MK);
+  GNUNET_CRYPTO_symmetric_derive_iv (&iv,
+                                     &MK,
+                                     NULL, 0,
+                                     NULL);
+  GNUNET_assert (size >= sizeof (struct GNUNET_MessageHeader));
+  out_size = GNUNET_CRYPTO_symmetric_decrypt (src,
+                                              size,
+                                              &MK,
+                                              &iv,
+                                              dst);
+  GNUNET_assert (out_size == size);
+}
+
+
+/**
+ * Encrypt header with the axolotl header key.
+ *
+ * @param hk header key to use.
+ * @param[in|out] msg Message whose header to encrypt.
+ */
+static void
+t_h_encrypt (const struct CadetTunnelHeaderKey *hk,
+             struct GNUNET_CADET_TunnelEncryptedMessage *msg)
+{
+  size_t out_size;
+
+  out_size = GNUNET_CRYPTO_symmetric_encrypt (&msg->ax_header,
+                                              sizeof (struct GNUNET_CADET_AxHeader),
+                                              &hk->HK,
+                                              &hk->iv,
+                                              &msg->ax_header);
+  GNUNET_assert (sizeof (struct GNUNET_CADET_AxHeader) == out_size);
+}
+
+
+/**
+ * Encrypt a message with the axolotl tunnel keys: encrypt the
+ * payload, fill in and encrypt the header and compute the HMAC.
+ *
+ * @param ax key material to use
+ * @param[out] ax_msg message to fill in, followed by @a size bytes
+ *        for the encrypted payload
+ * @param payload the plaintext
+ * @param size number of bytes in @a payload
+ */
+void
+GCAX_encrypt (struct CadetTunnelAxolotl *ax,
+              struct GNUNET_CADET_TunnelEncryptedMessage *ax_msg,
+              const void *payload,
+              size_t size)
+{
+  const struct CadetTunnelHeaderKey *hk;
+
+  t_ax_encrypt (ax,
+                &ax_msg[1],
+                payload,
+                size);
+  ax_msg->ax_header.Ns = htonl (ax->Ns++);
+  ax_msg->ax_header.PNs = htonl (ax->PNs);
+  /* FIXME: we should do this once, not once per message;
+     this is a point multiplication, and DHRs does not
+     change all the time. */
+  GNUNET_CRYPTO_ecdhe_key_get_public (&ax->DHRs,
+                                      &ax_msg->ax_header.DHRs);
+  hk = get_header_key (&ax->HKs_cache,
+                       &ax->HKs);
+  t_h_encrypt (hk,
+               ax_msg);
+  t_hmac (&ax_msg->ax_header,
+          sizeof (struct GNUNET_CADET_AxHeader) + size,
+          hk,
+          &ax_msg->hmac);
+}
+
+
+/**
+ * Decrypt header with an axolotl header key.
+ *
+ * @param hk header key to use.
+ * @param src Message whose header to decrypt.
+ * @param dst Where to decrypt header to.
+ */
+static void
+t_h_decrypt (const struct CadetTunnelHeaderKey *hk,
+             const struct GNUNET_CADET_TunnelEncryptedMessage *src,
+             struct GNUNET_CADET_TunnelEncryptedMessage *dst)
+{
+  size_t out_size;
+
+  out_size = GNUNET_CRYPTO_symmetric_decrypt (&src->ax_header.Ns,
+                                              sizeof (struct GNUNET_CADET_AxHeader),
+                                              &hk->HK,
+                                              &hk->iv,
+                                              &dst->ax_header.Ns);
+  GNUNET_assert (sizeof (struct GNUNET_CADET_AxHeader) == out_size);
+}
+
+
+/**
+ * Check if the HMAC of @a src was computed with header key @a hk.
+ *
+ * @param hk header key to check
+ * @param src the message
+ * @param esize number of bytes of encrypted payload in @a src
+ * @return #GNUNET_YES if the HMAC matches
+ */
+static int
+check_hmac (const struct CadetTunnelHeaderKey *hk,
+            const struct GNUNET_CADET_TunnelEncryptedMessage *src,
+            size_t esize)
+{
+  struct GNUNET_ShortHashCode msg_hmac;
+
+  t_hmac (&src->ax_header,
+          sizeof (struct GNUNET_CADET_AxHeader) + esize,
+          hk,
+          &msg_hmac);
+  return (0 == memcmp (&msg_hmac,
+                       &src->hmac,
+                       sizeof (msg_hmac))) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Compute the key of a skipped message key in the
+ * @e skipped_index.
+ *
+ * @param hk header key of the message
+ * @param Kn number of the message
+ * @return index key
+ */
+static uint32_t
+skipped_key_hash (const struct CadetTunnelSkippedHeaderKey *hk,
+                  unsigned int Kn)
+{
+  uint32_t h;
+
+  GNUNET_memcpy (&h,
+                 &hk->key.HK,
+                 sizeof (h));
+  return h ^ (uint32_t) Kn;
+}
+
+
+/**
+ * Check if a skipped key from the index is the one we look for.
+ *
+ * @param cls the `struct SkippedKeyLookup`
+ * @param key index key
+ * @param value a `struct CadetTunnelSkippedKey`
+ * @return #GNUNET_NO if we found it, #GNUNET_YES to continue
+ */
+static int
+find_skipped_key_cb (void *cls,
+                     uint32_t key,
+                     void *value)
+{
+  struct SkippedKeyLookup *skl = cls;
+  struct CadetTunnelSkippedKey *sk = value;
+
+  if ( (sk->hk != skl->hk) ||
+       (sk->Kn != skl->Kn) )
+    return GNUNET_YES;
+  skl->key = sk;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Find the skipped key for message @a Kn under header key @a hk.
+ *
+ * @param ax key material to search
+ * @param hk header key of the message
+ * @param Kn number of the message
+ * @return NULL if we do not have the key
+ */
+static struct CadetTunnelSkippedKey *
+find_skipped_key (struct CadetTunnelAxolotl *ax,
+                  const struct CadetTunnelSkippedHeaderKey *hk,
+                  unsigned int Kn)
+{
+  struct SkippedKeyLookup skl;
+
+  if (NULL == ax->skipped_index)
+    return NULL;
+  skl.hk = hk;
+  skl.Kn = Kn;
+  skl.key = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (ax->skipped_index,
+                                                skipped_key_hash (hk,
+                                                                  Kn),
+                                                &find_skipped_key_cb,
+                                                &skl);
+  return skl.key;
+}
+
+
+/**
+ * Find the skipped header key entry for header key @a HK.
+ *
+ * @param ax key material to search
+ * @param HK header key to look for
+ * @return NULL if we have no skipped keys under @a HK
+ */
+static struct CadetTunnelSkippedHeaderKey *
+find_skipped_header_key (struct CadetTunnelAxolotl *ax,
+                         const struct GNUNET_CRYPTO_SymmetricSessionKey *HK)
+{
+  for (struct CadetTunnelSkippedHeaderKey *hk = ax->skipped_hk_head;
+       NULL != hk;
+       hk = hk->next)
+    if (0 == memcmp (&hk->key.HK,
+                     HK,
+                     sizeof (*HK)))
+      return hk;
+  return NULL;
+}
+
+
+/**
+ * Delete a key from the list of skipped keys.
+ *
+ * @param ax key material to delete @a key from.
+ * @param key Key to delete.
+ */
+static void
+delete_skipped_key (struct CadetTunnelAxolotl *ax,
+                    struct CadetTunnelSkippedKey *key)
+{
+  struct CadetTunnelSkippedHeaderKey *hk = key->hk;
+
+  GNUNET_CONTAINER_DLL_remove (ax->skipped_head,
+                               ax->skipped_tail,
+                               key);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap32_remove (ax->skipped_index,
+                                                         skipped_key_hash (hk,
+                                                                           key->Kn),
+                                                         key));
+  GNUNET_free (key);
+  ax->skipped--;
+  GNUNET_assert (hk->rc > 0);
+  if (0 != --hk->rc)
+    return;
+  GNUNET_CONTAINER_DLL_remove (ax->skipped_hk_head,
+                               ax->skipped_hk_tail,
+                               hk);
+  GNUNET_free (hk);
+}
+
+
+/**
+ * Decrypt the payload of @a src with a skipped key, which is then
+ * deleted.
+ *
+ * @param ax key material to use.
+ * @param hk header key the HMAC of @a src was computed with.
+ * @param Np message number from the decrypted header of @a src.
+ * @param dst Destination for the plaintext.
+ * @param src Source of the message. Can overlap with @c dst.
+ * @param size Size of the message.
+ * @return Size of the decrypted data, -1 if we have no key for @a Np.
+ */
+static ssize_t
+decrypt_with_skipped_key (struct CadetTunnelAxolotl *ax,
+                          const struct CadetTunnelSkippedHeaderKey *hk,
+                          uint32_t Np,
+                          void *dst,
+                          const struct GNUNET_CADET_TunnelEncryptedMessage *src,
+                          size_t size)
+{
+  struct CadetTunnelSkippedKey *key;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  size_t res;
+  size_t len;
+
+  /* Should've been checked in -cadet_connection.c handle_cadet_encrypted. */
+  GNUNET_assert (size > sizeof (struct GNUNET_CADET_TunnelEncryptedMessage));
+  len = size - sizeof (struct GNUNET_CADET_TunnelEncryptedMessage);
+  GNUNET_assert (len >= sizeof (struct GNUNET_MessageHeader));
+
+  /* Find the correct message key */
+  key = find_skipped_key (ax,
+                          hk,
+                          Np);
+  if (NULL == key)
+    return -1;
+
+  /* Decrypt payload */
+  GNUNET_CRYPTO_symmetric_derive_iv (&iv,
+                                     &key->MK,
+                                     NULL,
+                                     0,
+                                     NULL);
+  res = GNUNET_CRYPTO_symmetric_decrypt (&src[1],
+                                         len,
+                                         &key->MK,
+                                         &iv,
+                                         dst);
+  delete_skipped_key (ax,
+                      key);
+  return res;
+}
+
+
+/**
+ * Decrypt and verify data with the appropriate tunnel key and verify that the
+ * data has not been altered since it was sent by the remote peer.
+ *
+ * @param ax key material to use.
+ * @param dst Destination for the plaintext.
+ * @param src Source of the message. Can overlap with @c dst.
+ * @param size Size of the message.
+ * @return Size of the decrypted data, -1 if an error was encountered.
+ */
+static ssize_t
+try_old_ax_keys (struct CadetTunnelAxolotl *ax,
+                 void *dst,
+                 const struct GNUNET_CADET_TunnelEncryptedMessage *src,
+                 size_t size)
+{
+  struct CadetTunnelSkippedHeaderKey *hk;
+  struct GNUNET_CADET_TunnelEncryptedMessage plaintext_header;
+  size_t esize;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Trying skipped keys\n");
+  esize = size - sizeof (struct GNUNET_CADET_TunnelEncryptedMessage);
+
+  /* Find a correct Header Key */
+  for (hk = ax->skipped_hk_head; NULL != hk; hk = hk->next)
+    if (GNUNET_YES == check_hmac (&hk->key,
+                                  src,
+                                  esize))
+      break;
+  if (NULL == hk)
+    return -1;
+
+  /* Decrypt header */
+  t_h_decrypt (&hk->key,
+               src,
+               &plaintext_header);
+  return decrypt_with_skipped_key (ax,
+                                   hk,
+                                   ntohl (plaintext_header.ax_header.Ns),
+                                   dst,
+                                   src,
+                                   size);
+}
+
+
+/**
+ * Store the key of message @e Nr, which we skipped, and advance the
+ * receiving chain.
+ *
+ * @param ax key material to use.
+ * @param hk header key of the message.
+ */
+static void
+store_skipped_key (struct CadetTunnelAxolotl *ax,
+                   struct CadetTunnelSkippedHeaderKey *hk)
+{
+  struct CadetTunnelSkippedKey *key;
+
+  key = GNUNET_new (struct CadetTunnelSkippedKey);
+  key->timestamp = GNUNET_TIME_absolute_get ();
+  key->Kn = ax->Nr;
+  key->hk = hk;
+  hk->rc++;
+  t_ax_chain_step (&ax->CKr,
+                   &key->MK);
+  GNUNET_CONTAINER_DLL_insert (ax->skipped_head,
+                               ax->skipped_tail,
+                               key);
+  if (NULL == ax->skipped_index)
+    ax->skipped_index
+      = GNUNET_CONTAINER_multihashmap32_create (MAX_SKIPPED_KEYS);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (ax->skipped_index,
+                                                      skipped_key_hash (hk,
+                                                                        key->Kn),
+                                                      key,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  ax->skipped++;
+  ax->Nr++;
+}
+
+
+/**
+ * Stage skipped AX keys and calculate the message key.
+ * Stores each HK and MK for skipped messages.
+ *
+ * @param ax key material to use
+ * @param HKr Header key.
+ * @param Np Received meesage number.
+ * @return #GNUNET_OK if keys were stored.
+ *         #GNUNET_SYSERR if an error ocurred (@a Np not expected).
+ */
+static int
+store_ax_keys (struct CadetTunnelAxolotl *ax,
+               const struct CadetTunnelHeaderKey *HKr,
+               uint32_t Np)
+{
+  struct CadetTunnelSkippedHeaderKey *hk;
+  int gap;
+
+  gap = Np - ax->Nr;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Storing skipped keys [%u, %u)\n",
+       ax->Nr,
+       Np);
+  if (MAX_KEY_GAP < gap)
+  {
+    /* Avoid DoS (forcing peer to do more than #MAX_KEY_GAP HMAC operations) */
+    /* TODO: start new key exchange on return */
+    GNUNET_break_op (0);
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Got message %u, expected %u+\n",
+         Np,
+         ax->Nr);
+    return GNUNET_SYSERR;
+  }
+  if (0 > gap)
+  {
+    /* Delayed message: don't store keys, flag to try old keys. */
+    return GNUNET_SYSERR;
+  }
+  if (0 == gap)
+    return GNUNET_OK;
+
+  hk = find_skipped_header_key (ax,
+                                &HKr->HK);
+  if (NULL == hk)
+  {
+    hk = GNUNET_new (struct CadetTunnelSkippedHeaderKey);
+    hk->key = *HKr;
+    GNUNET_CONTAINER_DLL_insert (ax->skipped_hk_head,
+                                 ax->skipped_hk_tail,
+                                 hk);
+  }
+  while (ax->Nr < Np)
+    store_skipped_key (ax,
+                       hk);
+
+  while (ax->skipped > MAX_SKIPPED_KEYS)
+    delete_skipped_key (ax,
+                        ax->skipped_tail);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Decrypt and verify data with the appropriate tunnel key and verify that the
+ * data has not been altered since it was sent by the remote peer.
+ *
+ * @param ax key material to use
+ * @param dst Destination for the plaintext.
+ * @param src Source of the message. Can overlap with @c dst.
+ * @param size Size of the message.
+ * @return Size of the decrypted data, -1 if an error was encountered.
+ */
+ssize_t
+GCAX_decrypt_and_validate (struct CadetTunnelAxolotl *ax,
+                           void *dst,
+                           const struct GNUNET_CADET_TunnelEncryptedMessage *src,
+                           size_t size)
+{
+  struct GNUNET_HashCode hmac;
+  struct GNUNET_CADET_TunnelEncryptedMessage plaintext_header;
+  const struct CadetTunnelHeaderKey *hkr;
+  uint32_t Np;
+  uint32_t PNp;
+  size_t esize; /* Size of encryped payload */
+
+  esize = size - sizeof (struct GNUNET_CADET_TunnelEncryptedMessage);
+
+  /* Try current HK */
+  hkr = get_header_key (&ax->HKr_cache,
+                        &ax->HKr);
+  if (GNUNET_YES != check_hmac (hkr,
+                                src,
+                                esize))
+  {
+    static const char ctx[] = "axolotl ratchet";
+    struct GNUNET_CRYPTO_SymmetricSessionKey keys[3]; /* RKp, NHKp, CKp */
+    struct CadetTunnelHeaderKey HK;
+    struct GNUNET_HashCode dh;
+    struct GNUNET_CRYPTO_EcdhePublicKey *DHRp;
+
+    /* Try Next HK */
+    if (GNUNET_YES != check_hmac (get_header_key (&ax->NHKr_cache,
+                                                  &ax->NHKr),
+                                  src,
+                                  esize))
+    {
+      /* Try the skipped keys, if that fails, we're out of luck. */
+      return try_old_ax_keys (ax,
+                              dst,
+                              src,
+                              size);
+    }
+    HK = *hkr;
+    ax->HKr = ax->NHKr;
+    ax->HKr_cache = ax->NHKr_cache;
+    hkr = &ax->HKr_cache;
+    t_h_decrypt (hkr,
+                 src,
+                 &plaintext_header);
+    Np = ntohl (plaintext_header.ax_header.Ns);
+    PNp = ntohl (plaintext_header.ax_header.PNs);
+    DHRp = &plaintext_header.ax_header.DHRs;
+    store_ax_keys (ax,
+                   &HK,
+                   PNp);
+
+    /* RKp, NHKp, CKp = KDF (HMAC-HASH (RK, DH (DHRp, DHRs))) */
+    GNUNET_CRYPTO_ecc_ecdh (&ax->DHRs,
+                            DHRp,
+                            &dh);
+    t_ax_hmac_hash (&ax->RK,
+                    &hmac,
+                    &dh, sizeof (dh));
+    GNUNET_CRYPTO_kdf (keys, sizeof (keys),
+                       ctx, sizeof (ctx),
+                       &hmac, sizeof (hmac),
+                       NULL);
+
+    /* Commit "purported" keys */
+    ax->RK = keys[0];
+    ax->NHKr = keys[1];
+    ax->CKr = keys[2];
+    ax->DHRr = *DHRp;
+    ax->Nr = 0;
+    ax->ratchet_allowed = GNUNET_YES;
+  }
+  else
+  {
+    t_h_decrypt (hkr,
+                 src,
+                 &plaintext_header);
+    Np = ntohl (plaintext_header.ax_header.Ns);
+    PNp = ntohl (plaintext_header.ax_header.PNs);
+  }
+  if ( (Np != ax->Nr) &&
+       (GNUNET_OK != store_ax_keys (ax,
+                                    hkr,
+                                    Np)) )
+  {
+    struct CadetTunnelSkippedHeaderKey *hk;
+
+    /* Late message under the current HK: we already checked the
+       HMAC and decrypted the header, so just look up its key. */
+    hk = find_skipped_header_key (ax,
+                                  &ax->HKr);
+    if (NULL == hk)
+      return -1;
+    return decrypt_with_skipped_key (ax,
+                                     hk,
+                                     Np,
+                                     dst,
+                                     src,
+                                     size);
+  }
+
+  t_ax_decrypt (ax,
+                dst,
+                &src[1],
+                esize);
+  ax->Nr = Np + 1;
+  return esize;
+}
+
+
+/**
+ * Cleanup state used by @a ax.
+ *
+ * @param ax state to free, but not memory of @a ax itself
+ */
+void
+GCAX_cleanup (struct CadetTunnelAxolotl *ax)
+{
+  while (NULL != ax->skipped_head)
+    delete_skipped_key (ax,
+                        ax->skipped_head);
+  GNUNET_assert (0 == ax->skipped);
+  GNUNET_assert (NULL == ax->skipped_hk_head);
+  if (NULL != ax->skipped_index)
+  {
+    GNUNET_CONTAINER_multihashmap32_destroy (ax->skipped_index);
+    ax->skipped_index = NULL;
+  }
+  GNUNET_CRYPTO_ecdhe_key_clear (&ax->kx_0);
+  GNUNET_CRYPTO_ecdhe_key_clear (&ax->DHRs);
+}
+
+
+/* end of gnunet-service-cadet_axolotl.c */
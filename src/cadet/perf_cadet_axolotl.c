@@ -0,0 +1,242 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file cadet/perf_cadet_axolotl.c
+ * @brief measure how fast the tunnel encryption of CADET decrypts
+ *        messages that arrive in order and reordered
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "cadet_protocol.h"
+#include "gnunet-service-cadet_axolotl.h"
+#include <gauger.h>
+
+/**
+ * Number of messages we encrypt per measurement.
+ */
+#define NUM_MESSAGES 4096
+
+/**
+ * Number of bytes of payload per message.
+ */
+#define PAYLOAD_SIZE 1024
+
+/**
+ * After how many messages does the sender advance the ratchet?
+ */
+#define RATCHET_MESSAGES 256
+
+
+/**
+ * How many messages until the ratchet advances, used by the
+ * encryption code (normally from the configuration).
+ */
+unsigned long long ratchet_messages;
+
+/**
+ * How long until the ratchet advances, used by the encryption code
+ * (normally from the configuration).
+ */
+struct GNUNET_TIME_Relative ratchet_time;
+
+/**
+ * Encrypted messages.
+ */
+static struct GNUNET_CADET_TunnelEncryptedMessage *msgs[NUM_MESSAGES];
+
+/**
+ * Order in which we deliver the messages.
+ */
+static unsigned int order[NUM_MESSAGES];
+
+
+/**
+ * Initialize the key material of a tunnel between @a alice and
+ * @a bob as if the key exchange had just completed, with @a alice
+ * sending and @a bob receiving.
+ *
+ * @param[out] alice sender state
+ * @param[out] bob receiver state
+ */
+static void
+setup_keys (struct CadetTunnelAxolotl *alice,
+            struct CadetTunnelAxolotl *bob)
+{
+  memset (alice,
+          0,
+          sizeof (*alice));
+  memset (bob,
+          0,
+          sizeof (*bob));
+  GNUNET_CRYPTO_symmetric_create_session_key (&alice->RK);
+  GNUNET_CRYPTO_symmetric_create_session_key (&alice->HKs);
+  GNUNET_CRYPTO_symmetric_create_session_key (&alice->NHKs);
+  GNUNET_CRYPTO_symmetric_create_session_key (&alice->CKs);
+  bob->RK = alice->RK;
+  bob->HKr = alice->HKs;
+  bob->NHKr = alice->NHKs;
+  bob->CKr = alice->CKs;
+  GCAX_new_ephemeral (alice);
+  GCAX_new_ephemeral (bob);
+  GNUNET_CRYPTO_ecdhe_key_get_public (&bob->DHRs,
+                                      &alice->DHRr);
+  GNUNET_CRYPTO_ecdhe_key_get_public (&alice->DHRs,
+                                      &bob->DHRr);
+  alice->ratchet_expiration = GNUNET_TIME_UNIT_FOREVER_ABS;
+  bob->ratchet_expiration = GNUNET_TIME_UNIT_FOREVER_ABS;
+}
+
+
+/**
+ * Encrypt #NUM_MESSAGES messages from @a alice, advancing the ratchet
+ * every #RATCHET_MESSAGES messages as if @a alice kept receiving
+ * traffic from the other side.
+ *
+ * @param alice sender state
+ */
+static void
+encrypt_messages (struct CadetTunnelAxolotl *alice)
+{
+  char payload[PAYLOAD_SIZE];
+  struct GNUNET_MessageHeader *mh;
+
+  mh = (struct GNUNET_MessageHeader *) payload;
+  for (unsigned int i = 0; i < NUM_MESSAGES; i++)
+  {
+    memset (payload,
+            (int) i,
+            sizeof (payload));
+    mh->size = htons (sizeof (payload));
+    mh->type = htons (i);
+    msgs[i] = GNUNET_malloc (sizeof (struct GNUNET_CADET_TunnelEncryptedMessage)
+                             + sizeof (payload));
+    alice->ratchet_allowed = GNUNET_YES;
+    GCAX_encrypt (alice,
+                  msgs[i],
+                  payload,
+                  sizeof (payload));
+  }
+}
+
+
+/**
+ * Measure decryption with messages reordered within windows of
+ * @a window messages.
+ *
+ * @param window size of the windows, 1 for in-order delivery
+ * @return number of messages that failed to decrypt
+ */
+static unsigned int
+perf_decrypt (unsigned int window)
+{
+  struct CadetTunnelAxolotl alice;
+  struct CadetTunnelAxolotl bob;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  char plaintext[PAYLOAD_SIZE];
+  char expected[PAYLOAD_SIZE];
+  struct GNUNET_MessageHeader *mh;
+  unsigned int *perm;
+  unsigned int lost;
+  double rate;
+  char gauger_name[128];
+  ssize_t ret;
+
+  setup_keys (&alice,
+              &bob);
+  encrypt_messages (&alice);
+  for (unsigned int i = 0; i < NUM_MESSAGES; i += window)
+  {
+    perm = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_WEAK,
+                                         window);
+    for (unsigned int j = 0; j < window; j++)
+      order[i + j] = i + perm[j];
+    GNUNET_free (perm);
+  }
+  lost = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < NUM_MESSAGES; i++)
+  {
+    ret = GCAX_decrypt_and_validate (&bob,
+                                     plaintext,
+                                     msgs[order[i]],
+                                     sizeof (struct GNUNET_CADET_TunnelEncryptedMessage)
+                                     + PAYLOAD_SIZE);
+    if (PAYLOAD_SIZE != ret)
+    {
+      lost++;
+      continue;
+    }
+    memset (expected,
+            (int) order[i],
+            sizeof (expected));
+    mh = (struct GNUNET_MessageHeader *) expected;
+    mh->size = htons (sizeof (expected));
+    mh->type = htons (order[i]);
+    if (0 != memcmp (expected,
+                     plaintext,
+                     sizeof (plaintext)))
+    {
+      GNUNET_break (0);
+      lost++;
+    }
+  }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = NUM_MESSAGES * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  printf ("window %2u: %.0f messages/s, %u skipped keys left, %u lost\n",
+          window,
+          rate,
+          bob.skipped,
+          lost);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "Axolotl decryption, reordering window %u",
+                   window);
+  GAUGER ("CADET",
+          gauger_name,
+          rate,
+          "messages/s");
+  for (unsigned int i = 0; i < NUM_MESSAGES; i++)
+    GNUNET_free (msgs[i]);
+  GCAX_cleanup (&alice);
+  GCAX_cleanup (&bob);
+  return lost;
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  unsigned int lost;
+
+  GNUNET_log_setup ("perf-cadet-axolotl",
+                    "WARNING",
+                    NULL);
+  ratchet_messages = RATCHET_MESSAGES;
+  ratchet_time = GNUNET_TIME_UNIT_FOREVER_REL;
+  lost = 0;
+  lost += perf_decrypt (1);
+  lost += perf_decrypt (8);
+  lost += perf_decrypt (32);
+  return (0 == lost) ? 0 : 1;
+}
+
+/* end of perf_cadet_axolotl.c */
@@ -62,6 +62,16 @@ struct GSC_Client
    */
   struct GSC_Client *prev;
 
+  /**
+   * Clients with non-zero @e options are also kept in a linked list.
+   */
+  struct GSC_Client *next_opt;
+
+  /**
+   * Clients with non-zero @e options are also kept in a linked list.
+   */
+  struct GSC_Client *prev_opt;
+
   /**
    * Handle for the client with the server API.
    */
@@ -141,6 +151,56 @@ static struct GSC_Client *client_head;
  */
 static struct GSC_Client *client_tail;
 
+/**
+ * Head of linked list of our clients with non-zero options.
+ */
+static struct GSC_Client *opt_head;
+
+/**
+ * Tail of linked list of our clients with non-zero options.
+ */
+static struct GSC_Client *opt_tail;
+
+/**
+ * Map from message types to the clients (of type `struct GSC_Client`)
+ * that have a handler for them, so that we do not have to check every
+ * client for every message we deliver.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *type_subscribers;
+
+
+/**
+ * Closure for #deliver_to_subscriber().
+ */
+struct DeliverContext
+{
+  /**
+   * Peer who sent us the message.
+   */
+  const struct GNUNET_PeerIdentity *sender;
+
+  /**
+   * The message.
+   */
+  const struct GNUNET_MessageHeader *msg;
+
+  /**
+   * Envelope with the notification for the clients, created when
+   * the first client wants it and shared with all others.
+   */
+  struct GNUNET_MQ_Envelope *env;
+
+  /**
+   * Number of bytes of @e msg to transmit.
+   */
+  uint16_t msize;
+
+  /**
+   * Options for checking which clients should receive the message.
+   */
+  uint32_t options;
+};
+
 
 /**
  * Test if the client is interested in messages of the given type.
@@ -198,6 +258,12 @@ handle_client_init (void *cls,
   const uint16_t *types;
 
   /* check that we don't have an entry already */
+  if (GNUNET_YES == c->got_init)
+  {
+    GNUNET_break_op (0);
+    GNUNET_SERVICE_client_drop (c->client);
+    return;
+  }
   msize = ntohs (im->header.size) - sizeof (struct InitMessage);
   types = (const uint16_t *) &im[1];
   c->tcnt = msize / sizeof (uint16_t);
@@ -211,7 +277,22 @@ handle_client_init (void *cls,
                                                     NULL,
                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
   for (unsigned int i = 0; i < c->tcnt; i++)
+  {
     c->types[i] = ntohs (types[i]);
+    if (GNUNET_NO ==
+        GNUNET_CONTAINER_multihashmap32_contains_value (type_subscribers,
+                                                        c->types[i],
+                                                        c))
+      (void) GNUNET_CONTAINER_multihashmap32_put (type_subscribers,
+                                                  c->types[i],
+                                                  c,
+                                                  GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  }
+  if (0 != c->options)
+    GNUNET_CONTAINER_MDLL_insert (opt,
+                                  opt_head,
+                                  opt_tail,
+                                  c);
   GSC_TYPEMAP_add (c->types,
 		   c->tcnt);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -664,8 +745,17 @@ client_disconnect_cb (void *cls,
   }
   GNUNET_CONTAINER_multipeermap_destroy (c->connectmap);
   c->connectmap = NULL;
+  if (0 != c->options)
+    GNUNET_CONTAINER_MDLL_remove (opt,
+                                  opt_head,
+                                  opt_tail,
+                                  c);
   if (NULL != c->types)
   {
+    for (unsigned int i = 0; i < c->tcnt; i++)
+      (void) GNUNET_CONTAINER_multihashmap32_remove (type_subscribers,
+                                                     c->types[i],
+                                                     c);
     GSC_TYPEMAP_remove (c->types,
 			c->tcnt);
     GNUNET_free (c->types);
@@ -674,7 +764,7 @@ client_disconnect_cb (void *cls,
 
   /* recalculate 'all_client_options' */
   all_client_options = 0;
-  for (c = client_head; NULL != c ; c = c->next)
+  for (c = opt_head; NULL != c ; c = c->next_opt)
     all_client_options |= c->options;
 }
 
@@ -791,6 +881,119 @@ GSC_CLIENTS_notify_clients_about_neighbour (const struct GNUNET_PeerIdentity *ne
 }
 
 
+/**
+ * Queue the notification about a P2P message for a client, unless
+ * the client is too busy.
+ *
+ * @param dc details about the message
+ * @param c client to notify
+ * @param tm #GNUNET_YES if @a c has a handler for the message type
+ */
+static void
+deliver_to_client (struct DeliverContext *dc,
+                   struct GSC_Client *c,
+                   int tm)
+{
+  const struct GNUNET_MessageHeader *msg = dc->msg;
+  struct NotifyTrafficMessage *ntm;
+  uint16_t mtype;
+  unsigned int qlen;
+
+  /* Drop messages if:
+     1) We are above the hard limit, or
+     2) We are above the soft limit, and a coin toss limited
+        to the message size (giving larger messages a
+        proportionally higher chance of being queued) falls
+        below the threshold. The threshold is based on where
+        we are between the soft and the hard limit, scaled
+        to match the range of message sizes we usually encounter
+        (i.e. up to 32k); so a 64k message has a 50% chance of
+        being kept if we are just barely below the hard max,
+        and a 99% chance of being kept if we are at the soft max.
+     The reason is to make it more likely to drop control traffic
+     (ACK, queries) which may be cummulative or highly redundant,
+     and cheap to drop than data traffic.  */
+  qlen = GNUNET_MQ_get_length (c->mq);
+  if ( (qlen >= HARD_MAX_QUEUE) ||
+       ( (qlen > SOFT_MAX_QUEUE) &&
+         ( (GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                      ntohs (msg->size)) ) <
+           (qlen - SOFT_MAX_QUEUE) * 0x8000 /
+           (HARD_MAX_QUEUE - SOFT_MAX_QUEUE) ) ) )
+  {
+    char buf[1024];
+
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
+                "Dropping decrypted message of type %u as client is too busy (queue full)\n",
+                (unsigned int) ntohs (msg->type));
+    GNUNET_snprintf (buf,
+                     sizeof (buf),
+                     gettext_noop ("# messages of type %u discarded (client busy)"),
+                     (unsigned int) ntohs (msg->type));
+    GNUNET_STATISTICS_update (GSC_stats,
+                              buf,
+                              1,
+                              GNUNET_NO);
+    return;
+  }
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sending %u message with %u bytes to client interested in messages of type %u.\n",
+              dc->options,
+              ntohs (msg->size),
+              (unsigned int) ntohs (msg->type));
+
+  if (NULL == dc->env)
+  {
+    /* first client that wants the message, build the notification
+       once; all clients get the same message */
+    if (0 != (dc->options & (GNUNET_CORE_OPTION_SEND_FULL_INBOUND | GNUNET_CORE_OPTION_SEND_HDR_INBOUND)))
+      mtype = GNUNET_MESSAGE_TYPE_CORE_NOTIFY_INBOUND;
+    else
+      mtype = GNUNET_MESSAGE_TYPE_CORE_NOTIFY_OUTBOUND;
+    dc->env = GNUNET_MQ_msg_extra (ntm,
+                                   dc->msize,
+                                   mtype);
+    ntm->peer = *dc->sender;
+    GNUNET_memcpy (&ntm[1],
+                   msg,
+                   dc->msize);
+  }
+  GNUNET_assert ( (0 == (c->options & GNUNET_CORE_OPTION_SEND_FULL_INBOUND)) ||
+                  (GNUNET_YES != tm) ||
+                  (GNUNET_YES ==
+                   GNUNET_CONTAINER_multipeermap_contains (c->connectmap,
+                                                           dc->sender)) );
+  GNUNET_MQ_send (c->mq,
+                  GNUNET_MQ_env_share (dc->env));
+}
+
+
+/**
+ * Deliver P2P message to a client that has a handler for its type.
+ *
+ * @param cls the `struct DeliverContext`
+ * @param key the message type
+ * @param value the `struct GSC_Client`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+deliver_to_subscriber (void *cls,
+                       uint32_t key,
+                       void *value)
+{
+  struct DeliverContext *dc = cls;
+  struct GSC_Client *c = value;
+
+  if (0 != c->options)
+    return GNUNET_OK; /* already handled with the clients with options */
+  deliver_to_client (dc,
+                     c,
+                     GNUNET_YES);
+  return GNUNET_OK;
+}
+
+
 /**
  * Deliver P2P message to interested clients.  Caller must have checked
  * that the sending peer actually lists the given message type as one
@@ -809,6 +1012,7 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
                              uint32_t options)
 {
   size_t size = msize + sizeof (struct NotifyTrafficMessage);
+  struct DeliverContext dc;
 
   if (size >= GNUNET_MAX_MESSAGE_SIZE)
   {
@@ -824,13 +1028,15 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
               (unsigned int) ntohs (msg->type));
   GSC_SESSIONS_add_to_typemap (sender,
 			       ntohs (msg->type));
-
-  for (struct GSC_Client *c = client_head; NULL != c; c = c->next)
+  dc.sender = sender;
+  dc.msg = msg;
+  dc.env = NULL;
+  dc.msize = msize;
+  dc.options = options;
+  /* Clients with options may want the message regardless of its
+     type, check them individually. */
+  for (struct GSC_Client *c = opt_head; NULL != c; c = c->next_opt)
   {
-    struct GNUNET_MQ_Envelope *env;
-    struct NotifyTrafficMessage *ntm;
-    uint16_t mtype;
-    unsigned int qlen;
     int tm;
 
     tm = type_match (ntohs (msg->type),
@@ -846,71 +1052,19 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
     if ( (0 != (options & GNUNET_CORE_OPTION_SEND_HDR_OUTBOUND)) &&
 	 (0 != (c->options & GNUNET_CORE_OPTION_SEND_FULL_OUTBOUND)) )
       continue;
-
-    /* Drop messages if:
-       1) We are above the hard limit, or
-       2) We are above the soft limit, and a coin toss limited
-          to the message size (giving larger messages a
-          proportionally higher chance of being queued) falls
-          below the threshold. The threshold is based on where
-          we are between the soft and the hard limit, scaled
-          to match the range of message sizes we usually encounter
-          (i.e. up to 32k); so a 64k message has a 50% chance of
-          being kept if we are just barely below the hard max,
-          and a 99% chance of being kept if we are at the soft max.
-       The reason is to make it more likely to drop control traffic
-       (ACK, queries) which may be cummulative or highly redundant,
-       and cheap to drop than data traffic.  */
-    qlen = GNUNET_MQ_get_length (c->mq);
-    if ( (qlen >= HARD_MAX_QUEUE) ||
-         ( (qlen > SOFT_MAX_QUEUE) &&
-           ( (GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-                                        ntohs (msg->size)) ) <
-             (qlen - SOFT_MAX_QUEUE) * 0x8000 /
-             (HARD_MAX_QUEUE - SOFT_MAX_QUEUE) ) ) )
-    {
-      char buf[1024];
-
-      GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
-                  "Dropping decrypted message of type %u as client is too busy (queue full)\n",
-                  (unsigned int) ntohs (msg->type));
-      GNUNET_snprintf (buf,
-                       sizeof (buf),
-                       gettext_noop ("# messages of type %u discarded (client busy)"),
-                       (unsigned int) ntohs (msg->type));
-      GNUNET_STATISTICS_update (GSC_stats,
-                                buf,
-                                1,
-                                GNUNET_NO);
-      continue;
-    }
-
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Sending %u message with %u bytes to client interested in messages of type %u.\n",
-		options,
-		ntohs (msg->size),
-                (unsigned int) ntohs (msg->type));
-
-    if (0 != (options & (GNUNET_CORE_OPTION_SEND_FULL_INBOUND | GNUNET_CORE_OPTION_SEND_HDR_INBOUND)))
-      mtype = GNUNET_MESSAGE_TYPE_CORE_NOTIFY_INBOUND;
-    else
-      mtype = GNUNET_MESSAGE_TYPE_CORE_NOTIFY_OUTBOUND;
-    env = GNUNET_MQ_msg_extra (ntm,
-			       msize,
-			       mtype);
-    ntm->peer = *sender;
-    GNUNET_memcpy (&ntm[1],
-		   msg,
-		   msize);
-
-    GNUNET_assert ( (0 == (c->options & GNUNET_CORE_OPTION_SEND_FULL_INBOUND)) ||
-		    (GNUNET_YES != tm) ||
-		    (GNUNET_YES ==
-		     GNUNET_CONTAINER_multipeermap_contains (c->connectmap,
-							     sender)) );
-    GNUNET_MQ_send (c->mq,
-		    env);
+    deliver_to_client (&dc,
+                       c,
+                       tm);
   }
+  /* All other clients only get full inbound messages of the types
+     they have handlers for. */
+  if (0 != (options & GNUNET_CORE_OPTION_SEND_FULL_INBOUND))
+    GNUNET_CONTAINER_multihashmap32_get_multiple (type_subscribers,
+                                                  ntohs (msg->type),
+                                                  &deliver_to_subscriber,
+                                                  &dc);
+  if (NULL != dc.env)
+    GNUNET_MQ_discard (dc.env);
 }
 
 
@@ -932,6 +1086,11 @@ shutdown_task (void *cls)
   GSC_SESSIONS_done ();
   GSC_KX_done ();
   GSC_TYPEMAP_done ();
+  if (NULL != type_subscribers)
+  {
+    GNUNET_CONTAINER_multihashmap32_destroy (type_subscribers);
+    type_subscribers = NULL;
+  }
   if (NULL != GSC_stats)
   {
     GNUNET_STATISTICS_destroy (GSC_stats,
@@ -978,6 +1137,7 @@ run (void *cls,
   char *keyfile;
 
   GSC_cfg = c;
+  type_subscribers = GNUNET_CONTAINER_multihashmap32_create (128);
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_filename (GSC_cfg,
 					       "PEER",
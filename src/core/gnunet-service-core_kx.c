@@ -289,6 +289,16 @@ struct GSC_KeyExchangeInfo
    */
   struct GNUNET_CRYPTO_SymmetricSessionKey decrypt_key;
 
+  /**
+   * Keyed cipher context for @e encrypt_key, NULL if not yet needed.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *encrypt_ctx;
+
+  /**
+   * Keyed cipher context for @e decrypt_key, NULL if not yet needed.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *decrypt_ctx;
+
   /**
    * At what time did the other peer generate the decryption key?
    */
@@ -533,6 +543,28 @@ derive_aes_key (const struct GNUNET_PeerIdentity *sender,
 }
 
 
+/**
+ * Release the keyed cipher contexts of @a kx, they will be
+ * re-created from the current session keys when needed.
+ *
+ * @param kx session to release cipher contexts of
+ */
+static void
+release_cipher_contexts (struct GSC_KeyExchangeInfo *kx)
+{
+  if (NULL != kx->encrypt_ctx)
+  {
+    GNUNET_CRYPTO_symmetric_context_destroy (kx->encrypt_ctx);
+    kx->encrypt_ctx = NULL;
+  }
+  if (NULL != kx->decrypt_ctx)
+  {
+    GNUNET_CRYPTO_symmetric_context_destroy (kx->decrypt_ctx);
+    kx->decrypt_ctx = NULL;
+  }
+}
+
+
 /**
  * Encrypt size bytes from @a in and write the result to @a out.  Use the
  * @a kx key for outbound traffic of the given neighbour.
@@ -556,12 +588,14 @@ do_encrypt (struct GSC_KeyExchangeInfo *kx,
     GNUNET_break (0);
     return GNUNET_NO;
   }
+  if (NULL == kx->encrypt_ctx)
+    kx->encrypt_ctx = GNUNET_CRYPTO_symmetric_context_create (&kx->encrypt_key);
   GNUNET_assert (size ==
-                 GNUNET_CRYPTO_symmetric_encrypt (in,
-						  (uint16_t) size,
-						  &kx->encrypt_key,
-						  iv,
-						  out));
+                 GNUNET_CRYPTO_symmetric_context_encrypt (kx->encrypt_ctx,
+                                                          in,
+                                                          (uint16_t) size,
+                                                          iv,
+                                                          out));
   GNUNET_STATISTICS_update (GSC_stats,
 			    gettext_noop ("# bytes encrypted"),
 			    size,
@@ -612,12 +646,14 @@ do_decrypt (struct GSC_KeyExchangeInfo *kx,
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
   }
+  if (NULL == kx->decrypt_ctx)
+    kx->decrypt_ctx = GNUNET_CRYPTO_symmetric_context_create (&kx->decrypt_key);
   if (size !=
-      GNUNET_CRYPTO_symmetric_decrypt (in,
-                                       (uint16_t) size,
-                                       &kx->decrypt_key,
-                                       iv,
-                                       out))
+      GNUNET_CRYPTO_symmetric_context_decrypt (kx->decrypt_ctx,
+                                               in,
+                                               (uint16_t) size,
+                                               iv,
+                                               out))
   {
     GNUNET_break (0);
     return GNUNET_SYSERR;
@@ -856,6 +892,7 @@ handle_transport_notify_disconnect (void *cls,
 			       kx_tail,
 			       kx);
   GNUNET_MST_destroy (kx->mst);
+  release_cipher_contexts (kx);
   GNUNET_free (kx);
 }
 
@@ -898,6 +935,7 @@ derive_session_keys (struct GSC_KeyExchangeInfo *kx)
     GNUNET_break (0);
     return;
   }
+  release_cipher_contexts (kx);
   derive_aes_key (&GSC_my_identity,
 		  kx->peer,
 		  &key_material,
@@ -0,0 +1,411 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file core/perf_core_api_fanout.c
+ * @brief measure how fast CORE passes messages of mixed types to
+ *        many clients with handlers for some of the types
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_testing_lib.h"
+#include "gnunet_core_service.h"
+#include <gauger.h>
+
+/**
+ * Number of CORE clients.
+ */
+#define NUM_CLIENTS 20
+
+/**
+ * Number of different message types we send.
+ */
+#define NUM_TYPES 8
+
+/**
+ * First message type we use (types up to `PERF_TYPE + NUM_TYPES - 1`
+ * are not used by GNUnet).
+ */
+#define PERF_TYPE 60000
+
+/**
+ * Number of messages we send.
+ */
+#define NUM_MESSAGES 10000
+
+/**
+ * Number of messages we allow to be in flight, small enough to
+ * never make CORE drop messages for busy clients.
+ */
+#define WINDOW 32
+
+/**
+ * Number of bytes of payload per message.
+ */
+#define PAYLOAD_SIZE 1024
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Message we send to ourselves.
+ */
+struct PerfMessage
+{
+  /**
+   * Type: PERF_TYPE + x
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Sequence number of the message.
+   */
+  uint32_t seq GNUNET_PACKED;
+
+  /**
+   * Payload.
+   */
+  char payload[PAYLOAD_SIZE];
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * A CORE client.
+ */
+struct Client
+{
+  /**
+   * Handle to CORE.
+   */
+  struct GNUNET_CORE_Handle *core;
+
+  /**
+   * Queue for sending messages to ourselves.
+   */
+  struct GNUNET_MQ_Handle *mq;
+};
+
+
+/**
+ * Our clients.
+ */
+static struct Client clients[NUM_CLIENTS];
+
+/**
+ * Number of clients with a handler for each type.
+ */
+static unsigned int subscribers[NUM_TYPES];
+
+/**
+ * Number of clients that received each message.
+ */
+static unsigned int received[NUM_MESSAGES];
+
+/**
+ * Our identity.
+ */
+static struct GNUNET_PeerIdentity myself;
+
+/**
+ * Number of clients connected to ourselves.
+ */
+static unsigned int ready;
+
+/**
+ * Number of messages sent.
+ */
+static unsigned int sent;
+
+/**
+ * Number of messages received by all their subscribers.
+ */
+static unsigned int completed;
+
+/**
+ * Number of messages received by clients.
+ */
+static unsigned long long deliveries;
+
+/**
+ * When did we start to send?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Handle to the timeout task.
+ */
+static struct GNUNET_SCHEDULER_Task *die_task;
+
+/**
+ * Final status code.
+ */
+static int ret;
+
+
+/**
+ * Does client @a c have a handler for type `PERF_TYPE + t`?  Every
+ * client handles two types, so that each type has a different set
+ * of subscribers.
+ *
+ * @param c index of the client
+ * @param t index of the type
+ * @return #GNUNET_YES if so
+ */
+static int
+subscribes (unsigned int c,
+            unsigned int t)
+{
+  return ( (t == c % NUM_TYPES) ||
+           (t == (3 * c + 1) % NUM_TYPES) ) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Clean up.
+ *
+ * @param cls NULL
+ */
+static void
+cleanup (void *cls)
+{
+  if (NULL != die_task)
+  {
+    GNUNET_SCHEDULER_cancel (die_task);
+    die_task = NULL;
+  }
+  for (unsigned int i = 0; i < NUM_CLIENTS; i++)
+  {
+    if (NULL != clients[i].core)
+    {
+      GNUNET_CORE_disconnect (clients[i].core);
+      clients[i].core = NULL;
+    }
+  }
+}
+
+
+/**
+ * We took too long.
+ *
+ * @param cls NULL
+ */
+static void
+do_timeout (void *cls)
+{
+  die_task = NULL;
+  fprintf (stderr,
+           "Timeout after %u messages sent, %u completed\n",
+           sent,
+           completed);
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Send messages to ourselves until the window is full.
+ */
+static void
+send_messages ()
+{
+  struct GNUNET_MQ_Envelope *env;
+  struct PerfMessage *pm;
+
+  while ( (sent < NUM_MESSAGES) &&
+          (sent - completed < WINDOW) )
+  {
+    env = GNUNET_MQ_msg (pm,
+                         PERF_TYPE + sent % NUM_TYPES);
+    pm->seq = htonl (sent);
+    memset (pm->payload,
+            (int) sent,
+            sizeof (pm->payload));
+    GNUNET_MQ_send (clients[0].mq,
+                    env);
+    sent++;
+  }
+}
+
+
+/**
+ * All messages were received, report.
+ */
+static void
+finish ()
+{
+  struct GNUNET_TIME_Relative duration;
+  double msgs;
+  double dels;
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  msgs = NUM_MESSAGES * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  dels = deliveries * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  printf ("%u clients, %u types: %.0f messages/s, %.0f deliveries/s\n",
+          NUM_CLIENTS,
+          NUM_TYPES,
+          msgs,
+          dels);
+  GAUGER ("CORE",
+          "Fan-out to 20 clients",
+          dels,
+          "deliveries/s");
+  ret = 0;
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Handle a message we sent to ourselves.
+ *
+ * @param cls the `struct Client` that received the message
+ * @param pm the message
+ */
+static void
+handle_perf (void *cls,
+             const struct PerfMessage *pm)
+{
+  uint32_t seq = ntohl (pm->seq);
+
+  if (seq >= NUM_MESSAGES)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  deliveries++;
+  if (++received[seq] < subscribers[seq % NUM_TYPES])
+    return;
+  completed++;
+  if (NUM_MESSAGES == completed)
+  {
+    finish ();
+    return;
+  }
+  send_messages ();
+}
+
+
+/**
+ * A client connected to a peer.  Once all clients are connected to
+ * ourselves, start sending.
+ *
+ * @param cls the `struct Client`
+ * @param peer the peer
+ * @param mq queue for sending to @a peer
+ * @return NULL
+ */
+static void *
+connect_cb (void *cls,
+            const struct GNUNET_PeerIdentity *peer,
+            struct GNUNET_MQ_Handle *mq)
+{
+  struct Client *c = cls;
+
+  if (0 != memcmp (peer,
+                   &myself,
+                   sizeof (struct GNUNET_PeerIdentity)))
+    return NULL;
+  c->mq = mq;
+  if (NUM_CLIENTS != ++ready)
+    return NULL;
+  start = GNUNET_TIME_absolute_get ();
+  send_messages ();
+  return NULL;
+}
+
+
+/**
+ * Connection to CORE is up.
+ *
+ * @param cls the `struct Client`
+ * @param my_identity our identity
+ */
+static void
+init_cb (void *cls,
+         const struct GNUNET_PeerIdentity *my_identity)
+{
+  if (NULL == my_identity)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  myself = *my_identity;
+}
+
+
+/**
+ * Connect the clients to CORE.
+ *
+ * @param cls NULL
+ * @param cfg configuration
+ * @param peer the peer
+ */
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *cfg,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  GNUNET_SCHEDULER_add_shutdown (&cleanup,
+                                 NULL);
+  die_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES,
+                                                                          5),
+                                           &do_timeout,
+                                           NULL);
+  for (unsigned int i = 0; i < NUM_CLIENTS; i++)
+  {
+    struct GNUNET_MQ_MessageHandler handlers[NUM_TYPES + 1];
+    unsigned int off;
+
+    off = 0;
+    for (unsigned int t = 0; t < NUM_TYPES; t++)
+    {
+      if (GNUNET_YES != subscribes (i,
+                                    t))
+        continue;
+      subscribers[t]++;
+      handlers[off++] = GNUNET_MQ_hd_fixed_size (perf,
+                                                 PERF_TYPE + t,
+                                                 struct PerfMessage,
+                                                 &clients[i]);
+    }
+    handlers[off] = (struct GNUNET_MQ_MessageHandler) GNUNET_MQ_handler_end ();
+    clients[i].core = GNUNET_CORE_connect (cfg,
+                                           &clients[i],
+                                           &init_cb,
+                                           &connect_cb,
+                                           NULL,
+                                           handlers);
+  }
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  ret = 1;
+  if (0 != GNUNET_TESTING_peer_run ("perf-core-api-fanout",
+                                    "test_core_api_peer1.conf",
+                                    &run,
+                                    NULL))
+    return 1;
+  return ret;
+}
+
+/* end of perf_core_api_fanout.c */
@@ -33,6 +33,31 @@
 
 #define ITERATIONS 10000
 
+/**
+ * Number of keys with many values.
+ */
+#define HOT_KEYS 2
+
+/**
+ * Number of values per key with many values.
+ */
+#define HOT_VALUES 1000
+
+/**
+ * Number of GETs per key with many values.
+ */
+#define HOT_GETS 100
+
+/**
+ * Number of queries for values close to random keys.
+ */
+#define CLOSEST_GETS 1000
+
+/**
+ * Number of results we ask for per query for close values.
+ */
+#define CLOSEST_RESULTS 8
+
 static int ok;
 
 static unsigned int found;
@@ -57,6 +82,202 @@ checkIt (void *cls,
 }
 
 
+/**
+ * Count a result for a key with many values.
+ *
+ * @param cls pointer to the `unsigned int` to increment
+ * @return #GNUNET_OK to continue
+ */
+static int
+count_result (void *cls,
+              const struct GNUNET_HashCode *key,
+              size_t size,
+              const char *data,
+              enum GNUNET_BLOCK_Type type,
+              struct GNUNET_TIME_Absolute exp,
+              unsigned int path_len,
+              const struct GNUNET_PeerIdentity *path)
+{
+  unsigned int *cnt = cls;
+
+  (*cnt)++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Take the first result for a key with many values.
+ *
+ * @param cls pointer to the `unsigned int` to increment
+ * @return #GNUNET_NO to stop
+ */
+static int
+first_result (void *cls,
+              const struct GNUNET_HashCode *key,
+              size_t size,
+              const char *data,
+              enum GNUNET_BLOCK_Type type,
+              struct GNUNET_TIME_Absolute exp,
+              unsigned int path_len,
+              const struct GNUNET_PeerIdentity *path)
+{
+  unsigned int *cnt = cls;
+
+  (*cnt)++;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Measure GETs on keys with #HOT_VALUES values each.
+ *
+ * @param h datacache to use
+ * @param gstr name for GAUGER
+ * @return #GNUNET_OK on success
+ */
+static int
+run_hot_keys (struct GNUNET_DATACACHE_Handle *h,
+              const char *gstr)
+{
+  struct GNUNET_HashCode keys[HOT_KEYS];
+  struct GNUNET_HashCode n;
+  struct GNUNET_TIME_Absolute exp;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  unsigned int cnt;
+  double rate;
+
+  /* expire after the values of the first phase, so that the
+     quota makes room by discarding those */
+  exp = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_DAYS);
+  for (unsigned int k = 0; k < HOT_KEYS; k++)
+  {
+    GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_WEAK,
+                                      &keys[k]);
+    for (unsigned int i = 0; i < HOT_VALUES; i++)
+    {
+      GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_WEAK,
+                                        &n);
+      if (GNUNET_OK !=
+          GNUNET_DATACACHE_put (h,
+                                &keys[k],
+                                sizeof (n),
+                                (const char *) &n,
+                                GNUNET_BLOCK_TYPE_TEST,
+                                exp,
+                                0,
+                                NULL))
+        return GNUNET_SYSERR;
+    }
+  }
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < HOT_GETS; i++)
+    for (unsigned int k = 0; k < HOT_KEYS; k++)
+    {
+      cnt = 0;
+      GNUNET_DATACACHE_get (h,
+                            &keys[k],
+                            GNUNET_BLOCK_TYPE_TEST,
+                            &count_result,
+                            &cnt);
+      if (HOT_VALUES != cnt)
+      {
+        FPRINTF (stderr,
+                 "Found %u/%u values for key with many values\n",
+                 cnt,
+                 HOT_VALUES);
+        return GNUNET_SYSERR;
+      }
+    }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = HOT_GETS * HOT_KEYS * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  FPRINTF (stdout,
+           "%.0f GETs/s for all of %u values per key\n",
+           rate,
+           HOT_VALUES);
+  GAUGER (gstr, "GETs for all of 1000 values per key",
+          rate,
+          "GETs/s");
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < HOT_GETS; i++)
+    for (unsigned int k = 0; k < HOT_KEYS; k++)
+    {
+      cnt = 0;
+      GNUNET_DATACACHE_get (h,
+                            &keys[k],
+                            GNUNET_BLOCK_TYPE_TEST,
+                            &first_result,
+                            &cnt);
+      if (1 != cnt)
+        return GNUNET_SYSERR;
+    }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = HOT_GETS * HOT_KEYS * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  FPRINTF (stdout,
+           "%.0f GETs/s for one of %u values per key\n",
+           rate,
+           HOT_VALUES);
+  GAUGER (gstr, "GETs for one of 1000 values per key",
+          rate,
+          "GETs/s");
+  return GNUNET_OK;
+}
+
+
+/**
+ * Measure queries for the values closest to random keys, as
+ * used by the DHT to find values for peers it connects to.
+ *
+ * @param h datacache to use
+ * @param gstr name for GAUGER
+ * @return #GNUNET_OK on success
+ */
+static int
+run_closest (struct GNUNET_DATACACHE_Handle *h,
+             const char *gstr)
+{
+  struct GNUNET_HashCode key;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  unsigned int cnt;
+  unsigned int total;
+  double rate;
+
+  total = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < CLOSEST_GETS; i++)
+  {
+    GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_WEAK,
+                                      &key);
+    cnt = 0;
+    if (GNUNET_DATACACHE_get_closest (h,
+                                      &key,
+                                      CLOSEST_RESULTS,
+                                      &count_result,
+                                      &cnt) != cnt)
+      return GNUNET_SYSERR;
+    if (cnt > CLOSEST_RESULTS)
+      return GNUNET_SYSERR;
+    total += cnt;
+  }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  /* the cache holds thousands of values, so all but the queries
+     for keys above the largest keys must find some */
+  if (0 == total)
+    return GNUNET_SYSERR;
+  rate = CLOSEST_GETS * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  FPRINTF (stdout,
+           "%.0f closest GETs/s for %u values (%u found)\n",
+           rate,
+           CLOSEST_RESULTS,
+           total);
+  GAUGER (gstr, "Closest GETs for 8 values",
+          rate,
+          "GETs/s");
+  return GNUNET_OK;
+}
+
+
 static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
@@ -119,6 +340,10 @@ run (void *cls, char *const *args, const char *cfgfile,
     GAUGER (gstr, "Time to GET item from datacache",
             GNUNET_TIME_absolute_get_duration (start).rel_value_us / 1000LL / found,
             "ms/item");
+  ASSERT (GNUNET_OK == run_hot_keys (h,
+                                     gstr));
+  ASSERT (GNUNET_OK == run_closest (h,
+                                    gstr));
   GNUNET_DATACACHE_destroy (h);
   ASSERT (ok == 0);
   return;
@@ -31,6 +31,15 @@
 
 #define LOG_STRERROR_FILE(kind,op,fn) GNUNET_log_from_strerror_file (kind, "datacache-heap", op, fn)
 
+/**
+ * Maximum number of levels of the skip list that orders the values
+ * by key.  With a branching factor of 4, this suffices for 4^16
+ * values.
+ */
+#define MAX_LEVELS 16
+
+
+struct Value;
 
 
 /**
@@ -53,6 +62,17 @@ struct Plugin
    */
   struct GNUNET_CONTAINER_Heap *heap;
 
+  /**
+   * Heads of the levels of the skip list with all values ordered by
+   * key (for #heap_plugin_get_closest()).
+   */
+  struct Value *skip_head[MAX_LEVELS];
+
+  /**
+   * Number of levels currently used in the skip list.
+   */
+  unsigned int skip_levels;
+
 };
 
 
@@ -81,11 +101,22 @@ struct Value
    */
   struct GNUNET_PeerIdentity *path_info;
 
+  /**
+   * Successors of this value in the levels of the skip list,
+   * array of length @e skip_levels.
+   */
+  struct Value **skip_next;
+
   /**
    * Payload (actual payload follows this struct)
    */
   size_t size;
 
+  /**
+   * Number of levels of the skip list this value is in.
+   */
+  unsigned int skip_levels;
+
   /**
    * Number of entries in @e path_info.
    */
@@ -102,6 +133,150 @@ struct Value
 #define OVERHEAD (sizeof (struct Value) + 64)
 
 
+/**
+ * Check if @a val comes before the position given by @a key and
+ * @a ref in the skip list.  Values are ordered by key (in the same
+ * order as the SQL backends order their BLOBs) and values with the
+ * same key by their address.
+ *
+ * @param val value in the skip list
+ * @param key key of the position
+ * @param ref value at the position, NULL for the first position
+ *        with @a key
+ * @return #GNUNET_YES if @a val comes before the position
+ */
+static int
+skip_before (const struct Value *val,
+             const struct GNUNET_HashCode *key,
+             const struct Value *ref)
+{
+  int cmp;
+
+  cmp = memcmp (&val->key,
+                key,
+                sizeof (struct GNUNET_HashCode));
+  if (0 != cmp)
+    return (cmp < 0) ? GNUNET_YES : GNUNET_NO;
+  return ((uintptr_t) val < (uintptr_t) ref) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Find, on each level of the skip list, the successor pointer that
+ * leads to the first value at or after the given position.
+ *
+ * @param plugin the plugin
+ * @param key key of the position
+ * @param ref value at the position, NULL for the first position
+ *        with @a key
+ * @param[out] update set to the successor pointers, one per level
+ */
+static void
+skip_find (struct Plugin *plugin,
+           const struct GNUNET_HashCode *key,
+           const struct Value *ref,
+           struct Value ***update)
+{
+  struct Value **next;
+
+  next = plugin->skip_head;
+  for (unsigned int level = plugin->skip_levels; level > 0; level--)
+  {
+    while ( (NULL != next[level - 1]) &&
+            (GNUNET_YES == skip_before (next[level - 1],
+                                        key,
+                                        ref)) )
+      next = next[level - 1]->skip_next;
+    update[level - 1] = &next[level - 1];
+  }
+}
+
+
+/**
+ * Add a value to the skip list.
+ *
+ * @param plugin the plugin
+ * @param val value to add
+ */
+static void
+skip_insert (struct Plugin *plugin,
+             struct Value *val)
+{
+  struct Value **update[MAX_LEVELS];
+  uint32_t r;
+  unsigned int levels;
+
+  /* each level has a quarter of the values of the level below */
+  r = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                UINT32_MAX);
+  levels = 1;
+  while ( (levels < MAX_LEVELS) &&
+          (0 == (r & 3)) )
+  {
+    levels++;
+    r >>= 2;
+  }
+  while (plugin->skip_levels < levels)
+    plugin->skip_head[plugin->skip_levels++] = NULL;
+  skip_find (plugin,
+             &val->key,
+             val,
+             update);
+  val->skip_levels = levels;
+  val->skip_next = GNUNET_new_array (levels,
+                                     struct Value *);
+  for (unsigned int i = 0; i < levels; i++)
+  {
+    val->skip_next[i] = *update[i];
+    *update[i] = val;
+  }
+}
+
+
+/**
+ * Remove a value from the skip list.
+ *
+ * @param plugin the plugin
+ * @param val value to remove
+ */
+static void
+skip_remove (struct Plugin *plugin,
+             struct Value *val)
+{
+  struct Value **update[MAX_LEVELS];
+
+  skip_find (plugin,
+             &val->key,
+             val,
+             update);
+  for (unsigned int i = 0; i < val->skip_levels; i++)
+  {
+    GNUNET_assert (*update[i] == val);
+    *update[i] = val->skip_next[i];
+  }
+  while ( (plugin->skip_levels > 0) &&
+          (NULL == plugin->skip_head[plugin->skip_levels - 1]) )
+    plugin->skip_levels--;
+  GNUNET_free (val->skip_next);
+  val->skip_next = NULL;
+}
+
+
+/**
+ * Free a value that is no longer in the map, the heap or the skip
+ * list.
+ *
+ * @param val value to free
+ */
+static void
+free_value (struct Value *val)
+{
+  GNUNET_free_non_null (val->path_info);
+  GNUNET_free_non_null (val->skip_next);
+  GNUNET_free (val);
+}
+
+
 /**
  * Closure for #put_cb().
  */
@@ -254,6 +429,8 @@ heap_plugin_put (void *cls,
   val->hn = GNUNET_CONTAINER_heap_insert (plugin->heap,
 					  val,
 					  val->discard_time.abs_value_us);
+  skip_insert (plugin,
+               val);
   return size + OVERHEAD;
 }
 
@@ -376,11 +553,12 @@ heap_plugin_del (void *cls)
 		 GNUNET_CONTAINER_multihashmap_remove (plugin->map,
 						       &val->key,
 						       val));
+  skip_remove (plugin,
+               val);
   plugin->env->delete_notify (plugin->env->cls,
 			      &val->key,
 			      val->size + OVERHEAD);
-  GNUNET_free_non_null (val->path_info);
-  GNUNET_free (val);
+  free_value (val);
   return GNUNET_OK;
 }
 
@@ -416,7 +594,8 @@ heap_plugin_get_random (void *cls,
  * Iterate over the results that are "close" to a particular key in
  * the datacache.  "close" is defined as numerically larger than @a
  * key (when interpreted as a circular address space), with small
- * distance.
+ * distance.  Like the SQL backends, we return the values with the
+ * smallest keys at or above @a key that did not yet expire.
  *
  * @param cls closure (internal context for the plugin)
  * @param key area of the keyspace to look into
@@ -432,8 +611,40 @@ heap_plugin_get_closest (void *cls,
                          GNUNET_DATACACHE_Iterator iter,
                          void *iter_cls)
 {
-  GNUNET_break (0); // not implemented!
-  return 0;
+  struct Plugin *plugin = cls;
+  struct Value **update[MAX_LEVELS];
+  struct GNUNET_TIME_Absolute now;
+  struct Value *val;
+  unsigned int cnt;
+
+  if (0 == plugin->skip_levels)
+    return 0;
+  skip_find (plugin,
+             key,
+             NULL,
+             update);
+  now = GNUNET_TIME_absolute_get ();
+  cnt = 0;
+  for (val = *update[0];
+       (NULL != val) && (cnt < num_results);
+       val = val->skip_next[0])
+  {
+    if (val->discard_time.abs_value_us < now.abs_value_us)
+      continue;
+    cnt++;
+    if ( (NULL != iter) &&
+         (GNUNET_OK !=
+          iter (iter_cls,
+                &val->key,
+                val->size,
+                (const char *) &val[1],
+                val->type,
+                val->discard_time,
+                val->path_info_len,
+                val->path_info)) )
+      break;
+  }
+  return cnt;
 }
 
 
@@ -449,9 +660,14 @@ libgnunet_plugin_datacache_heap_init (void *cls)
   struct GNUNET_DATACACHE_PluginEnvironment *env = cls;
   struct GNUNET_DATACACHE_PluginFunctions *api;
   struct Plugin *plugin;
+  unsigned long long max_entries;
 
+  /* every value uses at least #OVERHEAD bytes of the quota */
+  max_entries = env->quota / OVERHEAD;
   plugin = GNUNET_new (struct Plugin);
-  plugin->map = GNUNET_CONTAINER_multihashmap_create (1024,  /* FIXME: base on quota! */
+  plugin->map = GNUNET_CONTAINER_multihashmap_create ((unsigned int) GNUNET_MAX (16,
+                                                                                GNUNET_MIN (max_entries,
+                                                                                            1024 * 1024)),
 						      GNUNET_YES);
   plugin->heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   plugin->env = env;
@@ -487,8 +703,7 @@ libgnunet_plugin_datacache_heap_done (void *cls)
 		   GNUNET_CONTAINER_multihashmap_remove (plugin->map,
 							 &val->key,
 							 val));
-    GNUNET_free_non_null (val->path_info);
-    GNUNET_free (val);
+    free_value (val);
   }
   GNUNET_CONTAINER_heap_destroy (plugin->heap);
   GNUNET_CONTAINER_multihashmap_destroy (plugin->map);
@@ -40,6 +40,11 @@
  */
 #define OVERHEAD (sizeof(struct GNUNET_HashCode) + 32)
 
+/**
+ * How many puts do we group into one transaction at most?
+ */
+#define PUT_BATCH_SIZE 256
+
 /**
  * Context for all functions in this plugin.
  */
@@ -70,6 +75,11 @@ struct Plugin
    */
   sqlite3_stmt *get_count_stmt;
 
+  /**
+   * Prepared statement for #sqlite_plugin_get.
+   */
+  sqlite3_stmt *get_range_stmt;
+
   /**
    * Prepared statement for #sqlite_plugin_get.
    */
@@ -95,10 +105,25 @@ struct Plugin
    */
   sqlite3_stmt *get_closest_stmt;
 
+  /**
+   * Task that commits the transaction with the current batch of puts.
+   */
+  struct GNUNET_SCHEDULER_Task *commit_task;
+
   /**
    * Number of key-value pairs in the database.
    */
   unsigned int num_items;
+
+  /**
+   * Number of puts in the open transaction.
+   */
+  unsigned int batch_size;
+
+  /**
+   * #GNUNET_YES while we have an open transaction.
+   */
+  int in_transaction;
 };
 
 
@@ -144,6 +169,82 @@ sq_prepare (sqlite3 *dbh,
 }
 
 
+/**
+ * Commit the transaction with the current batch of puts, if any.
+ *
+ * @param plugin the plugin
+ */
+static void
+end_batch (struct Plugin *plugin)
+{
+  if (NULL != plugin->commit_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->commit_task);
+    plugin->commit_task = NULL;
+  }
+  if (GNUNET_NO == plugin->in_transaction)
+    return;
+  plugin->in_transaction = GNUNET_NO;
+  plugin->batch_size = 0;
+  /* without a journal, there is nothing to roll back to */
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh,
+                    "COMMIT",
+                    NULL,
+                    NULL,
+                    NULL))
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+}
+
+
+/**
+ * Commit the transaction with the current batch of puts.
+ *
+ * @param cls the `struct Plugin`
+ */
+static void
+commit_task_cb (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->commit_task = NULL;
+  end_batch (plugin);
+}
+
+
+/**
+ * Make sure a transaction is open for the next put.  Puts arriving
+ * in the same scheduler round are grouped into one transaction, as
+ * committing each of them is much more expensive than inserting.
+ *
+ * @param plugin the plugin
+ */
+static void
+begin_batch (struct Plugin *plugin)
+{
+  if (GNUNET_YES == plugin->in_transaction)
+    return;
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh,
+                    "BEGIN",
+                    NULL,
+                    NULL,
+                    NULL))
+  {
+    /* continue in autocommit mode */
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+    return;
+  }
+  plugin->in_transaction = GNUNET_YES;
+  plugin->commit_task = GNUNET_SCHEDULER_add_now (&commit_task_cb,
+                                                  plugin);
+}
+
+
 /**
  * Store an item in the datastore.
  *
@@ -185,6 +286,7 @@ sqlite_plugin_put (void *cls,
        GNUNET_h2s (key),
        GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_remaining (discard_time),
                                                GNUNET_YES));
+  begin_batch (plugin);
   if (GNUNET_OK !=
       GNUNET_SQ_bind (plugin->insert_stmt,
                       params))
@@ -209,50 +311,54 @@ sqlite_plugin_put (void *cls,
   plugin->num_items++;
   GNUNET_SQ_reset (plugin->dbh,
                    plugin->insert_stmt);
+  if ( (GNUNET_YES == plugin->in_transaction) &&
+       (++plugin->batch_size >= PUT_BATCH_SIZE) )
+    end_batch (plugin);
   return size + OVERHEAD;
 }
 
 
 /**
- * Iterate over the results for a particular key
- * in the datastore.
+ * Pass the results for a particular key with a row ID of at least
+ * @a min_rowid and below @a max_rowid to @a iter, in the order of
+ * their row IDs.
  *
- * @param cls closure (our `struct Plugin`)
- * @param key
+ * @param plugin the plugin
+ * @param key key to look for
  * @param type entries of which type are relevant?
- * @param iter maybe NULL (to just count)
+ * @param now current time, expired entries are skipped
+ * @param min_rowid smallest row ID to return
+ * @param max_rowid row ID to stop at
+ * @param iter function to call on each result
  * @param iter_cls closure for @a iter
- * @return the number of results found
+ * @param[in,out] cnt incremented for each result
+ * @return #GNUNET_OK to continue, #GNUNET_NO if @a iter asked us
+ *         to stop, #GNUNET_SYSERR on error
  */
-static unsigned int
-sqlite_plugin_get (void *cls,
-                   const struct GNUNET_HashCode *key,
-                   enum GNUNET_BLOCK_Type type,
-                   GNUNET_DATACACHE_Iterator iter,
-                   void *iter_cls)
+static int
+get_results (struct Plugin *plugin,
+             const struct GNUNET_HashCode *key,
+             enum GNUNET_BLOCK_Type type,
+             struct GNUNET_TIME_Absolute now,
+             uint64_t min_rowid,
+             uint64_t max_rowid,
+             GNUNET_DATACACHE_Iterator iter,
+             void *iter_cls,
+             unsigned int *cnt)
 {
-  struct Plugin *plugin = cls;
   uint32_t type32 = type;
-  struct GNUNET_TIME_Absolute now;
   struct GNUNET_TIME_Absolute exp;
   size_t size;
   void *dat;
-  unsigned int cnt;
-  uint32_t off;
-  unsigned int total;
   size_t psize;
+  uint64_t rowid;
+  int ret;
   struct GNUNET_PeerIdentity *path;
-  struct GNUNET_SQ_QueryParam params_count[] = {
-    GNUNET_SQ_query_param_auto_from_type (key),
-    GNUNET_SQ_query_param_uint32 (&type32),
-    GNUNET_SQ_query_param_absolute_time (&now),
-    GNUNET_SQ_query_param_end
-  };
-  struct GNUNET_SQ_QueryParam params_select[] = {
+  struct GNUNET_SQ_QueryParam params[] = {
     GNUNET_SQ_query_param_auto_from_type (key),
     GNUNET_SQ_query_param_uint32 (&type32),
     GNUNET_SQ_query_param_absolute_time (&now),
-    GNUNET_SQ_query_param_uint32 (&off),
+    GNUNET_SQ_query_param_uint64 (&min_rowid),
     GNUNET_SQ_query_param_end
   };
   struct GNUNET_SQ_ResultSpec rs[] = {
@@ -261,78 +367,36 @@ sqlite_plugin_get (void *cls,
     GNUNET_SQ_result_spec_absolute_time (&exp),
     GNUNET_SQ_result_spec_variable_size ((void **) &path,
                                          &psize),
+    GNUNET_SQ_result_spec_uint64 (&rowid),
     GNUNET_SQ_result_spec_end
   };
 
-  now = GNUNET_TIME_absolute_get ();
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Processing GET for key `%s'\n",
-       GNUNET_h2s (key));
-
   if (GNUNET_OK !=
-      GNUNET_SQ_bind (plugin->get_count_stmt,
-                      params_count))
+      GNUNET_SQ_bind (plugin->get_stmt,
+                      params))
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind_xxx");
     GNUNET_SQ_reset (plugin->dbh,
-                     plugin->get_count_stmt);
-    return 0;
-  }
-  if (SQLITE_ROW !=
-      sqlite3_step (plugin->get_count_stmt))
-  {
-    LOG_SQLITE (plugin->dbh, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite_step");
-    GNUNET_SQ_reset (plugin->dbh,
-                     plugin->get_count_stmt);
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "No content found when processing GET for key `%s'\n",
-         GNUNET_h2s (key));
-    return 0;
-  }
-  total = sqlite3_column_int (plugin->get_count_stmt,
-                              0);
-  GNUNET_SQ_reset (plugin->dbh,
-                   plugin->get_count_stmt);
-  if ( (0 == total) ||
-       (NULL == iter) )
-  {
-    if (0 == total)
-      LOG (GNUNET_ERROR_TYPE_DEBUG,
-           "No content found when processing GET for key `%s'\n",
-           GNUNET_h2s (key));
-    return total;
+                     plugin->get_stmt);
+    return GNUNET_SYSERR;
   }
-
-  cnt = 0;
-  off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-                                  total);
-  while (cnt < total)
+  ret = GNUNET_OK;
+  while (SQLITE_ROW ==
+         sqlite3_step (plugin->get_stmt))
   {
-    off = (off + 1) % total;
-    if (GNUNET_OK !=
-        GNUNET_SQ_bind (plugin->get_stmt,
-                        params_select))
-    {
-      LOG_SQLITE (plugin->dbh,
-                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                  "sqlite3_bind_xxx");
-      GNUNET_SQ_reset (plugin->dbh,
-                       plugin->get_stmt);
-      return cnt;
-    }
-    if (SQLITE_ROW !=
-        sqlite3_step (plugin->get_stmt))
-      break;
     if (GNUNET_OK !=
         GNUNET_SQ_extract_result (plugin->get_stmt,
                                   rs))
     {
       GNUNET_break (0);
-      GNUNET_SQ_reset (plugin->dbh,
-                       plugin->get_stmt);
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    if (rowid >= max_rowid)
+    {
+      GNUNET_SQ_cleanup_result (rs);
       break;
     }
     if (0 != psize % sizeof (struct GNUNET_PeerIdentity))
@@ -342,7 +406,7 @@ sqlite_plugin_get (void *cls,
       path = NULL;
     }
     psize /= sizeof (struct GNUNET_PeerIdentity);
-    cnt++;
+    (*cnt)++;
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Found %u-byte result when processing GET for key `%s'\n",
          (unsigned int) size,
@@ -357,16 +421,154 @@ sqlite_plugin_get (void *cls,
                            path))
     {
       GNUNET_SQ_cleanup_result (rs);
-      GNUNET_SQ_reset (plugin->dbh,
-                       plugin->get_stmt);
+      ret = GNUNET_NO;
       break;
     }
     GNUNET_SQ_cleanup_result (rs);
-    GNUNET_SQ_reset (plugin->dbh,
-                     plugin->get_stmt);
   }
   GNUNET_SQ_reset (plugin->dbh,
                    plugin->get_stmt);
+  return ret;
+}
+
+
+/**
+ * Iterate over the results for a particular key
+ * in the datastore.
+ *
+ * @param cls closure (our `struct Plugin`)
+ * @param key
+ * @param type entries of which type are relevant?
+ * @param iter maybe NULL (to just count)
+ * @param iter_cls closure for @a iter
+ * @return the number of results found
+ */
+static unsigned int
+sqlite_plugin_get (void *cls,
+                   const struct GNUNET_HashCode *key,
+                   enum GNUNET_BLOCK_Type type,
+                   GNUNET_DATACACHE_Iterator iter,
+                   void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  uint32_t type32 = type;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int cnt;
+  unsigned int total;
+  uint64_t min_rowid;
+  uint64_t max_rowid;
+  uint64_t start;
+  struct GNUNET_SQ_QueryParam params_count[] = {
+    GNUNET_SQ_query_param_auto_from_type (key),
+    GNUNET_SQ_query_param_uint32 (&type32),
+    GNUNET_SQ_query_param_absolute_time (&now),
+    GNUNET_SQ_query_param_end
+  };
+  struct GNUNET_SQ_QueryParam params_range[] = {
+    GNUNET_SQ_query_param_auto_from_type (key),
+    GNUNET_SQ_query_param_uint32 (&type32),
+    GNUNET_SQ_query_param_end
+  };
+  struct GNUNET_SQ_ResultSpec rs_range[] = {
+    GNUNET_SQ_result_spec_uint64 (&min_rowid),
+    GNUNET_SQ_result_spec_uint64 (&max_rowid),
+    GNUNET_SQ_result_spec_end
+  };
+
+  now = GNUNET_TIME_absolute_get ();
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Processing GET for key `%s'\n",
+       GNUNET_h2s (key));
+
+  if (NULL == iter)
+  {
+    if (GNUNET_OK !=
+        GNUNET_SQ_bind (plugin->get_count_stmt,
+                        params_count))
+    {
+      LOG_SQLITE (plugin->dbh,
+                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                  "sqlite3_bind_xxx");
+      GNUNET_SQ_reset (plugin->dbh,
+                       plugin->get_count_stmt);
+      return 0;
+    }
+    if (SQLITE_ROW !=
+        sqlite3_step (plugin->get_count_stmt))
+    {
+      LOG_SQLITE (plugin->dbh, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                  "sqlite_step");
+      GNUNET_SQ_reset (plugin->dbh,
+                       plugin->get_count_stmt);
+      return 0;
+    }
+    total = sqlite3_column_int (plugin->get_count_stmt,
+                                0);
+    GNUNET_SQ_reset (plugin->dbh,
+                     plugin->get_count_stmt);
+    return total;
+  }
+
+  /* Find the range of row IDs used by the key, so that we can start
+     at a random result (to not always return the same results if
+     @a iter stops early) and then wrap around. */
+  if (GNUNET_OK !=
+      GNUNET_SQ_bind (plugin->get_range_stmt,
+                      params_range))
+  {
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_bind_xxx");
+    GNUNET_SQ_reset (plugin->dbh,
+                     plugin->get_range_stmt);
+    return 0;
+  }
+  if ( (SQLITE_ROW !=
+        sqlite3_step (plugin->get_range_stmt)) ||
+       (SQLITE_NULL ==
+        sqlite3_column_type (plugin->get_range_stmt,
+                             0)) ||
+       (GNUNET_OK !=
+        GNUNET_SQ_extract_result (plugin->get_range_stmt,
+                                  rs_range)) )
+  {
+    GNUNET_SQ_reset (plugin->dbh,
+                     plugin->get_range_stmt);
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "No content found when processing GET for key `%s'\n",
+         GNUNET_h2s (key));
+    return 0;
+  }
+  GNUNET_SQ_reset (plugin->dbh,
+                   plugin->get_range_stmt);
+  start = min_rowid
+    + GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                max_rowid - min_rowid + 1);
+  cnt = 0;
+  if ( (GNUNET_OK ==
+        get_results (plugin,
+                     key,
+                     type,
+                     now,
+                     start,
+                     UINT64_MAX,
+                     iter,
+                     iter_cls,
+                     &cnt)) &&
+       (start > min_rowid) )
+    (void) get_results (plugin,
+                        key,
+                        type,
+                        now,
+                        min_rowid,
+                        start,
+                        iter,
+                        iter_cls,
+                        &cnt);
+  if (0 == cnt)
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "No content found when processing GET for key `%s'\n",
+         GNUNET_h2s (key));
   return cnt;
 }
 
@@ -470,15 +672,11 @@ sqlite_plugin_get_random (void *cls,
   struct GNUNET_TIME_Absolute exp;
   size_t size;
   void *dat;
-  uint32_t off;
+  uint32_t pos;
   size_t psize;
   uint32_t type;
   struct GNUNET_PeerIdentity *path;
   struct GNUNET_HashCode key;
-  struct GNUNET_SQ_QueryParam params[] = {
-    GNUNET_SQ_query_param_uint32 (&off),
-    GNUNET_SQ_query_param_end
-  };
   struct GNUNET_SQ_ResultSpec rs[] = {
     GNUNET_SQ_result_spec_variable_size (&dat,
                                          &size),
@@ -494,13 +692,21 @@ sqlite_plugin_get_random (void *cls,
     return 0;
   if (NULL == iter)
     return 1;
-  off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
-                                  plugin->num_items);
-  if (GNUNET_OK !=
-      GNUNET_SQ_bind (plugin->get_random_stmt,
-                      params))
+  /* random position in the range of row IDs, in units of 2^-32 */
+  pos = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                  UINT32_MAX);
   {
-    return 0;
+    struct GNUNET_SQ_QueryParam params[] = {
+      GNUNET_SQ_query_param_uint32 (&pos),
+      GNUNET_SQ_query_param_end
+    };
+
+    if (GNUNET_OK !=
+        GNUNET_SQ_bind (plugin->get_random_stmt,
+                        params))
+    {
+      return 0;
+    }
   }
   if (SQLITE_ROW !=
       sqlite3_step (plugin->get_random_stmt))
@@ -713,7 +919,7 @@ libgnunet_plugin_datacache_sqlite_init (void *cls)
                 "  key BLOB NOT NULL DEFAULT '',"
                 "  value BLOB NOT NULL DEFAULT '',"
 		"  path BLOB DEFAULT '')");
-  SQLITE3_EXEC (dbh, "CREATE INDEX idx_hashidx ON ds090 (key,type,expire)");
+  SQLITE3_EXEC (dbh, "CREATE INDEX idx_hashidx ON ds090 (key,type)");
   SQLITE3_EXEC (dbh, "CREATE INDEX idx_expire ON ds090 (expire)");
   plugin = GNUNET_new (struct Plugin);
   plugin->env = env;
@@ -732,8 +938,15 @@ libgnunet_plugin_datacache_sqlite_init (void *cls)
                     &plugin->get_count_stmt)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "SELECT value,expire,path FROM ds090 "
-                    "WHERE key=? AND type=? AND expire >= ? LIMIT 1 OFFSET ?",
+                    "SELECT "
+                    " (SELECT min(_ROWID_) FROM ds090 WHERE key=?1 AND type=?2),"
+                    " (SELECT max(_ROWID_) FROM ds090 WHERE key=?1 AND type=?2)",
+                    &plugin->get_range_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (plugin->dbh,
+                    "SELECT value,expire,path,_ROWID_ FROM ds090 "
+                    "WHERE key=? AND type=? AND expire >= ? AND _ROWID_ >= ? "
+                    "ORDER BY _ROWID_ ASC",
                     &plugin->get_stmt)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
@@ -746,7 +959,10 @@ libgnunet_plugin_datacache_sqlite_init (void *cls)
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
                     "SELECT value,expire,path,key,type FROM ds090 "
-                    "ORDER BY key LIMIT 1 OFFSET ?",
+                    "WHERE _ROWID_ >= (SELECT min(_ROWID_) FROM ds090)"
+                    " + ? * ((SELECT max(_ROWID_) FROM ds090)"
+                    "        - (SELECT min(_ROWID_) FROM ds090) + 1) / 4294967296 "
+                    "ORDER BY _ROWID_ ASC LIMIT 1",
                     &plugin->get_random_stmt)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
@@ -802,8 +1018,10 @@ libgnunet_plugin_datacache_sqlite_done (void *cls)
                        plugin->fn);
   GNUNET_free_non_null (plugin->fn);
 #endif
+  end_batch (plugin);
   sqlite3_finalize (plugin->insert_stmt);
   sqlite3_finalize (plugin->get_count_stmt);
+  sqlite3_finalize (plugin->get_range_stmt);
   sqlite3_finalize (plugin->get_stmt);
   sqlite3_finalize (plugin->del_select_stmt);
   sqlite3_finalize (plugin->del_stmt);
@@ -60,6 +60,37 @@ checkIt (void *cls,
 }
 
 
+/**
+ * Check that the values close to a key come in ascending order
+ * of their keys.
+ *
+ * @param cls pointer to the key of the previous result
+ * @return #GNUNET_OK to continue
+ */
+static int
+checkClosest (void *cls,
+              const struct GNUNET_HashCode *key,
+              size_t size,
+              const char *data,
+              enum GNUNET_BLOCK_Type type,
+              struct GNUNET_TIME_Absolute exp,
+              unsigned int path_len,
+              const struct GNUNET_PeerIdentity *path)
+{
+  struct GNUNET_HashCode *prev = cls;
+
+  if (0 > memcmp (key,
+                  prev,
+                  sizeof (struct GNUNET_HashCode)))
+  {
+    GNUNET_break (0);
+    ok = 4;
+  }
+  *prev = *key;
+  return GNUNET_OK;
+}
+
+
 static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
@@ -99,6 +130,9 @@ run (void *cls, char *const *args, const char *cfgfile,
     ASSERT (1 == GNUNET_DATACACHE_get (h, &k, 1 + i % 16, &checkIt, &n));
     k = n;
   }
+  /* the all-zero key was stored, so there are values at or above it */
+  memset (&k, 0, sizeof (struct GNUNET_HashCode));
+  ASSERT (4 == GNUNET_DATACACHE_get_closest (h, &k, 4, &checkClosest, &k));
 
   memset (&k, 42, sizeof (struct GNUNET_HashCode));
   GNUNET_CRYPTO_hash (&k, sizeof (struct GNUNET_HashCode), &n);
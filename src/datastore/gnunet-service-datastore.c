@@ -136,11 +136,46 @@ struct ReservationList
 
 
 
+/**
+ * A PUT or REMOVE request the plugin has not answered yet.  Plugins
+ * that commit operations in groups call the continuation later, so
+ * the client may have disconnected in the meantime.
+ */
+struct PendingRequest
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingRequest *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingRequest *prev;
+
+  /**
+   * Client that made the request, NULL if it disconnected.
+   */
+  struct GNUNET_SERVICE_Client *client;
+};
+
+
 /**
  * Our datastore plugin (NULL if not available).
  */
 static struct DatastorePlugin *plugin;
 
+/**
+ * Head of requests waiting for the plugin.
+ */
+static struct PendingRequest *pr_head;
+
+/**
+ * Tail of requests waiting for the plugin.
+ */
+static struct PendingRequest *pr_tail;
+
 /**
  * Linked list of space reservations made by clients.
  */
@@ -732,6 +767,45 @@ check_data (const struct DataMessage *dm)
 }
 
 
+/**
+ * Remember that @a client is waiting for the plugin.
+ *
+ * @param client the client
+ * @return closure to pass to the plugin
+ */
+static struct PendingRequest *
+pending_request_create (struct GNUNET_SERVICE_Client *client)
+{
+  struct PendingRequest *pr;
+
+  pr = GNUNET_new (struct PendingRequest);
+  pr->client = client;
+  GNUNET_CONTAINER_DLL_insert (pr_head,
+                               pr_tail,
+                               pr);
+  return pr;
+}
+
+
+/**
+ * The plugin answered a request.
+ *
+ * @param pr the request
+ * @return the client that made the request, NULL if it disconnected
+ */
+static struct GNUNET_SERVICE_Client *
+pending_request_done (struct PendingRequest *pr)
+{
+  struct GNUNET_SERVICE_Client *client = pr->client;
+
+  GNUNET_CONTAINER_DLL_remove (pr_head,
+                               pr_tail,
+                               pr);
+  GNUNET_free (pr);
+  return client;
+}
+
+
 /**
  * Put continuation.
  *
@@ -749,7 +823,7 @@ put_continuation (void *cls,
                   int status,
                   const char *msg)
 {
-  struct GNUNET_SERVICE_Client *client = cls;
+  struct GNUNET_SERVICE_Client *client = pending_request_done (cls);
 
   if (GNUNET_OK == status)
   {
@@ -757,16 +831,23 @@ put_continuation (void *cls,
                               gettext_noop ("# bytes stored"),
                               size,
                               GNUNET_YES);
-    GNUNET_CONTAINER_bloomfilter_add (filter,
-                                      key);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Successfully stored %u bytes under key `%s'\n",
                 size,
                 GNUNET_h2s (key));
   }
-  transmit_status (client,
-                   GNUNET_SYSERR == status ? GNUNET_SYSERR : GNUNET_OK,
-                   msg);
+  else
+  {
+    /* no new row was stored, undo the add from #handle_put() */
+    GNUNET_CONTAINER_bloomfilter_remove (filter,
+                                         key);
+  }
+  if (NULL != client)
+    transmit_status (client,
+                     GNUNET_SYSERR == status ? GNUNET_SYSERR : GNUNET_OK,
+                     msg);
+  if (GNUNET_YES == cleaning_done)
+    return;
   if (quota - reserved - cache_size < payload)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
@@ -841,6 +922,12 @@ handle_put (void *cls,
   }
   bool absent = GNUNET_NO == GNUNET_CONTAINER_bloomfilter_test (filter,
                                                                 &dm->key);
+  /* Add the key now rather than once the put committed: with group
+     commit, a second PUT for the same key may arrive while the first
+     is still pending and must not skip the plugin's dedupe.  If
+     nothing gets inserted, #put_continuation() removes it again. */
+  GNUNET_CONTAINER_bloomfilter_add (filter,
+                                    &dm->key);
   plugin->api->put (plugin->api->cls,
                     &dm->key,
                     absent,
@@ -852,7 +939,7 @@ handle_put (void *cls,
                     ntohl (dm->replication),
                     GNUNET_TIME_absolute_ntoh (dm->expiration),
                     &put_continuation,
-                    client);
+                    pending_request_create (client));
   GNUNET_SERVICE_client_continue (client);
 }
 
@@ -1015,25 +1102,27 @@ remove_continuation (void *cls,
                      int status,
                      const char *msg)
 {
-  struct GNUNET_SERVICE_Client *client = cls;
+  struct GNUNET_SERVICE_Client *client = pending_request_done (cls);
 
   if (GNUNET_SYSERR == status)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 "REMOVE request failed: %s.\n",
                 msg);
-    transmit_status (client,
-                     GNUNET_NO,
-                     msg);
+    if (NULL != client)
+      transmit_status (client,
+                       GNUNET_NO,
+                       msg);
     return;
   }
   if (GNUNET_NO == status)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Content not found for REMOVE request.\n");
-    transmit_status (client,
-                     GNUNET_NO,
-                     _("Content not found"));
+    if (NULL != client)
+      transmit_status (client,
+                       GNUNET_NO,
+                       _("Content not found"));
     return;
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1045,9 +1134,10 @@ remove_continuation (void *cls,
                             GNUNET_YES);
   GNUNET_CONTAINER_bloomfilter_remove (filter,
                                        key);
-  transmit_status (client,
-                   GNUNET_OK,
-                   NULL);
+  if (NULL != client)
+    transmit_status (client,
+                     GNUNET_OK,
+                     NULL);
 }
 
 
@@ -1095,7 +1185,7 @@ handle_remove (void *cls,
                            ntohl (dm->size),
                            &dm[1],
                            &remove_continuation,
-                           client);
+                           pending_request_create (client));
   GNUNET_SERVICE_client_continue (client);
 }
 
@@ -1267,6 +1357,10 @@ add_key_to_bloomfilter (void *cls,
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
 		_("Bloomfilter construction complete.\n"));
+    if (GNUNET_OK !=
+        GNUNET_CONTAINER_bloomfilter_flush (bf))
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Failed to write bloomfilter to disk.\n"));
     begin_service ();
     return;
   }
@@ -1380,8 +1474,17 @@ cleaning_task (void *cls)
     unload_plugin (plugin);
     plugin = NULL;
   }
+  while (NULL != pr_head)
+    (void) pending_request_done (pr_head);
   if (NULL != filter)
   {
+    /* counter updates are written lazily; if they do not make it
+       to the drive, the file stays marked as dirty and we rebuild
+       the filter at the next start */
+    if (GNUNET_OK !=
+        GNUNET_CONTAINER_bloomfilter_flush (filter))
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Failed to write bloomfilter to disk.\n"));
     GNUNET_CONTAINER_bloomfilter_free (filter);
     filter = NULL;
   }
@@ -1443,8 +1546,12 @@ client_disconnect_cb (void *cls,
   struct ReservationList *pos;
   struct ReservationList *prev;
   struct ReservationList *next;
+  struct PendingRequest *pr;
 
   GNUNET_assert (app_ctx == client);
+  for (pr = pr_head; NULL != pr; pr = pr->next)
+    if (pr->client == client)
+      pr->client = NULL;
   prev = NULL;
   pos = reservations;
   while (NULL != pos)
@@ -1553,7 +1660,8 @@ run (void *cls,
       filter = GNUNET_CONTAINER_bloomfilter_load (pfn, bf_size, 5);        /* approx. 3% false positives at max use */
       if (NULL == filter)
       {
-	/* file exists but not valid, remove and try again, but refresh */
+	/* file exists but not valid (or was not closed cleanly, so
+	   it may miss keys), remove and try again, but refresh */
 	if (0 != UNLINK (pfn))
 	{
 	  /* failed to remove, run without file */
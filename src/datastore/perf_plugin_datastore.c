@@ -19,7 +19,8 @@
 */
 /*
  * @file perf_plugin_datastore.c
- * @brief Profile database plugin directly, focusing on iterators.
+ * @brief Profile database plugin directly, focusing on iterators
+ *        and on puts per second with group commit.
  * @author Christian Grothoff
  */
 
@@ -40,6 +41,37 @@
 
 #define ITERATIONS 2
 
+/**
+ * Number of puts we measure per group commit setting.
+ */
+#define WINDOW_PUTS 1024
+
+/**
+ * Number of puts we keep in flight when measuring group commit.
+ */
+#define WINDOW_PARALLEL 64
+
+/**
+ * Size of the items we store when measuring group commit.
+ */
+#define WINDOW_ITEM_SIZE 4096
+
+/**
+ * Group commit settings (operations per transaction, maximum delay
+ * in ms) for which we measure puts per second.
+ */
+static const struct
+{
+  unsigned long long size;
+  unsigned int delay_ms;
+} windows[] = {
+  { 1, 0 },
+  { 16, 0 },
+  { 64, 0 },
+  { 256, 0 },
+  { 256, 5 }
+};
+
 /**
  * Number of put operations equivalent to 1/10th of MAX_SIZE
  */
@@ -66,6 +98,7 @@ enum RunPhase
   RP_REP_GET,
   RP_ZA_GET,
   RP_EXP_GET,
+  RP_PUT_WINDOW,
   RP_DONE
 };
 
@@ -81,6 +114,32 @@ struct CpsRunContext
   unsigned int cnt;
   unsigned int iter;
   uint64_t offset;
+
+  /**
+   * Configuration with the group commit setting we measure,
+   * NULL if we are not measuring group commit yet.
+   */
+  struct GNUNET_CONFIGURATION_Handle *window_cfg;
+
+  /**
+   * Index of the group commit setting in #windows we measure.
+   */
+  unsigned int window;
+
+  /**
+   * Number of puts issued for the current setting.
+   */
+  unsigned int window_issued;
+
+  /**
+   * Number of puts for the current setting without continuation.
+   */
+  unsigned int window_outstanding;
+
+  /**
+   * #GNUNET_YES while we issue puts.
+   */
+  int in_burst;
 };
 
 
@@ -365,6 +424,162 @@ replication_get (void *cls,
 }
 
 
+static void
+window_burst (void *cls);
+
+
+/**
+ * Put continuation while measuring group commit.
+ *
+ * @param cls closure
+ * @param key key for the item stored
+ * @param size size of the item stored
+ * @param status #GNUNET_OK or #GNUNET_SYSERROR
+ * @param msg error message on error
+ */
+static void
+window_put_continuation (void *cls,
+                         const struct GNUNET_HashCode *key,
+                         uint32_t size,
+                         int status,
+                         const char *msg)
+{
+  struct CpsRunContext *crc = cls;
+
+  if (GNUNET_SYSERR == status)
+    FPRINTF (stderr, "ERROR: `%s'\n", msg);
+  crc->window_outstanding--;
+  if ( (0 == crc->window_outstanding) &&
+       (GNUNET_NO == crc->in_burst) )
+    GNUNET_SCHEDULER_add_now (&window_burst, crc);
+}
+
+
+/**
+ * Issue the next #WINDOW_PARALLEL puts for the current group commit
+ * setting, or report the result once all puts completed.
+ *
+ * @param cls the `struct CpsRunContext`
+ */
+static void
+window_burst (void *cls)
+{
+  struct CpsRunContext *crc = cls;
+  static char value[WINDOW_ITEM_SIZE];
+  struct GNUNET_HashCode key;
+  struct GNUNET_TIME_Relative duration;
+  char gauger_name[128];
+  unsigned int i;
+  double rate;
+
+  if (WINDOW_PUTS == crc->window_issued)
+  {
+    duration = GNUNET_TIME_absolute_get_duration (crc->start);
+    rate = WINDOW_PUTS * 1000000.0 / (1 + duration.rel_value_us);
+    GNUNET_snprintf (gauger_name,
+                     sizeof (gauger_name),
+                     "Puts per second (group commit %llu/%u ms)",
+                     windows[crc->window].size,
+                     windows[crc->window].delay_ms);
+    printf ("%s: %.0f\n",
+            gauger_name,
+            rate);
+    GAUGER (category, gauger_name, rate, "puts/s");
+    crc->window++;
+    GNUNET_SCHEDULER_add_now (&test, crc);
+    return;
+  }
+  crc->in_burst = GNUNET_YES;
+  for (i = 0; (i < WINDOW_PARALLEL) && (crc->window_issued < WINDOW_PUTS); i++)
+  {
+    GNUNET_CRYPTO_hash (&crc->window_issued,
+                        sizeof (crc->window_issued),
+                        &key);
+    key.bits[0] ^= crc->window;
+    value[0] = (char) crc->window_issued;
+    crc->window_issued++;
+    crc->window_outstanding++;
+    crc->api->put (crc->api->cls,
+                   &key,
+                   true /* absent */,
+                   sizeof (value),
+                   value,
+                   GNUNET_BLOCK_TYPE_FS_DBLOCK,
+                   0 /* priority */,
+                   0 /* anonymity */,
+                   0 /* replication */,
+                   GNUNET_TIME_UNIT_FOREVER_ABS,
+                   &window_put_continuation,
+                   crc);
+  }
+  crc->in_burst = GNUNET_NO;
+  if (0 == crc->window_outstanding)
+    GNUNET_SCHEDULER_add_now (&window_burst, crc);
+}
+
+
+static struct GNUNET_DATASTORE_PluginFunctions *
+load_plugin (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+static void
+unload_plugin (struct GNUNET_DATASTORE_PluginFunctions *api,
+               const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Reload the plugin with the next group commit setting and start
+ * measuring puts per second.  Plugins that do not support group
+ * commit ignore the setting.
+ *
+ * @param crc run context
+ */
+static void
+start_window (struct CpsRunContext *crc)
+{
+  char section[64];
+  char delay[32];
+
+  if (sizeof (windows) / sizeof (windows[0]) == crc->window)
+  {
+    crc->phase++;
+    GNUNET_SCHEDULER_add_now (&test, crc);
+    return;
+  }
+  unload_plugin (crc->api, crc->cfg);
+  if (NULL != crc->window_cfg)
+    GNUNET_CONFIGURATION_destroy (crc->window_cfg);
+  crc->window_cfg = GNUNET_CONFIGURATION_dup (crc->cfg);
+  GNUNET_snprintf (section,
+                   sizeof (section),
+                   "datastore-%s",
+                   plugin_name);
+  GNUNET_snprintf (delay,
+                   sizeof (delay),
+                   "%u ms",
+                   windows[crc->window].delay_ms);
+  GNUNET_CONFIGURATION_set_value_number (crc->window_cfg,
+                                         section,
+                                         "GROUP_COMMIT_SIZE",
+                                         windows[crc->window].size);
+  GNUNET_CONFIGURATION_set_value_string (crc->window_cfg,
+                                         section,
+                                         "GROUP_COMMIT_DELAY",
+                                         delay);
+  crc->api = load_plugin (crc->window_cfg);
+  if (NULL == crc->api)
+  {
+    crc->phase = RP_ERROR;
+    GNUNET_SCHEDULER_add_now (&test, crc);
+    return;
+  }
+  crc->window_issued = 0;
+  crc->window_outstanding = 0;
+  crc->start = GNUNET_TIME_absolute_get ();
+  window_burst (crc);
+}
+
+
 /**
  * Function called when the service shuts
  * down.  Unloads our datastore plugin.
@@ -405,7 +620,10 @@ cleaning_task (void *cls)
 {
   struct CpsRunContext *crc = cls;
 
-  unload_plugin (crc->api, crc->cfg);
+  if (NULL != crc->api)
+    unload_plugin (crc->api, crc->cfg);
+  if (NULL != crc->window_cfg)
+    GNUNET_CONFIGURATION_destroy (crc->window_cfg);
   GNUNET_free (crc);
 }
 
@@ -421,7 +639,8 @@ test (void *cls)
   {
   case RP_ERROR:
     GNUNET_break (0);
-    crc->api->drop (crc->api->cls);
+    if (NULL != crc->api)
+      crc->api->drop (crc->api->cls);
     ok = 1;
     GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
                                         &cleaning_task, crc);
@@ -439,6 +658,9 @@ test (void *cls)
   case RP_EXP_GET:
     crc->api->get_expiration (crc->api->cls, &expiration_get, crc);
     break;
+  case RP_PUT_WINDOW:
+    start_window (crc);
+    break;
   case RP_DONE:
     crc->api->drop (crc->api->cls);
     ok = 0;
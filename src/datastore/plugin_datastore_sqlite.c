@@ -66,6 +66,56 @@
 #define LOG_SQLITE_MSG(db, msg, level, cmd) do { GNUNET_log_from (level, "sqlite", _("`%s' failed at %s:%d with error: %s\n"), cmd, __FILE__, __LINE__, sqlite3_errmsg(db->dbh)); GNUNET_asprintf(msg, _("`%s' failed at %s:%u with error: %s"), cmd, __FILE__, __LINE__, sqlite3_errmsg(db->dbh)); } while(0)
 
 
+/**
+ * A put or remove whose changes are part of the open transaction.
+ * Its continuation is called once the transaction was committed.
+ */
+struct PendingOperation
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingOperation *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingOperation *prev;
+
+  /**
+   * Continuation to call (puts and removes use the same signature).
+   */
+  PluginPutCont cont;
+
+  /**
+   * Closure for @e cont.
+   */
+  void *cont_cls;
+
+  /**
+   * Key of the item.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Size of the item.
+   */
+  uint32_t size;
+
+  /**
+   * Status to report if the transaction commits.
+   */
+  int status;
+
+  /**
+   * Change in disk utilization we reported for the operation, to be
+   * undone if the transaction fails.
+   */
+  int duc_delta;
+};
+
+
 
 /**
  * Context for all functions in this plugin.
@@ -137,11 +187,47 @@ struct Plugin
    */
   sqlite3_stmt *get;
 
+  /**
+   * Head of operations waiting for the open transaction to commit.
+   */
+  struct PendingOperation *pending_head;
+
+  /**
+   * Tail of operations waiting for the open transaction to commit.
+   */
+  struct PendingOperation *pending_tail;
+
+  /**
+   * Task that commits the open transaction.
+   */
+  struct GNUNET_SCHEDULER_Task *commit_task;
+
+  /**
+   * Maximum number of puts and removes we group into one
+   * transaction; 1 if every operation commits on its own.
+   */
+  unsigned long long group_commit_size;
+
+  /**
+   * How long may an operation wait for the transaction to commit?
+   */
+  struct GNUNET_TIME_Relative group_commit_delay;
+
+  /**
+   * Number of entries in the pending list.
+   */
+  unsigned int pending_count;
+
   /**
    * Should the database be dropped on shutdown?
    */
   int drop_on_shutdown;
 
+  /**
+   * #GNUNET_YES while we have an open transaction.
+   */
+  int in_transaction;
+
 };
 
 
@@ -517,6 +603,198 @@ delete_by_rowid (struct Plugin *plugin,
 }
 
 
+/**
+ * Commit the open transaction.
+ *
+ * @param cls the plugin context (state for this module)
+ */
+static void
+commit_task_cb (void *cls);
+
+
+/**
+ * Open a transaction for the following puts and removes, unless
+ * group commit is disabled or a transaction is open already.  The
+ * transaction is committed after the group commit delay at the
+ * latest.
+ *
+ * @param plugin the plugin context (state for this module)
+ */
+static void
+begin_transaction (struct Plugin *plugin)
+{
+  if ( (GNUNET_YES == plugin->in_transaction) ||
+       (plugin->group_commit_size <= 1) )
+    return;
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh,
+                    "BEGIN",
+                    NULL,
+                    NULL,
+                    NULL))
+  {
+    /* continue in autocommit mode */
+    LOG_SQLITE (plugin,
+                GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+    return;
+  }
+  plugin->in_transaction = GNUNET_YES;
+  plugin->commit_task
+    = GNUNET_SCHEDULER_add_delayed (plugin->group_commit_delay,
+                                    &commit_task_cb,
+                                    plugin);
+}
+
+
+/**
+ * End the open transaction (if any) and call the continuations of
+ * the operations that were part of it.
+ *
+ * @param plugin the plugin context (state for this module)
+ * @param commit #GNUNET_YES to commit, #GNUNET_NO to roll back
+ */
+static void
+end_transaction (struct Plugin *plugin,
+                 int commit)
+{
+  struct PendingOperation *head;
+  struct PendingOperation *po;
+  char *msg = NULL;
+  int ok;
+
+  if (NULL != plugin->commit_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->commit_task);
+    plugin->commit_task = NULL;
+  }
+  if (GNUNET_NO == plugin->in_transaction)
+    return;
+  ok = GNUNET_NO;
+  if (GNUNET_YES == commit)
+  {
+    if (SQLITE_OK ==
+        sqlite3_exec (plugin->dbh,
+                      "COMMIT",
+                      NULL,
+                      NULL,
+                      NULL))
+      ok = GNUNET_YES;
+    else
+      LOG_SQLITE_MSG (plugin, &msg, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                      "sqlite3_exec");
+  }
+  if ( (GNUNET_NO == ok) &&
+       (SQLITE_OK !=
+        sqlite3_exec (plugin->dbh,
+                      "ROLLBACK",
+                      NULL,
+                      NULL,
+                      NULL)) )
+    LOG_SQLITE (plugin,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+  /* continuations may issue new operations, which then go
+     into a new transaction */
+  head = plugin->pending_head;
+  plugin->pending_head = NULL;
+  plugin->pending_tail = NULL;
+  plugin->pending_count = 0;
+  plugin->in_transaction = GNUNET_NO;
+  while (NULL != (po = head))
+  {
+    head = po->next;
+    if (GNUNET_YES == ok)
+    {
+      po->cont (po->cont_cls,
+                &po->key,
+                po->size,
+                po->status,
+                NULL);
+    }
+    else
+    {
+      if ( (0 != po->duc_delta) &&
+           (NULL != plugin->env->duc) )
+        plugin->env->duc (plugin->env->cls,
+                          - po->duc_delta);
+      po->cont (po->cont_cls,
+                &po->key,
+                po->size,
+                GNUNET_SYSERR,
+                (NULL != msg) ? msg : _("sqlite transaction rolled back"));
+    }
+    GNUNET_free (po);
+  }
+  GNUNET_free_non_null (msg);
+}
+
+
+/**
+ * Commit the open transaction.
+ *
+ * @param cls the plugin context (state for this module)
+ */
+static void
+commit_task_cb (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->commit_task = NULL;
+  end_transaction (plugin,
+                   GNUNET_YES);
+}
+
+
+/**
+ * A put or remove succeeded.  Call its continuation now if we are
+ * not in a transaction, otherwise once the transaction committed.
+ *
+ * @param plugin the plugin context (state for this module)
+ * @param cont continuation to call
+ * @param cont_cls closure for @a cont
+ * @param key key of the item
+ * @param size size of the item
+ * @param status status to report
+ * @param duc_delta change in disk utilization reported for the operation
+ */
+static void
+operation_done (struct Plugin *plugin,
+                PluginPutCont cont,
+                void *cont_cls,
+                const struct GNUNET_HashCode *key,
+                uint32_t size,
+                int status,
+                int duc_delta)
+{
+  struct PendingOperation *po;
+
+  if (GNUNET_NO == plugin->in_transaction)
+  {
+    cont (cont_cls,
+          key,
+          size,
+          status,
+          NULL);
+    return;
+  }
+  po = GNUNET_new (struct PendingOperation);
+  po->cont = cont;
+  po->cont_cls = cont_cls;
+  po->key = *key;
+  po->size = size;
+  po->status = status;
+  po->duc_delta = duc_delta;
+  GNUNET_CONTAINER_DLL_insert_tail (plugin->pending_head,
+                                    plugin->pending_tail,
+                                    po);
+  plugin->pending_count++;
+  if (plugin->pending_count >= plugin->group_commit_size)
+    end_transaction (plugin,
+                     GNUNET_YES);
+}
+
+
 /**
  * Store an item in the datastore.
  *
@@ -554,6 +832,7 @@ sqlite_plugin_put (void *cls,
   GNUNET_CRYPTO_hash (data,
                       size,
                       &vhash);
+  begin_transaction (plugin);
 
   if (!absent)
   {
@@ -594,11 +873,13 @@ sqlite_plugin_put (void *cls,
                      plugin->update);
     if (0 != changes)
     {
-      cont (cont_cls,
-            key,
-            size,
-            GNUNET_NO,
-            NULL);
+      operation_done (plugin,
+                      cont,
+                      cont_cls,
+                      key,
+                      size,
+                      GNUNET_NO,
+                      0);
       return;
     }
   }
@@ -666,6 +947,8 @@ sqlite_plugin_put (void *cls,
                     "sqlite3_step");
     GNUNET_SQ_reset (plugin->dbh,
                      stmt);
+    end_transaction (plugin,
+                     GNUNET_NO);
     database_shutdown (plugin);
     database_setup (plugin->env->cfg, plugin);
     cont (cont_cls, key, size, GNUNET_SYSERR, msg);
@@ -674,7 +957,16 @@ sqlite_plugin_put (void *cls,
   }
   GNUNET_SQ_reset (plugin->dbh,
                    stmt);
-  cont (cont_cls, key, size, ret, msg);
+  if (GNUNET_OK == ret)
+    operation_done (plugin,
+                    cont,
+                    cont_cls,
+                    key,
+                    size,
+                    GNUNET_OK,
+                    size + GNUNET_DATASTORE_ENTRY_OVERHEAD);
+  else
+    cont (cont_cls, key, size, ret, msg);
   GNUNET_free_non_null(msg);
 }
 
@@ -746,8 +1038,14 @@ execute_get (struct Plugin *plugin,
     GNUNET_SQ_cleanup_result (rs);
     GNUNET_SQ_reset (plugin->dbh,
                      stmt);
-    if ( (GNUNET_NO == ret) &&
-         (GNUNET_OK == delete_by_rowid (plugin,
+    if (GNUNET_NO != ret)
+      return;
+    /* the disk utilization change is reported right away, so the
+       deletion must not be part of a transaction that may still
+       be rolled back */
+    end_transaction (plugin,
+                     GNUNET_YES);
+    if ( (GNUNET_OK == delete_by_rowid (plugin,
                                         rowid)) &&
          (NULL != plugin->env->duc) )
       plugin->env->duc (plugin->env->cls,
@@ -1182,6 +1480,7 @@ sqlite_plugin_remove_key (void *cls,
     GNUNET_SQ_query_param_end
   };
 
+  begin_transaction (plugin);
   if (GNUNET_OK !=
       GNUNET_SQ_bind (plugin->remove,
                       params))
@@ -1222,11 +1521,13 @@ sqlite_plugin_remove_key (void *cls,
   if (NULL != plugin->env->duc)
     plugin->env->duc (plugin->env->cls,
                       -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
-  cont (cont_cls,
-        key,
-        size,
-        GNUNET_OK,
-        NULL);
+  operation_done (plugin,
+                  cont,
+                  cont_cls,
+                  key,
+                  size,
+                  GNUNET_OK,
+                  -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
 }
 
 
@@ -1252,6 +1553,9 @@ sqlite_plugin_estimate_size (void *cls,
 
   if (NULL == estimate)
     return;
+  /* VACUUM cannot run inside of a transaction */
+  end_transaction (plugin,
+                   GNUNET_YES);
   if (SQLITE_VERSION_NUMBER < 3006000)
   {
     GNUNET_log_from (GNUNET_ERROR_TYPE_WARNING,
@@ -1316,6 +1620,18 @@ libgnunet_plugin_datastore_sqlite_init (void *cls)
           0,
           sizeof (struct Plugin));
   plugin.env = env;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (env->cfg,
+                                             "datastore-sqlite",
+                                             "GROUP_COMMIT_SIZE",
+                                             &plugin.group_commit_size))
+    plugin.group_commit_size = 1;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (env->cfg,
+                                           "datastore-sqlite",
+                                           "GROUP_COMMIT_DELAY",
+                                           &plugin.group_commit_delay))
+    plugin.group_commit_delay = GNUNET_TIME_UNIT_ZERO;
   if (GNUNET_OK != database_setup (env->cfg, &plugin))
   {
     database_shutdown (&plugin);
@@ -1355,6 +1671,8 @@ libgnunet_plugin_datastore_sqlite_done (void *cls)
   GNUNET_log_from (GNUNET_ERROR_TYPE_DEBUG,
                    "sqlite",
                    "sqlite plugin is done\n");
+  end_transaction (plugin,
+                   GNUNET_YES);
   fn = NULL;
   if (plugin->drop_on_shutdown)
     fn = GNUNET_strdup (plugin->fn);
@@ -456,7 +456,10 @@ void
 GDS_ROUTING_init ()
 {
   recent_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
-  recent_map = GNUNET_CONTAINER_multihashmap_create (DHT_MAX_RECENT * 4 / 3, GNUNET_NO);
+  recent_map =
+      GNUNET_CONTAINER_multihashmap_create_with_layout (DHT_MAX_RECENT * 4 / 3,
+                                                        GNUNET_NO,
+                                                        GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING);
 }
 
 
@@ -1819,13 +1819,19 @@ write_download_request (struct GNUNET_BIO_WriteHandle *wh,
                         struct DownloadRequest *dr)
 {
   unsigned int i;
-
-  if ((GNUNET_OK != GNUNET_BIO_write_int32 (wh, dr->state)) ||
+  enum BlockRequestState state;
+
+  state = dr->state;
+  if ( (BRS_DOWNLOAD_DOWN == state) &&
+       (dr->depth > 0) &&
+       (0 == dr->num_children) )
+    state = BRS_CHK_SET; /* children were deferred, fetch block again */
+  if ((GNUNET_OK != GNUNET_BIO_write_int32 (wh, state)) ||
       (GNUNET_OK != GNUNET_BIO_write_int64 (wh, dr->offset)) ||
       (GNUNET_OK != GNUNET_BIO_write_int32 (wh, dr->num_children)) ||
       (GNUNET_OK != GNUNET_BIO_write_int32 (wh, dr->depth)))
     return GNUNET_NO;
-  if ((BRS_CHK_SET == dr->state) &&
+  if ((BRS_CHK_SET == state) &&
       (GNUNET_OK !=
        GNUNET_BIO_write (wh, &dr->chk, sizeof (struct ContentHashKey))))
     return GNUNET_NO;
@@ -1855,8 +1861,7 @@ read_download_request (struct GNUNET_BIO_ReadHandle *rh)
       (dr->num_children > CHK_PER_INODE) ||
       (GNUNET_OK != GNUNET_BIO_read_int32 (rh, &dr->depth)) ||
       ( (0 == dr->depth) &&
-        (dr->num_children > 0) ) ||
-      ((dr->depth > 0) && (0 == dr->num_children)))
+        (dr->num_children > 0) ))
   {
     GNUNET_break (0);
     dr->num_children = 0;
@@ -1890,6 +1895,9 @@ read_download_request (struct GNUNET_BIO_ReadHandle *rh)
     if (NULL == (dr->children[i] = read_download_request (rh)))
       goto cleanup;
     dr->children[i]->parent = dr;
+    dr->children[i]->chk_idx
+      = (dr->children[i]->offset - dr->offset)
+      / GNUNET_FS_tree_compute_tree_size (dr->depth - 1);
   }
   return dr;
 cleanup:
@@ -1948,6 +1956,8 @@ GNUNET_FS_download_sync_ (struct GNUNET_FS_DownloadContext *dc)
   char *fn;
   char *dir;
 
+  dc->last_sync = GNUNET_TIME_absolute_get ();
+  dc->unsynced_blocks = 0;
   if (0 != (dc->options & GNUNET_FS_DOWNLOAD_IS_PROBE))
     return; /* we don't sync probes */
   if (NULL == dc->serialization)
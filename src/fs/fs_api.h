@@ -1705,6 +1705,8 @@ struct DownloadRequest
 
   /**
    * Array (!) of child-requests, or NULL for the bottom of the tree.
+   * Also NULL as long as we do not know the CHKs of the children
+   * yet and after the subtree was downloaded completely.
    */
   struct DownloadRequest **children;
 
@@ -1876,6 +1878,14 @@ struct GNUNET_FS_DownloadContext
    */
   struct GNUNET_CONTAINER_MultiHashMap *active;
 
+  /**
+   * IBlocks that we downloaded (and stored on disk) while enough
+   * requests were active already, ordered by offset.  Their
+   * children are only created (and requested) once some of the
+   * active requests are done.  NULL if we never had to do this.
+   */
+  struct GNUNET_CONTAINER_Heap *deferred;
+
   /**
    * Top-level download request.
    */
@@ -1928,6 +1938,11 @@ struct GNUNET_FS_DownloadContext
    */
   struct GNUNET_TIME_Absolute start_time;
 
+  /**
+   * When did we last write the download to disk?
+   */
+  struct GNUNET_TIME_Absolute last_sync;
+
   /**
    * How long to wait before we try to reconnect to FS service?
    */
@@ -1943,6 +1958,12 @@ struct GNUNET_FS_DownloadContext
    */
   unsigned int treedepth;
 
+  /**
+   * Number of blocks we received since we last wrote the download
+   * to disk.
+   */
+  unsigned int unsynced_blocks;
+
   /**
    * Options for the download.
    */
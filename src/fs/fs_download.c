@@ -28,6 +28,26 @@
 #include "fs_api.h"
 #include "fs_tree.h"
 
+/**
+ * After how many received blocks do we write the download to disk
+ * again (at the latest)?
+ */
+#define SYNC_BLOCK_INTERVAL 64
+
+/**
+ * After how much time do we write the download to disk again (at
+ * the latest, as long as blocks keep arriving)?
+ */
+#define SYNC_TIME_INTERVAL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * How many requests do we want to have active at most?  Beyond
+ * this, we do not create the children of IBlocks we receive (if we
+ * can read them back from disk later), so that only a window of
+ * the tree is kept in memory for large files.
+ */
+#define MAX_ACTIVE_REQUESTS (4 * CHK_PER_INODE)
+
 
 /**
  * Determine if the given download (options and meta data) should cause
@@ -131,6 +151,27 @@ GNUNET_FS_download_make_status_ (struct GNUNET_FS_ProgressInfo *pi,
 }
 
 
+/**
+ * Write the download to disk after we received a block, unless we
+ * did so very recently.  If we are interrupted before the next sync,
+ * the blocks received in the meantime are found again by the
+ * top-down reconstruction from the file on disk (or are simply
+ * downloaded again).
+ *
+ * @param dc download that made progress
+ */
+static void
+download_sync_lazy (struct GNUNET_FS_DownloadContext *dc)
+{
+  dc->unsynced_blocks++;
+  if ( (dc->unsynced_blocks < SYNC_BLOCK_INTERVAL) &&
+       (GNUNET_TIME_absolute_get_duration (dc->last_sync).rel_value_us <
+        SYNC_TIME_INTERVAL.rel_value_us) )
+    return;
+  GNUNET_FS_download_sync_ (dc);
+}
+
+
 /**
  * Closure for iterator processing results.
  */
@@ -172,6 +213,12 @@ struct ProcessResultClosure
    */
   int do_store;
 
+  /**
+   * May we free completed subtrees right away?  Not while
+   * #try_top_down_reconstruction() is still walking the tree.
+   */
+  int collapse;
+
   /**
    * how much respect did we offer to get this reply?
    */
@@ -250,6 +297,7 @@ encrypt_existing_match (struct GNUNET_FS_DownloadContext *dc,
        dr->depth) ? GNUNET_BLOCK_TYPE_FS_DBLOCK : GNUNET_BLOCK_TYPE_FS_IBLOCK;
   prc.query = chk->query;
   prc.do_store = do_store;
+  prc.collapse = GNUNET_NO;
   prc.last_transmission = GNUNET_TIME_UNIT_FOREVER_ABS;
   process_result_with_request (&prc, &chk->key, dr);
   return GNUNET_OK;
@@ -420,6 +468,132 @@ check_completed (struct GNUNET_FS_DownloadContext *dc)
 }
 
 
+/**
+ * Create a download request structure.  The children of the
+ * request are only created once we know their CHKs, see
+ * #expand_download_request().
+ *
+ * @param parent parent of the current entry
+ * @param chk_idx index of the chk for this block in the parent block
+ * @param depth depth of the current entry, 0 are the DBLOCKs,
+ *              top level block is 'dc->treedepth - 1'
+ * @param dr_offset offset in the original file this block maps to
+ *              (as in, offset of the first byte of the first DBLOCK
+ *               in the subtree rooted in the returned download request tree)
+ * @return download request for the given block
+ */
+static struct DownloadRequest *
+create_download_request (struct DownloadRequest *parent,
+			 unsigned int chk_idx,
+			 unsigned int depth,
+                         uint64_t dr_offset)
+{
+  struct DownloadRequest *dr;
+
+  dr = GNUNET_new (struct DownloadRequest);
+  dr->parent = parent;
+  dr->depth = depth;
+  dr->offset = dr_offset;
+  dr->chk_idx = chk_idx;
+  return dr;
+}
+
+
+/**
+ * Create the children of an IBlock request (if we did not do so
+ * already).  Only the children for DBLOCKs in the range requested
+ * by the download are created.  Doing this lazily keeps only the
+ * part of the tree that is being downloaded in memory, instead of
+ * one request per block of the file.
+ *
+ * @param dc overall download the request belongs to
+ * @param dr request to create the children for
+ */
+static void
+expand_download_request (struct GNUNET_FS_DownloadContext *dc,
+                         struct DownloadRequest *dr)
+{
+  unsigned int head_skip;
+  uint64_t child_block_size;
+  uint64_t end;
+
+  if ( (0 == dr->depth) ||
+       (NULL != dr->children) )
+    return;
+  child_block_size = GNUNET_FS_tree_compute_tree_size (dr->depth - 1);
+
+  /* calculate how many blocks at this level are not interesting
+   * from the start (rounded down), either because of the requested
+   * file offset or because this IBlock is further along */
+  if (dr->offset < dc->offset)
+    head_skip = (dc->offset - dr->offset) / child_block_size;
+  else
+    head_skip = 0;
+
+  /* calculate index of last block at this level that is interesting (rounded up) */
+  end = dc->offset + dc->length - dr->offset;
+  dr->num_children = end / child_block_size;
+  if (dr->num_children * child_block_size < end)
+    dr->num_children++;       /* round up */
+  GNUNET_assert (dr->num_children > head_skip);
+  dr->num_children -= head_skip;
+  if (dr->num_children > CHK_PER_INODE)
+    dr->num_children = CHK_PER_INODE; /* cap at max */
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Block at offset %llu and depth %u has %u children\n",
+	      (unsigned long long) dr->offset,
+	      dr->depth,
+	      dr->num_children);
+  dr->children =
+    GNUNET_new_array (dr->num_children,
+                      struct DownloadRequest *);
+  for (unsigned int i = 0; i < dr->num_children; i++)
+    dr->children[i] =
+      create_download_request (dr,
+                               i + head_skip,
+                               dr->depth - 1,
+                               dr->offset + (i + head_skip) * child_block_size);
+}
+
+
+/**
+ * Free the children of a request whose subtree is complete.  The
+ * request itself stays in the tree (in state #BRS_DOWNLOAD_UP) and
+ * then represents the whole range of the subtree, both in memory
+ * and in the serialized download.
+ *
+ * @param dr completed request
+ */
+static void
+collapse_download_request (struct DownloadRequest *dr)
+{
+  GNUNET_assert (BRS_DOWNLOAD_UP == dr->state);
+  for (unsigned int i = 0; i < dr->num_children; i++)
+    GNUNET_FS_free_download_request_ (dr->children[i]);
+  GNUNET_free_non_null (dr->children);
+  dr->children = NULL;
+  dr->num_children = 0;
+}
+
+
+/**
+ * Walk the tree and collapse all completed subtrees.
+ *
+ * @param dr root of the tree
+ */
+static void
+collapse_completed (struct DownloadRequest *dr)
+{
+  if (BRS_DOWNLOAD_UP == dr->state)
+  {
+    collapse_download_request (dr);
+    return;
+  }
+  for (unsigned int i = 0; i < dr->num_children; i++)
+    collapse_completed (dr->children[i]);
+}
+
+
 /**
  * We got a block of plaintext data (from the meta data).
  * Try it for upward reconstruction of the data.  On success,
@@ -467,6 +641,7 @@ try_match_block (struct GNUNET_FS_DownloadContext *dc,
          IBlock reconstruction. (need good tests though). */
       return;
     }
+    expand_download_request (dc, dr);
     complete = GNUNET_YES;
     for (i = 0; i < dr->num_children; i++)
     {
@@ -713,6 +888,7 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
   dr->state = BRS_DOWNLOAD_DOWN;
 
   /* set CHKs for children */
+  expand_download_request (dc, dr);
   up_done = GNUNET_YES;
   chks = (const struct ContentHashKey *) block;
   for (i = 0; i < dr->num_children; i++)
@@ -772,6 +948,43 @@ retry_entry (void *cls,
 }
 
 
+/**
+ * Remember an IBlock whose children we do not want to request yet.
+ *
+ * @param dc overall download this block belongs to
+ * @param dr request for the IBlock (in state #BRS_DOWNLOAD_DOWN)
+ */
+static void
+defer_download_request (struct GNUNET_FS_DownloadContext *dc,
+                        struct DownloadRequest *dr)
+{
+  if (NULL == dc->deferred)
+    dc->deferred
+      = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  GNUNET_CONTAINER_heap_insert (dc->deferred,
+                                dr,
+                                dr->offset);
+}
+
+
+/**
+ * Forget about all deferred IBlocks (as the tree is about to be
+ * freed).
+ *
+ * @param dc download to clean up
+ */
+static void
+clear_deferred (struct GNUNET_FS_DownloadContext *dc)
+{
+  if (NULL == dc->deferred)
+    return;
+  while (NULL != GNUNET_CONTAINER_heap_remove_root (dc->deferred))
+    ;
+  GNUNET_CONTAINER_heap_destroy (dc->deferred);
+  dc->deferred = NULL;
+}
+
+
 /**
  * Schedule the download of the specified block in the tree.
  *
@@ -834,6 +1047,91 @@ schedule_block_download (struct GNUNET_FS_DownloadContext *dc,
 }
 
 
+/**
+ * Read a deferred IBlock back from disk and request its children.
+ * If the block is no longer on disk, we download it again.
+ *
+ * @param dc overall download this block belongs to
+ * @param dr request for the IBlock
+ */
+static void
+expand_deferred (struct GNUNET_FS_DownloadContext *dc,
+                 struct DownloadRequest *dr)
+{
+  char block[DBLOCK_SIZE];
+  const struct ContentHashKey *chks;
+  const char *fn;
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_HashCode key;
+  struct DownloadRequest *drc;
+  uint64_t total;
+  uint64_t off;
+  size_t len;
+
+  if ( (BRS_DOWNLOAD_DOWN != dr->state) ||
+       (NULL != dr->children) )
+    return;                     /* already expanded */
+  total = GNUNET_FS_uri_chk_get_file_size (dc->uri);
+  len = GNUNET_FS_tree_calculate_block_size (total, dr->offset, dr->depth);
+  off = compute_disk_offset (total, dr->offset, dr->depth);
+  fn = (NULL != dc->filename) ? dc->filename : dc->temp_filename;
+  fh = (NULL == fn)
+    ? NULL
+    : GNUNET_DISK_file_open (fn,
+                             GNUNET_DISK_OPEN_READ,
+                             GNUNET_DISK_PERM_NONE);
+  if ( (NULL != fh) &&
+       (off == GNUNET_DISK_file_seek (fh, off, GNUNET_DISK_SEEK_SET)) &&
+       (len == GNUNET_DISK_file_read (fh, block, len)) )
+    GNUNET_CRYPTO_hash (block, len, &key);
+  else
+    memset (&key, 0, sizeof (key));
+  if (0 != memcmp (&key, &dr->chk.key, sizeof (struct GNUNET_HashCode)))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "IBlock at offset %llu and depth %u no longer on disk, downloading it again\n",
+                (unsigned long long) dr->offset,
+                dr->depth);
+    if (NULL != fh)
+      GNUNET_DISK_file_close (fh);
+    dr->state = BRS_CHK_SET;
+    schedule_block_download (dc, dr);
+    return;
+  }
+  GNUNET_DISK_file_close (fh);
+  chks = (const struct ContentHashKey *) block;
+  expand_download_request (dc, dr);
+  for (unsigned int i = 0; i < dr->num_children; i++)
+  {
+    drc = dr->children[i];
+    GNUNET_assert ((drc->chk_idx + 1) * sizeof (struct ContentHashKey) <= len);
+    drc->chk = chks[drc->chk_idx];
+    drc->state = BRS_CHK_SET;
+    schedule_block_download (dc, drc);
+  }
+}
+
+
+/**
+ * Request the children of deferred IBlocks as long as we do not
+ * have too many active requests.
+ *
+ * @param dc download to process
+ */
+static void
+resume_deferred (struct GNUNET_FS_DownloadContext *dc)
+{
+  struct DownloadRequest *dr;
+
+  if (NULL == dc->deferred)
+    return;
+  while ( (NULL != dc->active) &&
+          (GNUNET_CONTAINER_multihashmap_size (dc->active) < MAX_ACTIVE_REQUESTS) &&
+          (NULL != (dr = GNUNET_CONTAINER_heap_remove_root (dc->deferred))) )
+    expand_deferred (dc, dr);
+}
+
+
 #define GNUNET_FS_URI_CHK_PREFIX GNUNET_FS_URI_PREFIX GNUNET_FS_URI_CHK_INFIX
 
 /**
@@ -1028,6 +1326,7 @@ process_result_with_request (void *cls,
   size_t app;
   int i;
   struct ContentHashKey *chkarr;
+  int stored;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received %u byte block `%s' matching pending request at depth %u and offset %llu/%llu\n",
@@ -1059,6 +1358,7 @@ process_result_with_request (void *cls,
     goto signal_error;
   }
 
+  stored = GNUNET_NO;
   (void) GNUNET_CONTAINER_multihashmap_remove (dc->active,
                                                &prc->query,
                                                dr);
@@ -1126,6 +1426,7 @@ process_result_with_request (void *cls,
     }
     GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
     fh = NULL;
+    stored = GNUNET_YES;
   }
 
   if (0 == dr->depth)
@@ -1196,16 +1497,35 @@ process_result_with_request (void *cls,
   }
   if (0 == dr->depth)
   {
-    /* bottom of the tree, no child downloads possible, just sync */
-    GNUNET_FS_download_sync_ (dc);
+    /* bottom of the tree, no child downloads possible; free the
+       largest completed subtree this block belongs to and sync */
+    if (GNUNET_YES == prc->collapse)
+    {
+      while ( (NULL != dr->parent) &&
+              (BRS_DOWNLOAD_UP == dr->parent->state) )
+        dr = dr->parent;
+      collapse_download_request (dr);
+    }
+    download_sync_lazy (dc);
     return GNUNET_YES;
   }
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Triggering downloads of children (this block was at depth %u and offset %llu)\n",
               dr->depth, (unsigned long long) dr->offset);
+  if ( (GNUNET_YES == stored) &&
+       (GNUNET_YES == dc->issue_requests) &&
+       (GNUNET_CONTAINER_multihashmap_size (dc->active) >= MAX_ACTIVE_REQUESTS) )
+  {
+    /* enough requests in flight, we read this IBlock back from
+       disk once some of them are done */
+    defer_download_request (dc, dr);
+    download_sync_lazy (dc);
+    return GNUNET_YES;
+  }
   GNUNET_assert (0 == (prc->size % sizeof (struct ContentHashKey)));
   chkarr = (struct ContentHashKey *) pt;
+  expand_download_request (dc, dr);
   for (i = dr->num_children - 1; i >= 0; i--)
   {
     drc = dr->children[i];
@@ -1251,7 +1571,7 @@ process_result_with_request (void *cls,
       break;
     }
   }
-  GNUNET_FS_download_sync_ (dc);
+  download_sync_lazy (dc);
   return GNUNET_YES;
 
 signal_error:
@@ -1262,6 +1582,7 @@ signal_error:
   GNUNET_FS_download_make_status_ (&pi, dc);
   GNUNET_MQ_destroy (dc->mq);
   dc->mq = NULL;
+  clear_deferred (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   dc->top_request = NULL;
   GNUNET_CONTAINER_multihashmap_destroy (dc->active);
@@ -1313,6 +1634,7 @@ handle_put (void *cls,
   prc.size = msize;
   prc.type = ntohl (cm->type);
   prc.do_store = GNUNET_YES;
+  prc.collapse = GNUNET_YES;
   prc.respect_offered = ntohl (cm->respect_offered);
   prc.num_transmissions = ntohl (cm->num_transmissions);
   GNUNET_CRYPTO_hash (prc.data,
@@ -1325,6 +1647,7 @@ handle_put (void *cls,
                                               &prc.query,
                                               &process_result_with_request,
                                               &prc);
+  resume_deferred (dc);
 }
 
 
@@ -1471,96 +1794,6 @@ deactivate_fs_download (void *cls)
 }
 
 
-/**
- * (recursively) Create a download request structure.
- *
- * @param parent parent of the current entry
- * @param chk_idx index of the chk for this block in the parent block
- * @param depth depth of the current entry, 0 are the DBLOCKs,
- *              top level block is 'dc->treedepth - 1'
- * @param dr_offset offset in the original file this block maps to
- *              (as in, offset of the first byte of the first DBLOCK
- *               in the subtree rooted in the returned download request tree)
- * @param file_start_offset desired starting offset for the download
- *             in the original file; requesting tree should not contain
- *             DBLOCKs prior to the file_start_offset
- * @param desired_length desired number of bytes the user wanted to access
- *        (from file_start_offset).  Resulting tree should not contain
- *        DBLOCKs after file_start_offset + file_length.
- * @return download request tree for the given range of DBLOCKs at
- *         the specified depth
- */
-static struct DownloadRequest *
-create_download_request (struct DownloadRequest *parent,
-			 unsigned int chk_idx,
-			 unsigned int depth,
-                         uint64_t dr_offset,
-                         uint64_t file_start_offset,
-                         uint64_t desired_length)
-{
-  struct DownloadRequest *dr;
-  unsigned int i;
-  unsigned int head_skip;
-  uint64_t child_block_size;
-
-  dr = GNUNET_new (struct DownloadRequest);
-  dr->parent = parent;
-  dr->depth = depth;
-  dr->offset = dr_offset;
-  dr->chk_idx = chk_idx;
-  if (0 == depth)
-    return dr;
-  child_block_size = GNUNET_FS_tree_compute_tree_size (depth - 1);
-
-  /* calculate how many blocks at this level are not interesting
-   * from the start (rounded down), either because of the requested
-   * file offset or because this IBlock is further along */
-  if (dr_offset < file_start_offset)
-  {
-    head_skip = (file_start_offset - dr_offset) / child_block_size;
-  }
-  else
-  {
-    head_skip = 0;
-  }
-
-  /* calculate index of last block at this level that is interesting (rounded up) */
-  dr->num_children = (file_start_offset + desired_length - dr_offset) / child_block_size;
-  if (dr->num_children * child_block_size <
-      file_start_offset + desired_length - dr_offset)
-    dr->num_children++;       /* round up */
-  GNUNET_assert (dr->num_children > head_skip);
-  dr->num_children -= head_skip;
-  if (dr->num_children > CHK_PER_INODE)
-    dr->num_children = CHK_PER_INODE; /* cap at max */
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Block at offset %llu and depth %u has %u children\n",
-	      (unsigned long long) dr_offset,
-	      depth,
-	      dr->num_children);
-
-  /* now we can get the total number of *interesting* children for this block */
-
-  /* why else would we have gotten here to begin with? (that'd be a bad logic error) */
-  GNUNET_assert (dr->num_children > 0);
-
-  dr->children =
-    GNUNET_new_array (dr->num_children,
-                      struct DownloadRequest *);
-  for (i = 0; i < dr->num_children; i++)
-  {
-    dr->children[i] =
-      create_download_request (dr,
-                               i + head_skip,
-                               depth - 1,
-			       dr_offset + (i + head_skip) * child_block_size,
-			       file_start_offset,
-                               desired_length);
-  }
-  return dr;
-}
-
-
 /**
  * Continuation after a possible attempt to reconstruct
  * the current IBlock from the existing file.
@@ -1588,6 +1821,7 @@ reconstruct_cont (void *cls)
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Starting normal download\n");
   schedule_block_download (dc, dc->top_request);
+  resume_deferred (dc);
 }
 
 
@@ -1642,7 +1876,13 @@ reconstruct_cb (void *cls,
   dr = dc->top_request;
   while (dr->depth > depth)
   {
-    GNUNET_assert (dr->num_children > 0);
+    if (0 == dr->num_children)
+    {
+      /* subtree is complete or we do not know its CHKs yet */
+      dc->task = GNUNET_SCHEDULER_add_now (&get_next_block,
+                                           dc);
+      return;
+    }
     blen = GNUNET_FS_tree_compute_tree_size (dr->depth - 1);
     chld = (offset - dr->offset) / blen;
     if (chld < dr->children[0]->chk_idx)
@@ -1696,6 +1936,7 @@ reconstruct_cb (void *cls,
       (void) GNUNET_CONTAINER_multihashmap_remove (dc->active,
                                                    &dr->chk.query,
                                                    dr);
+      collapse_download_request (dr);
       /* calculate how many bytes of payload this block
        * corresponds to */
       blen = GNUNET_FS_tree_compute_tree_size (dr->depth);
@@ -1837,8 +2078,7 @@ GNUNET_FS_download_start_task_ (void *cls)
   if (NULL == dc->top_request)
   {
     dc->top_request =
-      create_download_request (NULL, 0, dc->treedepth - 1, 0, dc->offset,
-			       dc->length);
+      create_download_request (NULL, 0, dc->treedepth - 1, 0);
     dc->top_request->state = BRS_CHK_SET;
     dc->top_request->chk =
         (dc->uri->type ==
@@ -1865,6 +2105,7 @@ GNUNET_FS_download_start_task_ (void *cls)
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                   "Trying top-down reconstruction for `%s'\n", dc->filename);
       try_top_down_reconstruction (dc, dc->top_request);
+      collapse_completed (dc->top_request);
       switch (dc->top_request->state)
       {
       case BRS_CHK_SET:
@@ -1937,6 +2178,7 @@ GNUNET_FS_download_start_task_ (void *cls)
     /* simple, top-level download */
     dc->issue_requests = GNUNET_YES;
     schedule_block_download (dc, dc->top_request);
+    resume_deferred (dc);
   }
   if (BRS_DOWNLOAD_UP == dc->top_request->state)
     check_completed (dc);
@@ -1977,6 +2219,8 @@ GNUNET_FS_download_signal_suspend_ (void *cls)
     GNUNET_SCHEDULER_cancel (dc->task);
     dc->task = NULL;
   }
+  if (0 != dc->unsynced_blocks)
+    GNUNET_FS_download_sync_ (dc);
   pi.status = GNUNET_FS_STATUS_DOWNLOAD_SUSPEND;
   GNUNET_FS_download_make_status_ (&pi, dc);
   if (NULL != dc->te)
@@ -1989,6 +2233,7 @@ GNUNET_FS_download_signal_suspend_ (void *cls)
     GNUNET_DISK_file_close (dc->rfh);
     dc->rfh = NULL;
   }
+  clear_deferred (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   if (NULL != dc->active)
   {
@@ -2361,6 +2606,7 @@ GNUNET_FS_download_stop (struct GNUNET_FS_DownloadContext *dc,
                                 dc->serialization);
   pi.status = GNUNET_FS_STATUS_DOWNLOAD_STOPPED;
   GNUNET_FS_download_make_status_ (&pi, dc);
+  clear_deferred (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   dc->top_request = NULL;
   if (NULL != dc->active)
@@ -26,6 +26,76 @@
  */
 #include "platform.h"
 #include "fs_tree.h"
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/**
+ * How many DBLOCKs do we read ahead and encode as one batch?
+ */
+#define LEAVES_PER_BATCH 64
+
+
+/**
+ * A batch of consecutive DBLOCKs of the file.  The encoder reads
+ * DBLOCKs ahead into a batch; they are hashed and encrypted by the
+ * worker threads (and by the main thread while it waits) and handed
+ * to the client in order.
+ */
+struct LeafBatch
+{
+
+  /**
+   * Plaintext of the DBLOCKs, #DBLOCK_SIZE bytes per block.
+   */
+  char *plaintext;
+
+  /**
+   * Encrypted DBLOCKs, #DBLOCK_SIZE bytes per block.
+   */
+  char *ciphertext;
+
+  /**
+   * Error message from the reader if @e read_failed.
+   */
+  char *emsg;
+
+  /**
+   * Index of the first DBLOCK of the batch in the file.
+   */
+  uint64_t first_leaf;
+
+  /**
+   * CHKs of the DBLOCKs.
+   */
+  struct ContentHashKey chks[LEAVES_PER_BATCH];
+
+  /**
+   * Sizes of the DBLOCKs.
+   */
+  uint16_t sizes[LEAVES_PER_BATCH];
+
+  /**
+   * #GNUNET_YES for DBLOCKs that have been encrypted.
+   */
+  int ready[LEAVES_PER_BATCH];
+
+  /**
+   * Number of DBLOCKs read into the batch.
+   */
+  unsigned int count;
+
+  /**
+   * Index of the first DBLOCK nobody started to encrypt yet.
+   */
+  unsigned int next_job;
+
+  /**
+   * #GNUNET_YES if reading the DBLOCK after the last one
+   * of the batch failed.
+   */
+  int read_failed;
+};
 
 
 /**
@@ -108,11 +178,79 @@ struct GNUNET_FS_TreeEncoder
    */
   struct ContentHashKey *chk_tree;
 
+  /**
+   * DBLOCKs read ahead; one batch is handed to the client while
+   * the other one is prepared.
+   */
+  struct LeafBatch batches[2];
+
+  /**
+   * Index of the batch in @e batches we are handing out.
+   */
+  unsigned int current_batch;
+
+  /**
+   * Number of DBLOCKs in the file.
+   */
+  uint64_t num_leaves;
+
+  /**
+   * Number of DBLOCKs we have read so far.
+   */
+  uint64_t leaves_read;
+
+  /**
+   * Number of worker threads to use for encrypting DBLOCKs.
+   */
+  unsigned int num_threads;
+
   /**
    * Are we currently in 'GNUNET_FS_tree_encoder_next'?
    * Flag used to prevent recursion.
    */
   int in_next;
+
+  /**
+   * #GNUNET_YES once we started reading DBLOCKs into @e batches.
+   */
+  int batches_started;
+
+  /**
+   * #GNUNET_YES if the reader failed, so we must not read ahead.
+   */
+  int read_failed;
+
+#if HAVE_PTHREAD_H
+  /**
+   * Array of @e num_workers worker threads.
+   */
+  pthread_t *workers;
+
+  /**
+   * Number of worker threads we actually started.
+   */
+  unsigned int num_workers;
+
+  /**
+   * Protects the job state of @e batches.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Signalled when new DBLOCKs were read or the workers should stop.
+   */
+  pthread_cond_t work_cond;
+
+  /**
+   * Signalled when a DBLOCK was encrypted.
+   */
+  pthread_cond_t done_cond;
+
+  /**
+   * #GNUNET_YES if the workers should terminate.
+   */
+  int stop;
+#endif
 };
 
 
@@ -249,6 +387,25 @@ GNUNET_FS_tree_calculate_block_size (uint64_t fsize, uint64_t offset,
 }
 
 
+/**
+ * Determine how many worker threads to use by default.  The main
+ * thread encrypts DBLOCKs as well while it waits for the workers.
+ *
+ * @return number of online CPUs minus one
+ */
+static unsigned int
+default_thread_count ()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 1)
+    return (unsigned int) (n - 1);
+#endif
+  return 0;
+}
+
+
 /**
  * Initialize a tree encoder.  This function will call @a proc and
  * "progress" on each block in the tree.  Once all blocks have been
@@ -288,6 +445,8 @@ GNUNET_FS_tree_encoder_create (struct GNUNET_FS_Handle *h, uint64_t size,
   te->chk_tree
     = GNUNET_new_array (te->chk_tree_depth * CHK_PER_INODE,
                         struct ContentHashKey);
+  te->num_leaves = (0 == size) ? 1 : (size + DBLOCK_SIZE - 1) / DBLOCK_SIZE;
+  te->num_threads = default_thread_count ();
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Created tree encoder for file with %llu bytes and depth %u\n",
 	      (unsigned long long) size,
@@ -321,6 +480,384 @@ compute_chk_offset (unsigned int depth, uint64_t end_offset)
 }
 
 
+/**
+ * Set the number of worker threads the encoder uses to encrypt
+ * DBLOCKs.  Must be called before the first call to
+ * #GNUNET_FS_tree_encoder_next.
+ *
+ * @param te tree encoder to configure
+ * @param num_threads number of worker threads, 0 to encrypt
+ *        everything in the calling thread
+ */
+void
+GNUNET_FS_tree_encoder_set_threads (struct GNUNET_FS_TreeEncoder *te,
+                                    unsigned int num_threads)
+{
+  GNUNET_assert (GNUNET_NO == te->batches_started);
+  te->num_threads = num_threads;
+}
+
+
+/**
+ * Compute the CHK of a block and encrypt it.
+ *
+ * @param pt_block plaintext of the block
+ * @param pt_size number of bytes in @a pt_block
+ * @param[out] chk set to the CHK of the block
+ * @param[out] enc set to the encrypted block, @a pt_size bytes
+ */
+static void
+encrypt_block (const void *pt_block,
+               uint16_t pt_size,
+               struct ContentHashKey *chk,
+               char *enc)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+
+  GNUNET_CRYPTO_hash (pt_block, pt_size, &chk->key);
+  GNUNET_CRYPTO_hash_to_aes_key (&chk->key, &sk, &iv);
+  GNUNET_CRYPTO_symmetric_encrypt (pt_block, pt_size, &sk, &iv, enc);
+  GNUNET_CRYPTO_hash (enc, pt_size, &chk->query);
+}
+
+
+/**
+ * Lock the job state of the batches.
+ *
+ * @param te tree encoder to lock
+ */
+static void
+lock_batches (struct GNUNET_FS_TreeEncoder *te)
+{
+#if HAVE_PTHREAD_H
+  if (0 != te->num_workers)
+    GNUNET_assert (0 == pthread_mutex_lock (&te->lock));
+#endif
+}
+
+
+/**
+ * Unlock the job state of the batches.
+ *
+ * @param te tree encoder to unlock
+ */
+static void
+unlock_batches (struct GNUNET_FS_TreeEncoder *te)
+{
+#if HAVE_PTHREAD_H
+  if (0 != te->num_workers)
+    GNUNET_assert (0 == pthread_mutex_unlock (&te->lock));
+#endif
+}
+
+
+/**
+ * Claim a DBLOCK for encryption, preferring the batch the client
+ * is waiting for.  Must be called with the batches locked.
+ *
+ * @param te tree encoder
+ * @param[out] idx set to the index of the DBLOCK in the batch
+ * @return batch of the DBLOCK, NULL if there is nothing to do
+ */
+static struct LeafBatch *
+claim_leaf (struct GNUNET_FS_TreeEncoder *te,
+            unsigned int *idx)
+{
+  struct LeafBatch *b;
+  unsigned int i;
+
+  for (i = 0; i < 2; i++)
+  {
+    b = &te->batches[(te->current_batch + i) % 2];
+    if (b->next_job < b->count)
+    {
+      *idx = b->next_job++;
+      return b;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * Encrypt a claimed DBLOCK and mark it as ready.  Must be called
+ * with the batches unlocked, returns with the batches locked.
+ *
+ * @param te tree encoder
+ * @param b batch of the DBLOCK
+ * @param idx index of the DBLOCK in @a b
+ */
+static void
+encrypt_leaf (struct GNUNET_FS_TreeEncoder *te,
+              struct LeafBatch *b,
+              unsigned int idx)
+{
+  encrypt_block (&b->plaintext[idx * DBLOCK_SIZE],
+                 b->sizes[idx],
+                 &b->chks[idx],
+                 &b->ciphertext[idx * DBLOCK_SIZE]);
+  lock_batches (te);
+  b->ready[idx] = GNUNET_YES;
+#if HAVE_PTHREAD_H
+  if (0 != te->num_workers)
+    GNUNET_assert (0 == pthread_cond_broadcast (&te->done_cond));
+#endif
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Main function of a worker thread: encrypt DBLOCKs until
+ * the encoder is finished.
+ *
+ * @param cls the `struct GNUNET_FS_TreeEncoder`
+ * @return NULL
+ */
+static void *
+worker_main (void *cls)
+{
+  struct GNUNET_FS_TreeEncoder *te = cls;
+  struct LeafBatch *b;
+  unsigned int idx;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&te->lock));
+  while (GNUNET_NO == te->stop)
+  {
+    b = claim_leaf (te, &idx);
+    if (NULL == b)
+    {
+      GNUNET_assert (0 == pthread_cond_wait (&te->work_cond,
+                                             &te->lock));
+      continue;
+    }
+    GNUNET_assert (0 == pthread_mutex_unlock (&te->lock));
+    encrypt_leaf (te, b, idx);
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&te->lock));
+  return NULL;
+}
+
+
+/**
+ * Start the worker threads.  If no thread can be started, the
+ * calling thread encrypts all DBLOCKs.
+ *
+ * @param te tree encoder to start the workers for
+ */
+static void
+start_workers (struct GNUNET_FS_TreeEncoder *te)
+{
+  unsigned int i;
+
+  GNUNET_assert (0 == pthread_mutex_init (&te->lock,
+                                          NULL));
+  GNUNET_assert (0 == pthread_cond_init (&te->work_cond,
+                                         NULL));
+  GNUNET_assert (0 == pthread_cond_init (&te->done_cond,
+                                         NULL));
+  te->workers = GNUNET_new_array (te->num_threads,
+                                  pthread_t);
+  for (i = 0; i < te->num_threads; i++)
+  {
+    if (0 != pthread_create (&te->workers[te->num_workers],
+                             NULL,
+                             &worker_main,
+                             te))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "pthread_create");
+      break;
+    }
+    te->num_workers++;
+  }
+  if (0 == te->num_workers)
+  {
+    GNUNET_free (te->workers);
+    te->workers = NULL;
+    GNUNET_assert (0 == pthread_cond_destroy (&te->done_cond));
+    GNUNET_assert (0 == pthread_cond_destroy (&te->work_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&te->lock));
+  }
+}
+
+
+/**
+ * Stop and join the worker threads.
+ *
+ * @param te tree encoder to stop the workers of
+ */
+static void
+stop_workers (struct GNUNET_FS_TreeEncoder *te)
+{
+  unsigned int i;
+
+  if (0 == te->num_workers)
+    return;
+  GNUNET_assert (0 == pthread_mutex_lock (&te->lock));
+  te->stop = GNUNET_YES;
+  GNUNET_assert (0 == pthread_cond_broadcast (&te->work_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&te->lock));
+  for (i = 0; i < te->num_workers; i++)
+    GNUNET_assert (0 == pthread_join (te->workers[i],
+                                      NULL));
+  te->num_workers = 0;
+  GNUNET_free (te->workers);
+  te->workers = NULL;
+  GNUNET_assert (0 == pthread_cond_destroy (&te->done_cond));
+  GNUNET_assert (0 == pthread_cond_destroy (&te->work_cond));
+  GNUNET_assert (0 == pthread_mutex_destroy (&te->lock));
+}
+#endif
+
+
+/**
+ * Read the next DBLOCKs of the file into batch @a b.  The batch
+ * must not contain DBLOCKs the client has not yet processed.
+ *
+ * @param te tree encoder
+ * @param b batch to fill
+ */
+static void
+fill_batch (struct GNUNET_FS_TreeEncoder *te,
+            struct LeafBatch *b)
+{
+  uint64_t offset;
+  uint16_t pt_size;
+
+  lock_batches (te);
+  b->first_leaf = te->leaves_read;
+  b->count = 0;
+  b->next_job = 0;
+  unlock_batches (te);
+  b->read_failed = GNUNET_NO;
+  while ( (b->count < LEAVES_PER_BATCH) &&
+          (te->leaves_read < te->num_leaves) &&
+          (GNUNET_NO == te->read_failed) )
+  {
+    offset = te->leaves_read * DBLOCK_SIZE;
+    pt_size = GNUNET_MIN (DBLOCK_SIZE, te->size - offset);
+    if (pt_size !=
+        te->reader (te->cls,
+                    offset,
+                    pt_size,
+                    &b->plaintext[b->count * DBLOCK_SIZE],
+                    &b->emsg))
+    {
+      b->read_failed = GNUNET_YES;
+      te->read_failed = GNUNET_YES;
+      break;
+    }
+    te->leaves_read++;
+    lock_batches (te);
+    b->sizes[b->count] = pt_size;
+    b->ready[b->count] = GNUNET_NO;
+    b->count++;
+#if HAVE_PTHREAD_H
+    if (0 != te->num_workers)
+      GNUNET_assert (0 == pthread_cond_signal (&te->work_cond));
+#endif
+    unlock_batches (te);
+  }
+}
+
+
+/**
+ * Allocate the batches, start the workers and read the first
+ * DBLOCKs.  The second batch is only needed for larger files.
+ *
+ * @param te tree encoder
+ */
+static void
+start_batches (struct GNUNET_FS_TreeEncoder *te)
+{
+  unsigned int capacity;
+  unsigned int i;
+
+  te->batches_started = GNUNET_YES;
+  capacity = (unsigned int) GNUNET_MIN (te->num_leaves,
+                                        LEAVES_PER_BATCH);
+  for (i = 0; i < 2; i++)
+  {
+    if ( (1 == i) &&
+         (te->num_leaves <= LEAVES_PER_BATCH) )
+      break;
+    te->batches[i].plaintext = GNUNET_malloc (capacity * DBLOCK_SIZE);
+    te->batches[i].ciphertext = GNUNET_malloc (capacity * DBLOCK_SIZE);
+  }
+#if HAVE_PTHREAD_H
+  if ( (0 < te->num_threads) &&
+       (1 < te->num_leaves) )
+    start_workers (te);
+#endif
+  fill_batch (te, &te->batches[0]);
+  fill_batch (te, &te->batches[1]);
+}
+
+
+/**
+ * Get the encrypted DBLOCK with index @a leaf, reading ahead and
+ * waiting for (or helping) the workers as needed.  DBLOCKs must be
+ * requested in order.
+ *
+ * @param te tree encoder
+ * @param leaf index of the DBLOCK in the file
+ * @param[out] idx set to the index of the DBLOCK in the batch
+ * @return batch with the DBLOCK, NULL if reading it failed
+ *         (then te->emsg is set from the reader)
+ */
+static struct LeafBatch *
+get_leaf (struct GNUNET_FS_TreeEncoder *te,
+          uint64_t leaf,
+          unsigned int *idx)
+{
+  struct LeafBatch *b;
+  struct LeafBatch *jb;
+  unsigned int ji;
+
+  if (GNUNET_NO == te->batches_started)
+    start_batches (te);
+  b = &te->batches[te->current_batch];
+  if ( (leaf >= b->first_leaf + b->count) &&
+       (GNUNET_NO == b->read_failed) )
+  {
+    /* the client is done with this batch, move on to the next
+       one and reuse this one for reading ahead */
+    te->current_batch = (te->current_batch + 1) % 2;
+    fill_batch (te, b);
+    b = &te->batches[te->current_batch];
+  }
+  if (leaf >= b->first_leaf + b->count)
+  {
+    GNUNET_assert (GNUNET_YES == b->read_failed);
+    te->emsg = b->emsg;
+    b->emsg = NULL;
+    return NULL;
+  }
+  *idx = (unsigned int) (leaf - b->first_leaf);
+  lock_batches (te);
+  while (GNUNET_NO == b->ready[*idx])
+  {
+    jb = claim_leaf (te, &ji);
+    if (NULL != jb)
+    {
+      unlock_batches (te);
+      encrypt_leaf (te, jb, ji);
+      continue;
+    }
+#if HAVE_PTHREAD_H
+    GNUNET_assert (0 != te->num_workers);
+    GNUNET_assert (0 == pthread_cond_wait (&te->done_cond,
+                                           &te->lock));
+#else
+    GNUNET_assert (0);
+#endif
+  }
+  unlock_batches (te);
+  return b;
+}
+
+
 /**
  * Encrypt the next block of the file (and call proc and progress
  * accordingly; or of course "cont" if we have already completed
@@ -332,13 +869,13 @@ void
 GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
 {
   struct ContentHashKey *mychk;
+  struct LeafBatch *b;
   const void *pt_block;
+  const char *enc;
   uint16_t pt_size;
   char iob[DBLOCK_SIZE];
-  char enc[DBLOCK_SIZE];
-  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
-  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
   unsigned int off;
+  unsigned int idx;
 
   GNUNET_assert (GNUNET_NO == te->in_next);
   te->in_next = GNUNET_YES;
@@ -355,18 +892,22 @@ GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
     te->cont (te->cls);
     return;
   }
+  off = compute_chk_offset (te->current_depth, te->publish_offset);
+  mychk = &te->chk_tree[te->current_depth * CHK_PER_INODE + off];
   if (0 == te->current_depth)
   {
-    /* read DBLOCK */
-    pt_size = GNUNET_MIN (DBLOCK_SIZE, te->size - te->publish_offset);
-    if (pt_size !=
-        te->reader (te->cls, te->publish_offset, pt_size, iob, &te->emsg))
+    /* DBLOCK, read ahead and encrypted in a batch */
+    b = get_leaf (te, te->publish_offset / DBLOCK_SIZE, &idx);
+    if (NULL == b)
     {
       te->in_next = GNUNET_NO;
       te->cont (te->cls);
       return;
     }
-    pt_block = iob;
+    pt_size = b->sizes[idx];
+    pt_block = &b->plaintext[idx * DBLOCK_SIZE];
+    enc = &b->ciphertext[idx * DBLOCK_SIZE];
+    *mychk = b->chks[idx];
   }
   else
   {
@@ -374,17 +915,13 @@ GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
         GNUNET_FS_tree_compute_iblock_size (te->current_depth,
                                             te->publish_offset);
     pt_block = &te->chk_tree[(te->current_depth - 1) * CHK_PER_INODE];
+    encrypt_block (pt_block, pt_size, mychk, iob);
+    enc = iob;
   }
-  off = compute_chk_offset (te->current_depth, te->publish_offset);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "TE is at offset %llu and depth %u with block size %u and target-CHK-offset %u\n",
               (unsigned long long) te->publish_offset, te->current_depth,
               (unsigned int) pt_size, (unsigned int) off);
-  mychk = &te->chk_tree[te->current_depth * CHK_PER_INODE + off];
-  GNUNET_CRYPTO_hash (pt_block, pt_size, &mychk->key);
-  GNUNET_CRYPTO_hash_to_aes_key (&mychk->key, &sk, &iv);
-  GNUNET_CRYPTO_symmetric_encrypt (pt_block, pt_size, &sk, &iv, enc);
-  GNUNET_CRYPTO_hash (enc, pt_size, &mychk->query);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "TE calculates query to be `%s', stored at %u\n",
               GNUNET_h2s (&mychk->query),
@@ -444,12 +981,23 @@ void
 GNUNET_FS_tree_encoder_finish (struct GNUNET_FS_TreeEncoder *te,
 			       char **emsg)
 {
+  unsigned int i;
+
   if (NULL != te->reader)
   {
     (void) te->reader (te->cls, UINT64_MAX, 0, 0, NULL);
     te->reader =  NULL;
   }
   GNUNET_assert (GNUNET_NO == te->in_next);
+#if HAVE_PTHREAD_H
+  stop_workers (te);
+#endif
+  for (i = 0; i < 2; i++)
+  {
+    GNUNET_free_non_null (te->batches[i].plaintext);
+    GNUNET_free_non_null (te->batches[i].ciphertext);
+    GNUNET_free_non_null (te->batches[i].emsg);
+  }
   if (NULL != te->uri)
     GNUNET_FS_uri_destroy (te->uri);
   if (emsg != NULL)
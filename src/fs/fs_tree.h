@@ -145,6 +145,21 @@ GNUNET_FS_tree_encoder_create (struct GNUNET_FS_Handle *h, uint64_t size,
                                GNUNET_SCHEDULER_TaskCallback cont);
 
 
+/**
+ * Set the number of worker threads the encoder uses to encrypt
+ * DBLOCKs.  By default, the encoder uses one thread per additional
+ * CPU.  Must be called before the first call to
+ * #GNUNET_FS_tree_encoder_next.
+ *
+ * @param te tree encoder to configure
+ * @param num_threads number of worker threads, 0 to encrypt
+ *        everything in the calling thread
+ */
+void
+GNUNET_FS_tree_encoder_set_threads (struct GNUNET_FS_TreeEncoder *te,
+                                    unsigned int num_threads);
+
+
 /**
  * Encrypt the next block of the file (and
  * call proc and progress accordingly; or
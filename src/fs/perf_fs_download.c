@@ -0,0 +1,471 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file fs/perf_fs_download.c
+ * @brief measure memory use and persistence cost of a large local
+ *        (indexed) download with persistence enabled
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_fs_service.h"
+#include "gnunet_testing_lib.h"
+#include "fs_api.h"
+#include <gauger.h>
+
+/**
+ * Default size of the file in MiB, can be overridden on the
+ * command line.
+ */
+#define DEFAULT_SIZE_MB 64
+
+/**
+ * How often do we sync the download explicitly to measure
+ * the cost of a single sync?
+ */
+#define SYNC_ROUNDS 16
+
+/**
+ * How long until we give up?
+ */
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 30)
+
+/**
+ * How long should our test-content live?
+ */
+#define LIFETIME GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 60)
+
+static uint64_t filesize;
+
+static struct GNUNET_TIME_Absolute start;
+
+static struct GNUNET_FS_Handle *fs;
+
+static struct GNUNET_FS_DownloadContext *download;
+
+static struct GNUNET_FS_PublishContext *publish;
+
+static struct GNUNET_SCHEDULER_Task *timeout_kill;
+
+/**
+ * Name of the file we publish.
+ */
+static char *src_fn;
+
+/**
+ * Name of the file we download to.
+ */
+static char *dst_fn;
+
+/**
+ * Maximum number of download requests in memory at any time.
+ */
+static unsigned long long max_nodes;
+
+/**
+ * Resident set size (in KiB) when the download started.
+ */
+static long rss_start;
+
+/**
+ * Largest resident set size (in KiB) we saw during the download.
+ */
+static long rss_max;
+
+/**
+ * Number of progress events we got.
+ */
+static unsigned long long num_progress;
+
+/**
+ * Have we measured the cost of a sync yet?
+ */
+static int sync_measured;
+
+static int err;
+
+
+/**
+ * Return the current resident set size of this process in KiB.
+ */
+static long
+get_rss ()
+{
+  FILE *f;
+  long pages;
+  long rss;
+
+  f = FOPEN ("/proc/self/statm", "r");
+  if (NULL == f)
+    return 0;
+  if (2 != fscanf (f, "%ld %ld", &pages, &rss))
+    rss = 0;
+  FCLOSE (f);
+  return rss * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+
+/**
+ * Count the download requests in memory.
+ *
+ * @param dr root of the (sub)tree
+ * @return number of nodes in the tree
+ */
+static unsigned long long
+count_nodes (const struct DownloadRequest *dr)
+{
+  unsigned long long ret;
+
+  if (NULL == dr)
+    return 0;
+  ret = 1;
+  for (unsigned int i = 0; i < dr->num_children; i++)
+    ret += count_nodes (dr->children[i]);
+  return ret;
+}
+
+
+/**
+ * Half way through the download, measure how long it takes to
+ * write the download to disk and how large the result is.
+ *
+ * @param dc download to sync
+ */
+static void
+measure_sync (struct GNUNET_FS_DownloadContext *dc)
+{
+  struct GNUNET_TIME_Absolute sstart;
+  struct GNUNET_TIME_Relative duration;
+  char *dir;
+  char *fn;
+  uint64_t size;
+
+  sstart = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < SYNC_ROUNDS; i++)
+    GNUNET_FS_download_sync_ (dc);
+  duration = GNUNET_TIME_absolute_get_duration (sstart);
+  size = 0;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (dc->h->cfg,
+                                                          "fs",
+                                                          "STATE_DIR",
+                                                          &dir));
+  GNUNET_asprintf (&fn,
+                   "%s%s%s%s%s%s%s",
+                   dir,
+                   DIR_SEPARATOR_STR,
+                   dc->h->client_name,
+                   DIR_SEPARATOR_STR,
+                   GNUNET_FS_SYNC_PATH_MASTER_DOWNLOAD,
+                   DIR_SEPARATOR_STR,
+                   dc->serialization);
+  (void) GNUNET_DISK_file_size (fn,
+                                &size,
+                                GNUNET_YES,
+                                GNUNET_YES);
+  GNUNET_free (fn);
+  GNUNET_free (dir);
+  printf ("Sync at %llu%%: %llu bytes, %llu us per sync, %llu nodes in memory\n",
+          (unsigned long long) (dc->completed * 100 / dc->length),
+          (unsigned long long) size,
+          (unsigned long long) (duration.rel_value_us / SYNC_ROUNDS),
+          count_nodes (dc->top_request));
+  GAUGER ("FS",
+          "Download sync size",
+          size / 1024,
+          "KiB");
+  GAUGER ("FS",
+          "Download sync time",
+          duration.rel_value_us / SYNC_ROUNDS,
+          "us");
+}
+
+
+/**
+ * Check that the file we downloaded matches the original.
+ *
+ * @return #GNUNET_OK if both files are equal
+ */
+static int
+check_download ()
+{
+  struct GNUNET_DISK_FileHandle *src;
+  struct GNUNET_DISK_FileHandle *dst;
+  char sbuf[DBLOCK_SIZE];
+  char dbuf[DBLOCK_SIZE];
+  ssize_t ret;
+  int ok;
+
+  src = GNUNET_DISK_file_open (src_fn,
+                               GNUNET_DISK_OPEN_READ,
+                               GNUNET_DISK_PERM_NONE);
+  dst = GNUNET_DISK_file_open (dst_fn,
+                               GNUNET_DISK_OPEN_READ,
+                               GNUNET_DISK_PERM_NONE);
+  ok = (NULL != src) && (NULL != dst);
+  while (ok)
+  {
+    ret = GNUNET_DISK_file_read (src, sbuf, sizeof (sbuf));
+    ok = (ret == GNUNET_DISK_file_read (dst, dbuf, sizeof (dbuf))) &&
+      (ret >= 0) &&
+      (0 == memcmp (sbuf, dbuf, ret));
+    if (ret <= 0)
+      break;
+  }
+  if (NULL != src)
+    GNUNET_DISK_file_close (src);
+  if (NULL != dst)
+    GNUNET_DISK_file_close (dst);
+  return ok ? GNUNET_OK : GNUNET_SYSERR;
+}
+
+
+static void
+timeout_kill_task (void *cls)
+{
+  timeout_kill = NULL;
+  GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+              "Timeout downloading file\n");
+  err = 1;
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+static void
+do_shutdown (void *cls)
+{
+  if (NULL != timeout_kill)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_kill);
+    timeout_kill = NULL;
+  }
+  if (NULL != download)
+  {
+    GNUNET_FS_download_stop (download,
+                             GNUNET_YES);
+    download = NULL;
+  }
+  if (NULL != publish)
+  {
+    GNUNET_FS_publish_stop (publish);
+    publish = NULL;
+  }
+  if (NULL != fs)
+  {
+    GNUNET_FS_stop (fs);
+    fs = NULL;
+  }
+  if (NULL != dst_fn)
+  {
+    GNUNET_DISK_directory_remove (dst_fn);
+    GNUNET_free (dst_fn);
+    dst_fn = NULL;
+  }
+}
+
+
+static void *
+progress_cb (void *cls,
+             const struct GNUNET_FS_ProgressInfo *event)
+{
+  struct GNUNET_TIME_Relative duration;
+  unsigned long long nodes;
+
+  switch (event->status)
+  {
+  case GNUNET_FS_STATUS_PUBLISH_COMPLETED:
+    duration = GNUNET_TIME_absolute_get_duration (start);
+    printf ("Publishing %llu MiB took %s\n",
+            (unsigned long long) (filesize / 1024 / 1024),
+            GNUNET_STRINGS_relative_time_to_string (duration,
+                                                    GNUNET_YES));
+    dst_fn = GNUNET_DISK_mktemp ("gnunet-perf-download-dst");
+    rss_start = get_rss ();
+    rss_max = rss_start;
+    start = GNUNET_TIME_absolute_get ();
+    download
+      = GNUNET_FS_download_start (fs,
+                                  event->value.publish.specifics.completed.chk_uri,
+                                  NULL,
+                                  dst_fn,
+                                  NULL,
+                                  0,
+                                  filesize,
+                                  0,
+                                  GNUNET_FS_DOWNLOAD_OPTION_NONE,
+                                  "download",
+                                  NULL);
+    GNUNET_assert (NULL != download);
+    break;
+  case GNUNET_FS_STATUS_DOWNLOAD_PROGRESS:
+    num_progress++;
+    if (0 == (num_progress % 64))
+    {
+      nodes = count_nodes (event->value.download.dc->top_request);
+      max_nodes = GNUNET_MAX (max_nodes,
+                              nodes);
+      rss_max = GNUNET_MAX (rss_max,
+                            get_rss ());
+    }
+    if ( (GNUNET_NO == sync_measured) &&
+         (event->value.download.completed * 2 >= filesize) )
+    {
+      sync_measured = GNUNET_YES;
+      measure_sync (event->value.download.dc);
+    }
+    break;
+  case GNUNET_FS_STATUS_DOWNLOAD_COMPLETED:
+    duration = GNUNET_TIME_absolute_get_duration (start);
+    printf ("Download of %llu MiB took %s (%llu KiB/s)\n",
+            (unsigned long long) (filesize / 1024 / 1024),
+            GNUNET_STRINGS_relative_time_to_string (duration,
+                                                    GNUNET_YES),
+            (unsigned long long) (filesize * 1000000LL /
+                                  (1 + duration.rel_value_us) / 1024LL));
+    printf ("At most %llu download requests (%llu KiB) in memory, RSS grew by up to %ld KiB\n",
+            max_nodes,
+            (unsigned long long) (max_nodes * sizeof (struct DownloadRequest) / 1024),
+            rss_max - rss_start);
+    GAUGER ("FS",
+            "Large download RSS growth",
+            rss_max - rss_start,
+            "KiB");
+    if (GNUNET_OK != check_download ())
+    {
+      FPRINTF (stderr,
+               "Downloaded file differs from the original\n");
+      err = 1;
+    }
+    GNUNET_SCHEDULER_shutdown ();
+    break;
+  case GNUNET_FS_STATUS_PUBLISH_ERROR:
+    FPRINTF (stderr,
+             "Error publishing file: %s\n",
+             event->value.publish.specifics.error.message);
+    err = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    break;
+  case GNUNET_FS_STATUS_DOWNLOAD_ERROR:
+    FPRINTF (stderr,
+             "Error downloading file: %s\n",
+             event->value.download.specifics.error.message);
+    err = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    break;
+  case GNUNET_FS_STATUS_DOWNLOAD_STOPPED:
+    download = NULL;
+    break;
+  case GNUNET_FS_STATUS_PUBLISH_STOPPED:
+    publish = NULL;
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *cfg,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  struct GNUNET_CONTAINER_MetaData *meta;
+  struct GNUNET_FS_FileInformation *fi;
+  struct GNUNET_FS_BlockOptions bo;
+
+  fs = GNUNET_FS_start (cfg,
+                        "perf-fs-download",
+                        &progress_cb,
+                        NULL,
+                        GNUNET_FS_FLAGS_PERSISTENCE,
+                        GNUNET_FS_OPTIONS_END);
+  GNUNET_assert (NULL != fs);
+  GNUNET_SCHEDULER_add_shutdown (&do_shutdown,
+                                 NULL);
+  meta = GNUNET_CONTAINER_meta_data_create ();
+  bo.content_priority = 42;
+  bo.anonymity_level = 0;
+  bo.replication_level = 0;
+  bo.expiration_time = GNUNET_TIME_relative_to_absolute (LIFETIME);
+  fi = GNUNET_FS_file_information_create_from_file (fs,
+                                                    "publish-context",
+                                                    src_fn,
+                                                    NULL,
+                                                    meta,
+                                                    GNUNET_YES,
+                                                    &bo);
+  GNUNET_CONTAINER_meta_data_destroy (meta);
+  GNUNET_assert (NULL != fi);
+  timeout_kill = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                               &timeout_kill_task,
+                                               NULL);
+  start = GNUNET_TIME_absolute_get ();
+  publish = GNUNET_FS_publish_start (fs,
+                                     fi,
+                                     NULL, NULL, NULL,
+                                     GNUNET_FS_PUBLISH_OPTION_NONE);
+  GNUNET_assert (NULL != publish);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  unsigned long long size_mb;
+  char buf[DBLOCK_SIZE];
+
+  size_mb = DEFAULT_SIZE_MB;
+  if ( (argc > 1) &&
+       (1 != sscanf (argv[1], "%llu", &size_mb)) )
+  {
+    fprintf (stderr, "Usage: %s [SIZE_MB]\n", argv[0]);
+    return 1;
+  }
+  filesize = size_mb * 1024 * 1024;
+  /* random content, so that the tree has no duplicate blocks */
+  src_fn = GNUNET_DISK_mktemp ("gnunet-perf-download-src");
+  fh = GNUNET_DISK_file_open (src_fn,
+                              GNUNET_DISK_OPEN_WRITE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE);
+  GNUNET_assert (NULL != fh);
+  for (uint64_t off = 0; off < filesize; off += sizeof (buf))
+  {
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                buf,
+                                sizeof (buf));
+    GNUNET_assert (sizeof (buf) ==
+                   GNUNET_DISK_file_write (fh,
+                                           buf,
+                                           sizeof (buf)));
+  }
+  GNUNET_DISK_file_close (fh);
+  if (0 != GNUNET_TESTING_peer_run ("perf-fs-download",
+                                    "perf_fs_download.conf",
+                                    &run,
+                                    NULL))
+    err = 1;
+  UNLINK (src_fn);
+  GNUNET_free (src_fn);
+  return err;
+}
+
+/* end of perf_fs_download.c */
@@ -0,0 +1,153 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file fs/perf_fs_tree.c
+ * @brief measure the throughput of the CHK tree encoder on a large
+ *        sparse file with different numbers of worker threads
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_fs_service.h"
+#include "fs_tree.h"
+#include <gauger.h>
+
+/**
+ * Default size of the file in MiB, can be overridden on the
+ * command line.
+ */
+#define DEFAULT_SIZE_MB 2048
+
+/**
+ * File we encode.
+ */
+#define TESTFILE "/tmp/perf-fs-tree.dat"
+
+
+/**
+ * Set once the encoder called the continuation.
+ */
+static int done;
+
+
+static void
+cont (void *cls)
+{
+  done = GNUNET_YES;
+}
+
+
+/**
+ * Encode #TESTFILE and report the throughput.
+ *
+ * @param size size of the file
+ * @param num_threads number of worker threads to use
+ */
+static void
+perfEncode (uint64_t size,
+            unsigned int num_threads)
+{
+  struct GNUNET_FS_TreeEncoder *te;
+  struct GNUNET_FS_Uri *uri;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  char gauger_name[64];
+  char *emsg;
+  char *us;
+  double rate;
+
+  done = GNUNET_NO;
+  te = GNUNET_FS_tree_encoder_create (NULL,
+                                      size,
+                                      GNUNET_FS_make_file_reader_context_ (TESTFILE),
+                                      &GNUNET_FS_data_reader_file_,
+                                      NULL,
+                                      NULL,
+                                      &cont);
+  GNUNET_FS_tree_encoder_set_threads (te,
+                                      num_threads);
+  start = GNUNET_TIME_absolute_get ();
+  while (GNUNET_NO == done)
+    GNUNET_FS_tree_encoder_next (te);
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  uri = GNUNET_FS_tree_encoder_get_uri (te);
+  GNUNET_FS_tree_encoder_finish (te,
+                                 &emsg);
+  GNUNET_assert (NULL == emsg);
+  GNUNET_assert (NULL != uri);
+  us = GNUNET_FS_uri_to_string (uri);
+  rate = size * 1.0 / 1024 / 1024
+    / (1 + duration.rel_value_us / 1000LL) * 1000;
+  printf ("%u worker threads: %s (%.3f GB/s)\n%s\n",
+          num_threads,
+          GNUNET_STRINGS_relative_time_to_string (duration,
+                                                  GNUNET_YES),
+          rate / 1024,
+          us);
+  GNUNET_free (us);
+  GNUNET_FS_uri_destroy (uri);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "Tree encoder, %u worker threads",
+                   num_threads);
+  GAUGER ("FS", gauger_name, rate, "MiB/s");
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  unsigned long long size_mb;
+  unsigned int threads[3];
+  unsigned int i;
+  long n;
+
+  GNUNET_log_setup ("perf-fs-tree",
+                    "WARNING",
+                    NULL);
+  size_mb = DEFAULT_SIZE_MB;
+  if ( (argc > 1) &&
+       (1 != sscanf (argv[1], "%llu", &size_mb)) )
+  {
+    fprintf (stderr, "Usage: %s [SIZE_MB]\n", argv[0]);
+    return 1;
+  }
+  fh = GNUNET_DISK_file_open (TESTFILE,
+                              GNUNET_DISK_OPEN_READWRITE | GNUNET_DISK_OPEN_CREATE,
+                              GNUNET_DISK_PERM_USER_READ | GNUNET_DISK_PERM_USER_WRITE);
+  GNUNET_assert (NULL != fh);
+  /* sparse file, so that we measure the encoder and not the disk */
+  GNUNET_assert (0 == ftruncate (fh->fd, size_mb * 1024 * 1024));
+  GNUNET_DISK_file_close (fh);
+  n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+  n = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  threads[0] = 0;
+  threads[1] = (n > 1) ? (unsigned int) (n - 1) : 1;
+  threads[2] = (n > 1) ? (unsigned int) (2 * n) : 3;
+  for (i = 0; i < 3; i++)
+    perfEncode (size_mb * 1024 * 1024,
+                threads[i]);
+  GNUNET_break (0 == UNLINK (TESTFILE));
+  return 0;
+}
+
+/* end of perf_fs_tree.c */
@@ -0,0 +1,350 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file fs/test_fs_tree.c
+ * @brief Test for fs_tree.c: the encoder must produce the same
+ *        blocks in the same order with any number of threads
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_fs_service.h"
+#include "fs_tree.h"
+
+
+/**
+ * State of one encoding run.
+ */
+struct Run
+{
+  /**
+   * The encoder.
+   */
+  struct GNUNET_FS_TreeEncoder *te;
+
+  /**
+   * Digest over all blocks handed to us, in order.
+   */
+  struct GNUNET_HashCode digest;
+
+  /**
+   * Read requests at or beyond this offset fail.
+   */
+  uint64_t fail_offset;
+
+  /**
+   * Number of blocks handed to us.
+   */
+  unsigned int blocks;
+
+  /**
+   * Set once the encoder called the continuation.
+   */
+  int done;
+
+  /**
+   * Set if a block did not decrypt to the data we provided.
+   */
+  int bad;
+};
+
+
+/**
+ * Compute the test data at @a offset.
+ *
+ * @param offset offset in the file
+ * @return data byte
+ */
+static char
+data_at (uint64_t offset)
+{
+  return (char) ((offset * 7) ^ (offset >> 12));
+}
+
+
+static size_t
+reader (void *cls,
+        uint64_t offset,
+        size_t max,
+        void *buf,
+        char **emsg)
+{
+  struct Run *run = cls;
+  char *cbuf = buf;
+  size_t i;
+
+  if (UINT64_MAX == offset)
+    return 0;
+  if (offset + max > run->fail_offset)
+  {
+    *emsg = GNUNET_strdup ("read failed");
+    return 0;
+  }
+  for (i = 0; i < max; i++)
+    cbuf[i] = data_at (offset + i);
+  return max;
+}
+
+
+static void
+proc (void *cls,
+      const struct ContentHashKey *chk,
+      uint64_t offset,
+      unsigned int depth,
+      enum GNUNET_BLOCK_Type type,
+      const void *block,
+      uint16_t block_size)
+{
+  struct Run *run = cls;
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  struct GNUNET_HashCode hc;
+  char pt[block_size + 1];
+  char buf[sizeof (struct GNUNET_HashCode) * 2 + sizeof (uint64_t)
+           + sizeof (uint32_t) * 2];
+  uint64_t no;
+  uint32_t v;
+  unsigned int i;
+
+  GNUNET_CRYPTO_hash (block, block_size, &hc);
+  if (0 != memcmp (&hc, &chk->query, sizeof (hc)))
+    run->bad = GNUNET_YES;
+  if (GNUNET_BLOCK_TYPE_FS_DBLOCK == type)
+  {
+    GNUNET_CRYPTO_hash_to_aes_key (&chk->key, &sk, &iv);
+    GNUNET_CRYPTO_symmetric_decrypt (block, block_size, &sk, &iv, pt);
+    for (i = 0; i < block_size; i++)
+      if (pt[i] != data_at (offset + i))
+        run->bad = GNUNET_YES;
+  }
+  /* fold this block into the digest over the whole stream */
+  GNUNET_memcpy (buf, &run->digest, sizeof (struct GNUNET_HashCode));
+  GNUNET_memcpy (&buf[sizeof (struct GNUNET_HashCode)],
+                 &chk->query,
+                 sizeof (struct GNUNET_HashCode));
+  no = GNUNET_htonll (offset);
+  GNUNET_memcpy (&buf[2 * sizeof (struct GNUNET_HashCode)],
+                 &no,
+                 sizeof (no));
+  v = htonl (depth);
+  GNUNET_memcpy (&buf[2 * sizeof (struct GNUNET_HashCode) + sizeof (no)],
+                 &v,
+                 sizeof (v));
+  v = htonl (block_size);
+  GNUNET_memcpy (&buf[2 * sizeof (struct GNUNET_HashCode) + sizeof (no)
+                      + sizeof (v)],
+                 &v,
+                 sizeof (v));
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), &run->digest);
+  run->blocks++;
+}
+
+
+static void
+cont (void *cls)
+{
+  struct Run *run = cls;
+
+  run->done = GNUNET_YES;
+}
+
+
+/**
+ * Encode a file of @a size bytes.
+ *
+ * @param size size of the file
+ * @param num_threads number of worker threads to use
+ * @param fail_offset reads at or beyond this offset fail
+ * @param[out] run state of the run
+ * @param[out] emsg set to the error of the encoder, if any
+ * @return the URI, NULL on error
+ */
+static struct GNUNET_FS_Uri *
+encode (uint64_t size,
+        unsigned int num_threads,
+        uint64_t fail_offset,
+        struct Run *run,
+        char **emsg)
+{
+  struct GNUNET_FS_Uri *uri;
+
+  memset (run, 0, sizeof (struct Run));
+  run->fail_offset = fail_offset;
+  run->te = GNUNET_FS_tree_encoder_create (NULL,
+                                           size,
+                                           run,
+                                           &reader,
+                                           &proc,
+                                           NULL,
+                                           &cont);
+  GNUNET_FS_tree_encoder_set_threads (run->te,
+                                      num_threads);
+  while (GNUNET_NO == run->done)
+    GNUNET_FS_tree_encoder_next (run->te);
+  uri = GNUNET_FS_tree_encoder_get_uri (run->te);
+  GNUNET_FS_tree_encoder_finish (run->te,
+                                 emsg);
+  return uri;
+}
+
+
+/**
+ * Encode a file of @a size bytes with and without worker threads
+ * and compare the results.
+ *
+ * @param size size of the file
+ * @return 0 on success
+ */
+static int
+testSize (uint64_t size)
+{
+  struct Run r0;
+  struct Run r3;
+  struct GNUNET_FS_Uri *u0;
+  struct GNUNET_FS_Uri *u3;
+  char *emsg;
+  int ret;
+
+  ret = 0;
+  u0 = encode (size, 0, UINT64_MAX, &r0, &emsg);
+  GNUNET_assert (NULL == emsg);
+  u3 = encode (size, 3, UINT64_MAX, &r3, &emsg);
+  GNUNET_assert (NULL == emsg);
+  if ( (NULL == u0) ||
+       (NULL == u3) ||
+       (GNUNET_YES != GNUNET_FS_uri_test_equal (u0, u3)) ||
+       (size != GNUNET_FS_uri_chk_get_file_size (u0)) )
+  {
+    fprintf (stderr, "URIs differ for size %llu\n",
+             (unsigned long long) size);
+    ret = 1;
+  }
+  if ( (r0.blocks != r3.blocks) ||
+       (0 != memcmp (&r0.digest, &r3.digest, sizeof (r0.digest))) )
+  {
+    fprintf (stderr, "Blocks differ for size %llu\n",
+             (unsigned long long) size);
+    ret = 1;
+  }
+  if ( (GNUNET_YES == r0.bad) ||
+       (GNUNET_YES == r3.bad) )
+  {
+    fprintf (stderr, "Bad block for size %llu\n",
+             (unsigned long long) size);
+    ret = 1;
+  }
+  if (NULL != u0)
+    GNUNET_FS_uri_destroy (u0);
+  if (NULL != u3)
+    GNUNET_FS_uri_destroy (u3);
+  return ret;
+}
+
+
+/**
+ * Check the URI for a fixed file against the one computed by the
+ * original, single-threaded encoder.
+ *
+ * @return 0 on success
+ */
+static int
+testKnownUri ()
+{
+  struct Run run;
+  struct GNUNET_FS_Uri *uri;
+  char *emsg;
+  char *us;
+  int ret;
+
+  uri = encode (300 * DBLOCK_SIZE + 7, 2, UINT64_MAX, &run, &emsg);
+  GNUNET_assert (NULL == emsg);
+  GNUNET_assert (NULL != uri);
+  us = GNUNET_FS_uri_to_string (uri);
+  ret = (0 == strcmp (us,
+                      "gnunet://fs/chk/"
+                      "VACGDHWEM25Q1Q5F4K3Z2FBXQRVWM8E00DY3B0HQKDEFJRMQHMG9JR7KZ92MMRC5DD2NGMW7DKP0RFGNBGNBTBT0AG76NGNEF4QAEKG."
+                      "8JB8DD0KQPP6Y0Z1PW405XAHM7RYT82YVKDHFRFJJJV3ZXNYPQ7SA7WF69TFK2ZG5P4HK82ZCYTW1J8JSVMPES4D274ZWXPM4R8PCZR."
+                      "9830407")) ? 0 : 1;
+  if (0 != ret)
+    fprintf (stderr, "Unexpected URI `%s'\n", us);
+  GNUNET_free (us);
+  GNUNET_FS_uri_destroy (uri);
+  return ret;
+}
+
+
+/**
+ * Check that a read error ends the encoding with an error
+ * after all blocks before the error were handed out.
+ *
+ * @param num_threads number of worker threads to use
+ * @return 0 on success
+ */
+static int
+testReadError (unsigned int num_threads)
+{
+  struct Run run;
+  struct GNUNET_FS_Uri *uri;
+  char *emsg;
+
+  uri = encode (200 * DBLOCK_SIZE,
+                num_threads,
+                100 * DBLOCK_SIZE + 1,
+                &run,
+                &emsg);
+  if ( (NULL != uri) ||
+       (NULL == emsg) ||
+       (100 != run.blocks) ||
+       (GNUNET_YES == run.bad) )
+  {
+    fprintf (stderr, "Read error not handled correctly\n");
+    if (NULL != uri)
+      GNUNET_FS_uri_destroy (uri);
+    GNUNET_free_non_null (emsg);
+    return 1;
+  }
+  GNUNET_free (emsg);
+  return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  static const uint64_t sizes[] = {
+    0, 1, DBLOCK_SIZE - 1, DBLOCK_SIZE, DBLOCK_SIZE + 1,
+    64 * DBLOCK_SIZE, 64 * DBLOCK_SIZE + 5,
+    CHK_PER_INODE * DBLOCK_SIZE, CHK_PER_INODE * DBLOCK_SIZE + 1,
+    300 * DBLOCK_SIZE + 7
+  };
+  int failureCount = 0;
+  unsigned int i;
+
+  GNUNET_log_setup ("test-fs-tree", "WARNING", NULL);
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    failureCount += testSize (sizes[i]);
+  failureCount += testKnownUri ();
+  failureCount += testReadError (0);
+  failureCount += testReadError (3);
+  if (failureCount != 0)
+    return 1;
+  return 0;
+}
+
+/* end of test_fs_tree.c */
@@ -88,9 +88,16 @@
 #define MAX_PEM_SIZE (10 * 1024)
 
 /**
- * After how long do we clean up unused MHD SSL/TLS instances?
+ * How many certificates do we keep in memory at most?  Certificates
+ * of domains with active connections are kept in addition to these.
  */
-#define MHD_CACHE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+#define MAX_CERT_CACHE 256
+
+/**
+ * Certificates from the disk cache that expire within this time
+ * are generated again.
+ */
+#define CERT_RENEW_MARGIN GNUNET_TIME_UNIT_DAYS
 
 /**
  * After how long do we clean up Socks5 handles that failed to show any activity
@@ -310,19 +317,46 @@ struct ProxyCA
 
 
 /**
- * Structure for GNS certificates
+ * Structure for GNS certificates.  All certificates use the key of
+ * the proxy CA, so we only need to keep the certificates.
  */
 struct ProxyGNSCertificate
 {
   /**
-   * The certificate as PEM
+   * DLL of certificates, most recently used first.
+   */
+  struct ProxyGNSCertificate *prev;
+
+  /**
+   * DLL of certificates, most recently used first.
+   */
+  struct ProxyGNSCertificate *next;
+
+  /**
+   * The domain the certificate is for.
+   */
+  char *domain;
+
+  /**
+   * Hash of @e domain, key in #cert_map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * The certificate as given to GnuTLS.
    */
-  char cert[MAX_PEM_SIZE];
+  gnutls_pcert_st pcert;
 
   /**
-   * The private key as PEM
+   * Number of socks requests using this certificate; while
+   * non-zero, the certificate is not evicted.
    */
-  char key[MAX_PEM_SIZE];
+  unsigned int rc;
+
+  /**
+   * #GNUNET_YES if the certificate is in the disk cache.
+   */
+  int on_disk;
 };
 
 
@@ -342,21 +376,11 @@ struct MhdHttpList
    */
   struct MhdHttpList *next;
 
-  /**
-   * the domain name to server (only important for SSL)
-   */
-  char *domain;
-
   /**
    * The daemon handle
    */
   struct MHD_Daemon *daemon;
 
-  /**
-   * Optional proxy certificate used
-   */
-  struct ProxyGNSCertificate *proxy_cert;
-
   /**
    * The task ID
    */
@@ -607,6 +631,22 @@ struct Socks5Request
    */
   struct HttpResponseHeader *header_tail;
 
+  /**
+   * Certificate we present for @e domain, NULL if not HTTPS.
+   */
+  struct ProxyGNSCertificate *cert;
+
+  /**
+   * TLS session of our MHD connection, NULL if not HTTPS.  Its
+   * session pointer refers back to us for #sni_cert_cb().
+   */
+  gnutls_session_t tls_session;
+
+  /**
+   * Task preparing @e cert while we resolve @e domain.
+   */
+  struct GNUNET_SCHEDULER_Task *cert_task;
+
   /**
    * SSL Certificate status
    */
@@ -674,11 +714,47 @@ static struct MhdHttpList *mhd_httpd_head;
 static struct MhdHttpList *mhd_httpd_tail;
 
 /**
- * Daemon for HTTP (we have one per SSL certificate, and then one for
- * all HTTP connections; this is the one for HTTP, not HTTPS).
+ * Daemon for HTTP (we have one for all HTTP connections and one for
+ * all HTTPS connections; this is the one for HTTP, not HTTPS).
  */
 static struct MhdHttpList *httpd;
 
+/**
+ * Daemon for HTTPS, picks the certificate by the name the client
+ * gives via SNI.
+ */
+static struct MhdHttpList *httpsd;
+
+/**
+ * Map from the hash of a domain to its `struct ProxyGNSCertificate`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *cert_map;
+
+/**
+ * DLL of certificates, most recently used first.
+ */
+static struct ProxyGNSCertificate *cert_head;
+
+/**
+ * DLL of certificates, most recently used first.
+ */
+static struct ProxyGNSCertificate *cert_tail;
+
+/**
+ * Number of certificates in #cert_map.
+ */
+static unsigned int cert_count;
+
+/**
+ * Directory with the disk cache of certificates, NULL for none.
+ */
+static char *cert_cache_dir;
+
+/**
+ * The key of the proxy CA, as given to GnuTLS for all certificates.
+ */
+static gnutls_privkey_t proxy_privkey;
+
 /**
  * DLL of active socks requests.
  */
@@ -732,6 +808,15 @@ static void
 run_mhd_now (struct MhdHttpList *hd);
 
 
+/**
+ * A socks request no longer uses a certificate.
+ *
+ * @param pgc the certificate
+ */
+static void
+release_certificate (struct ProxyGNSCertificate *pgc);
+
+
 /**
  * Clean up s5r handles.
  *
@@ -766,6 +851,13 @@ cleanup_s5r (struct Socks5Request *s5r)
     GNUNET_SCHEDULER_cancel (s5r->wtask);
   if (NULL != s5r->gns_lookup)
     GNUNET_GNS_lookup_cancel (s5r->gns_lookup);
+  if (NULL != s5r->cert_task)
+    GNUNET_SCHEDULER_cancel (s5r->cert_task);
+  if (NULL != s5r->cert)
+    release_certificate (s5r->cert);
+  if (NULL != s5r->tls_session)
+    gnutls_session_set_ptr (s5r->tls_session,
+                            NULL);
   if (NULL != s5r->sock)
   {
     if (SOCKS5_SOCKET_WITH_MHD <= s5r->state)
@@ -1897,6 +1989,15 @@ mhd_connection_cb (void *cls,
                       "Context set...\n");
           s5r->ssl_checked = GNUNET_NO;
           *con_cls = s5r;
+          /* let #sni_cert_cb() find us during the handshake */
+          ci = MHD_get_connection_info (connection,
+                                        MHD_CONNECTION_INFO_GNUTLS_SESSION);
+          if (NULL != ci)
+          {
+            s5r->tls_session = ci->tls_session;
+            gnutls_session_set_ptr (s5r->tls_session,
+                                    s5r);
+          }
           break;
         }
       }
@@ -1977,35 +2078,20 @@ kill_httpd (struct MhdHttpList *hd)
   GNUNET_CONTAINER_DLL_remove (mhd_httpd_head,
                                mhd_httpd_tail,
                                hd);
-  GNUNET_free_non_null (hd->domain);
   MHD_stop_daemon (hd->daemon);
   if (NULL != hd->httpd_task)
   {
     GNUNET_SCHEDULER_cancel (hd->httpd_task);
     hd->httpd_task = NULL;
   }
-  GNUNET_free_non_null (hd->proxy_cert);
   if (hd == httpd)
     httpd = NULL;
+  if (hd == httpsd)
+    httpsd = NULL;
   GNUNET_free (hd);
 }
 
 
-/**
- * Task run whenever HTTP server is idle for too long. Kill it.
- *
- * @param cls the `struct MhdHttpList *`
- */
-static void
-kill_httpd_task (void *cls)
-{
-  struct MhdHttpList *hd = cls;
-
-  hd->httpd_task = NULL;
-  kill_httpd (hd);
-}
-
-
 /**
  * Task run whenever HTTP server operations are pending.
  *
@@ -2066,22 +2152,10 @@ schedule_httpd (struct MhdHttpList *hd)
     GNUNET_SCHEDULER_cancel (hd->httpd_task);
     hd->httpd_task = NULL;
   }
-  if ( (MHD_YES != haveto) &&
-       (-1 == max) &&
-       (hd != httpd) )
-  {
-    /* daemon is idle, kill after timeout */
-    hd->httpd_task = GNUNET_SCHEDULER_add_delayed (MHD_CACHE_TIMEOUT,
-                                                   &kill_httpd_task,
-                                                   hd);
-  }
-  else
-  {
-    hd->httpd_task =
-      GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
-                                   tv, wrs, wws,
-                                   &do_httpd, hd);
-  }
+  hd->httpd_task =
+    GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
+                                 tv, wrs, wws,
+                                 &do_httpd, hd);
   if (NULL != wrs)
     GNUNET_NETWORK_fdset_destroy (wrs);
   if (NULL != wws)
@@ -2214,25 +2288,26 @@ load_cert_from_file (gnutls_x509_crt_t crt,
  * Generate new certificate for specific name
  *
  * @param name the subject name to generate a cert for
- * @return a struct holding the PEM data, NULL on error
+ * @param[out] der where to write the certificate (DER encoded)
+ * @param[in,out] der_size size of @a der, set to the size of the certificate
+ * @return #GNUNET_OK on success
  */
-static struct ProxyGNSCertificate *
-generate_gns_certificate (const char *name)
+static int
+generate_gns_certificate (const char *name,
+                          unsigned char *der,
+                          size_t *der_size)
 {
   unsigned int serial;
-  size_t key_buf_size;
-  size_t cert_buf_size;
   gnutls_x509_crt_t request;
   time_t etime;
   struct tm *tm_data;
-  struct ProxyGNSCertificate *pgc;
+  int ret;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Generating TLS/SSL certificate for `%s'\n",
               name);
   GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_init (&request));
   GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_set_key (request, proxy_ca.key));
-  pgc = GNUNET_new (struct ProxyGNSCertificate);
   gnutls_x509_crt_set_dn_by_oid (request, GNUTLS_OID_X520_COUNTRY_NAME,
                                  0, "ZZ", 2);
   gnutls_x509_crt_set_dn_by_oid (request, GNUTLS_OID_X520_ORGANIZATION_NAME,
@@ -2252,87 +2327,393 @@ generate_gns_certificate (const char *name)
   etime = mktime (tm_data);
   gnutls_x509_crt_set_expiration_time (request,
                                        etime);
-  gnutls_x509_crt_sign (request,
-                        proxy_ca.cert,
-                        proxy_ca.key);
-  key_buf_size = sizeof (pgc->key);
-  cert_buf_size = sizeof (pgc->cert);
-  gnutls_x509_crt_export (request, GNUTLS_X509_FMT_PEM,
-                          pgc->cert, &cert_buf_size);
-  gnutls_x509_privkey_export (proxy_ca.key, GNUTLS_X509_FMT_PEM,
-                              pgc->key, &key_buf_size);
+  ret = gnutls_x509_crt_sign (request,
+                              proxy_ca.cert,
+                              proxy_ca.key);
+  if (GNUTLS_E_SUCCESS == ret)
+    ret = gnutls_x509_crt_export (request, GNUTLS_X509_FMT_DER,
+                                  der, der_size);
   gnutls_x509_crt_deinit (request);
-  return pgc;
+  return (GNUTLS_E_SUCCESS == ret) ? GNUNET_OK : GNUNET_SYSERR;
 }
 
 
 /**
- * Function called by MHD with errors, suppresses them all.
+ * Get the name of the file caching the certificate with the
+ * given @a key.
  *
- * @param cls closure
- * @param fm format string (`printf()`-style)
- * @param ap arguments to @a fm
+ * @param key hash of the domain of the certificate
+ * @return file name, caller must free
+ */
+static char *
+get_cert_filename (const struct GNUNET_HashCode *key)
+{
+  struct GNUNET_CRYPTO_HashAsciiEncoded enc;
+  char *fn;
+
+  GNUNET_CRYPTO_hash_to_enc (key,
+                             &enc);
+  GNUNET_asprintf (&fn,
+                   "%s%s%s.der",
+                   cert_cache_dir,
+                   DIR_SEPARATOR_STR,
+                   (const char *) &enc);
+  return fn;
+}
+
+
+/**
+ * Load the certificate for @a domain from the disk cache.  The
+ * certificate must be signed by our CA, be for @a domain and not
+ * expire soon.
+ *
+ * @param domain domain to load the certificate for
+ * @param key hash of @a domain
+ * @param[out] data set to the certificate (DER encoded), caller
+ *        must free the data on success
+ * @return #GNUNET_OK on success, #GNUNET_NO if the certificate is
+ *         not in the cache, #GNUNET_SYSERR if it is not usable
+ */
+static int
+load_cached_certificate (const char *domain,
+                         const struct GNUNET_HashCode *key,
+                         gnutls_datum_t *data)
+{
+  gnutls_x509_crt_t crt;
+  unsigned int status;
+  time_t expiration;
+  char *fn;
+  int ret;
+
+  if (NULL == cert_cache_dir)
+    return GNUNET_NO;
+  fn = get_cert_filename (key);
+  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
+  {
+    GNUNET_free (fn);
+    return GNUNET_NO;
+  }
+  data->data = load_file (fn, &data->size);
+  if (NULL == data->data)
+  {
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  ret = GNUNET_SYSERR;
+  GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_init (&crt));
+  if ( (GNUTLS_E_SUCCESS ==
+        gnutls_x509_crt_import (crt, data,
+                                GNUTLS_X509_FMT_DER)) &&
+       (GNUTLS_E_SUCCESS ==
+        gnutls_x509_crt_verify (crt, &proxy_ca.cert, 1,
+                                0,
+                                &status)) &&
+       (0 == status) &&
+       (0 != gnutls_x509_crt_check_hostname (crt, domain)) )
+  {
+    expiration = gnutls_x509_crt_get_expiration_time (crt);
+    if ( ((time_t) -1 != expiration) &&
+         (expiration > time (NULL)
+          + CERT_RENEW_MARGIN.rel_value_us / GNUNET_TIME_UNIT_SECONDS.rel_value_us) )
+      ret = GNUNET_OK;
+  }
+  gnutls_x509_crt_deinit (crt);
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Ignoring cached certificate `%s' for `%s'\n",
+                fn,
+                domain);
+    GNUNET_free (data->data);
+    data->data = NULL;
+  }
+  GNUNET_free (fn);
+  return ret;
+}
+
+
+/**
+ * Write a certificate to the disk cache.
+ *
+ * @param pgc certificate to store
  */
 static void
-mhd_error_log_callback (void *cls,
-                        const char *fm,
-                        va_list ap)
+store_certificate (struct ProxyGNSCertificate *pgc)
 {
-  /* do nothing */
+  char *fn;
+
+  if (NULL == cert_cache_dir)
+    return;
+  fn = get_cert_filename (&pgc->key);
+  if ( (GNUNET_OK ==
+        GNUNET_DISK_directory_create_for_file (fn)) &&
+       (pgc->pcert.cert.size ==
+        GNUNET_DISK_fn_write (fn,
+                              pgc->pcert.cert.data,
+                              pgc->pcert.cert.size,
+                              GNUNET_DISK_PERM_USER_READ
+                              | GNUNET_DISK_PERM_USER_WRITE)) )
+    pgc->on_disk = GNUNET_YES;
+  else
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              fn);
+  GNUNET_free (fn);
 }
 
 
 /**
- * Lookup (or create) an SSL MHD instance for a particular domain.
+ * Remove a certificate from the cache and free it.
  *
- * @param domain the domain the SSL daemon has to serve
+ * @param pgc certificate to free
+ */
+static void
+free_certificate (struct ProxyGNSCertificate *pgc)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (cert_map,
+                                                       &pgc->key,
+                                                       pgc));
+  GNUNET_CONTAINER_DLL_remove (cert_head,
+                               cert_tail,
+                               pgc);
+  cert_count--;
+  gnutls_pcert_deinit (&pgc->pcert);
+  GNUNET_free (pgc->domain);
+  GNUNET_free (pgc);
+}
+
+
+/**
+ * Evict the least recently used certificates that are not in use
+ * until the cache is within #MAX_CERT_CACHE.
+ */
+static void
+trim_certificate_cache ()
+{
+  struct ProxyGNSCertificate *pos;
+  struct ProxyGNSCertificate *prev;
+
+  pos = cert_tail;
+  while ( (cert_count > MAX_CERT_CACHE) &&
+          (NULL != pos) )
+  {
+    prev = pos->prev;
+    if (0 == pos->rc)
+      free_certificate (pos);
+    pos = prev;
+  }
+}
+
+
+/**
+ * Get the certificate for @a domain, from memory, the disk cache
+ * or by generating it.  The caller must release the certificate
+ * with #release_certificate().
+ *
+ * @param domain the domain to get a certificate for
  * @return NULL on error
  */
-static struct MhdHttpList *
-lookup_ssl_httpd (const char* domain)
+static struct ProxyGNSCertificate *
+acquire_certificate (const char *domain)
 {
-  struct MhdHttpList *hd;
   struct ProxyGNSCertificate *pgc;
+  struct GNUNET_HashCode key;
+  unsigned char der[MAX_PEM_SIZE];
+  size_t der_size;
+  gnutls_datum_t data;
+  int cached;
+  int ret;
 
   if (NULL == domain)
   {
     GNUNET_break (0);
     return NULL;
   }
-  for (hd = mhd_httpd_head; NULL != hd; hd = hd->next)
-    if ( (NULL != hd->domain) &&
-         (0 == strcmp (hd->domain, domain)) )
-      return hd;
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Starting fresh MHD HTTPS instance for domain `%s'\n",
-              domain);
-  pgc = generate_gns_certificate (domain);
-  hd = GNUNET_new (struct MhdHttpList);
-  hd->is_ssl = GNUNET_YES;
-  hd->domain = GNUNET_strdup (domain);
-  hd->proxy_cert = pgc;
-  hd->daemon = MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SSL | MHD_USE_NO_LISTEN_SOCKET,
-                                 0,
-                                 NULL, NULL,
-                                 &create_response, hd,
-                                 MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 16,
-                                 MHD_OPTION_NOTIFY_COMPLETED, &mhd_completed_cb, NULL,
-                                 MHD_OPTION_NOTIFY_CONNECTION, &mhd_connection_cb, NULL,
-                                 MHD_OPTION_URI_LOG_CALLBACK, &mhd_log_callback, NULL,
-                                 MHD_OPTION_EXTERNAL_LOGGER, &mhd_error_log_callback, NULL,
-                                 MHD_OPTION_HTTPS_MEM_KEY, pgc->key,
-                                 MHD_OPTION_HTTPS_MEM_CERT, pgc->cert,
-                                 MHD_OPTION_END);
-  if (NULL == hd->daemon)
+  GNUNET_CRYPTO_hash (domain,
+                      strlen (domain),
+                      &key);
+  pgc = GNUNET_CONTAINER_multihashmap_get (cert_map,
+                                           &key);
+  if (NULL != pgc)
+  {
+    GNUNET_CONTAINER_DLL_remove (cert_head,
+                                 cert_tail,
+                                 pgc);
+    GNUNET_CONTAINER_DLL_insert (cert_head,
+                                 cert_tail,
+                                 pgc);
+    pgc->rc++;
+    return pgc;
+  }
+  cached = load_cached_certificate (domain,
+                                    &key,
+                                    &data);
+  if (GNUNET_OK != cached)
+  {
+    der_size = sizeof (der);
+    if (GNUNET_OK !=
+        generate_gns_certificate (domain,
+                                  der,
+                                  &der_size))
+      return NULL;
+    data.data = der;
+    data.size = der_size;
+  }
+  pgc = GNUNET_new (struct ProxyGNSCertificate);
+  ret = gnutls_pcert_import_x509_raw (&pgc->pcert,
+                                      &data,
+                                      GNUTLS_X509_FMT_DER,
+                                      0);
+  if (GNUNET_OK == cached)
+    GNUNET_free (data.data);
+  if (GNUTLS_E_SUCCESS != ret)
   {
     GNUNET_free (pgc);
-    GNUNET_free (hd);
     return NULL;
   }
-  GNUNET_CONTAINER_DLL_insert (mhd_httpd_head,
-                               mhd_httpd_tail,
-                               hd);
-  return hd;
+  pgc->domain = GNUNET_strdup (domain);
+  pgc->key = key;
+  pgc->on_disk = (GNUNET_OK == cached) ? GNUNET_YES : GNUNET_NO;
+  pgc->rc = 1;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (cert_map,
+                                                    &pgc->key,
+                                                    pgc,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  GNUNET_CONTAINER_DLL_insert (cert_head,
+                               cert_tail,
+                               pgc);
+  cert_count++;
+  trim_certificate_cache ();
+  return pgc;
+}
+
+
+/**
+ * A socks request no longer uses a certificate.
+ *
+ * @param pgc the certificate
+ */
+static void
+release_certificate (struct ProxyGNSCertificate *pgc)
+{
+  GNUNET_assert (0 < pgc->rc);
+  pgc->rc--;
+  if (0 == pgc->rc)
+    trim_certificate_cache ();
+}
+
+
+/**
+ * Task preparing the certificate of a socks request while we
+ * resolve its domain, so the TLS handshake does not have to wait
+ * for it.
+ *
+ * @param cls the `struct Socks5Request *`
+ */
+static void
+prepare_certificate (void *cls)
+{
+  struct Socks5Request *s5r = cls;
+
+  s5r->cert_task = NULL;
+  if (NULL == s5r->cert)
+    s5r->cert = acquire_certificate (s5r->domain);
+}
+
+
+/**
+ * Function called by GnuTLS during the handshake of the HTTPS
+ * daemon to select the certificate by the server name the client
+ * indicated (SNI).  We only present certificates of domains socks
+ * requests are currently using.  Clients that send no (or an
+ * unknown) server name get the certificate for the domain of their
+ * SOCKS5 request.
+ *
+ * @param session the TLS session
+ * @param req_ca_dn CAs accepted by the client (unused)
+ * @param nreqs length of @a req_ca_dn
+ * @param pk_algos signature algorithms the client supports (unused)
+ * @param pk_algos_length length of @a pk_algos
+ * @param[out] pcert set to the certificate chain
+ * @param[out] pcert_length set to the length of @a pcert
+ * @param[out] pkey set to the private key
+ * @return 0 on success, -1 to abort the handshake
+ */
+static int
+sni_cert_cb (gnutls_session_t session,
+             const gnutls_datum_t *req_ca_dn,
+             int nreqs,
+             const gnutls_pk_algorithm_t *pk_algos,
+             int pk_algos_length,
+             gnutls_pcert_st **pcert,
+             unsigned int *pcert_length,
+             gnutls_privkey_t *pkey)
+{
+  struct Socks5Request *s5r;
+  struct ProxyGNSCertificate *pgc;
+  struct GNUNET_HashCode key;
+  char name[256];
+  size_t name_len;
+  unsigned int type;
+
+  pgc = NULL;
+  name_len = sizeof (name);
+  if ( (GNUTLS_E_SUCCESS ==
+        gnutls_server_name_get (session,
+                                name,
+                                &name_len,
+                                &type,
+                                0)) &&
+       (GNUTLS_NAME_DNS == type) )
+  {
+    name[sizeof (name) - 1] = '\0';
+    GNUNET_CRYPTO_hash (name,
+                        strlen (name),
+                        &key);
+    pgc = GNUNET_CONTAINER_multihashmap_get (cert_map,
+                                             &key);
+    if ( (NULL != pgc) &&
+         (0 == pgc->rc) )
+      pgc = NULL;
+    if (NULL == pgc)
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "No certificate for `%s', using the SOCKS5 domain\n",
+                  name);
+  }
+  if (NULL == pgc)
+  {
+    s5r = gnutls_session_get_ptr (session);
+    if (NULL != s5r)
+      pgc = s5r->cert;
+  }
+  if (NULL == pgc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("No certificate for TLS client\n"));
+    return -1;
+  }
+  *pcert = &pgc->pcert;
+  *pcert_length = 1;
+  *pkey = proxy_privkey;
+  return 0;
+}
+
+
+/**
+ * Function called by MHD with errors, suppresses them all.
+ *
+ * @param cls closure
+ * @param fm format string (`printf()`-style)
+ * @param ap arguments to @a fm
+ */
+static void
+mhd_error_log_callback (void *cls,
+                        const char *fm,
+                        va_list ap)
+{
+  /* do nothing */
 }
 
 
@@ -2372,15 +2753,26 @@ setup_data_transfer (struct Socks5Request *s5r)
   switch (s5r->port)
   {
     case HTTPS_PORT:
-      hd = lookup_ssl_httpd (s5r->domain);
-      if (NULL == hd)
+      if (NULL != s5r->cert_task)
+      {
+        GNUNET_SCHEDULER_cancel (s5r->cert_task);
+        s5r->cert_task = NULL;
+      }
+      if (NULL == s5r->cert)
+        s5r->cert = acquire_certificate (s5r->domain);
+      if ( (NULL == httpsd) ||
+           (NULL == s5r->cert) )
       {
         GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                    _("Failed to start HTTPS server for `%s'\n"),
+                    _("Failed to setup HTTPS for `%s'\n"),
                     s5r->domain);
         cleanup_s5r (s5r);
         return;
       }
+      /* only cache certificates of domains that resolved */
+      if (GNUNET_NO == s5r->cert->on_disk)
+        store_certificate (s5r->cert);
+      hd = httpsd;
       break;
     case HTTP_PORT:
     default:
@@ -2832,6 +3224,9 @@ do_s5r_read (void *cls)
                         ntohs (*port));
             s5r->state = SOCKS5_RESOLVING;
             s5r->port = ntohs (*port);
+            if (HTTPS_PORT == s5r->port)
+              s5r->cert_task = GNUNET_SCHEDULER_add_now (&prepare_certificate,
+                                                         s5r);
             s5r->gns_lookup = GNUNET_GNS_lookup (gns_handle,
                                                  s5r->domain,
                                                  &local_gns_zone,
@@ -2988,6 +3383,16 @@ do_shutdown (void *cls)
     GNUNET_SCHEDULER_cancel (ltask6);
     ltask6 = NULL;
   }
+  while (NULL != cert_head)
+    free_certificate (cert_head);
+  if (NULL != cert_map)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (cert_map);
+    cert_map = NULL;
+  }
+  GNUNET_free_non_null (cert_cache_dir);
+  cert_cache_dir = NULL;
+  gnutls_privkey_deinit (proxy_privkey);
   gnutls_x509_crt_deinit (proxy_ca.cert);
   gnutls_x509_privkey_deinit (proxy_ca.key);
   gnutls_global_deinit ();
@@ -3145,6 +3550,29 @@ run_cont ()
   }
   httpd = hd;
   GNUNET_CONTAINER_DLL_insert (mhd_httpd_head, mhd_httpd_tail, hd);
+
+  /* start MHD daemon for HTTPS, certificates are selected by SNI */
+  hd = GNUNET_new (struct MhdHttpList);
+  hd->is_ssl = GNUNET_YES;
+  hd->daemon = MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SSL | MHD_USE_NO_LISTEN_SOCKET,
+                                 0,
+                                 NULL, NULL,
+                                 &create_response, hd,
+                                 MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 16,
+                                 MHD_OPTION_NOTIFY_COMPLETED, &mhd_completed_cb, NULL,
+                                 MHD_OPTION_NOTIFY_CONNECTION, &mhd_connection_cb, NULL,
+                                 MHD_OPTION_URI_LOG_CALLBACK, &mhd_log_callback, NULL,
+                                 MHD_OPTION_EXTERNAL_LOGGER, &mhd_error_log_callback, NULL,
+                                 MHD_OPTION_HTTPS_CERT_CALLBACK, &sni_cert_cb,
+                                 MHD_OPTION_END);
+  if (NULL == hd->daemon)
+  {
+    GNUNET_free (hd);
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  httpsd = hd;
+  GNUNET_CONTAINER_DLL_insert (mhd_httpd_head, mhd_httpd_tail, hd);
 }
 
 
@@ -3256,6 +3684,19 @@ run (void *cls,
     gnutls_global_deinit ();
     return;
   }
+  gnutls_privkey_init (&proxy_privkey);
+  GNUNET_break (GNUTLS_E_SUCCESS ==
+                gnutls_privkey_import_x509 (proxy_privkey,
+                                            proxy_ca.key,
+                                            0));
+  cert_map = GNUNET_CONTAINER_multihashmap_create (MAX_CERT_CACHE,
+                                                   GNUNET_NO);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "gns-proxy",
+                                               "PROXY_CERT_CACHE",
+                                               &cert_cache_dir))
+    cert_cache_dir = NULL;
   identity = GNUNET_IDENTITY_connect (cfg,
                                       NULL, NULL);
   id_op = GNUNET_IDENTITY_get (identity,
@@ -480,11 +480,12 @@ run (void *cls,
                                        &identity_intercept_cb,
                                        (void *) c);
   }
+  statistics = GNUNET_STATISTICS_create ("gns", c);
   GNS_resolver_init (namecache_handle,
                      dht_handle,
+                     statistics,
                      c,
                      max_parallel_bg_queries);
-  statistics = GNUNET_STATISTICS_create ("gns", c);
   GNUNET_SCHEDULER_add_shutdown (&shutdown_task,
                                  NULL);
 }
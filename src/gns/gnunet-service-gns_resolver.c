@@ -30,9 +30,11 @@
 #include "gnunet_dht_service.h"
 #include "gnunet_gnsrecord_lib.h"
 #include "gnunet_namecache_service.h"
+#include "gnunet_namestore_service.h"
 #include "gnunet_dns_service.h"
 #include "gnunet_resolver_service.h"
 #include "gnunet_revocation_service.h"
+#include "gnunet_statistics_service.h"
 #include "gnunet_dnsparser_lib.h"
 #include "gnunet_tun_lib.h"
 #include "gnunet_gns_service.h"
@@ -66,6 +68,21 @@
  */
 #define MAX_RECURSION 256
 
+/**
+ * Default number of results we keep in the result cache.
+ */
+#define DEFAULT_RESULT_CACHE_SIZE 4096
+
+/**
+ * Default limit for how long we keep results in the result cache.
+ */
+#define DEFAULT_RESULT_CACHE_MAX_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+
+/**
+ * Default for how long we remember failed lookups.
+ */
+#define DEFAULT_RESULT_CACHE_NEGATIVE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 15)
+
 
 /**
  * DLL to hold the authority chain we had to pass in the resolution
@@ -378,6 +395,133 @@ struct GNS_ResolverHandle
    */
   unsigned int loop_limiter;
 
+  /**
+   * If non-NULL, this handle does not resolve anything itself but
+   * waits for the result of this cache entry.  Such handles are
+   * returned by #GNS_resolver_lookup() and only use @e next, @e prev,
+   * @e proc and @e proc_cls.
+   */
+  struct ResultCacheEntry *rce;
+
+  /**
+   * #GNUNET_YES if this handle waits for @e rce and is in the
+   * DLL of waiters currently being given the result.
+   */
+  int in_delivery;
+
+};
+
+
+/**
+ * Revocation check of a zone a cached result depends on.
+ */
+struct CacheRevocationCheck
+{
+
+  /**
+   * Cache entry the check is for.
+   */
+  struct ResultCacheEntry *rce;
+
+  /**
+   * Pending revocation query, NULL if none is active.
+   */
+  struct GNUNET_REVOCATION_Query *q;
+
+};
+
+
+/**
+ * Final result of a resolution, shared by all lookups for the same
+ * zone, name, record type and options.  While the resolution is
+ * running, further lookups wait for it; afterwards the result is
+ * kept until the records expire.
+ */
+struct ResultCacheEntry
+{
+
+  /**
+   * Key of the entry in #result_cache.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Resolution in progress, NULL once we have the result.
+   */
+  struct GNS_ResolverHandle *rh;
+
+  /**
+   * DLL of lookups waiting for the result.
+   */
+  struct GNS_ResolverHandle *waiter_head;
+
+  /**
+   * DLL of lookups waiting for the result.
+   */
+  struct GNS_ResolverHandle *waiter_tail;
+
+  /**
+   * DLL of lookups being given the result right now.
+   */
+  struct GNS_ResolverHandle *deliver_head;
+
+  /**
+   * DLL of lookups being given the result right now.
+   */
+  struct GNS_ResolverHandle *deliver_tail;
+
+  /**
+   * Node in #result_cache_heap, NULL if the result is not cached
+   * (yet).
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Task giving the cached result to the waiters.
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * GNS zones the result was obtained from.  They are checked for
+   * revocation before we hand out the cached result.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey *zones;
+
+  /**
+   * Revocation checks, one for each of the @e zones.
+   */
+  struct CacheRevocationCheck *rev_checks;
+
+  /**
+   * Serialized records of the result.
+   */
+  char *rd_data;
+
+  /**
+   * When does the result expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Number of bytes in @e rd_data.
+   */
+  size_t rd_data_size;
+
+  /**
+   * Number of records in the result, 0 for a negative result.
+   */
+  unsigned int rd_count;
+
+  /**
+   * Length of the @e zones and @e rev_checks arrays.
+   */
+  unsigned int num_zones;
+
+  /**
+   * Number of revocation checks still pending.
+   */
+  unsigned int rev_pending;
+
 };
 
 
@@ -465,6 +609,43 @@ static int use_cache;
  */
 static const struct GNUNET_CONFIGURATION_Handle *cfg;
 
+/**
+ * Handle to the statistics service.
+ */
+static struct GNUNET_STATISTICS_Handle *stats;
+
+/**
+ * Map from hashes of (zone, name, record type, options) to
+ * `struct ResultCacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *result_cache;
+
+/**
+ * Heap of cached results, ordered by expiration.
+ */
+static struct GNUNET_CONTAINER_Heap *result_cache_heap;
+
+/**
+ * Maximum number of results we keep in #result_cache_heap.
+ */
+static unsigned long long result_cache_size;
+
+/**
+ * For how long do we keep results at most?
+ */
+static struct GNUNET_TIME_Relative result_cache_max_ttl;
+
+/**
+ * For how long do we remember that a lookup failed?
+ */
+static struct GNUNET_TIME_Relative result_cache_negative_ttl;
+
+/**
+ * Monitor for changes to our own zones, which must not stay hidden
+ * behind cached results.
+ */
+static struct GNUNET_NAMESTORE_ZoneMonitor *zone_monitor;
+
 
 /**
  * Determine if this name is canonical (is a legal name in a zone, without delegation);
@@ -2367,9 +2548,581 @@ start_resolver_lookup (void *cls)
 }
 
 
+/* ***************** Result cache ********************* */
+
+
 /**
- * Lookup of a record in a specific zone calls lookup result processor
- * on result.
+ * Compute the key of a lookup in the #result_cache.
+ *
+ * @param zone the zone to perform the lookup in
+ * @param record_type the record type to look up
+ * @param name the name to look up
+ * @param options local options to control local lookup
+ * @param key set to the key
+ */
+static void
+get_result_cache_key (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                      uint32_t record_type,
+                      const char *name,
+                      enum GNUNET_GNS_LocalOptions options,
+                      struct GNUNET_HashCode *key)
+{
+  struct GNUNET_HashContext *hc;
+  uint32_t type_nbo;
+  uint32_t options_nbo;
+
+  type_nbo = htonl (record_type);
+  options_nbo = htonl ((uint32_t) options);
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   zone,
+                                   sizeof (*zone));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   &type_nbo,
+                                   sizeof (type_nbo));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   &options_nbo,
+                                   sizeof (options_nbo));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   name,
+                                   strlen (name));
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     key);
+}
+
+
+/**
+ * Check if anything still waits for the result of @a rce.
+ *
+ * @param rce cache entry to check
+ * @return #GNUNET_YES if the entry is in use
+ */
+static int
+result_cache_entry_busy (const struct ResultCacheEntry *rce)
+{
+  return ( (NULL != rce->rh) ||
+           (NULL != rce->waiter_head) ||
+           (NULL != rce->deliver_head) ||
+           (NULL != rce->task) ||
+           (0 != rce->rev_pending) ) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Update the statistic with the number of cached results.
+ */
+static void
+update_result_cache_stats ()
+{
+  GNUNET_STATISTICS_set (stats,
+                         "# resolver cache entries",
+                         GNUNET_CONTAINER_heap_get_size (result_cache_heap),
+                         GNUNET_NO);
+}
+
+
+/**
+ * Remove @a rce from the cache and free it.  Nothing may wait for
+ * the result of @a rce anymore.
+ *
+ * @param rce cache entry to free
+ */
+static void
+free_result_cache_entry (struct ResultCacheEntry *rce)
+{
+  GNUNET_assert (NULL == rce->waiter_head);
+  GNUNET_assert (NULL == rce->deliver_head);
+  GNUNET_assert (NULL == rce->rh);
+  if (NULL != rce->task)
+  {
+    GNUNET_SCHEDULER_cancel (rce->task);
+    rce->task = NULL;
+  }
+  for (unsigned int i=0;i<rce->num_zones;i++)
+    if (NULL != rce->rev_checks[i].q)
+      GNUNET_REVOCATION_query_cancel (rce->rev_checks[i].q);
+  if (NULL != rce->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (rce->hn);
+    rce->hn = NULL;
+    update_result_cache_stats ();
+  }
+  /* the entry may already have been removed from the map */
+  (void) GNUNET_CONTAINER_multihashmap_remove (result_cache,
+                                               &rce->key,
+                                               rce);
+  GNUNET_free_non_null (rce->zones);
+  GNUNET_free_non_null (rce->rev_checks);
+  GNUNET_free_non_null (rce->rd_data);
+  GNUNET_free (rce);
+}
+
+
+/**
+ * Give a result to all lookups waiting for @a rce.  Lookups that
+ * arrive while we call the processors wait for the next delivery.
+ *
+ * @param rce cache entry with the waiting lookups
+ * @param rd_count number of records in @a rd
+ * @param rd records of the result
+ */
+static void
+deliver_result (struct ResultCacheEntry *rce,
+                uint32_t rd_count,
+                const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct GNS_ResolverHandle *rh;
+
+  GNUNET_assert (NULL == rce->deliver_head);
+  rce->deliver_head = rce->waiter_head;
+  rce->deliver_tail = rce->waiter_tail;
+  rce->waiter_head = NULL;
+  rce->waiter_tail = NULL;
+  for (rh = rce->deliver_head; NULL != rh; rh = rh->next)
+    rh->in_delivery = GNUNET_YES;
+  while (NULL != (rh = rce->deliver_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (rce->deliver_head,
+                                 rce->deliver_tail,
+                                 rh);
+    rh->proc (rh->proc_cls,
+              rd_count,
+              rd);
+    GNUNET_free (rh);
+  }
+}
+
+
+/**
+ * Give the cached result of @a rce to the lookups waiting for it.
+ *
+ * @param cls the `struct ResultCacheEntry`
+ */
+static void
+deliver_cached_result (void *cls)
+{
+  struct ResultCacheEntry *rce = cls;
+
+  rce->task = NULL;
+  if (0 == rce->rd_count)
+  {
+    deliver_result (rce,
+                    0,
+                    NULL);
+    return;
+  }
+  {
+    struct GNUNET_GNSRECORD_Data rd[rce->rd_count];
+
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_GNSRECORD_records_deserialize (rce->rd_data_size,
+                                                         rce->rd_data,
+                                                         rce->rd_count,
+                                                         rd));
+    deliver_result (rce,
+                    rce->rd_count,
+                    rd);
+  }
+}
+
+
+/**
+ * Function called with the result of a revocation check of a zone
+ * a cached result depends on.
+ *
+ * @param cls the `struct CacheRevocationCheck`
+ * @param is_valid #GNUNET_YES if the zone was not yet revoked
+ */
+static void
+handle_cached_revocation_result (void *cls,
+                                 int is_valid)
+{
+  struct CacheRevocationCheck *rc = cls;
+  struct ResultCacheEntry *rce = rc->rce;
+
+  rc->q = NULL;
+  rce->rev_pending--;
+  if (GNUNET_YES != is_valid)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Zone %s was revoked, dropping cached result\n"),
+                GNUNET_GNSRECORD_z2s (&rce->zones[rc - rce->rev_checks]));
+    GNUNET_STATISTICS_update (stats,
+                              "# resolver cache entries revoked",
+                              1,
+                              GNUNET_NO);
+    for (unsigned int i=0;i<rce->num_zones;i++)
+      if (NULL != rce->rev_checks[i].q)
+      {
+        GNUNET_REVOCATION_query_cancel (rce->rev_checks[i].q);
+        rce->rev_checks[i].q = NULL;
+      }
+    rce->rev_pending = 0;
+    GNUNET_CONTAINER_multihashmap_remove (result_cache,
+                                          &rce->key,
+                                          rce);
+    deliver_result (rce,
+                    0,
+                    NULL);
+    free_result_cache_entry (rce);
+    return;
+  }
+  if (0 != rce->rev_pending)
+    return;
+  deliver_cached_result (rce);
+}
+
+
+/**
+ * Give the cached result of @a rce to the lookups waiting for it
+ * once we know that none of the zones it depends on was revoked.
+ *
+ * @param rce cache entry with a result
+ */
+static void
+start_cached_delivery (struct ResultCacheEntry *rce)
+{
+  if ( (NULL != rce->task) ||
+       (0 != rce->rev_pending) )
+    return; /* delivery already pending */
+  if (0 == rce->num_zones)
+  {
+    rce->task = GNUNET_SCHEDULER_add_now (&deliver_cached_result,
+                                          rce);
+    return;
+  }
+  rce->rev_pending = rce->num_zones;
+  for (unsigned int i=0;i<rce->num_zones;i++)
+  {
+    rce->rev_checks[i].rce = rce;
+    rce->rev_checks[i].q
+      = GNUNET_REVOCATION_query (cfg,
+                                 &rce->zones[i],
+                                 &handle_cached_revocation_result,
+                                 &rce->rev_checks[i]);
+    GNUNET_assert (NULL != rce->rev_checks[i].q);
+  }
+}
+
+
+/**
+ * Drop expired results and, if we have too many, the results that
+ * expire first.  Results that are still being handed out are kept,
+ * so the cache may briefly exceed #result_cache_size.
+ */
+static void
+trim_result_cache ()
+{
+  struct ResultCacheEntry *rce;
+  struct GNUNET_TIME_Absolute now;
+
+  now = GNUNET_TIME_absolute_get ();
+  while (NULL != (rce = GNUNET_CONTAINER_heap_peek (result_cache_heap)))
+  {
+    if ( (GNUNET_CONTAINER_heap_get_size (result_cache_heap) <= result_cache_size) &&
+         (rce->expiration.abs_value_us > now.abs_value_us) )
+      break;
+    if (GNUNET_YES == result_cache_entry_busy (rce))
+      break;
+    free_result_cache_entry (rce);
+  }
+}
+
+
+/**
+ * Remember the GNS zones @a rh went through, they must be checked
+ * for revocation before we hand out the cached result.
+ *
+ * @param rce cache entry to update
+ * @param rh the resolution that produced the result
+ */
+static void
+store_result_zones (struct ResultCacheEntry *rce,
+                    const struct GNS_ResolverHandle *rh)
+{
+  const struct AuthorityChain *ac;
+  unsigned int n;
+
+  n = 0;
+  for (ac = rh->ac_head; NULL != ac; ac = ac->next)
+    if (GNUNET_YES == ac->gns_authority)
+      n++;
+  if (0 == n)
+    return;
+  rce->zones = GNUNET_new_array (n,
+                                 struct GNUNET_CRYPTO_EcdsaPublicKey);
+  rce->rev_checks = GNUNET_new_array (n,
+                                      struct CacheRevocationCheck);
+  for (ac = rh->ac_head; NULL != ac; ac = ac->next)
+    if (GNUNET_YES == ac->gns_authority)
+      rce->zones[rce->num_zones++] = ac->authority_info.gns_authority;
+}
+
+
+/**
+ * The resolution for @a cls finished.  Cache the result and give it
+ * to all lookups waiting for it.
+ *
+ * @param cls the `struct ResultCacheEntry`
+ * @param rd_count number of records in @a rd
+ * @param rd records of the result
+ */
+static void
+handle_resolution_result (void *cls,
+                          uint32_t rd_count,
+                          const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct ResultCacheEntry *rce = cls;
+  struct GNUNET_TIME_Absolute now;
+  ssize_t len;
+
+  now = GNUNET_TIME_absolute_get ();
+  if (0 == rd_count)
+    rce->expiration = GNUNET_TIME_relative_to_absolute (result_cache_negative_ttl);
+  else
+    rce->expiration
+      = GNUNET_TIME_absolute_min (GNUNET_GNSRECORD_record_get_expiration_time (rd_count,
+                                                                               rd),
+                                  GNUNET_TIME_relative_to_absolute (result_cache_max_ttl));
+  len = GNUNET_GNSRECORD_records_get_size (rd_count,
+                                           rd);
+  /* if a zone the result came from changed meanwhile, the entry
+     was taken out of the map and the result may be outdated */
+  if ( (0 != result_cache_size) &&
+       (rce->expiration.abs_value_us > now.abs_value_us) &&
+       (len >= 0) &&
+       (GNUNET_YES ==
+        GNUNET_CONTAINER_multihashmap_contains_value (result_cache,
+                                                      &rce->key,
+                                                      rce)) )
+  {
+    rce->rd_count = rd_count;
+    rce->rd_data_size = (size_t) len;
+    if (0 != len)
+    {
+      rce->rd_data = GNUNET_malloc (len);
+      GNUNET_assert (len ==
+                     GNUNET_GNSRECORD_records_serialize (rd_count,
+                                                         rd,
+                                                         len,
+                                                         rce->rd_data));
+    }
+    store_result_zones (rce,
+                        rce->rh);
+    rce->hn = GNUNET_CONTAINER_heap_insert (result_cache_heap,
+                                            rce,
+                                            rce->expiration.abs_value_us);
+    update_result_cache_stats ();
+  }
+  else
+  {
+    /* not cacheable, new lookups must start a new resolution */
+    GNUNET_CONTAINER_multihashmap_remove (result_cache,
+                                          &rce->key,
+                                          rce);
+  }
+  /* the caller of our result processor frees the resolution */
+  rce->rh = NULL;
+  deliver_result (rce,
+                  rd_count,
+                  rd);
+  if (NULL == rce->hn)
+    free_result_cache_entry (rce);
+  else
+    trim_result_cache ();
+}
+
+
+/**
+ * Closure for #find_zone_results().
+ */
+struct ZoneChangeContext
+{
+
+  /**
+   * The zone that changed.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey zone;
+
+  /**
+   * Cache entries found to be affected by the change.
+   */
+  struct ResultCacheEntry **matches;
+
+  /**
+   * Number of entries in @e matches.
+   */
+  unsigned int num_matches;
+
+  /**
+   * #GNUNET_YES to match all entries, regardless of @e zone.
+   */
+  int all;
+
+};
+
+
+/**
+ * Check if the result of @a rce depends on the zone @a zone.
+ *
+ * @param rce cache entry to check
+ * @param zone a GNS zone
+ * @return #GNUNET_YES if @a rce went (or is going) through @a zone
+ */
+static int
+result_depends_on_zone (const struct ResultCacheEntry *rce,
+                        const struct GNUNET_CRYPTO_EcdsaPublicKey *zone)
+{
+  const struct AuthorityChain *ac;
+
+  if (NULL != rce->rh)
+  {
+    /* zones the resolution reaches later are read after the change */
+    for (ac = rce->rh->ac_head; NULL != ac; ac = ac->next)
+      if ( (GNUNET_YES == ac->gns_authority) &&
+           (0 == memcmp (zone,
+                         &ac->authority_info.gns_authority,
+                         sizeof (*zone))) )
+        return GNUNET_YES;
+    return GNUNET_NO;
+  }
+  for (unsigned int i=0;i<rce->num_zones;i++)
+    if (0 == memcmp (zone,
+                     &rce->zones[i],
+                     sizeof (*zone)))
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Collect the cache entries affected by a zone change.
+ *
+ * @param cls the `struct ZoneChangeContext`
+ * @param key unused
+ * @param value a `struct ResultCacheEntry`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+find_zone_results (void *cls,
+                   const struct GNUNET_HashCode *key,
+                   void *value)
+{
+  struct ZoneChangeContext *zcc = cls;
+  struct ResultCacheEntry *rce = value;
+
+  if ( (GNUNET_YES == zcc->all) ||
+       (GNUNET_YES == result_depends_on_zone (rce,
+                                              &zcc->zone)) )
+    GNUNET_array_append (zcc->matches,
+                         zcc->num_matches,
+                         rce);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Drop the cached results affected by a zone change.  Results that
+ * are still being computed or handed out are only taken out of the
+ * map, so that new lookups start a fresh resolution; they are freed
+ * once they are no longer busy.
+ *
+ * @param zcc the zone change
+ */
+static void
+drop_zone_results (struct ZoneChangeContext *zcc)
+{
+  struct ResultCacheEntry *rce;
+
+  GNUNET_CONTAINER_multihashmap_iterate (result_cache,
+                                         &find_zone_results,
+                                         zcc);
+  for (unsigned int i=0;i<zcc->num_matches;i++)
+  {
+    rce = zcc->matches[i];
+    GNUNET_STATISTICS_update (stats,
+                              "# resolver cache entries invalidated",
+                              1,
+                              GNUNET_NO);
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (result_cache,
+                                                         &rce->key,
+                                                         rce));
+    if (NULL == rce->hn)
+      continue; /* resolution running, will not be cached */
+    if (GNUNET_NO == result_cache_entry_busy (rce))
+    {
+      free_result_cache_entry (rce);
+      continue;
+    }
+    rce->expiration = GNUNET_TIME_UNIT_ZERO_ABS;
+    GNUNET_CONTAINER_heap_update_cost (rce->hn,
+                                       0);
+  }
+  GNUNET_array_grow (zcc->matches,
+                     zcc->num_matches,
+                     0);
+}
+
+
+/**
+ * Records in one of our own zones changed.  The namestore tells us
+ * once the namecache has the new block, so dropping the results
+ * that depend on the zone is enough to make the change visible.
+ *
+ * @param cls NULL
+ * @param zone private key of the zone
+ * @param label label of the records
+ * @param rd_count number of records in @a rd
+ * @param rd the new records
+ */
+static void
+handle_zone_change (void *cls,
+                    const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                    const char *label,
+                    unsigned int rd_count,
+                    const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct ZoneChangeContext zcc;
+
+  memset (&zcc,
+          0,
+          sizeof (zcc));
+  GNUNET_CRYPTO_ecdsa_key_get_public (zone,
+                                      &zcc.zone);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Records under `%s' in zone %s changed, dropping cached results\n",
+              label,
+              GNUNET_GNSRECORD_z2s (&zcc.zone));
+  drop_zone_results (&zcc);
+  trim_result_cache ();
+}
+
+
+/**
+ * We lost the connection to the namestore and may miss changes to
+ * our own zones, drop all cached results.
+ *
+ * @param cls NULL
+ */
+static void
+handle_zone_monitor_error (void *cls)
+{
+  struct ZoneChangeContext zcc;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              _("Lost connection to the namestore, dropping cached results\n"));
+  memset (&zcc,
+          0,
+          sizeof (zcc));
+  zcc.all = GNUNET_YES;
+  drop_zone_results (&zcc);
+  trim_result_cache ();
+}
+
+
+/**
+ * Start resolving a record in a specific zone.
  *
  * @param zone the zone to perform the lookup in
  * @param record_type the record type to look up
@@ -2379,13 +3132,13 @@ start_resolver_lookup (void *cls)
  * @param proc_cls the closure to pass to @a proc
  * @return handle to cancel operation
  */
-struct GNS_ResolverHandle *
-GNS_resolver_lookup (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
-		     uint32_t record_type,
-		     const char *name,
-		     enum GNUNET_GNS_LocalOptions options,
-		     GNS_ResultProcessor proc,
-		     void *proc_cls)
+static struct GNS_ResolverHandle *
+start_resolution (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                  uint32_t record_type,
+                  const char *name,
+                  enum GNUNET_GNS_LocalOptions options,
+                  GNS_ResultProcessor proc,
+                  void *proc_cls)
 {
   struct GNS_ResolverHandle *rh;
 
@@ -2409,6 +3162,101 @@ GNS_resolver_lookup (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
 }
 
 
+/**
+ * Lookup of a record in a specific zone calls lookup result processor
+ * on result.  Lookups for the same zone, name, record type and
+ * options share one resolution and its result is cached until the
+ * records expire.
+ *
+ * @param zone the zone to perform the lookup in
+ * @param record_type the record type to look up
+ * @param name the name to look up
+ * @param options local options to control local lookup
+ * @param proc the processor to call on result
+ * @param proc_cls the closure to pass to @a proc
+ * @return handle to cancel operation
+ */
+struct GNS_ResolverHandle *
+GNS_resolver_lookup (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+		     uint32_t record_type,
+		     const char *name,
+		     enum GNUNET_GNS_LocalOptions options,
+		     GNS_ResultProcessor proc,
+		     void *proc_cls)
+{
+  struct GNS_ResolverHandle *rh;
+  struct ResultCacheEntry *rce;
+  struct GNUNET_HashCode key;
+
+  get_result_cache_key (zone,
+                        record_type,
+                        name,
+                        options,
+                        &key);
+  rce = GNUNET_CONTAINER_multihashmap_get (result_cache,
+                                           &key);
+  if ( (NULL != rce) &&
+       (NULL == rce->rh) &&
+       (0 == GNUNET_TIME_absolute_get_remaining (rce->expiration).rel_value_us) &&
+       (GNUNET_NO == result_cache_entry_busy (rce)) )
+  {
+    free_result_cache_entry (rce);
+    rce = NULL;
+  }
+  rh = GNUNET_new (struct GNS_ResolverHandle);
+  rh->proc = proc;
+  rh->proc_cls = proc_cls;
+  if (NULL == rce)
+  {
+    GNUNET_STATISTICS_update (stats,
+                              "# resolver cache misses",
+                              1,
+                              GNUNET_NO);
+    rce = GNUNET_new (struct ResultCacheEntry);
+    rce->key = key;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (result_cache,
+                                                      &rce->key,
+                                                      rce,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    rce->rh = start_resolution (zone,
+                                record_type,
+                                name,
+                                options,
+                                &handle_resolution_result,
+                                rce);
+  }
+  else if (NULL != rce->rh)
+  {
+    GNUNET_STATISTICS_update (stats,
+                              "# resolver lookups coalesced",
+                              1,
+                              GNUNET_NO);
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Using cached result for `%s'\n",
+                name);
+    GNUNET_STATISTICS_update (stats,
+                              "# resolver cache hits",
+                              1,
+                              GNUNET_NO);
+    if (0 == rce->rd_count)
+      GNUNET_STATISTICS_update (stats,
+                                "# resolver cache negative hits",
+                                1,
+                                GNUNET_NO);
+    start_cached_delivery (rce);
+  }
+  rh->rce = rce;
+  GNUNET_CONTAINER_DLL_insert_tail (rce->waiter_head,
+                                    rce->waiter_tail,
+                                    rh);
+  return rh;
+}
+
+
 /**
  * Cancel active resolution (i.e. client disconnected).
  *
@@ -2420,7 +3268,30 @@ GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh)
   struct DnsResult *dr;
   struct AuthorityChain *ac;
   struct VpnContext *vpn_ctx;
+  struct ResultCacheEntry *rce;
 
+  if (NULL != (rce = rh->rce))
+  {
+    /* lookup waiting for a (cached) result */
+    if (GNUNET_YES == rh->in_delivery)
+      GNUNET_CONTAINER_DLL_remove (rce->deliver_head,
+                                   rce->deliver_tail,
+                                   rh);
+    else
+      GNUNET_CONTAINER_DLL_remove (rce->waiter_head,
+                                   rce->waiter_tail,
+                                   rh);
+    GNUNET_free (rh);
+    if ( (NULL != rce->rh) &&
+         (NULL == rce->waiter_head) )
+    {
+      /* nobody wants the result anymore */
+      GNS_resolver_lookup_cancel (rce->rh);
+      rce->rh = NULL;
+      free_result_cache_entry (rce);
+    }
+    return;
+  }
   GNUNET_CONTAINER_DLL_remove (rlh_head,
 			       rlh_tail,
 			       rh);
@@ -2513,12 +3384,14 @@ GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh)
  *
  * @param nc the namecache handle
  * @param dht the dht handle
+ * @param st handle to the statistics service
  * @param c configuration handle
  * @param max_bg_queries maximum number of parallel background queries in dht
  */
 void
 GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
 		   struct GNUNET_DHT_Handle *dht,
+		   struct GNUNET_STATISTICS_Handle *st,
 		   const struct GNUNET_CONFIGURATION_Handle *c,
 		   unsigned long long max_bg_queries)
 {
@@ -2527,6 +3400,42 @@ GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
   cfg = c;
   namecache_handle = nc;
   dht_handle = dht;
+  stats = st;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (c,
+                                             "gns",
+                                             "RESULT_CACHE_SIZE",
+                                             &result_cache_size))
+    result_cache_size = DEFAULT_RESULT_CACHE_SIZE;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (c,
+                                           "gns",
+                                           "RESULT_CACHE_MAX_TTL",
+                                           &result_cache_max_ttl))
+    result_cache_max_ttl = DEFAULT_RESULT_CACHE_MAX_TTL;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (c,
+                                           "gns",
+                                           "RESULT_CACHE_NEGATIVE_TTL",
+                                           &result_cache_negative_ttl))
+    result_cache_negative_ttl = DEFAULT_RESULT_CACHE_NEGATIVE_TTL;
+  result_cache = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                       GNUNET_NO);
+  result_cache_heap =
+    GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  if (0 != result_cache_size)
+  {
+    zone_monitor = GNUNET_NAMESTORE_zone_monitor_start (c,
+                                                        NULL,
+                                                        GNUNET_NO,
+                                                        &handle_zone_monitor_error,
+                                                        NULL,
+                                                        &handle_zone_change,
+                                                        NULL,
+                                                        NULL,
+                                                        NULL);
+    GNUNET_break (NULL != zone_monitor);
+  }
   dht_lookup_heap =
     GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   max_allowed_background_queries = max_bg_queries;
@@ -2561,14 +3470,45 @@ void
 GNS_resolver_done ()
 {
   struct GNS_ResolverHandle *rh;
+  struct ResultCacheEntry *rce;
   struct CacheOps *co;
 
+  if (NULL != zone_monitor)
+  {
+    GNUNET_NAMESTORE_zone_monitor_stop (zone_monitor);
+    zone_monitor = NULL;
+  }
   /* abort active resolutions */
   while (NULL != (rh = rlh_head))
   {
     rh->proc (rh->proc_cls, 0, NULL);
     GNS_resolver_lookup_cancel (rh);
   }
+  /* abort lookups waiting for cached results, drop the cache */
+  while (NULL != (rce = GNUNET_CONTAINER_heap_peek (result_cache_heap)))
+  {
+    if (NULL != rce->task)
+    {
+      GNUNET_SCHEDULER_cancel (rce->task);
+      rce->task = NULL;
+    }
+    for (unsigned int i=0;i<rce->num_zones;i++)
+      if (NULL != rce->rev_checks[i].q)
+      {
+        GNUNET_REVOCATION_query_cancel (rce->rev_checks[i].q);
+        rce->rev_checks[i].q = NULL;
+      }
+    rce->rev_pending = 0;
+    deliver_result (rce,
+                    0,
+                    NULL);
+    free_result_cache_entry (rce);
+  }
+  GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (result_cache));
+  GNUNET_CONTAINER_multihashmap_destroy (result_cache);
+  result_cache = NULL;
+  GNUNET_CONTAINER_heap_destroy (result_cache_heap);
+  result_cache_heap = NULL;
   while (NULL != (co = co_head))
   {
     GNUNET_CONTAINER_DLL_remove (co_head,
@@ -2585,6 +3525,7 @@ GNS_resolver_done ()
   vpn_handle = NULL;
   dht_handle = NULL;
   namecache_handle = NULL;
+  stats = NULL;
 }
 
 
@@ -28,6 +28,7 @@
 #include "gnunet_dht_service.h"
 #include "gnunet_gns_service.h"
 #include "gnunet_namecache_service.h"
+#include "gnunet_statistics_service.h"
 
 /**
  * Initialize the resolver subsystem.
@@ -35,12 +36,14 @@
  *
  * @param nc the namecache handle
  * @param dht handle to the dht
+ * @param st handle to the statistics service
  * @param c configuration handle
  * @param max_bg_queries maximum amount of background queries
  */
 void
 GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
 		   struct GNUNET_DHT_Handle *dht,
+		   struct GNUNET_STATISTICS_Handle *st,
 		   const struct GNUNET_CONFIGURATION_Handle *c,
 		   unsigned long long max_bg_queries);
 
@@ -73,7 +76,9 @@ typedef void
 
 /**
  * Lookup of a record in a specific zone
- * calls RecordLookupProcessor on result or timeout
+ * calls RecordLookupProcessor on result or timeout.
+ * Identical lookups share one resolution and its
+ * result is cached until the records expire.
  *
  * @param zone the zone to perform the lookup in
  * @param record_type the record type to look up
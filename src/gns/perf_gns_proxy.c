@@ -0,0 +1,865 @@
+/*
+     This file is part of GNUnet
+     Copyright (C) 2017 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+/**
+ * @file gns/perf_gns_proxy.c
+ * @brief benchmark for HTTPS connections to many domains via the GNS proxy
+ *
+ * We publish A records for NUM_DOMAINS synthetic domains, start the
+ * proxy and fetch "https://dN.gnu/" for each domain three times: with
+ * empty certificate caches, with the certificates in memory and after
+ * a restart of the proxy (certificates in the disk cache).  Nothing
+ * listens on port 443 of the target, so the proxy answers with its
+ * error page; we measure the proxy side of the connections (GNS
+ * lookup, certificate and TLS handshake), not the upstream.
+ */
+#include "platform.h"
+#if HAVE_CURL_CURL_H
+#include <curl/curl.h>
+#elif HAVE_GNURL_CURL_H
+#include <gnurl/curl.h>
+#endif
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+#include "gnunet_util_lib.h"
+#include "gnunet_identity_service.h"
+#include "gnunet_namestore_service.h"
+#include "gnunet_dnsparser_lib.h"
+#include "gnunet_gnsrecord_lib.h"
+#include "gnunet_testing_lib.h"
+
+/**
+ * Port the proxy listens on.
+ */
+#define PROXY_PORT 7778
+
+/**
+ * Default number of domains we fetch from.
+ */
+#define NUM_DOMAINS 100
+
+/**
+ * How many fetches do we run in parallel?
+ */
+#define PARALLEL 8
+
+/**
+ * Name of the ego we create for the proxy.
+ */
+#define EGO_NAME "perf-gns-proxy"
+
+/**
+ * How long do we give the proxy to start?
+ */
+#define PROXY_START_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 2)
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 10)
+
+
+/**
+ * Return value for 'main'.
+ */
+static int global_ret;
+
+/**
+ * Number of domains to fetch from.
+ */
+static unsigned int num_domains = NUM_DOMAINS;
+
+/**
+ * Our configuration (with the CA of the proxy).
+ */
+static struct GNUNET_CONFIGURATION_Handle *cfg;
+
+/**
+ * Configuration file for the proxy.
+ */
+static char *tmp_cfgfile;
+
+/**
+ * File with the CA certificate and key of the proxy.
+ */
+static char *cafile;
+
+/**
+ * Handle to the identity service.
+ */
+static struct GNUNET_IDENTITY_Handle *identity;
+
+/**
+ * Operation with the identity service.
+ */
+static struct GNUNET_IDENTITY_Operation *id_op;
+
+/**
+ * Our ego.
+ */
+static struct GNUNET_IDENTITY_Ego *ego;
+
+/**
+ * Handle to the namestore.
+ */
+static struct GNUNET_NAMESTORE_Handle *namestore;
+
+/**
+ * Pending namestore operation.
+ */
+static struct GNUNET_NAMESTORE_QueueEntry *qe;
+
+/**
+ * Path of the proxy binary.
+ */
+static char *proxy_binary;
+
+/**
+ * The proxy process.
+ */
+static struct GNUNET_OS_Process *proxy_proc;
+
+/**
+ * cURL multi handle.
+ */
+static CURLM *multi;
+
+/**
+ * Task running cURL or starting the next round.
+ */
+static struct GNUNET_SCHEDULER_Task *curl_task;
+
+/**
+ * Timeout task.
+ */
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+/**
+ * Number of records stored so far.
+ */
+static unsigned int stored;
+
+/**
+ * Next domain to fetch from in the current round.
+ */
+static unsigned int next_domain;
+
+/**
+ * Number of fetches completed in the current round.
+ */
+static unsigned int completed;
+
+/**
+ * Number of fetches that failed in the current round.
+ */
+static unsigned int failed;
+
+/**
+ * Current round (0, 1, 2).
+ */
+static unsigned int round_num;
+
+/**
+ * When did the current round start?
+ */
+static struct GNUNET_TIME_Absolute round_start;
+
+
+/**
+ * Descriptions of the rounds.
+ */
+static const char *round_names[] = {
+  "new certificates",
+  "certificates in memory",
+  "certificates on disk, after restart"
+};
+
+
+/**
+ * Stop the proxy.
+ */
+static void
+stop_proxy ()
+{
+  if (NULL == proxy_proc)
+    return;
+  (void) GNUNET_OS_process_kill (proxy_proc, SIGTERM);
+  GNUNET_assert (GNUNET_OK == GNUNET_OS_process_wait (proxy_proc));
+  GNUNET_OS_process_destroy (proxy_proc);
+  proxy_proc = NULL;
+}
+
+
+/**
+ * Clean up.
+ *
+ * @param cls NULL
+ */
+static void
+do_shutdown (void *cls)
+{
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  if (NULL != curl_task)
+  {
+    GNUNET_SCHEDULER_cancel (curl_task);
+    curl_task = NULL;
+  }
+  if (NULL != multi)
+  {
+    CURLMsg *msg;
+    int running;
+
+    /* remaining handles */
+    while (NULL != (msg = curl_multi_info_read (multi, &running)))
+    {
+      curl_multi_remove_handle (multi, msg->easy_handle);
+      curl_easy_cleanup (msg->easy_handle);
+    }
+    curl_multi_cleanup (multi);
+    multi = NULL;
+  }
+  if (NULL != qe)
+  {
+    GNUNET_NAMESTORE_cancel (qe);
+    qe = NULL;
+  }
+  if (NULL != namestore)
+  {
+    GNUNET_NAMESTORE_disconnect (namestore);
+    namestore = NULL;
+  }
+  if (NULL != id_op)
+  {
+    GNUNET_IDENTITY_cancel (id_op);
+    id_op = NULL;
+  }
+  if (NULL != identity)
+  {
+    GNUNET_IDENTITY_disconnect (identity);
+    identity = NULL;
+  }
+  stop_proxy ();
+  if (NULL != tmp_cfgfile)
+  {
+    if (0 != UNLINK (tmp_cfgfile))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                tmp_cfgfile);
+    GNUNET_free (tmp_cfgfile);
+    tmp_cfgfile = NULL;
+  }
+  if (NULL != cafile)
+  {
+    if (0 != UNLINK (cafile))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                cafile);
+    GNUNET_free (cafile);
+    cafile = NULL;
+  }
+  if (NULL != cfg)
+  {
+    GNUNET_CONFIGURATION_destroy (cfg);
+    cfg = NULL;
+  }
+}
+
+
+/**
+ * We took too long.
+ *
+ * @param cls NULL
+ */
+static void
+do_timeout (void *cls)
+{
+  timeout_task = NULL;
+  fprintf (stderr,
+           "Timeout in round %u\n",
+           round_num);
+  global_ret = 1;
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Print the resident set size of the proxy.
+ */
+static void
+report_proxy_rss ()
+{
+#ifdef LINUX
+  char fn[64];
+  FILE *f;
+  unsigned long pages;
+  unsigned long rss;
+
+  GNUNET_snprintf (fn,
+                   sizeof (fn),
+                   "/proc/%u/statm",
+                   (unsigned int) GNUNET_OS_process_get_pid (proxy_proc));
+  f = fopen (fn, "r");
+  if (NULL == f)
+    return;
+  if (2 == fscanf (f, "%lu %lu", &pages, &rss))
+    printf ("  proxy RSS: %lu KiB\n",
+            rss * (unsigned long) sysconf (_SC_PAGESIZE) / 1024);
+  fclose (f);
+#endif
+}
+
+
+/**
+ * Discard data received by cURL.
+ *
+ * @param ptr data
+ * @param size size of an element
+ * @param nmemb number of elements
+ * @param ctx NULL
+ * @return number of bytes consumed
+ */
+static size_t
+discard_cb (void *ptr,
+            size_t size,
+            size_t nmemb,
+            void *ctx)
+{
+  return size * nmemb;
+}
+
+
+/**
+ * Start fetching from the next domain.
+ */
+static void
+start_fetch ()
+{
+  CURL *curl;
+  char url[64];
+  char proxy[64];
+
+  GNUNET_snprintf (url,
+                   sizeof (url),
+                   "https://d%u.gnu/",
+                   next_domain++);
+  GNUNET_snprintf (proxy,
+                   sizeof (proxy),
+                   "socks5h://127.0.0.1:%u",
+                   PROXY_PORT);
+  curl = curl_easy_init ();
+  GNUNET_assert (NULL != curl);
+  curl_easy_setopt (curl, CURLOPT_URL, url);
+  curl_easy_setopt (curl, CURLOPT_PROXY, proxy);
+  curl_easy_setopt (curl, CURLOPT_CAINFO, cafile);
+  curl_easy_setopt (curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  curl_easy_setopt (curl, CURLOPT_SSL_VERIFYHOST, 2L);
+  curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, &discard_cb);
+  curl_easy_setopt (curl, CURLOPT_TIMEOUT, 60L);
+  curl_easy_setopt (curl, CURLOPT_CONNECTTIMEOUT, 15L);
+  curl_easy_setopt (curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt (curl, CURLOPT_FORBID_REUSE, 1L);
+  GNUNET_assert (CURLM_OK == curl_multi_add_handle (multi, curl));
+}
+
+
+/**
+ * Start a round of fetches.
+ *
+ * @param cls NULL
+ */
+static void
+start_round (void *cls);
+
+
+/**
+ * Start the proxy and the next round once it is up.
+ */
+static void
+start_proxy ()
+{
+  char port_s[16];
+
+  GNUNET_snprintf (port_s,
+                   sizeof (port_s),
+                   "%u",
+                   PROXY_PORT);
+  proxy_proc = GNUNET_OS_start_process (GNUNET_NO,
+                                        GNUNET_OS_INHERIT_STD_ALL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        proxy_binary,
+                                        "gnunet-gns-proxy",
+                                        "-c", tmp_cfgfile,
+                                        "-p", port_s,
+                                        NULL);
+  if (NULL == proxy_proc)
+  {
+    fprintf (stderr,
+             "Failed to start gnunet-gns-proxy\n");
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  curl_task = GNUNET_SCHEDULER_add_delayed (PROXY_START_DELAY,
+                                            &start_round,
+                                            NULL);
+}
+
+
+/**
+ * A round is complete, report and continue.
+ */
+static void
+finish_round ()
+{
+  struct GNUNET_TIME_Relative delta;
+
+  delta = GNUNET_TIME_absolute_get_duration (round_start);
+  printf ("%u HTTPS connections (%s) took %s",
+          num_domains,
+          round_names[round_num],
+          GNUNET_STRINGS_relative_time_to_string (delta,
+                                                  GNUNET_YES));
+  printf (" (%s per domain), %u failed\n",
+          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_relative_divide (delta,
+                                                                               num_domains),
+                                                  GNUNET_YES),
+          failed);
+  report_proxy_rss ();
+  if (0 != failed)
+    global_ret = 2;
+  round_num++;
+  if (1 == round_num)
+  {
+    curl_task = GNUNET_SCHEDULER_add_now (&start_round,
+                                          NULL);
+    return;
+  }
+  if (2 == round_num)
+  {
+    stop_proxy ();
+    start_proxy ();
+    return;
+  }
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Run cURL.
+ *
+ * @param cls NULL
+ */
+static void
+curl_run (void *cls)
+{
+  fd_set rs;
+  fd_set ws;
+  fd_set es;
+  int max;
+  struct GNUNET_NETWORK_FDSet nrs;
+  struct GNUNET_NETWORK_FDSet nws;
+  struct GNUNET_TIME_Relative delay;
+  long timeout;
+  int running;
+  CURLMsg *msg;
+
+  curl_task = NULL;
+  curl_multi_perform (multi, &running);
+  while (NULL != (msg = curl_multi_info_read (multi, &running)))
+  {
+    if (CURLMSG_DONE != msg->msg)
+      continue;
+    if (CURLE_OK != msg->data.result)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Fetch failed: %s\n",
+                  curl_easy_strerror (msg->data.result));
+      failed++;
+    }
+    completed++;
+    curl_multi_remove_handle (multi, msg->easy_handle);
+    curl_easy_cleanup (msg->easy_handle);
+    if (next_domain < num_domains)
+      start_fetch ();
+  }
+  if (completed == num_domains)
+  {
+    finish_round ();
+    return;
+  }
+  curl_multi_perform (multi, &running);
+  max = -1;
+  FD_ZERO (&rs);
+  FD_ZERO (&ws);
+  FD_ZERO (&es);
+  GNUNET_assert (CURLM_OK == curl_multi_fdset (multi, &rs, &ws, &es, &max));
+  if ( (CURLM_OK != curl_multi_timeout (multi, &timeout)) ||
+       (-1 == timeout) ||
+       (-1 == max) )
+    delay = GNUNET_TIME_UNIT_MILLISECONDS;
+  else
+    delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                           (unsigned int) timeout);
+  GNUNET_NETWORK_fdset_copy_native (&nrs,
+                                    &rs,
+                                    max + 1);
+  GNUNET_NETWORK_fdset_copy_native (&nws,
+                                    &ws,
+                                    max + 1);
+  curl_task = GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
+                                           delay,
+                                           &nrs,
+                                           &nws,
+                                           &curl_run,
+                                           NULL);
+}
+
+
+/**
+ * Start a round of fetches.
+ *
+ * @param cls NULL
+ */
+static void
+start_round (void *cls)
+{
+  curl_task = NULL;
+  next_domain = 0;
+  completed = 0;
+  failed = 0;
+  round_start = GNUNET_TIME_absolute_get ();
+  while ( (next_domain < num_domains) &&
+          (next_domain < PARALLEL) )
+    start_fetch ();
+  curl_run (NULL);
+}
+
+
+/**
+ * Store the record of the next domain.
+ */
+static void
+store_next ();
+
+
+/**
+ * Continuation called once a record was stored.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK on success
+ * @param emsg error message, NULL on success
+ */
+static void
+store_cont (void *cls,
+            int32_t success,
+            const char *emsg)
+{
+  qe = NULL;
+  if (GNUNET_OK != success)
+  {
+    fprintf (stderr,
+             "Failed to store record: %s\n",
+             emsg);
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  stored++;
+  if (stored < num_domains)
+  {
+    store_next ();
+    return;
+  }
+  start_proxy ();
+}
+
+
+static void
+store_next ()
+{
+  struct GNUNET_GNSRECORD_Data rd;
+  struct in_addr addr;
+  char label[32];
+
+  GNUNET_assert (1 == inet_pton (AF_INET,
+                                 "127.0.0.1",
+                                 &addr));
+  memset (&rd, 0, sizeof (rd));
+  rd.data = &addr;
+  rd.data_size = sizeof (addr);
+  rd.record_type = GNUNET_DNSPARSER_TYPE_A;
+  rd.expiration_time = GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us;
+  GNUNET_snprintf (label,
+                   sizeof (label),
+                   "d%u",
+                   stored);
+  qe = GNUNET_NAMESTORE_records_store (namestore,
+                                       GNUNET_IDENTITY_ego_get_private_key (ego),
+                                       label,
+                                       1,
+                                       &rd,
+                                       &store_cont,
+                                       NULL);
+}
+
+
+/**
+ * Our ego is now the one of the proxy, store the records.
+ *
+ * @param cls NULL
+ * @param emsg error message, NULL on success
+ */
+static void
+ego_set_cont (void *cls,
+              const char *emsg)
+{
+  id_op = NULL;
+  if (NULL != emsg)
+  {
+    fprintf (stderr,
+             "Failed to set ego for the proxy: %s\n",
+             emsg);
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  store_next ();
+}
+
+
+/**
+ * Called by the identity service for each ego.  We wait for the
+ * ego we created.
+ *
+ * @param cls NULL
+ * @param e ego handle
+ * @param ctx unused
+ * @param name name of the ego
+ */
+static void
+identity_cb (void *cls,
+             struct GNUNET_IDENTITY_Ego *e,
+             void **ctx,
+             const char *name)
+{
+  if ( (NULL != ego) ||
+       (NULL == e) ||
+       (NULL == name) ||
+       (0 != strcmp (name,
+                     EGO_NAME)) )
+    return;
+  ego = e;
+  id_op = GNUNET_IDENTITY_set (identity,
+                               "gns-proxy",
+                               ego,
+                               &ego_set_cont,
+                               NULL);
+}
+
+
+/**
+ * The ego was created.
+ *
+ * @param cls NULL
+ * @param emsg error message, NULL on success
+ */
+static void
+ego_create_cont (void *cls,
+                 const char *emsg)
+{
+  id_op = NULL;
+  if (NULL != emsg)
+  {
+    fprintf (stderr,
+             "Failed to create ego: %s\n",
+             emsg);
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+  }
+}
+
+
+/**
+ * Create a CA for the proxy and write its certificate and key to
+ * #cafile.
+ *
+ * @return #GNUNET_OK on success
+ */
+static int
+create_ca ()
+{
+  gnutls_x509_privkey_t key;
+  gnutls_x509_crt_t crt;
+  unsigned int serial = 1;
+  char pem[2 * 10 * 1024];
+  size_t off;
+  size_t len;
+  int ret;
+
+  cafile = GNUNET_DISK_mktemp ("perf-gns-proxy-ca.pem");
+  if (NULL == cafile)
+    return GNUNET_SYSERR;
+  gnutls_x509_privkey_init (&key);
+  gnutls_x509_crt_init (&crt);
+  ret = gnutls_x509_privkey_generate (key,
+                                      GNUTLS_PK_RSA,
+                                      2048,
+                                      0);
+  gnutls_x509_crt_set_key (crt, key);
+  gnutls_x509_crt_set_dn_by_oid (crt, GNUTLS_OID_X520_COMMON_NAME,
+                                 0, "perf-gns-proxy", strlen ("perf-gns-proxy"));
+  gnutls_x509_crt_set_version (crt, 3);
+  gnutls_x509_crt_set_serial (crt, &serial, sizeof (serial));
+  gnutls_x509_crt_set_activation_time (crt, time (NULL));
+  gnutls_x509_crt_set_expiration_time (crt, time (NULL) + 7 * 24 * 60 * 60);
+  gnutls_x509_crt_set_basic_constraints (crt, 1, -1);
+  gnutls_x509_crt_set_key_usage (crt, GNUTLS_KEY_KEY_CERT_SIGN);
+  if (GNUTLS_E_SUCCESS == ret)
+    ret = gnutls_x509_crt_sign (crt, crt, key);
+  off = 0;
+  len = sizeof (pem);
+  if (GNUTLS_E_SUCCESS == ret)
+    ret = gnutls_x509_crt_export (crt, GNUTLS_X509_FMT_PEM,
+                                  pem, &len);
+  off = len;
+  len = sizeof (pem) - off;
+  if (GNUTLS_E_SUCCESS == ret)
+    ret = gnutls_x509_privkey_export (key, GNUTLS_X509_FMT_PEM,
+                                      &pem[off], &len);
+  gnutls_x509_crt_deinit (crt);
+  gnutls_x509_privkey_deinit (key);
+  if (GNUTLS_E_SUCCESS != ret)
+    return GNUNET_SYSERR;
+  off += len;
+  if (off != GNUNET_DISK_fn_write (cafile,
+                                   pem,
+                                   off,
+                                   GNUNET_DISK_PERM_USER_READ
+                                   | GNUNET_DISK_PERM_USER_WRITE))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Main function of the benchmark.
+ *
+ * @param cls NULL
+ * @param c configuration of the peer
+ * @param peer handle to the peer
+ */
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *c,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  GNUNET_SCHEDULER_add_shutdown (&do_shutdown,
+                                 NULL);
+  timeout_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                               &do_timeout,
+                                               NULL);
+  cfg = GNUNET_CONFIGURATION_dup (c);
+  if (GNUNET_OK != create_ca ())
+  {
+    fprintf (stderr,
+             "Failed to create CA\n");
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  GNUNET_CONFIGURATION_set_value_string (cfg,
+                                         "gns-proxy",
+                                         "PROXY_CACERT",
+                                         cafile);
+  tmp_cfgfile = GNUNET_DISK_mktemp ("perf_gns_proxy_tmp.conf");
+  if ( (NULL == tmp_cfgfile) ||
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_write (cfg,
+                                    tmp_cfgfile)) )
+  {
+    fprintf (stderr,
+             "Failed to write configuration\n");
+    global_ret = 1;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  multi = curl_multi_init ();
+  GNUNET_assert (NULL != multi);
+  namestore = GNUNET_NAMESTORE_connect (cfg);
+  GNUNET_assert (NULL != namestore);
+  identity = GNUNET_IDENTITY_connect (cfg,
+                                      &identity_cb,
+                                      NULL);
+  GNUNET_assert (NULL != identity);
+  id_op = GNUNET_IDENTITY_create (identity,
+                                  EGO_NAME,
+                                  &ego_create_cont,
+                                  NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  if (argc > 1)
+    num_domains = atoi (argv[1]);
+  if (0 == num_domains)
+  {
+    fprintf (stderr,
+             "Usage: %s [NUM_DOMAINS]\n",
+             argv[0]);
+    return 1;
+  }
+  GNUNET_log_setup ("perf-gns-proxy",
+                    "WARNING",
+                    NULL);
+  proxy_binary = GNUNET_OS_get_libexec_binary_path ("gnunet-gns-proxy");
+  if (GNUNET_SYSERR ==
+      GNUNET_OS_check_helper_binary (proxy_binary,
+                                     GNUNET_NO,
+                                     NULL))
+  {
+    fprintf (stderr,
+             "Proxy binary not installed... skipping!\n");
+    GNUNET_free (proxy_binary);
+    return 0;
+  }
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+  {
+    fprintf (stderr,
+             "failed to initialize curl\n");
+    return 2;
+  }
+  gnutls_global_init ();
+  if (0 != GNUNET_TESTING_peer_run ("perf-gns-proxy",
+                                    "perf_gns_proxy.conf",
+                                    &run,
+                                    NULL))
+    global_ret = 1;
+  gnutls_global_deinit ();
+  curl_global_cleanup ();
+  GNUNET_DISK_directory_remove ("/tmp/perf-gns-proxy");
+  GNUNET_free (proxy_binary);
+  return global_ret;
+}
+
+/* end of perf_gns_proxy.c */
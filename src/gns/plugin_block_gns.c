@@ -42,6 +42,34 @@
  */
 #define GNS_BF_SIZE 8
 
+/**
+ * How many blocks with verified signatures do we remember?
+ */
+#define VERIFIED_CACHE_SIZE 1024
+
+
+/**
+ * Context used inside the plugin.
+ */
+struct InternalContext
+{
+  /**
+   * Hashes of the blocks in @e verified_ring, mapped to NULL.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *verified;
+
+  /**
+   * Hashes of recently verified blocks, oldest at
+   * @e verified_off once the ring is full.
+   */
+  struct GNUNET_HashCode verified_ring[VERIFIED_CACHE_SIZE];
+
+  /**
+   * Next slot to use in @e verified_ring.
+   */
+  unsigned int verified_off;
+};
+
 
 /**
  * Create a new block group.
@@ -121,9 +149,11 @@ block_plugin_gns_evaluate (void *cls,
                            const void *reply_block,
                            size_t reply_block_size)
 {
+  struct InternalContext *ic = cls;
   const struct GNUNET_GNSRECORD_Block *block;
   struct GNUNET_HashCode h;
   struct GNUNET_HashCode chash;
+  struct GNUNET_HashCode *slot;
 
   if (type != GNUNET_BLOCK_TYPE_GNS_NAMERECORD)
     return GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED;
@@ -158,15 +188,36 @@ block_plugin_gns_evaluate (void *cls,
       GNUNET_break_op (0);
       return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
     }
-  if (GNUNET_OK !=
-      GNUNET_GNSRECORD_block_verify (block))
+  GNUNET_CRYPTO_hash (reply_block,
+                      reply_block_size,
+                      &chash);
+  /* the DHT evaluates the same block on every hop and for every
+     GET that hits it in the datacache; the hash covers the
+     signature, so a block we verified before is still valid */
+  if (GNUNET_NO ==
+      GNUNET_CONTAINER_multihashmap_contains (ic->verified,
+                                              &chash))
+  {
+    if (GNUNET_OK !=
+        GNUNET_GNSRECORD_block_verify (block))
     {
       GNUNET_break_op (0);
       return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
     }
-  GNUNET_CRYPTO_hash (reply_block,
-                      reply_block_size,
-                      &chash);
+    slot = &ic->verified_ring[ic->verified_off];
+    if (VERIFIED_CACHE_SIZE ==
+        GNUNET_CONTAINER_multihashmap_size (ic->verified))
+      GNUNET_break (1 ==
+                    GNUNET_CONTAINER_multihashmap_remove_all (ic->verified,
+                                                              slot));
+    *slot = chash;
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_CONTAINER_multihashmap_put (ic->verified,
+                                                     &chash,
+                                                     NULL,
+                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    ic->verified_off = (ic->verified_off + 1) % VERIFIED_CACHE_SIZE;
+  }
   if (GNUNET_YES ==
       GNUNET_BLOCK_GROUP_bf_test_and_set (bg,
                                           &chash))
@@ -222,12 +273,17 @@ libgnunet_plugin_block_gns_init (void *cls)
     GNUNET_BLOCK_TYPE_ANY       /* end of list */
   };
   struct GNUNET_BLOCK_PluginFunctions *api;
+  struct InternalContext *ic;
 
+  ic = GNUNET_new (struct InternalContext);
+  ic->verified = GNUNET_CONTAINER_multihashmap_create (VERIFIED_CACHE_SIZE,
+                                                      GNUNET_NO);
   api = GNUNET_new (struct GNUNET_BLOCK_PluginFunctions);
   api->evaluate = &block_plugin_gns_evaluate;
   api->get_key = &block_plugin_gns_get_key;
   api->create_group = &block_plugin_gns_create_group;
   api->types = types;
+  api->cls = ic;
   return api;
 }
 
@@ -239,7 +295,10 @@ void *
 libgnunet_plugin_block_gns_done (void *cls)
 {
   struct GNUNET_BLOCK_PluginFunctions *api = cls;
+  struct InternalContext *ic = api->cls;
 
+  GNUNET_CONTAINER_multihashmap_destroy (ic->verified);
+  GNUNET_free (ic);
   GNUNET_free (api);
   return NULL;
 }
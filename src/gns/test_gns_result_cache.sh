@@ -0,0 +1,69 @@
+#!/bin/bash
+trap "gnunet-arm -e -c test_gns_lookup.conf" SIGINT
+
+LOCATION=$(which gnunet-config)
+if [ -z $LOCATION ]
+then
+  LOCATION="gnunet-config"
+fi
+$LOCATION --version 1> /dev/null
+if test $? != 0
+then
+	echo "GNUnet command line tools cannot be found, check environmental variables PATH and GNUNET_PREFIX"
+	exit 77
+fi
+
+rm -rf `gnunet-config -c test_gns_lookup.conf -s PATHS -o GNUNET_HOME -f`
+which timeout &> /dev/null && DO_TIMEOUT="timeout 30"
+TEST_IP="127.0.0.1"
+TEST_IP2="127.0.0.2"
+gnunet-arm -s -c test_gns_lookup.conf
+gnunet-identity -C testego -c test_gns_lookup.conf
+gnunet-namestore -p -z testego -a -n www -t A -V $TEST_IP -e never -c test_gns_lookup.conf
+RES_IP=`$DO_TIMEOUT gnunet-gns --raw -z testego -u www.gnu -t A -c test_gns_lookup.conf`
+RES_IP_CACHED=`$DO_TIMEOUT gnunet-gns --raw -z testego -u www.gnu -t A -c test_gns_lookup.conf`
+HITS=`gnunet-statistics -c test_gns_lookup.conf -s gns -n "# resolver cache hits" -q`
+# edits to our own zone must be visible at once, not when the
+# cached results expire
+gnunet-namestore -z testego -d -n www -t A -V $TEST_IP -e never -c test_gns_lookup.conf
+gnunet-namestore -p -z testego -a -n www -t A -V $TEST_IP2 -e never -c test_gns_lookup.conf
+RES_IP_EDITED=`$DO_TIMEOUT gnunet-gns --raw -z testego -u www.gnu -t A -c test_gns_lookup.conf`
+RES_IP_MISSING=`$DO_TIMEOUT gnunet-gns --raw -z testego -u new.gnu -t A -c test_gns_lookup.conf`
+gnunet-namestore -p -z testego -a -n new -t A -V $TEST_IP -e never -c test_gns_lookup.conf
+RES_IP_ADDED=`$DO_TIMEOUT gnunet-gns --raw -z testego -u new.gnu -t A -c test_gns_lookup.conf`
+gnunet-namestore -z testego -d -n www -t A -V $TEST_IP2 -e never -c test_gns_lookup.conf
+gnunet-namestore -z testego -d -n new -t A -V $TEST_IP -e never -c test_gns_lookup.conf
+gnunet-identity -D testego -c test_gns_lookup.conf
+gnunet-arm -e -c test_gns_lookup.conf
+
+if [ "$RES_IP" != "$TEST_IP" ]
+then
+  echo "FAIL: Failed to resolve to proper IP, got $RES_IP."
+  exit 1
+fi
+if [ "$RES_IP_CACHED" != "$TEST_IP" ]
+then
+  echo "FAIL: Failed to resolve to proper IP from cache, got $RES_IP_CACHED."
+  exit 1
+fi
+if [ "$HITS" != "1" ]
+then
+  echo "FAIL: Expected one cache hit, got $HITS."
+  exit 1
+fi
+if [ "$RES_IP_EDITED" != "$TEST_IP2" ]
+then
+  echo "FAIL: Edited record not visible, got $RES_IP_EDITED."
+  exit 1
+fi
+if [ "$RES_IP_MISSING" != "" ]
+then
+  echo "FAIL: Resolved a name that does not exist to $RES_IP_MISSING."
+  exit 1
+fi
+if [ "$RES_IP_ADDED" != "$TEST_IP" ]
+then
+  echo "FAIL: Added record not visible, got $RES_IP_ADDED."
+  exit 1
+fi
+exit 0
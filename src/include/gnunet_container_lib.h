@@ -231,7 +231,9 @@ typedef int
  *        to next power of 2
  * @param k the number of #GNUNET_CRYPTO_hash-functions to apply per
  *        element (number of bits set per element in the set)
- * @return the bloomfilter
+ * @return the bloomfilter, NULL on error or if the file was not
+ *         closed cleanly (then updates of its counters were lost,
+ *         so it may miss elements)
  */
 struct GNUNET_CONTAINER_BloomFilter *
 GNUNET_CONTAINER_bloomfilter_load (const char *filename,
@@ -287,6 +289,25 @@ GNUNET_CONTAINER_bloomfilter_test (const struct GNUNET_CONTAINER_BloomFilter *bf
                                    const struct GNUNET_HashCode *e);
 
 
+/**
+ * @ingroup bloomfilter
+ * Test if elements are in the filter.  Faster than testing the
+ * elements one by one.
+ *
+ * @param bf the filter
+ * @param e array of elements to test
+ * @param count number of elements in @a e
+ * @param[out] results array of @a count results, set to #GNUNET_YES
+ *             if the element is in the filter, #GNUNET_NO if not
+ * @return number of elements in the filter
+ */
+unsigned int
+GNUNET_CONTAINER_bloomfilter_test_batch (const struct GNUNET_CONTAINER_BloomFilter *bf,
+                                         const struct GNUNET_HashCode *e,
+                                         unsigned int count,
+                                         int *results);
+
+
 /**
  * @ingroup bloomfilter
  * Add an element to the filter.
@@ -299,6 +320,20 @@ GNUNET_CONTAINER_bloomfilter_add (struct GNUNET_CONTAINER_BloomFilter *bf,
                                   const struct GNUNET_HashCode *e);
 
 
+/**
+ * @ingroup bloomfilter
+ * Add elements to the filter.
+ *
+ * @param bf the filter
+ * @param e array of elements to add
+ * @param count number of elements in @a e
+ */
+void
+GNUNET_CONTAINER_bloomfilter_add_batch (struct GNUNET_CONTAINER_BloomFilter *bf,
+                                        const struct GNUNET_HashCode *e,
+                                        unsigned int count);
+
+
 /**
  * @ingroup bloomfilter
  * Remove an element from the filter.
@@ -335,6 +370,21 @@ void
 GNUNET_CONTAINER_bloomfilter_free (struct GNUNET_CONTAINER_BloomFilter *bf);
 
 
+/**
+ * @ingroup bloomfilter
+ * Write pending changes to the usage counters of a filter that was
+ * loaded from a file to the drive.  Counters are written lazily,
+ * in batches; use this to make sure the file is up to date without
+ * freeing the filter.
+ *
+ * @param bf the filter
+ * @return #GNUNET_OK on success (or if @a bf is not backed by a file),
+ *         #GNUNET_SYSERR on write errors
+ */
+int
+GNUNET_CONTAINER_bloomfilter_flush (struct GNUNET_CONTAINER_BloomFilter *bf);
+
+
 /**
  * Get the number of the addresses set per element in the bloom filter.
  *
@@ -786,6 +836,50 @@ GNUNET_CONTAINER_multihashmap_create (unsigned int len,
 				      int do_not_copy_keys);
 
 
+/**
+ * @ingroup hashmap
+ * Memory layouts available for a HashMap.
+ */
+enum GNUNET_CONTAINER_MultiHashMapLayout
+{
+
+  /**
+   * @ingroup hashmap
+   * Buckets with a linked list of individually allocated entries.
+   * Iterators survive growing the map.  This is the default.
+   */
+  GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_CHAINED = 0,
+
+  /**
+   * @ingroup hashmap
+   * Open addressing with linear probing over a flat array of 64-bit
+   * key fingerprints, with keys and values in a second flat array.
+   * Puts do not allocate (except when growing) and lookups touch few
+   * cache lines, which pays off for maps with many entries.  Removed
+   * entries leave a marker behind until the map is next rebuilt, so
+   * removing entries while iterating is safe.
+   */
+  GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING = 1
+};
+
+
+/**
+ * @ingroup hashmap
+ * Create a multi hash map with a particular memory layout.  All
+ * layouts behave the same (including iterator invalidation), they
+ * only differ in performance.
+ *
+ * @param len initial size (map will grow as needed)
+ * @param do_not_copy_keys see #GNUNET_CONTAINER_multihashmap_create()
+ * @param layout memory layout to use
+ * @return NULL on error
+ */
+struct GNUNET_CONTAINER_MultiHashMap *
+GNUNET_CONTAINER_multihashmap_create_with_layout (unsigned int len,
+                                                  int do_not_copy_keys,
+                                                  enum GNUNET_CONTAINER_MultiHashMapLayout layout);
+
+
 /**
  * @ingroup hashmap
  * Destroy a hash map.  Will not free any values
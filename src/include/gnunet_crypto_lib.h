@@ -77,6 +77,7 @@ struct GNUNET_ShortHashCode
 struct GNUNET_PeerIdentity;
 
 #include "gnunet_common.h"
+#include "gnunet_time_lib.h"
 #include <gcrypt.h>
 
 
@@ -576,6 +577,118 @@ GNUNET_CRYPTO_symmetric_decrypt (const void *block,
                                  void *result);
 
 
+/**
+ * @ingroup crypto
+ * Keyed context for symmetric encryption with a fixed session key.
+ */
+struct GNUNET_CRYPTO_SymmetricContext;
+
+
+/**
+ * @ingroup crypto
+ * Create a keyed context for encrypting and decrypting many blocks
+ * with the same session key.  Cheaper than calling
+ * #GNUNET_CRYPTO_symmetric_encrypt() for every block, as the key
+ * schedules are only computed once.  A context must not be used
+ * by multiple threads at the same time.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free with #GNUNET_CRYPTO_symmetric_context_destroy()
+ */
+struct GNUNET_CRYPTO_SymmetricContext *
+GNUNET_CRYPTO_symmetric_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey);
+
+
+/**
+ * @ingroup crypto
+ * Encrypt a block using a keyed context.
+ *
+ * @param ctx the keyed context
+ * @param block the block to encrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may overlap with @a block
+ * @return the size of the encrypted block, -1 for errors
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_encrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result);
+
+
+/**
+ * @ingroup crypto
+ * Decrypt a block using a keyed context.
+ *
+ * @param ctx the keyed context
+ * @param block the data to decrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may overlap with @a block
+ * @return -1 on failure, size of decrypted block on success
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_decrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result);
+
+
+/**
+ * @ingroup crypto
+ * Encrypt @a num independent blocks using a keyed context.
+ *
+ * @param ctx the keyed context
+ * @param num number of blocks
+ * @param blocks the blocks to encrypt
+ * @param sizes the size of each block
+ * @param ivs the initialization vector for each block
+ * @param results where to store the encrypted blocks, each may be the
+ *                same as the respective block
+ */
+void
+GNUNET_CRYPTO_symmetric_context_encrypt_bulk (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                              unsigned int num,
+                                              const void *const *blocks,
+                                              const size_t *sizes,
+                                              const struct GNUNET_CRYPTO_SymmetricInitializationVector *ivs,
+                                              void *const *results);
+
+
+/**
+ * @ingroup crypto
+ * Decrypt @a num independent blocks using a keyed context.
+ *
+ * @param ctx the keyed context
+ * @param num number of blocks
+ * @param blocks the blocks to decrypt
+ * @param sizes the size of each block
+ * @param ivs the initialization vector for each block
+ * @param results where to store the decrypted blocks, each may be the
+ *                same as the respective block
+ */
+void
+GNUNET_CRYPTO_symmetric_context_decrypt_bulk (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                              unsigned int num,
+                                              const void *const *blocks,
+                                              const size_t *sizes,
+                                              const struct GNUNET_CRYPTO_SymmetricInitializationVector *ivs,
+                                              void *const *results);
+
+
+/**
+ * @ingroup crypto
+ * Destroy a keyed context.
+ *
+ * @param ctx context to destroy
+ */
+void
+GNUNET_CRYPTO_symmetric_context_destroy (struct GNUNET_CRYPTO_SymmetricContext *ctx);
+
+
 /**
  * @ingroup crypto
  * @brief Derive an IV
@@ -869,6 +982,131 @@ GNUNET_CRYPTO_hash_get_bit (const struct GNUNET_HashCode *code,
 			    unsigned int bit);
 
 
+/**
+ * @ingroup hash
+ * Count the number of leading zero bits in a hash, as used
+ * for proofs of work.
+ *
+ * @param hash the hash to inspect
+ * @return number of leading zero bits
+ */
+unsigned int
+GNUNET_CRYPTO_hash_count_leading_zeros (const struct GNUNET_HashCode *hash);
+
+
+/**
+ * @ingroup hash
+ * Calculate the SCRYPT-based proof-of-work hash (an expensive hash).
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param buf data to hash
+ * @param buf_len number of bytes in @a buf
+ * @param result where to write the resulting hash
+ */
+void
+GNUNET_CRYPTO_pow_hash (const char *salt,
+                        const void *buf,
+                        size_t buf_len,
+                        struct GNUNET_HashCode *result);
+
+
+/**
+ * @ingroup hash
+ * Check whether @a nonce is a valid proof of work for @a data.  The
+ * hash input is the nonce (in host byte order) followed by @a data.
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param data data the proof is for
+ * @param data_size number of bytes in @a data
+ * @param nonce the nonce to check
+ * @param matching_bits number of leading zero bits required
+ * @return #GNUNET_YES if valid, #GNUNET_NO if not
+ */
+int
+GNUNET_CRYPTO_pow_check (const char *salt,
+                         const void *data,
+                         size_t data_size,
+                         uint64_t nonce,
+                         unsigned int matching_bits);
+
+
+/**
+ * @ingroup hash
+ * Handle for a proof-of-work search running in the background.
+ */
+struct GNUNET_CRYPTO_PowSearch;
+
+
+/**
+ * Function called periodically during a proof-of-work search.
+ *
+ * @param cls closure
+ * @param checkpoint all nonces below this value have been tested,
+ *        the search can be resumed from here
+ */
+typedef void
+(*GNUNET_CRYPTO_PowProgressCallback) (void *cls,
+                                      uint64_t checkpoint);
+
+
+/**
+ * Function called once a proof of work was found.  The search
+ * handle is invalid afterwards.
+ *
+ * @param cls closure
+ * @param proof the nonce that satisfies the proof of work
+ */
+typedef void
+(*GNUNET_CRYPTO_PowResultCallback) (void *cls,
+                                    uint64_t proof);
+
+
+/**
+ * @ingroup hash
+ * Start searching for a proof of work for @a data in the background.
+ * The nonce space starting at @a start is split among @a num_threads
+ * worker threads; the callbacks are run from the scheduler.  Falls
+ * back to searching from the scheduler if threads are not available.
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param data data the proof is for
+ * @param data_size number of bytes in @a data, at most 1024
+ * @param start first nonce to test
+ * @param matching_bits number of leading zero bits required
+ * @param num_threads number of threads to use, 0 for one per CPU
+ * @param delay how long each thread should pause between batches
+ *        of nonces, to limit the CPU load
+ * @param progress_cb function to call periodically with a
+ *        checkpoint, can be NULL
+ * @param result_cb function to call once a proof was found
+ * @param cb_cls closure for @a progress_cb and @a result_cb
+ * @return handle to stop the search, NULL on error
+ */
+struct GNUNET_CRYPTO_PowSearch *
+GNUNET_CRYPTO_pow_search_start (const char *salt,
+                                const void *data,
+                                size_t data_size,
+                                uint64_t start,
+                                unsigned int matching_bits,
+                                unsigned int num_threads,
+                                struct GNUNET_TIME_Relative delay,
+                                GNUNET_CRYPTO_PowProgressCallback progress_cb,
+                                GNUNET_CRYPTO_PowResultCallback result_cb,
+                                void *cb_cls);
+
+
+/**
+ * @ingroup hash
+ * Stop a proof-of-work search.  Must not be called after the
+ * result callback of the search was invoked.
+ *
+ * @param ps search to stop
+ * @return nonce from which to resume the search later
+ */
+uint64_t
+GNUNET_CRYPTO_pow_search_stop (struct GNUNET_CRYPTO_PowSearch *ps);
+
+
 /**
  * @ingroup hash
  * Determine how many low order bits match in two
@@ -1382,9 +1620,27 @@ GNUNET_CRYPTO_ecc_dlog_prepare (unsigned int max,
 				unsigned int mem);
 
 
+/**
+ * Do pre-calculation for ECC discrete logarithm for small factors,
+ * keeping the table in @a filename.  If @a filename contains a table
+ * for the same parameters, it is mapped into memory; otherwise the
+ * table is calculated and written to @a filename for the next time.
+ *
+ * @param max maximum value the factor can be
+ * @param mem memory to use (should be smaller than @a max), must not be zero.
+ * @param filename file with the table
+ * @return NULL on error
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_dlog_prepare_file (unsigned int max,
+                                     unsigned int mem,
+                                     const char *filename);
+
+
 /**
  * Calculate ECC discrete logarithm for small factors.
  * Opposite of #GNUNET_CRYPTO_ecc_dexp().
+ * The giant steps are split among one thread per CPU.
  *
  * @param dlc precalculated values, determine range of factors
  * @param input point on the curve to factor
@@ -1679,6 +1935,153 @@ GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
                             const struct GNUNET_CRYPTO_EcdsaPublicKey *pub);
 
 
+/**
+ * @ingroup crypto
+ * Kind of signature in a `struct GNUNET_CRYPTO_VerifyItem`.
+ */
+enum GNUNET_CRYPTO_VerifyType
+{
+  /**
+   * EdDSA signature, verified as by #GNUNET_CRYPTO_eddsa_verify().
+   */
+  GNUNET_CRYPTO_VERIFY_EDDSA = 0,
+
+  /**
+   * ECDSA signature, verified as by #GNUNET_CRYPTO_ecdsa_verify().
+   */
+  GNUNET_CRYPTO_VERIFY_ECDSA = 1
+};
+
+
+/**
+ * @ingroup crypto
+ * One signature to check as part of a batch.
+ */
+struct GNUNET_CRYPTO_VerifyItem
+{
+  /**
+   * Kind of signature, determines which members of
+   * @e sig and @e pub are used.
+   */
+  enum GNUNET_CRYPTO_VerifyType type;
+
+  /**
+   * What is the purpose that the signature should have?
+   */
+  uint32_t purpose;
+
+  /**
+   * Block to validate (size, purpose, data).
+   */
+  const struct GNUNET_CRYPTO_EccSignaturePurpose *validate;
+
+  /**
+   * Signature that is being validated.
+   */
+  union
+  {
+    const struct GNUNET_CRYPTO_EddsaSignature *eddsa;
+    const struct GNUNET_CRYPTO_EcdsaSignature *ecdsa;
+  } sig;
+
+  /**
+   * Public key of the signer.
+   */
+  union
+  {
+    const struct GNUNET_CRYPTO_EddsaPublicKey *eddsa;
+    const struct GNUNET_CRYPTO_EcdsaPublicKey *ecdsa;
+  } pub;
+};
+
+
+/**
+ * @ingroup crypto
+ * Pool of threads verifying signatures in the background.
+ */
+struct GNUNET_CRYPTO_VerifyPool;
+
+
+/**
+ * @ingroup crypto
+ * Handle for a batch of signatures being verified.
+ */
+struct GNUNET_CRYPTO_VerifyBatch;
+
+
+/**
+ * Function called with the results of a batch of signature
+ * checks.  The batch handle is invalid afterwards.
+ *
+ * @param cls closure
+ * @param num_items number of items in the batch
+ * @param results #GNUNET_OK or #GNUNET_SYSERR for each item,
+ *        in the order the items were given
+ */
+typedef void
+(*GNUNET_CRYPTO_VerifyBatchCallback) (void *cls,
+                                      unsigned int num_items,
+                                      const int *results);
+
+
+/**
+ * @ingroup crypto
+ * Create a pool of threads to verify signatures with.  Batches
+ * submitted to the pool are verified on the threads, the results
+ * are delivered from the scheduler.  Falls back to verifying from
+ * the scheduler if threads are not available.
+ *
+ * @param num_threads number of threads to use, 0 for one per CPU
+ * @return the pool
+ */
+struct GNUNET_CRYPTO_VerifyPool *
+GNUNET_CRYPTO_verify_pool_create (unsigned int num_threads);
+
+
+/**
+ * @ingroup crypto
+ * Destroy a verification pool.  Batches that have not completed
+ * yet are cancelled, their callbacks are not invoked.
+ *
+ * @param pool pool to destroy
+ */
+void
+GNUNET_CRYPTO_verify_pool_destroy (struct GNUNET_CRYPTO_VerifyPool *pool);
+
+
+/**
+ * @ingroup crypto
+ * Verify a batch of signatures in the background.  The items
+ * (including the data they point to) are copied, so the caller
+ * may release them as soon as this function returns.
+ *
+ * @param pool pool to verify the signatures with
+ * @param items signatures to verify
+ * @param num_items number of entries in @a items, must not be 0
+ * @param cb function to call with the results
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the batch, NULL if an item is malformed
+ *         (its signed data is shorter than the purpose header)
+ */
+struct GNUNET_CRYPTO_VerifyBatch *
+GNUNET_CRYPTO_verify_batch_start (struct GNUNET_CRYPTO_VerifyPool *pool,
+                                  const struct GNUNET_CRYPTO_VerifyItem *items,
+                                  unsigned int num_items,
+                                  GNUNET_CRYPTO_VerifyBatchCallback cb,
+                                  void *cb_cls);
+
+
+/**
+ * @ingroup crypto
+ * Cancel a batch of signature checks.  Must not be called after
+ * the callback of the batch was invoked.
+ *
+ * @param vb batch to cancel
+ */
+void
+GNUNET_CRYPTO_verify_batch_cancel (struct GNUNET_CRYPTO_VerifyBatch *vb);
+
+
 /**
  * @ingroup crypto
  * Derive a private key from a given private key and a label.
@@ -604,6 +604,21 @@ GNUNET_MQ_send (struct GNUNET_MQ_Handle *mq,
 		struct GNUNET_MQ_Envelope *ev);
 
 
+/**
+ * Create an envelope that shares the message of @a env instead of
+ * copying it, so that the same message can be queued with several
+ * message queues.  The message is freed once @a env and all
+ * envelopes sharing it were sent or discarded; it must not be
+ * modified after it was shared.  Options and callbacks of @a env
+ * are not shared.
+ *
+ * @param env envelope with the message to share
+ * @return new envelope with the same message
+ */
+struct GNUNET_MQ_Envelope *
+GNUNET_MQ_env_share (struct GNUNET_MQ_Envelope *env);
+
+
 /**
  * Send a copy of a message with the given message queue.
  * Can be called repeatedly on the same envelope.
@@ -794,6 +809,53 @@ void
 GNUNET_MQ_impl_send_continue (struct GNUNET_MQ_Handle *mq);
 
 
+/**
+ * Obtain the current message and the messages queued behind it, so
+ * that the implementation can transmit several of them with a single
+ * system call.  The implementation must report the outcome with
+ * #GNUNET_MQ_impl_send_continue_multiple() before returning to the
+ * scheduler, as the queued messages may be cancelled afterwards.
+ *
+ * Only useful for implementing message queues, results in undefined
+ * behavior if not used carefully.
+ *
+ * @param mq message queue with the current message
+ * @param[out] msgs set to the current message followed by queued ones
+ * @param msgs_len length of the @a msgs array, at least 1
+ * @return number of messages stored in @a msgs, at least 1
+ */
+unsigned int
+GNUNET_MQ_impl_peek (struct GNUNET_MQ_Handle *mq,
+                     const struct GNUNET_MessageHeader **msgs,
+                     unsigned int msgs_len);
+
+
+/**
+ * Tell the queue that the current message and the @a done - 1
+ * messages queued behind it (as returned by #GNUNET_MQ_impl_peek())
+ * were transmitted completely, and call their send notifications.
+ * If @a next_started is #GNUNET_YES, the following message was
+ * partially transmitted and becomes the current (in flight) message
+ * without the send implementation being called for it; otherwise
+ * this behaves like #GNUNET_MQ_impl_send_continue().
+ *
+ * The notifications may destroy the queue, so the implementation
+ * must not touch @a mq (or its own state) after this call.
+ *
+ * Only useful for implementing message queues, results in undefined
+ * behavior if not used carefully.
+ *
+ * @param mq message queue to send the next message with
+ * @param done number of messages transmitted completely, at least 1
+ * @param next_started #GNUNET_YES if the message following these
+ *        was partially transmitted
+ */
+void
+GNUNET_MQ_impl_send_continue_multiple (struct GNUNET_MQ_Handle *mq,
+                                       unsigned int done,
+                                       int next_started);
+
+
 /**
  * Call the send notification for the current message, but do not
  * try to send the next message until #gnunet_mq_impl_send_continue
@@ -312,6 +312,23 @@ GNUNET_NETWORK_socket_send (const struct GNUNET_NETWORK_Handle *desc,
                             size_t length);
 
 
+/**
+ * Send data from several buffers with a single system call
+ * (always non-blocking).
+ *
+ * @param desc socket
+ * @param buffers array of @a num buffers to send, in order
+ * @param lengths sizes of the respective @a buffers
+ * @param num number of entries in @a buffers and @a lengths
+ * @return number of bytes sent, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_NETWORK_socket_sendv (const struct GNUNET_NETWORK_Handle *desc,
+                             const void *const *buffers,
+                             const size_t *lengths,
+                             unsigned int num);
+
+
 /**
  * Send data to a particular destination (always non-blocking).
  * This function only works for UDP sockets.
@@ -693,6 +693,21 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_STATISTICS_DISCONNECT_CONFIRM 175
 
+/**
+ * Client asks the service for a shared memory segment with counters.
+ */
+#define GNUNET_MESSAGE_TYPE_STATISTICS_SHM_ATTACH 176
+
+/**
+ * Service cannot provide a shared memory segment to the client.
+ */
+#define GNUNET_MESSAGE_TYPE_STATISTICS_SHM_REJECT 177
+
+/**
+ * Service tells the client where to map its shared memory segment.
+ */
+#define GNUNET_MESSAGE_TYPE_STATISTICS_SHM_GRANT 178
+
 /*******************************************************************************
  * VPN message types
  ******************************************************************************/
@@ -130,6 +130,13 @@ void
 GNUNET_REVOCATION_revoke_cancel (struct GNUNET_REVOCATION_Handle *h);
 
 
+/**
+ * Salt of the proof-of-work hash for revocations, for use with
+ * #GNUNET_CRYPTO_pow_search_start() to find a proof.
+ */
+#define GNUNET_REVOCATION_POW_SALT "gnunet-revocation-proof-of-work"
+
+
 /**
  * Check if the given proof-of-work value
  * would be acceptable for revoking the given key.
@@ -372,6 +372,16 @@ struct GNUNET_SCHEDULER_Driver *
 GNUNET_SCHEDULER_driver_select (void);
 
 
+/**
+ * Obtain the driver for using epoll() as the event loop.  This is
+ * the default driver used by #GNUNET_SCHEDULER_run() where available.
+ *
+ * @return NULL on error (or if epoll is not supported on this platform)
+ */
+struct GNUNET_SCHEDULER_Driver *
+GNUNET_SCHEDULER_driver_epoll (void);
+
+
 /**
  * Signature of the select function used by the scheduler.
  * #GNUNET_NETWORK_socket_select matches it.
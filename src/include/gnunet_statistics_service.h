@@ -218,6 +218,45 @@ GNUNET_STATISTICS_update (struct GNUNET_STATISTICS_Handle *handle,
                           int make_persistent);
 
 
+/**
+ * Handle for a counter that is updated without talking to the
+ * service for each change.
+ */
+struct GNUNET_STATISTICS_Counter;
+
+
+/**
+ * Obtain a fast counter for a statistic of our subsystem.  If the
+ * "SHM_SLOTS" option is set, the counter lives in memory shared with
+ * the statistics service, which picks up changes periodically and
+ * whenever values are requested.  Otherwise, changes are passed to
+ * #GNUNET_STATISTICS_update().  Counters are only ever updated by
+ * adding to them; mixing them with #GNUNET_STATISTICS_set() for the
+ * same value gives undefined results.  The counter is released
+ * together with the @a handle.
+ *
+ * @param handle identification of the statistics service
+ * @param name name of the statistic value
+ * @param make_persistent should the value be kept across restarts?
+ * @return NULL if @a handle is NULL
+ */
+struct GNUNET_STATISTICS_Counter *
+GNUNET_STATISTICS_counter_get (struct GNUNET_STATISTICS_Handle *handle,
+                               const char *name,
+                               int make_persistent);
+
+
+/**
+ * Change the value of a counter.
+ *
+ * @param counter counter to change, may be NULL
+ * @param delta change in value (added to existing value)
+ */
+void
+GNUNET_STATISTICS_counter_add (struct GNUNET_STATISTICS_Counter *counter,
+                               int64_t delta);
+
+
 
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
@@ -36,6 +36,12 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
 
+/**
+ * How many results of a zone iteration do we queue for a client
+ * before waiting for the transmission to complete?
+ */
+#define MAX_ITERATION_BATCH 128
+
 
 /**
  * A namestore client
@@ -79,13 +85,31 @@ struct ZoneIteration
   uint32_t request_id;
 
   /**
-   * Offset of the zone iteration used to address next result of the zone
-   * iteration in the store
+   * Serial number of the last record returned by the zone iteration,
+   * the next round resumes after it.
    *
    * Initialy set to 0 in handle_iteration_start
-   * Incremented with by every call to handle_iteration_next
+   * Updated with every result passed to the client
+   */
+  uint64_t seq;
+
+  /**
+   * Number of results the client asked for that we did not
+   * send yet.
+   */
+  uint64_t limit;
+
+  /**
+   * #GNUNET_YES if we wait for the last result of a batch to be
+   * transmitted before we send more.
+   */
+  int batch_pending;
+
+  /**
+   * #GNUNET_YES if the client stopped the iteration while a batch
+   * was pending; we free the iteration once the batch was sent.
    */
-  uint32_t offset;
+  int stopped;
 
 };
 
@@ -151,13 +175,13 @@ struct ZoneMonitor
   struct GNUNET_SCHEDULER_Task *task;
 
   /**
-   * Offset of the zone iteration used to address next result of the zone
-   * iteration in the store
+   * Serial number of the last record returned by the initial
+   * iteration, the next step resumes after it.
    *
    * Initialy set to 0.
-   * Incremented with by every call to #handle_iteration_next
+   * Updated by every call to #monitor_iterate_cb
    */
-  uint32_t offset;
+  uint64_t seq;
 
 };
 
@@ -192,6 +216,32 @@ struct CacheOperation
    * Client's request ID.
    */
   uint32_t rid;
+
+  /**
+   * Label of the records to tell the monitors about once the
+   * block is in the namecache, NULL if they need not be told.
+   */
+  char *name;
+
+  /**
+   * Serialized records to tell the monitors about.
+   */
+  char *rd_ser;
+
+  /**
+   * Number of bytes in @e rd_ser.
+   */
+  size_t rd_ser_len;
+
+  /**
+   * Number of records in @e rd_ser.
+   */
+  unsigned int rd_count;
+
+  /**
+   * Zone of the records.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
 };
 
 
@@ -264,6 +314,8 @@ cleanup_task (void *cls)
     GNUNET_CONTAINER_DLL_remove (cop_head,
                                  cop_tail,
                                  cop);
+    GNUNET_free_non_null (cop->name);
+    GNUNET_free_non_null (cop->rd_ser);
     GNUNET_free (cop);
   }
   GNUNET_NAMECACHE_disconnect (namecache);
@@ -362,6 +414,7 @@ client_connect_cb (void *cls,
  * record, which (if found) is then copied to @a cls for future use.
  *
  * @param cls a `struct GNUNET_GNSRECORD_Data **` for storing the nick (if found)
+ * @param seq serial number of the record (unused)
  * @param private_key the private key of the zone (unused)
  * @param label should be #GNUNET_GNS_MASTERZONE_STR
  * @param rd_count number of records in @a rd
@@ -369,6 +422,7 @@ client_connect_cb (void *cls,
  */
 static void
 lookup_nick_it (void *cls,
+                uint64_t seq,
                 const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
                 const char *label,
                 unsigned int rd_count,
@@ -597,7 +651,54 @@ send_store_response (struct NamestoreClient *nc,
 
 
 /**
- * Cache operation complete, clean up.
+ * Tell the monitors of @a zone_key about new records.
+ *
+ * @param zone_key private key of the zone
+ * @param name label of the records
+ * @param rd_count number of records
+ * @param rd records now stored under @a name
+ */
+static void
+notify_monitors (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                 const char *name,
+                 unsigned int rd_count,
+                 const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct ZoneMonitor *zm;
+
+  for (zm = monitor_head; NULL != zm; zm = zm->next)
+  {
+    if ( (0 == memcmp (zone_key, &zm->zone,
+                       sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) ||
+         (0 == memcmp (&zm->zone,
+                       &zero,
+                       sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Notifying monitor about changes under label `%s'\n",
+                  name);
+      send_lookup_response (zm->nc,
+                            0,
+                            zone_key,
+                            name,
+                            rd_count,
+                            rd);
+    }
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Monitor is for another zone\n");
+  }
+  if (NULL == monitor_head)
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "No monitors active\n");
+}
+
+
+/**
+ * Cache operation complete, clean up.  If the operation was for
+ * a store, the monitors learn about the new records now, so that
+ * by then lookups through the namecache (like those of GNS) see
+ * them, too.
  *
  * @param cls the `struct CacheOperation`
  * @param success success
@@ -620,6 +721,24 @@ finish_cache_operation (void *cls,
   GNUNET_CONTAINER_DLL_remove (cop_head,
                                cop_tail,
                                cop);
+  if (NULL != cop->name)
+  {
+    struct GNUNET_GNSRECORD_Data rd[cop->rd_count];
+
+    if (GNUNET_OK ==
+        GNUNET_GNSRECORD_records_deserialize (cop->rd_ser_len,
+                                              cop->rd_ser,
+                                              cop->rd_count,
+                                              rd))
+      notify_monitors (&cop->zone,
+                       cop->name,
+                       cop->rd_count,
+                       rd);
+    else
+      GNUNET_break (0);
+    GNUNET_free (cop->name);
+    GNUNET_free_non_null (cop->rd_ser);
+  }
   if (NULL != cop->nc)
     send_store_response (cop->nc,
                          success,
@@ -638,6 +757,8 @@ finish_cache_operation (void *cls,
  * @param name label for the records
  * @param rd_count number of records
  * @param rd records stored under the given @a name
+ * @param notify #GNUNET_YES to tell the monitors about @a rd once
+ *        the block is in the namecache
  */
 static void
 refresh_block (struct NamestoreClient *nc,
@@ -645,7 +766,8 @@ refresh_block (struct NamestoreClient *nc,
                const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
                const char *name,
                unsigned int rd_count,
-               const struct GNUNET_GNSRECORD_Data *rd)
+               const struct GNUNET_GNSRECORD_Data *rd,
+               int notify)
 {
   struct GNUNET_GNSRECORD_Block *block;
   struct CacheOperation *cop;
@@ -653,6 +775,7 @@ refresh_block (struct NamestoreClient *nc,
   struct GNUNET_GNSRECORD_Data *nick;
   struct GNUNET_GNSRECORD_Data *res;
   unsigned int res_count;
+  ssize_t len;
 
   nick = get_nick_record (zone_key);
   res_count = rd_count;
@@ -689,6 +812,25 @@ refresh_block (struct NamestoreClient *nc,
   cop = GNUNET_new (struct CacheOperation);
   cop->nc = nc;
   cop->rid = rid;
+  if (GNUNET_YES == notify)
+  {
+    len = GNUNET_GNSRECORD_records_get_size (rd_count,
+                                             rd);
+    GNUNET_assert (len >= 0);
+    cop->zone = *zone_key;
+    cop->name = GNUNET_strdup (name);
+    cop->rd_count = rd_count;
+    cop->rd_ser_len = (size_t) len;
+    if (0 != len)
+    {
+      cop->rd_ser = GNUNET_malloc (len);
+      GNUNET_assert (len ==
+                     GNUNET_GNSRECORD_records_serialize (rd_count,
+                                                         rd,
+                                                         len,
+                                                         cop->rd_ser));
+    }
+  }
   GNUNET_CONTAINER_DLL_insert (cop_head,
                                cop_tail,
                                cop);
@@ -721,6 +863,7 @@ struct RecordLookupContext
 
 static void
 lookup_it (void *cls,
+           uint64_t seq,
            const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
            const char *label,
            unsigned int rd_count,
@@ -949,7 +1092,6 @@ handle_record_store (void *cls,
   unsigned int rd_count;
   int res;
   struct GNUNET_CRYPTO_EcdsaPublicKey pubkey;
-  struct ZoneMonitor *zm;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received NAMESTORE_RECORD_STORE message\n");
@@ -997,8 +1139,9 @@ handle_record_store (void *cls,
           GSN_database->iterate_records (GSN_database->cls,
                                          &rp_msg->private_key,
                                          0,
+                                         1,
                                          NULL,
-                                         0)) )
+                                         NULL)) )
     {
       /* This name does not exist, so cannot be removed */
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1026,34 +1169,7 @@ handle_record_store (void *cls,
 					 conv_name,
 					 rd_clean_off,
                                          rd_clean);
-      if (GNUNET_OK == res)
-      {
-        for (zm = monitor_head; NULL != zm; zm = zm->next)
-        {
-          if ( (0 == memcmp (&rp_msg->private_key, &zm->zone,
-                             sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) ||
-               (0 == memcmp (&zm->zone,
-                             &zero,
-                             sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) )
-          {
-            GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                        "Notifying monitor about changes under label `%s'\n",
-                        conv_name);
-            send_lookup_response (zm->nc,
-                                  0,
-                                  &rp_msg->private_key,
-                                  conv_name,
-                                  rd_count, rd);
-          }
-          else
-            GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                        "Monitor is for another zone\n");
-        }
-        if (NULL == monitor_head)
-          GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                      "No monitors active\n");
-      }
-      else
+      if (GNUNET_OK != res)
       {
         GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                     "Error storing record: %d\n",
@@ -1062,12 +1178,14 @@ handle_record_store (void *cls,
     }
     if (GNUNET_OK == res)
     {
+      /* monitors are told once the namecache has the block */
       refresh_block (nc,
 		     rid,
                      &rp_msg->private_key,
                      conv_name,
                      rd_count,
-		     rd);
+		     rd,
+                     GNUNET_YES);
       GNUNET_SERVICE_client_continue (nc->client);
       GNUNET_free (conv_name);
       return;
@@ -1110,6 +1228,7 @@ struct ZoneToNameCtx
  * Zone to name iterator
  *
  * @param cls struct ZoneToNameCtx *
+ * @param seq serial number of the record
  * @param zone_key the zone key
  * @param name name
  * @param rd_count number of records in @a rd
@@ -1117,6 +1236,7 @@ struct ZoneToNameCtx
  */
 static void
 handle_zone_to_name_it (void *cls,
+			uint64_t seq,
 			const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
 			const char *name,
 			unsigned int rd_count,
@@ -1219,29 +1339,6 @@ handle_zone_to_name (void *cls,
 }
 
 
-/**
- * Zone iteration processor result
- */
-enum ZoneIterationResult
-{
-  /**
-   * Iteration start.
-   */
-  IT_START = 0,
-
-  /**
-   * Found records,
-   * Continue to iterate with next iteration_next call
-   */
-  IT_SUCCESS_MORE_AVAILABLE = 1,
-
-  /**
-   * Iteration complete
-   */
-  IT_SUCCESS_NOT_MORE_RESULTS_AVAILABLE = 2
-};
-
-
 /**
  * Context for record remove operations passed from
  * #run_zone_iteration_round to #zone_iterate_proc as closure
@@ -1254,13 +1351,9 @@ struct ZoneIterationProcResult
   struct ZoneIteration *zi;
 
   /**
-   * Iteration result: iteration done?
-   * #IT_SUCCESS_MORE_AVAILABLE:  if there may be more results overall but
-   * we got one for now and have sent it to the client
-   * #IT_SUCCESS_NOT_MORE_RESULTS_AVAILABLE: if there are no further results,
-   * #IT_START: if we are still trying to find a result.
+   * Number of results left to be returned in this iteration.
    */
-  int res_iteration_finished;
+  uint64_t limit;
 
 };
 
@@ -1268,7 +1361,8 @@ struct ZoneIterationProcResult
 /**
  * Process results for zone iteration from database
  *
- * @param cls struct ZoneIterationProcResult *proc
+ * @param cls struct ZoneIterationProcResult
+ * @param seq sequence number of the record
  * @param zone_key the zone key
  * @param name name
  * @param rd_count number of records for this name
@@ -1276,6 +1370,7 @@ struct ZoneIterationProcResult
  */
 static void
 zone_iterate_proc (void *cls,
+                   uint64_t seq,
 		   const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
 		   const char *name,
 		   unsigned int rd_count,
@@ -1284,21 +1379,21 @@ zone_iterate_proc (void *cls,
   struct ZoneIterationProcResult *proc = cls;
   int do_refresh_block;
 
-  if ((NULL == zone_key) && (NULL == name))
+  if ( (NULL == zone_key) ||
+       (NULL == name) )
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Iteration done\n");
-    proc->res_iteration_finished = IT_SUCCESS_NOT_MORE_RESULTS_AVAILABLE;
+    /* what is this!? should never happen */
+    GNUNET_break (0);
     return;
   }
-  if ((NULL == zone_key) || (NULL == name))
+  if (0 == proc->limit)
   {
     /* what is this!? should never happen */
-    proc->res_iteration_finished = IT_START;
     GNUNET_break (0);
     return;
   }
-  proc->res_iteration_finished = IT_SUCCESS_MORE_AVAILABLE;
+  proc->limit--;
+  proc->zi->seq = seq;
   send_lookup_response (proc->zi->nc,
 			proc->zi->request_id,
 			zone_key,
@@ -1318,13 +1413,26 @@ zone_iterate_proc (void *cls,
                    zone_key,
                    name,
                    rd_count,
-                   rd);
+                   rd,
+                   GNUNET_NO);
 
 }
 
 
 /**
- * Perform the next round of the zone iteration.
+ * Function called once the last result of a batch of a zone
+ * iteration was transmitted.
+ *
+ * @param cls the `struct ZoneIteration`
+ */
+static void
+iteration_batch_sent (void *cls);
+
+
+/**
+ * Perform the next round of the zone iteration.  We return at most
+ * #MAX_ITERATION_BATCH of the results the client asked for and
+ * continue once they were transmitted.
  *
  * @param zi zone iterator to process
  */
@@ -1334,33 +1442,43 @@ run_zone_iteration_round (struct ZoneIteration *zi)
   struct ZoneIterationProcResult proc;
   struct GNUNET_MQ_Envelope *env;
   struct RecordResultMessage *rrm;
-  int ret;
+  uint64_t limit;
 
   memset (&proc, 0, sizeof (proc));
+  limit = GNUNET_MIN (zi->limit,
+                      MAX_ITERATION_BATCH);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Asked to return up to %llu records at position %llu\n",
+              (unsigned long long) limit,
+              (unsigned long long) zi->seq);
   proc.zi = zi;
-  proc.res_iteration_finished = IT_START;
-  while (IT_START == proc.res_iteration_finished)
-  {
-    if (GNUNET_SYSERR ==
-	(ret = GSN_database->iterate_records (GSN_database->cls,
-					      (0 == memcmp (&zi->zone, &zero, sizeof (zero)))
-					      ? NULL
-					      : &zi->zone,
-					      zi->offset,
-					      &zone_iterate_proc, &proc)))
-    {
-      GNUNET_break (0);
-      break;
-    }
-    if (GNUNET_NO == ret)
-      proc.res_iteration_finished = IT_SUCCESS_NOT_MORE_RESULTS_AVAILABLE;
-    zi->offset++;
-  }
-  if (IT_SUCCESS_MORE_AVAILABLE == proc.res_iteration_finished)
+  proc.limit = limit;
+  GNUNET_break (GNUNET_SYSERR !=
+                GSN_database->iterate_records (GSN_database->cls,
+                                               (0 == memcmp (&zi->zone,
+                                                             &zero,
+                                                             sizeof (zero)))
+                                               ? NULL
+                                               : &zi->zone,
+                                               zi->seq,
+                                               limit,
+                                               &zone_iterate_proc,
+                                               &proc));
+  zi->limit -= limit - proc.limit;
+  if (0 == proc.limit)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "More results available\n");
-    return; /* more results later */
+    if (0 == zi->limit)
+      return; /* more results when the client asks for them */
+    /* continue once the client received this batch */
+    env = GNUNET_MQ_get_last_envelope (zi->nc->mq);
+    GNUNET_assert (NULL != env);
+    zi->batch_pending = GNUNET_YES;
+    GNUNET_MQ_notify_sent (env,
+                           &iteration_batch_sent,
+                           zi);
+    return;
   }
   /* send empty response to indicate end of list */
   env = GNUNET_MQ_msg (rrm,
@@ -1375,6 +1493,30 @@ run_zone_iteration_round (struct ZoneIteration *zi)
 }
 
 
+/**
+ * Function called once the last result of a batch of a zone
+ * iteration was transmitted.
+ *
+ * @param cls the `struct ZoneIteration`
+ */
+static void
+iteration_batch_sent (void *cls)
+{
+  struct ZoneIteration *zi = cls;
+
+  zi->batch_pending = GNUNET_NO;
+  if (GNUNET_YES == zi->stopped)
+  {
+    GNUNET_CONTAINER_DLL_remove (zi->nc->op_head,
+                                 zi->nc->op_tail,
+                                 zi);
+    GNUNET_free (zi);
+    return;
+  }
+  run_zone_iteration_round (zi);
+}
+
+
 /**
  * Handles a #GNUNET_MESSAGE_TYPE_NAMESTORE_ZONE_ITERATION_START message
  *
@@ -1392,9 +1534,10 @@ handle_iteration_start (void *cls,
 	      "Received ZONE_ITERATION_START message\n");
   zi = GNUNET_new (struct ZoneIteration);
   zi->request_id = ntohl (zis_msg->gns_header.r_id);
-  zi->offset = 0;
+  zi->seq = 0;
   zi->nc = nc;
   zi->zone = zis_msg->zone;
+  zi->limit = 1;
 
   GNUNET_CONTAINER_DLL_insert (nc->op_head,
 			       nc->op_tail,
@@ -1423,7 +1566,8 @@ handle_iteration_stop (void *cls,
 	      "ZONE_ITERATION_STOP");
   rid = ntohl (zis_msg->gns_header.r_id);
   for (zi = nc->op_head; NULL != zi; zi = zi->next)
-    if (zi->request_id == rid)
+    if ( (zi->request_id == rid) &&
+         (GNUNET_NO == zi->stopped) )
       break;
   if (NULL == zi)
   {
@@ -1431,10 +1575,18 @@ handle_iteration_stop (void *cls,
     GNUNET_SERVICE_client_drop (nc->client);
     return;
   }
-  GNUNET_CONTAINER_DLL_remove (nc->op_head,
-			       nc->op_tail,
-			       zi);
-  GNUNET_free (zi);
+  if (GNUNET_YES == zi->batch_pending)
+  {
+    /* freed in #iteration_batch_sent() */
+    zi->stopped = GNUNET_YES;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_remove (nc->op_head,
+                                 nc->op_tail,
+                                 zi);
+    GNUNET_free (zi);
+  }
   GNUNET_SERVICE_client_continue (nc->client);
 }
 
@@ -1452,20 +1604,29 @@ handle_iteration_next (void *cls,
   struct NamestoreClient *nc = cls;
   struct ZoneIteration *zi;
   uint32_t rid;
+  uint64_t limit;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received ZONE_ITERATION_NEXT message\n");
   rid = ntohl (zis_msg->gns_header.r_id);
+  limit = GNUNET_ntohll (zis_msg->limit);
   for (zi = nc->op_head; NULL != zi; zi = zi->next)
-    if (zi->request_id == rid)
+    if ( (zi->request_id == rid) &&
+         (GNUNET_NO == zi->stopped) )
       break;
-  if (NULL == zi)
+  if ( (NULL == zi) ||
+       (0 == limit) )
   {
     GNUNET_break (0);
     GNUNET_SERVICE_client_drop (nc->client);
     return;
   }
-  run_zone_iteration_round (zi);
+  if (zi->limit + limit < zi->limit)
+    zi->limit = UINT64_MAX; /* overflow */
+  else
+    zi->limit += limit;
+  if (GNUNET_NO == zi->batch_pending)
+    run_zone_iteration_round (zi);
   GNUNET_SERVICE_client_continue (nc->client);
 }
 
@@ -1501,6 +1662,7 @@ monitor_next (void *cls);
  * A #GNUNET_NAMESTORE_RecordIterator for monitors.
  *
  * @param cls a 'struct ZoneMonitor *' with information about the monitor
+ * @param seq serial number of the record
  * @param zone_key zone key of the zone
  * @param name name
  * @param rd_count number of records in @a rd
@@ -1508,6 +1670,7 @@ monitor_next (void *cls);
  */
 static void
 monitor_iterate_cb (void *cls,
+		    uint64_t seq,
 		    const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
 		    const char *name,
 		    unsigned int rd_count,
@@ -1521,6 +1684,7 @@ monitor_iterate_cb (void *cls,
     monitor_sync (zm);
     return;
   }
+  zm->seq = seq;
   send_lookup_response (zm->nc,
 			0,
 			zone_key,
@@ -1583,7 +1747,8 @@ monitor_next (void *cls)
 						     sizeof (zero)))
                                        ? NULL
                                        : &zm->zone,
-				       zm->offset++,
+				       zm->seq,
+				       1,
 				       &monitor_iterate_cb,
 				       zm);
   if (GNUNET_SYSERR == ret)
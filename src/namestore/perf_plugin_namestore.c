@@ -0,0 +1,440 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file namestore/perf_plugin_namestore.c
+ * @brief measure store, lookup and zone iteration latency and startup
+ *        time of a namestore plugin with many records
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_dnsparser_lib.h"
+#include "gnunet_namestore_plugin.h"
+#include "gnunet_testing_lib.h"
+#include <gauger.h>
+
+/**
+ * Default number of labels we store, can be overridden on the
+ * command line.
+ */
+#define DEFAULT_RECORDS (1000 * 1000)
+
+/**
+ * Number of zones the labels are spread over.
+ */
+#define NUM_ZONES 16
+
+/**
+ * Number of lookups we measure.
+ */
+#define NUM_LOOKUPS (100 * 1000)
+
+/**
+ * Byte the private key of the zone we iterate over is filled with;
+ * distinct from the zones used by #make_label.
+ */
+#define ITERATION_ZONE 0xFF
+
+/**
+ * Directory with the database.
+ */
+#define TEST_DIR "/tmp/gnunet-test-plugin-namestore-sqlite"
+
+
+static int ok;
+
+/**
+ * Name of plugin under test.
+ */
+static const char *plugin_name;
+
+/**
+ * Number of labels we store.
+ */
+static unsigned int num_records;
+
+/**
+ * Number of lookups that found a record.
+ */
+static unsigned int found;
+
+/**
+ * Serial number of the last record we were given.
+ */
+static uint64_t last_serial;
+
+
+/**
+ * Load the namestore plugin.
+ *
+ * @param cfg configuration to pass
+ * @return NULL on error
+ */
+static struct GNUNET_NAMESTORE_PluginFunctions *
+load_plugin (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct GNUNET_NAMESTORE_PluginFunctions *ret;
+  char *libname;
+
+  GNUNET_asprintf (&libname, "libgnunet_plugin_namestore_%s", plugin_name);
+  ret = GNUNET_PLUGIN_load (libname, (void*) cfg);
+  GNUNET_free (libname);
+  return ret;
+}
+
+
+/**
+ * Unload our namestore plugin.
+ *
+ * @param api api to unload
+ */
+static void
+unload_plugin (struct GNUNET_NAMESTORE_PluginFunctions *api)
+{
+  char *libname;
+
+  GNUNET_asprintf (&libname, "libgnunet_plugin_namestore_%s", plugin_name);
+  GNUNET_break (NULL == GNUNET_PLUGIN_unload (libname, api));
+  GNUNET_free (libname);
+}
+
+
+/**
+ * Report one measurement.
+ *
+ * @param what what we measured
+ * @param value the measurement
+ * @param unit unit of @a value
+ */
+static void
+report (const char *what,
+        double value,
+        const char *unit)
+{
+  char gauger_name[128];
+
+  printf ("%-32s %12.3f %s\n",
+          what,
+          value,
+          unit);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "%s plugin: %s",
+                   plugin_name,
+                   what);
+  GAUGER ("NAMESTORE", gauger_name, value, unit);
+}
+
+
+/**
+ * Compute zone and label of record @a id.
+ *
+ * @param id number of the record
+ * @param[out] zone set to the private key of the zone
+ * @param[out] label set to the label
+ * @param label_size size of @a label
+ */
+static void
+make_label (unsigned int id,
+            struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+            char *label,
+            size_t label_size)
+{
+  memset (zone, 1 + (id % NUM_ZONES), sizeof (*zone));
+  GNUNET_snprintf (label,
+                   label_size,
+                   "label%u",
+                   id);
+}
+
+
+static void
+count_record (void *cls,
+              uint64_t serial,
+              const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
+              const char *label,
+              unsigned int rd_count,
+              const struct GNUNET_GNSRECORD_Data *rd)
+{
+  last_serial = serial;
+  found++;
+}
+
+
+/**
+ * Iterate over the zone filled by #run in batches of @a limit
+ * records and report the time per record.
+ *
+ * @param nsp plugin to use
+ * @param zone_labels number of labels in the zone
+ * @param limit number of records to fetch per call
+ */
+static void
+timed_iteration (struct GNUNET_NAMESTORE_PluginFunctions *nsp,
+                 unsigned int zone_labels,
+                 uint64_t limit)
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  char what[64];
+  int ret;
+
+  memset (&zone, ITERATION_ZONE, sizeof (zone));
+  found = 0;
+  last_serial = 0;
+  start = GNUNET_TIME_absolute_get ();
+  do
+  {
+    ret = nsp->iterate_records (nsp->cls,
+                                &zone,
+                                last_serial,
+                                limit,
+                                &count_record,
+                                NULL);
+  } while (GNUNET_OK == ret);
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  GNUNET_break (GNUNET_NO == ret);
+  GNUNET_snprintf (what,
+                   sizeof (what),
+                   "iteration latency (batch %llu)",
+                   (unsigned long long) limit);
+  report (what,
+          duration.rel_value_us * 1.0 / GNUNET_MAX (1, found),
+          "us");
+  if (zone_labels != found)
+  {
+    FPRINTF (stderr,
+             "Iteration returned %u of %u labels\n",
+             found,
+             zone_labels);
+    ok = 1;
+  }
+}
+
+
+/**
+ * Load the plugin and report how long that took.
+ *
+ * @param cfg configuration to use
+ * @param what name of the measurement
+ * @return the plugin, NULL on error
+ */
+static struct GNUNET_NAMESTORE_PluginFunctions *
+timed_load (const struct GNUNET_CONFIGURATION_Handle *cfg,
+            const char *what)
+{
+  struct GNUNET_NAMESTORE_PluginFunctions *nsp;
+  struct GNUNET_TIME_Absolute start;
+
+  start = GNUNET_TIME_absolute_get ();
+  nsp = load_plugin (cfg);
+  if (NULL != nsp)
+    report (what,
+            GNUNET_TIME_absolute_get_duration (start).rel_value_us / 1000.0,
+            "ms");
+  return nsp;
+}
+
+
+static void
+run (void *cls, char *const *args, const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct GNUNET_NAMESTORE_PluginFunctions *nsp;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+  struct GNUNET_GNSRECORD_Data rd;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Absolute op_start;
+  struct GNUNET_TIME_Relative max;
+  struct GNUNET_TIME_Relative duration;
+  uint32_t addr;
+  char label[64];
+  char *fn;
+  char *index_fn;
+  unsigned int zone_labels;
+  unsigned int i;
+
+  nsp = timed_load (cfg,
+                    "startup (empty)");
+  if (NULL == nsp)
+  {
+    FPRINTF (stderr,
+             "%s",
+             "Failed to initialize namestore.  Database likely not setup, skipping benchmark.\n");
+    return;
+  }
+  rd.data = &addr;
+  rd.data_size = sizeof (addr);
+  rd.record_type = GNUNET_DNSPARSER_TYPE_A;
+  rd.flags = GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION;
+  rd.expiration_time = GNUNET_TIME_UNIT_HOURS.rel_value_us;
+  max = GNUNET_TIME_UNIT_ZERO;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < num_records; i++)
+  {
+    op_start = GNUNET_TIME_absolute_get ();
+    addr = htonl (i);
+    make_label (i, &zone, label, sizeof (label));
+    if (GNUNET_OK !=
+        nsp->store_records (nsp->cls,
+                            &zone,
+                            label,
+                            1,
+                            &rd))
+    {
+      GNUNET_break (0);
+      ok = 1;
+      break;
+    }
+    max = GNUNET_TIME_relative_max (max,
+                                    GNUNET_TIME_absolute_get_duration (op_start));
+  }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  report ("store latency (average)",
+          duration.rel_value_us * 1.0 / num_records,
+          "us");
+  report ("store latency (maximum)",
+          max.rel_value_us * 1.0,
+          "us");
+
+  found = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_LOOKUPS; i++)
+  {
+    make_label (GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                          num_records),
+                &zone, label, sizeof (label));
+    nsp->lookup_records (nsp->cls,
+                         &zone,
+                         label,
+                         &count_record,
+                         NULL);
+  }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  report ("lookup latency",
+          duration.rel_value_us * 1.0 / NUM_LOOKUPS,
+          "us");
+  if (NUM_LOOKUPS != found)
+  {
+    FPRINTF (stderr,
+             "Only found %u of %u labels\n",
+             found,
+             NUM_LOOKUPS);
+    ok = 1;
+  }
+
+  /* one large zone next to the others, iterated in batches */
+  zone_labels = num_records / 2;
+  memset (&zone, ITERATION_ZONE, sizeof (zone));
+  for (i = 0; i < zone_labels; i++)
+  {
+    addr = htonl (i);
+    GNUNET_snprintf (label,
+                     sizeof (label),
+                     "big%u",
+                     i);
+    if (GNUNET_OK !=
+        nsp->store_records (nsp->cls,
+                            &zone,
+                            label,
+                            1,
+                            &rd))
+    {
+      GNUNET_break (0);
+      ok = 1;
+      break;
+    }
+  }
+  timed_iteration (nsp, zone_labels, 1);
+  timed_iteration (nsp, zone_labels, 100);
+  timed_iteration (nsp, zone_labels, 10000);
+
+  start = GNUNET_TIME_absolute_get ();
+  unload_plugin (nsp);
+  report ("shutdown",
+          GNUNET_TIME_absolute_get_duration (start).rel_value_us / 1000.0,
+          "ms");
+  nsp = timed_load (cfg,
+                    "startup");
+  GNUNET_assert (NULL != nsp);
+  unload_plugin (nsp);
+
+  if (0 == strcmp (plugin_name, "flat"))
+  {
+    /* without the index we need to scan the whole log */
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                            "namestore-flat",
+                                                            "FILENAME",
+                                                            &fn));
+    GNUNET_asprintf (&index_fn,
+                     "%s.idx",
+                     fn);
+    GNUNET_break (0 == UNLINK (index_fn));
+    GNUNET_free (index_fn);
+    GNUNET_free (fn);
+    nsp = timed_load (cfg,
+                      "startup (no index)");
+    GNUNET_assert (NULL != nsp);
+    unload_plugin (nsp);
+  }
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  char cfg_name[128];
+  char *const xargv[] = {
+    "perf-plugin-namestore",
+    "-c",
+    cfg_name,
+    NULL
+  };
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+
+  num_records = DEFAULT_RECORDS;
+  if ( (argc > 1) &&
+       ( (1 != sscanf (argv[1], "%u", &num_records)) ||
+         (0 == num_records) ) )
+  {
+    FPRINTF (stderr, "Usage: %s [RECORDS]\n", argv[0]);
+    return 1;
+  }
+  GNUNET_DISK_directory_remove (TEST_DIR);
+  GNUNET_log_setup ("perf-plugin-namestore",
+                    "WARNING",
+                    NULL);
+  plugin_name = GNUNET_TESTING_get_testname_from_underscore (argv[0]);
+  GNUNET_snprintf (cfg_name, sizeof (cfg_name), "test_plugin_namestore_%s.conf",
+                   plugin_name);
+  printf ("%u labels in %u zones, %u labels in the iterated zone\n",
+          num_records,
+          NUM_ZONES,
+          num_records / 2);
+  GNUNET_PROGRAM_run ((sizeof (xargv) / sizeof (char *)) - 1, xargv,
+                      "perf-plugin-namestore", "nohelp", options, &run, NULL);
+  GNUNET_DISK_directory_remove (TEST_DIR);
+  return ok;
+}
+
+/* end of perf_plugin_namestore.c */
@@ -1,6 +1,6 @@
  /*
   * This file is part of GNUnet
-  * Copyright (C) 2009-2015 GNUnet e.V.
+  * Copyright (C) 2009-2015, 2018 GNUnet e.V.
   *
   * GNUnet is free software; you can redistribute it and/or modify
   * it under the terms of the GNU General Public License as published
@@ -22,6 +22,24 @@
  * @file namestore/plugin_namestore_flat.c
  * @brief file-based namestore backend
  * @author Martin Schanzenbach
+ *
+ * The database is an append-only log of binary records which we
+ * access through a read-only memory map.  Every store appends one
+ * record (a record with no GNS records is a deletion) and we keep
+ * only the offset of the latest record for each label in memory.
+ * On shutdown we write an index of these offsets next to the log,
+ * so that on startup we only need to read the index and scan the
+ * part of the log that was appended after the index was written.
+ * Once most of the log is garbage, we copy the live records into a
+ * new log in the background and atomically replace the old one.
+ *
+ * Zone iteration follows serial numbers that we assign to the
+ * labels in the order in which they were last stored; an array of
+ * the live entries sorted by serial allows resuming an iteration
+ * with a binary search.
+ *
+ * Databases in the old text format (one base64-encoded line per
+ * label) are converted on startup.
  */
 
 #include "platform.h"
@@ -30,6 +48,301 @@
 #include "gnunet_gnsrecord_lib.h"
 #include "namestore.h"
 
+/**
+ * Magic bytes at the beginning of the record log.
+ */
+#define LOG_MAGIC "GNSFLAT1"
+
+/**
+ * Magic bytes at the beginning of the index.
+ */
+#define INDEX_MAGIC "GNSFIDX1"
+
+/**
+ * Version of the log and index format.
+ */
+#define FORMAT_VERSION 1
+
+/**
+ * We map at least this many bytes of the log, and grow the mapping
+ * by doubling it so that appends rarely require a new mapping.
+ */
+#define MIN_MAP_SIZE (1024 * 1024)
+
+/**
+ * Do not compact the log unless it contains at least this many
+ * bytes of garbage.
+ */
+#define COMPACTION_MIN_GARBAGE (1024 * 1024)
+
+/**
+ * How many bytes do we copy per compaction step before returning
+ * to the scheduler?
+ */
+#define COMPACTION_CHUNK (1024 * 1024)
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header at the beginning of the record log.
+ */
+struct FlatLogHeader
+{
+  /**
+   * #LOG_MAGIC.
+   */
+  char magic[8];
+
+  /**
+   * #FORMAT_VERSION in NBO.
+   */
+  uint32_t version GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * Random value identifying this log; changes whenever the log is
+   * rewritten, so that we notice an index that belongs to another
+   * log.
+   */
+  uint64_t epoch GNUNET_PACKED;
+};
+
+
+/**
+ * Header of a record in the log.  Followed by the 0-terminated
+ * label and the serialized GNS records.
+ */
+struct FlatRecordHeader
+{
+  /**
+   * Total size of the record in NBO, including this header.
+   */
+  uint32_t size GNUNET_PACKED;
+
+  /**
+   * CRC32 over the rest of the record in NBO, to detect records that
+   * were only partially written.
+   */
+  uint32_t crc GNUNET_PACKED;
+
+  /**
+   * Private key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+
+  /**
+   * Number of GNS records in NBO, 0 if the label was deleted.
+   */
+  uint32_t rd_count GNUNET_PACKED;
+
+  /**
+   * Length of the label in NBO, including the 0-terminator.
+   */
+  uint16_t label_len GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint16_t reserved GNUNET_PACKED;
+};
+
+
+/**
+ * Header of the index.  Followed by @e count `struct FlatIndexEntry`s.
+ */
+struct FlatIndexHeader
+{
+  /**
+   * #INDEX_MAGIC.
+   */
+  char magic[8];
+
+  /**
+   * #FORMAT_VERSION in NBO.
+   */
+  uint32_t version GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * Epoch of the log this index belongs to.
+   */
+  uint64_t epoch GNUNET_PACKED;
+
+  /**
+   * Size of the log covered by this index in NBO.
+   */
+  uint64_t log_size GNUNET_PACKED;
+
+  /**
+   * Number of entries in the index in NBO.
+   */
+  uint64_t count GNUNET_PACKED;
+};
+
+
+/**
+ * Entry in the index.
+ */
+struct FlatIndexEntry
+{
+  /**
+   * Hash over label and zone.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Offset of the record in the log in NBO.
+   */
+  uint64_t off GNUNET_PACKED;
+
+  /**
+   * Size of the record in the log in NBO.
+   */
+  uint32_t size GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * The CRC of a record covers everything after the CRC field.
+ */
+#define CRC_START (2 * sizeof (uint32_t))
+
+
+/**
+ * Live record of a label in the log.
+ */
+struct FlatFileEntry
+{
+  /**
+   * Hash over label and zone, key in the hash map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Offset of the record in the log.
+   */
+  uint64_t off;
+
+  /**
+   * Size of the record in the log.
+   */
+  uint32_t size;
+
+  /**
+   * Serial number of the entry, see `struct SerialSlot`.
+   */
+  uint64_t serial;
+};
+
+
+/**
+ * Element of the array of entries sorted by serial number.
+ */
+struct SerialSlot
+{
+  /**
+   * Serial number of @e entry.
+   */
+  uint64_t serial;
+
+  /**
+   * The entry, NULL if it was removed or stored again.
+   */
+  struct FlatFileEntry *entry;
+};
+
+
+/**
+ * A record that is copied by a compaction.
+ */
+struct CompactionItem
+{
+  /**
+   * Offset of the record in the old log.
+   */
+  uint64_t old_off;
+
+  /**
+   * Offset of the record in the new log.
+   */
+  uint64_t new_off;
+
+  /**
+   * Size of the record.
+   */
+  uint32_t size;
+};
+
+
+/**
+ * State of a running compaction.
+ */
+struct Compaction
+{
+  /**
+   * The new log.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Name of the new log.
+   */
+  char *fn;
+
+  /**
+   * Records live when the compaction started, sorted by @e old_off.
+   */
+  struct CompactionItem *items;
+
+  /**
+   * Length of the @e items array.
+   */
+  unsigned int items_len;
+
+  /**
+   * Next item to copy.
+   */
+  unsigned int pos;
+
+  /**
+   * Size of the old log when the compaction started.  Records
+   * appended later are copied verbatim once all @e items are done.
+   */
+  uint64_t snapshot_end;
+
+  /**
+   * Current size of the new log.
+   */
+  uint64_t new_size;
+
+  /**
+   * Epoch of the new log.
+   */
+  uint64_t epoch;
+
+  /**
+   * Task copying the next chunk.
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+};
+
+
 /**
  * Context for all functions in this plugin.
  */
@@ -44,19 +357,79 @@ struct Plugin
   char *fn;
 
   /**
-   * HashMap
+   * Filename of the index.
+   */
+  char *index_fn;
+
+  /**
+   * The log, opened for appending.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Mapping of the log.
+   */
+  struct GNUNET_DISK_MapHandle *map;
+
+  /**
+   * Start of the mapping of the log.
+   */
+  const char *map_addr;
+
+  /**
+   * Length of the mapping, may exceed @e log_size.
+   */
+  uint64_t map_size;
+
+  /**
+   * Size of the valid part of the log.
+   */
+  uint64_t log_size;
+
+  /**
+   * Sum of the sizes of all live records in the log.
+   */
+  uint64_t live_bytes;
+
+  /**
+   * Epoch of the log.
+   */
+  uint64_t epoch;
+
+  /**
+   * Maps hashes over label and zone to `struct FlatFileEntry`.
    */
   struct GNUNET_CONTAINER_MultiHashMap *hm;
 
   /**
-   * Offset
+   * Running compaction, NULL for none.
+   */
+  struct Compaction *compaction;
+
+  /**
+   * Live entries sorted by serial number, with holes.
+   */
+  struct SerialSlot *serials;
+
+  /**
+   * Number of slots used in @e serials.
+   */
+  unsigned int serials_len;
+
+  /**
+   * Allocated length of @e serials.
    */
-  uint32_t offset;
+  unsigned int serials_size;
 
   /**
-   * Target Offset
+   * Number of slots in @e serials without an entry.
    */
-  uint32_t target_offset;
+  unsigned int serials_holes;
+
+  /**
+   * Serial number of the last entry stored.
+   */
+  uint64_t last_serial;
 
   /**
    * Iterator closure
@@ -68,52 +441,1404 @@ struct Plugin
    */
   GNUNET_NAMESTORE_RecordIterator iter;
 
-  /**
-   * Zone to iterate
-   */
-  const struct GNUNET_CRYPTO_EcdsaPrivateKey *iter_zone;
+  /**
+   * Zone to iterate
+   */
+  const struct GNUNET_CRYPTO_EcdsaPrivateKey *iter_zone;
+
+  /**
+   * PKEY to look for in zone to name
+   */
+  const struct GNUNET_CRYPTO_EcdsaPublicKey *iter_pkey;
+
+  /**
+   * Iteration result found
+   */
+  int iter_result_found;
+
+};
+
+
+/**
+ * Compute the key of a label in the hash map.
+ *
+ * @param zone private key of the zone
+ * @param label the label
+ * @param[out] hkey set to the key
+ */
+static void
+get_key (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+         const char *label,
+         struct GNUNET_HashCode *hkey)
+{
+  size_t label_len = strlen (label);
+  char key[label_len + sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey)];
+
+  GNUNET_memcpy (key,
+                 label,
+                 label_len);
+  GNUNET_memcpy (&key[label_len],
+                 zone,
+                 sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
+  GNUNET_CRYPTO_hash (key,
+                      sizeof (key),
+                      hkey);
+}
+
+
+/**
+ * Make sure the first @a end bytes of the log are mapped.
+ *
+ * @param plugin the plugin context
+ * @param end number of bytes that must be mapped
+ * @return #GNUNET_OK on success
+ */
+static int
+ensure_mapped (struct Plugin *plugin,
+               uint64_t end)
+{
+  uint64_t len;
+
+  if (end <= plugin->map_size)
+    return GNUNET_OK;
+  if (NULL != plugin->map)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (plugin->map));
+    plugin->map = NULL;
+    plugin->map_addr = NULL;
+    plugin->map_size = 0;
+  }
+  len = MIN_MAP_SIZE;
+  while (len < end)
+    len *= 2;
+  if (len != (size_t) len)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Database `%s' is too large to be mapped.\n"),
+                plugin->fn);
+    return GNUNET_SYSERR;
+  }
+  /* mapping beyond the end of the file is fine as long as we only
+     access the part that exists; appends become visible through
+     the (shared) mapping */
+  plugin->map_addr = GNUNET_DISK_file_map (plugin->fh,
+                                           &plugin->map,
+                                           GNUNET_DISK_MAP_TYPE_READ,
+                                           (size_t) len);
+  if (NULL == plugin->map_addr)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "mmap",
+                              plugin->fn);
+    plugin->map = NULL;
+    return GNUNET_SYSERR;
+  }
+  plugin->map_size = len;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Parse the record at @a off in the log.
+ *
+ * @param plugin the plugin context
+ * @param off offset of the record
+ * @param end the record must end before this offset
+ * @param verify #GNUNET_YES to check the CRC of the record
+ * @param[out] hdr set to the header of the record
+ * @param[out] label set to the label of the record
+ * @param[out] data set to the serialized GNS records
+ * @param[out] data_size set to the size of @a data
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the record is malformed
+ */
+static int
+read_record (struct Plugin *plugin,
+             uint64_t off,
+             uint64_t end,
+             int verify,
+             struct FlatRecordHeader *hdr,
+             const char **label,
+             const char **data,
+             size_t *data_size)
+{
+  const char *pos;
+  uint32_t size;
+  uint16_t label_len;
+
+  if ( (off + sizeof (struct FlatRecordHeader) > end) ||
+       (GNUNET_OK != ensure_mapped (plugin,
+                                    end)) )
+    return GNUNET_SYSERR;
+  pos = &plugin->map_addr[off];
+  GNUNET_memcpy (hdr,
+                 pos,
+                 sizeof (struct FlatRecordHeader));
+  size = ntohl (hdr->size);
+  label_len = ntohs (hdr->label_len);
+  if ( (0 == label_len) ||
+       (size < sizeof (struct FlatRecordHeader) + label_len) ||
+       (off + size > end) ||
+       ('\0' != pos[sizeof (struct FlatRecordHeader) + label_len - 1]) )
+    return GNUNET_SYSERR;
+  if ( (GNUNET_YES == verify) &&
+       (ntohl (hdr->crc) !=
+        (uint32_t) GNUNET_CRYPTO_crc32_n (&pos[CRC_START],
+                                          size - CRC_START)) )
+    return GNUNET_SYSERR;
+  *label = &pos[sizeof (struct FlatRecordHeader)];
+  *data = &pos[sizeof (struct FlatRecordHeader) + label_len];
+  *data_size = size - sizeof (struct FlatRecordHeader) - label_len;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Decode the record of @a entry and pass it to @a iter.
+ *
+ * @param plugin the plugin context
+ * @param entry the entry to process
+ * @param zone only process the entry if it belongs to this zone,
+ *        NULL for any zone
+ * @param iter function to call with the records
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK if @a iter was called, #GNUNET_NO if the entry
+ *         is in another zone, #GNUNET_SYSERR on error
+ */
+static int
+process_entry (struct Plugin *plugin,
+               const struct FlatFileEntry *entry,
+               const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+               GNUNET_NAMESTORE_RecordIterator iter,
+               void *iter_cls)
+{
+  struct FlatRecordHeader hdr;
+  const char *label;
+  const char *data;
+  size_t data_size;
+  unsigned int rd_count;
+
+  if (GNUNET_OK !=
+      read_record (plugin,
+                   entry->off,
+                   plugin->log_size,
+                   GNUNET_NO,
+                   &hdr,
+                   &label,
+                   &data,
+                   &data_size))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  if ( (NULL != zone) &&
+       (0 != memcmp (&hdr.zone,
+                     zone,
+                     sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) )
+    return GNUNET_NO;
+  rd_count = ntohl (hdr.rd_count);
+  if ( (0 == rd_count) ||
+       (rd_count > data_size) )
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  {
+    struct GNUNET_GNSRECORD_Data rd[rd_count];
+
+    if (GNUNET_OK !=
+        GNUNET_GNSRECORD_records_deserialize (data_size,
+                                              data,
+                                              rd_count,
+                                              rd))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Unable to deserialize record %s\n",
+                  label);
+      return GNUNET_SYSERR;
+    }
+    if (NULL != iter)
+      iter (iter_cls,
+            entry->serial,
+            &hdr.zone,
+            label,
+            rd_count,
+            rd);
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Find the first slot in the serial array with a serial number
+ * above @a serial.
+ *
+ * @param plugin the plugin context
+ * @param serial serial number to look for
+ * @return index of the slot, @e serials_len if there is none
+ */
+static unsigned int
+find_serial (const struct Plugin *plugin,
+             uint64_t serial)
+{
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+
+  lo = 0;
+  hi = plugin->serials_len;
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (plugin->serials[mid].serial <= serial)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+/**
+ * Give @a entry the next serial number and append it to the serial
+ * array.
+ *
+ * @param plugin the plugin context
+ * @param entry the entry
+ */
+static void
+add_serial (struct Plugin *plugin,
+            struct FlatFileEntry *entry)
+{
+  struct SerialSlot *slot;
+
+  if (plugin->serials_len == plugin->serials_size)
+  {
+    /* may exceed the limit of GNUNET_array_grow for large zones */
+    plugin->serials_size = GNUNET_MAX (1024,
+                                       2 * plugin->serials_size);
+    plugin->serials = GNUNET_realloc (plugin->serials,
+                                      plugin->serials_size * sizeof (struct SerialSlot));
+  }
+  entry->serial = ++plugin->last_serial;
+  slot = &plugin->serials[plugin->serials_len++];
+  slot->serial = entry->serial;
+  slot->entry = entry;
+}
+
+
+/**
+ * Remove @a entry from the serial array.  Once more than half of
+ * the slots are empty, the array is compacted.
+ *
+ * @param plugin the plugin context
+ * @param entry the entry
+ */
+static void
+remove_serial (struct Plugin *plugin,
+               struct FlatFileEntry *entry)
+{
+  unsigned int pos;
+  unsigned int i;
+
+  pos = find_serial (plugin,
+                     entry->serial - 1);
+  GNUNET_assert ( (pos < plugin->serials_len) &&
+                  (entry == plugin->serials[pos].entry) );
+  plugin->serials[pos].entry = NULL;
+  plugin->serials_holes++;
+  if (2 * plugin->serials_holes <= plugin->serials_len)
+    return;
+  pos = 0;
+  for (i = 0; i < plugin->serials_len; i++)
+    if (NULL != plugin->serials[i].entry)
+      plugin->serials[pos++] = plugin->serials[i];
+  plugin->serials_len = pos;
+  plugin->serials_holes = 0;
+}
+
+
+/**
+ * Forget all entries in the serial array.
+ *
+ * @param plugin the plugin context
+ */
+static void
+clear_serials (struct Plugin *plugin)
+{
+  GNUNET_free_non_null (plugin->serials);
+  plugin->serials = NULL;
+  plugin->serials_size = 0;
+  plugin->serials_len = 0;
+  plugin->serials_holes = 0;
+}
+
+
+/**
+ * Update the hash map after a record for @a key was added to the log.
+ *
+ * @param plugin the plugin context
+ * @param key hash over label and zone
+ * @param off offset of the record
+ * @param size size of the record
+ * @param rd_count number of GNS records, 0 if the label was deleted
+ */
+static void
+apply_record (struct Plugin *plugin,
+              const struct GNUNET_HashCode *key,
+              uint64_t off,
+              uint32_t size,
+              unsigned int rd_count)
+{
+  struct FlatFileEntry *entry;
+
+  entry = GNUNET_CONTAINER_multihashmap_get (plugin->hm,
+                                             key);
+  if (NULL != entry)
+  {
+    plugin->live_bytes -= entry->size;
+    remove_serial (plugin,
+                   entry);
+    if (0 == rd_count)
+    {
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multihashmap_remove (plugin->hm,
+                                                           &entry->key,
+                                                           entry));
+      GNUNET_free (entry);
+      return;
+    }
+  }
+  else
+  {
+    if (0 == rd_count)
+      return;
+    entry = GNUNET_new (struct FlatFileEntry);
+    entry->key = *key;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (plugin->hm,
+                                                      &entry->key,
+                                                      entry,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  }
+  entry->off = off;
+  entry->size = size;
+  add_serial (plugin,
+              entry);
+  plugin->live_bytes += size;
+}
+
+
+/**
+ * Remove an entry from the hash map and free it.
+ *
+ * @param cls the plugin context
+ * @param key hash over label and zone
+ * @param value the `struct FlatFileEntry`
+ * @return #GNUNET_YES
+ */
+static int
+free_entry (void *cls,
+            const struct GNUNET_HashCode *key,
+            void *value)
+{
+  struct Plugin *plugin = cls;
+  struct FlatFileEntry *entry = value;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (plugin->hm,
+                                                       &entry->key,
+                                                       entry));
+  GNUNET_free (entry);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Append a record to the log.
+ *
+ * @param plugin the plugin context
+ * @param zone private key of the zone
+ * @param label name of the record in the zone
+ * @param rd_count number of entries in @a rd array, 0 to delete
+ * @param rd array of records
+ * @param[out] off set to the offset of the new record
+ * @param[out] size set to the size of the new record
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+append_record (struct Plugin *plugin,
+               const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+               const char *label,
+               unsigned int rd_count,
+               const struct GNUNET_GNSRECORD_Data *rd,
+               uint64_t *off,
+               uint32_t *size)
+{
+  struct FlatRecordHeader hdr;
+  size_t label_len;
+  size_t data_size;
+  size_t total;
+
+  label_len = strlen (label) + 1;
+  data_size = GNUNET_GNSRECORD_records_get_size (rd_count,
+                                                 rd);
+  total = sizeof (struct FlatRecordHeader) + label_len + data_size;
+  if ( (label_len > UINT16_MAX) ||
+       (total > GNUNET_MAX_MESSAGE_SIZE) )
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  {
+    char buf[total];
+
+    hdr.size = htonl ((uint32_t) total);
+    hdr.zone = *zone;
+    hdr.rd_count = htonl (rd_count);
+    hdr.label_len = htons ((uint16_t) label_len);
+    hdr.reserved = htons (0);
+    GNUNET_memcpy (buf,
+                   &hdr,
+                   sizeof (hdr));
+    GNUNET_memcpy (&buf[sizeof (hdr)],
+                   label,
+                   label_len);
+    if (data_size !=
+        GNUNET_GNSRECORD_records_serialize (rd_count,
+                                            rd,
+                                            data_size,
+                                            &buf[sizeof (hdr) + label_len]))
+    {
+      GNUNET_break (0);
+      return GNUNET_SYSERR;
+    }
+    hdr.crc = htonl ((uint32_t) GNUNET_CRYPTO_crc32_n (&buf[CRC_START],
+                                                       total - CRC_START));
+    GNUNET_memcpy (&buf[sizeof (uint32_t)],
+                   &hdr.crc,
+                   sizeof (uint32_t));
+    if (total !=
+        GNUNET_DISK_file_write (plugin->fh,
+                                buf,
+                                total))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "write",
+                                plugin->fn);
+      /* drop whatever made it to disk, the next append must
+         start where the log ends */
+      if (0 != FTRUNCATE (plugin->fh->fd,
+                          plugin->log_size))
+        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                  "ftruncate",
+                                  plugin->fn);
+      GNUNET_DISK_file_seek (plugin->fh,
+                             plugin->log_size,
+                             GNUNET_DISK_SEEK_SET);
+      return GNUNET_SYSERR;
+    }
+  }
+  *off = plugin->log_size;
+  *size = (uint32_t) total;
+  plugin->log_size += total;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Write a fresh log header to @a fh.
+ *
+ * @param fh file to write to, positioned at the beginning
+ * @param epoch epoch of the log
+ * @return #GNUNET_OK on success
+ */
+static int
+write_log_header (struct GNUNET_DISK_FileHandle *fh,
+                  uint64_t epoch)
+{
+  struct FlatLogHeader hdr;
+
+  memset (&hdr,
+          0,
+          sizeof (hdr));
+  GNUNET_memcpy (hdr.magic,
+                 LOG_MAGIC,
+                 sizeof (hdr.magic));
+  hdr.version = htonl (FORMAT_VERSION);
+  hdr.epoch = GNUNET_htonll (epoch);
+  if (sizeof (hdr) !=
+      GNUNET_DISK_file_write (fh,
+                              &hdr,
+                              sizeof (hdr)))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Read the log header from the beginning of @a fh.
+ *
+ * @param plugin the plugin context
+ * @param fh the log
+ * @param size size of the log
+ * @param[out] epoch set to the epoch of the log
+ * @return #GNUNET_OK on success, #GNUNET_NO if the file is not in
+ *         our format, #GNUNET_SYSERR if it has an unsupported version
+ */
+static int
+read_log_header (struct Plugin *plugin,
+                 struct GNUNET_DISK_FileHandle *fh,
+                 off_t size,
+                 uint64_t *epoch)
+{
+  struct FlatLogHeader hdr;
+
+  if ( (size < (off_t) sizeof (hdr)) ||
+       (sizeof (hdr) !=
+        GNUNET_DISK_file_read (fh,
+                               &hdr,
+                               sizeof (hdr))) ||
+       (0 != memcmp (hdr.magic,
+                     LOG_MAGIC,
+                     sizeof (hdr.magic))) )
+    return GNUNET_NO;
+  if (FORMAT_VERSION != ntohl (hdr.version))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Database `%s' has unsupported version %u.\n"),
+                plugin->fn,
+                (unsigned int) ntohl (hdr.version));
+    return GNUNET_SYSERR;
+  }
+  *epoch = GNUNET_ntohll (hdr.epoch);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Open the log and position it at the end.
+ *
+ * @param plugin the plugin context
+ * @param[out] size set to the size of the log
+ * @return #GNUNET_OK on success
+ */
+static int
+open_log (struct Plugin *plugin,
+          off_t *size)
+{
+  plugin->fh = GNUNET_DISK_file_open (plugin->fn,
+                                      GNUNET_DISK_OPEN_CREATE |
+                                      GNUNET_DISK_OPEN_READWRITE,
+                                      GNUNET_DISK_PERM_USER_WRITE |
+                                      GNUNET_DISK_PERM_USER_READ);
+  if (NULL == plugin->fh)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Unable to initialize file: %s.\n"),
+                plugin->fn);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK !=
+      GNUNET_DISK_file_handle_size (plugin->fh,
+                                    size))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Unable to get filesize: %s.\n"),
+                plugin->fn);
+    GNUNET_DISK_file_close (plugin->fh);
+    plugin->fh = NULL;
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Convert a database in the old text format, one line of
+ * "ZONE,RVALUE,RD_COUNT,RD,LABEL" per label with zone and records
+ * base64-encoded, into a log.  On success, @a plugin->fh is the
+ * converted log.
+ *
+ * @param plugin the plugin context, @a plugin->fh is the old database
+ * @param size size of the old database
+ * @return #GNUNET_OK on success
+ */
+static int
+import_legacy (struct Plugin *plugin,
+               off_t size)
+{
+  char *buffer;
+  char *line;
+  char *zone_private_key;
+  char *rvalue;
+  char *record_count;
+  char *record_data_b64;
+  char *label;
+  char *record_data;
+  char *key_data;
+  char *tmp_fn;
+  size_t record_data_size;
+  size_t key_size;
+  unsigned int rd_count;
+  unsigned int imported;
+  uint64_t off;
+  uint32_t rsize;
+  int ret;
+
+  buffer = GNUNET_malloc_large (size + 1);
+  if ( (NULL == buffer) ||
+       (GNUNET_SYSERR ==
+        GNUNET_DISK_file_seek (plugin->fh,
+                               0,
+                               GNUNET_DISK_SEEK_SET)) ||
+       (size !=
+        GNUNET_DISK_file_read (plugin->fh,
+                               buffer,
+                               size)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Unable to read file: %s.\n"),
+                plugin->fn);
+    GNUNET_free_non_null (buffer);
+    return GNUNET_SYSERR;
+  }
+  buffer[size] = '\0';
+  GNUNET_DISK_file_close (plugin->fh);
+  GNUNET_asprintf (&tmp_fn,
+                   "%s.import",
+                   plugin->fn);
+  plugin->fh = GNUNET_DISK_file_open (tmp_fn,
+                                      GNUNET_DISK_OPEN_CREATE |
+                                      GNUNET_DISK_OPEN_TRUNCATE |
+                                      GNUNET_DISK_OPEN_READWRITE,
+                                      GNUNET_DISK_PERM_USER_WRITE |
+                                      GNUNET_DISK_PERM_USER_READ);
+  plugin->epoch = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                            UINT64_MAX);
+  plugin->log_size = sizeof (struct FlatLogHeader);
+  if ( (NULL == plugin->fh) ||
+       (GNUNET_OK !=
+        write_log_header (plugin->fh,
+                          plugin->epoch)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "open",
+                              tmp_fn);
+    if (NULL != plugin->fh)
+      GNUNET_DISK_file_close (plugin->fh);
+    plugin->fh = NULL;
+    GNUNET_free (tmp_fn);
+    GNUNET_free (buffer);
+    return GNUNET_SYSERR;
+  }
+  ret = GNUNET_OK;
+  imported = 0;
+  line = strtok (buffer, "\n");
+  while (line != NULL)
+  {
+    zone_private_key = strtok (line, ",");
+    if (NULL == zone_private_key)
+      break;
+    rvalue = strtok (NULL, ",");
+    if (NULL == rvalue)
+      break;
+    record_count = strtok (NULL, ",");
+    if (NULL == record_count)
+      break;
+    record_data_b64 = strtok (NULL, ",");
+    if (NULL == record_data_b64)
+      break;
+    label = strtok (NULL, ",");
+    if (NULL == label)
+      break;
+    line = strtok (NULL, "\n");
+    if ( (1 != sscanf (record_count, "%u", &rd_count)) ||
+         (0 == rd_count) ||
+         (rd_count > size) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Error parsing entry\n");
+      break;
+    }
+    key_size = GNUNET_STRINGS_base64_decode (zone_private_key,
+                                             strlen (zone_private_key),
+                                             &key_data);
+    if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) != key_size)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Error parsing entry\n");
+      GNUNET_free_non_null (key_data);
+      break;
+    }
+    record_data_size = GNUNET_STRINGS_base64_decode (record_data_b64,
+                                                     strlen (record_data_b64),
+                                                     &record_data);
+    {
+      struct GNUNET_GNSRECORD_Data rd[rd_count];
+
+      if (GNUNET_OK !=
+          GNUNET_GNSRECORD_records_deserialize (record_data_size,
+                                                record_data,
+                                                rd_count,
+                                                rd))
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                    "Unable to deserialize record %s\n",
+                    label);
+        GNUNET_free (key_data);
+        GNUNET_free_non_null (record_data);
+        break;
+      }
+      if (GNUNET_OK !=
+          append_record (plugin,
+                         (const struct GNUNET_CRYPTO_EcdsaPrivateKey *) key_data,
+                         label,
+                         rd_count,
+                         rd,
+                         &off,
+                         &rsize))
+        ret = GNUNET_SYSERR;
+    }
+    GNUNET_free (key_data);
+    GNUNET_free (record_data);
+    if (GNUNET_OK != ret)
+      break;
+    imported++;
+  }
+  GNUNET_free (buffer);
+  if ( (GNUNET_OK == ret) &&
+       (GNUNET_OK != GNUNET_DISK_file_sync (plugin->fh)) )
+    ret = GNUNET_SYSERR;
+  GNUNET_DISK_file_close (plugin->fh);
+  plugin->fh = NULL;
+  if ( (GNUNET_OK == ret) &&
+       (0 != RENAME (tmp_fn,
+                     plugin->fn)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "rename",
+                              tmp_fn);
+    ret = GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_break (0 == UNLINK (tmp_fn));
+    GNUNET_free (tmp_fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (tmp_fn);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              _("Converted %u labels in `%s' to the new format.\n"),
+              imported,
+              plugin->fn);
+  if (GNUNET_OK !=
+      open_log (plugin,
+                &size))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Load the index, if it matches the log.
+ *
+ * @param plugin the plugin context
+ * @param size size of the log
+ * @return offset up to which the index covers the log
+ */
+static uint64_t
+load_index (struct Plugin *plugin,
+            uint64_t size)
+{
+  struct FlatIndexHeader hdr;
+  struct FlatIndexEntry *entries;
+  struct GNUNET_DISK_FileHandle *fh;
+  uint64_t covered;
+  uint64_t count;
+  uint64_t off;
+  uint32_t esize;
+  off_t fsize;
+  uint64_t i;
+
+  if (GNUNET_YES !=
+      GNUNET_DISK_file_test (plugin->index_fn))
+    return sizeof (struct FlatLogHeader);
+  fh = GNUNET_DISK_file_open (plugin->index_fn,
+                              GNUNET_DISK_OPEN_READ,
+                              GNUNET_DISK_PERM_NONE);
+  if (NULL == fh)
+    return sizeof (struct FlatLogHeader);
+  entries = NULL;
+  covered = 0;
+  count = 0;
+  if ( (GNUNET_OK ==
+        GNUNET_DISK_file_handle_size (fh,
+                                      &fsize)) &&
+       (sizeof (hdr) ==
+        GNUNET_DISK_file_read (fh,
+                               &hdr,
+                               sizeof (hdr))) &&
+       (0 == memcmp (hdr.magic,
+                     INDEX_MAGIC,
+                     sizeof (hdr.magic))) &&
+       (FORMAT_VERSION == ntohl (hdr.version)) &&
+       (plugin->epoch == GNUNET_ntohll (hdr.epoch)) )
+  {
+    covered = GNUNET_ntohll (hdr.log_size);
+    count = GNUNET_ntohll (hdr.count);
+  }
+  if ( (covered < sizeof (struct FlatLogHeader)) ||
+       (covered > size) ||
+       (count > (fsize - sizeof (hdr)) / sizeof (struct FlatIndexEntry)) ||
+       (fsize != sizeof (hdr) + count * sizeof (struct FlatIndexEntry)) ||
+       ( (count > 0) &&
+         (NULL == (entries = GNUNET_malloc_large (count * sizeof (struct FlatIndexEntry)))) ) ||
+       ( (count > 0) &&
+         (count * sizeof (struct FlatIndexEntry) !=
+          GNUNET_DISK_file_read (fh,
+                                 entries,
+                                 count * sizeof (struct FlatIndexEntry))) ) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Ignoring index `%s', it does not match the database.\n"),
+                plugin->index_fn);
+    GNUNET_free_non_null (entries);
+    GNUNET_DISK_file_close (fh);
+    return sizeof (struct FlatLogHeader);
+  }
+  GNUNET_DISK_file_close (fh);
+  /* the map is still empty, size it for all labels right away */
+  GNUNET_CONTAINER_multihashmap_destroy (plugin->hm);
+  plugin->hm = GNUNET_CONTAINER_multihashmap_create_with_layout (count + count / 4 + 1024,
+                                                                 GNUNET_YES,
+                                                                 GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING);
+  for (i = 0; i < count; i++)
+  {
+    off = GNUNET_ntohll (entries[i].off);
+    esize = ntohl (entries[i].size);
+    if ( (off < sizeof (struct FlatLogHeader)) ||
+         (esize < sizeof (struct FlatRecordHeader)) ||
+         (off + esize > covered) )
+      break;
+    apply_record (plugin,
+                  &entries[i].key,
+                  off,
+                  esize,
+                  1);
+  }
+  GNUNET_free_non_null (entries);
+  if (i < count)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Ignoring index `%s', it does not match the database.\n"),
+                plugin->index_fn);
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
+                                           &free_entry,
+                                           plugin);
+    clear_serials (plugin);
+    plugin->live_bytes = 0;
+    return sizeof (struct FlatLogHeader);
+  }
+  return covered;
+}
+
+
+/**
+ * Scan the log from @a off to @a end and apply all records to the
+ * hash map.  A damaged record at the end of the log (i.e. from a
+ * crash while appending) is cut off.
+ *
+ * @param plugin the plugin context
+ * @param off where to start
+ * @param end size of the log
+ */
+static void
+scan_log (struct Plugin *plugin,
+          uint64_t off,
+          uint64_t end)
+{
+  struct FlatRecordHeader hdr;
+  struct GNUNET_HashCode key;
+  const char *label;
+  const char *data;
+  size_t data_size;
+
+  while (off < end)
+  {
+    if (GNUNET_OK !=
+        read_record (plugin,
+                     off,
+                     end,
+                     GNUNET_YES,
+                     &hdr,
+                     &label,
+                     &data,
+                     &data_size))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Dropping %llu bytes of damaged data at the end of `%s'.\n"),
+                  (unsigned long long) (end - off),
+                  plugin->fn);
+      if (0 != FTRUNCATE (plugin->fh->fd,
+                          off))
+        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                  "ftruncate",
+                                  plugin->fn);
+      end = off;
+      break;
+    }
+    get_key (&hdr.zone,
+             label,
+             &key);
+    apply_record (plugin,
+                  &key,
+                  off,
+                  ntohl (hdr.size),
+                  ntohl (hdr.rd_count));
+    off += ntohl (hdr.size);
+  }
+  plugin->log_size = end;
+}
+
+
+/**
+ * Write the index for the current log.  The entries are written in
+ * the order of their serial numbers, so that loading the index
+ * restores the order of the zone iteration.  The log is synced
+ * first, so that the index never covers entries that did not reach
+ * the disk.
+ *
+ * @param plugin the plugin context
+ */
+static void
+write_index (struct Plugin *plugin)
+{
+  struct FlatIndexHeader *hdr;
+  struct FlatIndexEntry *ie;
+  const struct FlatFileEntry *entry;
+  struct GNUNET_DISK_FileHandle *fh;
+  unsigned int count;
+  unsigned int i;
+  size_t size;
+  char *tmp_fn;
+  int ret;
+
+  if (GNUNET_OK != GNUNET_DISK_file_sync (plugin->fh))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "fsync",
+                              plugin->fn);
+    return;
+  }
+  count = GNUNET_CONTAINER_multihashmap_size (plugin->hm);
+  size = sizeof (struct FlatIndexHeader)
+    + count * sizeof (struct FlatIndexEntry);
+  hdr = GNUNET_malloc_large (size);
+  if (NULL == hdr)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "malloc");
+    return;
+  }
+  GNUNET_memcpy (hdr->magic,
+                 INDEX_MAGIC,
+                 sizeof (hdr->magic));
+  hdr->version = htonl (FORMAT_VERSION);
+  hdr->epoch = GNUNET_htonll (plugin->epoch);
+  hdr->log_size = GNUNET_htonll (plugin->log_size);
+  hdr->count = GNUNET_htonll (count);
+  ie = (struct FlatIndexEntry *) &hdr[1];
+  for (i = 0; i < plugin->serials_len; i++)
+  {
+    entry = plugin->serials[i].entry;
+    if (NULL == entry)
+      continue;
+    ie->key = entry->key;
+    ie->off = GNUNET_htonll (entry->off);
+    ie->size = htonl (entry->size);
+    ie->reserved = htonl (0);
+    ie++;
+  }
+  GNUNET_assert (ie == ((struct FlatIndexEntry *) &hdr[1]) + count);
+  GNUNET_asprintf (&tmp_fn,
+                   "%s.tmp",
+                   plugin->index_fn);
+  fh = GNUNET_DISK_file_open (tmp_fn,
+                              GNUNET_DISK_OPEN_CREATE |
+                              GNUNET_DISK_OPEN_TRUNCATE |
+                              GNUNET_DISK_OPEN_WRITE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE);
+  ret = GNUNET_SYSERR;
+  if (NULL != fh)
+  {
+    if ( (size ==
+          GNUNET_DISK_file_write (fh,
+                                  hdr,
+                                  size)) &&
+         (GNUNET_OK == GNUNET_DISK_file_sync (fh)) )
+      ret = GNUNET_OK;
+    GNUNET_DISK_file_close (fh);
+  }
+  if ( (GNUNET_OK != ret) ||
+       (0 != RENAME (tmp_fn,
+                     plugin->index_fn)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              plugin->index_fn);
+    (void) UNLINK (tmp_fn);
+  }
+  GNUNET_free (tmp_fn);
+  GNUNET_free (hdr);
+}
+
+
+/**
+ * Abort a running compaction and remove the new log.
+ *
+ * @param plugin the plugin context
+ */
+static void
+abort_compaction (struct Plugin *plugin)
+{
+  struct Compaction *c = plugin->compaction;
+
+  if (NULL != c->task)
+    GNUNET_SCHEDULER_cancel (c->task);
+  if (NULL != c->fh)
+    GNUNET_DISK_file_close (c->fh);
+  if (0 != UNLINK (c->fn))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "unlink",
+                              c->fn);
+  GNUNET_free (c->fn);
+  GNUNET_free_non_null (c->items);
+  GNUNET_free (c);
+  plugin->compaction = NULL;
+}
+
+
+/**
+ * Compare two compaction items by their offset in the old log.
+ *
+ * @param a first `struct CompactionItem`
+ * @param b second `struct CompactionItem`
+ * @return -1, 0 or 1
+ */
+static int
+compaction_item_cmp (const void *a,
+                     const void *b)
+{
+  const struct CompactionItem *ia = a;
+  const struct CompactionItem *ib = b;
+
+  if (ia->old_off < ib->old_off)
+    return -1;
+  if (ia->old_off > ib->old_off)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Move an entry to its offset in the compacted log.
+ *
+ * @param cls the plugin context
+ * @param key hash over label and zone
+ * @param value the `struct FlatFileEntry`
+ * @return #GNUNET_YES
+ */
+static int
+relocate_entry (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  struct Plugin *plugin = cls;
+  struct Compaction *c = plugin->compaction;
+  struct FlatFileEntry *entry = value;
+  struct CompactionItem needle;
+  struct CompactionItem *item;
+
+  if (entry->off >= c->snapshot_end)
+  {
+    /* appended while we were compacting, copied verbatim */
+    entry->off = entry->off - c->snapshot_end + c->new_size;
+    return GNUNET_YES;
+  }
+  /* unchanged since the compaction started, so we copied it */
+  needle.old_off = entry->off;
+  item = bsearch (&needle,
+                  c->items,
+                  c->items_len,
+                  sizeof (struct CompactionItem),
+                  &compaction_item_cmp);
+  GNUNET_assert (NULL != item);
+  entry->off = item->new_off;
+  return GNUNET_YES;
+}
+
+
+/**
+ * All live records have been copied.  Copy the records appended
+ * since, and replace the old log with the new one.
+ *
+ * @param plugin the plugin context
+ */
+static void
+finish_compaction (struct Plugin *plugin)
+{
+  struct Compaction *c = plugin->compaction;
+  uint64_t tail;
+  uint64_t old_size;
+  off_t size;
+
+  tail = plugin->log_size - c->snapshot_end;
+  if ( (GNUNET_OK !=
+        ensure_mapped (plugin,
+                       plugin->log_size)) ||
+       ( (0 != tail) &&
+         (tail !=
+          GNUNET_DISK_file_write (c->fh,
+                                  &plugin->map_addr[c->snapshot_end],
+                                  tail)) ) ||
+       (GNUNET_OK !=
+        GNUNET_DISK_file_sync (c->fh)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              c->fn);
+    abort_compaction (plugin);
+    return;
+  }
+  GNUNET_DISK_file_close (c->fh);
+  c->fh = NULL;
+  if (0 != RENAME (c->fn,
+                   plugin->fn))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "rename",
+                              c->fn);
+    abort_compaction (plugin);
+    return;
+  }
+  /* the index belongs to the old log */
+  (void) UNLINK (plugin->index_fn);
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
+                                         &relocate_entry,
+                                         plugin);
+  old_size = plugin->log_size;
+  plugin->log_size = c->new_size + tail;
+  plugin->epoch = c->epoch;
+  GNUNET_free (c->fn);
+  GNUNET_free_non_null (c->items);
+  GNUNET_free (c);
+  plugin->compaction = NULL;
+  if (NULL != plugin->map)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (plugin->map));
+    plugin->map = NULL;
+    plugin->map_addr = NULL;
+    plugin->map_size = 0;
+  }
+  GNUNET_DISK_file_close (plugin->fh);
+  plugin->fh = NULL;
+  if ( (GNUNET_OK !=
+        open_log (plugin,
+                  &size)) ||
+       (size != (off_t) plugin->log_size) ||
+       (GNUNET_SYSERR ==
+        GNUNET_DISK_file_seek (plugin->fh,
+                               0,
+                               GNUNET_DISK_SEEK_END)) )
+  {
+    /* we cannot continue without a log */
+    GNUNET_assert (0);
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Compacted `%s' from %llu to %llu bytes\n",
+              plugin->fn,
+              (unsigned long long) old_size,
+              (unsigned long long) plugin->log_size);
+}
+
 
-  /**
-   * PKEY to look for in zone to name
-   */
-  struct GNUNET_CRYPTO_EcdsaPublicKey *iter_pkey;
+/**
+ * Copy the next chunk of live records into the new log.
+ *
+ * @param cls the plugin context
+ */
+static void
+compaction_task (void *cls)
+{
+  struct Plugin *plugin = cls;
+  struct Compaction *c = plugin->compaction;
+  struct CompactionItem *item;
+  uint64_t run_off;
+  uint64_t run_len;
+  uint64_t copied;
 
-  /**
-   * Iteration result found
-   */
-  int iter_result_found;
+  c->task = NULL;
+  if (GNUNET_OK !=
+      ensure_mapped (plugin,
+                     plugin->log_size))
+  {
+    abort_compaction (plugin);
+    return;
+  }
+  copied = 0;
+  while ( (c->pos < c->items_len) &&
+          (copied < COMPACTION_CHUNK) )
+  {
+    /* copy runs of adjacent live records with one write */
+    run_off = c->items[c->pos].old_off;
+    run_len = 0;
+    while ( (c->pos < c->items_len) &&
+            (run_len < COMPACTION_CHUNK) &&
+            (c->items[c->pos].old_off == run_off + run_len) )
+    {
+      item = &c->items[c->pos++];
+      item->new_off = c->new_size + run_len;
+      run_len += item->size;
+    }
+    if (run_len !=
+        GNUNET_DISK_file_write (c->fh,
+                                &plugin->map_addr[run_off],
+                                run_len))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "write",
+                                c->fn);
+      abort_compaction (plugin);
+      return;
+    }
+    c->new_size += run_len;
+    copied += run_len;
+  }
+  if (c->pos < c->items_len)
+  {
+    c->task = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                  &compaction_task,
+                                                  plugin);
+    return;
+  }
+  finish_compaction (plugin);
+}
 
-};
 
-struct FlatFileEntry
+/**
+ * Closure for #add_compaction_item.
+ */
+struct CompactionContext
 {
   /**
-   * Entry zone
+   * Where to write the next item.
    */
-  struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key;
+  struct CompactionItem *pos;
+};
 
-  /**
-   * Record cound
-   */
-  uint32_t record_count;
 
-  /**
-   * Rvalue
-   */
-  uint64_t rvalue;
+/**
+ * Add a live record to the compaction.
+ *
+ * @param cls the `struct CompactionContext`
+ * @param key hash over label and zone
+ * @param value the `struct FlatFileEntry`
+ * @return #GNUNET_YES
+ */
+static int
+add_compaction_item (void *cls,
+                     const struct GNUNET_HashCode *key,
+                     void *value)
+{
+  struct CompactionContext *cc = cls;
+  struct FlatFileEntry *entry = value;
 
-  /**
-   * Record data
-   */
-  struct GNUNET_GNSRECORD_Data *record_data;
+  cc->pos->old_off = entry->off;
+  cc->pos->size = entry->size;
+  cc->pos++;
+  return GNUNET_YES;
+}
 
-  /**
-   * Label
-   */
-  char *label;
 
+/**
+ * Start compacting the log if most of it is garbage.
+ *
+ * @param plugin the plugin context
+ */
+static void
+maybe_compact (struct Plugin *plugin)
+{
+  struct Compaction *c;
+  struct CompactionContext cc;
+  uint64_t garbage;
 
-};
+  if (NULL != plugin->compaction)
+    return;
+  garbage = plugin->log_size - sizeof (struct FlatLogHeader)
+    - plugin->live_bytes;
+  if ( (garbage < COMPACTION_MIN_GARBAGE) ||
+       (garbage < plugin->live_bytes) )
+    return;
+  c = GNUNET_new (struct Compaction);
+  GNUNET_asprintf (&c->fn,
+                   "%s.compact",
+                   plugin->fn);
+  c->epoch = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                       UINT64_MAX);
+  c->fh = GNUNET_DISK_file_open (c->fn,
+                                 GNUNET_DISK_OPEN_CREATE |
+                                 GNUNET_DISK_OPEN_TRUNCATE |
+                                 GNUNET_DISK_OPEN_WRITE,
+                                 GNUNET_DISK_PERM_USER_WRITE |
+                                 GNUNET_DISK_PERM_USER_READ);
+  if ( (NULL == c->fh) ||
+       (GNUNET_OK !=
+        write_log_header (c->fh,
+                          c->epoch)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "open",
+                              c->fn);
+    plugin->compaction = c;
+    abort_compaction (plugin);
+    return;
+  }
+  c->items_len = GNUNET_CONTAINER_multihashmap_size (plugin->hm);
+  if (c->items_len > 0)
+  {
+    c->items = GNUNET_malloc_large (c->items_len * sizeof (struct CompactionItem));
+    if (NULL == c->items)
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "malloc");
+      plugin->compaction = c;
+      abort_compaction (plugin);
+      return;
+    }
+    cc.pos = c->items;
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
+                                           &add_compaction_item,
+                                           &cc);
+    qsort (c->items,
+           c->items_len,
+           sizeof (struct CompactionItem),
+           &compaction_item_cmp);
+  }
+  c->snapshot_end = plugin->log_size;
+  c->new_size = sizeof (struct FlatLogHeader);
+  plugin->compaction = c;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Compacting `%s', %llu of %llu bytes are garbage\n",
+              plugin->fn,
+              (unsigned long long) garbage,
+              (unsigned long long) plugin->log_size);
+  c->task = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                &compaction_task,
+                                                plugin);
+}
 
 
 /**
@@ -128,21 +1853,9 @@ static int
 database_setup (struct Plugin *plugin)
 {
   char *afsdir;
-  char *key;
-  char *record_data;
-  char *zone_private_key;
-  char *record_data_b64;
-  char *buffer;
-  char *line;
-  char *label;
-  char *rvalue;
-  char *record_count;
-  size_t record_data_size;
-  size_t size;
-  size_t key_len;
-  struct GNUNET_HashCode hkey;
-  struct GNUNET_DISK_FileHandle *fh;
-  struct FlatFileEntry *entry;
+  off_t size;
+  uint64_t covered;
+  int ret;
 
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_filename (plugin->cfg,
@@ -164,193 +1877,84 @@ database_setup (struct Plugin *plugin)
   }
   /* afsdir should be UTF-8-encoded. If it isn't, it's a bug */
   plugin->fn = afsdir;
-
-  /* Load data from file into hashmap */
-  plugin->hm = GNUNET_CONTAINER_multihashmap_create (10,
-                                                     GNUNET_NO);
-  fh = GNUNET_DISK_file_open (afsdir,
-                              GNUNET_DISK_OPEN_CREATE |
-                              GNUNET_DISK_OPEN_READWRITE,
-                              GNUNET_DISK_PERM_USER_WRITE |
-                              GNUNET_DISK_PERM_USER_READ);
-  if (NULL == fh)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-         _("Unable to initialize file: %s.\n"),
-         afsdir);
-    return GNUNET_SYSERR;
-  }
-  if (GNUNET_SYSERR ==
-      GNUNET_DISK_file_size (afsdir,
-                             &size,
-                             GNUNET_YES,
-                             GNUNET_YES))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-         _("Unable to get filesize: %s.\n"),
-         afsdir);
-    GNUNET_DISK_file_close (fh);
-    return GNUNET_SYSERR;
-  }
-
-  buffer = GNUNET_malloc (size + 1);
-  if (GNUNET_SYSERR ==
-      GNUNET_DISK_file_read (fh,
-                             buffer,
-                             size))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-         _("Unable to read file: %s.\n"),
-         afsdir);
-    GNUNET_free (buffer);
-    GNUNET_DISK_file_close (fh);
+  GNUNET_asprintf (&plugin->index_fn,
+                   "%s.idx",
+                   afsdir);
+  if (GNUNET_OK !=
+      open_log (plugin,
+                &size))
     return GNUNET_SYSERR;
-  }
-  buffer[size] = '\0';
-  GNUNET_DISK_file_close (fh);
-
-  if (0 < size)
+  if (0 == size)
   {
-    line = strtok (buffer, "\n");
-    while (line != NULL) {
-      zone_private_key = strtok (line, ",");
-      if (NULL == zone_private_key)
-        break;
-      rvalue = strtok (NULL, ",");
-      if (NULL == rvalue)
-        break;
-      record_count = strtok (NULL, ",");
-      if (NULL == record_count)
-        break;
-      record_data_b64 = strtok (NULL, ",");
-      if (NULL == record_data_b64)
-        break;
-      label = strtok (NULL, ",");
-      if (NULL == label)
-        break;
-      line = strtok (NULL, "\n");
-      entry = GNUNET_malloc (sizeof (struct FlatFileEntry));
-      if (1 != sscanf (rvalue, "%lu", &entry->rvalue))
-      {
-        GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                    "Error parsing entry\n");
-        GNUNET_free (entry);
-        break;
-      }
-      if (1 != sscanf (record_count, "%u", &entry->record_count))
-      {
-        GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                    "Error parsing entry\n");
-        GNUNET_free (entry);
-        break;
-      }
-      entry->label = GNUNET_strdup (label);
-      record_data_size = GNUNET_STRINGS_base64_decode (record_data_b64,
-                                                       strlen (record_data_b64),
-                                                       &record_data);
-      entry->record_data =
-        GNUNET_malloc (sizeof (struct GNUNET_GNSRECORD_Data) * entry->record_count);
-      if (GNUNET_OK != GNUNET_GNSRECORD_records_deserialize (record_data_size,
-                                                             record_data,
-                                                             entry->record_count,
-                                                             entry->record_data))
-      {
-        GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                    "Unable to deserialize record %s\n", label);
-        GNUNET_free (entry->label);
-        GNUNET_free (entry);
-        GNUNET_free (record_data);
-        break;
-      }
-      GNUNET_free (record_data);
-      GNUNET_STRINGS_base64_decode (zone_private_key,
-                                    strlen (zone_private_key),
-                                    (char**)&entry->private_key);
-      key_len = strlen (label) + sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey);
-      key = GNUNET_malloc (strlen (label) + sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-      GNUNET_memcpy (key, label, strlen (label));
-      GNUNET_memcpy (key+strlen(label),
-              entry->private_key,
-              sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-      GNUNET_CRYPTO_hash (key,
-                          key_len,
-                          &hkey);
-      GNUNET_free (key);
-      if (GNUNET_OK !=
-          GNUNET_CONTAINER_multihashmap_put (plugin->hm,
-                                             &hkey,
-                                             entry,
-                                             GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-      {
-        GNUNET_free (entry);
-        GNUNET_break (0);
-      }
+    plugin->epoch = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                              UINT64_MAX);
+    if (GNUNET_OK !=
+        write_log_header (plugin->fh,
+                          plugin->epoch))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "write",
+                                afsdir);
+      return GNUNET_SYSERR;
     }
+    size = sizeof (struct FlatLogHeader);
   }
-  GNUNET_free (buffer);
-  return GNUNET_OK;
-}
-
-
-/**
- * Store values in hashmap in file and free data
- *
- * @param plugin the plugin context
- */
-static int
-store_and_free_entries (void *cls,
-                        const struct GNUNET_HashCode *key,
-                        void *value)
-{
-  struct GNUNET_DISK_FileHandle *fh = cls;
-  struct FlatFileEntry *entry = value;
-  char *line;
-  char *zone_private_key;
-  char *record_data_b64;
-  size_t data_size;
-
-  GNUNET_STRINGS_base64_encode ((char*)entry->private_key,
-                                sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
-                                &zone_private_key);
-  data_size = GNUNET_GNSRECORD_records_get_size (entry->record_count,
-                                                 entry->record_data);
+  else
   {
-    char data[data_size];
-
-    if (data_size !=
-        GNUNET_GNSRECORD_records_serialize (entry->record_count,
-                                            entry->record_data,
-                                            data_size,
-                                            data))
+    ret = read_log_header (plugin,
+                           plugin->fh,
+                           size,
+                           &plugin->epoch);
+    if (GNUNET_SYSERR == ret)
+      return GNUNET_SYSERR;
+    if ( (GNUNET_NO == ret) &&
+         (GNUNET_OK !=
+          import_legacy (plugin,
+                         size)) )
+      return GNUNET_SYSERR;
+    if ( (GNUNET_NO == ret) &&
+         ( (GNUNET_OK !=
+            GNUNET_DISK_file_handle_size (plugin->fh,
+                                          &size)) ||
+           (GNUNET_OK !=
+            read_log_header (plugin,
+                             plugin->fh,
+                             size,
+                             &plugin->epoch)) ) )
     {
       GNUNET_break (0);
-      GNUNET_free (zone_private_key);
       return GNUNET_SYSERR;
     }
-    GNUNET_STRINGS_base64_encode (data,
-                                  data_size,
-                                  &record_data_b64);
-  }
-  GNUNET_asprintf (&line,
-                   "%s,%lu,%u,%s,%s\n",
-                   zone_private_key,
-                   entry->rvalue,
-                   entry->record_count,
-                   record_data_b64,
-                   entry->label);
-  GNUNET_free (record_data_b64);
-  GNUNET_free (zone_private_key);
-
-  GNUNET_DISK_file_write (fh,
-                          line,
-                          strlen (line));
-
-  GNUNET_free (line);
-  GNUNET_free (entry->private_key);
-  GNUNET_free (entry->label);
-  GNUNET_free (entry->record_data);
-  GNUNET_free (entry);
-  return GNUNET_YES;
+  }
+  if (GNUNET_OK !=
+      ensure_mapped (plugin,
+                     size))
+    return GNUNET_SYSERR;
+  plugin->hm = GNUNET_CONTAINER_multihashmap_create_with_layout (1024,
+                                                                 GNUNET_YES,
+                                                                 GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING);
+  covered = load_index (plugin,
+                        size);
+  scan_log (plugin,
+            covered,
+            size);
+  if (GNUNET_SYSERR ==
+      GNUNET_DISK_file_seek (plugin->fh,
+                             plugin->log_size,
+                             GNUNET_DISK_SEEK_SET))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "seek",
+                              afsdir);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Loaded %u labels, read %llu of %llu bytes of the log\n",
+              GNUNET_CONTAINER_multihashmap_size (plugin->hm),
+              (unsigned long long) (plugin->log_size - covered),
+              (unsigned long long) plugin->log_size);
+  maybe_compact (plugin);
+  return GNUNET_OK;
 }
 
 
@@ -362,26 +1966,32 @@ store_and_free_entries (void *cls,
 static void
 database_shutdown (struct Plugin *plugin)
 {
-  struct GNUNET_DISK_FileHandle *fh;
-  fh = GNUNET_DISK_file_open (plugin->fn,
-                              GNUNET_DISK_OPEN_CREATE |
-                              GNUNET_DISK_OPEN_TRUNCATE |
-                              GNUNET_DISK_OPEN_READWRITE,
-                              GNUNET_DISK_PERM_USER_WRITE |
-                              GNUNET_DISK_PERM_USER_READ);
-  if (NULL == fh)
+  if (NULL != plugin->compaction)
+    abort_compaction (plugin);
+  if (NULL != plugin->hm)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                _("Unable to initialize file: %s.\n"),
-                plugin->fn);
-    return;
+    if (NULL != plugin->fh)
+      write_index (plugin);
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
+                                           &free_entry,
+                                           plugin);
+    GNUNET_CONTAINER_multihashmap_destroy (plugin->hm);
+    plugin->hm = NULL;
   }
-
-  GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
-                                         &store_and_free_entries,
-                                         fh);
-  GNUNET_CONTAINER_multihashmap_destroy (plugin->hm);
-  GNUNET_DISK_file_close (fh);
+  clear_serials (plugin);
+  if (NULL != plugin->map)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (plugin->map));
+    plugin->map = NULL;
+  }
+  if (NULL != plugin->fh)
+  {
+    GNUNET_DISK_file_close (plugin->fh);
+    plugin->fh = NULL;
+  }
+  GNUNET_free_non_null (plugin->index_fn);
+  GNUNET_free_non_null (plugin->fn);
 }
 
 
@@ -404,54 +2014,34 @@ namestore_store_records (void *cls,
                          const struct GNUNET_GNSRECORD_Data *rd)
 {
   struct Plugin *plugin = cls;
-  uint64_t rvalue;
-  size_t key_len;
-  char *key;
   struct GNUNET_HashCode hkey;
-  struct FlatFileEntry *entry;
-  int i;
-
-  rvalue = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK, UINT64_MAX);
-  key_len = strlen (label) + sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey);
-  key = GNUNET_malloc (key_len);
-  GNUNET_memcpy (key, label, strlen (label));
-  GNUNET_memcpy (key+strlen(label),
-          zone_key,
-          sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-  GNUNET_CRYPTO_hash (key,
-                      key_len,
-                      &hkey);
-
-  GNUNET_CONTAINER_multihashmap_remove_all (plugin->hm, &hkey);
-
-  if (0 < rd_count)
-  {
-    entry = GNUNET_malloc (sizeof (struct FlatFileEntry));
-    entry->private_key = GNUNET_malloc (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-    GNUNET_asprintf (&entry->label,
+  uint64_t off;
+  uint32_t size;
+
+  get_key (zone_key,
+           label,
+           &hkey);
+  if ( (0 == rd_count) &&
+       (GNUNET_NO ==
+        GNUNET_CONTAINER_multihashmap_contains (plugin->hm,
+                                                &hkey)) )
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      append_record (plugin,
+                     zone_key,
                      label,
-                     strlen (label));
-    GNUNET_memcpy (entry->private_key,
-            zone_key,
-            sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-    entry->rvalue = rvalue;
-    entry->record_count = rd_count;
-    entry->record_data = GNUNET_malloc (sizeof (struct GNUNET_GNSRECORD_Data) * rd_count);
-    for (i = 0; i < rd_count; i++)
-    {
-      entry->record_data[i].expiration_time = rd[i].expiration_time;
-      entry->record_data[i].record_type = rd[i].record_type;
-      entry->record_data[i].flags = rd[i].flags;
-      entry->record_data[i].data_size = rd[i].data_size;
-      entry->record_data[i].data = GNUNET_malloc (rd[i].data_size);
-      GNUNET_memcpy ((char*)entry->record_data[i].data, rd[i].data, rd[i].data_size);
-    }
-    return GNUNET_CONTAINER_multihashmap_put (plugin->hm,
-                                              &hkey,
-                                              entry,
-                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY);
-  }
-  return GNUNET_NO;
+                     rd_count,
+                     rd,
+                     &off,
+                     &size))
+    return GNUNET_SYSERR;
+  apply_record (plugin,
+                &hkey,
+                off,
+                size,
+                rd_count);
+  maybe_compact (plugin);
+  return GNUNET_OK;
 }
 
 
@@ -475,123 +2065,141 @@ namestore_lookup_records (void *cls,
   struct Plugin *plugin = cls;
   struct FlatFileEntry *entry;
   struct GNUNET_HashCode hkey;
-  char *key;
-  size_t key_len;
 
   if (NULL == zone)
   {
     return GNUNET_SYSERR;
   }
-  key_len = strlen (label) + sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey);
-  key = GNUNET_malloc (key_len);
-  GNUNET_memcpy (key, label, strlen (label));
-  GNUNET_memcpy (key+strlen(label),
-          zone,
-          sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
-  GNUNET_CRYPTO_hash (key,
-                      key_len,
-                      &hkey);
-  GNUNET_free (key);
-
+  get_key (zone,
+           label,
+           &hkey);
   entry = GNUNET_CONTAINER_multihashmap_get (plugin->hm, &hkey);
 
   if (NULL == entry)
     return GNUNET_NO;
-  if (NULL != iter)
-    iter (iter_cls, entry->private_key, entry->label, entry->record_count, entry->record_data);
+  if (GNUNET_OK !=
+      process_entry (plugin,
+                     entry,
+                     NULL,
+                     iter,
+                     iter_cls))
+    return GNUNET_SYSERR;
   return GNUNET_YES;
 }
 
 
-static int
-iterate_zones (void *cls,
-               const struct GNUNET_HashCode *key,
-               void *value)
-{
-  struct Plugin *plugin = cls;
-  struct FlatFileEntry *entry = value;
-
-  if ((plugin->target_offset > plugin->offset) ||
-      ( (NULL != plugin->iter_zone) &&
-        (0 != memcmp (entry->private_key,
-                      plugin->iter_zone,
-                      sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))))) {
-    plugin->offset++;
-    return GNUNET_YES;
-  }
-  plugin->iter (plugin->iter_cls,
-                entry->private_key,
-                entry->label,
-                entry->record_count,
-                entry->record_data);
-  plugin->iter_result_found = GNUNET_YES;
-  return GNUNET_NO;
-}
-
 /**
  * Iterate over the results for a particular key and zone in the
- * datastore.  Will return at most one result to the iterator.
+ * datastore.  Will return at most @a limit results to the iterator.
  *
  * @param cls closure (internal context for the plugin)
  * @param zone hash of public key of the zone, NULL to iterate over all zones
- * @param offset offset in the list of all matching records
+ * @param serial serial number to exclude in the list of all matching records
+ * @param limit maximum number of results to return
  * @param iter function to call with the result
  * @param iter_cls closure for @a iter
- * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
+ * @return #GNUNET_OK on success, #GNUNET_NO if there were no more results, #GNUNET_SYSERR on error
  */
 static int
 namestore_iterate_records (void *cls,
                            const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
-                           uint64_t offset,
-                           GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+                           uint64_t serial,
+                           uint64_t limit,
+                           GNUNET_NAMESTORE_RecordIterator iter,
+                           void *iter_cls)
 {
   struct Plugin *plugin = cls;
-  plugin->target_offset = offset;
-  plugin->offset = 0;
-  plugin->iter = iter;
-  plugin->iter_cls = iter_cls;
-  plugin->iter_zone = zone;
-  plugin->iter_result_found = GNUNET_NO;
-  GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
-                                         &iterate_zones,
-                                         plugin);
-  return plugin->iter_result_found;
+  const struct SerialSlot *slot;
+  unsigned int pos;
+  uint64_t found;
+
+  found = 0;
+  pos = find_serial (plugin,
+                     serial);
+  while ( (found < limit) &&
+          (pos < plugin->serials_len) )
+  {
+    slot = &plugin->serials[pos++];
+    if (NULL == slot->entry)
+      continue;
+    serial = slot->serial;
+    if (GNUNET_OK !=
+        process_entry (plugin,
+                       slot->entry,
+                       zone,
+                       iter,
+                       iter_cls))
+      continue;
+    found++;
+    /* @a iter may have stored records and thereby moved the slots */
+    pos = find_serial (plugin,
+                       serial);
+  }
+  return (0 == found) ? GNUNET_NO : GNUNET_OK;
 }
 
-static int
-zone_to_name (void *cls,
-              const struct GNUNET_HashCode *key,
-              void *value)
+
+/**
+ * Check if the records of a label contain the PKEY we are looking
+ * for and if so, pass them on.
+ *
+ * @param cls the plugin context
+ * @param serial serial number of the label
+ * @param zone_key private key of the zone
+ * @param label the label
+ * @param rd_count number of entries in @a rd array
+ * @param rd array of records
+ */
+static void
+check_pkey (void *cls,
+            uint64_t serial,
+            const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+            const char *label,
+            unsigned int rd_count,
+            const struct GNUNET_GNSRECORD_Data *rd)
 {
   struct Plugin *plugin = cls;
-  struct FlatFileEntry *entry = value;
-  int i;
-
-  if (0 != memcmp (entry->private_key,
-                   plugin->iter_zone,
-                   sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey)))
-    return GNUNET_YES;
+  unsigned int i;
 
-  for (i = 0; i < entry->record_count; i++) {
-    if (GNUNET_GNSRECORD_TYPE_PKEY != entry->record_data[i].record_type)
+  for (i = 0; i < rd_count; i++)
+  {
+    if (GNUNET_GNSRECORD_TYPE_PKEY != rd[i].record_type)
       continue;
-    if (0 == memcmp (plugin->iter_pkey,
-                     entry->record_data[i].data,
-                     sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey)))
+    if ( (sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey) == rd[i].data_size) &&
+         (0 == memcmp (plugin->iter_pkey,
+                       rd[i].data,
+                       sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey))) )
     {
       plugin->iter (plugin->iter_cls,
-                    entry->private_key,
-                    entry->label,
-                    entry->record_count,
-                    entry->record_data);
+                    serial,
+                    zone_key,
+                    label,
+                    rd_count,
+                    rd);
       plugin->iter_result_found = GNUNET_YES;
-
+      return;
     }
   }
+}
+
 
+static int
+zone_to_name (void *cls,
+              const struct GNUNET_HashCode *key,
+              void *value)
+{
+  struct Plugin *plugin = cls;
+  struct FlatFileEntry *entry = value;
+
+  (void) process_entry (plugin,
+                        entry,
+                        plugin->iter_zone,
+                        &check_pkey,
+                        plugin);
   return GNUNET_YES;
 }
 
+
 /**
  * Look for an existing PKEY delegation record for a given public key.
  * Returns at most one result to the iterator.
@@ -614,12 +2222,14 @@ namestore_zone_to_name (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Performing reverse lookup for `%s'\n",
               GNUNET_GNSRECORD_z2s (value_zone));
-
+  plugin->iter = iter;
+  plugin->iter_cls = iter_cls;
+  plugin->iter_zone = zone;
+  plugin->iter_pkey = value_zone;
+  plugin->iter_result_found = GNUNET_NO;
   GNUNET_CONTAINER_multihashmap_iterate (plugin->hm,
                                          &zone_to_name,
                                          plugin);
-
-
   return plugin->iter_result_found;
 }
 
@@ -644,6 +2254,7 @@ libgnunet_plugin_namestore_flat_init (void *cls)
   if (GNUNET_OK != database_setup (&plugin))
   {
     database_shutdown (&plugin);
+    plugin.cfg = NULL;
     return NULL;
   }
   api = GNUNET_new (struct GNUNET_NAMESTORE_PluginFunctions);
@@ -66,6 +66,7 @@ database_setup (struct Plugin *plugin)
 {
   struct GNUNET_PQ_ExecuteStatement es_temporary =
     GNUNET_PQ_make_execute ("CREATE TEMPORARY TABLE IF NOT EXISTS ns097records ("
+                            " seq BIGSERIAL,"
                             " zone_private_key BYTEA NOT NULL DEFAULT '',"
                             " pkey BYTEA DEFAULT '',"
                             " rvalue BYTEA NOT NULL DEFAULT '',"
@@ -76,6 +77,7 @@ database_setup (struct Plugin *plugin)
                             "WITH OIDS");
   struct GNUNET_PQ_ExecuteStatement es_default =
     GNUNET_PQ_make_execute ("CREATE TABLE IF NOT EXISTS ns097records ("
+                            " seq BIGSERIAL,"
                             " zone_private_key BYTEA NOT NULL DEFAULT '',"
                             " pkey BYTEA DEFAULT '',"
                             " rvalue BYTEA NOT NULL DEFAULT '',"
@@ -107,10 +109,15 @@ database_setup (struct Plugin *plugin)
       *cr,
       GNUNET_PQ_make_try_execute ("CREATE INDEX IF NOT EXISTS ir_pkey_reverse "
                                   "ON ns097records (zone_private_key,pkey)"),
-      GNUNET_PQ_make_try_execute ("CREATE INDEX IF NOT EXISTS ir_pkey_iter "
-                                  "ON ns097records (zone_private_key,rvalue)"),
-      GNUNET_PQ_make_try_execute ("CREATE INDEX IF NOT EXISTS it_iter "
-                                  "ON ns097records (rvalue)"),
+      /* tables created before iteration used 'seq' */
+      GNUNET_PQ_make_try_execute ("ALTER TABLE ns097records "
+                                  "ADD COLUMN IF NOT EXISTS seq BIGSERIAL"),
+      GNUNET_PQ_make_try_execute ("CREATE INDEX IF NOT EXISTS ir_zone_iter "
+                                  "ON ns097records (zone_private_key,seq)"),
+      GNUNET_PQ_make_try_execute ("CREATE UNIQUE INDEX IF NOT EXISTS ir_seq "
+                                  "ON ns097records (seq)"),
+      GNUNET_PQ_make_try_execute ("DROP INDEX IF EXISTS ir_pkey_iter"),
+      GNUNET_PQ_make_try_execute ("DROP INDEX IF EXISTS it_iter"),
       GNUNET_PQ_make_try_execute ("CREATE INDEX IF NOT EXISTS ir_label "
                                   "ON ns097records (label)"),
       GNUNET_PQ_EXECUTE_STATEMENT_END
@@ -135,16 +142,18 @@ database_setup (struct Plugin *plugin)
                               "DELETE FROM ns097records "
                               "WHERE zone_private_key=$1 AND label=$2", 2),
       GNUNET_PQ_make_prepare ("zone_to_name",
-                              "SELECT record_count,record_data,label FROM ns097records"
+                              "SELECT seq,record_count,record_data,label FROM ns097records"
                               " WHERE zone_private_key=$1 AND pkey=$2", 2),
       GNUNET_PQ_make_prepare ("iterate_zone",
-                              "SELECT record_count,record_data,label FROM ns097records "
-                              "WHERE zone_private_key=$1 ORDER BY rvalue LIMIT 1 OFFSET $2", 2),
+                              "SELECT seq,record_count,record_data,label FROM ns097records "
+                              "WHERE zone_private_key=$1 AND seq > $2"
+                              " ORDER BY seq ASC LIMIT $3", 3),
       GNUNET_PQ_make_prepare ("iterate_all_zones",
-                              "SELECT record_count,record_data,label,zone_private_key"
-                              " FROM ns097records ORDER BY rvalue LIMIT 1 OFFSET $1", 1),
+                              "SELECT seq,record_count,record_data,label,zone_private_key"
+                              " FROM ns097records WHERE seq > $1"
+                              " ORDER BY seq ASC LIMIT $2", 2),
       GNUNET_PQ_make_prepare ("lookup_label",
-                              "SELECT record_count,record_data,label "
+                              "SELECT seq,record_count,record_data,label "
                               "FROM ns097records WHERE zone_private_key=$1 AND label=$2", 2),
       GNUNET_PQ_PREPARED_STATEMENT_END
     };
@@ -275,12 +284,14 @@ parse_result_call_iterator (void *cls,
 
   for (unsigned int i=0;i<num_results;i++)
   {
+    uint64_t serial;
     void *data;
     size_t data_size;
     uint32_t record_count;
     char *label;
     struct GNUNET_CRYPTO_EcdsaPrivateKey zk;
     struct GNUNET_PQ_ResultSpec rs_with_zone[] = {
+      GNUNET_PQ_result_spec_uint64 ("seq", &serial),
       GNUNET_PQ_result_spec_uint32 ("record_count", &record_count),
       GNUNET_PQ_result_spec_variable_size ("record_data", &data, &data_size),
       GNUNET_PQ_result_spec_string ("label", &label),
@@ -288,6 +299,7 @@ parse_result_call_iterator (void *cls,
       GNUNET_PQ_result_spec_end
     };
     struct GNUNET_PQ_ResultSpec rs_without_zone[] = {
+      GNUNET_PQ_result_spec_uint64 ("seq", &serial),
       GNUNET_PQ_result_spec_uint32 ("record_count", &record_count),
       GNUNET_PQ_result_spec_variable_size ("record_data", &data, &data_size),
       GNUNET_PQ_result_spec_string ("label", &label),
@@ -327,11 +339,13 @@ parse_result_call_iterator (void *cls,
         GNUNET_PQ_cleanup_result (rs);
         return;
       }
-      pc->iter (pc->iter_cls,
-                (NULL == pc->zone_key) ? &zk : pc->zone_key,
-                label,
-                record_count,
-                rd);
+      if (NULL != pc->iter)
+        pc->iter (pc->iter_cls,
+                  serial,
+                  (NULL == pc->zone_key) ? &zk : pc->zone_key,
+                  label,
+                  record_count,
+                  rd);
     }
     GNUNET_PQ_cleanup_result (rs);
   }
@@ -366,7 +380,7 @@ namestore_postgres_lookup_records (void *cls,
 
   pc.iter = iter;
   pc.iter_cls = iter_cls;
-  pc.zone_key = NULL;
+  pc.zone_key = zone;
   res = GNUNET_PQ_eval_prepared_multi_select (plugin->dbh,
                                               "lookup_label",
                                               params,
@@ -380,11 +394,12 @@ namestore_postgres_lookup_records (void *cls,
 
 /**
  * Iterate over the results for a particular key and zone in the
- * datastore.  Will return at most one result to the iterator.
+ * datastore.  Will return at most @a limit results to the iterator.
  *
  * @param cls closure (internal context for the plugin)
  * @param zone hash of public key of the zone, NULL to iterate over all zones
- * @param offset offset in the list of all matching records
+ * @param serial serial number to exclude in the list of all matching records
+ * @param limit maximum number of results to return
  * @param iter function to call with the result
  * @param iter_cls closure for @a iter
  * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
@@ -392,7 +407,8 @@ namestore_postgres_lookup_records (void *cls,
 static int
 namestore_postgres_iterate_records (void *cls,
                                     const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
-                                    uint64_t offset,
+                                    uint64_t serial,
+                                    uint64_t limit,
                                     GNUNET_NAMESTORE_RecordIterator iter,
                                     void *iter_cls)
 {
@@ -406,7 +422,8 @@ namestore_postgres_iterate_records (void *cls,
   if (NULL == zone)
   {
     struct GNUNET_PQ_QueryParam params_without_zone[] = {
-      GNUNET_PQ_query_param_uint64 (&offset),
+      GNUNET_PQ_query_param_uint64 (&serial),
+      GNUNET_PQ_query_param_uint64 (&limit),
       GNUNET_PQ_query_param_end
     };
 
@@ -420,7 +437,8 @@ namestore_postgres_iterate_records (void *cls,
   {
     struct GNUNET_PQ_QueryParam params_with_zone[] = {
       GNUNET_PQ_query_param_auto_from_type (zone),
-      GNUNET_PQ_query_param_uint64 (&offset),
+      GNUNET_PQ_query_param_uint64 (&serial),
+      GNUNET_PQ_query_param_uint64 (&limit),
       GNUNET_PQ_query_param_end
     };
 
@@ -147,18 +147,27 @@ create_indices (sqlite3 * dbh)
   /* create indices */
   if ( (SQLITE_OK !=
 	sqlite3_exec (dbh,
-                      "CREATE INDEX IF NOT EXISTS ir_pkey_reverse ON ns097records (zone_private_key,pkey)",
+                      "CREATE INDEX IF NOT EXISTS ir_pkey_reverse ON ns098records (zone_private_key,pkey)",
 		      NULL, NULL, NULL)) ||
        (SQLITE_OK !=
 	sqlite3_exec (dbh,
-                      "CREATE INDEX IF NOT EXISTS ir_pkey_iter ON ns097records (zone_private_key,rvalue)",
+                      "CREATE INDEX IF NOT EXISTS ir_zone_iter ON ns098records (zone_private_key)",
+		      NULL, NULL, NULL)) )
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+	 "Failed to create indices: %s\n",
+         sqlite3_errmsg (dbh));
+  /* iteration now follows the uid, the indices on rvalue
+     only slow down inserts */
+  if ( (SQLITE_OK !=
+	sqlite3_exec (dbh,
+                      "DROP INDEX IF EXISTS ir_pkey_iter",
 		      NULL, NULL, NULL)) ||
        (SQLITE_OK !=
 	sqlite3_exec (dbh,
-                      "CREATE INDEX IF NOT EXISTS it_iter ON ns097records (rvalue)",
+                      "DROP INDEX IF EXISTS it_iter",
 		      NULL, NULL, NULL)) )
     LOG (GNUNET_ERROR_TYPE_ERROR,
-	 "Failed to create indices: %s\n",
+	 "Failed to drop indices: %s\n",
          sqlite3_errmsg (dbh));
 }
 
@@ -173,6 +182,53 @@ create_indices (sqlite3 * dbh)
 #endif
 
 
+/**
+ * Move the records of a database created before the serial numbers
+ * became an AUTOINCREMENT key into the new table, keeping their
+ * order.
+ *
+ * @param plugin the plugin context (state for this module)
+ */
+static void
+migrate_records (struct Plugin *plugin)
+{
+  sqlite3_stmt *stmt;
+  int have_old;
+
+  if (SQLITE_OK !=
+      sq_prepare (plugin->dbh,
+                  "SELECT 1 FROM sqlite_master WHERE type = 'table' AND tbl_name = 'ns097records'",
+                  &stmt))
+  {
+    LOG_SQLITE (plugin,
+                GNUNET_ERROR_TYPE_ERROR,
+                "sqlite3_prepare");
+    return;
+  }
+  have_old = (SQLITE_ROW == sqlite3_step (stmt));
+  sqlite3_finalize (stmt);
+  if (! have_old)
+    return;
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh,
+                    "BEGIN;"
+                    "INSERT INTO ns098records (zone_private_key, pkey, rvalue, record_count, record_data, label)"
+                    " SELECT zone_private_key, pkey, rvalue, record_count, record_data, label"
+                    " FROM ns097records ORDER BY _rowid_ ASC;"
+                    "DROP TABLE ns097records;"
+                    "COMMIT",
+                    NULL, NULL, NULL))
+  {
+    LOG_SQLITE (plugin,
+                GNUNET_ERROR_TYPE_ERROR,
+                "sqlite3_exec");
+    (void) sqlite3_exec (plugin->dbh,
+                         "ROLLBACK",
+                         NULL, NULL, NULL);
+  }
+}
+
+
 /**
  * Initialize the database connections and associated
  * data structures (create tables and indices
@@ -257,28 +313,34 @@ database_setup (struct Plugin *plugin)
                                BUSY_TIMEOUT_MS));
 
 
-  /* Create table */
+  /* Create table; the uid is the serial number of the records, so
+     it must never be re-used, not even for the highest one after it
+     was deleted (hence AUTOINCREMENT) */
   CHECK (SQLITE_OK ==
          sq_prepare (plugin->dbh,
-                     "SELECT 1 FROM sqlite_master WHERE tbl_name = 'ns097records'",
+                     "SELECT 1 FROM sqlite_master WHERE tbl_name = 'ns098records'",
                      &stmt));
-  if ((sqlite3_step (stmt) == SQLITE_DONE) &&
-      (sqlite3_exec
-       (plugin->dbh,
-        "CREATE TABLE ns097records ("
-        " zone_private_key BLOB NOT NULL DEFAULT '',"
-        " pkey BLOB,"
-	" rvalue INT8 NOT NULL DEFAULT '',"
-	" record_count INT NOT NULL DEFAULT 0,"
-        " record_data BLOB NOT NULL DEFAULT '',"
-        " label TEXT NOT NULL DEFAULT ''"
-	")",
-	NULL, NULL, NULL) != SQLITE_OK))
+  if (sqlite3_step (stmt) == SQLITE_DONE)
   {
-    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR,
-                "sqlite3_exec");
-    sqlite3_finalize (stmt);
-    return GNUNET_SYSERR;
+    if (sqlite3_exec
+        (plugin->dbh,
+         "CREATE TABLE ns098records ("
+         " uid INTEGER PRIMARY KEY AUTOINCREMENT,"
+         " zone_private_key BLOB NOT NULL DEFAULT '',"
+         " pkey BLOB,"
+         " rvalue INT8 NOT NULL DEFAULT '',"
+         " record_count INT NOT NULL DEFAULT 0,"
+         " record_data BLOB NOT NULL DEFAULT '',"
+         " label TEXT NOT NULL DEFAULT ''"
+         ")",
+         NULL, NULL, NULL) != SQLITE_OK)
+    {
+      LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR,
+                  "sqlite3_exec");
+      sqlite3_finalize (stmt);
+      return GNUNET_SYSERR;
+    }
+    migrate_records (plugin);
   }
   sqlite3_finalize (stmt);
 
@@ -286,33 +348,34 @@ database_setup (struct Plugin *plugin)
 
   if ( (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "INSERT INTO ns097records (zone_private_key, pkey, rvalue, record_count, record_data, label)"
+                    "INSERT INTO ns098records (zone_private_key, pkey, rvalue, record_count, record_data, label)"
                     " VALUES (?, ?, ?, ?, ?, ?)",
                     &plugin->store_records)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "DELETE FROM ns097records WHERE zone_private_key=? AND label=?",
+                    "DELETE FROM ns098records WHERE zone_private_key=? AND label=?",
                     &plugin->delete_records)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "SELECT record_count,record_data,label"
-                    " FROM ns097records WHERE zone_private_key=? AND pkey=?",
+                    "SELECT uid,record_count,record_data,label"
+                    " FROM ns098records WHERE zone_private_key=? AND pkey=?",
                     &plugin->zone_to_name)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "SELECT record_count,record_data,label"
-                    " FROM ns097records WHERE zone_private_key=?"
-                    " ORDER BY rvalue LIMIT 1 OFFSET ?",
+                    "SELECT uid,record_count,record_data,label"
+                    " FROM ns098records WHERE zone_private_key=? AND uid > ?"
+                    " ORDER BY uid ASC LIMIT ?",
                     &plugin->iterate_zone)) ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "SELECT record_count,record_data,label,zone_private_key"
-                    " FROM ns097records ORDER BY rvalue LIMIT 1 OFFSET ?",
+                    "SELECT uid,record_count,record_data,label,zone_private_key"
+                    " FROM ns098records WHERE uid > ?"
+                    " ORDER BY uid ASC LIMIT ?",
                     &plugin->iterate_all_zones))  ||
        (SQLITE_OK !=
         sq_prepare (plugin->dbh,
-                    "SELECT record_count,record_data,label,zone_private_key"
-                    " FROM ns097records WHERE zone_private_key=? AND label=?",
+                    "SELECT uid,record_count,record_data,label"
+                    " FROM ns098records WHERE zone_private_key=? AND label=?",
                     &plugin->lookup_label))
        )
   {
@@ -518,99 +581,110 @@ namestore_sqlite_store_records (void *cls,
 
 /**
  * The given 'sqlite' statement has been prepared to be run.
- * It will return a record which should be given to the iterator.
- * Runs the statement and parses the returned record.
+ * It will return records which should be given to the iterator.
+ * Runs the statement and parses the returned records.
  *
  * @param plugin plugin context
  * @param stmt to run (and then clean up)
  * @param zone_key private key of the zone
+ * @param limit maximum number of results to fetch
  * @param iter iterator to call with the result
  * @param iter_cls closure for @a iter
  * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
  */
 static int
-get_record_and_call_iterator (struct Plugin *plugin,
-			      sqlite3_stmt *stmt,
-			      const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
-			      GNUNET_NAMESTORE_RecordIterator iter,
-                              void *iter_cls)
+get_records_and_call_iterator (struct Plugin *plugin,
+                               sqlite3_stmt *stmt,
+                               const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                               uint64_t limit,
+                               GNUNET_NAMESTORE_RecordIterator iter,
+                               void *iter_cls)
 {
-  uint32_t record_count;
-  size_t data_size;
-  void *data;
-  char *label;
-  struct GNUNET_CRYPTO_EcdsaPrivateKey zk;
+  uint64_t i;
   int ret;
   int sret;
 
-  ret = GNUNET_NO;
-  if (SQLITE_ROW == (sret = sqlite3_step (stmt)))
+  ret = GNUNET_OK;
+  for (i = 0; i < limit; i++)
   {
-    struct GNUNET_SQ_ResultSpec rs[] = {
-      GNUNET_SQ_result_spec_uint32 (&record_count),
-      GNUNET_SQ_result_spec_variable_size (&data, &data_size),
-      GNUNET_SQ_result_spec_string (&label),
-      GNUNET_SQ_result_spec_end
-    };
-    struct GNUNET_SQ_ResultSpec rsx[] = {
-      GNUNET_SQ_result_spec_uint32 (&record_count),
-      GNUNET_SQ_result_spec_variable_size (&data, &data_size),
-      GNUNET_SQ_result_spec_string (&label),
-      GNUNET_SQ_result_spec_auto_from_type (&zk),
-      GNUNET_SQ_result_spec_end
-    };
-
-    if (NULL == zone_key)
-    {
-      zone_key = &zk;
-      ret = GNUNET_SQ_extract_result (stmt,
-                                      rsx);
-    }
-    else
+    sret = sqlite3_step (stmt);
+    if (SQLITE_DONE == sret)
     {
-      ret = GNUNET_SQ_extract_result (stmt,
-                                      rs);
+      if (0 == i)
+        ret = GNUNET_NO;
+      break;
     }
-    if ( (GNUNET_OK != ret) ||
-         (record_count > 64 * 1024) )
+    if (SQLITE_ROW != sret)
     {
-      /* sanity check, don't stack allocate far too much just
-	 because database might contain a large value here */
-      GNUNET_break (0);
+      LOG_SQLITE (plugin,
+                  GNUNET_ERROR_TYPE_ERROR,
+                  "sqlite_step");
       ret = GNUNET_SYSERR;
+      break;
     }
-    else
     {
-      struct GNUNET_GNSRECORD_Data rd[record_count];
+      uint64_t seq;
+      uint32_t record_count;
+      size_t data_size;
+      void *data;
+      char *label;
+      struct GNUNET_CRYPTO_EcdsaPrivateKey zk;
+      struct GNUNET_SQ_ResultSpec rs[] = {
+        GNUNET_SQ_result_spec_uint64 (&seq),
+        GNUNET_SQ_result_spec_uint32 (&record_count),
+        GNUNET_SQ_result_spec_variable_size (&data, &data_size),
+        GNUNET_SQ_result_spec_string (&label),
+        GNUNET_SQ_result_spec_end
+      };
+      struct GNUNET_SQ_ResultSpec rsx[] = {
+        GNUNET_SQ_result_spec_uint64 (&seq),
+        GNUNET_SQ_result_spec_uint32 (&record_count),
+        GNUNET_SQ_result_spec_variable_size (&data, &data_size),
+        GNUNET_SQ_result_spec_string (&label),
+        GNUNET_SQ_result_spec_auto_from_type (&zk),
+        GNUNET_SQ_result_spec_end
+      };
+      int eret;
 
-      if (GNUNET_OK !=
-	  GNUNET_GNSRECORD_records_deserialize (data_size,
-                                                data,
-						record_count,
-                                                rd))
+      eret = GNUNET_SQ_extract_result (stmt,
+                                       (NULL == zone_key) ? rsx : rs);
+      if ( (GNUNET_OK != eret) ||
+           (record_count > 64 * 1024) )
       {
-	GNUNET_break (0);
-	ret = GNUNET_SYSERR;
+        /* sanity check, don't stack allocate far too much just
+           because database might contain a large value here */
+        GNUNET_break (0);
+        ret = GNUNET_SYSERR;
+        if (GNUNET_OK == eret)
+          GNUNET_SQ_cleanup_result (rs);
+        break;
       }
-      else
       {
-      	if (NULL != iter)
+        struct GNUNET_GNSRECORD_Data rd[record_count];
+
+        if (GNUNET_OK !=
+            GNUNET_GNSRECORD_records_deserialize (data_size,
+                                                  data,
+                                                  record_count,
+                                                  rd))
+        {
+          GNUNET_break (0);
+          ret = GNUNET_SYSERR;
+        }
+        else if (NULL != iter)
+        {
           iter (iter_cls,
-                zone_key,
+                seq,
+                (NULL == zone_key) ? &zk : zone_key,
                 label,
                 record_count,
                 rd);
-	ret = GNUNET_YES;
+        }
       }
+      GNUNET_SQ_cleanup_result (rs);
+      if (GNUNET_SYSERR == ret)
+        break;
     }
-    GNUNET_SQ_cleanup_result (rs);
-  }
-  else
-  {
-    if (SQLITE_DONE != sret)
-      LOG_SQLITE (plugin,
-                  GNUNET_ERROR_TYPE_ERROR,
-                  "sqlite_step");
   }
   GNUNET_SQ_reset (plugin->dbh,
                    stmt);
@@ -654,29 +728,32 @@ namestore_sqlite_lookup_records (void *cls,
                      plugin->lookup_label);
     return GNUNET_SYSERR;
   }
-  return get_record_and_call_iterator (plugin,
-                                       plugin->lookup_label,
-                                       zone,
-                                       iter,
-                                       iter_cls);
+  return get_records_and_call_iterator (plugin,
+                                        plugin->lookup_label,
+                                        zone,
+                                        1,
+                                        iter,
+                                        iter_cls);
 }
 
 
 /**
  * Iterate over the results for a particular key and zone in the
- * datastore.  Will return at most one result to the iterator.
+ * datastore.  Will return at most @a limit results to the iterator.
  *
  * @param cls closure (internal context for the plugin)
  * @param zone hash of public key of the zone, NULL to iterate over all zones
- * @param offset offset in the list of all matching records
+ * @param serial serial number to exclude in the list of all matching records
+ * @param limit maximum number of results to return
  * @param iter function to call with the result
  * @param iter_cls closure for @a iter
- * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
+ * @return #GNUNET_OK on success, #GNUNET_NO if there were no more results, #GNUNET_SYSERR on error
  */
 static int
 namestore_sqlite_iterate_records (void *cls,
 				  const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
-				  uint64_t offset,
+				  uint64_t serial,
+                                  uint64_t limit,
 				  GNUNET_NAMESTORE_RecordIterator iter,
                                   void *iter_cls)
 {
@@ -687,7 +764,8 @@ namestore_sqlite_iterate_records (void *cls,
   if (NULL == zone)
   {
     struct GNUNET_SQ_QueryParam params[] = {
-      GNUNET_SQ_query_param_uint64 (&offset),
+      GNUNET_SQ_query_param_uint64 (&serial),
+      GNUNET_SQ_query_param_uint64 (&limit),
       GNUNET_SQ_query_param_end
     };
 
@@ -699,7 +777,8 @@ namestore_sqlite_iterate_records (void *cls,
   {
     struct GNUNET_SQ_QueryParam params[] = {
       GNUNET_SQ_query_param_auto_from_type (zone),
-      GNUNET_SQ_query_param_uint64 (&offset),
+      GNUNET_SQ_query_param_uint64 (&serial),
+      GNUNET_SQ_query_param_uint64 (&limit),
       GNUNET_SQ_query_param_end
     };
 
@@ -716,11 +795,12 @@ namestore_sqlite_iterate_records (void *cls,
                      stmt);
     return GNUNET_SYSERR;
   }
-  return get_record_and_call_iterator (plugin,
-                                       stmt,
-                                       zone,
-                                       iter,
-                                       iter_cls);
+  return get_records_and_call_iterator (plugin,
+                                        stmt,
+                                        zone,
+                                        limit,
+                                        iter,
+                                        iter_cls);
 }
 
 
@@ -762,11 +842,12 @@ namestore_sqlite_zone_to_name (void *cls,
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Performing reverse lookup for `%s'\n",
        GNUNET_GNSRECORD_z2s (value_zone));
-  return get_record_and_call_iterator (plugin,
-                                       plugin->zone_to_name,
-                                       zone,
-                                       iter,
-                                       iter_cls);
+  return get_records_and_call_iterator (plugin,
+                                        plugin->zone_to_name,
+                                        zone,
+                                        1,
+                                        iter,
+                                        iter_cls);
 }
 
 
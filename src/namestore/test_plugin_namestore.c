@@ -25,6 +25,7 @@
 #include "platform.h"
 #include "gnunet_util_lib.h"
 #include "gnunet_namestore_plugin.h"
+#include "gnunet_gnsrecord_lib.h"
 #include "gnunet_testing_lib.h"
 
 
@@ -35,6 +36,36 @@ static int ok;
  */
 static const char *plugin_name;
 
+/**
+ * Plugin we wait for to finish compacting.
+ */
+static struct GNUNET_NAMESTORE_PluginFunctions *compaction_nsp;
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *compaction_cfg;
+
+/**
+ * Serial number of the last record returned by the iteration.
+ */
+static uint64_t iter_serial;
+
+/**
+ * Number of records returned by the iteration.
+ */
+static unsigned int iter_count;
+
+/**
+ * Label of the last record returned by the iteration.
+ */
+static int iter_last;
+
+/**
+ * Labels returned by the iteration.
+ */
+static int iter_seen[100];
+
 
 /**
  * Function called when the service shuts down.  Unloads our namestore
@@ -81,6 +112,7 @@ load_plugin (const struct GNUNET_CONFIGURATION_Handle *cfg)
 
 static void
 test_record (void *cls,
+						 uint64_t serial,
 						 const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
 						 const char *label,
 						 unsigned int rd_count,
@@ -112,7 +144,129 @@ static void
 get_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp, int id)
 {
   GNUNET_assert (GNUNET_OK == nsp->iterate_records (nsp->cls,
-					    NULL, 0, &test_record, &id));
+					    NULL, 0, 1, &test_record, &id));
+}
+
+
+/**
+ * Check a record returned by the iteration and remember its label.
+ *
+ * @param cls NULL
+ * @param serial serial number of the record
+ * @param private_key zone of the record
+ * @param label label of the record
+ * @param rd_count number of entries in @a rd
+ * @param rd the records
+ */
+static void
+iterate_record (void *cls,
+                uint64_t serial,
+                const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
+                const char *label,
+                unsigned int rd_count,
+                const struct GNUNET_GNSRECORD_Data *rd)
+{
+  int id;
+
+  if ( (serial <= iter_serial) ||
+       (1 != sscanf (label, "a%d", &id)) ||
+       (id <= 0) ||
+       (id >= 100) ||
+       (iter_seen[id]) )
+  {
+    FPRINTF (stderr,
+             "Unexpected record `%s' with serial %llu in iteration\n",
+             label,
+             (unsigned long long) serial);
+    ok = 1;
+    return;
+  }
+  test_record (&id,
+               serial,
+               private_key,
+               label,
+               rd_count,
+               rd);
+  iter_seen[id] = GNUNET_YES;
+  iter_serial = serial;
+  iter_last = id;
+  iter_count++;
+}
+
+
+/**
+ * Iterate over all records in small batches and check that we get
+ * every label exactly once.
+ *
+ * @param nsp plugin to iterate
+ * @param expected number of labels in the database
+ * @param last label that was stored last
+ */
+static void
+check_iteration (struct GNUNET_NAMESTORE_PluginFunctions *nsp,
+                 unsigned int expected,
+                 int last)
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone_private_key;
+  unsigned int before;
+  int ret;
+
+  iter_serial = 0;
+  iter_count = 0;
+  iter_last = 0;
+  memset (iter_seen, 0, sizeof (iter_seen));
+  do
+  {
+    before = iter_count;
+    ret = nsp->iterate_records (nsp->cls,
+                                NULL,
+                                iter_serial,
+                                7,
+                                &iterate_record,
+                                NULL);
+    GNUNET_assert (GNUNET_SYSERR != ret);
+    GNUNET_assert ( (GNUNET_NO == ret) ||
+                    (iter_count > before) );
+    GNUNET_assert (iter_count - before <= 7);
+  } while (GNUNET_OK == ret);
+  if ( (expected != iter_count) ||
+       (last != iter_last) )
+  {
+    FPRINTF (stderr,
+             "Iteration returned %u records ending with a%d, expected %u ending with a%d\n",
+             iter_count,
+             iter_last,
+             expected,
+             last);
+    ok = 1;
+  }
+  /* a zone with exactly one label */
+  memset (&zone_private_key, (last % 241), sizeof (zone_private_key));
+  iter_serial = 0;
+  iter_count = 0;
+  memset (iter_seen, 0, sizeof (iter_seen));
+  GNUNET_assert (GNUNET_OK ==
+                 nsp->iterate_records (nsp->cls,
+                                       &zone_private_key,
+                                       0,
+                                       100,
+                                       &iterate_record,
+                                       NULL));
+  GNUNET_assert (GNUNET_NO ==
+                 nsp->iterate_records (nsp->cls,
+                                       &zone_private_key,
+                                       iter_serial,
+                                       100,
+                                       &iterate_record,
+                                       NULL));
+  if ( (1 != iter_count) ||
+       (last != iter_last) )
+  {
+    FPRINTF (stderr,
+             "Zone iteration returned %u records\n",
+             iter_count);
+    ok = 1;
+  }
 }
 
 
@@ -146,11 +300,230 @@ put_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp, int id)
 }
 
 
+static void
+lookup_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp,
+               int id,
+               int expected)
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone_private_key;
+  char label[64];
+
+  GNUNET_snprintf (label, sizeof (label),
+		   "a%u", (unsigned int ) id);
+  memset (&zone_private_key, (id % 241), sizeof (zone_private_key));
+  if (expected !=
+      nsp->lookup_records (nsp->cls,
+                           &zone_private_key,
+                           label,
+                           &test_record,
+                           &id))
+  {
+    FPRINTF (stderr,
+             "Unexpected lookup result for label `%s'\n",
+             label);
+    ok = 1;
+  }
+}
+
+
+static void
+remove_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp, int id)
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone_private_key;
+  char label[64];
+
+  GNUNET_snprintf (label, sizeof (label),
+		   "a%u", (unsigned int ) id);
+  memset (&zone_private_key, (id % 241), sizeof (zone_private_key));
+  GNUNET_assert (GNUNET_OK == nsp->store_records (nsp->cls,
+						&zone_private_key,
+						label,
+						0,
+						NULL));
+}
+
+
+/**
+ * Write a database in the text format used by older versions of the
+ * flat plugin, containing the record with the given @a id.
+ *
+ * @param cfg configuration with the database filename
+ * @param id record to store
+ */
+static void
+write_legacy_flat (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                   int id)
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone_private_key;
+  unsigned int rd_count = 1 + (id % 1024);
+  struct GNUNET_GNSRECORD_Data rd[rd_count];
+  char *fn;
+  char *index_fn;
+  char *line;
+  char *zone_b64;
+  char *rd_b64;
+  size_t data_size;
+  unsigned int i;
+
+  for (i=0;i<rd_count;i++)
+  {
+    rd[i].data = "Hello World";
+    rd[i].data_size = id % 10;
+    rd[i].expiration_time = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_MINUTES).abs_value_us;
+    rd[i].record_type = 1 + (id % 13);
+    rd[i].flags = 0;
+  }
+  memset (&zone_private_key, (id % 241), sizeof (zone_private_key));
+  data_size = GNUNET_GNSRECORD_records_get_size (rd_count, rd);
+  {
+    char data[data_size];
+
+    GNUNET_assert (data_size ==
+                   GNUNET_GNSRECORD_records_serialize (rd_count,
+                                                       rd,
+                                                       data_size,
+                                                       data));
+    GNUNET_STRINGS_base64_encode (data,
+                                  data_size,
+                                  &rd_b64);
+  }
+  GNUNET_STRINGS_base64_encode ((const char *) &zone_private_key,
+                                sizeof (zone_private_key),
+                                &zone_b64);
+  GNUNET_asprintf (&line,
+                   "%s,%lu,%u,%s,a%u\n",
+                   zone_b64,
+                   42LU,
+                   rd_count,
+                   rd_b64,
+                   (unsigned int) id);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                          "namestore-flat",
+                                                          "FILENAME",
+                                                          &fn));
+  GNUNET_assert (strlen (line) ==
+                 GNUNET_DISK_fn_write (fn,
+                                       line,
+                                       strlen (line),
+                                       GNUNET_DISK_PERM_USER_READ |
+                                       GNUNET_DISK_PERM_USER_WRITE));
+  GNUNET_asprintf (&index_fn,
+                   "%s.idx",
+                   fn);
+  (void) UNLINK (index_fn);
+  GNUNET_free (index_fn);
+  GNUNET_free (fn);
+  GNUNET_free (line);
+  GNUNET_free (zone_b64);
+  GNUNET_free (rd_b64);
+}
+
+
+/**
+ * Wait for the flat plugin to compact its log, then check that all
+ * records survived.
+ *
+ * @param cls NULL
+ */
+static void
+check_compaction (void *cls)
+{
+  static unsigned int attempts;
+  char *fn;
+  uint64_t size;
+  int i;
+
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (compaction_cfg,
+                                                          "namestore-flat",
+                                                          "FILENAME",
+                                                          &fn));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_DISK_file_size (fn,
+                                        &size,
+                                        GNUNET_YES,
+                                        GNUNET_YES));
+  GNUNET_free (fn);
+  if ( (size > 1024 * 1024) &&
+       (attempts++ < 100) )
+  {
+    GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                                                 50),
+                                  &check_compaction,
+                                  NULL);
+    return;
+  }
+  if (size > 1024 * 1024)
+  {
+    FPRINTF (stderr,
+             "Log was not compacted, still %llu bytes\n",
+             (unsigned long long) size);
+    ok = 1;
+  }
+  for (i = 1; i < 100; i++)
+    lookup_record (compaction_nsp, i, GNUNET_YES);
+  check_iteration (compaction_nsp, 99, 99);
+  unload_plugin (compaction_nsp);
+  compaction_nsp = load_plugin (compaction_cfg);
+  GNUNET_assert (NULL != compaction_nsp);
+  for (i = 1; i < 100; i++)
+    lookup_record (compaction_nsp, i, GNUNET_YES);
+  lookup_record (compaction_nsp, 42, GNUNET_YES);
+  check_iteration (compaction_nsp, 99, 99);
+  unload_plugin (compaction_nsp);
+}
+
+
+/**
+ * Remove the label stored last and store it again.  Its new serial
+ * must be higher than the old one, so that an iteration continuing
+ * after the old serial sees it.
+ *
+ * @param nsp plugin to use
+ * @param last label that was stored last
+ */
+static void
+check_restore_serial (struct GNUNET_NAMESTORE_PluginFunctions *nsp,
+                      int last)
+{
+  uint64_t serial;
+
+  /* set by the last iteration over the zone of @a last */
+  serial = iter_serial;
+  remove_record (nsp, last);
+  put_record (nsp, last);
+  iter_serial = serial;
+  iter_count = 0;
+  iter_last = 0;
+  memset (iter_seen, 0, sizeof (iter_seen));
+  GNUNET_assert (GNUNET_SYSERR !=
+                 nsp->iterate_records (nsp->cls,
+                                       NULL,
+                                       serial,
+                                       100,
+                                       &iterate_record,
+                                       NULL));
+  if ( (1 != iter_count) ||
+       (last != iter_last) )
+  {
+    FPRINTF (stderr,
+             "Iteration after serial %llu returned %u records, expected a%d again\n",
+             (unsigned long long) serial,
+             iter_count,
+             last);
+    ok = 1;
+  }
+}
+
+
 static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
 {
   struct GNUNET_NAMESTORE_PluginFunctions *nsp;
+  unsigned int round;
+  int i;
 
   ok = 0;
   nsp = load_plugin (cfg);
@@ -163,8 +536,45 @@ run (void *cls, char *const *args, const char *cfgfile,
   }
   put_record (nsp, 1);
   get_record (nsp, 1);
+  for (i = 2; i < 100; i++)
+    put_record (nsp, i);
+  put_record (nsp, 7);
+  remove_record (nsp, 5);
+  lookup_record (nsp, 7, GNUNET_YES);
+  lookup_record (nsp, 5, GNUNET_NO);
+  check_iteration (nsp, 98, 7);
+  check_restore_serial (nsp, 7);
+  unload_plugin (nsp);
+  if (0 == strcmp (plugin_name, "postgres"))
+    return; /* uses a temporary table */
 
+  /* everything must survive reloading the database */
+  nsp = load_plugin (cfg);
+  GNUNET_assert (NULL != nsp);
+  for (i = 1; i < 100; i++)
+    lookup_record (nsp, i, (5 == i) ? GNUNET_NO : GNUNET_YES);
+  check_iteration (nsp, 98, 7);
   unload_plugin (nsp);
+  if (0 != strcmp (plugin_name, "flat"))
+    return;
+
+  /* databases in the old text format must be converted */
+  write_legacy_flat (cfg, 42);
+  nsp = load_plugin (cfg);
+  GNUNET_assert (NULL != nsp);
+  lookup_record (nsp, 42, GNUNET_YES);
+  lookup_record (nsp, 1, GNUNET_NO);
+
+  /* overwrite labels until most of the log is garbage, the plugin
+     must then compact it in the background */
+  for (round = 0; round < 10; round++)
+    for (i = 1; i < 100; i++)
+      put_record (nsp, i);
+  compaction_nsp = nsp;
+  compaction_cfg = cfg;
+  GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MILLISECONDS,
+                                &check_compaction,
+                                NULL);
 }
 
 
@@ -182,7 +592,7 @@ main (int argc, char *argv[])
     GNUNET_GETOPT_OPTION_END
   };
 
-  //GNUNET_DISK_directory_remove ("/tmp/gnunet-test-plugin-namestore-sqlite");
+  GNUNET_DISK_directory_remove ("/tmp/gnunet-test-plugin-namestore-sqlite");
   GNUNET_log_setup ("test-plugin-namestore",
                     "WARNING",
                     NULL);
@@ -193,7 +603,7 @@ main (int argc, char *argv[])
                       "test-plugin-namestore", "nohelp", options, &run, NULL);
   if (ok != 0)
     FPRINTF (stderr, "Missed some testcases: %d\n", ok);
-  //GNUNET_DISK_directory_remove ("/tmp/gnunet-test-plugin-namestore-sqlite");
+  GNUNET_DISK_directory_remove ("/tmp/gnunet-test-plugin-namestore-sqlite");
   return ok;
 }
 
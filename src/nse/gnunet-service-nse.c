@@ -48,7 +48,6 @@
 #include "gnunet_testbed_logger_service.h"
 #endif
 #include "nse.h"
-#include <gcrypt.h>
 
 
 
@@ -73,6 +72,11 @@
  */
 #define NSE_PRIORITY GNUNET_CORE_PRIO_CRITICAL_CONTROL
 
+/**
+ * Salt for our proof of work.
+ */
+#define NSE_POW_SALT "gnunet-proof-of-work"
+
 #if FREEBSD
 #define log2(a) (log(a)/log(2))
 #endif
@@ -92,6 +96,11 @@ static struct GNUNET_TIME_Relative gnunet_nse_interval;
  */
 static struct GNUNET_TIME_Relative proof_find_delay;
 
+/**
+ * Number of threads to use for finding our proof, 0 for all CPUs.
+ */
+static unsigned long long proof_find_threads;
+
 #if ENABLE_NSE_HISTOGRAM
 
 /**
@@ -279,9 +288,9 @@ static unsigned int estimate_count;
 static struct GNUNET_SCHEDULER_Task *flood_task;
 
 /**
- * Task scheduled to compute our proof.
+ * Search for our proof, NULL if we have it.
  */
-static struct GNUNET_SCHEDULER_Task *proof_task;
+static struct GNUNET_CRYPTO_PowSearch *proof_search;
 
 /**
  * Notification context, simplifies client broadcasts.
@@ -493,30 +502,6 @@ get_delay_randomization (uint32_t matching_bits)
 }
 
 
-/**
- * Calculate the 'proof-of-work' hash (an expensive hash).
- *
- * @param buf data to hash
- * @param buf_len number of bytes in @a buf
- * @param result where to write the resulting hash
- */
-static void
-pow_hash (const void *buf,
-	  size_t buf_len,
-	  struct GNUNET_HashCode *result)
-{
-  GNUNET_break (0 ==
-		gcry_kdf_derive (buf, buf_len,
-				 GCRY_KDF_SCRYPT,
-				 1 /* subalgo */,
-				 "gnunet-proof-of-work",
-				 strlen ("gnunet-proof-of-work"),
-				 2 /* iterations; keep cost of individual op small */,
-				 sizeof (struct GNUNET_HashCode),
-				 result));
-}
-
-
 /**
  * Get the number of matching bits that the given timestamp has to the given peer ID.
  *
@@ -620,7 +605,7 @@ transmit_task_cb (void *cls)
 				      peer_entry);
   }
   if ((0 == ntohl (size_estimate_messages[idx].hop_count)) &&
-      (NULL != proof_task))
+      (NULL != proof_search))
   {
     GNUNET_STATISTICS_update (stats,
                               "# flood messages not generated (no proof yet)",
@@ -818,25 +803,6 @@ update_flood_message (void *cls)
 }
 
 
-/**
- * Count the leading zeroes in hash.
- *
- * @param hash to count leading zeros in
- * @return the number of leading zero bits.
- */
-static unsigned int
-count_leading_zeroes (const struct GNUNET_HashCode *hash)
-{
-  unsigned int hash_count;
-
-  hash_count = 0;
-  while (0 == GNUNET_CRYPTO_hash_get_bit (hash,
-					  hash_count))
-    hash_count++;
-  return hash_count;
-}
-
-
 /**
  * Check whether the given public key and integer are a valid proof of
  * work.
@@ -849,21 +815,11 @@ static int
 check_proof_of_work (const struct GNUNET_CRYPTO_EddsaPublicKey *pkey,
                      uint64_t val)
 {
-  char buf[sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
-           sizeof (val)] GNUNET_ALIGN;
-  struct GNUNET_HashCode result;
-
-  GNUNET_memcpy (buf,
-		 &val,
-		 sizeof (val));
-  GNUNET_memcpy (&buf[sizeof (val)],
-		 pkey,
-		 sizeof (struct GNUNET_CRYPTO_EddsaPublicKey));
-  pow_hash (buf,
-	    sizeof (buf),
-	    &result);
-  return (count_leading_zeroes (&result) >=
-          nse_work_required) ? GNUNET_YES : GNUNET_NO;
+  return GNUNET_CRYPTO_pow_check (NSE_POW_SALT,
+                                  pkey,
+                                  sizeof (struct GNUNET_CRYPTO_EddsaPublicKey),
+                                  val,
+                                  (unsigned int) nse_work_required);
 }
 
 
@@ -895,58 +851,45 @@ write_proof ()
 
 
 /**
- * Find our proof of work.
+ * The proof-of-work search made progress, remember it.
  *
  * @param cls closure (unused)
+ * @param checkpoint all values below have been tested
  */
 static void
-find_proof (void *cls)
+proof_progress (void *cls,
+                uint64_t checkpoint)
 {
-#define ROUND_SIZE 10
-  uint64_t counter;
-  char buf[sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
-           sizeof (uint64_t)] GNUNET_ALIGN;
-  struct GNUNET_HashCode result;
-  unsigned int i;
-
-  proof_task = NULL;
-  GNUNET_memcpy (&buf[sizeof (uint64_t)], &my_identity,
-          sizeof (struct GNUNET_PeerIdentity));
-  i = 0;
-  counter = my_proof;
-  while ((counter != UINT64_MAX) && (i < ROUND_SIZE))
-  {
-    GNUNET_memcpy (buf, &counter, sizeof (uint64_t));
-    pow_hash (buf, sizeof (buf), &result);
-    if (nse_work_required <= count_leading_zeroes (&result))
-    {
-      my_proof = counter;
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Proof of work found: %llu!\n",
-                  (unsigned long long) GNUNET_ntohll (counter));
-      write_proof ();
-      setup_flood_message (estimate_index, current_timestamp);
-      return;
-    }
-    counter++;
-    i++;
-  }
-  if (my_proof / (100 * ROUND_SIZE) < counter / (100 * ROUND_SIZE))
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Testing proofs currently at %llu\n",
+              (unsigned long long) checkpoint);
+  /* only write to disk about every 1000 values */
+  if (my_proof / 1000 < checkpoint / 1000)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Testing proofs currently at %llu\n",
-                (unsigned long long) counter);
-    /* remember progress every 100 rounds */
-    my_proof = counter;
+    my_proof = checkpoint;
     write_proof ();
   }
-  else
-  {
-    my_proof = counter;
-  }
-  proof_task =
-      GNUNET_SCHEDULER_add_delayed_with_priority (proof_find_delay,
-						  GNUNET_SCHEDULER_PRIORITY_IDLE,
-						  &find_proof, NULL);
+}
+
+
+/**
+ * We found our proof of work.
+ *
+ * @param cls closure (unused)
+ * @param proof the proof
+ */
+static void
+proof_found (void *cls,
+             uint64_t proof)
+{
+  proof_search = NULL;
+  my_proof = proof;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Proof of work found: %llu!\n",
+              (unsigned long long) GNUNET_ntohll (proof));
+  write_proof ();
+  setup_flood_message (estimate_index,
+                       current_timestamp);
 }
 
 
@@ -1332,10 +1275,10 @@ shutdown_task (void *cls)
     GNUNET_SCHEDULER_cancel (flood_task);
     flood_task = NULL;
   }
-  if (NULL != proof_task)
+  if (NULL != proof_search)
   {
-    GNUNET_SCHEDULER_cancel (proof_task);
-    proof_task = NULL;
+    my_proof = GNUNET_CRYPTO_pow_search_stop (proof_search);
+    proof_search = NULL;
     write_proof ();             /* remember progress */
   }
   if (NULL != nc)
@@ -1514,6 +1457,12 @@ run (void *cls,
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "NSE",
+                                             "WORKTHREADS",
+                                             &proof_find_threads))
+    proof_find_threads = 0;
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_number (cfg,
 					     "NSE",
@@ -1596,10 +1545,17 @@ run (void *cls,
 			    sizeof (my_proof))))
     my_proof = 0;
   GNUNET_free (proof);
-  proof_task =
-      GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
-                                          &find_proof,
-					  NULL);
+  proof_search
+    = GNUNET_CRYPTO_pow_search_start (NSE_POW_SALT,
+                                      &my_identity.public_key,
+                                      sizeof (struct GNUNET_CRYPTO_EddsaPublicKey),
+                                      my_proof,
+                                      (unsigned int) nse_work_required,
+                                      (unsigned int) proof_find_threads,
+                                      proof_find_delay,
+                                      &proof_progress,
+                                      &proof_found,
+                                      NULL);
 
   peers = GNUNET_CONTAINER_multipeermap_create (128,
 						GNUNET_YES);
@@ -34,17 +34,71 @@
 #include "gnunet_protocols.h"
 #include "gnunet_statistics_service.h"
 #include "peerinfo.h"
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 /**
  * How often do we scan the HOST_DIR for new entries?
  */
 #define DATA_HOST_FREQ GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 15)
 
+/**
+ * How often do we scan the HOST_DIR for new entries if we are
+ * notified about changed files?  Only to catch changes the
+ * notifications missed (i.e. on network file systems).
+ */
+#define DATA_HOST_WATCHED_FREQ GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_HOURS, 6)
+
 /**
  * How often do we discard old entries in data/hosts/?
  */
 #define DATA_HOST_CLEAN_FREQ GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 60)
 
+/**
+ * How many bytes of outdated records do we allow in the packed
+ * HELLO store (in addition to as many as there are current ones)
+ * before we compact it?
+ */
+#define PACK_MIN_GARBAGE (1024 * 1024)
+
+/**
+ * Size of a record in the packed HELLO store with @a hs bytes
+ * of HELLOs.
+ */
+#define PACK_RECORD_SIZE(hs) (sizeof (struct PackedHelloHeader) + (((hs) + 7) & ~((size_t) 7)))
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a record in the packed HELLO store.  Followed by the
+ * HELLOs of the peer (as in a file in the HOSTS directory) and by
+ * padding to a multiple of 8 bytes, so that all HELLOs are aligned
+ * when the store is mapped into memory.  For each peer, the last
+ * record in the store is the current one; a record without HELLOs
+ * removes the HELLOs of the peer.
+ */
+struct PackedHelloHeader
+{
+  /**
+   * Number of bytes of HELLOs following, in NBO.
+   */
+  uint32_t size GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * Identity of the peer.
+   */
+  struct GNUNET_PeerIdentity peer;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
 
 /**
  * In-memory cache of known hosts.
@@ -67,6 +121,28 @@ struct HostEntry
    */
   struct GNUNET_HELLO_Message *friend_only_hello;
 
+  /**
+   * Inode of the file of the peer as we last wrote it.
+   */
+  ino_t own_ino;
+
+  /**
+   * Modification time of the file of the peer as we last wrote it.
+   */
+  time_t own_mtime;
+
+  /**
+   * Size of the file of the peer as we last wrote it, 0 if we did
+   * not write it.
+   */
+  off_t own_size;
+
+  /**
+   * Size of the current record of the peer in the packed HELLO
+   * store, 0 for none.
+   */
+  size_t pack_len;
+
 };
 
 
@@ -124,6 +200,49 @@ static struct GNUNET_SCHEDULER_Task *cron_clean;
  */
 static struct GNUNET_SCHEDULER_Task *cron_scan;
 
+/**
+ * inotify handle notifying us about changed files in
+ * #networkIdDirectory, NULL if not available.
+ */
+static struct GNUNET_DISK_FileHandle *watch_fh;
+
+/**
+ * Task reading from #watch_fh.
+ */
+static struct GNUNET_SCHEDULER_Task *watch_task;
+
+/**
+ * Name of the packed HELLO store, NULL to store one file
+ * per peer in #networkIdDirectory.
+ */
+static char *pack_filename;
+
+/**
+ * Packed HELLO store, opened for appending.
+ */
+static struct GNUNET_DISK_FileHandle *pack_fh;
+
+/**
+ * Size of the packed HELLO store.
+ */
+static uint64_t pack_size;
+
+/**
+ * Number of bytes of current records in the packed HELLO store.
+ */
+static uint64_t pack_live;
+
+/**
+ * Task to run #pack_compact().
+ */
+static struct GNUNET_SCHEDULER_Task *pack_compact_task;
+
+/**
+ * #GNUNET_YES while we load the packed HELLO store, so there is no
+ * need to store the HELLOs we find.
+ */
+static int pack_loading;
+
 
 /**
  * Notify all clients in the notify list about the
@@ -210,14 +329,16 @@ count_addresses (void *cls,
  * for the given host and protocol.
  *
  * @param id peer for which we need the filename for the HELLO
- * @return filename of the form DIRECTORY/HOSTID
+ * @return filename of the form DIRECTORY/HOSTID, NULL if we
+ *         do not store HELLOs in files
  */
 static char *
 get_host_filename (const struct GNUNET_PeerIdentity *id)
 {
   char *fn;
 
-  if (NULL == networkIdDirectory)
+  if ( (NULL == networkIdDirectory) ||
+       (NULL != pack_filename) )
     return NULL;
   GNUNET_asprintf (&fn,
                    "%s%s%s",
@@ -270,23 +391,27 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
 
 
 /**
- * Try to read the HELLOs in the given filename and discard expired
- * addresses.  Removes the file if one the HELLO is malformed.  If all
- * addresses are expired, the HELLO is also removed (but the HELLO
- * with the public key is still returned if it was found and valid).
- * The file can contain multiple HELLO messages.
+ * Parse the HELLOs in the given buffer and discard expired addresses.
+ * If all addresses of a HELLO are expired, the HELLO is not returned.
+ * The buffer can contain multiple HELLO messages.
  *
- * @param fn name of the file
- * @param unlink_garbage if #GNUNET_YES, try to remove useless files
- * @param r ReadHostFileContext to store the resutl
+ * @param buffer the HELLOs, must be aligned
+ * @param size_total number of bytes in @a buffer
+ * @param source where the HELLOs come from, for logging
+ * @param[out] r ReadHostFileContext to store the result
+ * @param[out] valid set to the number of bytes of well-formed
+ *             HELLOs if the buffer is malformed
+ * @return #GNUNET_OK if the buffer is well-formed,
+ *         #GNUNET_NO if a HELLO has no addresses left,
+ *         #GNUNET_SYSERR if the buffer is malformed
  */
-static void
-read_host_file (const char *fn,
-                int unlink_garbage,
-                struct ReadHostFileContext *r)
+static int
+parse_hellos (const char *buffer,
+              size_t size_total,
+              const char *source,
+              struct ReadHostFileContext *r,
+              size_t *valid)
 {
-  char buffer[GNUNET_MAX_MESSAGE_SIZE - 1] GNUNET_ALIGN;
-  ssize_t size_total;
   struct GNUNET_TIME_Absolute now;
   unsigned int left;
   const struct GNUNET_HELLO_Message *hello;
@@ -296,62 +421,22 @@ read_host_file (const char *fn,
 
   r->friend_only_hello = NULL;
   r->hello = NULL;
-
-  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
-    return;
-  size_total = GNUNET_DISK_fn_read (fn,
-                                    buffer,
-                                    sizeof (buffer));
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Read %d bytes from `%s'\n",
-              (int) size_total,
-              fn);
-  if ( (size_total < 0) ||
-       (((size_t) size_total) < sizeof (struct GNUNET_MessageHeader)) )
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		_("Failed to parse HELLO in file `%s': %s\n"),
-		fn,
-                "File has invalid size");
-    if ( (GNUNET_YES == unlink_garbage) &&
-	 (0 != UNLINK (fn)) &&
-	 (ENOENT != errno) )
-      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                "unlink",
-                                fn);
-    return;
-  }
-
+  left = 0;
   read_pos = 0;
-  while (read_pos < (size_t) size_total)
+  while (read_pos < size_total)
   {
     hello = (const struct GNUNET_HELLO_Message *) &buffer[read_pos];
-    size_hello = GNUNET_HELLO_size (hello);
+    size_hello = (size_total - read_pos < sizeof (struct GNUNET_MessageHeader))
+      ? 0
+      : GNUNET_HELLO_size (hello);
     if ( (0 == size_hello) ||
-         (((size_t) size_total) - read_pos < size_hello) )
+         (size_total - read_pos < size_hello) )
     {
       GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                   _("Failed to parse HELLO in file `%s'\n"),
-                  fn);
-      if (0 == read_pos)
-      {
-        if ((GNUNET_YES == unlink_garbage) &&
-            (0 != UNLINK (fn)) &&
-            (ENOENT != errno) )
-          GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                    "unlink",
-                                    fn);
-      }
-      else
-      {
-        if ( (GNUNET_YES == unlink_garbage) &&
-             (0 != TRUNCATE (fn, read_pos)) &&
-             (ENOENT != errno) )
-          GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                    "truncate",
-                                    fn);
-      }
-      return;
+                  source);
+      *valid = read_pos;
+      return GNUNET_SYSERR;
     }
 
     now = GNUNET_TIME_absolute_get ();
@@ -363,14 +448,9 @@ read_host_file (const char *fn,
     {
       GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                   _("Failed to parse HELLO in file `%s'\n"),
-                  fn);
-      if ((GNUNET_YES == unlink_garbage) &&
-          (0 != UNLINK (fn)) &&
-          (ENOENT != errno) )
-        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                  "unlink",
-                                  fn);
-      return;
+                  source);
+      *valid = 0;
+      return GNUNET_SYSERR;
     }
     left = 0;
     (void) GNUNET_HELLO_iterate_addresses (hello_clean,
@@ -408,20 +488,99 @@ read_host_file (const char *fn,
     }
     read_pos += size_hello;
   }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Found `%s' and `%s' HELLO message in file\n",
+	      (NULL != r->hello) ? "public" : "NON-public",
+	      (NULL != r->friend_only_hello) ? "friend only" : "NO friend only");
+  return (0 == left) ? GNUNET_NO : GNUNET_OK;
+}
 
-  if (0 == left)
+
+/**
+ * Try to read the HELLOs in the given filename and discard expired
+ * addresses.  Removes the file if one the HELLO is malformed.  If all
+ * addresses are expired, the HELLO is also removed (but the HELLO
+ * with the public key is still returned if it was found and valid).
+ * The file can contain multiple HELLO messages.
+ *
+ * @param fn name of the file
+ * @param unlink_garbage if #GNUNET_YES, try to remove useless files
+ * @param r ReadHostFileContext to store the resutl
+ */
+static void
+read_host_file (const char *fn,
+                int unlink_garbage,
+                struct ReadHostFileContext *r)
+{
+  char buffer[GNUNET_MAX_MESSAGE_SIZE - 1] GNUNET_ALIGN;
+  ssize_t size_total;
+  size_t valid;
+
+  r->friend_only_hello = NULL;
+  r->hello = NULL;
+
+  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
+    return;
+  size_total = GNUNET_DISK_fn_read (fn,
+                                    buffer,
+                                    sizeof (buffer));
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Read %d bytes from `%s'\n",
+              (int) size_total,
+              fn);
+  if ( (size_total < 0) ||
+       (((size_t) size_total) < sizeof (struct GNUNET_MessageHeader)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Failed to parse HELLO in file `%s': %s\n"),
+		fn,
+                "File has invalid size");
+    if ( (GNUNET_YES == unlink_garbage) &&
+	 (0 != UNLINK (fn)) &&
+	 (ENOENT != errno) )
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                fn);
+    return;
+  }
+
+  switch (parse_hellos (buffer,
+                        size_total,
+                        fn,
+                        r,
+                        &valid))
   {
+  case GNUNET_OK:
+    break;
+  case GNUNET_NO:
     /* no addresses left, remove from disk */
     if ( (GNUNET_YES == unlink_garbage) &&
          (0 != UNLINK (fn)) )
       GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
                                 "unlink",
                                 fn);
+    break;
+  case GNUNET_SYSERR:
+    if (GNUNET_YES != unlink_garbage)
+      break;
+    if (0 == valid)
+    {
+      if ( (0 != UNLINK (fn)) &&
+           (ENOENT != errno) )
+        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                  "unlink",
+                                  fn);
+    }
+    else
+    {
+      if ( (0 != TRUNCATE (fn, valid)) &&
+           (ENOENT != errno) )
+        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                  "truncate",
+                                  fn);
+    }
+    break;
   }
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Found `%s' and `%s' HELLO message in file\n",
-	      (NULL != r->hello) ? "public" : "NON-public",
-	      (NULL != r->friend_only_hello) ? "friend only" : "NO friend only");
 }
 
 
@@ -519,6 +678,93 @@ struct DirScanContext
 };
 
 
+/**
+ * Remember the HELLOs we read for a peer.
+ *
+ * @param r the HELLOs, freed by this function
+ * @param expected identity the HELLOs must be for, NULL for any
+ * @param[out] id set to the identity of the peer
+ * @return #GNUNET_OK if we remembered the HELLOs,
+ *         #GNUNET_NO if there were none,
+ *         #GNUNET_SYSERR if they were invalid
+ */
+static int
+remember_hellos (struct ReadHostFileContext *r,
+                 const struct GNUNET_PeerIdentity *expected,
+                 struct GNUNET_PeerIdentity *id)
+{
+  struct GNUNET_PeerIdentity id_public;
+  struct GNUNET_PeerIdentity id_friend;
+  int ret;
+
+  if ( (NULL == r->hello) &&
+       (NULL == r->friend_only_hello))
+    return GNUNET_NO;
+  ret = GNUNET_OK;
+  if ( (NULL != r->friend_only_hello) &&
+       (GNUNET_OK !=
+        GNUNET_HELLO_get_id (r->friend_only_hello,
+                             &id_friend)) )
+    ret = GNUNET_SYSERR;
+  else if (NULL != r->friend_only_hello)
+    *id = id_friend;
+  if ( (NULL != r->hello) &&
+       (GNUNET_OK !=
+        GNUNET_HELLO_get_id (r->hello,
+                             &id_public)) )
+    ret = GNUNET_SYSERR;
+  else if (NULL != r->hello)
+    *id = id_public;
+  if ( (GNUNET_OK == ret) &&
+       (NULL != r->hello) &&
+       (NULL != r->friend_only_hello) &&
+       (0 != memcmp (&id_friend,
+                     &id_public,
+                     sizeof (id_friend))) )
+  {
+    /* HELLOs are not for the same peer */
+    GNUNET_break (0);
+    ret = GNUNET_SYSERR;
+  }
+  if ( (GNUNET_OK == ret) &&
+       (NULL != expected) &&
+       (0 != memcmp (id,
+                     expected,
+                     sizeof (struct GNUNET_PeerIdentity))) )
+  {
+    /* HELLOs are not for the same peer */
+    GNUNET_break (0);
+    ret = GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_free_non_null (r->hello);
+    GNUNET_free_non_null (r->friend_only_hello);
+    return ret;
+  }
+
+  /* ok, found something valid, remember HELLO */
+  add_host_to_known_hosts (id);
+  if (NULL != r->hello)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Updating peer `%s' public HELLO \n",
+		GNUNET_i2s (id));
+    update_hello (id, r->hello);
+    GNUNET_free (r->hello);
+  }
+  if (NULL != r->friend_only_hello)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Updating peer `%s' friend only HELLO \n",
+		GNUNET_i2s (id));
+    update_hello (id, r->friend_only_hello);
+    GNUNET_free (r->friend_only_hello);
+  }
+  return GNUNET_OK;
+}
+
+
 /**
  * Function that is called on each HELLO file in a particular directory.
  * Try to parse the file and add the HELLO to our list.
@@ -536,9 +782,8 @@ hosts_directory_scan_callback (void *cls,
   struct GNUNET_PeerIdentity identity;
   struct ReadHostFileContext r;
   const char *filename;
-  struct GNUNET_PeerIdentity id_public;
-  struct GNUNET_PeerIdentity id_friend;
   struct GNUNET_PeerIdentity id;
+  int ret;
 
   if (GNUNET_YES != GNUNET_DISK_file_test (fullname))
     return GNUNET_OK;           /* ignore non-files */
@@ -554,81 +799,97 @@ hosts_directory_scan_callback (void *cls,
   read_host_file (fullname,
                   dsc->remove_files,
                   &r);
-  if ( (NULL == r.hello) &&
-       (NULL == r.friend_only_hello))
-    return GNUNET_OK;
-  if (NULL != r.friend_only_hello)
-  {
-    if (GNUNET_OK !=
-        GNUNET_HELLO_get_id (r.friend_only_hello,
-                             &id_friend))
-    {
-      if (GNUNET_YES == dsc->remove_files)
-	remove_garbage (fullname);
-      return GNUNET_OK;
-    }
-    id = id_friend;
-  }
-  if (NULL != r.hello)
-  {
-    if (GNUNET_OK !=
-        GNUNET_HELLO_get_id (r.hello,
-                             &id_public))
-    {
-      if (GNUNET_YES == dsc->remove_files)
-	remove_garbage (fullname);
-      return GNUNET_OK;
-    }
-    id = id_public;
-  }
+  ret = remember_hellos (&r,
+                         (GNUNET_OK ==
+                          GNUNET_CRYPTO_eddsa_public_key_from_string (filename,
+                                                                      strlen (filename),
+                                                                      &identity.public_key))
+                         ? &identity
+                         : NULL,
+                         &id);
+  if ( (GNUNET_SYSERR == ret) &&
+       (GNUNET_YES == dsc->remove_files) )
+    remove_garbage (fullname);
+  if (GNUNET_OK == ret)
+    dsc->matched++;
+  return GNUNET_OK;
+}
 
-  if (  (NULL != r.hello) &&
-        (NULL != r.friend_only_hello) &&
-        (0 != memcmp (&id_friend,
-                      &id_public,
-                      sizeof (id_friend))) )
-  {
-    /* HELLOs are not for the same peer */
-    GNUNET_break (0);
-    if (GNUNET_YES == dsc->remove_files)
-      remove_garbage (fullname);
-    return GNUNET_OK;
-  }
-  if (GNUNET_OK ==
+
+/**
+ * Find the host entry for the peer a file in #networkIdDirectory
+ * is named after.
+ *
+ * @param filename name of the file, without the directory
+ * @return the entry, NULL if the file is not for a known peer
+ */
+static struct HostEntry *
+lookup_host_by_filename (const char *filename)
+{
+  struct GNUNET_PeerIdentity identity;
+
+  if (GNUNET_OK !=
       GNUNET_CRYPTO_eddsa_public_key_from_string (filename,
                                                   strlen (filename),
                                                   &identity.public_key))
-  {
-    if (0 != memcmp (&id, &identity, sizeof (id_friend)))
-    {
-      /* HELLOs are not for the same peer */
-      GNUNET_break (0);
-      if (GNUNET_YES == dsc->remove_files)
-	remove_garbage (fullname);
-      return GNUNET_OK;
-    }
-  }
+    return NULL;
+  return GNUNET_CONTAINER_multipeermap_get (hostmap,
+                                            &identity);
+}
 
-  /* ok, found something valid, remember HELLO */
-  add_host_to_known_hosts (&id);
-  if (NULL != r.hello)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Updating peer `%s' public HELLO \n",
-		GNUNET_i2s (&id));
-    update_hello (&id, r.hello);
-    GNUNET_free (r.hello);
-  }
-  if (NULL != r.friend_only_hello)
+
+/**
+ * We changed the file of @a host in #networkIdDirectory, ignore the
+ * notifications about it as long as the file stays as we wrote it.
+ * We cannot count our writes instead: the kernel may merge
+ * notifications, and someone else may write the file before we read
+ * the notification about our write.
+ *
+ * @param host the peer whose file we wrote
+ * @param fn name of the file
+ */
+static void
+note_own_write (struct HostEntry *host,
+                const char *fn)
+{
+  struct stat sbuf;
+
+  if ( (NULL == host) ||
+       (NULL == watch_fh) )
+    return;
+  if (0 != STAT (fn,
+                 &sbuf))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Updating peer `%s' friend only HELLO \n",
-		GNUNET_i2s (&id));
-    update_hello (&id, r.friend_only_hello);
-    GNUNET_free (r.friend_only_hello);
+    host->own_size = 0;
+    return;
   }
-  dsc->matched++;
-  return GNUNET_OK;
+  host->own_ino = sbuf.st_ino;
+  host->own_mtime = sbuf.st_mtime;
+  host->own_size = sbuf.st_size;
+}
+
+
+/**
+ * Check if the file of @a host in #networkIdDirectory is still the
+ * way we last wrote it.
+ *
+ * @param host the peer the file is for
+ * @param fn name of the file
+ * @return #GNUNET_YES if the file is as we wrote it
+ */
+static int
+is_own_write (const struct HostEntry *host,
+              const char *fn)
+{
+  struct stat sbuf;
+
+  if ( (0 == host->own_size) ||
+       (0 != STAT (fn,
+                   &sbuf)) )
+    return GNUNET_NO;
+  return ( (host->own_ino == sbuf.st_ino) &&
+           (host->own_mtime == sbuf.st_mtime) &&
+           (host->own_size == sbuf.st_size) ) ? GNUNET_YES : GNUNET_NO;
 }
 
 
@@ -666,13 +927,158 @@ cron_scan_directory_data_hosts (void *cls)
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
                 _("Still no peers found in `%s'!\n"),
                 networkIdDirectory);
-  cron_scan = GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_FREQ,
+  cron_scan = GNUNET_SCHEDULER_add_delayed_with_priority ((NULL != watch_fh)
+                                                          ? DATA_HOST_WATCHED_FREQ
+                                                          : DATA_HOST_FREQ,
 							  GNUNET_SCHEDULER_PRIORITY_IDLE,
 							  &cron_scan_directory_data_hosts,
 							  NULL);
 }
 
 
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Stop watching #networkIdDirectory for changes.
+ */
+static void
+stop_watching ()
+{
+  if (NULL != watch_task)
+  {
+    GNUNET_SCHEDULER_cancel (watch_task);
+    watch_task = NULL;
+  }
+  if (NULL != watch_fh)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (watch_fh));
+    watch_fh = NULL;
+  }
+}
+
+
+/**
+ * Files in #networkIdDirectory changed, read the HELLOs in them
+ * (instead of waiting for the next scan of the whole directory).
+ *
+ * @param cls unused
+ */
+static void
+watch_read_cb (void *cls)
+{
+  char buffer[4096] GNUNET_ALIGN;
+  const struct inotify_event *ev;
+  struct DirScanContext dsc;
+  struct HostEntry *host;
+  ssize_t len;
+  size_t off;
+  char *fn;
+  int rescan;
+
+  (void) cls;
+  watch_task = NULL;
+  dsc.matched = 0;
+  dsc.remove_files = GNUNET_YES;
+  rescan = GNUNET_NO;
+  while (0 < (len = GNUNET_DISK_file_read (watch_fh,
+                                           buffer,
+                                           sizeof (buffer))))
+  {
+    off = 0;
+    while (off + sizeof (struct inotify_event) <= (size_t) len)
+    {
+      ev = (const struct inotify_event *) &buffer[off];
+      off += sizeof (struct inotify_event) + ev->len;
+      if (0 != (ev->mask & IN_Q_OVERFLOW))
+        rescan = GNUNET_YES;
+      if (0 != (ev->mask & IN_IGNORED))
+      {
+        /* directory is gone, fall back to scanning */
+        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                    _("Stopped watching directory `%s'\n"),
+                    networkIdDirectory);
+        stop_watching ();
+        rescan = GNUNET_YES;
+        break;
+      }
+      if (0 == ev->len)
+        continue;
+      GNUNET_asprintf (&fn,
+                       "%s%s%s",
+                       networkIdDirectory,
+                       DIR_SEPARATOR_STR,
+                       ev->name);
+      host = lookup_host_by_filename (ev->name);
+      if ( (NULL == host) ||
+           (GNUNET_YES != is_own_write (host,
+                                        fn)) )
+        (void) hosts_directory_scan_callback (&dsc,
+                                              fn);
+      GNUNET_free (fn);
+    }
+    if (NULL == watch_fh)
+      break;
+  }
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# HELLO files read after change notifications"),
+                            dsc.matched,
+                            GNUNET_NO);
+  if (GNUNET_YES == rescan)
+  {
+    /* we missed changes, scan the whole directory */
+    if (NULL != cron_scan)
+      GNUNET_SCHEDULER_cancel (cron_scan);
+    cron_scan
+      = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                            &cron_scan_directory_data_hosts,
+                                            NULL);
+  }
+  if (NULL != watch_fh)
+    watch_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 watch_fh,
+                                                 &watch_read_cb,
+                                                 NULL);
+}
+#endif
+
+
+/**
+ * Start watching #networkIdDirectory for files that are written,
+ * if the platform supports it.
+ */
+static void
+start_watching ()
+{
+#if HAVE_SYS_INOTIFY_H
+  int fd;
+
+  fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (-1 == fd)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "inotify_init1");
+    return;
+  }
+  if (-1 == inotify_add_watch (fd,
+                               networkIdDirectory,
+                               IN_CLOSE_WRITE | IN_MOVED_TO))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "inotify_add_watch",
+                              networkIdDirectory);
+    GNUNET_break (0 == close (fd));
+    return;
+  }
+  watch_fh = GNUNET_DISK_get_handle_from_int_fd (fd);
+  GNUNET_assert (NULL != watch_fh);
+  watch_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                               watch_fh,
+                                               &watch_read_cb,
+                                               NULL);
+#endif
+}
+
+
 /**
  * Update the HELLO of a friend by merging the addresses.
  *
@@ -714,6 +1120,422 @@ update_friend_hello (const struct GNUNET_HELLO_Message *hello,
 }
 
 
+/**
+ * Build what we store for a peer: its public and its friend-only
+ * HELLO, if they have addresses.
+ *
+ * @param host the peer
+ * @param[out] size set to the size of the result
+ * @return the HELLOs, NULL if there is nothing to store
+ */
+static char *
+make_host_record (struct HostEntry *host,
+                  size_t *size)
+{
+  unsigned int cnt;
+  int store_hello;
+  int store_friend_hello;
+  size_t pos;
+  char *buffer;
+
+  store_hello = GNUNET_NO;
+  *size = 0;
+  cnt = 0;
+  if (NULL != host->hello)
+    (void) GNUNET_HELLO_iterate_addresses (host->hello,
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &cnt);
+  if (cnt > 0)
+  {
+    store_hello = GNUNET_YES;
+    *size += GNUNET_HELLO_size (host->hello);
+  }
+  cnt = 0;
+  if (NULL != host->friend_only_hello)
+    (void) GNUNET_HELLO_iterate_addresses (host->friend_only_hello,
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &cnt);
+  store_friend_hello = GNUNET_NO;
+  if (0 < cnt)
+  {
+    store_friend_hello = GNUNET_YES;
+    *size += GNUNET_HELLO_size (host->friend_only_hello);
+  }
+  if ( (GNUNET_NO == store_hello) &&
+       (GNUNET_NO == store_friend_hello) )
+    return NULL;
+  buffer = GNUNET_malloc (*size);
+  pos = 0;
+  if (GNUNET_YES == store_hello)
+  {
+    GNUNET_memcpy (buffer,
+                   host->hello,
+                   GNUNET_HELLO_size (host->hello));
+    pos += GNUNET_HELLO_size (host->hello);
+  }
+  if (GNUNET_YES == store_friend_hello)
+  {
+    GNUNET_memcpy (&buffer[pos],
+                   host->friend_only_hello,
+                   GNUNET_HELLO_size (host->friend_only_hello));
+    pos += GNUNET_HELLO_size (host->friend_only_hello);
+  }
+  GNUNET_assert (pos == *size);
+  return buffer;
+}
+
+
+/**
+ * Write a record for a peer to a packed HELLO store.
+ *
+ * @param fh the store
+ * @param peer the peer
+ * @param hellos HELLOs of the peer, NULL for none
+ * @param size number of bytes in @a hellos
+ * @return #GNUNET_OK on success
+ */
+static int
+pack_write (struct GNUNET_DISK_FileHandle *fh,
+            const struct GNUNET_PeerIdentity *peer,
+            const char *hellos,
+            size_t size)
+{
+  struct PackedHelloHeader *hdr;
+  size_t rec_len;
+  ssize_t ret;
+
+  rec_len = PACK_RECORD_SIZE (size);
+  hdr = GNUNET_malloc (rec_len);
+  hdr->size = htonl ((uint32_t) size);
+  hdr->peer = *peer;
+  GNUNET_memcpy (&hdr[1],
+                 hellos,
+                 size);
+  /* single write, so a crash leaves at most a truncated last record */
+  ret = GNUNET_DISK_file_write (fh,
+                                hdr,
+                                rec_len);
+  GNUNET_free (hdr);
+  return (ret == (ssize_t) rec_len) ? GNUNET_OK : GNUNET_SYSERR;
+}
+
+
+/**
+ * Write the current record of a peer to the new packed HELLO store.
+ *
+ * @param cls the `struct GNUNET_DISK_FileHandle` of the new store
+ * @param key identity of the peer
+ * @param value the `struct HostEntry`
+ * @return #GNUNET_YES to continue, #GNUNET_SYSERR on write errors
+ */
+static int
+pack_write_host (void *cls,
+                 const struct GNUNET_PeerIdentity *key,
+                 void *value)
+{
+  struct GNUNET_DISK_FileHandle *fh = cls;
+  struct HostEntry *host = value;
+  char *buffer;
+  size_t size;
+  int ret;
+
+  buffer = make_host_record (host,
+                             &size);
+  if (NULL == buffer)
+  {
+    host->pack_len = 0;
+    return GNUNET_YES;
+  }
+  ret = pack_write (fh,
+                    key,
+                    buffer,
+                    size);
+  GNUNET_free (buffer);
+  if (GNUNET_OK != ret)
+    return GNUNET_SYSERR;
+  host->pack_len = PACK_RECORD_SIZE (size);
+  pack_live += host->pack_len;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Open the packed HELLO store for appending.
+ *
+ * @return #GNUNET_OK on success
+ */
+static int
+pack_open ()
+{
+  pack_fh = GNUNET_DISK_file_open (pack_filename,
+                                   GNUNET_DISK_OPEN_WRITE |
+                                   GNUNET_DISK_OPEN_APPEND |
+                                   GNUNET_DISK_OPEN_CREATE,
+                                   GNUNET_DISK_PERM_USER_READ |
+                                   GNUNET_DISK_PERM_USER_WRITE |
+                                   GNUNET_DISK_PERM_GROUP_READ |
+                                   GNUNET_DISK_PERM_OTHER_READ);
+  if (NULL == pack_fh)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "open",
+                              pack_filename);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Replace the packed HELLO store by one with only the current
+ * records.
+ *
+ * @param cls unused
+ */
+static void
+pack_compact (void *cls)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  char *tmp;
+
+  (void) cls;
+  pack_compact_task = NULL;
+  GNUNET_asprintf (&tmp,
+                   "%s.tmp",
+                   pack_filename);
+  fh = GNUNET_DISK_file_open (tmp,
+                              GNUNET_DISK_OPEN_WRITE |
+                              GNUNET_DISK_OPEN_TRUNCATE |
+                              GNUNET_DISK_OPEN_CREATE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE |
+                              GNUNET_DISK_PERM_GROUP_READ |
+                              GNUNET_DISK_PERM_OTHER_READ);
+  if (NULL == fh)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "open",
+                              tmp);
+    GNUNET_free (tmp);
+    return;
+  }
+  pack_live = 0;
+  if ( (GNUNET_SYSERR ==
+        GNUNET_CONTAINER_multipeermap_iterate (hostmap,
+                                               &pack_write_host,
+                                               fh)) ||
+       (GNUNET_OK !=
+        GNUNET_DISK_file_sync (fh)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              tmp);
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (fh));
+    (void) UNLINK (tmp);
+    GNUNET_free (tmp);
+    /* keep appending to the old store, only our accounting is off */
+    pack_size = pack_live;
+    return;
+  }
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (fh));
+  if (0 != RENAME (tmp,
+                   pack_filename))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "rename",
+                              tmp);
+    (void) UNLINK (tmp);
+    GNUNET_free (tmp);
+    pack_size = pack_live;
+    return;
+  }
+  GNUNET_free (tmp);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Compacted `%s' from %llu to %llu bytes\n",
+              pack_filename,
+              (unsigned long long) pack_size,
+              (unsigned long long) pack_live);
+  pack_size = pack_live;
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (pack_fh));
+  if (GNUNET_OK != pack_open ())
+    GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Append the current HELLOs of a peer to the packed HELLO store,
+ * and compact the store if most of it is outdated.
+ *
+ * @param host the peer
+ * @param hellos its HELLOs, NULL for none
+ * @param size number of bytes in @a hellos
+ */
+static void
+pack_append (struct HostEntry *host,
+             const char *hellos,
+             size_t size)
+{
+  if ( (NULL == hellos) &&
+       (0 == host->pack_len) )
+    return; /* nothing stored, nothing to remove */
+  if (GNUNET_OK !=
+      pack_write (pack_fh,
+                  &host->identity,
+                  hellos,
+                  size))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              pack_filename);
+    return;
+  }
+  pack_size += PACK_RECORD_SIZE (size);
+  pack_live -= host->pack_len;
+  host->pack_len = (NULL == hellos) ? 0 : PACK_RECORD_SIZE (size);
+  pack_live += host->pack_len;
+  if ( (pack_size > PACK_MIN_GARBAGE + 2 * pack_live) &&
+       (NULL == pack_compact_task) )
+    pack_compact_task
+      = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                            &pack_compact,
+                                            NULL);
+}
+
+
+/**
+ * Remember the HELLOs of the current record of a peer in the
+ * packed HELLO store.
+ *
+ * @param cls unused
+ * @param key identity of the peer
+ * @param value the `struct PackedHelloHeader` of the record
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+pack_load_host (void *cls,
+                const struct GNUNET_PeerIdentity *key,
+                void *value)
+{
+  const struct PackedHelloHeader *hdr = value;
+  struct ReadHostFileContext r;
+  struct GNUNET_PeerIdentity id;
+  struct HostEntry *host;
+  size_t valid;
+  size_t size;
+
+  (void) cls;
+  size = ntohl (hdr->size);
+  if (0 == size)
+    return GNUNET_YES; /* removed */
+  (void) parse_hellos ((const char *) &hdr[1],
+                       size,
+                       pack_filename,
+                       &r,
+                       &valid);
+  if (GNUNET_OK !=
+      remember_hellos (&r,
+                       key,
+                       &id))
+    return GNUNET_YES;
+  host = GNUNET_CONTAINER_multipeermap_get (hostmap,
+                                            key);
+  host->pack_len = PACK_RECORD_SIZE (size);
+  pack_live += host->pack_len;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Load the HELLOs in the packed HELLO store and open it for
+ * appending.
+ *
+ * @return #GNUNET_OK on success
+ */
+static int
+pack_load ()
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_DISK_MapHandle *mh;
+  struct GNUNET_CONTAINER_MultiPeerMap *latest;
+  const struct PackedHelloHeader *hdr;
+  const char *data;
+  off_t fsize;
+  size_t off;
+  size_t rec_len;
+
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (pack_filename))
+    return GNUNET_SYSERR;
+  pack_size = 0;
+  pack_live = 0;
+  fh = NULL;
+  if (GNUNET_YES == GNUNET_DISK_file_test (pack_filename))
+    fh = GNUNET_DISK_file_open (pack_filename,
+                                GNUNET_DISK_OPEN_READ,
+                                GNUNET_DISK_PERM_NONE);
+  if ( (NULL != fh) &&
+       (GNUNET_OK ==
+        GNUNET_DISK_file_handle_size (fh,
+                                      &fsize)) &&
+       (0 < fsize) &&
+       (NULL != (data = GNUNET_DISK_file_map (fh,
+                                              &mh,
+                                              GNUNET_DISK_MAP_TYPE_READ,
+                                              (size_t) fsize))) )
+  {
+    /* find the current record of each peer */
+    latest = GNUNET_CONTAINER_multipeermap_create (1024,
+                                                   GNUNET_NO);
+    off = 0;
+    while (off + sizeof (struct PackedHelloHeader) <= (size_t) fsize)
+    {
+      hdr = (const struct PackedHelloHeader *) &data[off];
+      rec_len = PACK_RECORD_SIZE (ntohl (hdr->size));
+      if (rec_len > ((size_t) fsize) - off)
+        break;
+      (void) GNUNET_CONTAINER_multipeermap_put (latest,
+                                                &hdr->peer,
+                                                (void *) hdr,
+                                                GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
+      off += rec_len;
+    }
+    pack_loading = GNUNET_YES;
+    GNUNET_CONTAINER_multipeermap_iterate (latest,
+                                           &pack_load_host,
+                                           NULL);
+    pack_loading = GNUNET_NO;
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Loaded %u peers from `%s'\n"),
+                GNUNET_CONTAINER_multipeermap_size (latest),
+                pack_filename);
+    GNUNET_CONTAINER_multipeermap_destroy (latest);
+    GNUNET_DISK_file_unmap (mh);
+    pack_size = off;
+    if ( (off < (size_t) fsize) &&
+         (0 != TRUNCATE (pack_filename,
+                         off)) )
+    {
+      /* incomplete last record from a crash while appending */
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "truncate",
+                                pack_filename);
+      GNUNET_break (GNUNET_OK ==
+                    GNUNET_DISK_file_close (fh));
+      return GNUNET_SYSERR;
+    }
+  }
+  if (NULL != fh)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (fh));
+  return pack_open ();
+}
+
+
 /**
  * Bind a host address (hello) to a hostId.
  *
@@ -729,14 +1551,11 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
   struct GNUNET_HELLO_Message *mrg;
   struct GNUNET_HELLO_Message **dest;
   struct GNUNET_TIME_Absolute delta;
-  unsigned int cnt;
-  unsigned int size;
+  size_t size;
   int friend_hello_type;
-  int store_hello;
-  int store_friend_hello;
-  unsigned int pos;
   char *buffer;
 
+  fn = NULL;
   host = GNUNET_CONTAINER_multipeermap_get (hostmap, peer);
   GNUNET_assert (NULL != host);
 
@@ -800,39 +1619,26 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
     GNUNET_assert ((GNUNET_YES ==
                     GNUNET_HELLO_is_friend_only (host->friend_only_hello)));
 
-  fn = get_host_filename (peer);
-  if ( (NULL != fn) &&
-       (GNUNET_OK ==
-        GNUNET_DISK_directory_create_for_file (fn)) )
+  if (GNUNET_YES == pack_loading)
   {
-    store_hello = GNUNET_NO;
-    size = 0;
-    cnt = 0;
-    if (NULL != host->hello)
-      (void) GNUNET_HELLO_iterate_addresses (host->hello,
-					     GNUNET_NO,
-                                             &count_addresses,
-                                             &cnt);
-    if (cnt > 0)
-    {
-      store_hello = GNUNET_YES;
-      size += GNUNET_HELLO_size (host->hello);
-    }
-    cnt = 0;
-    if (NULL != host->friend_only_hello)
-      (void) GNUNET_HELLO_iterate_addresses (host->friend_only_hello,
-                                             GNUNET_NO,
-					     &count_addresses,
-                                             &cnt);
-    store_friend_hello = GNUNET_NO;
-    if (0 < cnt)
-    {
-      store_friend_hello = GNUNET_YES;
-      size += GNUNET_HELLO_size (host->friend_only_hello);
-    }
-
-    if ( (GNUNET_NO == store_hello) &&
-         (GNUNET_NO == store_friend_hello) )
+    /* HELLOs are already in the packed store */
+  }
+  else if (NULL != pack_fh)
+  {
+    buffer = make_host_record (host,
+                               &size);
+    pack_append (host,
+                 buffer,
+                 size);
+    GNUNET_free_non_null (buffer);
+  }
+  else if ( (NULL != (fn = get_host_filename (peer))) &&
+            (GNUNET_OK ==
+             GNUNET_DISK_directory_create_for_file (fn)) )
+  {
+    buffer = make_host_record (host,
+                               &size);
+    if (NULL == buffer)
     {
       /* no valid addresses, don't put HELLO on disk; in fact,
 	 if one exists on disk, remove it */
@@ -840,25 +1646,6 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
     }
     else
     {
-      buffer = GNUNET_malloc (size);
-      pos = 0;
-
-      if (GNUNET_YES == store_hello)
-      {
-	GNUNET_memcpy (buffer,
-                       host->hello,
-                       GNUNET_HELLO_size (host->hello));
-	pos += GNUNET_HELLO_size (host->hello);
-      }
-      if (GNUNET_YES == store_friend_hello)
-      {
-	GNUNET_memcpy (&buffer[pos],
-		       host->friend_only_hello,
-		       GNUNET_HELLO_size (host->friend_only_hello));
-	pos += GNUNET_HELLO_size (host->friend_only_hello);
-      }
-      GNUNET_assert (pos == size);
-
       if (GNUNET_SYSERR == GNUNET_DISK_fn_write (fn, buffer, size,
 						 GNUNET_DISK_PERM_USER_READ |
 						 GNUNET_DISK_PERM_USER_WRITE |
@@ -866,12 +1653,14 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
 						 GNUNET_DISK_PERM_OTHER_READ))
 	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "write", fn);
       else
+      {
+        note_own_write (host,
+                        fn);
 	GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                    "Stored %s %s HELLO in %s  with total size %u\n",
-		    (GNUNET_YES == store_friend_hello) ? "friend-only": "",
-		    (GNUNET_YES == store_hello) ? "public": "",
+                    "Stored HELLOs in %s with total size %u\n",
 		    fn,
-                    size);
+                    (unsigned int) size);
+      }
       GNUNET_free (buffer);
     }
   }
@@ -1064,13 +1853,16 @@ discard_hosts_helper (void *cls,
 
   if (0 < write_pos)
   {
-    GNUNET_DISK_fn_write (fn,
-                          writebuffer,
-                          write_pos,
-                          GNUNET_DISK_PERM_USER_READ |
-                          GNUNET_DISK_PERM_USER_WRITE |
-                          GNUNET_DISK_PERM_GROUP_READ |
-                          GNUNET_DISK_PERM_OTHER_READ);
+    if (GNUNET_SYSERR !=
+        GNUNET_DISK_fn_write (fn,
+                              writebuffer,
+                              write_pos,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE |
+                              GNUNET_DISK_PERM_GROUP_READ |
+                              GNUNET_DISK_PERM_OTHER_READ))
+      note_own_write (lookup_host_by_filename (GNUNET_STRINGS_get_short_name (fn)),
+                      fn);
   }
   else if (0 != UNLINK (fn))
     GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING |
@@ -1102,6 +1894,13 @@ cron_clean_data_hosts (void *cls)
   GNUNET_DISK_directory_scan (networkIdDirectory,
                               &discard_hosts_helper,
                               &now);
+  if ( (NULL != pack_fh) &&
+       (pack_size > pack_live) &&
+       (NULL == pack_compact_task) )
+    pack_compact_task
+      = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                            &pack_compact,
+                                            NULL);
   cron_clean = GNUNET_SCHEDULER_add_delayed (DATA_HOST_CLEAN_FREQ,
 					     &cron_clean_data_hosts,
 					     NULL);
@@ -1329,6 +2128,22 @@ static void
 shutdown_task (void *cls)
 {
   (void) cls;
+#if HAVE_SYS_INOTIFY_H
+  stop_watching ();
+#endif
+  if (NULL != pack_compact_task)
+  {
+    GNUNET_SCHEDULER_cancel (pack_compact_task);
+    pack_compact_task = NULL;
+  }
+  if (NULL != pack_fh)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (pack_fh));
+    pack_fh = NULL;
+  }
+  GNUNET_free_non_null (pack_filename);
+  pack_filename = NULL;
   GNUNET_notification_context_destroy (notify_list);
   notify_list = NULL;
   GNUNET_notification_context_destroy (notify_friend_only_list);
@@ -1416,6 +2231,21 @@ run (void *cls,
       GNUNET_SCHEDULER_shutdown ();
       return;
     }
+    if ( (GNUNET_YES ==
+          GNUNET_CONFIGURATION_have_value (cfg,
+                                           "peerinfo",
+                                           "PACKED_STORE")) &&
+         (GNUNET_OK ==
+          GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                   "peerinfo",
+                                                   "PACKED_STORE",
+                                                   &pack_filename)) &&
+         (GNUNET_OK != pack_load ()) )
+    {
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    start_watching ();
 
     cron_scan
       = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
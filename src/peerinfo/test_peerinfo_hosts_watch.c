@@ -0,0 +1,294 @@
+/*
+ This file is part of GNUnet.
+ Copyright (C) 2018 GNUnet e.V.
+
+ GNUnet is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3, or (at your
+ option) any later version.
+
+ GNUnet is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with GNUnet; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * @file peerinfo/test_peerinfo_hosts_watch.c
+ * @brief testcase for HELLO files put into the HOSTS directory of a
+ *        running peerinfo service: they must be picked up at once,
+ *        not with the next scan of the directory
+ */
+#include "platform.h"
+#include "gnunet_hello_lib.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_peerinfo_service.h"
+#include "gnunet_testing_lib.h"
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10)
+
+/**
+ * Number of HELLO files we put into the directory, one after the
+ * other.
+ */
+#define NUM_FILES 2
+
+
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+static struct GNUNET_PEERINFO_Handle *h;
+
+static struct GNUNET_PEERINFO_IteratorContext *ic;
+
+static struct GNUNET_PEERINFO_NotifyContext *pnc;
+
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+static char *hosts_dir;
+
+/**
+ * Number of files we put into the directory so far.
+ */
+static unsigned int files_written;
+
+static int ok;
+
+
+static ssize_t
+address_generator (void *cls,
+                   size_t max,
+                   void *buf)
+{
+  size_t *agc = cls;
+  ssize_t ret;
+  struct GNUNET_HELLO_Address address;
+
+  if (0 == *agc)
+    return GNUNET_SYSERR; /* Done */
+  memset (&address.peer, 0, sizeof (struct GNUNET_PeerIdentity));
+  address.address = "Address";
+  address.transport_name = "peerinfotest";
+  address.address_length = *agc;
+  address.local_info = GNUNET_HELLO_ADDRESS_INFO_NONE;
+  ret = GNUNET_HELLO_add_address (&address,
+                                  GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS),
+                                  buf,
+                                  max);
+  (*agc)--;
+  return ret;
+}
+
+
+/**
+ * Create a HELLO for peer number @a n, whose identity consists of
+ * bytes with the value @a n.
+ *
+ * @param n number of the peer
+ * @param[out] pid set to the identity of the peer
+ * @return the HELLO
+ */
+static struct GNUNET_HELLO_Message *
+make_hello (unsigned int n,
+            struct GNUNET_PeerIdentity *pid)
+{
+  size_t agc;
+
+  agc = 2;
+  memset (pid, n, sizeof (*pid));
+  return GNUNET_HELLO_create (&pid->public_key,
+                              &address_generator,
+                              &agc,
+                              GNUNET_NO);
+}
+
+
+/**
+ * Put the HELLO of the next peer into the HOSTS directory, the way
+ * an external tool would.
+ */
+static void
+write_hello_file ()
+{
+  struct GNUNET_HELLO_Message *hello;
+  struct GNUNET_PeerIdentity pid;
+  char *fn;
+
+  files_written++;
+  hello = make_hello (1 + files_written,
+                      &pid);
+  GNUNET_asprintf (&fn,
+                   "%s%s%s",
+                   hosts_dir,
+                   DIR_SEPARATOR_STR,
+                   GNUNET_i2s_full (&pid));
+  GNUNET_assert (GNUNET_HELLO_size (hello) ==
+                 GNUNET_DISK_fn_write (fn,
+                                       hello,
+                                       GNUNET_HELLO_size (hello),
+                                       GNUNET_DISK_PERM_USER_READ |
+                                       GNUNET_DISK_PERM_USER_WRITE));
+  GNUNET_free (fn);
+  GNUNET_free (hello);
+}
+
+
+static void
+end ()
+{
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  if (NULL != pnc)
+  {
+    GNUNET_PEERINFO_notify_cancel (pnc);
+    pnc = NULL;
+  }
+  if (NULL != ic)
+  {
+    GNUNET_PEERINFO_iterate_cancel (ic);
+    ic = NULL;
+  }
+  if (NULL != h)
+  {
+    GNUNET_PEERINFO_disconnect (h);
+    h = NULL;
+  }
+}
+
+
+static void
+timeout_cb (void *cls)
+{
+  timeout_task = NULL;
+  fprintf (stderr,
+           "HELLO file %u was not picked up\n",
+           files_written);
+  ok = 1;
+  end ();
+}
+
+
+static void
+notify_cb (void *cls,
+           const struct GNUNET_PeerIdentity *peer,
+           const struct GNUNET_HELLO_Message *hello,
+           const char *err_msg)
+{
+  struct GNUNET_PeerIdentity pid;
+
+  if (NULL != err_msg)
+  {
+    fprintf (stderr,
+             "Error from peerinfo: %s\n",
+             err_msg);
+    ok = 1;
+    end ();
+    return;
+  }
+  memset (&pid, 1 + files_written, sizeof (pid));
+  if ( (NULL == peer) ||
+       (NULL == hello) ||
+       (0 != memcmp (peer,
+                     &pid,
+                     sizeof (pid))) )
+    return;
+  if (NUM_FILES == files_written)
+  {
+    ok = 0;
+    end ();
+    return;
+  }
+  write_hello_file ();
+}
+
+
+static void
+process (void *cls,
+         const struct GNUNET_PeerIdentity *peer,
+         const struct GNUNET_HELLO_Message *hello,
+         const char *err_msg)
+{
+  if (NULL != err_msg)
+  {
+    ic = NULL;
+    fprintf (stderr,
+             "Error from peerinfo: %s\n",
+             err_msg);
+    ok = 1;
+    end ();
+    return;
+  }
+  if (NULL != peer)
+    return;
+  ic = NULL;
+  /* the service is up and has scanned the directory */
+  write_hello_file ();
+  pnc = GNUNET_PEERINFO_notify (cfg,
+                                GNUNET_NO,
+                                &notify_cb,
+                                NULL);
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *c,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  struct GNUNET_HELLO_Message *hello;
+  struct GNUNET_PeerIdentity pid;
+
+  cfg = c;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                          "peerinfo",
+                                                          "HOSTS",
+                                                          &hosts_dir));
+  timeout_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                               &timeout_cb,
+                                               NULL);
+  h = GNUNET_PEERINFO_connect (cfg);
+  GNUNET_assert (NULL != h);
+  hello = make_hello (1,
+                      &pid);
+  GNUNET_PEERINFO_add_peer (h,
+                            hello,
+                            NULL,
+                            NULL);
+  GNUNET_free (hello);
+  ic = GNUNET_PEERINFO_iterate (h,
+                                GNUNET_NO,
+                                &pid,
+                                &process,
+                                NULL);
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+#if ! HAVE_SYS_INOTIFY_H
+  /* without inotify, files are only found by the periodic scan */
+  return 77;
+#else
+  ok = 1;
+  if (0 != GNUNET_TESTING_service_run ("test-peerinfo-hosts-watch",
+                                       "peerinfo",
+                                       "test_peerinfo_api_data.conf",
+                                       &run,
+                                       NULL))
+    return 1;
+  GNUNET_free_non_null (hosts_dir);
+  return ok;
+#endif
+}
+
+/* end of test_peerinfo_hosts_watch.c */
@@ -0,0 +1,552 @@
+/*
+ This file is part of GNUnet.
+ Copyright (C) 2018 GNUnet e.V.
+
+ GNUnet is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3, or (at your
+ option) any later version.
+
+ GNUnet is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with GNUnet; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * @file peerinfo/test_peerinfo_packed_store.c
+ * @brief testcase for the packed HELLO store of the peerinfo service:
+ *        restarts, removal records, a truncated last record and
+ *        compaction of the store
+ */
+#include "platform.h"
+#include "gnunet_hello_lib.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_peerinfo_service.h"
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10)
+
+#define CONF_FILE "test_peerinfo_packed_store_data.conf"
+
+/**
+ * Size of a record in the packed HELLO store with @a hs bytes of
+ * HELLOs, as in gnunet-service-peerinfo.c.
+ */
+#define PACK_RECORD_SIZE(hs) (sizeof (struct PackedHelloHeader) + (((hs) + 7) & ~((size_t) 7)))
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a record in the packed HELLO store, must match the one
+ * in gnunet-service-peerinfo.c.
+ */
+struct PackedHelloHeader
+{
+  uint32_t size GNUNET_PACKED;
+
+  uint32_t reserved GNUNET_PACKED;
+
+  struct GNUNET_PeerIdentity peer;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+static struct GNUNET_CONFIGURATION_Handle *cfg;
+
+static struct GNUNET_PEERINFO_Handle *h;
+
+static struct GNUNET_PEERINFO_IteratorContext *ic;
+
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+static struct GNUNET_SCHEDULER_Task *poll_task;
+
+static char *pack_fn;
+
+static char *hosts_dir;
+
+/**
+ * HELLO to add in the current run of the service, or NULL.
+ */
+static const struct GNUNET_HELLO_Message *add_hello;
+
+/**
+ * Size of the store we wait for it to be compacted from, 0 for
+ * not waiting.
+ */
+static uint64_t compact_from;
+
+/**
+ * Bitmask of the peers with HELLOs the service told us about.
+ */
+static unsigned int found;
+
+static int ok;
+
+
+static ssize_t
+address_generator (void *cls,
+                   size_t max,
+                   void *buf)
+{
+  size_t *agc = cls;
+  ssize_t ret;
+  struct GNUNET_HELLO_Address address;
+
+  if (0 == *agc)
+    return GNUNET_SYSERR; /* Done */
+  memset (&address.peer, 0, sizeof (struct GNUNET_PeerIdentity));
+  address.address = "Address";
+  address.transport_name = "peerinfotest";
+  address.address_length = *agc;
+  address.local_info = GNUNET_HELLO_ADDRESS_INFO_NONE;
+  ret = GNUNET_HELLO_add_address (&address,
+                                  GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS),
+                                  buf,
+                                  max);
+  (*agc)--;
+  return ret;
+}
+
+
+/**
+ * Create a HELLO for peer number @a n, whose identity consists of
+ * bytes with the value @a n.
+ *
+ * @param n number of the peer, less than 32
+ * @return the HELLO
+ */
+static struct GNUNET_HELLO_Message *
+make_hello (unsigned int n)
+{
+  struct GNUNET_PeerIdentity pid;
+  size_t agc;
+
+  agc = 2;
+  memset (&pid, n, sizeof (pid));
+  return GNUNET_HELLO_create (&pid.public_key,
+                              &address_generator,
+                              &agc,
+                              GNUNET_NO);
+}
+
+
+/**
+ * Append a record for peer number @a n to the packed store.
+ *
+ * @param fh the store
+ * @param n number of the peer
+ * @param with_hello #GNUNET_NO for a removal record
+ * @param truncate #GNUNET_YES to write only part of the record, as
+ *        a crash while appending would
+ */
+static void
+append_record (struct GNUNET_DISK_FileHandle *fh,
+               unsigned int n,
+               int with_hello,
+               int truncate)
+{
+  struct GNUNET_HELLO_Message *hello;
+  struct PackedHelloHeader *hdr;
+  size_t size;
+  size_t rec_len;
+
+  hello = make_hello (n);
+  size = (GNUNET_YES == with_hello) ? GNUNET_HELLO_size (hello) : 0;
+  rec_len = PACK_RECORD_SIZE (size);
+  hdr = GNUNET_malloc (rec_len);
+  hdr->size = htonl ((uint32_t) size);
+  memset (&hdr->peer, n, sizeof (hdr->peer));
+  GNUNET_memcpy (&hdr[1],
+                 hello,
+                 size);
+  if (GNUNET_YES == truncate)
+    rec_len = sizeof (*hdr) + size / 2;
+  GNUNET_assert (rec_len ==
+                 GNUNET_DISK_file_write (fh,
+                                         hdr,
+                                         rec_len));
+  GNUNET_free (hdr);
+  GNUNET_free (hello);
+}
+
+
+/**
+ * Open the packed store, replacing what is in it.
+ *
+ * @return handle to write the store with
+ */
+static struct GNUNET_DISK_FileHandle *
+create_store ()
+{
+  struct GNUNET_DISK_FileHandle *fh;
+
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_DISK_directory_create_for_file (pack_fn));
+  fh = GNUNET_DISK_file_open (pack_fn,
+                              GNUNET_DISK_OPEN_WRITE |
+                              GNUNET_DISK_OPEN_TRUNCATE |
+                              GNUNET_DISK_OPEN_CREATE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE);
+  GNUNET_assert (NULL != fh);
+  return fh;
+}
+
+
+/**
+ * Get the size of the packed store.
+ *
+ * @return size of the store, 0 if it does not exist
+ */
+static uint64_t
+store_size ()
+{
+  uint64_t size;
+
+  if (GNUNET_OK !=
+      GNUNET_DISK_file_size (pack_fn,
+                             &size,
+                             GNUNET_YES,
+                             GNUNET_YES))
+    return 0;
+  return size;
+}
+
+
+static void
+finish ()
+{
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  if (NULL != poll_task)
+  {
+    GNUNET_SCHEDULER_cancel (poll_task);
+    poll_task = NULL;
+  }
+  if (NULL != ic)
+  {
+    GNUNET_PEERINFO_iterate_cancel (ic);
+    ic = NULL;
+  }
+  if (NULL != h)
+  {
+    GNUNET_PEERINFO_disconnect (h);
+    h = NULL;
+  }
+}
+
+
+static void
+timeout_cb (void *cls)
+{
+  timeout_task = NULL;
+  fprintf (stderr,
+           "Timeout talking to peerinfo\n");
+  ok = 1;
+  finish ();
+}
+
+
+static void
+poll_compaction (void *cls)
+{
+  poll_task = NULL;
+  if (store_size () < compact_from)
+  {
+    finish ();
+    return;
+  }
+  poll_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 100),
+                                            &poll_compaction,
+                                            NULL);
+}
+
+
+static void
+process (void *cls,
+         const struct GNUNET_PeerIdentity *peer,
+         const struct GNUNET_HELLO_Message *hello,
+         const char *err_msg)
+{
+  if (NULL != err_msg)
+  {
+    fprintf (stderr,
+             "Error iterating peers: %s\n",
+             err_msg);
+    ic = NULL;
+    ok = 1;
+    finish ();
+    return;
+  }
+  if (NULL == peer)
+  {
+    ic = NULL;
+    if (0 != compact_from)
+      poll_compaction (NULL);
+    else
+      finish ();
+    return;
+  }
+  if (NULL != hello)
+    found |= 1 << ((const unsigned char *) peer)[0];
+}
+
+
+static void
+run_phase (void *cls)
+{
+  timeout_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                               &timeout_cb,
+                                               NULL);
+  h = GNUNET_PEERINFO_connect (cfg);
+  GNUNET_assert (NULL != h);
+  if (NULL != add_hello)
+    GNUNET_PEERINFO_add_peer (h,
+                              add_hello,
+                              NULL,
+                              NULL);
+  ic = GNUNET_PEERINFO_iterate (h,
+                                GNUNET_NO,
+                                NULL,
+                                &process,
+                                NULL);
+}
+
+
+/**
+ * Start the service, optionally add a HELLO, and find out which
+ * peers it knows; then stop the service again.
+ *
+ * @param hello HELLO to add, NULL for none
+ * @param wait_compact if non-zero, wait until the store shrinks
+ *        below this size before stopping the service
+ * @return bitmask of the peers the service has HELLOs for
+ */
+static unsigned int
+run_service (const struct GNUNET_HELLO_Message *hello,
+             uint64_t wait_compact)
+{
+  struct GNUNET_OS_Process *proc;
+  char *binary;
+
+  binary = GNUNET_OS_get_libexec_binary_path ("gnunet-service-peerinfo");
+  proc = GNUNET_OS_start_process (GNUNET_YES,
+                                  GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
+                                  NULL, NULL, NULL,
+                                  binary,
+                                  "gnunet-service-peerinfo",
+                                  "-c", CONF_FILE,
+                                  NULL);
+  GNUNET_assert (NULL != proc);
+  GNUNET_free (binary);
+  add_hello = hello;
+  compact_from = wait_compact;
+  found = 0;
+  GNUNET_SCHEDULER_run (&run_phase,
+                        NULL);
+  if (0 != GNUNET_OS_process_kill (proc,
+                                   GNUNET_TERM_SIG))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "kill");
+    ok = 1;
+  }
+  GNUNET_OS_process_wait (proc);
+  GNUNET_OS_process_destroy (proc);
+  return found;
+}
+
+
+/**
+ * HELLOs added by a client must be appended to the packed store,
+ * not written to HOSTS, and must be loaded after a restart.
+ */
+static void
+test_restart ()
+{
+  struct GNUNET_HELLO_Message *hello;
+  struct GNUNET_PeerIdentity pid;
+  char *fn;
+
+  hello = make_hello (1);
+  if (0 == (run_service (hello, 0) & (1 << 1)))
+  {
+    fprintf (stderr, "Added HELLO not found\n");
+    ok = 2;
+  }
+  GNUNET_free (hello);
+  memset (&pid, 1, sizeof (pid));
+  GNUNET_asprintf (&fn,
+                   "%s%s%s",
+                   hosts_dir,
+                   DIR_SEPARATOR_STR,
+                   GNUNET_i2s_full (&pid));
+  if ( (0 == store_size ()) ||
+       (GNUNET_YES == GNUNET_DISK_file_test (fn)) )
+  {
+    fprintf (stderr, "HELLO was not stored in the packed store\n");
+    ok = 3;
+  }
+  GNUNET_free (fn);
+  if (0 == (run_service (NULL, 0) & (1 << 1)))
+  {
+    fprintf (stderr, "HELLO not loaded from the packed store\n");
+    ok = 4;
+  }
+}
+
+
+/**
+ * A record without HELLOs removes the peer.
+ */
+static void
+test_removal ()
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  unsigned int peers;
+
+  fh = create_store ();
+  append_record (fh, 2, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 3, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 2, GNUNET_NO, GNUNET_NO);
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+  peers = run_service (NULL, 0);
+  if (peers != (1 << 3))
+  {
+    fprintf (stderr, "Removal record not honoured, peers %x\n", peers);
+    ok = 5;
+  }
+}
+
+
+/**
+ * An incomplete last record, as left by a crash, is dropped and cut
+ * off the store.
+ */
+static void
+test_truncated ()
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_HELLO_Message *hello;
+  unsigned int peers;
+  uint64_t want;
+
+  hello = make_hello (4);
+  want = PACK_RECORD_SIZE (GNUNET_HELLO_size (hello));
+  GNUNET_free (hello);
+  fh = create_store ();
+  append_record (fh, 4, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 5, GNUNET_YES, GNUNET_YES);
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+  peers = run_service (NULL, 0);
+  if (peers != (1 << 4))
+  {
+    fprintf (stderr, "Wrong peers after truncated record: %x\n", peers);
+    ok = 6;
+  }
+  if (store_size () != want)
+  {
+    fprintf (stderr, "Truncated record not cut off, store has %llu bytes\n",
+             (unsigned long long) store_size ());
+    ok = 7;
+  }
+}
+
+
+/**
+ * Outdated records are dropped when the store is rewritten, and the
+ * rewritten store loads again.
+ */
+static void
+test_compaction ()
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  unsigned int peers;
+  uint64_t before;
+
+  fh = create_store ();
+  for (unsigned int i = 0; i < 16; i++)
+    append_record (fh, 6, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 7, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 8, GNUNET_YES, GNUNET_NO);
+  append_record (fh, 8, GNUNET_NO, GNUNET_NO);
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+  before = store_size ();
+  peers = run_service (NULL, before);
+  if (peers != ((1 << 6) | (1 << 7)))
+  {
+    fprintf (stderr, "Wrong peers before compaction: %x\n", peers);
+    ok = 8;
+  }
+  if (store_size () >= before)
+  {
+    fprintf (stderr, "Store was not compacted\n");
+    ok = 9;
+  }
+  peers = run_service (NULL, 0);
+  if (peers != ((1 << 6) | (1 << 7)))
+  {
+    fprintf (stderr, "Wrong peers after compaction: %x\n", peers);
+    ok = 10;
+  }
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  char *home;
+
+  GNUNET_log_setup ("test-peerinfo-packed-store",
+                    "WARNING",
+                    NULL);
+  cfg = GNUNET_CONFIGURATION_create ();
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_load (cfg,
+                                 CONF_FILE))
+  {
+    GNUNET_CONFIGURATION_destroy (cfg);
+    return 1;
+  }
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                          "PATHS",
+                                                          "GNUNET_TEST_HOME",
+                                                          &home));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                          "peerinfo",
+                                                          "PACKED_STORE",
+                                                          &pack_fn));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                                          "peerinfo",
+                                                          "HOSTS",
+                                                          &hosts_dir));
+  (void) GNUNET_DISK_directory_remove (home);
+  ok = 0;
+  test_restart ();
+  test_removal ();
+  test_truncated ();
+  test_compaction ();
+  (void) GNUNET_DISK_directory_remove (home);
+  GNUNET_free (home);
+  GNUNET_free (pack_fn);
+  GNUNET_free (hosts_dir);
+  GNUNET_CONFIGURATION_destroy (cfg);
+  return ok;
+}
+
+/* end of test_peerinfo_packed_store.c */
@@ -80,9 +80,9 @@ static const struct GNUNET_CONFIGURATION_Handle *cfg;
 static unsigned long long matching_bits;
 
 /**
- * Task used for proof-of-work calculation.
+ * Search for the proof of work.
  */
-static struct GNUNET_SCHEDULER_Task *pow_task;
+static struct GNUNET_CRYPTO_PowSearch *pow_search;
 
 
 /**
@@ -240,10 +240,10 @@ static void
 sync_rd (const struct RevocationData *rd)
 {
   if ( (NULL != filename) &&
-       (sizeof (struct RevocationData) ==
+       (sizeof (struct RevocationData) !=
 	GNUNET_DISK_fn_write (filename,
-			      &rd,
-			      sizeof (rd),
+			      rd,
+			      sizeof (struct RevocationData),
 			      GNUNET_DISK_PERM_USER_READ |
 			      GNUNET_DISK_PERM_USER_WRITE)) )
     GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
@@ -253,7 +253,7 @@ sync_rd (const struct RevocationData *rd)
 
 
 /**
- * Perform the proof-of-work calculation.
+ * Stop the proof-of-work calculation and remember how far we got.
  *
  * @param cls the `struct RevocationData`
  */
@@ -262,10 +262,10 @@ calculate_pow_shutdown (void *cls)
 {
   struct RevocationData *rd = cls;
 
-  if (NULL != pow_task)
+  if (NULL != pow_search)
   {
-    GNUNET_SCHEDULER_cancel (pow_task);
-    pow_task = NULL;
+    rd->pow = GNUNET_CRYPTO_pow_search_stop (pow_search);
+    pow_search = NULL;
   }
   sync_rd (rd);
   GNUNET_free (rd);
@@ -273,62 +273,79 @@ calculate_pow_shutdown (void *cls)
 
 
 /**
- * Perform the proof-of-work calculation.
+ * The proof-of-work calculation made progress.  Store the
+ * temporary result and display a progress estimate.
  *
  * @param cls the `struct RevocationData`
+ * @param checkpoint all values below have been tested
  */
 static void
-calculate_pow (void *cls)
+calculate_pow_progress (void *cls,
+                        uint64_t checkpoint)
 {
   struct RevocationData *rd = cls;
 
-  /* store temporary results */
-  pow_task = NULL;
-  if (0 == (rd->pow % 128))
-    sync_rd (rd);
-  /* display progress estimate */
-  if ( (0 == ((1 << matching_bits) / 100 / 50)) ||
-       (0 == (rd->pow % ((1 << matching_bits) / 100 / 50))) )
-    FPRINTF (stderr, "%s", ".");
-  if ( (0 != rd->pow) &&
-       ( (0 == ((1 << matching_bits) / 100)) ||
-         (0 == (rd->pow % ((1 << matching_bits) / 100))) ) )
-    FPRINTF (stderr, " - @ %3u%% (estimate)\n",
-             (unsigned int) (rd->pow * 100) / (1 << matching_bits));
-  /* actually do POW calculation */
-  rd->pow++;
-  if (GNUNET_OK ==
-      GNUNET_REVOCATION_check_pow (&rd->key,
-                                   rd->pow,
-                                   (unsigned int) matching_bits))
+  rd->pow = checkpoint;
+  sync_rd (rd);
+  if (matching_bits < 64)
+    FPRINTF (stderr,
+             " - @ %3u%% (estimate)\n",
+             (unsigned int) (checkpoint * 100 / (1LLU << matching_bits)));
+}
+
+
+/**
+ * The proof-of-work calculation is done.
+ *
+ * @param cls the `struct RevocationData`
+ * @param pow the proof of work
+ */
+static void
+calculate_pow_done (void *cls,
+                    uint64_t pow)
+{
+  struct RevocationData *rd = cls;
+
+  pow_search = NULL;
+  rd->pow = pow;
+  sync_rd (rd);
+  if (perform)
   {
-    if ( (NULL != filename) &&
-         (sizeof (struct RevocationData) !=
-          GNUNET_DISK_fn_write (filename,
-                                rd,
-                                sizeof (struct RevocationData),
-                                GNUNET_DISK_PERM_USER_READ |
-                                GNUNET_DISK_PERM_USER_WRITE)) )
-      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
-                                "write",
-                                filename);
-    if (perform)
-    {
-      perform_revocation (rd);
-    }
-    else
-    {
-      FPRINTF (stderr, "%s", "\n");
-      FPRINTF (stderr,
-               _("Revocation certificate for `%s' stored in `%s'\n"),
-               revoke_ego,
-               filename);
-      GNUNET_SCHEDULER_shutdown ();
-    }
-    return;
+    perform_revocation (rd);
   }
-  pow_task = GNUNET_SCHEDULER_add_now (&calculate_pow,
-				       rd);
+  else
+  {
+    FPRINTF (stderr, "%s", "\n");
+    FPRINTF (stderr,
+             _("Revocation certificate for `%s' stored in `%s'\n"),
+             revoke_ego,
+             filename);
+    GNUNET_SCHEDULER_shutdown ();
+  }
+}
+
+
+/**
+ * Start the proof-of-work calculation.
+ *
+ * @param rd revocation data to calculate the proof for
+ */
+static void
+calculate_pow (struct RevocationData *rd)
+{
+  pow_search
+    = GNUNET_CRYPTO_pow_search_start (GNUNET_REVOCATION_POW_SALT,
+                                      &rd->key,
+                                      sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
+                                      rd->pow + 1,
+                                      (unsigned int) matching_bits,
+                                      0,
+                                      GNUNET_TIME_UNIT_ZERO,
+                                      &calculate_pow_progress,
+                                      &calculate_pow_done,
+                                      rd);
+  GNUNET_SCHEDULER_add_shutdown (&calculate_pow_shutdown,
+				 rd);
 }
 
 
@@ -401,10 +418,7 @@ ego_callback (void *cls,
   FPRINTF (stderr,
            "%s",
            _("Revocation certificate not ready, calculating proof of work\n"));
-  pow_task = GNUNET_SCHEDULER_add_now (&calculate_pow,
-				       rd);
-  GNUNET_SCHEDULER_add_shutdown (&calculate_pow_shutdown,
-				 rd);
+  calculate_pow (rd);
 }
 
 
@@ -502,10 +516,7 @@ run (void *cls,
       struct RevocationData *cp = GNUNET_new (struct RevocationData);
 
       *cp = rd;
-      pow_task = GNUNET_SCHEDULER_add_now (&calculate_pow,
-					   cp);
-      GNUNET_SCHEDULER_add_shutdown (&calculate_pow_shutdown,
-				     cp);
+      calculate_pow (cp);
       return;
     }
     perform_revocation (&rd);
@@ -35,6 +35,12 @@
 #include "gnunet_time_lib.h"
 #include "statistics.h"
 
+/**
+ * How often do we pick up changes to counters in shared memory
+ * segments (if nobody asks for them earlier)?
+ */
+#define DEFAULT_SHM_SYNC_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
 /**
  * Watch entry.
  */
@@ -51,11 +57,26 @@ struct WatchEntry
    */
   struct WatchEntry *prev;
 
+  /**
+   * Watch entries of a client are kept in a linked list.
+   */
+  struct WatchEntry *next_client;
+
+  /**
+   * Watch entries of a client are kept in a linked list.
+   */
+  struct WatchEntry *prev_client;
+
   /**
    * For which client is this watch entry?
    */
   struct ClientEntry *ce;
 
+  /**
+   * Which value is watched?
+   */
+  struct StatsEntry *se;
+
   /**
    * Last value we communicated to the client for this watch entry.
    */
@@ -168,6 +189,11 @@ struct SubsystemEntry
    */
   struct StatsEntry *stat_tail;
 
+  /**
+   * Maps the CRC of value names to the `struct StatsEntry`.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *stat_map;
+
   /**
    * Name of the subsystem this entry is for, allocated at
    * the end of this struct, do not free().
@@ -182,6 +208,16 @@ struct SubsystemEntry
  */
 struct ClientEntry
 {
+  /**
+   * Clients with a shared memory segment are kept in a DLL.
+   */
+  struct ClientEntry *next;
+
+  /**
+   * Clients with a shared memory segment are kept in a DLL.
+   */
+  struct ClientEntry *prev;
+
   /**
    * Corresponding server handle.
    */
@@ -197,6 +233,48 @@ struct ClientEntry
    */
   struct SubsystemEntry *subsystem;
 
+  /**
+   * Head of the watch entries of this client.
+   */
+  struct WatchEntry *we_head;
+
+  /**
+   * Tail of the watch entries of this client.
+   */
+  struct WatchEntry *we_tail;
+
+  /**
+   * Subsystem of the counters in the shared memory segment.
+   */
+  struct SubsystemEntry *shm_subsystem;
+
+  /**
+   * Memory file with the shared memory segment we created for the
+   * client, or NULL.
+   */
+  struct GNUNET_DISK_FileHandle *shm_fh;
+
+  /**
+   * Mapping of the shared memory segment.
+   */
+  struct GNUNET_DISK_MapHandle *shm_map;
+
+  /**
+   * The shared memory segment.
+   */
+  struct GNUNET_STATISTICS_ShmHeader *shm;
+
+  /**
+   * Values of the counters in the segment we already applied,
+   * array of length @e shm_slots.
+   */
+  uint64_t *shm_last;
+
+  /**
+   * Number of slots in the segment.
+   */
+  uint32_t shm_slots;
+
   /**
    * Maximum watch ID used by this client so far.
    */
@@ -220,6 +298,31 @@ static struct SubsystemEntry *sub_head;
  */
 static struct SubsystemEntry *sub_tail;
 
+/**
+ * Maps the CRC of subsystem names to the `struct SubsystemEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *sub_map;
+
+/**
+ * Head of the clients with a shared memory segment.
+ */
+static struct ClientEntry *shm_head;
+
+/**
+ * Tail of the clients with a shared memory segment.
+ */
+static struct ClientEntry *shm_tail;
+
+/**
+ * Task picking up changes to counters in shared memory segments.
+ */
+static struct GNUNET_SCHEDULER_Task *shm_task;
+
+/**
+ * How often do we run #shm_task?
+ */
+static struct GNUNET_TIME_Relative shm_sync_frequency;
+
 /**
  * Number of connected clients.
  */
@@ -321,6 +424,7 @@ save ()
       }
       GNUNET_free (pos);
     }
+    GNUNET_CONTAINER_multihashmap32_destroy (se->stat_map);
     GNUNET_free (se);
   }
   if (NULL != wh)
@@ -409,93 +513,6 @@ client_connect_cb (void *cls,
 }
 
 
-/**
- * Check integrity of GET-message.
- *
- * @param cls identification of the client
- * @param message the actual message
- * @return #GNUNET_OK if @a message is well-formed
- */
-static int
-check_get (void *cls,
-	   const struct GNUNET_MessageHeader *message)
-{
-  const char *service;
-  const char *name;
-  size_t size;
-
-  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
-  if (size !=
-      GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
-                                      size,
-                                      2,
-                                      &service,
-                                      &name))
-  {
-    GNUNET_break (0);
-    return GNUNET_SYSERR;
-  }
-  return GNUNET_OK;
-}
-
-
-/**
- * Handle GET-message.
- *
- * @param cls identification of the client
- * @param message the actual message
- */
-static void
-handle_get (void *cls,
-            const struct GNUNET_MessageHeader *message)
-{
-  struct ClientEntry *ce = cls;
-  struct GNUNET_MQ_Envelope *env;
-  struct GNUNET_MessageHeader *end;
-  const char *service;
-  const char *name;
-  size_t slen;
-  size_t nlen;
-  struct SubsystemEntry *se;
-  struct StatsEntry *pos;
-  size_t size;
-
-  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
-  GNUNET_assert (size ==
-		 GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
-						 size,
-						 2,
-						 &service,
-						 &name));
-  slen = strlen (service);
-  nlen = strlen (name);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Received request for statistics on `%s:%s'\n",
-              slen ? service : "*",
-              nlen ? name : "*");
-  for (se = sub_head; NULL != se; se = se->next)
-  {
-    if (! ( (0 == slen) ||
-            (0 == strcmp (service, se->service))) )
-      continue;
-    for (pos = se->stat_head; NULL != pos; pos = pos->next)
-    {
-      if  (! ( (0 == nlen) ||
-               (0 == strcmp (name,
-			     pos->name))) )
-        continue;
-      transmit (ce,
-		pos);
-    }
-  }
-  env = GNUNET_MQ_msg (end,
-		       GNUNET_MESSAGE_TYPE_STATISTICS_END);
-  GNUNET_MQ_send (ce->mq,
-		  env);
-  GNUNET_SERVICE_client_continue (ce->client);
-}
-
-
 /**
  * Notify all clients listening about a change to a value.
  *
@@ -532,6 +549,106 @@ notify_change (struct StatsEntry *se)
 }
 
 
+/**
+ * Compute the key of a subsystem or value name in our maps.
+ *
+ * @param name the name
+ * @return key for the name
+ */
+static uint32_t
+name_key (const char *name)
+{
+  return (uint32_t) GNUNET_CRYPTO_crc32_n (name,
+                                           strlen (name));
+}
+
+
+/**
+ * Closure for #find_subsystem_cb() and #find_stat_cb().
+ */
+struct FindContext
+{
+  /**
+   * Name we are looking for.
+   */
+  const char *name;
+
+  /**
+   * Set to the entry with that name, if found.
+   */
+  void *result;
+};
+
+
+/**
+ * Check if a subsystem entry has the name we are looking for.
+ *
+ * @param cls the `struct FindContext`
+ * @param key unused
+ * @param value a `struct SubsystemEntry`
+ * @return #GNUNET_NO if we found the entry
+ */
+static int
+find_subsystem_cb (void *cls,
+                   uint32_t key,
+                   void *value)
+{
+  struct FindContext *fc = cls;
+  struct SubsystemEntry *se = value;
+
+  if (0 != strcmp (fc->name,
+                   se->service))
+    return GNUNET_YES;
+  fc->result = se;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Check if a statistics entry has the name we are looking for.
+ *
+ * @param cls the `struct FindContext`
+ * @param key unused
+ * @param value a `struct StatsEntry`
+ * @return #GNUNET_NO if we found the entry
+ */
+static int
+find_stat_cb (void *cls,
+              uint32_t key,
+              void *value)
+{
+  struct FindContext *fc = cls;
+  struct StatsEntry *pos = value;
+
+  if (0 != strcmp (fc->name,
+                   pos->name))
+    return GNUNET_YES;
+  fc->result = pos;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Find the subsystem entry of the given name.
+ *
+ * @param service name of the subsystem to look for
+ * @return subsystem entry, or NULL if not found
+ */
+static struct SubsystemEntry *
+lookup_subsystem_entry (const char *service)
+{
+  struct FindContext fc;
+
+  fc.name = service;
+  fc.result = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (sub_map,
+                                                name_key (service),
+                                                &find_subsystem_cb,
+                                                &fc);
+  return fc.result;
+}
+
+
 /**
  * Find the subsystem entry of the given name for the specified client.
  *
@@ -555,10 +672,7 @@ find_subsystem_entry (struct ClientEntry *ce,
        (0 != strcmp (service,
                      se->service)) )
   {
-    for (se = sub_head; NULL != se; se = se->next)
-      if (0 == strcmp (service,
-                       se->service))
-        break;
+    se = lookup_subsystem_entry (service);
     if (NULL != ce)
       ce->subsystem = se;
   }
@@ -574,9 +688,15 @@ find_subsystem_entry (struct ClientEntry *ce,
           service,
           slen);
   se->service = (const char *) &se[1];
+  se->stat_map = GNUNET_CONTAINER_multihashmap32_create (16);
   GNUNET_CONTAINER_DLL_insert (sub_head,
                                sub_tail,
                                se);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (sub_map,
+                                                      name_key (service),
+                                                      se,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
   if (NULL != ce)
     ce->subsystem = se;
   return se;
@@ -594,84 +714,76 @@ static struct StatsEntry *
 find_stat_entry (struct SubsystemEntry *se,
                  const char *name)
 {
-  struct StatsEntry *pos;
-
-  for (pos = se->stat_head; NULL != pos; pos = pos->next)
-    if  (0 == strcmp (name, pos->name))
-      return pos;
-  return NULL;
+  struct FindContext fc;
+
+  fc.name = name;
+  fc.result = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (se->stat_map,
+                                                name_key (name),
+                                                &find_stat_cb,
+                                                &fc);
+  return fc.result;
 }
 
 
 /**
- * Check format of SET-message.
+ * Create a new statistics entry that is not set yet.
  *
- * @param cls the `struct ClientEntry`
- * @param message the actual message
- * @return #GNUNET_OK if message is well-formed
+ * @param se subsystem of the entry
+ * @param name name of the entry
+ * @return the new entry
  */
-static int
-check_set (void *cls,
-	   const struct GNUNET_STATISTICS_SetMessage *msg)
+static struct StatsEntry *
+create_stat_entry (struct SubsystemEntry *se,
+                   const char *name)
 {
-  const char *service;
-  const char *name;
-  size_t msize;
+  struct StatsEntry *pos;
+  size_t nlen;
 
-  msize = ntohs (msg->header.size) - sizeof (*msg);
-  if (msize !=
-      GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
-                                      msize,
-                                      2,
-                                      &service,
-                                      &name))
-  {
-    GNUNET_break (0);
-    return GNUNET_SYSERR;
-  }
-  return GNUNET_OK;
+  nlen = strlen (name) + 1;
+  pos = GNUNET_malloc (sizeof (struct StatsEntry) + nlen);
+  GNUNET_memcpy (&pos[1],
+		 name,
+		 nlen);
+  pos->name = (const char *) &pos[1];
+  pos->subsystem = se;
+  pos->uid = uidgen++;
+  pos->set = GNUNET_NO;
+  GNUNET_CONTAINER_DLL_insert (se->stat_head,
+                               se->stat_tail,
+                               pos);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (se->stat_map,
+                                                      name_key (name),
+                                                      pos,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  return pos;
 }
 
 
 /**
- * Handle SET-message.
+ * Set or update a value.
  *
- * @param cls the `struct ClientEntry`
- * @param message the actual message
+ * @param se subsystem of the value
+ * @param name name of the value
+ * @param flags GNUNET_STATISTICS_SETFLAG_*
+ * @param value new value, or change if @a flags has
+ *        #GNUNET_STATISTICS_SETFLAG_RELATIVE
  */
 static void
-handle_set (void *cls,
-            const struct GNUNET_STATISTICS_SetMessage *msg)
+apply_set (struct SubsystemEntry *se,
+           const char *name,
+           uint32_t flags,
+           uint64_t value)
 {
-  struct ClientEntry *ce = cls;
-  const char *service;
-  const char *name;
-  size_t nlen;
-  uint16_t msize;
-  uint16_t size;
-  struct SubsystemEntry *se;
   struct StatsEntry *pos;
-  uint32_t flags;
-  uint64_t value;
   int64_t delta;
   int changed;
   int initial_set;
 
-  msize = ntohs (msg->header.size);
-  size = msize - sizeof (struct GNUNET_STATISTICS_SetMessage);
-  GNUNET_assert (size ==
-		 GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
-						 size,
-						 2,
-						 &service,
-						 &name));
-  se = find_subsystem_entry (ce,
-			     service);
-  flags = ntohl (msg->flags);
-  value = GNUNET_ntohll (msg->value);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received request to update statistic on `%s:%s' (%u) to/by %llu\n",
-              service,
+              se->service,
               name,
               (unsigned int) flags,
               (unsigned long long) value);
@@ -707,61 +819,522 @@ handle_set (void *cls,
       initial_set = 1;
     }
     pos->persistent = (0 != (flags & GNUNET_STATISTICS_SETFLAG_PERSISTENT));
-    if (pos != se->stat_head)
-    {
-      /* move to front for faster setting next time! */
-      GNUNET_CONTAINER_DLL_remove (se->stat_head,
-                                   se->stat_tail,
-                                   pos);
-      GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                                   se->stat_tail,
-                                   pos);
-    }
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Statistic `%s:%s' updated to value %llu (%d).\n",
-                service,
+                se->service,
                 name,
                 (unsigned long long) pos->value,
                 pos->persistent);
     if ( (changed) ||
          (1 == initial_set) )
       notify_change (pos);
-    GNUNET_SERVICE_client_continue (ce->client);
     return;
   }
   /* not found, create a new entry */
-  nlen = strlen (name) + 1;
-  pos = GNUNET_malloc (sizeof (struct StatsEntry) + nlen);
-  GNUNET_memcpy (&pos[1],
-		 name,
-		 nlen);
-  pos->name = (const char *) &pos[1];
-  pos->subsystem = se;
+  pos = create_stat_entry (se,
+                           name);
   if ( (0 == (flags & GNUNET_STATISTICS_SETFLAG_RELATIVE)) ||
-       (0 < (int64_t) GNUNET_ntohll (msg->value)) )
+       (0 < (int64_t) value) )
   {
-    pos->value = GNUNET_ntohll (msg->value);
+    pos->value = value;
     pos->set = GNUNET_YES;
   }
-  else
-  {
-    pos->set = GNUNET_NO;
-  }
-  pos->uid = uidgen++;
   pos->persistent = (0 != (flags & GNUNET_STATISTICS_SETFLAG_PERSISTENT));
-  GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                               se->stat_tail,
-                               pos);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "New statistic on `%s:%s' with value %llu created.\n",
-              service,
+              se->service,
               name,
               (unsigned long long) pos->value);
+}
+
+
+/**
+ * Apply the changes to the counters in the shared memory segment
+ * of a client.
+ *
+ * @param ce client with a shared memory segment
+ */
+static void
+sync_shm (struct ClientEntry *ce)
+{
+  const struct GNUNET_STATISTICS_ShmSlot *slots;
+  const struct GNUNET_STATISTICS_ShmSlot *slot;
+  uint32_t used;
+  uint32_t i;
+  uint64_t value;
+
+  slots = (const struct GNUNET_STATISTICS_ShmSlot *) &ce->shm[1];
+  /* pairs with the release store of the client, makes the names
+     of the slots visible; the client may write anything here, so
+     never trust it beyond the size of the segment */
+  used = __atomic_load_n (&ce->shm->used_slots,
+                          __ATOMIC_ACQUIRE);
+  used = GNUNET_MIN (used,
+                     ce->shm_slots);
+  for (i = 0; i < used; i++)
+  {
+    slot = &slots[i];
+    value = __atomic_load_n (&slot->value,
+                             __ATOMIC_RELAXED);
+    if (value == ce->shm_last[i])
+      continue;
+    if (NULL == memchr (slot->name,
+                        '\0',
+                        sizeof (slot->name)))
+    {
+      GNUNET_break_op (0);
+      ce->shm_last[i] = value;
+      continue;
+    }
+    apply_set (ce->shm_subsystem,
+               slot->name,
+               GNUNET_STATISTICS_SETFLAG_RELATIVE
+               | (slot->flags & GNUNET_STATISTICS_SETFLAG_PERSISTENT),
+               value - ce->shm_last[i]);
+    ce->shm_last[i] = value;
+  }
+}
+
+
+/**
+ * Apply the changes to the counters in all shared memory segments.
+ */
+static void
+sync_all_shm ()
+{
+  struct ClientEntry *ce;
+
+  for (ce = shm_head; NULL != ce; ce = ce->next)
+    sync_shm (ce);
+}
+
+
+/**
+ * Task that periodically picks up changes to the counters in shared
+ * memory segments.
+ *
+ * @param cls NULL
+ */
+static void
+shm_sync_task (void *cls)
+{
+  shm_task = NULL;
+  sync_all_shm ();
+  if (NULL != shm_head)
+    shm_task = GNUNET_SCHEDULER_add_delayed (shm_sync_frequency,
+                                             &shm_sync_task,
+                                             NULL);
+}
+
+
+/**
+ * Release the shared memory segment of a client.
+ *
+ * @param ce client with a shared memory segment
+ */
+static void
+detach_shm (struct ClientEntry *ce)
+{
+  if (NULL == ce->shm_fh)
+    return;
+  GNUNET_CONTAINER_DLL_remove (shm_head,
+                               shm_tail,
+                               ce);
+  if (NULL != ce->shm_map)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (ce->shm_map));
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (ce->shm_fh));
+  GNUNET_free_non_null (ce->shm_last);
+  ce->shm_fh = NULL;
+  ce->shm_map = NULL;
+  ce->shm = NULL;
+  ce->shm_last = NULL;
+  ce->shm_slots = 0;
+  if ( (NULL == shm_head) &&
+       (NULL != shm_task) )
+  {
+    GNUNET_SCHEDULER_cancel (shm_task);
+    shm_task = NULL;
+  }
+}
+
+
+/**
+ * Check integrity of GET-message.
+ *
+ * @param cls identification of the client
+ * @param message the actual message
+ * @return #GNUNET_OK if @a message is well-formed
+ */
+static int
+check_get (void *cls,
+	   const struct GNUNET_MessageHeader *message)
+{
+  const char *service;
+  const char *name;
+  size_t size;
+
+  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
+  if (size !=
+      GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
+                                      size,
+                                      2,
+                                      &service,
+                                      &name))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Transmit the matching values of a subsystem.
+ *
+ * @param ce receiver of the values
+ * @param se subsystem to transmit values of
+ * @param name name of the value to transmit, empty for all
+ */
+static void
+transmit_subsystem (struct ClientEntry *ce,
+                    struct SubsystemEntry *se,
+                    const char *name)
+{
+  struct StatsEntry *pos;
+
+  if ('\0' != *name)
+  {
+    pos = find_stat_entry (se,
+                           name);
+    if (NULL != pos)
+      transmit (ce,
+                pos);
+    return;
+  }
+  for (pos = se->stat_head; NULL != pos; pos = pos->next)
+    transmit (ce,
+              pos);
+}
+
+
+/**
+ * Handle GET-message.
+ *
+ * @param cls identification of the client
+ * @param message the actual message
+ */
+static void
+handle_get (void *cls,
+            const struct GNUNET_MessageHeader *message)
+{
+  struct ClientEntry *ce = cls;
+  struct GNUNET_MQ_Envelope *env;
+  struct GNUNET_MessageHeader *end;
+  const char *service;
+  const char *name;
+  size_t slen;
+  size_t nlen;
+  struct SubsystemEntry *se;
+  size_t size;
+
+  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
+  GNUNET_assert (size ==
+		 GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
+						 size,
+						 2,
+						 &service,
+						 &name));
+  slen = strlen (service);
+  nlen = strlen (name);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Received request for statistics on `%s:%s'\n",
+              slen ? service : "*",
+              nlen ? name : "*");
+  sync_all_shm ();
+  if (0 != slen)
+  {
+    se = lookup_subsystem_entry (service);
+    if (NULL != se)
+      transmit_subsystem (ce,
+                          se,
+                          name);
+  }
+  else
+  {
+    for (se = sub_head; NULL != se; se = se->next)
+      transmit_subsystem (ce,
+                          se,
+                          name);
+  }
+  env = GNUNET_MQ_msg (end,
+		       GNUNET_MESSAGE_TYPE_STATISTICS_END);
+  GNUNET_MQ_send (ce->mq,
+		  env);
+  GNUNET_SERVICE_client_continue (ce->client);
+}
+
+
+/**
+ * Check format of SET-message.
+ *
+ * @param cls the `struct ClientEntry`
+ * @param message the actual message
+ * @return #GNUNET_OK if message is well-formed
+ */
+static int
+check_set (void *cls,
+	   const struct GNUNET_STATISTICS_SetMessage *msg)
+{
+  const char *service;
+  const char *name;
+  size_t msize;
+
+  msize = ntohs (msg->header.size) - sizeof (*msg);
+  if (msize !=
+      GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
+                                      msize,
+                                      2,
+                                      &service,
+                                      &name))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Handle SET-message.
+ *
+ * @param cls the `struct ClientEntry`
+ * @param message the actual message
+ */
+static void
+handle_set (void *cls,
+            const struct GNUNET_STATISTICS_SetMessage *msg)
+{
+  struct ClientEntry *ce = cls;
+  const char *service;
+  const char *name;
+  uint16_t msize;
+  uint16_t size;
+  struct SubsystemEntry *se;
+
+  msize = ntohs (msg->header.size);
+  size = msize - sizeof (struct GNUNET_STATISTICS_SetMessage);
+  GNUNET_assert (size ==
+		 GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
+						 size,
+						 2,
+						 &service,
+						 &name));
+  /* changes the client made to its counters before sending
+     this message must be applied first */
+  if ( (NULL != ce) &&
+       (NULL != ce->shm) )
+    sync_shm (ce);
+  se = find_subsystem_entry (ce,
+			     service);
+  apply_set (se,
+             name,
+             ntohl (msg->flags),
+             GNUNET_ntohll (msg->value));
   if (NULL != ce)
     GNUNET_SERVICE_client_continue (ce->client);
 }
 
 
+/**
+ * Check format of SHM_ATTACH-message.
+ *
+ * @param cls the `struct ClientEntry`
+ * @param msg the actual message
+ * @return #GNUNET_OK if message is well-formed
+ */
+static int
+check_shm_attach (void *cls,
+                  const struct GNUNET_STATISTICS_ShmAttachMessage *msg)
+{
+  const char *service;
+  size_t msize;
+
+  msize = ntohs (msg->header.size) - sizeof (*msg);
+  if (msize !=
+      GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
+                                      msize,
+                                      1,
+                                      &service))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create a shared memory segment with @a num_slots counters for a
+ * client.  The segment is a memory file we own and seal against
+ * resizing, so the client can map it but cannot truncate it while
+ * we have it mapped.
+ *
+ * @param ce client to create the segment for
+ * @param num_slots number of slots in the segment
+ * @return #GNUNET_OK on success
+ */
+static int
+create_shm (struct ClientEntry *ce,
+            uint32_t num_slots)
+{
+#if HAVE_MEMFD_CREATE
+  size_t len;
+  int fd;
+
+  len = sizeof (struct GNUNET_STATISTICS_ShmHeader)
+    + num_slots * sizeof (struct GNUNET_STATISTICS_ShmSlot);
+  fd = memfd_create ("gnunet-statistics-shm",
+                     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (-1 == fd)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "memfd_create");
+    return GNUNET_SYSERR;
+  }
+  if ( (0 != FTRUNCATE (fd,
+                        len)) ||
+       (0 != fcntl (fd,
+                    F_ADD_SEALS,
+                    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "fcntl");
+    GNUNET_break (0 == CLOSE (fd));
+    return GNUNET_SYSERR;
+  }
+  ce->shm_fh = GNUNET_DISK_get_handle_from_int_fd (fd);
+  if (NULL == ce->shm_fh)
+  {
+    GNUNET_break (0 == CLOSE (fd));
+    return GNUNET_SYSERR;
+  }
+  ce->shm = GNUNET_DISK_file_map (ce->shm_fh,
+                                  &ce->shm_map,
+                                  GNUNET_DISK_MAP_TYPE_READWRITE,
+                                  len);
+  if (NULL == ce->shm)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "mmap");
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (ce->shm_fh));
+    ce->shm_fh = NULL;
+    ce->shm_map = NULL;
+    return GNUNET_SYSERR;
+  }
+  ce->shm->magic = GNUNET_STATISTICS_SHM_MAGIC;
+  ce->shm->num_slots = num_slots;
+  ce->shm->used_slots = 0;
+  return GNUNET_OK;
+#else
+  return GNUNET_SYSERR;
+#endif
+}
+
+
+/**
+ * Handle SHM_ATTACH-message.  Create a shared memory segment for the
+ * client and tell it where to map it from, or tell the client that
+ * we cannot.
+ *
+ * @param cls the `struct ClientEntry`
+ * @param msg the actual message
+ */
+static void
+handle_shm_attach (void *cls,
+                   const struct GNUNET_STATISTICS_ShmAttachMessage *msg)
+{
+  struct ClientEntry *ce = cls;
+  struct GNUNET_MQ_Envelope *env;
+  struct GNUNET_MessageHeader *reject;
+  struct GNUNET_STATISTICS_ShmGrantMessage *gm;
+  const char *service;
+  char *fn;
+  uint16_t size;
+  uint32_t num_slots;
+  size_t flen;
+
+  size = ntohs (msg->header.size) - sizeof (*msg);
+  GNUNET_assert (size ==
+                 GNUNET_STRINGS_buffer_tokenize ((const char *) &msg[1],
+                                                 size,
+                                                 1,
+                                                 &service));
+  num_slots = ntohl (msg->num_slots);
+  if ( (NULL != ce->shm_fh) ||
+       (0 == num_slots) ||
+       (num_slots > GNUNET_MAX_MALLOC_CHECKED
+        / sizeof (struct GNUNET_STATISTICS_ShmSlot)) )
+  {
+    GNUNET_break (0);
+    GNUNET_SERVICE_client_drop (ce->client);
+    return;
+  }
+  if (GNUNET_OK !=
+      create_shm (ce,
+                  num_slots))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Cannot share counters of `%s'\n"),
+                service);
+    env = GNUNET_MQ_msg (reject,
+                         GNUNET_MESSAGE_TYPE_STATISTICS_SHM_REJECT);
+    GNUNET_MQ_send (ce->mq,
+                    env);
+    GNUNET_SERVICE_client_continue (ce->client);
+    return;
+  }
+  /* the client opens the segment through our descriptor; that only
+     works on the same host and with the permission to inspect us,
+     otherwise it falls back to IPC */
+  GNUNET_asprintf (&fn,
+                   "/proc/%u/fd/%d",
+                   (unsigned int) getpid (),
+                   ce->shm_fh->fd);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sharing %u counters of `%s' via `%s'\n",
+              (unsigned int) num_slots,
+              service,
+              fn);
+  flen = strlen (fn) + 1;
+  env = GNUNET_MQ_msg_extra (gm,
+                             flen,
+                             GNUNET_MESSAGE_TYPE_STATISTICS_SHM_GRANT);
+  gm->num_slots = htonl (num_slots);
+  GNUNET_memcpy (&gm[1],
+                 fn,
+                 flen);
+  GNUNET_free (fn);
+  GNUNET_MQ_send (ce->mq,
+                  env);
+  ce->shm_slots = num_slots;
+  ce->shm_last = GNUNET_new_array (num_slots,
+                                   uint64_t);
+  ce->shm_subsystem = find_subsystem_entry (NULL,
+                                            service);
+  GNUNET_CONTAINER_DLL_insert (shm_head,
+                               shm_tail,
+                               ce);
+  if (NULL == shm_task)
+    shm_task = GNUNET_SCHEDULER_add_delayed (shm_sync_frequency,
+                                             &shm_sync_task,
+                                             NULL);
+  GNUNET_SERVICE_client_continue (ce->client);
+}
+
+
 /**
  * Check integrity of WATCH-message.
  *
@@ -810,7 +1383,6 @@ handle_watch (void *cls,
   struct SubsystemEntry *se;
   struct StatsEntry *pos;
   struct WatchEntry *we;
-  size_t nlen;
 
   if (NULL == nc)
   {
@@ -830,25 +1402,15 @@ handle_watch (void *cls,
               "Received request to watch statistic on `%s:%s'\n",
               service,
               name);
+  sync_all_shm ();
   se = find_subsystem_entry (ce,
 			     service);
   pos = find_stat_entry (se,
 			 name);
   if (NULL == pos)
   {
-    nlen = strlen (name) + 1;
-    pos = GNUNET_malloc (sizeof (struct StatsEntry) +
-                         nlen);
-    GNUNET_memcpy (&pos[1],
-		   name,
-		   nlen);
-    pos->name = (const char *) &pos[1];
-    pos->subsystem = se;
-    GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                                 se->stat_tail,
-                                 pos);
-    pos->uid = uidgen++;
-    pos->set = GNUNET_NO;
+    pos = create_stat_entry (se,
+                             name);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "New statistic on `%s:%s' with value %llu created.\n",
                 service,
@@ -857,11 +1419,16 @@ handle_watch (void *cls,
   }
   we = GNUNET_new (struct WatchEntry);
   we->ce = ce;
+  we->se = pos;
   we->last_value_set = GNUNET_NO;
   we->wid = ce->max_wid++;
   GNUNET_CONTAINER_DLL_insert (pos->we_head,
                                pos->we_tail,
                                we);
+  GNUNET_CONTAINER_MDLL_insert (client,
+                                ce->we_head,
+                                ce->we_tail,
+                                we);
   if (0 != pos->value)
     notify_change (pos);
   GNUNET_SERVICE_client_continue (ce->client);
@@ -884,6 +1451,8 @@ handle_disconnect (void *cls,
   struct GNUNET_MQ_Envelope *env;
   struct GNUNET_MessageHeader *msg;
 
+  if (NULL != ce->shm)
+    sync_shm (ce);
   env = GNUNET_MQ_msg (msg,
 		       GNUNET_MESSAGE_TYPE_STATISTICS_DISCONNECT_CONFIRM);
   GNUNET_MQ_send (ce->mq,
@@ -904,6 +1473,11 @@ do_shutdown ()
 
   if (NULL == nc)
     return;
+  if (NULL != shm_task)
+  {
+    GNUNET_SCHEDULER_cancel (shm_task);
+    shm_task = NULL;
+  }
   save ();
   GNUNET_notification_context_destroy (nc);
   nc = NULL;
@@ -928,8 +1502,11 @@ do_shutdown ()
       }
       GNUNET_free (pos);
     }
+    GNUNET_CONTAINER_multihashmap32_destroy (se->stat_map);
     GNUNET_free (se);
   }
+  GNUNET_CONTAINER_multihashmap32_destroy (sub_map);
+  sub_map = NULL;
 }
 
 
@@ -962,28 +1539,25 @@ client_disconnect_cb (void *cls,
 {
   struct ClientEntry *ce = app_cls;
   struct WatchEntry *we;
-  struct WatchEntry *wen;
-  struct StatsEntry *pos;
-  struct SubsystemEntry *se;
 
   client_count--;
-  for (se = sub_head; NULL != se; se = se->next)
+  while (NULL != (we = ce->we_head))
   {
-    for (pos = se->stat_head; NULL != pos; pos = pos->next)
-    {
-      wen = pos->we_head;
-      while (NULL != (we = wen))
-      {
-        wen = we->next;
-        if (we->ce != ce)
-          continue;
-        GNUNET_CONTAINER_DLL_remove (pos->we_head,
-                                     pos->we_tail,
-                                     we);
-        GNUNET_free (we);
-      }
-    }
+    GNUNET_CONTAINER_MDLL_remove (client,
+                                  ce->we_head,
+                                  ce->we_tail,
+                                  we);
+    GNUNET_CONTAINER_DLL_remove (we->se->we_head,
+                                 we->se->we_tail,
+                                 we);
+    GNUNET_free (we);
+  }
+  if (NULL != ce->shm)
+  {
+    /* pick up the last changes the client made */
+    sync_shm (ce);
   }
+  detach_shm (ce);
   GNUNET_free (ce);
   if ( (0 == client_count) &&
        (GNUNET_YES == in_shutdown) )
@@ -1116,6 +1690,13 @@ run (void *cls,
      struct GNUNET_SERVICE_Handle *service)
 {
   cfg = c;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "STATISTICS",
+                                           "SHM_SYNC_FREQUENCY",
+                                           &shm_sync_frequency))
+    shm_sync_frequency = DEFAULT_SHM_SYNC_FREQUENCY;
+  sub_map = GNUNET_CONTAINER_multihashmap32_create (16);
   nc = GNUNET_notification_context_create (16);
   load ();
   GNUNET_SCHEDULER_add_shutdown (&shutdown_task,
@@ -1149,6 +1730,10 @@ GNUNET_SERVICE_MAIN
 			  GNUNET_MESSAGE_TYPE_STATISTICS_DISCONNECT,
 			  struct GNUNET_MessageHeader,
 			  NULL),
+ GNUNET_MQ_hd_var_size (shm_attach,
+                        GNUNET_MESSAGE_TYPE_STATISTICS_SHM_ATTACH,
+                        struct GNUNET_STATISTICS_ShmAttachMessage,
+                        NULL),
  GNUNET_MQ_handler_end ());
 
 
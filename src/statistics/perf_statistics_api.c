@@ -0,0 +1,340 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file statistics/perf_statistics_api.c
+ * @brief measure how many updates per second we can make to many
+ *        distinct values, via IPC and via shared memory counters
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_statistics_service.h"
+#include <gauger.h>
+
+/**
+ * Number of distinct values we update.
+ */
+#define NUM_COUNTERS (10 * 1000)
+
+/**
+ * Number of updates we make.
+ */
+#define ROUNDS (1000 * 1000)
+
+/**
+ * Handle for the updates via IPC.
+ */
+static struct GNUNET_STATISTICS_Handle *h_ipc;
+
+/**
+ * Handle for the updates via shared memory.
+ */
+static struct GNUNET_STATISTICS_Handle *h_shm;
+
+/**
+ * Names of the values.
+ */
+static char *names[NUM_COUNTERS];
+
+/**
+ * Counters of the values for the updates via shared memory.
+ */
+static struct GNUNET_STATISTICS_Counter *counters[NUM_COUNTERS];
+
+/**
+ * When did the current measurement start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Value we read back from the service.
+ */
+static uint64_t result;
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+/**
+ * Return value from main, 0 on success.
+ */
+static int ok = 1;
+
+
+/**
+ * Print a measurement.
+ *
+ * @param what what we measured
+ * @param updates number of updates made
+ * @param duration time it took
+ */
+static void
+report (const char *what,
+        unsigned int updates,
+        struct GNUNET_TIME_Relative duration)
+{
+  double rate;
+
+  rate = updates * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  printf ("%-40s %14.0f updates/s\n",
+          what,
+          rate);
+  GAUGER ("STATISTICS", what, rate, "updates/s");
+}
+
+
+/**
+ * Remember the value we read back.
+ *
+ * @param cls NULL
+ * @param subsystem name of the subsystem
+ * @param name name of the value
+ * @param value the value
+ * @param is_persistent unused
+ * @return #GNUNET_OK
+ */
+static int
+get_value (void *cls,
+           const char *subsystem,
+           const char *name,
+           uint64_t value,
+           int is_persistent)
+{
+  result = value;
+  return GNUNET_OK;
+}
+
+
+/**
+ * All updates via shared memory were applied, we are done.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK on success
+ */
+static void
+shm_done (void *cls,
+          int success)
+{
+  report ("shared memory counters, applied",
+          ROUNDS,
+          GNUNET_TIME_absolute_get_duration (start));
+  if ( (GNUNET_OK == success) &&
+       (ROUNDS / NUM_COUNTERS == result) )
+    ok = 0;
+  else
+    fprintf (stderr,
+             "Expected %u, got %llu\n",
+             ROUNDS / NUM_COUNTERS,
+             (unsigned long long) result);
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * The service answered our first request, so it also granted us
+ * the shared memory segment (if it can).  Update values via shared
+ * memory counters.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK on success
+ */
+static void
+shm_granted (void *cls,
+             int success)
+{
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < ROUNDS; i++)
+    GNUNET_STATISTICS_counter_add (counters[i % NUM_COUNTERS],
+                                   1);
+  report ("shared memory counters, issued",
+          ROUNDS,
+          GNUNET_TIME_absolute_get_duration (start));
+  result = 0;
+  GNUNET_break (NULL !=
+                GNUNET_STATISTICS_get (h_shm,
+                                       "perf-statistics-api-shm",
+                                       names[NUM_COUNTERS - 1],
+                                       &shm_done,
+                                       &get_value,
+                                       NULL));
+}
+
+
+/**
+ * Obtain the shared memory counters and wait for the segment.
+ */
+static void
+run_shm ()
+{
+  h_shm = GNUNET_STATISTICS_create ("perf-statistics-api-shm",
+                                    cfg);
+  for (unsigned int i = 0; i < NUM_COUNTERS; i++)
+    counters[i] = GNUNET_STATISTICS_counter_get (h_shm,
+                                                 names[i],
+                                                 GNUNET_NO);
+  GNUNET_break (NULL !=
+                GNUNET_STATISTICS_get (h_shm,
+                                       "perf-statistics-api-shm",
+                                       names[0],
+                                       &shm_granted,
+                                       &get_value,
+                                       NULL));
+}
+
+
+/**
+ * All updates via IPC were applied, continue with shared memory.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK on success
+ */
+static void
+ipc_done (void *cls,
+          int success)
+{
+  report ("IPC updates, applied",
+          ROUNDS,
+          GNUNET_TIME_absolute_get_duration (start));
+  if ( (GNUNET_OK != success) ||
+       (ROUNDS / NUM_COUNTERS != result) )
+  {
+    fprintf (stderr,
+             "Expected %u, got %llu\n",
+             ROUNDS / NUM_COUNTERS,
+             (unsigned long long) result);
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  run_shm ();
+}
+
+
+/**
+ * Clean up.
+ *
+ * @param cls NULL
+ */
+static void
+do_shutdown (void *cls)
+{
+  if (NULL != h_ipc)
+  {
+    GNUNET_STATISTICS_destroy (h_ipc,
+                               GNUNET_NO);
+    h_ipc = NULL;
+  }
+  if (NULL != h_shm)
+  {
+    GNUNET_STATISTICS_destroy (h_shm,
+                               GNUNET_NO);
+    h_shm = NULL;
+  }
+}
+
+
+/**
+ * Update values via IPC.
+ *
+ * @param cls NULL
+ * @param args remaining command-line arguments
+ * @param cfgfile name of the configuration file used (for saving, can be NULL!)
+ * @param c configuration
+ */
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *c)
+{
+  cfg = c;
+  GNUNET_SCHEDULER_add_shutdown (&do_shutdown,
+                                 NULL);
+  h_ipc = GNUNET_STATISTICS_create ("perf-statistics-api-ipc",
+                                    cfg);
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < ROUNDS; i++)
+    GNUNET_STATISTICS_update (h_ipc,
+                              names[i % NUM_COUNTERS],
+                              1,
+                              GNUNET_NO);
+  report ("IPC updates, issued",
+          ROUNDS,
+          GNUNET_TIME_absolute_get_duration (start));
+  result = 0;
+  GNUNET_break (NULL !=
+                GNUNET_STATISTICS_get (h_ipc,
+                                       "perf-statistics-api-ipc",
+                                       names[NUM_COUNTERS - 1],
+                                       &ipc_done,
+                                       &get_value,
+                                       NULL));
+}
+
+
+int
+main (int argc,
+      char *argv_ign[])
+{
+  char *const argv[] = {
+    "perf-statistics-api",
+    "-c",
+    "perf_statistics_api_data.conf",
+    NULL
+  };
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+  struct GNUNET_OS_Process *proc;
+  char *binary;
+
+  for (unsigned int i = 0; i < NUM_COUNTERS; i++)
+    GNUNET_asprintf (&names[i],
+                     "# counter %u",
+                     i);
+  binary = GNUNET_OS_get_libexec_binary_path ("gnunet-service-statistics");
+  proc = GNUNET_OS_start_process (GNUNET_YES,
+                                  GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
+                                  NULL, NULL, NULL,
+                                  binary,
+                                  "gnunet-service-statistics",
+                                  "-c", "perf_statistics_api_data.conf",
+                                  NULL);
+  GNUNET_assert (NULL != proc);
+  GNUNET_PROGRAM_run (3, argv,
+                      "perf-statistics-api", "nohelp",
+                      options,
+                      &run,
+                      NULL);
+  if (0 != GNUNET_OS_process_kill (proc,
+                                   GNUNET_TERM_SIG))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "kill");
+    ok = 1;
+  }
+  GNUNET_OS_process_wait (proc);
+  GNUNET_OS_process_destroy (proc);
+  GNUNET_free (binary);
+  for (unsigned int i = 0; i < NUM_COUNTERS; i++)
+    GNUNET_free (names[i]);
+  return ok;
+}
+
+/* end of perf_statistics_api.c */
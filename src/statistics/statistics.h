@@ -147,6 +147,109 @@ struct GNUNET_STATISTICS_WatchValueMessage
   uint64_t value GNUNET_PACKED;
 
 };
+
+
+/**
+ * Message asking the service for a shared memory segment with
+ * counters.  Followed by the 0-terminated subsystem name.
+ */
+struct GNUNET_STATISTICS_ShmAttachMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_STATISTICS_SHM_ATTACH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of slots the client wants.
+   */
+  uint32_t num_slots GNUNET_PACKED;
+
+};
+
+
+/**
+ * Message granting a shared memory segment to the client.  Followed
+ * by the 0-terminated name of the file to map the segment from.
+ */
+struct GNUNET_STATISTICS_ShmGrantMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_STATISTICS_SHM_GRANT
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of slots in the segment.
+   */
+  uint32_t num_slots GNUNET_PACKED;
+
+};
 GNUNET_NETWORK_STRUCT_END
 
+
+/**
+ * Magic number at the beginning of a shared memory segment.
+ */
+#define GNUNET_STATISTICS_SHM_MAGIC 0x53544131
+
+/**
+ * Maximum length of the name of a counter in a shared memory
+ * segment, including the 0-terminator.
+ */
+#define GNUNET_STATISTICS_SHM_NAME_LEN 108
+
+/**
+ * Shared memory segments are only ever accessed on the local host,
+ * so the header and slots use host byte order.  The header is
+ * followed by `num_slots` slots.
+ */
+struct GNUNET_STATISTICS_ShmHeader
+{
+  /**
+   * #GNUNET_STATISTICS_SHM_MAGIC
+   */
+  uint32_t magic;
+
+  /**
+   * Number of slots in the segment.
+   */
+  uint32_t num_slots;
+
+  /**
+   * Number of slots in use.  Only incremented (with release
+   * semantics) once the name of the slot has been written.
+   */
+  uint32_t used_slots;
+
+  /**
+   * Reserved (always 0).
+   */
+  uint32_t reserved;
+};
+
+
+/**
+ * A counter in a shared memory segment.
+ */
+struct GNUNET_STATISTICS_ShmSlot
+{
+  /**
+   * Sum of all changes to the counter made by the client since
+   * the segment was created, updated with atomic operations.
+   * Negative changes wrap around.
+   */
+  uint64_t value;
+
+  /**
+   * #GNUNET_STATISTICS_SETFLAG_PERSISTENT or 0.
+   */
+  uint32_t flags;
+
+  /**
+   * Name of the counter, 0-terminated.
+   */
+  char name[GNUNET_STATISTICS_SHM_NAME_LEN];
+};
+
 #endif
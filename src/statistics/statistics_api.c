@@ -95,6 +95,36 @@ struct GNUNET_STATISTICS_WatchEntry
 };
 
 
+/**
+ * Counter of our subsystem that we update without IPC if we can.
+ */
+struct GNUNET_STATISTICS_Counter
+{
+
+  /**
+   * Main statistics handle.
+   */
+  struct GNUNET_STATISTICS_Handle *sh;
+
+  /**
+   * Name of the counter.
+   */
+  char *name;
+
+  /**
+   * Slot of the counter in our shared memory segment, NULL if we
+   * have to use #GNUNET_STATISTICS_update().
+   */
+  struct GNUNET_STATISTICS_ShmSlot *slot;
+
+  /**
+   * Should the value be kept across restarts?
+   */
+  int make_persistent;
+
+};
+
+
 /**
  * Linked list of things we still need to do.
  */
@@ -205,6 +235,18 @@ struct GNUNET_STATISTICS_Handle
    */
   struct GNUNET_STATISTICS_GetHandle *action_tail;
 
+  /**
+   * Maps the CRC of value names to the pending #ACTION_SET and
+   * #ACTION_UPDATE actions for them.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *setters;
+
+  /**
+   * Maps the CRC of value names to our `struct GNUNET_STATISTICS_Counter`s,
+   * NULL if we have no counters.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *counters;
+
   /**
    * Action we are currently busy with (action request has been
    * transmitted, we're now receiving the response from the
@@ -212,6 +254,22 @@ struct GNUNET_STATISTICS_Handle
    */
   struct GNUNET_STATISTICS_GetHandle *current;
 
+  /**
+   * File with the shared memory segment the service granted us, or
+   * NULL.
+   */
+  struct GNUNET_DISK_FileHandle *shm_fh;
+
+  /**
+   * Mapping of our shared memory segment.
+   */
+  struct GNUNET_DISK_MapHandle *shm_map;
+
+  /**
+   * Our shared memory segment with counters.
+   */
+  struct GNUNET_STATISTICS_ShmHeader *shm;
+
   /**
    * Array of watch entries.
    */
@@ -247,6 +305,18 @@ struct GNUNET_STATISTICS_Handle
    */
   unsigned int watches_size;
 
+  /**
+   * Number of slots to use for a shared memory segment, 0 to
+   * not use one.
+   */
+  unsigned int shm_slots;
+
+  /**
+   * Did we ask the service for a shared memory segment on the
+   * current connection?
+   */
+  int shm_requested;
+
   /**
    * Should this handle auto-destruct once all actions have
    * been processed?
@@ -330,6 +400,23 @@ static void
 schedule_action (void *cls);
 
 
+/**
+ * Queue a request to change a statistic.
+ *
+ * @param h statistics handle
+ * @param name name of the value
+ * @param make_persistent  should the value be kept across restarts?
+ * @param value new value or change
+ * @param type type of the action (#ACTION_SET or #ACTION_UPDATE)
+ */
+static void
+add_setter_action (struct GNUNET_STATISTICS_Handle *h,
+                   const char *name,
+                   int make_persistent,
+                   uint64_t value,
+                   enum ActionType type);
+
+
 /**
  * Transmit request to service that we want to watch
  * the development of a particular value.
@@ -384,6 +471,172 @@ free_action_item (struct GNUNET_STATISTICS_GetHandle *gh)
 }
 
 
+/**
+ * Compute the key of a value name in our maps.
+ *
+ * @param name the name
+ * @return key for the name
+ */
+static uint32_t
+name_key (const char *name)
+{
+  return (uint32_t) GNUNET_CRYPTO_crc32_n (name,
+                                           strlen (name));
+}
+
+
+/**
+ * Remove an action from the list of pending actions.
+ *
+ * @param h statistics handle
+ * @param ai action to remove
+ */
+static void
+dequeue_action (struct GNUNET_STATISTICS_Handle *h,
+                struct GNUNET_STATISTICS_GetHandle *ai)
+{
+  GNUNET_CONTAINER_DLL_remove (h->action_head,
+                               h->action_tail,
+                               ai);
+  if ( (ACTION_SET == ai->type) ||
+       (ACTION_UPDATE == ai->type) )
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap32_remove (h->setters,
+                                                           name_key (ai->name),
+                                                           ai));
+}
+
+
+/**
+ * Release our shared memory segment.
+ *
+ * @param h statistics handle
+ */
+static void
+release_shm (struct GNUNET_STATISTICS_Handle *h)
+{
+  if (NULL == h->shm_fh)
+    return;
+  if (NULL != h->shm_map)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (h->shm_map));
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (h->shm_fh));
+  h->shm_fh = NULL;
+  h->shm_map = NULL;
+  h->shm = NULL;
+}
+
+
+/**
+ * Stop using the slot of a counter.
+ *
+ * @param cls the `struct GNUNET_STATISTICS_Handle`
+ * @param key unused
+ * @param value a `struct GNUNET_STATISTICS_Counter`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+unslot_counter (void *cls,
+                uint32_t key,
+                void *value)
+{
+  struct GNUNET_STATISTICS_Counter *counter = value;
+
+  counter->slot = NULL;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Stop using our shared memory segment.  The segment belongs to the
+ * service, which picks up the last changes to it once it notices
+ * that we are gone.  Until the service grants us a new segment,
+ * changes to our counters go via IPC.
+ *
+ * @param h statistics handle
+ */
+static void
+drop_shm (struct GNUNET_STATISTICS_Handle *h)
+{
+  if (NULL == h->shm)
+    return;
+  GNUNET_CONTAINER_multihashmap32_iterate (h->counters,
+                                           &unslot_counter,
+                                           h);
+  release_shm (h);
+}
+
+
+/**
+ * Give a counter a slot in our shared memory segment, if we have
+ * one and there is room for it.
+ *
+ * @param cls the `struct GNUNET_STATISTICS_Handle`
+ * @param key unused
+ * @param value a `struct GNUNET_STATISTICS_Counter`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+slot_counter (void *cls,
+              uint32_t key,
+              void *value)
+{
+  struct GNUNET_STATISTICS_Handle *h = cls;
+  struct GNUNET_STATISTICS_Counter *counter = value;
+  struct GNUNET_STATISTICS_ShmSlot *slot;
+  size_t nlen;
+
+  nlen = strlen (counter->name) + 1;
+  if ( (NULL != counter->slot) ||
+       (NULL == h->shm) ||
+       (h->shm->used_slots == h->shm_slots) ||
+       (nlen > GNUNET_STATISTICS_SHM_NAME_LEN) )
+    return GNUNET_YES; /* use IPC */
+  slot = &((struct GNUNET_STATISTICS_ShmSlot *) &h->shm[1])[h->shm->used_slots];
+  GNUNET_memcpy (slot->name,
+                 counter->name,
+                 nlen);
+  slot->flags = counter->make_persistent ? GNUNET_STATISTICS_SETFLAG_PERSISTENT : 0;
+  counter->slot = slot;
+  /* publish the slot to the service only once its name is there */
+  __atomic_store_n (&h->shm->used_slots,
+                    h->shm->used_slots + 1,
+                    __ATOMIC_RELEASE);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Ask the service for a shared memory segment for our counters.
+ * Counters only move into the segment once the service granted it.
+ *
+ * @param h statistics handle, connected to the service
+ */
+static void
+send_shm_attach (struct GNUNET_STATISTICS_Handle *h)
+{
+  struct GNUNET_STATISTICS_ShmAttachMessage *am;
+  struct GNUNET_MQ_Envelope *env;
+  size_t slen;
+
+  h->shm_requested = GNUNET_YES;
+  slen = strlen (h->subsystem) + 1;
+  env = GNUNET_MQ_msg_extra (am,
+                             slen,
+                             GNUNET_MESSAGE_TYPE_STATISTICS_SHM_ATTACH);
+  am->num_slots = htonl (h->shm_slots);
+  GNUNET_memcpy (&am[1],
+                 h->subsystem,
+                 slen);
+  GNUNET_MQ_notify_sent (env,
+                         &schedule_action,
+                         h);
+  GNUNET_MQ_send (h->mq,
+                  env);
+}
+
+
 /**
  * Disconnect from the statistics service.
  *
@@ -412,6 +665,8 @@ do_disconnect (struct GNUNET_STATISTICS_Handle *h)
     GNUNET_MQ_destroy (h->mq);
     h->mq = NULL;
   }
+  drop_shm (h);
+  h->shm_requested = GNUNET_NO;
 }
 
 
@@ -525,6 +780,111 @@ handle_statistics_watch_value (void *cls,
 }
 
 
+/**
+ * Check the format of a #GNUNET_MESSAGE_TYPE_STATISTICS_SHM_GRANT
+ * message.
+ *
+ * @param cls statistics handle
+ * @param gm the grant message
+ * @return #GNUNET_OK if the message is well-formed
+ */
+static int
+check_shm_grant (void *cls,
+                 const struct GNUNET_STATISTICS_ShmGrantMessage *gm)
+{
+  const char *fn;
+  uint16_t size;
+
+  size = ntohs (gm->header.size) - sizeof (*gm);
+  if (size !=
+      GNUNET_STRINGS_buffer_tokenize ((const char *) &gm[1],
+                                      size,
+                                      1,
+                                      &fn))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * The service created a shared memory segment for our counters.
+ * Map it and move our counters into it.  If we cannot map it (for
+ * example because we may not access the files of the service), we
+ * keep using IPC.
+ *
+ * @param cls statistics handle
+ * @param gm the grant message
+ */
+static void
+handle_shm_grant (void *cls,
+                  const struct GNUNET_STATISTICS_ShmGrantMessage *gm)
+{
+  struct GNUNET_STATISTICS_Handle *h = cls;
+  const char *fn = (const char *) &gm[1];
+  size_t len;
+  off_t fsize;
+
+  if ( (NULL != h->shm_fh) ||
+       (ntohl (gm->num_slots) != h->shm_slots) )
+  {
+    GNUNET_break (0);
+    return;
+  }
+  len = sizeof (struct GNUNET_STATISTICS_ShmHeader)
+    + h->shm_slots * sizeof (struct GNUNET_STATISTICS_ShmSlot);
+  h->shm_fh = GNUNET_DISK_file_open (fn,
+                                     GNUNET_DISK_OPEN_READWRITE,
+                                     GNUNET_DISK_PERM_NONE);
+  if ( (NULL != h->shm_fh) &&
+       (GNUNET_OK ==
+        GNUNET_DISK_file_handle_size (h->shm_fh,
+                                      &fsize)) &&
+       (fsize == (off_t) len) )
+    h->shm = GNUNET_DISK_file_map (h->shm_fh,
+                                   &h->shm_map,
+                                   GNUNET_DISK_MAP_TYPE_READWRITE,
+                                   len);
+  if ( (NULL == h->shm) ||
+       (GNUNET_STATISTICS_SHM_MAGIC != h->shm->magic) ||
+       (h->shm_slots != h->shm->num_slots) ||
+       (0 != h->shm->used_slots) )
+  {
+    LOG (GNUNET_ERROR_TYPE_INFO,
+         "Cannot map counters from `%s', falling back to IPC\n",
+         fn);
+    release_shm (h);
+    h->shm_slots = 0;
+    return;
+  }
+  if (NULL != h->counters)
+    GNUNET_CONTAINER_multihashmap32_iterate (h->counters,
+                                             &slot_counter,
+                                             h);
+}
+
+
+/**
+ * The service cannot share memory with us.  Keep sending changes
+ * to our counters via IPC.
+ *
+ * @param cls statistics handle
+ * @param msg the reject message
+ */
+static void
+handle_shm_reject (void *cls,
+                   const struct GNUNET_MessageHeader *msg)
+{
+  struct GNUNET_STATISTICS_Handle *h = cls;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Service cannot share counters, using IPC\n");
+  h->shm_slots = 0;
+}
+
+
 /**
  * Generic error handler, called with the appropriate error code and
  * the same closure specified at the creation of the message queue.
@@ -669,6 +1029,14 @@ try_connect (struct GNUNET_STATISTICS_Handle *h)
                              GNUNET_MESSAGE_TYPE_STATISTICS_WATCH_VALUE,
                              struct GNUNET_STATISTICS_WatchValueMessage,
                              h),
+    GNUNET_MQ_hd_fixed_size (shm_reject,
+                             GNUNET_MESSAGE_TYPE_STATISTICS_SHM_REJECT,
+                             struct GNUNET_MessageHeader,
+                             h),
+    GNUNET_MQ_hd_var_size (shm_grant,
+                           GNUNET_MESSAGE_TYPE_STATISTICS_SHM_GRANT,
+                           struct GNUNET_STATISTICS_ShmGrantMessage,
+                           h),
     GNUNET_MQ_handler_end ()
   };
   struct GNUNET_STATISTICS_GetHandle *gh;
@@ -701,6 +1069,9 @@ try_connect (struct GNUNET_STATISTICS_Handle *h)
       free_action_item (gh);
     }
   }
+  if ( (0 != h->shm_slots) &&
+       (NULL != h->counters) )
+    send_shm_attach (h);
   for (unsigned int i = 0; i < h->watches_size; i++)
     if (NULL != h->watches[i])
       schedule_watch_request (h,
@@ -895,20 +1266,51 @@ GNUNET_STATISTICS_create (const char *subsystem,
                           const struct GNUNET_CONFIGURATION_Handle *cfg)
 {
   struct GNUNET_STATISTICS_Handle *h;
+  unsigned long long shm_slots;
 
   if (GNUNET_YES ==
       GNUNET_CONFIGURATION_get_value_yesno (cfg,
                                             "statistics",
                                             "DISABLE"))
     return NULL;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "statistics",
+                                             "SHM_SLOTS",
+                                             &shm_slots))
+    shm_slots = 0;
   h = GNUNET_new (struct GNUNET_STATISTICS_Handle);
   h->cfg = cfg;
   h->subsystem = GNUNET_strdup (subsystem);
   h->backoff = GNUNET_TIME_UNIT_MILLISECONDS;
+  h->setters = GNUNET_CONTAINER_multihashmap32_create (16);
+  h->shm_slots = (unsigned int) GNUNET_MIN (shm_slots,
+                                            1024 * 1024);
   return h;
 }
 
 
+/**
+ * Free a counter.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value a `struct GNUNET_STATISTICS_Counter`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+free_counter (void *cls,
+              uint32_t key,
+              void *value)
+{
+  struct GNUNET_STATISTICS_Counter *counter = value;
+
+  GNUNET_free (counter->name);
+  GNUNET_free (counter);
+  return GNUNET_YES;
+}
+
+
 /**
  * Destroy a handle (free all state associated with
  * it).
@@ -964,12 +1366,19 @@ GNUNET_STATISTICS_destroy (struct GNUNET_STATISTICS_Handle *h,
               "Cleaning all up\n");
   while (NULL != (pos = h->action_head))
   {
-    GNUNET_CONTAINER_DLL_remove (h->action_head,
-				 h->action_tail,
-				 pos);
+    dequeue_action (h,
+                    pos);
     free_action_item (pos);
   }
   do_disconnect (h);
+  if (NULL != h->counters)
+  {
+    GNUNET_CONTAINER_multihashmap32_iterate (h->counters,
+                                             &free_counter,
+                                             NULL);
+    GNUNET_CONTAINER_multihashmap32_destroy (h->counters);
+  }
+  GNUNET_CONTAINER_multihashmap32_destroy (h->setters);
   if (NULL != h->backoff_task)
   {
     GNUNET_SCHEDULER_cancel (h->backoff_task);
@@ -1040,9 +1449,8 @@ schedule_action (void *cls)
                       env);
       return;
     }
-    GNUNET_CONTAINER_DLL_remove (h->action_head,
-                                 h->action_tail,
-                                 h->current);
+    dequeue_action (h,
+                    h->current);
     switch (h->current->type)
     {
     case ACTION_GET:
@@ -1221,6 +1629,47 @@ GNUNET_STATISTICS_watch_cancel (struct GNUNET_STATISTICS_Handle *handle,
 }
 
 
+/**
+ * Closure for #find_setter_cb() and #find_counter_cb().
+ */
+struct FindContext
+{
+  /**
+   * Name we are looking for.
+   */
+  const char *name;
+
+  /**
+   * Set to the entry with that name, if found.
+   */
+  void *result;
+};
+
+
+/**
+ * Check if a pending action is for the value we are looking for.
+ *
+ * @param cls the `struct FindContext`
+ * @param key unused
+ * @param value a `struct GNUNET_STATISTICS_GetHandle`
+ * @return #GNUNET_NO if we found the action
+ */
+static int
+find_setter_cb (void *cls,
+                uint32_t key,
+                void *value)
+{
+  struct FindContext *fc = cls;
+  struct GNUNET_STATISTICS_GetHandle *ai = value;
+
+  if (0 != strcmp (fc->name,
+                   ai->name))
+    return GNUNET_YES;
+  fc->result = ai;
+  return GNUNET_NO;
+}
+
+
 /**
  * Queue a request to change a statistic.
  *
@@ -1238,6 +1687,7 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
                    enum ActionType type)
 {
   struct GNUNET_STATISTICS_GetHandle *ai;
+  struct FindContext fc;
   size_t slen;
   size_t nlen;
   size_t nsize;
@@ -1251,15 +1701,15 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
     GNUNET_break (0);
     return;
   }
-  for (ai = h->action_head; NULL != ai; ai = ai->next)
+  fc.name = name;
+  fc.result = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (h->setters,
+                                                name_key (name),
+                                                &find_setter_cb,
+                                                &fc);
+  ai = fc.result;
+  if (NULL != ai)
   {
-    if (! ( (0 == strcmp (ai->subsystem,
-			  h->subsystem)) &&
-	    (0 == strcmp (ai->name,
-			  name)) &&
-	    ( (ACTION_UPDATE == ai->type) ||
-	      (ACTION_SET == ai->type) ) ) )
-      continue;
     if (ACTION_SET == ai->type)
     {
       if (ACTION_UPDATE == type)
@@ -1319,6 +1769,11 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
   GNUNET_CONTAINER_DLL_insert_tail (h->action_head,
                                     h->action_tail,
 				    ai);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (h->setters,
+                                                      name_key (name),
+                                                      ai,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
   schedule_action (h);
 }
 
@@ -1377,4 +1832,112 @@ GNUNET_STATISTICS_update (struct GNUNET_STATISTICS_Handle *handle,
 }
 
 
+/**
+ * Check if a counter has the name we are looking for.
+ *
+ * @param cls the `struct FindContext`
+ * @param key unused
+ * @param value a `struct GNUNET_STATISTICS_Counter`
+ * @return #GNUNET_NO if we found the counter
+ */
+static int
+find_counter_cb (void *cls,
+                 uint32_t key,
+                 void *value)
+{
+  struct FindContext *fc = cls;
+  struct GNUNET_STATISTICS_Counter *counter = value;
+
+  if (0 != strcmp (fc->name,
+                   counter->name))
+    return GNUNET_YES;
+  fc->result = counter;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Obtain a fast counter for a statistic of our subsystem.  If the
+ * "SHM_SLOTS" option is set, the counter lives in memory the
+ * statistics service shares with us once it granted it, and the
+ * service picks up changes periodically and whenever values are
+ * requested.  Otherwise, changes are passed to
+ * #GNUNET_STATISTICS_update().
+ *
+ * @param handle identification of the statistics service
+ * @param name name of the statistic value
+ * @param make_persistent should the value be kept across restarts?
+ * @return NULL if @a handle is NULL
+ */
+struct GNUNET_STATISTICS_Counter *
+GNUNET_STATISTICS_counter_get (struct GNUNET_STATISTICS_Handle *handle,
+                               const char *name,
+                               int make_persistent)
+{
+  struct GNUNET_STATISTICS_Counter *counter;
+  struct FindContext fc;
+
+  if (NULL == handle)
+    return NULL;
+  GNUNET_assert (GNUNET_NO == handle->do_destroy);
+  if (NULL == handle->counters)
+    handle->counters = GNUNET_CONTAINER_multihashmap32_create (16);
+  fc.name = name;
+  fc.result = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (handle->counters,
+                                                name_key (name),
+                                                &find_counter_cb,
+                                                &fc);
+  if (NULL != fc.result)
+    return fc.result;
+  counter = GNUNET_new (struct GNUNET_STATISTICS_Counter);
+  counter->sh = handle;
+  counter->name = GNUNET_strdup (name);
+  counter->make_persistent = make_persistent;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (handle->counters,
+                                                      name_key (name),
+                                                      counter,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  if ( (0 != handle->shm_slots) &&
+       (GNUNET_NO == handle->shm_requested) )
+  {
+    if (NULL != handle->mq)
+      send_shm_attach (handle);
+    else
+      schedule_action (handle);
+  }
+  slot_counter (handle,
+                0,
+                counter);
+  return counter;
+}
+
+
+/**
+ * Change the value of a counter.
+ *
+ * @param counter counter to change, may be NULL
+ * @param delta change in value (added to existing value)
+ */
+void
+GNUNET_STATISTICS_counter_add (struct GNUNET_STATISTICS_Counter *counter,
+                               int64_t delta)
+{
+  if (NULL == counter)
+    return;
+  if (NULL == counter->slot)
+  {
+    GNUNET_STATISTICS_update (counter->sh,
+                              counter->name,
+                              delta,
+                              counter->make_persistent);
+    return;
+  }
+  (void) __atomic_add_fetch (&counter->slot->value,
+                             (uint64_t) delta,
+                             __ATOMIC_RELAXED);
+}
+
+
 /* end of statistics_api.c */
@@ -0,0 +1,258 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file statistics/test_statistics_api_counter.c
+ * @brief testcase for statistics_api.c counter functions: changes
+ *        to counters must reach watches and GET requests of other
+ *        clients, both from shared memory and via IPC
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_statistics_service.h"
+
+/**
+ * Subsystem of our counters.
+ */
+#define SUBSYSTEM "test-statistics-api-counter"
+
+/**
+ * Name of a counter that fits into a shared memory slot.
+ */
+#define SHORT_NAME "counter-1"
+
+/**
+ * Name of a counter too long for a shared memory slot, always
+ * updated via IPC.
+ */
+#define LONG_NAME "counter-2-with-a-name-that-is-much-too-long-to-fit-into-a-slot-of-the-shared-memory-segment-so-it-falls-back-to-ipc"
+
+
+static int ok;
+
+static struct GNUNET_STATISTICS_Handle *h;
+
+static struct GNUNET_STATISTICS_Handle *h2;
+
+static struct GNUNET_STATISTICS_Counter *c1;
+
+static struct GNUNET_STATISTICS_Counter *c2;
+
+static struct GNUNET_STATISTICS_GetHandle *get;
+
+static struct GNUNET_SCHEDULER_Task *shutdown_task;
+
+static unsigned int values_seen;
+
+
+static void
+force_shutdown (void *cls)
+{
+  fprintf (stderr, "Timeout, failed to receive notifications: %d\n", ok);
+  if (NULL != get)
+    GNUNET_STATISTICS_get_cancel (get);
+  GNUNET_STATISTICS_destroy (h, GNUNET_NO);
+  GNUNET_STATISTICS_destroy (h2, GNUNET_NO);
+  ok = 7;
+}
+
+
+static void
+normal_shutdown (void *cls)
+{
+  GNUNET_STATISTICS_destroy (h, GNUNET_NO);
+  GNUNET_STATISTICS_destroy (h2, GNUNET_NO);
+}
+
+
+static int
+check_value (void *cls,
+             const char *subsystem,
+             const char *name,
+             uint64_t value,
+             int is_persistent)
+{
+  GNUNET_assert (0 == strcmp (subsystem, SUBSYSTEM));
+  if (0 == strcmp (name, SHORT_NAME))
+    GNUNET_assert (42 == value);
+  else if (0 == strcmp (name, LONG_NAME))
+    GNUNET_assert (43 == value);
+  else
+    GNUNET_assert (0);
+  values_seen++;
+  return GNUNET_OK;
+}
+
+
+static void
+get_done (void *cls,
+          int success)
+{
+  get = NULL;
+  GNUNET_assert (GNUNET_OK == success);
+  if (2 != values_seen)
+  {
+    fprintf (stderr, "GET returned %u values, wanted 2\n", values_seen);
+    ok = 8;
+  }
+  GNUNET_SCHEDULER_cancel (shutdown_task);
+  GNUNET_SCHEDULER_add_now (&normal_shutdown, NULL);
+}
+
+
+static void
+check_done ()
+{
+  if (0 != ok)
+    return;
+  get = GNUNET_STATISTICS_get (h,
+                               SUBSYSTEM,
+                               NULL,
+                               &get_done,
+                               &check_value,
+                               NULL);
+}
+
+
+static int
+watch_1 (void *cls,
+	 const char *subsystem,
+	 const char *name,
+	 uint64_t value,
+         int is_persistent)
+{
+  GNUNET_assert (0 == strcmp (name, SHORT_NAME));
+  if (40 == value)
+  {
+    GNUNET_STATISTICS_counter_add (c1, 2);
+    return GNUNET_OK;
+  }
+  GNUNET_assert (42 == value);
+  ok &= ~1;
+  check_done ();
+  return GNUNET_OK;
+}
+
+
+static int
+watch_2 (void *cls,
+	 const char *subsystem,
+	 const char *name,
+	 uint64_t value,
+         int is_persistent)
+{
+  GNUNET_assert (0 == strcmp (name, LONG_NAME));
+  if (50 == value)
+    return GNUNET_OK; /* second update not yet applied */
+  GNUNET_assert (43 == value);
+  ok &= ~2;
+  check_done ();
+  return GNUNET_OK;
+}
+
+
+static int
+ignore_value (void *cls,
+              const char *subsystem,
+              const char *name,
+              uint64_t value,
+              int is_persistent)
+{
+  return GNUNET_OK;
+}
+
+
+static void
+start_updates (void *cls,
+               int success)
+{
+  /* the service answered our first request, so by now it also
+     granted the shared memory segment */
+  GNUNET_assert (GNUNET_OK == success);
+  get = NULL;
+  GNUNET_STATISTICS_counter_add (c1, 40);
+  GNUNET_STATISTICS_counter_add (c2, 50);
+  GNUNET_STATISTICS_counter_add (c2, -7);
+}
+
+
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  h = GNUNET_STATISTICS_create ("dummy", cfg);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (h, SUBSYSTEM,
+                                          SHORT_NAME, &watch_1, NULL));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (h, SUBSYSTEM,
+                                          LONG_NAME, &watch_2, NULL));
+  h2 = GNUNET_STATISTICS_create (SUBSYSTEM, cfg);
+  c1 = GNUNET_STATISTICS_counter_get (h2, SHORT_NAME, GNUNET_NO);
+  c2 = GNUNET_STATISTICS_counter_get (h2, LONG_NAME, GNUNET_NO);
+  get = GNUNET_STATISTICS_get (h2, SUBSYSTEM, SHORT_NAME,
+                               &start_updates, &ignore_value, NULL);
+  shutdown_task =
+      GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+				    &force_shutdown,
+                                    NULL);
+}
+
+
+int
+main (int argc, char *argv_ign[])
+{
+  char *const argv[] = { "test-statistics-api",
+    "-c",
+    "test_statistics_api_counter_data.conf",
+    NULL
+  };
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+  struct GNUNET_OS_Process *proc;
+  char *binary;
+
+  binary = GNUNET_OS_get_libexec_binary_path ("gnunet-service-statistics");
+  proc =
+    GNUNET_OS_start_process (GNUNET_YES, GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
+                             NULL, NULL, NULL,
+			     binary,
+			     "gnunet-service-statistics",
+			     "-c", "test_statistics_api_counter_data.conf", NULL);
+  GNUNET_assert (NULL != proc);
+  ok = 3;
+  GNUNET_PROGRAM_run (3, argv, "test-statistics-api", "nohelp", options, &run,
+                      NULL);
+  if (0 != GNUNET_OS_process_kill (proc, GNUNET_TERM_SIG))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "kill");
+    ok = 1;
+  }
+  GNUNET_OS_process_wait (proc);
+  GNUNET_OS_process_destroy (proc);
+  proc = NULL;
+  GNUNET_free (binary);
+  return ok;
+}
+
+
+/* end of test_statistics_api_counter.c */
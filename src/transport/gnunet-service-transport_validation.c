@@ -218,6 +218,38 @@ struct TransportPongMessage
 };
 GNUNET_NETWORK_STRUCT_END
 
+struct ValidationEntry;
+
+
+/**
+ * Signature check of a PONG that is running on the pool.
+ */
+struct PongCheck
+{
+
+  /**
+   * Address the PONG is for.
+   */
+  struct ValidationEntry *ve;
+
+  /**
+   * Handle for the signature check.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *verify;
+
+  /**
+   * Signature of the PONG.
+   */
+  struct GNUNET_CRYPTO_EddsaSignature sig;
+
+  /**
+   * Until when is @e sig valid?
+   */
+  struct GNUNET_TIME_Absolute sig_valid_until;
+
+};
+
+
 /**
  * Information about an address under validation
  */
@@ -239,6 +271,12 @@ struct ValidationEntry
    */
   struct GNUNET_CRYPTO_EddsaSignature pong_sig_cache;
 
+  /**
+   * PONG whose signature we are verifying, NULL for none.  Further
+   * PONGs for the address are dropped while it is checked.
+   */
+  struct PongCheck *pc;
+
   /**
    * ID of task that will clean up this entry if nothing happens.
    */
@@ -335,6 +373,11 @@ static struct GNUNET_CONTAINER_MultiPeerMap *validation_map;
  */
 static struct GNUNET_PEERINFO_NotifyContext *pnc;
 
+/**
+ * Threads verifying the signatures of PONGs.
+ */
+static struct GNUNET_CRYPTO_VerifyPool *verify_pool;
+
 /**
  * Minimum delay between to validations
  */
@@ -433,6 +476,24 @@ validation_entry_changed (struct ValidationEntry *ve,
 }
 
 
+/**
+ * Cancel the signature check of a PONG for an address, if any.
+ *
+ * @param ve the address
+ */
+static void
+cancel_pong_check (struct ValidationEntry *ve)
+{
+  struct PongCheck *pc = ve->pc;
+
+  if (NULL == pc)
+    return;
+  ve->pc = NULL;
+  GNUNET_CRYPTO_verify_batch_cancel (pc->verify);
+  GNUNET_free (pc);
+}
+
+
 /**
  * Iterate over validation entries and free them.
  *
@@ -460,6 +521,7 @@ cleanup_validation_entry (void *cls,
     GST_blacklist_test_cancel (ve->bc);
     ve->bc = NULL;
   }
+  cancel_pong_check (ve);
   GNUNET_break (GNUNET_OK ==
                 GNUNET_CONTAINER_multipeermap_remove (validation_map,
                                                       &ve->address->peer,
@@ -1004,6 +1066,7 @@ GST_validation_start (unsigned int max_fds)
                                                       GNUNET_YES));
   validation_map = GNUNET_CONTAINER_multipeermap_create (VALIDATION_MAP_SIZE,
 							 GNUNET_NO);
+  verify_pool = GNUNET_CRYPTO_verify_pool_create (0);
   pnc = GNUNET_PEERINFO_notify (GST_cfg, GNUNET_YES,
                                 &process_peerinfo_hello, NULL);
 }
@@ -1020,6 +1083,8 @@ GST_validation_stop ()
                                          NULL);
   GNUNET_CONTAINER_multipeermap_destroy (validation_map);
   validation_map = NULL;
+  GNUNET_CRYPTO_verify_pool_destroy (verify_pool);
+  verify_pool = NULL;
   GNUNET_PEERINFO_notify_cancel (pnc);
 }
 
@@ -1422,6 +1487,142 @@ add_valid_peer_address (void *cls,
 }
 
 
+/**
+ * The signature of a PONG checked out (or did not need checking).
+ * Mark the address of @a ve as confirmed.
+ *
+ * @param ve validation entry the PONG was for
+ * @param sig signature of the PONG
+ * @param sig_valid_until until when the signature is valid
+ */
+static void
+pong_verified (struct ValidationEntry *ve,
+               const struct GNUNET_CRYPTO_EddsaSignature *sig,
+               struct GNUNET_TIME_Absolute sig_valid_until)
+{
+  struct GNUNET_HELLO_Message *hello;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Validation process successful for peer `%s' with plugin `%s' address `%s'\n",
+              GNUNET_i2s (&ve->address->peer),
+              ve->address->transport_name,
+              GST_plugins_a2s (ve->address));
+  GNUNET_STATISTICS_update (GST_stats,
+                            gettext_noop ("# validations succeeded"),
+                            1,
+                            GNUNET_NO);
+  /* validity achieved, remember it! */
+  ve->expecting_pong = GNUNET_NO;
+  ve->valid_until = GNUNET_TIME_relative_to_absolute (HELLO_ADDRESS_EXPIRATION);
+  ve->pong_sig_cache = *sig;
+  ve->pong_sig_valid_until = sig_valid_until;
+  ve->latency = GNUNET_TIME_absolute_get_duration (ve->send_time);
+  {
+    if (GNUNET_YES == ve->known_to_ats)
+    {
+      GNUNET_assert (GNUNET_YES ==
+                     GST_ats_is_known_no_session (ve->address));
+      GST_ats_update_delay (ve->address,
+                            GNUNET_TIME_relative_divide (ve->latency, 2));
+    }
+    else
+    {
+      struct GNUNET_ATS_Properties prop;
+
+      memset (&prop, 0, sizeof (prop));
+      GNUNET_break (GNUNET_ATS_NET_UNSPECIFIED != ve->network);
+      prop.scope = ve->network;
+      prop.delay = GNUNET_TIME_relative_divide (ve->latency, 2);
+      GNUNET_assert (GNUNET_NO ==
+                     GST_ats_is_known_no_session (ve->address));
+      ve->known_to_ats = GNUNET_YES;
+      GST_ats_add_address (ve->address, &prop);
+      GNUNET_assert (GNUNET_YES ==
+                     GST_ats_is_known_no_session (ve->address));
+    }
+  }
+  if (validations_running > 0)
+  {
+    validations_running--;
+    GNUNET_STATISTICS_set (GST_stats,
+                           gettext_noop ("# validations running"),
+                           validations_running,
+                           GNUNET_NO);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Validation finished, %u validation processes running\n",
+                validations_running);
+  }
+  else
+  {
+    GNUNET_break (0);
+  }
+
+  /* Notify about new validity */
+  validation_entry_changed (ve,
+                            GNUNET_TRANSPORT_VS_UPDATE);
+
+  /* build HELLO to store in PEERINFO */
+  ve->copied = GNUNET_NO;
+  hello = GNUNET_HELLO_create (&ve->address->peer.public_key,
+                               &add_valid_peer_address,
+			       ve,
+                               GNUNET_NO);
+  GNUNET_PEERINFO_add_peer (GST_peerinfo,
+			    hello,
+			    NULL,
+			    NULL);
+  GNUNET_free (hello);
+}
+
+
+/**
+ * The signature of a PONG was verified by the pool.  If it is
+ * invalid, the sender forged it and we disconnect from it, just as
+ * we would for any other malformed PONG.  Otherwise the address is
+ * validated.
+ *
+ * @param cls the `struct PongCheck`
+ * @param num_items always 1
+ * @param results result of the signature check
+ */
+static void
+pong_signature_checked (void *cls,
+                        unsigned int num_items,
+                        const int *results)
+{
+  struct PongCheck *pc = cls;
+  struct ValidationEntry *ve = pc->ve;
+  struct GNUNET_CRYPTO_EddsaSignature sig;
+  struct GNUNET_TIME_Absolute sig_valid_until;
+
+  ve->pc = NULL;
+  sig = pc->sig;
+  sig_valid_until = pc->sig_valid_until;
+  GNUNET_free (pc);
+  if (GNUNET_OK != results[0])
+  {
+    GNUNET_break_op (0);
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to verify: invalid signature on address `%s':%s from peer `%s'\n",
+                ve->address->transport_name,
+                GST_plugins_a2s (ve->address),
+                GNUNET_i2s (&ve->address->peer));
+    GNUNET_STATISTICS_update (GST_stats,
+                              gettext_noop
+                              ("# PONGs dropped, invalid signature"),
+                              1,
+                              GNUNET_NO);
+    GST_neighbours_force_disconnect (&ve->address->peer);
+    return;
+  }
+  if (GNUNET_NO == ve->expecting_pong)
+    return; /* validated by a cached signature in the meantime */
+  pong_verified (ve,
+                 &sig,
+                 sig_valid_until);
+}
+
+
 /**
  * We've received a PONG.  Check if it matches a pending PING and
  * mark the respective address as confirmed.
@@ -1441,10 +1642,9 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
   size_t addrlen;
   size_t slen;
   size_t size;
-  struct GNUNET_HELLO_Message *hello;
   struct GNUNET_HELLO_Address address;
-  int sig_res;
-  int do_verify;
+  struct GNUNET_CRYPTO_VerifyItem item;
+  struct PongCheck *pc;
 
   if (0 ==
       memcmp (&GST_my_identity,
@@ -1519,8 +1719,6 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
     return GNUNET_SYSERR;
   }
 
-  sig_res = GNUNET_SYSERR;
-  do_verify = GNUNET_YES;
   if (0 != GNUNET_TIME_absolute_get_remaining (ve->pong_sig_valid_until).rel_value_us)
   {
     /* We have a cached and valid signature for this peer,
@@ -1530,109 +1728,54 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
                      sizeof (struct GNUNET_CRYPTO_EddsaSignature)))
     {
       /* signatures are identical, we can skip verification */
-      sig_res = GNUNET_OK;
-      do_verify = GNUNET_NO;
-    }
-    else
-    {
-      sig_res = GNUNET_SYSERR;
-      /* signatures do not match, we have to verify */
+      cancel_pong_check (ve);
+      pong_verified (ve,
+                     &pong->signature,
+                     GNUNET_TIME_absolute_ntoh (pong->expiration));
+      return GNUNET_OK;
     }
+    /* signatures do not match, we have to verify */
   }
 
-  if (GNUNET_YES == do_verify)
-  {
-    /* Do expensive verification */
-    sig_res = GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_TRANSPORT_PONG_OWN,
-                                          &pong->purpose,
-                                          &pong->signature,
-                                          &ve->address->peer.public_key);
-    if (sig_res == GNUNET_SYSERR)
-    {
-      GNUNET_break_op (0);
-      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                  "Failed to verify: invalid signature on address `%s':%s from peer `%s'\n",
-                  tname,
-                  GST_plugins_a2s (ve->address),
-                  GNUNET_i2s (sender));
-    }
-  }
-  if (sig_res == GNUNET_SYSERR)
+  /* Do expensive verification off the main thread; the signed
+     block is copied, so it must be exactly the rest of the message.
+     Only the peer itself can send PONGs for its addresses, so we
+     check one at a time and drop the others meanwhile. */
+  if (ntohl (pong->purpose.size) !=
+      ntohs (hdr->size) - offsetof (struct TransportPongMessage, purpose))
   {
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
   }
-
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-              "Validation process successful for peer `%s' with plugin `%s' address `%s'\n",
-              GNUNET_i2s (sender),
-              tname,
-              GST_plugins_a2s (ve->address));
-  GNUNET_STATISTICS_update (GST_stats,
-                            gettext_noop ("# validations succeeded"),
-                            1,
-                            GNUNET_NO);
-  /* validity achieved, remember it! */
-  ve->expecting_pong = GNUNET_NO;
-  ve->valid_until = GNUNET_TIME_relative_to_absolute (HELLO_ADDRESS_EXPIRATION);
-  ve->pong_sig_cache = pong->signature;
-  ve->pong_sig_valid_until = GNUNET_TIME_absolute_ntoh (pong->expiration);
-  ve->latency = GNUNET_TIME_absolute_get_duration (ve->send_time);
+  if (NULL != ve->pc)
   {
-    if (GNUNET_YES == ve->known_to_ats)
-    {
-      GNUNET_assert (GNUNET_YES ==
-                     GST_ats_is_known_no_session (ve->address));
-      GST_ats_update_delay (ve->address,
-                            GNUNET_TIME_relative_divide (ve->latency, 2));
-    }
-    else
-    {
-      struct GNUNET_ATS_Properties prop;
-
-      memset (&prop, 0, sizeof (prop));
-      GNUNET_break (GNUNET_ATS_NET_UNSPECIFIED != ve->network);
-      prop.scope = ve->network;
-      prop.delay = GNUNET_TIME_relative_divide (ve->latency, 2);
-      GNUNET_assert (GNUNET_NO ==
-                     GST_ats_is_known_no_session (ve->address));
-      ve->known_to_ats = GNUNET_YES;
-      GST_ats_add_address (ve->address, &prop);
-      GNUNET_assert (GNUNET_YES ==
-                     GST_ats_is_known_no_session (ve->address));
-    }
-  }
-  if (validations_running > 0)
-  {
-    validations_running--;
-    GNUNET_STATISTICS_set (GST_stats,
-                           gettext_noop ("# validations running"),
-                           validations_running,
-                           GNUNET_NO);
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Validation finished, %u validation processes running\n",
-                validations_running);
+    GNUNET_STATISTICS_update (GST_stats,
+                              gettext_noop
+                              ("# PONGs dropped, signature check pending"),
+                              1,
+                              GNUNET_NO);
+    return GNUNET_OK;
   }
-  else
+  item.type = GNUNET_CRYPTO_VERIFY_EDDSA;
+  item.purpose = GNUNET_SIGNATURE_PURPOSE_TRANSPORT_PONG_OWN;
+  item.validate = &pong->purpose;
+  item.sig.eddsa = &pong->signature;
+  item.pub.eddsa = &ve->address->peer.public_key;
+  pc = GNUNET_new (struct PongCheck);
+  pc->ve = ve;
+  pc->sig = pong->signature;
+  pc->sig_valid_until = GNUNET_TIME_absolute_ntoh (pong->expiration);
+  pc->verify = GNUNET_CRYPTO_verify_batch_start (verify_pool,
+                                                 &item,
+                                                 1,
+                                                 &pong_signature_checked,
+                                                 pc);
+  if (NULL == pc->verify)
   {
-    GNUNET_break (0);
+    GNUNET_free (pc);
+    return GNUNET_SYSERR;
   }
-
-  /* Notify about new validity */
-  validation_entry_changed (ve,
-                            GNUNET_TRANSPORT_VS_UPDATE);
-
-  /* build HELLO to store in PEERINFO */
-  ve->copied = GNUNET_NO;
-  hello = GNUNET_HELLO_create (&ve->address->peer.public_key,
-                               &add_valid_peer_address,
-			       ve,
-                               GNUNET_NO);
-  GNUNET_PEERINFO_add_peer (GST_peerinfo,
-			    hello,
-			    NULL,
-			    NULL);
-  GNUNET_free (hello);
+  ve->pc = pc;
   return GNUNET_OK;
 }
 
@@ -0,0 +1,413 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file transport/perf_plugin_udp.c
+ * @brief measure how many small messages per second one UDP plugin
+ *        instance can pass to another one over loopback
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_hello_lib.h"
+#include "gnunet_transport_plugin.h"
+#include "plugin_transport_udp.h"
+#include <gauger.h>
+
+/**
+ * Number of messages we send.
+ */
+#define NUM_MESSAGES 100000
+
+/**
+ * Number of messages we allow to be in flight, small enough to never
+ * overflow the socket buffers.
+ */
+#define WINDOW 128
+
+/**
+ * Number of bytes of payload per message.
+ */
+#define PAYLOAD_SIZE 64
+
+/**
+ * Message type we use for the payload.
+ */
+#define PERF_TYPE 60000
+
+/**
+ * UDP port of the first instance, the second one uses the next port.
+ */
+#define BASE_PORT 2431
+
+
+/**
+ * One instance of the plugin.
+ */
+struct Instance
+{
+  /**
+   * Configuration of this instance.
+   */
+  struct GNUNET_CONFIGURATION_Handle *cfg;
+
+  /**
+   * Identity of this instance.
+   */
+  struct GNUNET_PeerIdentity id;
+
+  /**
+   * Environment of this instance.
+   */
+  struct GNUNET_TRANSPORT_PluginEnvironment env;
+
+  /**
+   * The plugin.
+   */
+  struct GNUNET_TRANSPORT_PluginFunctions *api;
+};
+
+
+/**
+ * Sender and receiver.
+ */
+static struct Instance instances[2];
+
+/**
+ * Address of the receiver.
+ */
+static struct GNUNET_HELLO_Address *address;
+
+/**
+ * Session of the sender with the receiver.
+ */
+static struct GNUNET_ATS_Session *session;
+
+/**
+ * Number of messages handed to the sender.
+ */
+static unsigned int sent;
+
+/**
+ * Number of messages the receiver got.
+ */
+static unsigned int received;
+
+/**
+ * When did we start to send?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Handle to the timeout task.
+ */
+static struct GNUNET_SCHEDULER_Task *die_task;
+
+/**
+ * Final status code.
+ */
+static int ret;
+
+
+/**
+ * Unload the plugins.
+ *
+ * @param cls NULL
+ */
+static void
+cleanup (void *cls)
+{
+  if (NULL != die_task)
+  {
+    GNUNET_SCHEDULER_cancel (die_task);
+    die_task = NULL;
+  }
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    if (NULL != instances[i].api)
+    {
+      GNUNET_PLUGIN_unload ("libgnunet_plugin_transport_udp",
+                            instances[i].api);
+      instances[i].api = NULL;
+    }
+    if (NULL != instances[i].cfg)
+    {
+      GNUNET_CONFIGURATION_destroy (instances[i].cfg);
+      instances[i].cfg = NULL;
+    }
+  }
+  if (NULL != address)
+  {
+    GNUNET_HELLO_address_free (address);
+    address = NULL;
+  }
+}
+
+
+/**
+ * We took too long.
+ *
+ * @param cls NULL
+ */
+static void
+do_timeout (void *cls)
+{
+  die_task = NULL;
+  fprintf (stderr,
+           "Timeout after %u messages sent, %u received\n",
+           sent,
+           received);
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Hand messages to the sender until the window is full.
+ */
+static void
+send_messages ()
+{
+  char buf[PAYLOAD_SIZE];
+  struct GNUNET_MessageHeader *hdr;
+
+  hdr = (struct GNUNET_MessageHeader *) buf;
+  memset (buf,
+          0,
+          sizeof (buf));
+  hdr->size = htons (sizeof (buf));
+  hdr->type = htons (PERF_TYPE);
+  while ( (sent < NUM_MESSAGES) &&
+          (sent - received < WINDOW) )
+  {
+    if (0 >= instances[0].api->send (instances[0].api->cls,
+                                     session,
+                                     buf,
+                                     sizeof (buf),
+                                     0,
+                                     GNUNET_TIME_UNIT_MINUTES,
+                                     NULL,
+                                     NULL))
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    sent++;
+  }
+}
+
+
+/**
+ * The receiver got a message.
+ *
+ * @param cls the `struct Instance`
+ * @param address address of the sender
+ * @param session session with the sender
+ * @param message the message
+ * @return no delay
+ */
+static struct GNUNET_TIME_Relative
+env_receive (void *cls,
+             const struct GNUNET_HELLO_Address *address,
+             struct GNUNET_ATS_Session *session,
+             const struct GNUNET_MessageHeader *message)
+{
+  struct GNUNET_TIME_Relative duration;
+  double pps;
+
+  if ( (cls != &instances[1]) ||
+       (PERF_TYPE != ntohs (message->type)) )
+    return GNUNET_TIME_UNIT_ZERO;
+  if (NUM_MESSAGES != ++received)
+  {
+    send_messages ();
+    return GNUNET_TIME_UNIT_ZERO;
+  }
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  pps = NUM_MESSAGES * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  printf ("%u messages of %u bytes: %.0f packets/s\n",
+          NUM_MESSAGES,
+          PAYLOAD_SIZE,
+          pps);
+  GAUGER ("TRANSPORT",
+          "UDP plugin packets over loopback",
+          pps,
+          "packets/s");
+  ret = 0;
+  GNUNET_SCHEDULER_shutdown ();
+  return GNUNET_TIME_UNIT_ZERO;
+}
+
+
+static void
+env_notify_address (void *cls,
+                    int add_remove,
+                    const struct GNUNET_HELLO_Address *address)
+{
+}
+
+
+static enum GNUNET_ATS_Network_Type
+env_get_address_type (void *cls,
+                      const struct sockaddr *addr,
+                      size_t addrlen)
+{
+  return GNUNET_ATS_NET_LOOPBACK;
+}
+
+
+static const struct GNUNET_MessageHeader *
+env_get_our_hello ()
+{
+  return NULL;
+}
+
+
+static void
+env_session_start (void *cls,
+                   const struct GNUNET_HELLO_Address *address,
+                   struct GNUNET_ATS_Session *session,
+                   enum GNUNET_ATS_Network_Type net)
+{
+}
+
+
+static void
+env_session_end (void *cls,
+                 const struct GNUNET_HELLO_Address *address,
+                 struct GNUNET_ATS_Session *session)
+{
+}
+
+
+static void
+env_update_distance (void *cls,
+                     const struct GNUNET_HELLO_Address *address,
+                     uint32_t distance)
+{
+}
+
+
+/**
+ * Load the two plugin instances and start sending.
+ *
+ * @param cls NULL
+ * @param args remaining command-line arguments
+ * @param cfgfile name of the configuration file used
+ * @param cfg configuration
+ */
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct IPv4UdpAddress v4;
+
+  GNUNET_SCHEDULER_add_shutdown (&cleanup,
+                                 NULL);
+  die_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                           &do_timeout,
+                                           NULL);
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    struct Instance *in = &instances[i];
+
+    in->cfg = GNUNET_CONFIGURATION_dup (cfg);
+    GNUNET_CONFIGURATION_set_value_number (in->cfg,
+                                           "transport-udp",
+                                           "PORT",
+                                           BASE_PORT + i);
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                &in->id,
+                                sizeof (in->id));
+    in->env.cfg = in->cfg;
+    in->env.cls = in;
+    in->env.my_identity = &in->id;
+    in->env.stats = NULL;
+    in->env.receive = &env_receive;
+    in->env.notify_address = &env_notify_address;
+    in->env.get_address_type = &env_get_address_type;
+    in->env.get_our_hello = &env_get_our_hello;
+    in->env.session_start = &env_session_start;
+    in->env.session_end = &env_session_end;
+    in->env.update_address_distance = &env_update_distance;
+    in->env.max_connections = 16;
+    in->api = GNUNET_PLUGIN_load ("libgnunet_plugin_transport_udp",
+                                  &in->env);
+    if (NULL == in->api)
+    {
+      fprintf (stderr,
+               "Failed to load UDP plugin\n");
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+  }
+  memset (&v4,
+          0,
+          sizeof (v4));
+  v4.ipv4_addr = htonl (INADDR_LOOPBACK);
+  v4.u4_port = htons (BASE_PORT + 1);
+  address = GNUNET_HELLO_address_allocate (&instances[1].id,
+                                           "udp",
+                                           &v4,
+                                           sizeof (v4),
+                                           GNUNET_HELLO_ADDRESS_INFO_NONE);
+  session = instances[0].api->get_session (instances[0].api->cls,
+                                           address);
+  if (NULL == session)
+  {
+    GNUNET_break (0);
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  start = GNUNET_TIME_absolute_get ();
+  send_messages ();
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  char *const argv_prog[] = {
+    "perf-plugin-udp",
+    "-c",
+    "perf_plugin_udp.conf",
+    "-L",
+    "ERROR",
+    NULL
+  };
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+
+  ret = 1;
+  if (GNUNET_OK !=
+      GNUNET_PROGRAM_run ((sizeof (argv_prog) / sizeof (char *)) - 1,
+                          argv_prog,
+                          "perf-plugin-udp",
+                          "nohelp",
+                          options,
+                          &run,
+                          NULL))
+    return 1;
+  return ret;
+}
+
+/* end of perf_plugin_udp.c */
@@ -66,6 +66,17 @@
  */
 #define UDP_MAX_SENDER_ADDRESSES_WITH_DEFRAG 128
 
+/**
+ * How many datagrams do we receive or send with one system call at
+ * most (if the system can do that)?
+ */
+#define UDP_IO_BATCH 16
+
+/**
+ * Size of the buffer for receiving one datagram.
+ */
+#define UDP_READ_BUFFER_SIZE 65536
+
 
 /**
  * UDP Message-Packet header (after defragmentation).
@@ -3073,19 +3084,21 @@ read_process_fragment (struct Plugin *plugin,
 
 
 /**
- * Read and process a message from the given socket.
+ * Process a datagram we received.
  *
  * @param plugin the overall plugin
- * @param rsock socket to read from
+ * @param buf the datagram
+ * @param size number of bytes in @a buf
+ * @param addr address of the sender
+ * @param fromlen number of bytes in @a addr
  */
 static void
-udp_select_read (struct Plugin *plugin,
-                 struct GNUNET_NETWORK_Handle *rsock)
+udp_process_datagram (struct Plugin *plugin,
+                      const char *buf,
+                      ssize_t size,
+                      const struct sockaddr_storage *addr,
+                      socklen_t fromlen)
 {
-  socklen_t fromlen;
-  struct sockaddr_storage addr;
-  char buf[65536] GNUNET_ALIGN;
-  ssize_t size;
   const struct GNUNET_MessageHeader *msg;
   struct IPv4UdpAddress v4;
   struct IPv6UdpAddress v6;
@@ -3096,44 +3109,11 @@ udp_select_read (struct Plugin *plugin,
   size_t int_addr_len;
   enum GNUNET_ATS_Network_Type network_type;
 
-  fromlen = sizeof (addr);
-  memset (&addr,
-          0,
-          sizeof(addr));
-  size = GNUNET_NETWORK_socket_recvfrom (rsock,
-                                         buf,
-                                         sizeof (buf),
-                                         (struct sockaddr *) &addr,
-                                         &fromlen);
-  sa = (const struct sockaddr *) &addr;
-#if MINGW
-  /* On SOCK_DGRAM UDP sockets recvfrom might fail with a
-   * WSAECONNRESET error to indicate that previous sendto() (yes, sendto!)
-   * on this socket has failed.
-   * Quote from MSDN:
-   *   WSAECONNRESET - The virtual circuit was reset by the remote side
-   *   executing a hard or abortive close. The application should close
-   *   the socket; it is no longer usable. On a UDP-datagram socket this
-   *   error indicates a previous send operation resulted in an ICMP Port
-   *   Unreachable message.
-   */
-  if ( (-1 == size) &&
-       (ECONNRESET == errno) )
-    return;
-#endif
-  if (-1 == size)
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "UDP failed to receive data: %s\n",
-         STRERROR (errno));
-    /* Connection failure or something. Not a protocol violation. */
-    return;
-  }
-
+  sa = (const struct sockaddr *) addr;
   /* Check if this is a STUN packet */
   if (GNUNET_NO !=
       GNUNET_NAT_stun_handle_packet (plugin->nat,
-				     (const struct sockaddr *) &addr,
+				     sa,
 				     fromlen,
 				     buf,
 				     size))
@@ -3179,7 +3159,7 @@ udp_select_read (struct Plugin *plugin,
   switch (sa->sa_family)
   {
   case AF_INET:
-    sa4 = (const struct sockaddr_in *) &addr;
+    sa4 = (const struct sockaddr_in *) addr;
     v4.options = 0;
     v4.ipv4_addr = sa4->sin_addr.s_addr;
     v4.u4_port = sa4->sin_port;
@@ -3187,7 +3167,7 @@ udp_select_read (struct Plugin *plugin,
     int_addr_len = sizeof (v4);
     break;
   case AF_INET6:
-    sa6 = (const struct sockaddr_in6 *) &addr;
+    sa6 = (const struct sockaddr_in6 *) addr;
     v6.options = 0;
     v6.ipv6_addr = sa6->sin6_addr;
     v6.u6_port = sa6->sin6_port;
@@ -3242,6 +3222,106 @@ udp_select_read (struct Plugin *plugin,
 }
 
 
+/**
+ * Read and process the datagrams waiting on the given socket, up to
+ * #UDP_IO_BATCH of them if we can receive several at once.
+ *
+ * @param plugin the overall plugin
+ * @param rsock socket to read from
+ */
+static void
+udp_select_read (struct Plugin *plugin,
+                 struct GNUNET_NETWORK_Handle *rsock)
+{
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_IO_BATCH];
+  struct iovec iov[UDP_IO_BATCH];
+  struct sockaddr_storage addrs[UDP_IO_BATCH];
+  int ret;
+
+  if (NULL == plugin->read_buf)
+    plugin->read_buf = GNUNET_malloc (UDP_IO_BATCH * UDP_READ_BUFFER_SIZE);
+  memset (msgs,
+          0,
+          sizeof (msgs));
+  memset (addrs,
+          0,
+          sizeof (addrs));
+  for (unsigned int i = 0; i < UDP_IO_BATCH; i++)
+  {
+    iov[i].iov_base = &plugin->read_buf[i * UDP_READ_BUFFER_SIZE];
+    iov[i].iov_len = UDP_READ_BUFFER_SIZE;
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof (addrs[i]);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  ret = recvmmsg (GNUNET_NETWORK_get_fd (rsock),
+                  msgs,
+                  UDP_IO_BATCH,
+                  MSG_DONTWAIT,
+                  NULL);
+  if (-1 == ret)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "UDP failed to receive data: %s\n",
+         STRERROR (errno));
+    /* Connection failure or something. Not a protocol violation. */
+    return;
+  }
+  for (int i = 0; i < ret; i++)
+    udp_process_datagram (plugin,
+                          iov[i].iov_base,
+                          msgs[i].msg_len,
+                          &addrs[i],
+                          msgs[i].msg_hdr.msg_namelen);
+#else
+  socklen_t fromlen;
+  struct sockaddr_storage addr;
+  char buf[UDP_READ_BUFFER_SIZE] GNUNET_ALIGN;
+  ssize_t size;
+
+  fromlen = sizeof (addr);
+  memset (&addr,
+          0,
+          sizeof(addr));
+  size = GNUNET_NETWORK_socket_recvfrom (rsock,
+                                         buf,
+                                         sizeof (buf),
+                                         (struct sockaddr *) &addr,
+                                         &fromlen);
+#if MINGW
+  /* On SOCK_DGRAM UDP sockets recvfrom might fail with a
+   * WSAECONNRESET error to indicate that previous sendto() (yes, sendto!)
+   * on this socket has failed.
+   * Quote from MSDN:
+   *   WSAECONNRESET - The virtual circuit was reset by the remote side
+   *   executing a hard or abortive close. The application should close
+   *   the socket; it is no longer usable. On a UDP-datagram socket this
+   *   error indicates a previous send operation resulted in an ICMP Port
+   *   Unreachable message.
+   */
+  if ( (-1 == size) &&
+       (ECONNRESET == errno) )
+    return;
+#endif
+  if (-1 == size)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "UDP failed to receive data: %s\n",
+         STRERROR (errno));
+    /* Connection failure or something. Not a protocol violation. */
+    return;
+  }
+  udp_process_datagram (plugin,
+                        buf,
+                        size,
+                        &addr,
+                        fromlen);
+#endif
+}
+
+
 /**
  * Removes messages from the transmission queue that have
  * timed out, and then selects a message that should be
@@ -3354,8 +3434,8 @@ analyze_send_error (struct Plugin *plugin,
                                         slen);
   if ( ( (GNUNET_ATS_NET_LAN == type) ||
          (GNUNET_ATS_NET_WAN == type) ) &&
-       ( (ENETUNREACH == errno) ||
-         (ENETDOWN == errno) ) )
+       ( (ENETUNREACH == error) ||
+         (ENETDOWN == error) ) )
   {
     if (slen == sizeof (struct sockaddr_in))
     {
@@ -3395,132 +3475,278 @@ analyze_send_error (struct Plugin *plugin,
 
 
 /**
- * It is time to try to transmit a UDP message.  Select one
- * and send.
+ * Get the socket address of the session of @a udpw.
  *
- * @param plugin the plugin
- * @param sock which socket (v4/v6) to send on
+ * @param udpw message to transmit
+ * @param[out] sa where to store the address
+ * @return number of bytes in @a sa, 0 if the address is malformed
  */
-static void
-udp_select_send (struct Plugin *plugin,
-                 struct GNUNET_NETWORK_Handle *sock)
+static socklen_t
+udp_message_sockaddr (const struct UDP_MessageWrapper *udpw,
+                      struct sockaddr_storage *sa)
 {
-  ssize_t sent;
-  socklen_t slen;
-  const struct sockaddr *a;
   const struct IPv4UdpAddress *u4;
-  struct sockaddr_in a4;
+  struct sockaddr_in *a4;
   const struct IPv6UdpAddress *u6;
-  struct sockaddr_in6 a6;
-  struct UDP_MessageWrapper *udpw;
+  struct sockaddr_in6 *a6;
 
-  /* Find message(s) to send */
-  while (NULL != (udpw = remove_timeout_messages_and_select (plugin,
-                                                             sock)))
+  memset (sa,
+          0,
+          sizeof (*sa));
+  if (sizeof (struct IPv4UdpAddress) == udpw->session->address->address_length)
   {
-    if (sizeof (struct IPv4UdpAddress) == udpw->session->address->address_length)
-    {
-      u4 = udpw->session->address->address;
-      memset (&a4,
-              0,
-              sizeof(a4));
-      a4.sin_family = AF_INET;
+    u4 = udpw->session->address->address;
+    a4 = (struct sockaddr_in *) sa;
+    a4->sin_family = AF_INET;
 #if HAVE_SOCKADDR_IN_SIN_LEN
-      a4.sin_len = sizeof (a4);
+    a4->sin_len = sizeof (*a4);
 #endif
-      a4.sin_port = u4->u4_port;
-      a4.sin_addr.s_addr = u4->ipv4_addr;
-      a = (const struct sockaddr *) &a4;
-      slen = sizeof (a4);
-    }
-    else if (sizeof (struct IPv6UdpAddress) == udpw->session->address->address_length)
-    {
-      u6 = udpw->session->address->address;
-      memset (&a6,
-              0,
-              sizeof(a6));
-      a6.sin6_family = AF_INET6;
+    a4->sin_port = u4->u4_port;
+    a4->sin_addr.s_addr = u4->ipv4_addr;
+    return sizeof (*a4);
+  }
+  if (sizeof (struct IPv6UdpAddress) == udpw->session->address->address_length)
+  {
+    u6 = udpw->session->address->address;
+    a6 = (struct sockaddr_in6 *) sa;
+    a6->sin6_family = AF_INET6;
 #if HAVE_SOCKADDR_IN_SIN_LEN
-      a6.sin6_len = sizeof (a6);
+    a6->sin6_len = sizeof (*a6);
 #endif
-      a6.sin6_port = u6->u6_port;
-      a6.sin6_addr = u6->ipv6_addr;
-      a = (const struct sockaddr *) &a6;
-      slen = sizeof (a6);
-    }
-    else
+    a6->sin6_port = u6->u6_port;
+    a6->sin6_addr = u6->ipv6_addr;
+    return sizeof (*a6);
+  }
+  return 0;
+}
+
+
+/**
+ * Transmit a batch of messages, with one system call if the system
+ * can do that.
+ *
+ * @param sock socket to send on
+ * @param batch the messages to send
+ * @param addrs destination addresses of the messages in @a batch
+ * @param slens number of bytes in each of the @a addrs
+ * @param n number of messages in @a batch
+ * @param[out] sent set to the number of bytes sent for each message,
+ *             #GNUNET_SYSERR on failure
+ * @param[out] errors set to the error for each failed message
+ */
+static void
+udp_send_batch (struct GNUNET_NETWORK_Handle *sock,
+                struct UDP_MessageWrapper *const *batch,
+                struct sockaddr_storage *addrs,
+                const socklen_t *slens,
+                unsigned int n,
+                ssize_t *sent,
+                int *errors)
+{
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[UDP_IO_BATCH];
+  struct iovec iov[UDP_IO_BATCH];
+  unsigned int off;
+  int ret;
+
+  memset (msgs,
+          0,
+          sizeof (msgs));
+  for (unsigned int i = 0; i < n; i++)
+  {
+    iov[i].iov_base = batch[i]->msg_buf;
+    iov[i].iov_len = batch[i]->msg_size;
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = slens[i];
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  off = 0;
+  while (off < n)
+  {
+    ret = sendmmsg (GNUNET_NETWORK_get_fd (sock),
+                    &msgs[off],
+                    n - off,
+                    MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (-1 == ret)
     {
-      GNUNET_break (0);
-      dequeue (plugin,
-               udpw);
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_SYSERR);
-      notify_session_monitor (plugin,
-                              udpw->session,
-                              GNUNET_TRANSPORT_SS_UPDATE);
-      GNUNET_free (udpw);
+      /* The first message failed, continue after it. */
+      sent[off] = GNUNET_SYSERR;
+      errors[off] = errno;
+      off++;
       continue;
     }
-    sent = GNUNET_NETWORK_socket_sendto (sock,
-                                         udpw->msg_buf,
-                                         udpw->msg_size,
-                                         a,
-                                         slen);
-    udpw->session->last_transmit_time
-      = GNUNET_TIME_absolute_max (GNUNET_TIME_absolute_get (),
-                                  udpw->session->last_transmit_time);
-    dequeue (plugin,
-             udpw);
-    if (GNUNET_SYSERR == sent)
+    for (unsigned int i = off; i < off + ret; i++)
     {
-      /* Failure */
-      analyze_send_error (plugin,
-                          a,
-                          slen,
-                          errno);
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_SYSERR);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, bytes, sent, failure",
-                                sent,
-                                GNUNET_NO);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, messages, sent, failure",
-                                1,
-                                GNUNET_NO);
+      sent[i] = msgs[i].msg_len;
+      errors[i] = 0;
     }
-    else
+    off += ret;
+  }
+#else
+  for (unsigned int i = 0; i < n; i++)
+  {
+    sent[i] = GNUNET_NETWORK_socket_sendto (sock,
+                                            batch[i]->msg_buf,
+                                            batch[i]->msg_size,
+                                            (const struct sockaddr *) &addrs[i],
+                                            slens[i]);
+    errors[i] = errno;
+  }
+#endif
+}
+
+
+/**
+ * We tried to transmit @a udpw.  Update statistics, call its
+ * continuation and release the session we kept alive for it.
+ *
+ * @param plugin the plugin
+ * @param udpw the message, dequeued and freed here
+ * @param a address we sent @a udpw to
+ * @param slen number of bytes in @a a
+ * @param sent number of bytes sent, #GNUNET_SYSERR on failure
+ * @param error the errno value for the failure
+ */
+static void
+udp_message_transmitted (struct Plugin *plugin,
+                         struct UDP_MessageWrapper *udpw,
+                         const struct sockaddr *a,
+                         socklen_t slen,
+                         ssize_t sent,
+                         int error)
+{
+  struct GNUNET_ATS_Session *session = udpw->session;
+
+  session->last_transmit_time
+    = GNUNET_TIME_absolute_max (GNUNET_TIME_absolute_get (),
+                                session->last_transmit_time);
+  if (GNUNET_SYSERR == sent)
+  {
+    /* Failure */
+    analyze_send_error (plugin,
+                        a,
+                        slen,
+                        error);
+    udpw->qc (udpw->qc_cls,
+              udpw,
+              GNUNET_SYSERR);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, bytes, sent, failure",
+                              sent,
+                              GNUNET_NO);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, messages, sent, failure",
+                              1,
+                              GNUNET_NO);
+  }
+  else
+  {
+    /* Success */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "UDP transmitted %u-byte message to  `%s' `%s' (%d: %s)\n",
+         (unsigned int) (udpw->msg_size),
+         GNUNET_i2s (&session->target),
+         GNUNET_a2s (a,
+                     slen),
+         (int ) sent,
+         "ok");
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, bytes, sent, success",
+                              sent,
+                              GNUNET_NO);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, messages, sent, success",
+                              1,
+                              GNUNET_NO);
+    if (NULL != udpw->frag_ctx)
+      udpw->frag_ctx->on_wire_size += udpw->msg_size;
+    udpw->qc (udpw->qc_cls,
+              udpw,
+              GNUNET_OK);
+  }
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  GNUNET_free (udpw);
+  session->rc--;
+  if ( (0 == session->rc) &&
+       (GNUNET_YES == session->in_destroy) )
+    free_session (session);
+}
+
+
+/**
+ * It is time to try to transmit UDP messages.  Select the messages
+ * that are ready and send them, #UDP_IO_BATCH at a time.
+ *
+ * @param plugin the plugin
+ * @param sock which socket (v4/v6) to send on
+ */
+static void
+udp_select_send (struct Plugin *plugin,
+                 struct GNUNET_NETWORK_Handle *sock)
+{
+  struct UDP_MessageWrapper *batch[UDP_IO_BATCH];
+  struct sockaddr_storage addrs[UDP_IO_BATCH];
+  socklen_t slens[UDP_IO_BATCH];
+  ssize_t sent[UDP_IO_BATCH];
+  int errors[UDP_IO_BATCH];
+  struct UDP_MessageWrapper *udpw;
+  unsigned int n;
+
+  do
+  {
+    /* Find message(s) to send */
+    n = 0;
+    while ( (n < UDP_IO_BATCH) &&
+            (NULL != (udpw = remove_timeout_messages_and_select (plugin,
+                                                                 sock))) )
     {
-      /* Success */
-      LOG (GNUNET_ERROR_TYPE_DEBUG,
-           "UDP transmitted %u-byte message to  `%s' `%s' (%d: %s)\n",
-           (unsigned int) (udpw->msg_size),
-           GNUNET_i2s (&udpw->session->target),
-           GNUNET_a2s (a,
-                       slen),
-           (int ) sent,
-           (sent < 0) ? STRERROR (errno) : "ok");
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, bytes, sent, success",
-                                sent,
-                                GNUNET_NO);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, messages, sent, success",
-                                1,
-                                GNUNET_NO);
-      if (NULL != udpw->frag_ctx)
-        udpw->frag_ctx->on_wire_size += udpw->msg_size;
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_OK);
+      /* Continuations of earlier messages in the batch may end the
+         fragmented message of a fragment, so fragments only ever
+         start a batch. */
+      if ( (NULL != udpw->frag_ctx) &&
+           (0 != n) )
+        break;
+      slens[n] = udp_message_sockaddr (udpw,
+                                       &addrs[n]);
+      if (0 == slens[n])
+      {
+        GNUNET_break (0);
+        dequeue (plugin,
+                 udpw);
+        udpw->qc (udpw->qc_cls,
+                  udpw,
+                  GNUNET_SYSERR);
+        notify_session_monitor (plugin,
+                                udpw->session,
+                                GNUNET_TRANSPORT_SS_UPDATE);
+        GNUNET_free (udpw);
+        continue;
+      }
+      dequeue (plugin,
+               udpw);
+      /* Keep the session alive until we are done with @a udpw. */
+      udpw->session->rc++;
+      batch[n++] = udpw;
     }
-    notify_session_monitor (plugin,
-                            udpw->session,
-                            GNUNET_TRANSPORT_SS_UPDATE);
-    GNUNET_free (udpw);
+    udp_send_batch (sock,
+                    batch,
+                    addrs,
+                    slens,
+                    n,
+                    sent,
+                    errors);
+    for (unsigned int i = 0; i < n; i++)
+      udp_message_transmitted (plugin,
+                               batch[i],
+                               (const struct sockaddr *) &addrs[i],
+                               slens[i],
+                               sent[i],
+                               errors[i]);
   }
+  while (0 != n);
 }
 
 
@@ -4164,6 +4390,7 @@ libgnunet_plugin_transport_udp_done (void *cls)
     }
     GNUNET_free (cur);
   }
+  GNUNET_free_non_null (plugin->read_buf);
   GNUNET_free (plugin);
   GNUNET_free (api);
   return NULL;
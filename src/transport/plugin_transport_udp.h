@@ -258,6 +258,12 @@ struct Plugin
    */
   struct GNUNET_TIME_Relative broadcast_interval;
 
+  /**
+   * Buffers for receiving #UDP_IO_BATCH datagrams at once, allocated
+   * on first use.
+   */
+  char *read_buf;
+
   /**
    * Bytes currently in buffer
    */
@@ -35,6 +35,12 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util-client",__VA_ARGS__)
 
+/**
+ * Maximum number of queued messages we try to transmit
+ * with a single system call.
+ */
+#define MAX_COALESCED_MESSAGES 32
+
 /**
  * Timeout we use on TCP connect before trying another
  * result from the DNS resolver.  Actual value used
@@ -244,7 +250,9 @@ connect_fail_continuation (struct ClientState *cstate)
 
 
 /**
- * We are ready to send a message to the service.
+ * We are ready to send a message to the service.  Transmits as many
+ * of the queued messages as the socket accepts with a single system
+ * call.
  *
  * @param cls the `struct ClientState` with the `msg` to transmit
  */
@@ -252,25 +260,42 @@ static void
 transmit_ready (void *cls)
 {
   struct ClientState *cstate = cls;
+  const struct GNUNET_MessageHeader *msgs[MAX_COALESCED_MESSAGES];
+  const void *bufs[MAX_COALESCED_MESSAGES];
+  size_t lens[MAX_COALESCED_MESSAGES];
+  unsigned int num;
+  unsigned int done;
   ssize_t ret;
   size_t len;
-  const char *pos;
+  size_t left;
   int notify_in_flight;
 
   cstate->send_task = NULL;
-  pos = (const char *) cstate->msg;
   len = ntohs (cstate->msg->size);
   GNUNET_assert (cstate->msg_off < len);
+  num = GNUNET_MQ_impl_peek (cstate->mq,
+                             msgs,
+                             MAX_COALESCED_MESSAGES);
+  GNUNET_assert (msgs[0] == cstate->msg);
+  bufs[0] = &((const char *) cstate->msg)[cstate->msg_off];
+  lens[0] = len - cstate->msg_off;
+  for (unsigned int i = 1; i < num; i++)
+  {
+    bufs[i] = msgs[i];
+    lens[i] = ntohs (msgs[i]->size);
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "client: message of type %u trying to send with socket %p (MQ: %p\n",
+              "client: message of type %u (and %u more) trying to send with socket %p (MQ: %p\n",
               ntohs(cstate->msg->type),
+              num - 1,
               cstate->sock,
               cstate->mq);
 
  RETRY:
-  ret = GNUNET_NETWORK_socket_send (cstate->sock,
-                                    &pos[cstate->msg_off],
-                                    len - cstate->msg_off);
+  ret = GNUNET_NETWORK_socket_sendv (cstate->sock,
+                                     bufs,
+                                     lens,
+                                     num);
   if (-1 == ret)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
@@ -286,10 +311,16 @@ transmit_ready (void *cls)
                             GNUNET_MQ_ERROR_WRITE);
     return;
   }
-  notify_in_flight = (0 == cstate->msg_off);
-  cstate->msg_off += ret;
-  if (cstate->msg_off < len)
+  /* how many messages went out completely? */
+  done = 0;
+  left = ret;
+  while ( (done < num) &&
+          (left >= lens[done]) )
+    left -= lens[done++];
+  if (0 == done)
   {
+    notify_in_flight = (0 == cstate->msg_off);
+    cstate->msg_off += ret;
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "client: rescheduling message of type %u\n",
                 ntohs(cstate->msg->type));
@@ -303,10 +334,27 @@ transmit_ready (void *cls)
     return;
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "client: sending message of type %u successful\n",
-              ntohs(cstate->msg->type));
+              "client: sending %u message(s) successful\n",
+              done);
+  if (0 != left)
+  {
+    /* we are in the middle of the next message */
+    cstate->msg = msgs[done];
+    cstate->msg_off = left;
+    cstate->send_task
+      = GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                        cstate->sock,
+                                        &transmit_ready,
+                                        cstate);
+    GNUNET_MQ_impl_send_continue_multiple (cstate->mq,
+                                           done,
+                                           GNUNET_YES);
+    return;
+  }
   cstate->msg = NULL;
-  GNUNET_MQ_impl_send_continue (cstate->mq);
+  GNUNET_MQ_impl_send_continue_multiple (cstate->mq,
+                                         done,
+                                         GNUNET_NO);
 }
 
 
@@ -33,7 +33,8 @@
  *
  * To be able to delete entries from the bloom filter, we maintain
  * a 4 bit counter in the file on the drive (we still use only one
- * bit in memory).
+ * bit for testing).  The counters are also kept in memory and only
+ * written to the file in batches.
  *
  * @author Igor Wronsky
  * @author Christian Grothoff
@@ -48,6 +49,36 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util-container-bloomfilter", syscall, filename)
 
+/**
+ * How many bit positions do we get out of one hash code?
+ */
+#define BITS_PER_HASH (sizeof (struct GNUNET_HashCode) / sizeof (uint32_t))
+
+/**
+ * How many elements do the batch operations process at once?
+ */
+#define BATCH_SIZE 8
+
+/**
+ * Granularity in which we track modified usage counters and
+ * write them to disk.
+ */
+#define COUNTER_PAGE_SIZE 4096
+
+/**
+ * After how many element additions or removals do we write the
+ * modified counter pages to disk without being asked to?
+ */
+#define MAX_PENDING_UPDATES 4096
+
+/**
+ * Suffix of the file that exists next to the file of a filter while
+ * counter updates are pending.  If it is still there when the filter
+ * is loaded, the filter was not closed cleanly and updates were lost.
+ */
+#define DIRTY_SUFFIX ".dirty"
+
+
 struct GNUNET_CONTAINER_BloomFilter
 {
 
@@ -76,9 +107,62 @@ struct GNUNET_CONTAINER_BloomFilter
    */
   size_t bitArraySize;
 
+  /**
+   * Number of bits in bitArray minus one if that number is a power
+   * of two (so we can mask instead of taking the modulus), 0 if not.
+   */
+  uint64_t bitMask;
+
+  /**
+   * In-memory copy of the 4 bit usage counters in the file (two per
+   * byte, the lower half for the even bit), NULL if the filter is
+   * not backed by a file.  Has 4 * bitArraySize bytes.
+   */
+  unsigned char *counters;
+
+  /**
+   * One bit per #COUNTER_PAGE_SIZE bytes of counters, set if
+   * the page was modified and not yet written to the file.
+   */
+  unsigned char *dirty;
+
+  /**
+   * Number of bits set in dirty.
+   */
+  unsigned int dirtyPages;
+
+  /**
+   * Number of elements added or removed since the last flush.
+   */
+  unsigned int pendingUpdates;
+
+  /**
+   * #GNUNET_YES if we created the #DIRTY_SUFFIX file for pending
+   * counter updates.
+   */
+  int markedDirty;
+
 };
 
 
+/**
+ * Set the size of the bit array of a filter.
+ *
+ * @param bf the filter
+ * @param size size of the bit array in bytes
+ */
+static void
+setSize (struct GNUNET_CONTAINER_BloomFilter *bf,
+         size_t size)
+{
+  bf->bitArraySize = size;
+  if (0 == (size & (size - 1)))
+    bf->bitMask = size * 8LL - 1;
+  else
+    bf->bitMask = 0;
+}
+
+
 /**
  * Get the number of the addresses set per element in the bloom filter.
  *
@@ -163,134 +247,278 @@ clearBit (char *bitArray, unsigned int bitIdx)
 }
 
 /**
- * Checks if a bit is active in the bitArray
+ * Number of counter pages of a filter.
  *
- * @param bitArray memory area to set the bit in
- * @param bitIdx which bit to test
- * @return GNUNET_YES if the bit is set, GNUNET_NO if not.
+ * @param bf the filter
+ * @return number of pages of #COUNTER_PAGE_SIZE bytes in counters
+ */
+static size_t
+counterPages (const struct GNUNET_CONTAINER_BloomFilter *bf)
+{
+  return (bf->bitArraySize * 4LL + COUNTER_PAGE_SIZE - 1) / COUNTER_PAGE_SIZE;
+}
+
+
+/**
+ * Allocate zeroed usage counters for a filter backed by a file.
+ *
+ * @param bf the filter, with the size of the bit array set
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if out of memory
  */
 static int
-testBit (char *bitArray, unsigned int bitIdx)
+allocCounters (struct GNUNET_CONTAINER_BloomFilter *bf)
 {
-  size_t slot;
-  unsigned int targetBit;
+  bf->counters = GNUNET_malloc_large (bf->bitArraySize * 4LL);
+  bf->dirty = GNUNET_malloc_large ((counterPages (bf) + 7) / 8);
+  bf->dirtyPages = 0;
+  if ( (NULL == bf->counters) ||
+       (NULL == bf->dirty) )
+  {
+    GNUNET_free_non_null (bf->counters);
+    GNUNET_free_non_null (bf->dirty);
+    bf->counters = NULL;
+    bf->dirty = NULL;
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
 
-  slot = bitIdx / 8;
-  targetBit = (1L << (bitIdx % 8));
-  if (bitArray[slot] & targetBit)
-    return GNUNET_YES;
-  else
-    return GNUNET_NO;
+
+/**
+ * Get the name of the file that marks the file of a filter as dirty.
+ *
+ * @param filename name of the file of the filter
+ * @return name of the marker, to be freed by the caller
+ */
+static char *
+dirtyName (const char *filename)
+{
+  char *dn;
+
+  GNUNET_asprintf (&dn,
+                   "%s%s",
+                   filename,
+                   DIRTY_SUFFIX);
+  return dn;
 }
 
+
 /**
- * Sets a bit active in the bitArray and increments
- * bit-specific usage counter on disk (but only if
- * the counter was below 4 bit max (==15)).
+ * Mark the file of a filter as dirty before the in-memory counters
+ * start to differ from it.
  *
- * @param bitArray memory area to set the bit in
- * @param bitIdx which bit to test
- * @param fh A file to keep the 4 bit address usage counters in
+ * @param bf the filter
  */
 static void
-incrementBit (char *bitArray, unsigned int bitIdx,
-              const struct GNUNET_DISK_FileHandle *fh)
+markFile (struct GNUNET_CONTAINER_BloomFilter *bf)
 {
-  off_t fileSlot;
-  unsigned char value;
-  unsigned int high;
-  unsigned int low;
-  unsigned int targetLoc;
+  struct GNUNET_DISK_FileHandle *fh;
+  char *dn;
 
-  setBit (bitArray, bitIdx);
-  if (GNUNET_DISK_handle_invalid (fh))
+  if (GNUNET_YES == bf->markedDirty)
     return;
-  /* Update the counter file on disk */
-  fileSlot = bitIdx / 2;
-  targetLoc = bitIdx % 2;
-
-  GNUNET_assert (fileSlot ==
-                 GNUNET_DISK_file_seek (fh, fileSlot, GNUNET_DISK_SEEK_SET));
-  if (1 != GNUNET_DISK_file_read (fh, &value, 1))
-    value = 0;
-  low = value & 0xF;
-  high = (value & (~0xF)) >> 4;
-
-  if (targetLoc == 0)
+  dn = dirtyName (bf->filename);
+  fh = GNUNET_DISK_file_open (dn,
+                              GNUNET_DISK_OPEN_CREATE |
+                              GNUNET_DISK_OPEN_WRITE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == fh)
   {
-    if (low < 0xF)
-      low++;
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "open",
+                       dn);
+    GNUNET_free (dn);
+    return;
   }
-  else
+  (void) GNUNET_DISK_file_sync (fh);
+  GNUNET_DISK_file_close (fh);
+  GNUNET_free (dn);
+  bf->markedDirty = GNUNET_YES;
+}
+
+
+/**
+ * All counters were written to the file of a filter, make sure they
+ * are on the drive and mark the file as clean again.
+ *
+ * @param bf the filter
+ */
+static void
+unmarkFile (struct GNUNET_CONTAINER_BloomFilter *bf)
+{
+  char *dn;
+
+  if (GNUNET_YES != bf->markedDirty)
+    return;
+  if (GNUNET_OK != GNUNET_DISK_file_sync (bf->fh))
   {
-    if (high < 0xF)
-      high++;
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "fsync",
+                       bf->filename);
+    return;
   }
-  value = ((high << 4) | low);
-  GNUNET_assert (fileSlot ==
-                 GNUNET_DISK_file_seek (fh, fileSlot, GNUNET_DISK_SEEK_SET));
-  GNUNET_assert (1 == GNUNET_DISK_file_write (fh, &value, 1));
+  dn = dirtyName (bf->filename);
+  if ( (0 != UNLINK (dn)) &&
+       (ENOENT != errno) )
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "unlink",
+                       dn);
+  else
+    bf->markedDirty = GNUNET_NO;
+  GNUNET_free (dn);
 }
 
+
 /**
- * Clears a bit from bitArray if the respective usage
- * counter on the disk hits/is zero.
+ * Note that a byte of the usage counters was modified.
  *
- * @param bitArray memory area to set the bit in
- * @param bitIdx which bit to test
- * @param fh A file to keep the 4bit address usage counters in
+ * @param bf the filter
+ * @param offset offset of the byte in counters
  */
 static void
-decrementBit (char *bitArray, unsigned int bitIdx,
-              const struct GNUNET_DISK_FileHandle *fh)
+markDirty (struct GNUNET_CONTAINER_BloomFilter *bf,
+           size_t offset)
 {
-  off_t fileslot;
-  unsigned char value;
-  unsigned int high;
-  unsigned int low;
-  unsigned int targetLoc;
+  size_t page = offset / COUNTER_PAGE_SIZE;
+  unsigned char bit = (unsigned char) (1 << (page % 8));
 
-  if (GNUNET_DISK_handle_invalid (fh))
-    return;                     /* cannot decrement! */
-  /* Each char slot in the counter file holds two 4 bit counters */
-  fileslot = bitIdx / 2;
-  targetLoc = bitIdx % 2;
-  if (GNUNET_SYSERR == GNUNET_DISK_file_seek (fh, fileslot, GNUNET_DISK_SEEK_SET))
-    {
-      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "seek");
-      return;
-    }
-  if (1 != GNUNET_DISK_file_read (fh, &value, 1))
-    value = 0;
-  low = value & 0xF;
-  high = (value & 0xF0) >> 4;
+  if (0 != (bf->dirty[page / 8] & bit))
+    return;
+  if (0 == bf->dirtyPages)
+    markFile (bf);
+  bf->dirty[page / 8] |= bit;
+  bf->dirtyPages++;
+}
 
-  /* decrement, but once we have reached the max, never go back! */
-  if (targetLoc == 0)
+
+/**
+ * Write the modified pages of the usage counters to the file.
+ * Adjacent pages are written together.
+ *
+ * @param bf the filter
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on write errors
+ *         (the affected pages stay dirty)
+ */
+static int
+flushCounters (struct GNUNET_CONTAINER_BloomFilter *bf)
+{
+  size_t pages;
+  size_t start;
+  size_t end;
+  size_t off;
+  size_t len;
+  size_t i;
+  int ret;
+
+  if (NULL == bf->counters)
+    return GNUNET_OK;
+  bf->pendingUpdates = 0;
+  if (0 == bf->dirtyPages)
   {
-    if ((low > 0) && (low < 0xF))
-      low--;
-    if (low == 0)
-    {
-      clearBit (bitArray, bitIdx);
-    }
+    unmarkFile (bf);
+    return GNUNET_OK;
   }
-  else
+  ret = GNUNET_OK;
+  pages = counterPages (bf);
+  start = 0;
+  while (start < pages)
   {
-    if ((high > 0) && (high < 0xF))
-      high--;
-    if (high == 0)
+    if (0 == (bf->dirty[start / 8] & (1 << (start % 8))))
     {
-      clearBit (bitArray, bitIdx);
+      start++;
+      continue;
     }
-  }
-  value = ((high << 4) | low);
-  if (GNUNET_SYSERR == GNUNET_DISK_file_seek (fh, fileslot, GNUNET_DISK_SEEK_SET))
+    for (end = start + 1; end < pages; end++)
+      if (0 == (bf->dirty[end / 8] & (1 << (end % 8))))
+        break;
+    off = start * COUNTER_PAGE_SIZE;
+    len = GNUNET_MIN (end * COUNTER_PAGE_SIZE,
+                      bf->bitArraySize * 4LL) - off;
+    if ( ((off_t) off !=
+          GNUNET_DISK_file_seek (bf->fh,
+                                 off,
+                                 GNUNET_DISK_SEEK_SET)) ||
+         (len !=
+          GNUNET_DISK_file_write (bf->fh,
+                                  &bf->counters[off],
+                                  len)) )
+    {
+      LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                         "write",
+                         bf->filename);
+      ret = GNUNET_SYSERR;
+    }
+    else
     {
-      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "seek");
-      return;
+      for (i = start; i < end; i++)
+        bf->dirty[i / 8] &= ~(1 << (i % 8));
+      bf->dirtyPages -= end - start;
     }
-  GNUNET_assert (1 == GNUNET_DISK_file_write (fh, &value, 1));
+    start = end;
+  }
+  if (0 == bf->dirtyPages)
+    unmarkFile (bf);
+  return ret;
+}
+
+
+/**
+ * Sets a bit active in the bitArray and increments the bit-specific
+ * usage counter (but only if the counter was below 4 bit max (==15)).
+ *
+ * @param bf the filter
+ * @param bitIdx which bit to set
+ */
+static void
+incrementBit (struct GNUNET_CONTAINER_BloomFilter *bf,
+              uint32_t bitIdx)
+{
+  size_t offset;
+  unsigned int shift;
+
+  setBit (bf->bitArray, bitIdx);
+  if (NULL == bf->counters)
+    return;
+  offset = bitIdx / 2;
+  shift = 4 * (bitIdx % 2);
+  if (0xF == ((bf->counters[offset] >> shift) & 0xF))
+    return;
+  bf->counters[offset] += (unsigned char) (1 << shift);
+  markDirty (bf, offset);
+}
+
+
+/**
+ * Decrements the usage counter of a bit and clears the bit from
+ * the bitArray if the counter hits/is zero.
+ *
+ * @param bf the filter
+ * @param bitIdx which bit to decrement
+ */
+static void
+decrementBit (struct GNUNET_CONTAINER_BloomFilter *bf,
+              uint32_t bitIdx)
+{
+  size_t offset;
+  unsigned int shift;
+  unsigned int value;
+
+  if (NULL == bf->counters)
+    return;                     /* cannot decrement! */
+  offset = bitIdx / 2;
+  shift = 4 * (bitIdx % 2);
+  value = (bf->counters[offset] >> shift) & 0xF;
+  /* decrement, but once we have reached the max, never go back! */
+  if ( (value > 0) &&
+       (value < 0xF) )
+  {
+    value--;
+    bf->counters[offset] -= (unsigned char) (1 << shift);
+    markDirty (bf, offset);
+  }
+  if (0 == value)
+    clearBit (bf->bitArray, bitIdx);
 }
 
 #define BUFFSIZE 65536
@@ -333,129 +561,220 @@ make_empty_file (const struct GNUNET_DISK_FileHandle *fh, size_t size)
   return GNUNET_OK;
 }
 
-/* ************** GNUNET_CONTAINER_BloomFilter iterator ********* */
+/* ************** GNUNET_CONTAINER_BloomFilter bit positions ********* */
 
 /**
- * Iterator (callback) method to be called by the
- * bloomfilter iterator on each bit that is to be
- * set or tested for the key.
- *
- * @param cls closure
- * @param bf the filter to manipulate
- * @param bit the current bit
- * @return GNUNET_YES to continue, GNUNET_NO to stop early
+ * Computes the bit positions that the bloomfilter must test or set
+ * for an element, #BITS_PER_HASH at a time.  The first positions
+ * come straight from the element; if more are needed, the element
+ * is hashed again.
  */
-typedef int (*BitIterator) (void *cls,
-                            const struct GNUNET_CONTAINER_BloomFilter * bf,
-                            unsigned int bit);
+struct BitCursor
+{
+  /**
+   * Hash code the next positions are taken from.
+   */
+  struct GNUNET_HashCode hc;
+
+  /**
+   * Number of positions still to compute.
+   */
+  unsigned int remaining;
+
+  /**
+   * Number of rounds of positions computed so far.
+   */
+  unsigned int round;
+};
 
 
 /**
- * Call an iterator for each bit that the bloomfilter
- * must test or set for this element.
+ * Start computing the bit positions for an element.
  *
  * @param bf the filter
- * @param callback the method to call
- * @param arg extra argument to callback
- * @param key the key for which we iterate over the BF bits
+ * @param[out] bc cursor to initialize
+ * @param key the element
  */
 static void
-iterateBits (const struct GNUNET_CONTAINER_BloomFilter *bf,
-             BitIterator callback, void *arg, const struct GNUNET_HashCode *key)
+cursorInit (const struct GNUNET_CONTAINER_BloomFilter *bf,
+            struct BitCursor *bc,
+            const struct GNUNET_HashCode *key)
 {
-  struct GNUNET_HashCode tmp[2];
-  int bitCount;
-  unsigned int round;
-  unsigned int slot = 0;
-
-  bitCount = bf->addressesPerElement;
-  tmp[0] = *key;
-  round = 0;
   GNUNET_assert (bf->bitArraySize > 0);
   GNUNET_assert (bf->bitArraySize * 8LL > bf->bitArraySize);
-  while (bitCount > 0)
+  bc->hc = *key;
+  bc->remaining = bf->addressesPerElement;
+  bc->round = 0;
+}
+
+
+/**
+ * Compute the next round of bit positions.
+ *
+ * @param bf the filter
+ * @param bc cursor for the element
+ * @param[out] bits where to store the positions
+ * @return number of positions stored in @a bits, 0 if there are no more
+ */
+static unsigned int
+cursorNext (const struct GNUNET_CONTAINER_BloomFilter *bf,
+            struct BitCursor *bc,
+            uint32_t bits[BITS_PER_HASH])
+{
+  struct GNUNET_HashCode next;
+  uint64_t numBits;
+  unsigned int n;
+  unsigned int i;
+
+  if (0 == bc->remaining)
+    return 0;
+  if (0 != bc->round)
   {
-    while (slot < (sizeof (struct GNUNET_HashCode) / sizeof (uint32_t)))
-    {
-      if (GNUNET_YES !=
-          callback (arg, bf,
-                    ntohl ((((uint32_t *) & tmp[round & 1])[slot])) %
-                    ((bf->bitArraySize * 8LL))))
-        return;
-      slot++;
-      bitCount--;
-      if (bitCount == 0)
-        break;
-    }
-    if (bitCount > 0)
-    {
-      GNUNET_CRYPTO_hash (&tmp[round & 1], sizeof (struct GNUNET_HashCode),
-                          &tmp[(round + 1) & 1]);
-      round++;
-      slot = 0;
-    }
+    GNUNET_CRYPTO_hash (&bc->hc,
+                        sizeof (struct GNUNET_HashCode),
+                        &next);
+    bc->hc = next;
+  }
+  bc->round++;
+  n = GNUNET_MIN (bc->remaining,
+                  BITS_PER_HASH);
+  bc->remaining -= n;
+  if (0 != bf->bitMask)
+  {
+    for (i = 0; i < n; i++)
+      bits[i] = ntohl (bc->hc.bits[i]) & bf->bitMask;
   }
+  else
+  {
+    numBits = bf->bitArraySize * 8LL;
+    for (i = 0; i < n; i++)
+      bits[i] = ntohl (bc->hc.bits[i]) % numBits;
+  }
+  return n;
 }
 
 
 /**
- * Callback: increment bit
+ * Check if all of the given bits are set.  Tests all of them
+ * without branching, which is faster than stopping early.
  *
- * @param cls pointer to writeable form of bf
- * @param bf the filter to manipulate
- * @param bit the bit to increment
- * @return GNUNET_YES
+ * @param bf the filter
+ * @param bits bit positions to test
+ * @param n number of positions in @a bits
+ * @return #GNUNET_YES if all bits are set, #GNUNET_NO if not
  */
 static int
-incrementBitCallback (void *cls, const struct GNUNET_CONTAINER_BloomFilter *bf,
-                      unsigned int bit)
+testBits (const struct GNUNET_CONTAINER_BloomFilter *bf,
+          const uint32_t *bits,
+          unsigned int n)
 {
-  struct GNUNET_CONTAINER_BloomFilter *b = cls;
+  const unsigned char *bytes = (const unsigned char *) bf->bitArray;
+  unsigned int missing;
+  unsigned int i;
 
-  incrementBit (b->bitArray, bit, bf->fh);
-  return GNUNET_YES;
+  missing = 0;
+  for (i = 0; i < n; i++)
+    missing |= (~bytes[bits[i] / 8]) & (1 << (bits[i] % 8));
+  return (0 == missing) ? GNUNET_YES : GNUNET_NO;
 }
 
 
 /**
- * Callback: decrement bit
+ * Test the remaining bit positions of an element.
  *
- * @param cls pointer to writeable form of bf
- * @param bf the filter to manipulate
- * @param bit the bit to decrement
- * @return GNUNET_YES
+ * @param bf the filter
+ * @param bc cursor for the element
+ * @return #GNUNET_YES if all bits are set, #GNUNET_NO if not
  */
 static int
-decrementBitCallback (void *cls, const struct GNUNET_CONTAINER_BloomFilter *bf,
-                      unsigned int bit)
+testRemaining (const struct GNUNET_CONTAINER_BloomFilter *bf,
+               struct BitCursor *bc)
 {
-  struct GNUNET_CONTAINER_BloomFilter *b = cls;
+  uint32_t bits[BITS_PER_HASH];
+  unsigned int n;
 
-  decrementBit (b->bitArray, bit, bf->fh);
+  while (0 != (n = cursorNext (bf, bc, bits)))
+    if (GNUNET_NO == testBits (bf, bits, n))
+      return GNUNET_NO;
   return GNUNET_YES;
 }
 
 
 /**
- * Callback: test if all bits are set
+ * Set the bits of an element and increment their usage counters.
  *
- * @param cls pointer set to GNUNET_NO if bit is not set
  * @param bf the filter
- * @param bit the bit to test
- * @return YES if the bit is set, NO if not
+ * @param e the element
  */
-static int
-testBitCallback (void *cls, const struct GNUNET_CONTAINER_BloomFilter *bf,
-                 unsigned int bit)
+static void
+addElement (struct GNUNET_CONTAINER_BloomFilter *bf,
+            const struct GNUNET_HashCode *e)
+{
+  struct BitCursor bc;
+  uint32_t bits[BITS_PER_HASH];
+  unsigned int n;
+  unsigned int i;
+
+  cursorInit (bf, &bc, e);
+  while (0 != (n = cursorNext (bf, &bc, bits)))
+    for (i = 0; i < n; i++)
+      incrementBit (bf, bits[i]);
+}
+
+
+/**
+ * Note that @a count elements were added or removed, and write the
+ * usage counters to disk if too many updates are pending.
+ *
+ * @param bf the filter
+ * @param count number of elements added or removed
+ */
+static void
+checkFlush (struct GNUNET_CONTAINER_BloomFilter *bf,
+            unsigned int count)
 {
-  int *arg = cls;
+  if (NULL == bf->counters)
+    return;
+  bf->pendingUpdates += count;
+  if (bf->pendingUpdates >= MAX_PENDING_UPDATES)
+    (void) flushCounters (bf);
+}
+
 
-  if (GNUNET_NO == testBit (bf->bitArray, bit))
+/**
+ * OR @a size bytes of @a src into @a dst.  Uses the compiler's
+ * vector extensions where available.
+ *
+ * @param dst where to OR into
+ * @param src what to OR in
+ * @param size number of bytes
+ */
+static void
+orBytes (char *dst,
+         const char *src,
+         size_t size)
+{
+  size_t i;
+#if defined(__GNUC__)
+  typedef uint64_t Vector __attribute__ ((vector_size (32)));
+  Vector a;
+  Vector b;
+#else
+  uint64_t a;
+  uint64_t b;
+#endif
+
+  /* memcpy() as the arrays need not be aligned; compilers turn
+     these into plain (unaligned) vector loads and stores */
+  for (i = 0; i + sizeof (a) <= size; i += sizeof (a))
   {
-    *arg = GNUNET_NO;
-    return GNUNET_NO;
+    memcpy (&a, &dst[i], sizeof (a));
+    memcpy (&b, &src[i], sizeof (b));
+    a |= b;
+    memcpy (&dst[i], &a, sizeof (a));
   }
-  return GNUNET_YES;
+  for (; i < size; i++)
+    dst[i] |= src[i];
 }
 
 /* *********************** INTERFACE **************** */
@@ -469,19 +788,21 @@ testBitCallback (void *cls, const struct GNUNET_CONTAINER_BloomFilter *bf,
  *        to next power of 2
  * @param k the number of GNUNET_CRYPTO_hash-functions to apply per
  *        element (number of bits set per element in the set)
- * @return the bloomfilter
+ * @return the bloomfilter, NULL on error or if the file was not
+ *         closed cleanly (then updates of its counters were lost,
+ *         so it may miss elements)
  */
 struct GNUNET_CONTAINER_BloomFilter *
 GNUNET_CONTAINER_bloomfilter_load (const char *filename, size_t size,
                                    unsigned int k)
 {
   struct GNUNET_CONTAINER_BloomFilter *bf;
-  char *rbuff;
   off_t pos;
   int i;
   size_t ui;
   off_t fsize;
   int must_read;
+  char *dn;
 
   GNUNET_assert (NULL != filename);
   if ((k == 0) || (size == 0))
@@ -494,6 +815,24 @@ GNUNET_CONTAINER_bloomfilter_load (const char *filename, size_t size,
     ui *= 2;
   size = ui;                    /* make sure it's a power of 2 */
 
+  dn = dirtyName (filename);
+  if (GNUNET_YES == GNUNET_DISK_file_test (dn))
+  {
+    if (GNUNET_YES == GNUNET_DISK_file_test (filename))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Bloom filter file `%s' was not closed cleanly\n"),
+                  filename);
+      GNUNET_free (dn);
+      return NULL;
+    }
+    /* stale marker of a file that is gone */
+    if (0 != UNLINK (dn))
+      LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                         "unlink",
+                         dn);
+  }
+  GNUNET_free (dn);
   bf = GNUNET_new (struct GNUNET_CONTAINER_BloomFilter);
   /* Try to open a bloomfilter file */
   if (GNUNET_YES == GNUNET_DISK_file_test (filename))
@@ -564,53 +903,51 @@ GNUNET_CONTAINER_bloomfilter_load (const char *filename, size_t size,
   bf->filename = GNUNET_strdup (filename);
   /* Alloc block */
   bf->bitArray = GNUNET_malloc_large (size);
-  if (NULL == bf->bitArray)
+  setSize (bf, size);
+  if ( (NULL == bf->bitArray) ||
+       (GNUNET_OK != allocCounters (bf)) )
   {
+    GNUNET_free_non_null (bf->bitArray);
     if (NULL != bf->fh)
       GNUNET_DISK_file_close (bf->fh);
     GNUNET_free (bf->filename);
     GNUNET_free (bf);
     return NULL;
   }
-  bf->bitArraySize = size;
   bf->addressesPerElement = k;
   if (GNUNET_YES != must_read)
     return bf; /* already done! */
-  /* Read from the file what bits we can */
-  rbuff = GNUNET_malloc (BUFFSIZE);
+  /* Read the usage counters and set the bits that are in use */
   pos = 0;
-  while (pos < ((off_t) size) * 8LL)
+  while (pos < ((off_t) size) * 4LL)
   {
-    int res;
+    ssize_t res;
 
     res = GNUNET_DISK_file_read (bf->fh,
-				 rbuff,
-				 BUFFSIZE);
+				 &bf->counters[pos],
+				 GNUNET_MIN (BUFFSIZE,
+                                             ((off_t) size) * 4LL - pos));
     if (res == -1)
     {
       LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
 			 "read",
 			 bf->filename);
-      GNUNET_free (rbuff);
-      GNUNET_free (bf->filename);
-      GNUNET_DISK_file_close (bf->fh);
-      GNUNET_free (bf);
+      GNUNET_CONTAINER_bloomfilter_free (bf);
       return NULL;
     }
     if (res == 0)
       break;                    /* is ok! we just did not use that many bits yet */
     for (i = 0; i < res; i++)
     {
-      if ((rbuff[i] & 0x0F) != 0)
-        setBit (bf->bitArray, pos + i * 2);
-      if ((rbuff[i] & 0xF0) != 0)
-        setBit (bf->bitArray, pos + i * 2 + 1);
+      if (0 == bf->counters[pos + i])
+        continue;
+      if ((bf->counters[pos + i] & 0x0F) != 0)
+        setBit (bf->bitArray, (pos + i) * 2);
+      if ((bf->counters[pos + i] & 0xF0) != 0)
+        setBit (bf->bitArray, (pos + i) * 2 + 1);
     }
-    if (res < BUFFSIZE)
-      break;
-    pos += BUFFSIZE * 2;        /* 2 bits per byte in the buffer */
+    pos += res;
   }
-  GNUNET_free (rbuff);
   return bf;
 }
 
@@ -645,7 +982,7 @@ GNUNET_CONTAINER_bloomfilter_init (const char *data, size_t size,
     GNUNET_free (bf);
     return NULL;
   }
-  bf->bitArraySize = size;
+  setSize (bf, size);
   bf->addressesPerElement = k;
   if (NULL != data)
     GNUNET_memcpy (bf->bitArray, data, size);
@@ -688,14 +1025,34 @@ GNUNET_CONTAINER_bloomfilter_free (struct GNUNET_CONTAINER_BloomFilter *bf)
 {
   if (NULL == bf)
     return;
+  (void) flushCounters (bf);
   if (bf->fh != NULL)
     GNUNET_DISK_file_close (bf->fh);
   GNUNET_free_non_null (bf->filename);
+  GNUNET_free_non_null (bf->counters);
+  GNUNET_free_non_null (bf->dirty);
   GNUNET_free (bf->bitArray);
   GNUNET_free (bf);
 }
 
 
+/**
+ * Write pending changes to the usage counters of a filter to its
+ * file.
+ *
+ * @param bf the filter
+ * @return #GNUNET_OK on success (or if @a bf is not backed by a file),
+ *         #GNUNET_SYSERR on write errors
+ */
+int
+GNUNET_CONTAINER_bloomfilter_flush (struct GNUNET_CONTAINER_BloomFilter *bf)
+{
+  if (NULL == bf)
+    return GNUNET_OK;
+  return flushCounters (bf);
+}
+
+
 /**
  * Reset a bloom filter to empty. Clears the file on disk.
  *
@@ -708,8 +1065,18 @@ GNUNET_CONTAINER_bloomfilter_clear (struct GNUNET_CONTAINER_BloomFilter *bf)
     return;
 
   memset (bf->bitArray, 0, bf->bitArraySize);
+  if (NULL != bf->counters)
+  {
+    memset (bf->counters, 0, bf->bitArraySize * 4LL);
+    memset (bf->dirty, 0, (counterPages (bf) + 7) / 8);
+    bf->dirtyPages = 0;
+    bf->pendingUpdates = 0;
+  }
   if (bf->filename != NULL)
+  {
     make_empty_file (bf->fh, bf->bitArraySize * 4LL);
+    unmarkFile (bf);
+  }
 }
 
 
@@ -724,13 +1091,69 @@ int
 GNUNET_CONTAINER_bloomfilter_test (const struct GNUNET_CONTAINER_BloomFilter *bf,
 				   const struct GNUNET_HashCode * e)
 {
-  int res;
+  struct BitCursor bc;
 
   if (NULL == bf)
     return GNUNET_YES;
-  res = GNUNET_YES;
-  iterateBits (bf, &testBitCallback, &res, e);
-  return res;
+  cursorInit (bf, &bc, e);
+  return testRemaining (bf, &bc);
+}
+
+
+/**
+ * Test if elements are in the filter.  Faster than testing the
+ * elements one by one, as the memory accesses for several elements
+ * are issued together.
+ *
+ * @param bf the filter
+ * @param e array of elements to test
+ * @param count number of elements in @a e
+ * @param[out] results array of @a count results, set to #GNUNET_YES
+ *             if the element is in the filter, #GNUNET_NO if not
+ * @return number of elements in the filter
+ */
+unsigned int
+GNUNET_CONTAINER_bloomfilter_test_batch (const struct GNUNET_CONTAINER_BloomFilter *bf,
+                                         const struct GNUNET_HashCode *e,
+                                         unsigned int count,
+                                         int *results)
+{
+  struct BitCursor bc[BATCH_SIZE];
+  uint32_t bits[BATCH_SIZE][BITS_PER_HASH];
+  unsigned int n[BATCH_SIZE];
+  unsigned int todo;
+  unsigned int found;
+  unsigned int off;
+  unsigned int i;
+
+  if (NULL == bf)
+  {
+    for (i = 0; i < count; i++)
+      results[i] = GNUNET_YES;
+    return count;
+  }
+  found = 0;
+  for (off = 0; off < count; off += todo)
+  {
+    /* first compute the positions of all elements in the batch,
+       then test them, so that the loads do not depend on each other */
+    todo = GNUNET_MIN (count - off,
+                       BATCH_SIZE);
+    for (i = 0; i < todo; i++)
+    {
+      cursorInit (bf, &bc[i], &e[off + i]);
+      n[i] = cursorNext (bf, &bc[i], bits[i]);
+    }
+    for (i = 0; i < todo; i++)
+    {
+      results[off + i] = testBits (bf, bits[i], n[i]);
+      if (GNUNET_YES == results[off + i])
+        results[off + i] = testRemaining (bf, &bc[i]);
+      if (GNUNET_YES == results[off + i])
+        found++;
+    }
+  }
+  return found;
 }
 
 
@@ -746,7 +1169,30 @@ GNUNET_CONTAINER_bloomfilter_add (struct GNUNET_CONTAINER_BloomFilter *bf,
 {
   if (NULL == bf)
     return;
-  iterateBits (bf, &incrementBitCallback, bf, e);
+  addElement (bf, e);
+  checkFlush (bf, 1);
+}
+
+
+/**
+ * Add elements to the filter.
+ *
+ * @param bf the filter
+ * @param e array of elements to add
+ * @param count number of elements in @a e
+ */
+void
+GNUNET_CONTAINER_bloomfilter_add_batch (struct GNUNET_CONTAINER_BloomFilter *bf,
+                                        const struct GNUNET_HashCode *e,
+                                        unsigned int count)
+{
+  unsigned int i;
+
+  if (NULL == bf)
+    return;
+  for (i = 0; i < count; i++)
+    addElement (bf, &e[i]);
+  checkFlush (bf, count);
 }
 
 
@@ -765,23 +1211,13 @@ GNUNET_CONTAINER_bloomfilter_or (struct GNUNET_CONTAINER_BloomFilter *bf,
                                  const char *data,
 				 size_t size)
 {
-  unsigned int i;
-  unsigned int n;
-  unsigned long long *fc;
-  const unsigned long long *dc;
-
   if (NULL == bf)
     return GNUNET_YES;
   if (bf->bitArraySize != size)
     return GNUNET_SYSERR;
-  fc = (unsigned long long *) bf->bitArray;
-  dc = (const unsigned long long *) data;
-  n = size / sizeof (unsigned long long);
-
-  for (i = 0; i < n; i++)
-    fc[i] |= dc[i];
-  for (i = n * sizeof (unsigned long long); i < size; i++)
-    bf->bitArray[i] |= data[i];
+  orBytes (bf->bitArray,
+           data,
+           size);
   return GNUNET_OK;
 }
 
@@ -799,12 +1235,6 @@ int
 GNUNET_CONTAINER_bloomfilter_or2 (struct GNUNET_CONTAINER_BloomFilter *bf,
                                   const struct GNUNET_CONTAINER_BloomFilter *to_or)
 {
-  unsigned int i;
-  unsigned int n;
-  unsigned long long *fc;
-  const unsigned long long *dc;
-  size_t size;
-
   if (NULL == bf)
     return GNUNET_OK;
   if (bf->bitArraySize != to_or->bitArraySize)
@@ -812,15 +1242,9 @@ GNUNET_CONTAINER_bloomfilter_or2 (struct GNUNET_CONTAINER_BloomFilter *bf,
     GNUNET_break (0);
     return GNUNET_SYSERR;
   }
-  size = bf->bitArraySize;
-  fc = (unsigned long long *) bf->bitArray;
-  dc = (const unsigned long long *) to_or->bitArray;
-  n = size / sizeof (unsigned long long);
-
-  for (i = 0; i < n; i++)
-    fc[i] |= dc[i];
-  for (i = n * sizeof (unsigned long long); i < size; i++)
-    bf->bitArray[i] |= to_or->bitArray[i];
+  orBytes (bf->bitArray,
+           to_or->bitArray,
+           bf->bitArraySize);
   return GNUNET_OK;
 }
 
@@ -835,14 +1259,20 @@ void
 GNUNET_CONTAINER_bloomfilter_remove (struct GNUNET_CONTAINER_BloomFilter *bf,
                                      const struct GNUNET_HashCode *e)
 {
+  struct BitCursor bc;
+  uint32_t bits[BITS_PER_HASH];
+  unsigned int n;
+  unsigned int i;
+
   if (NULL == bf)
     return;
   if (NULL == bf->filename)
     return;
-  iterateBits (bf,
-	       &decrementBitCallback,
-	       bf,
-	       e);
+  cursorInit (bf, &bc, e);
+  while (0 != (n = cursorNext (bf, &bc, bits)))
+    for (i = 0; i < n; i++)
+      decrementBit (bf, bits[i]);
+  checkFlush (bf, 1);
 }
 
 /**
@@ -872,8 +1302,14 @@ GNUNET_CONTAINER_bloomfilter_resize (struct GNUNET_CONTAINER_BloomFilter *bf,
     i *= 2;
   size = i;                     /* make sure it's a power of 2 */
   bf->addressesPerElement = k;
-  bf->bitArraySize = size;
+  setSize (bf, size);
   bf->bitArray = GNUNET_malloc (size);
+  if (NULL != bf->counters)
+  {
+    GNUNET_free (bf->counters);
+    GNUNET_free (bf->dirty);
+    GNUNET_assert (GNUNET_OK == allocCounters (bf));
+  }
   if (NULL != bf->filename)
     make_empty_file (bf->fh,
 		     bf->bitArraySize * 4LL);
@@ -93,6 +93,62 @@ union MapEntry
 };
 
 
+/**
+ * Entry of an open-addressing map with the full key.
+ */
+struct OpenBigEntry
+{
+
+  /**
+   * Key for the entry.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Value of the entry.
+   */
+  void *value;
+
+};
+
+
+/**
+ * Entry of an open-addressing map with just a pointer to the key.
+ */
+struct OpenSmallEntry
+{
+
+  /**
+   * Key for the entry.
+   */
+  const struct GNUNET_HashCode *key;
+
+  /**
+   * Value of the entry.
+   */
+  void *value;
+
+};
+
+
+/**
+ * Fingerprint of a slot of an open-addressing map that was never
+ * used since the map was last rebuilt.  Ends every probe sequence.
+ */
+#define FP_EMPTY 0
+
+/**
+ * Fingerprint of a slot of an open-addressing map whose entry was
+ * removed.  Probe sequences continue past such slots.
+ */
+#define FP_DELETED 1
+
+/**
+ * Smallest number of slots of an open-addressing map.
+ */
+#define OPEN_MIN_LENGTH 8
+
+
 /**
  * Internal representation of the hash map.
  */
@@ -124,6 +180,30 @@ struct GNUNET_CONTAINER_MultiHashMap
    * to the map, so that iterators can check if they are still valid.
    */
   unsigned int modification_counter;
+
+  /**
+   * Fingerprints of the keys in the slots of an open-addressing map
+   * (#FP_EMPTY or #FP_DELETED for free slots), NULL if the map uses
+   * chaining.  Has @e map_length entries, which is a power of two.
+   */
+  uint64_t *fps;
+
+  /**
+   * Slots of an open-addressing map with small entries,
+   * same index as @e fps.
+   */
+  struct OpenSmallEntry *osme;
+
+  /**
+   * Slots of an open-addressing map with big entries,
+   * same index as @e fps.
+   */
+  struct OpenBigEntry *obme;
+
+  /**
+   * Number of #FP_DELETED slots in an open-addressing map.
+   */
+  unsigned int deleted;
 };
 
 
@@ -156,6 +236,297 @@ struct GNUNET_CONTAINER_MultiHashMapIterator
 };
 
 
+/**
+ * Compute the fingerprint of a key for an open-addressing map.
+ * Like #idx_of(), this relies on keys being hash codes, whose
+ * first bytes are as good as any.
+ *
+ * @param key the key
+ * @return fingerprint of @a key, never #FP_EMPTY or #FP_DELETED
+ */
+static uint64_t
+oa_fingerprint (const struct GNUNET_HashCode *key)
+{
+  uint64_t fp;
+
+  GNUNET_memcpy (&fp,
+                 key,
+                 sizeof (fp));
+  if (fp <= FP_DELETED)
+    fp += 2;
+  return fp;
+}
+
+
+/**
+ * Compute the first slot of the probe sequence for a fingerprint.
+ *
+ * @param map open-addressing map
+ * @param fp fingerprint of the key
+ * @return offset into the slot arrays of @a map
+ */
+static unsigned int
+oa_home (const struct GNUNET_CONTAINER_MultiHashMap *map,
+         uint64_t fp)
+{
+  return ((unsigned int) (fp ^ (fp >> 32))) & (map->map_length - 1);
+}
+
+
+/**
+ * Get the key stored in a slot of an open-addressing map.
+ *
+ * @param map open-addressing map
+ * @param i index of an occupied slot
+ * @return the key
+ */
+static const struct GNUNET_HashCode *
+oa_key (const struct GNUNET_CONTAINER_MultiHashMap *map,
+        unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->osme[i].key;
+  return &map->obme[i].key;
+}
+
+
+/**
+ * Get the value stored in a slot of an open-addressing map.
+ *
+ * @param map open-addressing map
+ * @param i index of an occupied slot
+ * @return the value
+ */
+static void *
+oa_value (const struct GNUNET_CONTAINER_MultiHashMap *map,
+          unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->osme[i].value;
+  return map->obme[i].value;
+}
+
+
+/**
+ * Check if a slot of an open-addressing map holds the given key.
+ *
+ * @param map open-addressing map
+ * @param i index of the slot
+ * @param fp fingerprint of @a key
+ * @param key key to look for
+ * @return #GNUNET_YES if slot @a i holds @a key
+ */
+static int
+oa_match (const struct GNUNET_CONTAINER_MultiHashMap *map,
+          unsigned int i,
+          uint64_t fp,
+          const struct GNUNET_HashCode *key)
+{
+  if (fp != map->fps[i])
+    return GNUNET_NO;
+  if (0 != memcmp (key,
+                   oa_key (map, i),
+                   sizeof (struct GNUNET_HashCode)))
+    return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Find the first slot of an open-addressing map holding a key.
+ *
+ * @param map open-addressing map
+ * @param key key to look for
+ * @param fp fingerprint of @a key
+ * @return index of the slot, -1 if @a key is not in @a map
+ */
+static int
+oa_find (const struct GNUNET_CONTAINER_MultiHashMap *map,
+         const struct GNUNET_HashCode *key,
+         uint64_t fp)
+{
+  unsigned int i;
+
+  for (i = oa_home (map, fp);
+       FP_EMPTY != map->fps[i];
+       i = (i + 1) & (map->map_length - 1))
+    if (oa_match (map, i, fp, key))
+      return (int) i;
+  return -1;
+}
+
+
+/**
+ * Allocate empty slot arrays for an open-addressing map.
+ *
+ * @param map the map, slot arrays are overwritten
+ * @param len number of slots, must be a power of two
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if we are out of memory
+ */
+static int
+oa_alloc (struct GNUNET_CONTAINER_MultiHashMap *map,
+          unsigned int len)
+{
+  map->fps = GNUNET_malloc_large ((size_t) len * sizeof (uint64_t));
+  map->osme = NULL;
+  map->obme = NULL;
+  if (map->use_small_entries)
+    map->osme = GNUNET_malloc_large ((size_t) len * sizeof (struct OpenSmallEntry));
+  else
+    map->obme = GNUNET_malloc_large ((size_t) len * sizeof (struct OpenBigEntry));
+  if ( (NULL == map->fps) ||
+       ( (NULL == map->osme) &&
+         (NULL == map->obme) ) )
+  {
+    GNUNET_free_non_null (map->fps);
+    GNUNET_free_non_null (map->osme);
+    GNUNET_free_non_null (map->obme);
+    map->fps = NULL;
+    return GNUNET_SYSERR;
+  }
+  map->map_length = len;
+  map->deleted = 0;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Move all entries of an open-addressing map into new slot arrays,
+ * dropping the #FP_DELETED markers.
+ *
+ * @param map the map to rebuild
+ * @param new_len new number of slots, must be a power of two
+ */
+static void
+oa_rebuild (struct GNUNET_CONTAINER_MultiHashMap *map,
+            unsigned int new_len)
+{
+  struct GNUNET_CONTAINER_MultiHashMap old;
+  unsigned int i;
+  unsigned int j;
+
+  map->modification_counter++;
+  old = *map;
+  if (GNUNET_OK != oa_alloc (map,
+                             new_len))
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         "Failed to allocate %u slots\n",
+         new_len);
+    GNUNET_assert (0);
+  }
+  for (i = 0; i < old.map_length; i++)
+  {
+    if (old.fps[i] <= FP_DELETED)
+      continue;
+    for (j = oa_home (map, old.fps[i]);
+         FP_EMPTY != map->fps[j];
+         j = (j + 1) & (new_len - 1)) ;
+    map->fps[j] = old.fps[i];
+    if (map->use_small_entries)
+      map->osme[j] = old.osme[i];
+    else
+      map->obme[j] = old.obme[i];
+  }
+  GNUNET_free (old.fps);
+  GNUNET_free_non_null (old.osme);
+  GNUNET_free_non_null (old.obme);
+}
+
+
+/**
+ * Free a slot of an open-addressing map.  If the slot ends a probe
+ * sequence anyway, it (and the #FP_DELETED slots before it) become
+ * #FP_EMPTY again.  Entries never move, so iterations stay valid.
+ *
+ * @param map open-addressing map
+ * @param i index of an occupied slot
+ */
+static void
+oa_clear_slot (struct GNUNET_CONTAINER_MultiHashMap *map,
+               unsigned int i)
+{
+  unsigned int mask = map->map_length - 1;
+
+  map->size--;
+  if (FP_EMPTY != map->fps[(i + 1) & mask])
+  {
+    map->fps[i] = FP_DELETED;
+    map->deleted++;
+    return;
+  }
+  map->fps[i] = FP_EMPTY;
+  for (i = (i - 1) & mask; FP_DELETED == map->fps[i]; i = (i - 1) & mask)
+  {
+    map->fps[i] = FP_EMPTY;
+    map->deleted--;
+  }
+}
+
+
+/**
+ * Store a key-value pair in an open-addressing map.
+ *
+ * @param map the map
+ * @param key key to use
+ * @param value value to use
+ * @param opt options for put
+ * @return see #GNUNET_CONTAINER_multihashmap_put()
+ */
+static int
+oa_put (struct GNUNET_CONTAINER_MultiHashMap *map,
+        const struct GNUNET_HashCode *key,
+        void *value,
+        enum GNUNET_CONTAINER_MultiHashMapOption opt)
+{
+  uint64_t fp;
+  unsigned int i;
+  int off;
+
+  fp = oa_fingerprint (key);
+  if ((opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE) &&
+      (opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
+  {
+    off = oa_find (map, key, fp);
+    if (-1 != off)
+    {
+      if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
+        return GNUNET_SYSERR;
+      if (map->use_small_entries)
+        map->osme[off].value = value;
+      else
+        map->obme[off].value = value;
+      return GNUNET_NO;
+    }
+  }
+  /* keep at least a quarter of the slots empty, so that
+     probe sequences stay short */
+  if ((map->size + map->deleted + 1) * 4LLU > map->map_length * 3LLU)
+    oa_rebuild (map,
+                (map->size * 2LLU >= map->map_length)
+                ? map->map_length * 2
+                : map->map_length);
+  for (i = oa_home (map, fp);
+       FP_DELETED < map->fps[i];
+       i = (i + 1) & (map->map_length - 1)) ;
+  if (FP_DELETED == map->fps[i])
+    map->deleted--;
+  map->fps[i] = fp;
+  if (map->use_small_entries)
+  {
+    map->osme[i].key = key;
+    map->osme[i].value = value;
+  }
+  else
+  {
+    map->obme[i].key = *key;
+    map->obme[i].value = value;
+  }
+  map->size++;
+  return GNUNET_OK;
+}
+
+
 /**
  * Create a multi hash map.
  *
@@ -186,6 +557,42 @@ GNUNET_CONTAINER_multihashmap_create (unsigned int len,
 }
 
 
+/**
+ * Create a multi hash map with a particular memory layout.
+ *
+ * @param len initial size (map will grow as needed)
+ * @param do_not_copy_keys see #GNUNET_CONTAINER_multihashmap_create()
+ * @param layout memory layout to use
+ * @return NULL on error
+ */
+struct GNUNET_CONTAINER_MultiHashMap *
+GNUNET_CONTAINER_multihashmap_create_with_layout (unsigned int len,
+                                                  int do_not_copy_keys,
+                                                  enum GNUNET_CONTAINER_MultiHashMapLayout layout)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *map;
+  unsigned int slots;
+
+  if (GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING != layout)
+    return GNUNET_CONTAINER_multihashmap_create (len,
+                                                 do_not_copy_keys);
+  GNUNET_assert (len > 0);
+  GNUNET_assert (len <= (1U << 31));
+  slots = OPEN_MIN_LENGTH;
+  while (slots < len)
+    slots *= 2;
+  map = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMap);
+  map->use_small_entries = do_not_copy_keys;
+  if (GNUNET_OK != oa_alloc (map,
+                             slots))
+  {
+    GNUNET_free (map);
+    return NULL;
+  }
+  return map;
+}
+
+
 /**
  * Destroy a hash map.  Will not free any values
  * stored in the hash map!
@@ -199,6 +606,14 @@ GNUNET_CONTAINER_multihashmap_destroy (struct GNUNET_CONTAINER_MultiHashMap
   unsigned int i;
   union MapEntry me;
 
+  if (NULL != map->fps)
+  {
+    GNUNET_free (map->fps);
+    GNUNET_free_non_null (map->osme);
+    GNUNET_free_non_null (map->obme);
+    GNUNET_free (map);
+    return;
+  }
   for (i = 0; i < map->map_length; i++)
   {
     me = map->map[i];
@@ -280,6 +695,12 @@ GNUNET_CONTAINER_multihashmap_get (const struct GNUNET_CONTAINER_MultiHashMap *m
 {
   union MapEntry me;
 
+  if (NULL != map->fps)
+  {
+    int off = oa_find (map, key, oa_fingerprint (key));
+
+    return (-1 == off) ? NULL : oa_value (map, off);
+  }
   me = map->map[idx_of (map, key)];
   if (map->use_small_entries)
   {
@@ -323,6 +744,36 @@ GNUNET_CONTAINER_multihashmap_iterate (const struct
 
   count = 0;
   GNUNET_assert (NULL != map);
+  if (NULL != map->fps)
+  {
+    /* re-read the slot arrays in each round, @a it may put entries
+       and thereby rebuild the map */
+    for (i = 0; i < map->map_length; i++)
+    {
+      if (map->fps[i] <= FP_DELETED)
+        continue;
+      if (NULL != it)
+      {
+        if (map->use_small_entries)
+        {
+          if (GNUNET_OK != it (it_cls,
+                               map->osme[i].key,
+                               map->osme[i].value))
+            return GNUNET_SYSERR;
+        }
+        else
+        {
+          kc = map->obme[i].key;
+          if (GNUNET_OK != it (it_cls,
+                               &kc,
+                               map->obme[i].value))
+            return GNUNET_SYSERR;
+        }
+      }
+      count++;
+    }
+    return count;
+  }
   for (i = 0; i < map->map_length; i++)
   {
     me = map->map[i];
@@ -387,6 +838,23 @@ GNUNET_CONTAINER_multihashmap_remove (struct GNUNET_CONTAINER_MultiHashMap *map,
 
   map->modification_counter++;
 
+  if (NULL != map->fps)
+  {
+    uint64_t fp = oa_fingerprint (key);
+
+    for (i = oa_home (map, fp);
+         FP_EMPTY != map->fps[i];
+         i = (i + 1) & (map->map_length - 1))
+    {
+      if ( (oa_match (map, i, fp, key)) &&
+           (value == oa_value (map, i)) )
+      {
+        oa_clear_slot (map, i);
+        return GNUNET_YES;
+      }
+    }
+    return GNUNET_NO;
+  }
   i = idx_of (map, key);
   me = map->map[i];
   if (map->use_small_entries)
@@ -456,6 +924,22 @@ GNUNET_CONTAINER_multihashmap_remove_all (struct GNUNET_CONTAINER_MultiHashMap *
   map->modification_counter++;
 
   ret = 0;
+  if (NULL != map->fps)
+  {
+    uint64_t fp = oa_fingerprint (key);
+
+    for (i = oa_home (map, fp);
+         FP_EMPTY != map->fps[i];
+         i = (i + 1) & (map->map_length - 1))
+    {
+      if (oa_match (map, i, fp, key))
+      {
+        oa_clear_slot (map, i);
+        ret++;
+      }
+    }
+    return ret;
+  }
   i = idx_of (map, key);
   me = map->map[i];
   if (map->use_small_entries)
@@ -558,6 +1042,16 @@ GNUNET_CONTAINER_multihashmap_clear (struct GNUNET_CONTAINER_MultiHashMap *map)
   unsigned int ret;
 
   ret = map->size;
+  if (NULL != map->fps)
+  {
+    map->modification_counter++;
+    memset (map->fps,
+            0,
+            map->map_length * sizeof (uint64_t));
+    map->size = 0;
+    map->deleted = 0;
+    return ret;
+  }
   GNUNET_CONTAINER_multihashmap_iterate (map,
                                          &remove_all,
                                          map);
@@ -581,6 +1075,14 @@ GNUNET_CONTAINER_multihashmap_contains (const struct
 {
   union MapEntry me;
 
+  if (NULL != map->fps)
+  {
+    if (-1 == oa_find (map,
+                       key,
+                       oa_fingerprint (key)))
+      return GNUNET_NO;
+    return GNUNET_YES;
+  }
   me = map->map[idx_of (map, key)];
   if (map->use_small_entries)
   {
@@ -620,6 +1122,19 @@ GNUNET_CONTAINER_multihashmap_contains_value (const struct
 {
   union MapEntry me;
 
+  if (NULL != map->fps)
+  {
+    uint64_t fp = oa_fingerprint (key);
+    unsigned int i;
+
+    for (i = oa_home (map, fp);
+         FP_EMPTY != map->fps[i];
+         i = (i + 1) & (map->map_length - 1))
+      if ( (oa_match (map, i, fp, key)) &&
+           (value == oa_value (map, i)) )
+        return GNUNET_YES;
+    return GNUNET_NO;
+  }
   me = map->map[idx_of (map, key)];
   if (map->use_small_entries)
   {
@@ -718,6 +1233,11 @@ GNUNET_CONTAINER_multihashmap_put (struct GNUNET_CONTAINER_MultiHashMap *map,
   union MapEntry me;
   unsigned int i;
 
+  if (NULL != map->fps)
+    return oa_put (map,
+                   key,
+                   value,
+                   opt);
   i = idx_of (map, key);
   if ((opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE) &&
       (opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
@@ -801,6 +1321,23 @@ GNUNET_CONTAINER_multihashmap_get_multiple (const struct
   union MapEntry me;
 
   count = 0;
+  if (NULL != map->fps)
+  {
+    uint64_t fp = oa_fingerprint (key);
+    unsigned int i;
+
+    for (i = oa_home (map, fp);
+         FP_EMPTY != map->fps[i];
+         i = (i + 1) & (map->map_length - 1))
+    {
+      if (! oa_match (map, i, fp, key))
+        continue;
+      if ((it != NULL) && (GNUNET_OK != it (it_cls, key, oa_value (map, i))))
+        return GNUNET_SYSERR;
+      count++;
+    }
+    return count;
+  }
   me = map->map[idx_of (map, key)];
   if (map->use_small_entries)
   {
@@ -864,6 +1401,25 @@ GNUNET_CONTAINER_multihashmap_get_random (const struct GNUNET_CONTAINER_MultiHas
     return 1;
   off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
                                   map->size);
+  if (NULL != map->fps)
+  {
+    for (idx = 0; idx < map->map_length; idx++)
+    {
+      if (map->fps[idx] <= FP_DELETED)
+        continue;
+      if (0 == off)
+      {
+        if (GNUNET_OK != it (it_cls,
+                             oa_key (map, idx),
+                             oa_value (map, idx)))
+          return GNUNET_SYSERR;
+        return 1;
+      }
+      off--;
+    }
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
   for (idx = 0; idx < map->map_length; idx++)
   {
     me = map->map[idx];
@@ -932,7 +1488,8 @@ GNUNET_CONTAINER_multihashmap_iterator_create (const struct GNUNET_CONTAINER_Mul
   iter = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMapIterator);
   iter->map = map;
   iter->modification_counter = map->modification_counter;
-  iter->me = map->map[0];
+  if (NULL == map->fps)
+    iter->me = map->map[0];
   return iter;
 }
 
@@ -959,6 +1516,23 @@ GNUNET_CONTAINER_multihashmap_iterator_next (struct GNUNET_CONTAINER_MultiHashMa
   /* make sure the map has not been modified */
   GNUNET_assert (iter->modification_counter == iter->map->modification_counter);
 
+  if (NULL != iter->map->fps)
+  {
+    /* look for the next entry, skipping free slots */
+    while (iter->idx < iter->map->map_length)
+    {
+      unsigned int i = iter->idx++;
+
+      if (iter->map->fps[i] <= FP_DELETED)
+        continue;
+      if (NULL != key)
+        *key = *oa_key (iter->map, i);
+      if (NULL != value)
+        *value = oa_value (iter->map, i);
+      return GNUNET_YES;
+    }
+    return GNUNET_NO;
+  }
   /* look for the next entry, skipping empty buckets */
   while (1)
   {
@@ -0,0 +1,783 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/crypto_ecc_batch.c
+ * @brief verify batches of ECC signatures on a pool of threads
+ *
+ * Neither EdDSA nor ECDSA verification in libgcrypt offers a
+ * batched algorithm, so each signature is still checked on its own;
+ * the gain comes from spreading the checks over all CPUs and
+ * keeping them off the thread running the scheduler.
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-crypto-ecc-batch", __VA_ARGS__)
+
+/**
+ * How many signatures do we check per scheduler task if we have
+ * no threads?
+ */
+#define SCHEDULER_CHUNK_SIZE 8
+
+
+/**
+ * Copy of a `struct GNUNET_CRYPTO_VerifyItem`.
+ */
+struct Entry
+{
+  /**
+   * Kind of signature.
+   */
+  enum GNUNET_CRYPTO_VerifyType type;
+
+  /**
+   * Expected purpose of the signature.
+   */
+  uint32_t purpose;
+
+  /**
+   * Block to validate, allocated.
+   */
+  struct GNUNET_CRYPTO_EccSignaturePurpose *validate;
+
+  /**
+   * Signature to check.
+   */
+  union
+  {
+    struct GNUNET_CRYPTO_EddsaSignature eddsa;
+    struct GNUNET_CRYPTO_EcdsaSignature ecdsa;
+  } sig;
+
+  /**
+   * Public key of the signer.
+   */
+  union
+  {
+    struct GNUNET_CRYPTO_EddsaPublicKey eddsa;
+    struct GNUNET_CRYPTO_EcdsaPublicKey ecdsa;
+  } pub;
+};
+
+
+/**
+ * Handle for a batch of signatures being verified.
+ */
+struct GNUNET_CRYPTO_VerifyBatch
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *prev;
+
+  /**
+   * Pool the batch was submitted to.
+   */
+  struct GNUNET_CRYPTO_VerifyPool *pool;
+
+  /**
+   * Array of @e num_items signatures to check.
+   */
+  struct Entry *entries;
+
+  /**
+   * Array of @e num_items results.
+   */
+  int *results;
+
+  /**
+   * Function to call with the results.
+   */
+  GNUNET_CRYPTO_VerifyBatchCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Number of signatures in the batch.
+   */
+  unsigned int num_items;
+
+  /**
+   * Index of the next signature nobody is checking yet.
+   */
+  unsigned int next_item;
+
+  /**
+   * Number of signatures that have been checked.
+   */
+  unsigned int done;
+
+  /**
+   * #GNUNET_YES while the batch is in the pending list of the pool.
+   */
+  int pending;
+
+  /**
+   * #GNUNET_YES while the batch is in the done list of the pool.
+   */
+  int finished;
+
+  /**
+   * #GNUNET_YES if the batch was cancelled while workers were
+   * still checking some of its signatures.
+   */
+  int cancelled;
+};
+
+
+/**
+ * Pool of threads verifying signatures in the background.
+ */
+struct GNUNET_CRYPTO_VerifyPool
+{
+  /**
+   * Batches with signatures nobody is checking yet, head.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *pending_head;
+
+  /**
+   * Batches with signatures nobody is checking yet, tail.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *pending_tail;
+
+  /**
+   * Batches whose results still need to be delivered, head.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *done_head;
+
+  /**
+   * Batches whose results still need to be delivered, tail.
+   */
+  struct GNUNET_CRYPTO_VerifyBatch *done_tail;
+
+  /**
+   * Task run when the workers signal us (or the next chunk
+   * of signatures if we have no threads).
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * Number of batches whose callback has not been called yet.
+   */
+  unsigned int outstanding;
+
+#if HAVE_PTHREAD_H
+  /**
+   * Pipe the workers use to wake up the scheduler.
+   */
+  struct GNUNET_DISK_PipeHandle *wakeup;
+
+  /**
+   * Array of @e num_workers threads.
+   */
+  pthread_t *workers;
+
+  /**
+   * Number of entries in @e workers.
+   */
+  unsigned int num_workers;
+
+  /**
+   * Protects the batches and lists shared with the workers.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Signalled when a batch is added or the workers should stop.
+   */
+  pthread_cond_t work_cond;
+
+  /**
+   * Signalled when a worker finished a signature of a cancelled
+   * batch.
+   */
+  pthread_cond_t idle_cond;
+
+  /**
+   * #GNUNET_YES if the workers should terminate.
+   */
+  int stop;
+#endif
+};
+
+
+/**
+ * Check one signature.
+ *
+ * @param e signature to check
+ * @return #GNUNET_OK if valid, #GNUNET_SYSERR if not
+ */
+static int
+check_entry (const struct Entry *e)
+{
+  switch (e->type)
+  {
+  case GNUNET_CRYPTO_VERIFY_EDDSA:
+    return GNUNET_CRYPTO_eddsa_verify (e->purpose,
+                                       e->validate,
+                                       &e->sig.eddsa,
+                                       &e->pub.eddsa);
+  case GNUNET_CRYPTO_VERIFY_ECDSA:
+    return GNUNET_CRYPTO_ecdsa_verify (e->purpose,
+                                       e->validate,
+                                       &e->sig.ecdsa,
+                                       &e->pub.ecdsa);
+  }
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Release a batch.
+ *
+ * @param vb batch to release
+ */
+static void
+free_batch (struct GNUNET_CRYPTO_VerifyBatch *vb)
+{
+  for (unsigned int i = 0; i < vb->num_items; i++)
+    GNUNET_free (vb->entries[i].validate);
+  GNUNET_free (vb->entries);
+  GNUNET_free (vb->results);
+  GNUNET_free (vb);
+}
+
+
+/**
+ * Deliver the results of a completed batch and release it.
+ *
+ * @param vb batch to deliver
+ */
+static void
+deliver_batch (struct GNUNET_CRYPTO_VerifyBatch *vb)
+{
+  vb->pool->outstanding--;
+  vb->cb (vb->cb_cls,
+          vb->num_items,
+          vb->results);
+  free_batch (vb);
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Wake up the scheduler thread.
+ *
+ * @param pool pool to signal
+ */
+static void
+signal_scheduler (struct GNUNET_CRYPTO_VerifyPool *pool)
+{
+  const struct GNUNET_DISK_FileHandle *wh;
+  char c = 0;
+
+  wh = GNUNET_DISK_pipe_handle (pool->wakeup,
+                                GNUNET_DISK_PIPE_END_WRITE);
+  /* if the pipe is full, a wakeup is pending anyway */
+  (void) GNUNET_DISK_file_write (wh,
+                                 &c,
+                                 sizeof (c));
+}
+
+
+/**
+ * Main function of a worker thread.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_VerifyPool`
+ * @return NULL
+ */
+static void *
+worker_main (void *cls)
+{
+  struct GNUNET_CRYPTO_VerifyPool *pool = cls;
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+  unsigned int off;
+  int res;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  while (1)
+  {
+    while ( (GNUNET_NO == pool->stop) &&
+            (NULL == pool->pending_head) )
+      GNUNET_assert (0 == pthread_cond_wait (&pool->work_cond,
+                                             &pool->lock));
+    if (GNUNET_YES == pool->stop)
+      break;
+    vb = pool->pending_head;
+    off = vb->next_item++;
+    if (vb->next_item == vb->num_items)
+    {
+      GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                   pool->pending_tail,
+                                   vb);
+      vb->pending = GNUNET_NO;
+    }
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+    res = check_entry (&vb->entries[off]);
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    vb->results[off] = res;
+    vb->done++;
+    if (GNUNET_YES == vb->cancelled)
+    {
+      GNUNET_assert (0 == pthread_cond_broadcast (&pool->idle_cond));
+      continue;
+    }
+    if (vb->done == vb->num_items)
+    {
+      GNUNET_CONTAINER_DLL_insert_tail (pool->done_head,
+                                        pool->done_tail,
+                                        vb);
+      vb->finished = GNUNET_YES;
+      signal_scheduler (pool);
+    }
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  return NULL;
+}
+
+
+/**
+ * The workers signalled us.  Deliver the results of one completed
+ * batch, and come back for the next one.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_VerifyPool`
+ */
+static void
+wakeup_cb (void *cls)
+{
+  struct GNUNET_CRYPTO_VerifyPool *pool = cls;
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+  const struct GNUNET_DISK_FileHandle *rh;
+  char buf[64];
+  int more;
+
+  pool->task = NULL;
+  rh = GNUNET_DISK_pipe_handle (pool->wakeup,
+                                GNUNET_DISK_PIPE_END_READ);
+  while (0 < GNUNET_DISK_file_read (rh,
+                                    buf,
+                                    sizeof (buf)))
+    ;
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  vb = pool->done_head;
+  if (NULL != vb)
+  {
+    GNUNET_CONTAINER_DLL_remove (pool->done_head,
+                                 pool->done_tail,
+                                 vb);
+    vb->finished = GNUNET_NO;
+  }
+  more = (NULL != pool->done_head);
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  /* the callback may destroy the pool, so we must be done with
+     it before calling it */
+  if (GNUNET_YES == more)
+    pool->task = GNUNET_SCHEDULER_add_now (&wakeup_cb,
+                                           pool);
+  else if (pool->outstanding > ((NULL == vb) ? 0 : 1))
+    pool->task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 rh,
+                                                 &wakeup_cb,
+                                                 pool);
+  if (NULL != vb)
+    deliver_batch (vb);
+}
+
+
+/**
+ * Stop and join all worker threads.
+ *
+ * @param pool pool to stop the workers of
+ */
+static void
+join_workers (struct GNUNET_CRYPTO_VerifyPool *pool)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  pool->stop = GNUNET_YES;
+  GNUNET_assert (0 == pthread_cond_broadcast (&pool->work_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  for (unsigned int i = 0; i < pool->num_workers; i++)
+    GNUNET_assert (0 == pthread_join (pool->workers[i],
+                                      NULL));
+  pool->num_workers = 0;
+}
+
+
+/**
+ * Start the worker threads.
+ *
+ * @param pool pool to start
+ * @param num_threads number of threads to start
+ * @return #GNUNET_OK on success
+ */
+static int
+start_workers (struct GNUNET_CRYPTO_VerifyPool *pool,
+               unsigned int num_threads)
+{
+  pool->wakeup = GNUNET_DISK_pipe (GNUNET_NO,
+                                   GNUNET_NO,
+                                   GNUNET_NO,
+                                   GNUNET_NO);
+  if (NULL == pool->wakeup)
+    return GNUNET_SYSERR;
+  GNUNET_assert (0 == pthread_mutex_init (&pool->lock,
+                                          NULL));
+  GNUNET_assert (0 == pthread_cond_init (&pool->work_cond,
+                                         NULL));
+  GNUNET_assert (0 == pthread_cond_init (&pool->idle_cond,
+                                         NULL));
+  pool->workers = GNUNET_new_array (num_threads,
+                                    pthread_t);
+  for (unsigned int i = 0; i < num_threads; i++)
+  {
+    if (0 != pthread_create (&pool->workers[pool->num_workers],
+                             NULL,
+                             &worker_main,
+                             pool))
+    {
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           "Failed to start signature verification thread: %s\n",
+           STRERROR (errno));
+      break;
+    }
+    pool->num_workers++;
+  }
+  if (0 == pool->num_workers)
+  {
+    GNUNET_free (pool->workers);
+    GNUNET_assert (0 == pthread_cond_destroy (&pool->idle_cond));
+    GNUNET_assert (0 == pthread_cond_destroy (&pool->work_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&pool->lock));
+    GNUNET_DISK_pipe_close (pool->wakeup);
+    pool->wakeup = NULL;
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+#endif
+
+
+/**
+ * Check a chunk of signatures from the scheduler, used if we have
+ * no threads.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_VerifyPool`
+ */
+static void
+scheduler_chunk (void *cls)
+{
+  struct GNUNET_CRYPTO_VerifyPool *pool = cls;
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+  unsigned int off;
+
+  pool->task = NULL;
+  vb = pool->pending_head;
+  if (NULL == vb)
+    return;
+  for (unsigned int i = 0;
+       (i < SCHEDULER_CHUNK_SIZE) && (vb->next_item < vb->num_items);
+       i++)
+  {
+    off = vb->next_item++;
+    vb->results[off] = check_entry (&vb->entries[off]);
+    vb->done++;
+  }
+  if (vb->done == vb->num_items)
+  {
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 vb);
+    vb->pending = GNUNET_NO;
+  }
+  else
+  {
+    vb = NULL;
+  }
+  /* the callback may destroy the pool, so we must be done with
+     it before calling it */
+  if (NULL != pool->pending_head)
+    pool->task = GNUNET_SCHEDULER_add_now (&scheduler_chunk,
+                                           pool);
+  if (NULL != vb)
+    deliver_batch (vb);
+}
+
+
+/**
+ * Determine how many threads to use by default.
+ *
+ * @return number of online CPUs, at least 1
+ */
+static unsigned int
+default_thread_count ()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return (unsigned int) n;
+#endif
+  return 1;
+}
+
+
+/**
+ * Create a pool of threads to verify signatures with.  Batches
+ * submitted to the pool are verified on the threads, the results
+ * are delivered from the scheduler.  Falls back to verifying from
+ * the scheduler if threads are not available.
+ *
+ * @param num_threads number of threads to use, 0 for one per CPU
+ * @return the pool
+ */
+struct GNUNET_CRYPTO_VerifyPool *
+GNUNET_CRYPTO_verify_pool_create (unsigned int num_threads)
+{
+  struct GNUNET_CRYPTO_VerifyPool *pool;
+
+  pool = GNUNET_new (struct GNUNET_CRYPTO_VerifyPool);
+  if (0 == num_threads)
+    num_threads = default_thread_count ();
+#if HAVE_PTHREAD_H
+  if (GNUNET_OK == start_workers (pool,
+                                  num_threads))
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Verifying signatures with %u threads\n",
+         pool->num_workers);
+#endif
+  return pool;
+}
+
+
+/**
+ * Destroy a verification pool.  Batches that have not completed
+ * yet are cancelled, their callbacks are not invoked.
+ *
+ * @param pool pool to destroy
+ */
+void
+GNUNET_CRYPTO_verify_pool_destroy (struct GNUNET_CRYPTO_VerifyPool *pool)
+{
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+
+  if (NULL != pool->task)
+  {
+    GNUNET_SCHEDULER_cancel (pool->task);
+    pool->task = NULL;
+  }
+#if HAVE_PTHREAD_H
+  if (NULL != pool->wakeup)
+  {
+    /* workers finish the signature they are checking, so
+       afterwards every batch is in one of the lists */
+    join_workers (pool);
+    GNUNET_free (pool->workers);
+    GNUNET_assert (0 == pthread_cond_destroy (&pool->idle_cond));
+    GNUNET_assert (0 == pthread_cond_destroy (&pool->work_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&pool->lock));
+    GNUNET_DISK_pipe_close (pool->wakeup);
+  }
+#endif
+  while (NULL != (vb = pool->pending_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 vb);
+    free_batch (vb);
+  }
+  while (NULL != (vb = pool->done_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pool->done_head,
+                                 pool->done_tail,
+                                 vb);
+    free_batch (vb);
+  }
+  GNUNET_free (pool);
+}
+
+
+/**
+ * Verify a batch of signatures in the background.  The items
+ * (including the data they point to) are copied, so the caller
+ * may release them as soon as this function returns.
+ *
+ * @param pool pool to verify the signatures with
+ * @param items signatures to verify
+ * @param num_items number of entries in @a items, must not be 0
+ * @param cb function to call with the results
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the batch, NULL if an item is malformed
+ *         (its signed data is shorter than the purpose header)
+ */
+struct GNUNET_CRYPTO_VerifyBatch *
+GNUNET_CRYPTO_verify_batch_start (struct GNUNET_CRYPTO_VerifyPool *pool,
+                                  const struct GNUNET_CRYPTO_VerifyItem *items,
+                                  unsigned int num_items,
+                                  GNUNET_CRYPTO_VerifyBatchCallback cb,
+                                  void *cb_cls)
+{
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+
+  GNUNET_assert (0 < num_items);
+  for (unsigned int i = 0; i < num_items; i++)
+  {
+    /* we copy ntohl (size) bytes, and the verification reads the
+       purpose header from the copy */
+    if (ntohl (items[i].validate->size) <
+        sizeof (struct GNUNET_CRYPTO_EccSignaturePurpose))
+    {
+      GNUNET_break_op (0);
+      return NULL;
+    }
+  }
+  vb = GNUNET_new (struct GNUNET_CRYPTO_VerifyBatch);
+  vb->pool = pool;
+  vb->cb = cb;
+  vb->cb_cls = cb_cls;
+  vb->num_items = num_items;
+  vb->entries = GNUNET_new_array (num_items,
+                                  struct Entry);
+  vb->results = GNUNET_new_array (num_items,
+                                  int);
+  for (unsigned int i = 0; i < num_items; i++)
+  {
+    const struct GNUNET_CRYPTO_VerifyItem *item = &items[i];
+    struct Entry *e = &vb->entries[i];
+
+    e->type = item->type;
+    e->purpose = item->purpose;
+    e->validate = GNUNET_memdup (item->validate,
+                                 ntohl (item->validate->size));
+    switch (item->type)
+    {
+    case GNUNET_CRYPTO_VERIFY_EDDSA:
+      e->sig.eddsa = *item->sig.eddsa;
+      e->pub.eddsa = *item->pub.eddsa;
+      break;
+    case GNUNET_CRYPTO_VERIFY_ECDSA:
+      e->sig.ecdsa = *item->sig.ecdsa;
+      e->pub.ecdsa = *item->pub.ecdsa;
+      break;
+    default:
+      GNUNET_break (0);
+      break;
+    }
+  }
+  pool->outstanding++;
+  vb->pending = GNUNET_YES;
+#if HAVE_PTHREAD_H
+  if (NULL != pool->wakeup)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    GNUNET_CONTAINER_DLL_insert_tail (pool->pending_head,
+                                      pool->pending_tail,
+                                      vb);
+    GNUNET_assert (0 == pthread_cond_broadcast (&pool->work_cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+    if (NULL == pool->task)
+      pool->task
+        = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                          GNUNET_DISK_pipe_handle (pool->wakeup,
+                                                                   GNUNET_DISK_PIPE_END_READ),
+                                          &wakeup_cb,
+                                          pool);
+    return vb;
+  }
+#endif
+  GNUNET_CONTAINER_DLL_insert_tail (pool->pending_head,
+                                    pool->pending_tail,
+                                    vb);
+  if (NULL == pool->task)
+    pool->task = GNUNET_SCHEDULER_add_now (&scheduler_chunk,
+                                           pool);
+  return vb;
+}
+
+
+/**
+ * Cancel a batch of signature checks.  Must not be called after
+ * the callback of the batch was invoked.
+ *
+ * @param vb batch to cancel
+ */
+void
+GNUNET_CRYPTO_verify_batch_cancel (struct GNUNET_CRYPTO_VerifyBatch *vb)
+{
+  struct GNUNET_CRYPTO_VerifyPool *pool = vb->pool;
+
+#if HAVE_PTHREAD_H
+  if (NULL != pool->wakeup)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    if (GNUNET_YES == vb->pending)
+    {
+      GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                   pool->pending_tail,
+                                   vb);
+      vb->pending = GNUNET_NO;
+    }
+    vb->cancelled = GNUNET_YES;
+    /* wait for the workers to finish the signatures they are
+       checking, they still use the batch */
+    while ( (GNUNET_NO == vb->finished) &&
+            (vb->done < vb->next_item) )
+      GNUNET_assert (0 == pthread_cond_wait (&pool->idle_cond,
+                                             &pool->lock));
+    if (GNUNET_YES == vb->finished)
+    {
+      GNUNET_CONTAINER_DLL_remove (pool->done_head,
+                                   pool->done_tail,
+                                   vb);
+      vb->finished = GNUNET_NO;
+    }
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  }
+  else
+#endif
+  if (GNUNET_YES == vb->pending)
+  {
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 vb);
+    vb->pending = GNUNET_NO;
+  }
+  pool->outstanding--;
+  if ( (0 == pool->outstanding) &&
+       (NULL != pool->task) )
+  {
+    GNUNET_SCHEDULER_cancel (pool->task);
+    pool->task = NULL;
+  }
+  free_batch (vb);
+}
+
+/* end of crypto_ecc_batch.c */
@@ -29,6 +29,14 @@
 #include <gcrypt.h>
 #include "gnunet_crypto_lib.h"
 #include "gnunet_container_lib.h"
+#include "gnunet_disk_lib.h"
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-crypto-ecc-dlog", __VA_ARGS__)
+
+#define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util-crypto-ecc-dlog", syscall, filename)
 
 
 /**
@@ -41,7 +49,25 @@
 
 
 /**
+ * Minimum number of giant steps (or table entries) a thread should
+ * handle; for smaller ranges starting a thread costs more than it
+ * saves.
+ */
+#define MIN_STEPS_PER_THREAD 256
+
+/**
+ * Magic value at the beginning of a dlog table file ("EDLG").
+ */
+#define DLOG_TABLE_MAGIC 0x45444c47
+
+
+/**
+ * Extract the binary representation of a point.
  *
+ * @param pt point to extract
+ * @param ctx context to use for the conversion, the "q" point
+ *        of the context is overwritten
+ * @param[out] pid binary representation of @a pt
  */
 static void
 extract_pk (gcry_mpi_point_t pt,
@@ -60,6 +86,55 @@ extract_pk (gcry_mpi_point_t pt,
 }
 
 
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a dlog table file, followed by the entries.
+ */
+struct DlogTableHeader
+{
+  /**
+   * Always #DLOG_TABLE_MAGIC, in NBO.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Maximum absolute value the table was computed for, in NBO.
+   */
+  uint32_t max GNUNET_PACKED;
+
+  /**
+   * Number of baby steps the table was computed with, in NBO.
+   */
+  uint32_t mem GNUNET_PACKED;
+
+  /**
+   * Number of entries following the header, in NBO.
+   */
+  uint32_t size GNUNET_PACKED;
+};
+
+
+/**
+ * Entry of the baby-step table.  The table is sorted by @e key.
+ */
+struct DlogEntry
+{
+  /**
+   * Prefix of the binary representation of the point.  As the
+   * prefix may collide, every match is verified before we return it.
+   */
+  unsigned char key[8];
+
+  /**
+   * Factor j (as a signed value, in NBO), the point is j * K * g.
+   */
+  uint32_t value GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * Internal structure used to cache pre-calculated values for DLOG calculation.
  */
@@ -71,17 +146,36 @@ struct GNUNET_CRYPTO_EccDlogContext
   unsigned int max;
 
   /**
-   * How much memory should we use (relates to the number of entries in the map).
+   * How much memory should we use (relates to the number of entries in the table).
    */
   unsigned int mem;
 
   /**
-   * Map mapping points (here "interpreted" as EdDSA public keys) to
-   * a "void * = long" which corresponds to the numeric value of the
-   * point.  As NULL is used to represent "unknown", the actual value
-   * represented by the entry in the map is the "long" minus @e max.
+   * Table of the points j * K * g for j in [-(mem-1), mem], sorted
+   * by their binary representation.  Either points into @e map_data
+   * or was allocated by us.
    */
-  struct GNUNET_CONTAINER_MultiPeerMap *map;
+  const struct DlogEntry *table;
+
+  /**
+   * Number of entries in @e table.
+   */
+  unsigned int table_size;
+
+  /**
+   * File the table is mapped from, NULL if the table is in memory.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Mapping of @e fh, NULL if the table is in memory.
+   */
+  struct GNUNET_DISK_MapHandle *map;
+
+  /**
+   * Number of threads to use for calculations.
+   */
+  unsigned int num_threads;
 
   /**
    * Context to use for operations on the elliptic curve.
@@ -91,6 +185,461 @@ struct GNUNET_CRYPTO_EccDlogContext
 };
 
 
+/**
+ * A range of work done by one thread.
+ */
+struct DlogJob
+{
+  /**
+   * Function doing the work.
+   */
+  void (*fn) (struct DlogJob *job);
+
+  /**
+   * Context we are working for.
+   */
+  const struct GNUNET_CRYPTO_EccDlogContext *edc;
+
+  /**
+   * For table computation: the table to fill.
+   */
+  struct DlogEntry *entries;
+
+  /**
+   * For giant steps: point to start with, owned by the job.
+   */
+  gcry_mpi_point_t start;
+
+  /**
+   * For giant steps: binary representation of the input point.
+   */
+  const struct GNUNET_PeerIdentity *input_key;
+
+  /**
+   * First value of the range.
+   */
+  int lo;
+
+  /**
+   * End of the range (exclusive).
+   */
+  int hi;
+
+  /**
+   * For giant steps: the result, INT_MAX if not found.
+   */
+  int res;
+
+#if HAVE_PTHREAD_H
+  /**
+   * Thread running the job.
+   */
+  pthread_t thread;
+
+  /**
+   * #GNUNET_YES if @e thread was started.
+   */
+  int started;
+#endif
+};
+
+
+/**
+ * Determine how many threads to use by default.
+ *
+ * @return number of online CPUs, at least 1
+ */
+static unsigned int
+default_thread_count ()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return (unsigned int) n;
+#endif
+  return 1;
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Main function of a thread running a job.
+ *
+ * @param cls the `struct DlogJob`
+ * @return NULL
+ */
+static void *
+job_main (void *cls)
+{
+  struct DlogJob *job = cls;
+
+  job->fn (job);
+  return NULL;
+}
+#endif
+
+
+/**
+ * Run the given jobs, in parallel if possible, and wait for them.
+ *
+ * @param jobs array of jobs to run
+ * @param num_jobs length of @a jobs
+ */
+static void
+run_jobs (struct DlogJob *jobs,
+          unsigned int num_jobs)
+{
+#if HAVE_PTHREAD_H
+  for (unsigned int i=1;i<num_jobs;i++)
+    jobs[i].started
+      = (0 == pthread_create (&jobs[i].thread,
+                              NULL,
+                              &job_main,
+                              &jobs[i])) ? GNUNET_YES : GNUNET_NO;
+  jobs[0].fn (&jobs[0]);
+  for (unsigned int i=1;i<num_jobs;i++)
+  {
+    if (GNUNET_YES == jobs[i].started)
+      GNUNET_assert (0 == pthread_join (jobs[i].thread,
+                                        NULL));
+    else
+      jobs[i].fn (&jobs[i]);
+  }
+#else
+  for (unsigned int i=0;i<num_jobs;i++)
+    jobs[i].fn (&jobs[i]);
+#endif
+}
+
+
+/**
+ * Determine into how many jobs to split a range.
+ *
+ * @param edc context we work for
+ * @param range size of the range
+ * @return number of jobs, at least 1
+ */
+static unsigned int
+count_jobs (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+            unsigned int range)
+{
+  unsigned int num_jobs;
+
+  num_jobs = range / MIN_STEPS_PER_THREAD;
+  if (num_jobs > edc->num_threads)
+    num_jobs = edc->num_threads;
+  if (0 == num_jobs)
+    num_jobs = 1;
+  return num_jobs;
+}
+
+
+/**
+ * Set @a fact to the scalar representing @a val.
+ *
+ * @param ctx context of the curve
+ * @param fact scalar to set
+ * @param val (signed) value
+ */
+static void
+set_fact (gcry_ctx_t ctx,
+          gcry_mpi_t fact,
+          long long val)
+{
+  gcry_mpi_t n;
+
+  if (val >= 0)
+  {
+    gcry_mpi_set_ui (fact, (unsigned long) val);
+    return;
+  }
+  n = gcry_mpi_ec_get_mpi ("n", ctx, 1);
+  gcry_mpi_set_ui (fact, (unsigned long) - val);
+  gcry_mpi_sub (fact, n, fact);
+  gcry_mpi_release (n);
+}
+
+
+/**
+ * Compute the table entries for the factors of @a job.
+ * Instead of multiplying for every entry, we add K * g to the
+ * previous point.
+ *
+ * @param job job to run
+ */
+static void
+fill_table (struct DlogJob *job)
+{
+  const struct GNUNET_CRYPTO_EccDlogContext *edc = job->edc;
+  unsigned int K = ((edc->max + (edc->mem-1)) / edc->mem);
+  struct GNUNET_PeerIdentity key;
+  struct DlogEntry *e;
+  gcry_ctx_t ctx;
+  gcry_mpi_point_t g;
+  gcry_mpi_point_t gK;
+  gcry_mpi_point_t gKi;
+  gcry_mpi_t fact;
+
+  GNUNET_assert (0 == gcry_mpi_ec_new (&ctx,
+				       NULL,
+				       CURVE));
+  g = gcry_mpi_ec_get_point ("g", ctx, 0);
+  GNUNET_assert (NULL != g);
+  fact = gcry_mpi_new (0);
+  gK = gcry_mpi_point_new (0);
+  gKi = gcry_mpi_point_new (0);
+  gcry_mpi_set_ui (fact, K);
+  gcry_mpi_ec_mul (gK, fact, g, ctx);
+  set_fact (ctx, fact, (long long) job->lo * K);
+  gcry_mpi_ec_mul (gKi, fact, g, ctx);
+  for (int j=job->lo;j<job->hi;j++)
+  {
+    if (j != job->lo)
+      gcry_mpi_ec_add (gKi, gKi, gK, ctx);
+    extract_pk (gKi, ctx, &key);
+    e = &job->entries[j + edc->mem - 1];
+    GNUNET_memcpy (e->key,
+                   key.public_key.q_y,
+                   sizeof (e->key));
+    e->value = htonl ((uint32_t) j);
+  }
+  gcry_mpi_release (fact);
+  gcry_mpi_point_release (gKi);
+  gcry_mpi_point_release (gK);
+  gcry_mpi_point_release (g);
+  gcry_ctx_release (ctx);
+}
+
+
+/**
+ * Compare two table entries by their key, for qsort().
+ *
+ * @param a a `struct DlogEntry`
+ * @param b a `struct DlogEntry`
+ * @return memcmp() of the keys
+ */
+static int
+cmp_entry (const void *a,
+           const void *b)
+{
+  const struct DlogEntry *ea = a;
+  const struct DlogEntry *eb = b;
+
+  return memcmp (ea->key,
+                 eb->key,
+                 sizeof (ea->key));
+}
+
+
+/**
+ * Compute the baby-step table of @a edc in memory.
+ *
+ * @param edc context to compute the table for
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if we are out of memory
+ */
+static int
+compute_table (struct GNUNET_CRYPTO_EccDlogContext *edc)
+{
+  struct DlogEntry *entries;
+  struct DlogJob *jobs;
+  unsigned int num_jobs;
+  unsigned int size;
+  unsigned int per_job;
+
+  size = 2 * edc->mem;
+  entries = GNUNET_malloc_large (size * sizeof (struct DlogEntry));
+  if (NULL == entries)
+    return GNUNET_SYSERR;
+  num_jobs = count_jobs (edc,
+                         size);
+  per_job = (size + num_jobs - 1) / num_jobs;
+  jobs = GNUNET_new_array (num_jobs,
+                           struct DlogJob);
+  for (unsigned int i=0;i<num_jobs;i++)
+  {
+    jobs[i].fn = &fill_table;
+    jobs[i].edc = edc;
+    jobs[i].entries = entries;
+    jobs[i].lo = 1 - (int) edc->mem + (int) (i * per_job);
+    jobs[i].hi = GNUNET_MIN (jobs[i].lo + (int) per_job,
+                             (int) edc->mem + 1);
+  }
+  run_jobs (jobs,
+            num_jobs);
+  GNUNET_free (jobs);
+  qsort (entries,
+         size,
+         sizeof (struct DlogEntry),
+         &cmp_entry);
+  edc->table = entries;
+  edc->table_size = size;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Try to map the baby-step table of @a edc from @a filename.
+ *
+ * @param edc context to load the table for
+ * @param filename file to map
+ * @return #GNUNET_OK on success, #GNUNET_NO if the file does not
+ *         exist, #GNUNET_SYSERR if it is not usable
+ */
+static int
+map_table (struct GNUNET_CRYPTO_EccDlogContext *edc,
+           const char *filename)
+{
+  const struct DlogTableHeader *hdr;
+  const struct DlogEntry *entries;
+  const void *data;
+  off_t fsize;
+  uint32_t size;
+
+  if (GNUNET_YES != GNUNET_DISK_file_test (filename))
+    return GNUNET_NO;
+  edc->fh = GNUNET_DISK_file_open (filename,
+                                   GNUNET_DISK_OPEN_READ,
+                                   GNUNET_DISK_PERM_NONE);
+  if (NULL == edc->fh)
+    return GNUNET_SYSERR;
+  if ( (GNUNET_OK !=
+        GNUNET_DISK_file_handle_size (edc->fh,
+                                      &fsize)) ||
+       (fsize < (off_t) sizeof (struct DlogTableHeader)) ||
+       (NULL == (data = GNUNET_DISK_file_map (edc->fh,
+                                              &edc->map,
+                                              GNUNET_DISK_MAP_TYPE_READ,
+                                              fsize))) )
+    goto fail;
+  hdr = data;
+  entries = (const struct DlogEntry *) &hdr[1];
+  size = ntohl (hdr->size);
+  if ( (DLOG_TABLE_MAGIC != ntohl (hdr->magic)) ||
+       (edc->max != ntohl (hdr->max)) ||
+       (edc->mem != ntohl (hdr->mem)) ||
+       (2 * edc->mem != size) ||
+       (fsize != (off_t) (sizeof (struct DlogTableHeader)
+                          + size * sizeof (struct DlogEntry))) )
+    goto fail;
+  for (uint32_t i=1;i<size;i++)
+    if (cmp_entry (&entries[i - 1],
+                   &entries[i]) > 0)
+      goto fail;
+  edc->table = entries;
+  edc->table_size = size;
+  return GNUNET_OK;
+ fail:
+  LOG (GNUNET_ERROR_TYPE_WARNING,
+       _("Ignoring invalid dlog table `%s'\n"),
+       filename);
+  if (NULL != edc->map)
+  {
+    GNUNET_DISK_file_unmap (edc->map);
+    edc->map = NULL;
+  }
+  GNUNET_DISK_file_close (edc->fh);
+  edc->fh = NULL;
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Write the baby-step table of @a edc to @a filename.  We write to
+ * a temporary file first, so other processes never map a partial
+ * table.
+ *
+ * @param edc context with the table to store
+ * @param filename file to write
+ */
+static void
+store_table (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+             const char *filename)
+{
+  struct DlogTableHeader hdr;
+  struct GNUNET_DISK_FileHandle *fh;
+  char *tmp;
+  size_t tsize;
+  int ok;
+
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (filename))
+    return;
+  GNUNET_asprintf (&tmp,
+                   "%s.%u",
+                   filename,
+                   (unsigned int) getpid ());
+  fh = GNUNET_DISK_file_open (tmp,
+                              GNUNET_DISK_OPEN_WRITE
+                              | GNUNET_DISK_OPEN_CREATE
+                              | GNUNET_DISK_OPEN_TRUNCATE,
+                              GNUNET_DISK_PERM_USER_READ
+                              | GNUNET_DISK_PERM_USER_WRITE
+                              | GNUNET_DISK_PERM_GROUP_READ
+                              | GNUNET_DISK_PERM_OTHER_READ);
+  if (NULL == fh)
+  {
+    GNUNET_free (tmp);
+    return;
+  }
+  hdr.magic = htonl (DLOG_TABLE_MAGIC);
+  hdr.max = htonl (edc->max);
+  hdr.mem = htonl (edc->mem);
+  hdr.size = htonl (edc->table_size);
+  tsize = edc->table_size * sizeof (struct DlogEntry);
+  ok = ( (sizeof (hdr) ==
+          GNUNET_DISK_file_write (fh,
+                                  &hdr,
+                                  sizeof (hdr))) &&
+         (tsize ==
+          (size_t) GNUNET_DISK_file_write (fh,
+                                           edc->table,
+                                           tsize)) );
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (fh));
+  if ( (! ok) ||
+       (0 != rename (tmp,
+                     filename)) )
+  {
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "write",
+                       filename);
+    if (0 != UNLINK (tmp))
+      LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                         "unlink",
+                         tmp);
+  }
+  GNUNET_free (tmp);
+}
+
+
+/**
+ * Allocate a context without a table.
+ *
+ * @param max maximum value the factor can be
+ * @param mem memory to use
+ * @return the context
+ */
+static struct GNUNET_CRYPTO_EccDlogContext *
+create_context (unsigned int max,
+                unsigned int mem)
+{
+  struct GNUNET_CRYPTO_EccDlogContext *edc;
+
+  GNUNET_assert (max < INT32_MAX);
+  GNUNET_assert ( (0 != mem) &&
+                  (mem < INT32_MAX / 2) );
+  edc = GNUNET_new (struct GNUNET_CRYPTO_EccDlogContext);
+  edc->max = max;
+  edc->mem = mem;
+  edc->num_threads = default_thread_count ();
+  GNUNET_assert (0 == gcry_mpi_ec_new (&edc->ctx,
+				       NULL,
+				       CURVE));
+  return edc;
+}
+
+
 /**
  * Convert point value to binary representation.
  *
@@ -159,64 +708,158 @@ GNUNET_CRYPTO_ecc_dlog_prepare (unsigned int max,
 				unsigned int mem)
 {
   struct GNUNET_CRYPTO_EccDlogContext *edc;
-  unsigned int K = ((max + (mem-1)) / mem);
-  gcry_mpi_point_t g;
-  struct GNUNET_PeerIdentity key;
-  gcry_mpi_point_t gKi;
+
+  edc = create_context (max,
+                        mem);
+  if (GNUNET_OK != compute_table (edc))
+  {
+    GNUNET_CRYPTO_ecc_dlog_release (edc);
+    return NULL;
+  }
+  return edc;
+}
+
+
+/**
+ * Do pre-calculation for ECC discrete logarithm for small factors,
+ * keeping the table in @a filename.  If @a filename contains a table
+ * for the same parameters, it is mapped into memory; otherwise the
+ * table is calculated and written to @a filename for the next time.
+ *
+ * @param max maximum value the factor can be
+ * @param mem memory to use (should be smaller than @a max), must not be zero.
+ * @param filename file with the table
+ * @return NULL on error
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_dlog_prepare_file (unsigned int max,
+                                     unsigned int mem,
+                                     const char *filename)
+{
+  struct GNUNET_CRYPTO_EccDlogContext *edc;
+
+  edc = create_context (max,
+                        mem);
+  if (GNUNET_OK == map_table (edc,
+                              filename))
+    return edc;
+  if (GNUNET_OK != compute_table (edc))
+  {
+    GNUNET_CRYPTO_ecc_dlog_release (edc);
+    return NULL;
+  }
+  store_table (edc,
+               filename);
+  return edc;
+}
+
+
+/**
+ * Check if @a val is the discrete logarithm of the point with
+ * binary representation @a key.
+ *
+ * @param ctx context to use
+ * @param g generator of the curve
+ * @param val candidate value
+ * @param key binary representation of the point
+ * @return #GNUNET_YES if val * g is the point
+ */
+static int
+check_candidate (gcry_ctx_t ctx,
+                 gcry_mpi_point_t g,
+                 int val,
+                 const struct GNUNET_PeerIdentity *key)
+{
+  struct GNUNET_PeerIdentity vkey;
+  gcry_mpi_point_t v;
   gcry_mpi_t fact;
-  gcry_mpi_t n;
-  unsigned int i;
 
-  GNUNET_assert (max < INT32_MAX);
-  edc = GNUNET_new (struct GNUNET_CRYPTO_EccDlogContext);
-  edc->max = max;
-  edc->mem = mem;
+  fact = gcry_mpi_new (0);
+  set_fact (ctx, fact, val);
+  v = gcry_mpi_point_new (0);
+  gcry_mpi_ec_mul (v, fact, g, ctx);
+  extract_pk (v, ctx, &vkey);
+  gcry_mpi_point_release (v);
+  gcry_mpi_release (fact);
+  return (0 == memcmp (&vkey,
+                       key,
+                       sizeof (vkey))) ? GNUNET_YES : GNUNET_NO;
+}
 
-  edc->map = GNUNET_CONTAINER_multipeermap_create (mem * 2,
-						   GNUNET_NO);
 
-  GNUNET_assert (0 == gcry_mpi_ec_new (&edc->ctx,
+/**
+ * Do the giant steps of @a job: look up input + i * g in the table
+ * for i in the range of the job.
+ *
+ * @param job job to run
+ */
+static void
+giant_steps (struct DlogJob *job)
+{
+  const struct GNUNET_CRYPTO_EccDlogContext *edc = job->edc;
+  unsigned int K = ((edc->max + (edc->mem-1)) / edc->mem);
+  struct GNUNET_PeerIdentity key;
+  const struct DlogEntry *e;
+  gcry_ctx_t ctx;
+  gcry_mpi_point_t g;
+  gcry_mpi_point_t q;
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+  int cand;
+
+  GNUNET_assert (0 == gcry_mpi_ec_new (&ctx,
 				       NULL,
 				       CURVE));
-  g = gcry_mpi_ec_get_point ("g", edc->ctx, 0);
+  g = gcry_mpi_ec_get_point ("g", ctx, 0);
   GNUNET_assert (NULL != g);
-  fact = gcry_mpi_new (0);
-  gKi = gcry_mpi_point_new (0);
-  for (i=0;i<=mem;i++)
+  q = job->start;
+  for (int i=job->lo;i<job->hi;i++)
   {
-    gcry_mpi_set_ui (fact, i * K);
-    gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
-    extract_pk (gKi, edc->ctx, &key);
-    GNUNET_assert (GNUNET_OK ==
-		   GNUNET_CONTAINER_multipeermap_put (edc->map,
-						      &key,
-						      (void*) (long) i + max,
-						      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-  }
-  /* negative values */
-  n = gcry_mpi_ec_get_mpi ("n", edc->ctx, 1);
-  for (i=1;i<mem;i++)
-  {
-    gcry_mpi_set_ui (fact, i * K);
-    gcry_mpi_sub (fact, n, fact);
-    gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
-    extract_pk (gKi, edc->ctx, &key);
-    GNUNET_assert (GNUNET_OK ==
-		   GNUNET_CONTAINER_multipeermap_put (edc->map,
-						      &key,
-						      (void*) (long) max - i,
-						      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    if (i != job->lo)
+      gcry_mpi_ec_add (q, q, g, ctx);
+    extract_pk (q, ctx, &key);
+    /* find the first entry with a key >= key */
+    lo = 0;
+    hi = edc->table_size;
+    while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (0 > memcmp (edc->table[mid].key,
+                      key.public_key.q_y,
+                      sizeof (edc->table[mid].key)))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    for (e = &edc->table[lo];
+         (e < &edc->table[edc->table_size]) &&
+           (0 == memcmp (e->key,
+                         key.public_key.q_y,
+                         sizeof (e->key)));
+         e++)
+    {
+      /* we continue the loop after a match to make the
+         implementation "constant-time".  If we do not care about
+         this, we could just stop here and do fewer operations... */
+      if (INT_MAX != job->res)
+        continue;
+      cand = ((int) ntohl (e->value)) * (int) K - i;
+      if (GNUNET_YES == check_candidate (ctx,
+                                         g,
+                                         cand,
+                                         job->input_key))
+        job->res = cand;
+    }
   }
-  gcry_mpi_release (fact);
-  gcry_mpi_release (n);
-  gcry_mpi_point_release (gKi);
   gcry_mpi_point_release (g);
-  return edc;
+  gcry_ctx_release (ctx);
 }
 
 
 /**
  * Calculate ECC discrete logarithm for small factors.
+ * The giant steps are split among the threads of @a edc.
  *
  * @param edc precalculated values, determine range of factors
  * @param input point on the curve to factor
@@ -226,45 +869,51 @@ int
 GNUNET_CRYPTO_ecc_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
 			gcry_mpi_point_t input)
 {
-  unsigned int K = ((edc->max + (edc->mem-1)) / edc->mem);
+  unsigned int steps = edc->max / edc->mem + 1;
+  struct GNUNET_PeerIdentity input_key;
+  struct DlogJob *jobs;
+  unsigned int num_jobs;
+  unsigned int per_job;
   gcry_mpi_point_t g;
-  struct GNUNET_PeerIdentity key;
-  gcry_mpi_point_t q;
-  unsigned int i;
+  gcry_mpi_t fact;
   int res;
-  void *retp;
 
+  extract_pk (input, edc->ctx, &input_key);
   g = gcry_mpi_ec_get_point ("g", edc->ctx, 0);
   GNUNET_assert (NULL != g);
-  q = gcry_mpi_point_new (0);
-
+  fact = gcry_mpi_new (0);
+  num_jobs = count_jobs (edc,
+                         steps);
+  per_job = (steps + num_jobs - 1) / num_jobs;
+  jobs = GNUNET_new_array (num_jobs,
+                           struct DlogJob);
+  for (unsigned int i=0;i<num_jobs;i++)
+  {
+    jobs[i].fn = &giant_steps;
+    jobs[i].edc = edc;
+    jobs[i].input_key = &input_key;
+    jobs[i].lo = i * per_job;
+    jobs[i].hi = GNUNET_MIN ((i + 1) * per_job,
+                             steps);
+    jobs[i].res = INT_MAX;
+    /* start = input + lo * g */
+    jobs[i].start = gcry_mpi_point_new (0);
+    gcry_mpi_set_ui (fact, jobs[i].lo);
+    gcry_mpi_ec_mul (jobs[i].start, fact, g, edc->ctx);
+    gcry_mpi_ec_add (jobs[i].start, jobs[i].start, input, edc->ctx);
+  }
+  run_jobs (jobs,
+            num_jobs);
   res = INT_MAX;
-  for (i=0;i<=edc->max/edc->mem;i++)
+  for (unsigned int i=0;i<num_jobs;i++)
   {
-    if (0 == i)
-      extract_pk (input, edc->ctx, &key);
-    else
-      extract_pk (q, edc->ctx, &key);
-    retp = GNUNET_CONTAINER_multipeermap_get (edc->map,
-					      &key);
-    if (NULL != retp)
-    {
-      res = (((long) retp) - edc->max) * K - i;
-      /* we continue the loop here to make the implementation
-	 "constant-time". If we do not care about this, we could just
-	 'break' here and do fewer operations... */
-    }
-    if (i == edc->max/edc->mem)
-      break;
-    /* q = q + g */
-    if (0 == i)
-      gcry_mpi_ec_add (q, input, g, edc->ctx);
-    else
-      gcry_mpi_ec_add (q, q, g, edc->ctx);
+    if (INT_MAX != jobs[i].res)
+      res = jobs[i].res;
+    gcry_mpi_point_release (jobs[i].start);
   }
+  GNUNET_free (jobs);
+  gcry_mpi_release (fact);
   gcry_mpi_point_release (g);
-  gcry_mpi_point_release (q);
-
   return res;
 }
 
@@ -312,7 +961,15 @@ void
 GNUNET_CRYPTO_ecc_dlog_release (struct GNUNET_CRYPTO_EccDlogContext *edc)
 {
   gcry_ctx_release (edc->ctx);
-  GNUNET_CONTAINER_multipeermap_destroy (edc->map);
+  if (NULL != edc->fh)
+  {
+    GNUNET_DISK_file_unmap (edc->map);
+    GNUNET_DISK_file_close (edc->fh);
+  }
+  else
+  {
+    GNUNET_free_non_null ((void *) edc->table);
+  }
   GNUNET_free (edc);
 }
 
@@ -0,0 +1,740 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file util/crypto_pow.c
+ * @brief SCRYPT-based proofs of work and a parallel search for them
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gcrypt.h>
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-crypto-pow", __VA_ARGS__)
+
+/**
+ * How many nonces does a worker claim at a time?
+ */
+#define CHUNK_SIZE 4
+
+/**
+ * How often do we report progress to the application?
+ */
+#define PROGRESS_INTERVAL GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * Largest payload we support, so that we can use a fixed-size
+ * buffer for the hash input.
+ */
+#define MAX_DATA_SIZE 1024
+
+
+#if HAVE_PTHREAD_H
+/**
+ * State of one worker thread.
+ */
+struct Worker
+{
+  /**
+   * Search this worker belongs to.
+   */
+  struct GNUNET_CRYPTO_PowSearch *ps;
+
+  /**
+   * First nonce of the chunk the worker is testing,
+   * UINT64_MAX if it is not testing any.
+   */
+  uint64_t current;
+
+  /**
+   * Thread running the worker.
+   */
+  pthread_t thread;
+};
+#endif
+
+
+/**
+ * Handle for a proof-of-work search.
+ */
+struct GNUNET_CRYPTO_PowSearch
+{
+  /**
+   * Salt for the hash function.
+   */
+  char *salt;
+
+  /**
+   * Data the proof is for.
+   */
+  void *data;
+
+  /**
+   * Number of bytes in @e data.
+   */
+  size_t data_size;
+
+  /**
+   * Number of leading zero bits we need.
+   */
+  unsigned int matching_bits;
+
+  /**
+   * How long does a worker pause after each chunk?
+   */
+  struct GNUNET_TIME_Relative delay;
+
+  /**
+   * Function to call with progress.
+   */
+  GNUNET_CRYPTO_PowProgressCallback progress_cb;
+
+  /**
+   * Function to call with the result.
+   */
+  GNUNET_CRYPTO_PowResultCallback result_cb;
+
+  /**
+   * Closure for @e progress_cb and @e result_cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Next nonce no worker has claimed yet.
+   */
+  uint64_t next;
+
+  /**
+   * Proof found, only valid if @e found is #GNUNET_YES.
+   */
+  uint64_t proof;
+
+  /**
+   * When should we report progress next?
+   */
+  struct GNUNET_TIME_Absolute next_report;
+
+  /**
+   * Task run when the workers signal us (or the next chunk
+   * if we have no threads).
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * #GNUNET_YES once a proof was found.
+   */
+  int found;
+
+#if HAVE_PTHREAD_H
+  /**
+   * Pipe the workers use to wake up the scheduler.
+   */
+  struct GNUNET_DISK_PipeHandle *wakeup;
+
+  /**
+   * Array of @e num_workers workers.
+   */
+  struct Worker *workers;
+
+  /**
+   * Number of entries in @e workers.
+   */
+  unsigned int num_workers;
+
+  /**
+   * Protects all of the search state shared with the workers.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Signalled when the search is stopped, to interrupt workers
+   * waiting for @e delay.
+   */
+  pthread_cond_t stop_cond;
+
+  /**
+   * #GNUNET_YES if the workers should terminate.
+   */
+  int stop;
+#endif
+};
+
+
+/**
+ * Calculate the proof-of-work hash (an expensive hash).
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param buf data to hash
+ * @param buf_len number of bytes in @a buf
+ * @param result where to write the resulting hash
+ */
+void
+GNUNET_CRYPTO_pow_hash (const char *salt,
+                        const void *buf,
+                        size_t buf_len,
+                        struct GNUNET_HashCode *result)
+{
+  GNUNET_break (0 ==
+                gcry_kdf_derive (buf, buf_len,
+                                 GCRY_KDF_SCRYPT,
+                                 1 /* subalgo */,
+                                 salt,
+                                 strlen (salt),
+                                 2 /* iterations; keep cost of individual op small */,
+                                 sizeof (struct GNUNET_HashCode),
+                                 result));
+}
+
+
+/**
+ * Count the leading zeroes in @a hash.
+ *
+ * @param hash to count leading zeros in
+ * @return the number of leading zero bits.
+ */
+unsigned int
+GNUNET_CRYPTO_hash_count_leading_zeros (const struct GNUNET_HashCode *hash)
+{
+  unsigned int hash_count;
+
+  hash_count = 0;
+  while ( (hash_count < 8 * sizeof (struct GNUNET_HashCode)) &&
+          (0 == GNUNET_CRYPTO_hash_get_bit (hash,
+                                            hash_count)) )
+    hash_count++;
+  return hash_count;
+}
+
+
+/**
+ * Check whether @a nonce is a valid proof of work for @a data.
+ * The hash input is the nonce (in host byte order) followed
+ * by @a data.
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param data data the proof is for
+ * @param data_size number of bytes in @a data
+ * @param nonce the nonce to check
+ * @param matching_bits number of leading zero bits required
+ * @return #GNUNET_YES if valid, #GNUNET_NO if not
+ */
+int
+GNUNET_CRYPTO_pow_check (const char *salt,
+                         const void *data,
+                         size_t data_size,
+                         uint64_t nonce,
+                         unsigned int matching_bits)
+{
+  char buf[sizeof (uint64_t) + data_size] GNUNET_ALIGN;
+  struct GNUNET_HashCode result;
+
+  GNUNET_memcpy (buf,
+                 &nonce,
+                 sizeof (nonce));
+  GNUNET_memcpy (&buf[sizeof (nonce)],
+                 data,
+                 data_size);
+  GNUNET_CRYPTO_pow_hash (salt,
+                          buf,
+                          sizeof (buf),
+                          &result);
+  return (GNUNET_CRYPTO_hash_count_leading_zeros (&result) >=
+          matching_bits) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Test the nonces of one chunk.
+ *
+ * @param ps search we are part of
+ * @param start first nonce to test
+ * @param[out] proof set to the valid nonce, if any
+ * @return #GNUNET_YES if a proof was found
+ */
+static int
+test_chunk (const struct GNUNET_CRYPTO_PowSearch *ps,
+            uint64_t start,
+            uint64_t *proof)
+{
+  char buf[sizeof (uint64_t) + MAX_DATA_SIZE] GNUNET_ALIGN;
+  struct GNUNET_HashCode result;
+  uint64_t nonce;
+
+  GNUNET_memcpy (&buf[sizeof (uint64_t)],
+                 ps->data,
+                 ps->data_size);
+  for (unsigned int i = 0; i < CHUNK_SIZE; i++)
+  {
+    nonce = start + i;
+    GNUNET_memcpy (buf,
+                   &nonce,
+                   sizeof (nonce));
+    GNUNET_CRYPTO_pow_hash (ps->salt,
+                            buf,
+                            sizeof (uint64_t) + ps->data_size,
+                            &result);
+    if (GNUNET_CRYPTO_hash_count_leading_zeros (&result) >=
+        ps->matching_bits)
+    {
+      *proof = nonce;
+      return GNUNET_YES;
+    }
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Claim the next chunk of nonces.
+ *
+ * @param ps search to claim from
+ * @param[out] start set to the first nonce of the chunk
+ * @return #GNUNET_NO if the nonce space is exhausted
+ */
+static int
+claim_chunk (struct GNUNET_CRYPTO_PowSearch *ps,
+             uint64_t *start)
+{
+  if (ps->next > UINT64_MAX - CHUNK_SIZE)
+    return GNUNET_NO;
+  *start = ps->next;
+  ps->next += CHUNK_SIZE;
+  return GNUNET_YES;
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Wake up the scheduler thread.
+ *
+ * @param ps search to signal
+ */
+static void
+signal_scheduler (struct GNUNET_CRYPTO_PowSearch *ps)
+{
+  const struct GNUNET_DISK_FileHandle *wh;
+  char c = 0;
+
+  wh = GNUNET_DISK_pipe_handle (ps->wakeup,
+                                GNUNET_DISK_PIPE_END_WRITE);
+  /* if the pipe is full, a wakeup is pending anyway */
+  (void) GNUNET_DISK_file_write (wh,
+                                 &c,
+                                 sizeof (c));
+}
+
+
+/**
+ * Main function of a worker thread.
+ *
+ * @param cls the `struct Worker`
+ * @return NULL
+ */
+static void *
+worker_main (void *cls)
+{
+  struct Worker *w = cls;
+  struct GNUNET_CRYPTO_PowSearch *ps = w->ps;
+  struct GNUNET_TIME_Absolute resume;
+  struct timespec ts;
+  uint64_t start;
+  uint64_t proof;
+  int found;
+  int report;
+
+  found = GNUNET_NO;
+  GNUNET_assert (0 == pthread_mutex_lock (&ps->lock));
+  while (1)
+  {
+    w->current = UINT64_MAX;
+    if (GNUNET_YES == found)
+    {
+      if (GNUNET_NO == ps->found)
+      {
+        ps->found = GNUNET_YES;
+        ps->proof = proof;
+        signal_scheduler (ps);
+      }
+      break;
+    }
+    if ( (GNUNET_YES == ps->stop) ||
+         (GNUNET_YES == ps->found) ||
+         (GNUNET_NO == claim_chunk (ps,
+                                    &start)) )
+      break;
+    w->current = start;
+    report = (0 == GNUNET_TIME_absolute_get_remaining (ps->next_report).rel_value_us);
+    if (GNUNET_YES == report)
+      ps->next_report = GNUNET_TIME_relative_to_absolute (PROGRESS_INTERVAL);
+    GNUNET_assert (0 == pthread_mutex_unlock (&ps->lock));
+    if (GNUNET_YES == report)
+      signal_scheduler (ps);
+    found = test_chunk (ps,
+                        start,
+                        &proof);
+    GNUNET_assert (0 == pthread_mutex_lock (&ps->lock));
+    if ( (GNUNET_NO == found) &&
+         (0 != ps->delay.rel_value_us) )
+    {
+      /* the chunk is done, we are not blocking the checkpoint */
+      w->current = UINT64_MAX;
+      resume = GNUNET_TIME_relative_to_absolute (ps->delay);
+      ts.tv_sec = resume.abs_value_us / 1000LL / 1000LL;
+      ts.tv_nsec = (resume.abs_value_us % (1000LL * 1000LL)) * 1000LL;
+      while ( (GNUNET_NO == ps->stop) &&
+              (0 != GNUNET_TIME_absolute_get_remaining (resume).rel_value_us) )
+        (void) pthread_cond_timedwait (&ps->stop_cond,
+                                       &ps->lock,
+                                       &ts);
+    }
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&ps->lock));
+  return NULL;
+}
+
+
+/**
+ * Compute up to which nonce all nonces have been tested.
+ * Must be called with the lock held.
+ *
+ * @param ps search to inspect
+ * @return checkpoint
+ */
+static uint64_t
+get_checkpoint (const struct GNUNET_CRYPTO_PowSearch *ps)
+{
+  uint64_t cp;
+
+  cp = ps->next;
+  for (unsigned int i = 0; i < ps->num_workers; i++)
+    cp = GNUNET_MIN (cp,
+                     ps->workers[i].current);
+  return cp;
+}
+
+
+/**
+ * Stop and join all worker threads.
+ *
+ * @param ps search to stop the workers of
+ */
+static void
+join_workers (struct GNUNET_CRYPTO_PowSearch *ps)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&ps->lock));
+  ps->stop = GNUNET_YES;
+  GNUNET_assert (0 == pthread_cond_broadcast (&ps->stop_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&ps->lock));
+  for (unsigned int i = 0; i < ps->num_workers; i++)
+    GNUNET_assert (0 == pthread_join (ps->workers[i].thread,
+                                      NULL));
+  ps->num_workers = 0;
+}
+
+
+/**
+ * The workers signalled us.  Report progress or the result.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_PowSearch`
+ */
+static void
+wakeup_cb (void *cls)
+{
+  struct GNUNET_CRYPTO_PowSearch *ps = cls;
+  const struct GNUNET_DISK_FileHandle *rh;
+  GNUNET_CRYPTO_PowProgressCallback progress_cb;
+  char buf[64];
+  uint64_t cp;
+  int found;
+
+  ps->task = NULL;
+  rh = GNUNET_DISK_pipe_handle (ps->wakeup,
+                                GNUNET_DISK_PIPE_END_READ);
+  while (0 < GNUNET_DISK_file_read (rh,
+                                    buf,
+                                    sizeof (buf)))
+    ;
+  GNUNET_assert (0 == pthread_mutex_lock (&ps->lock));
+  found = ps->found;
+  cp = get_checkpoint (ps);
+  GNUNET_assert (0 == pthread_mutex_unlock (&ps->lock));
+  if (GNUNET_YES == found)
+  {
+    GNUNET_CRYPTO_PowResultCallback result_cb = ps->result_cb;
+    void *cb_cls = ps->cb_cls;
+    uint64_t proof = ps->proof;
+
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Proof of work found: %llu\n",
+         (unsigned long long) proof);
+    GNUNET_CRYPTO_pow_search_stop (ps);
+    result_cb (cb_cls,
+               proof);
+    return;
+  }
+  ps->task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                             rh,
+                                             &wakeup_cb,
+                                             ps);
+  progress_cb = ps->progress_cb;
+  /* this may stop the search */
+  if (NULL != progress_cb)
+    progress_cb (ps->cb_cls,
+                 cp);
+}
+
+
+/**
+ * Start the worker threads.
+ *
+ * @param ps search to start
+ * @param num_threads number of threads to start
+ * @return #GNUNET_OK on success
+ */
+static int
+start_workers (struct GNUNET_CRYPTO_PowSearch *ps,
+               unsigned int num_threads)
+{
+  ps->wakeup = GNUNET_DISK_pipe (GNUNET_NO,
+                                 GNUNET_NO,
+                                 GNUNET_NO,
+                                 GNUNET_NO);
+  if (NULL == ps->wakeup)
+    return GNUNET_SYSERR;
+  GNUNET_assert (0 == pthread_mutex_init (&ps->lock,
+                                          NULL));
+  GNUNET_assert (0 == pthread_cond_init (&ps->stop_cond,
+                                         NULL));
+  ps->workers = GNUNET_new_array (num_threads,
+                                  struct Worker);
+  for (unsigned int i = 0; i < num_threads; i++)
+  {
+    struct Worker *w = &ps->workers[ps->num_workers];
+
+    w->ps = ps;
+    w->current = UINT64_MAX;
+    if (0 != pthread_create (&w->thread,
+                             NULL,
+                             &worker_main,
+                             w))
+    {
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           "Failed to start proof-of-work thread: %s\n",
+           STRERROR (errno));
+      break;
+    }
+    ps->num_workers++;
+  }
+  if (0 == ps->num_workers)
+  {
+    GNUNET_free (ps->workers);
+    GNUNET_assert (0 == pthread_cond_destroy (&ps->stop_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&ps->lock));
+    GNUNET_DISK_pipe_close (ps->wakeup);
+    ps->wakeup = NULL;
+    return GNUNET_SYSERR;
+  }
+  ps->task
+    = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                      GNUNET_DISK_pipe_handle (ps->wakeup,
+                                                               GNUNET_DISK_PIPE_END_READ),
+                                      &wakeup_cb,
+                                      ps);
+  return GNUNET_OK;
+}
+#endif
+
+
+/**
+ * Test one chunk from the scheduler, used if we have no threads.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_PowSearch`
+ */
+static void
+scheduler_chunk (void *cls)
+{
+  struct GNUNET_CRYPTO_PowSearch *ps = cls;
+  uint64_t start;
+  uint64_t proof;
+
+  ps->task = NULL;
+  if (GNUNET_NO == claim_chunk (ps,
+                                &start))
+    return;
+  if (GNUNET_YES == test_chunk (ps,
+                                start,
+                                &proof))
+  {
+    GNUNET_CRYPTO_PowResultCallback result_cb = ps->result_cb;
+    void *cb_cls = ps->cb_cls;
+
+    GNUNET_CRYPTO_pow_search_stop (ps);
+    result_cb (cb_cls,
+               proof);
+    return;
+  }
+  ps->task = GNUNET_SCHEDULER_add_delayed_with_priority (ps->delay,
+                                                         GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                         &scheduler_chunk,
+                                                         ps);
+  if ( (NULL != ps->progress_cb) &&
+       (0 == GNUNET_TIME_absolute_get_remaining (ps->next_report).rel_value_us) )
+  {
+    ps->next_report = GNUNET_TIME_relative_to_absolute (PROGRESS_INTERVAL);
+    /* this may stop the search */
+    ps->progress_cb (ps->cb_cls,
+                     ps->next);
+  }
+}
+
+
+/**
+ * Determine how many threads to use by default.
+ *
+ * @return number of online CPUs, at least 1
+ */
+static unsigned int
+default_thread_count ()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return (unsigned int) n;
+#endif
+  return 1;
+}
+
+
+/**
+ * Start searching for a proof of work for @a data in the
+ * background.  The nonce space starting at @a start is split
+ * among @a num_threads worker threads; the callbacks are run
+ * from the scheduler.
+ *
+ * @param salt salt for the hash, determines the type of proof
+ * @param data data the proof is for
+ * @param data_size number of bytes in @a data
+ * @param start first nonce to test
+ * @param matching_bits number of leading zero bits required
+ * @param num_threads number of threads to use, 0 for one per CPU
+ * @param delay how long each thread should pause between batches
+ *        of nonces, to limit the CPU load
+ * @param progress_cb function to call periodically with a
+ *        checkpoint, can be NULL
+ * @param result_cb function to call once a proof was found
+ * @param cb_cls closure for @a progress_cb and @a result_cb
+ * @return handle to stop the search, NULL on error
+ */
+struct GNUNET_CRYPTO_PowSearch *
+GNUNET_CRYPTO_pow_search_start (const char *salt,
+                                const void *data,
+                                size_t data_size,
+                                uint64_t start,
+                                unsigned int matching_bits,
+                                unsigned int num_threads,
+                                struct GNUNET_TIME_Relative delay,
+                                GNUNET_CRYPTO_PowProgressCallback progress_cb,
+                                GNUNET_CRYPTO_PowResultCallback result_cb,
+                                void *cb_cls)
+{
+  struct GNUNET_CRYPTO_PowSearch *ps;
+
+  if (data_size > MAX_DATA_SIZE)
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  ps = GNUNET_new (struct GNUNET_CRYPTO_PowSearch);
+  ps->salt = GNUNET_strdup (salt);
+  ps->data = GNUNET_memdup (data,
+                            data_size);
+  ps->data_size = data_size;
+  ps->matching_bits = matching_bits;
+  ps->delay = delay;
+  ps->progress_cb = progress_cb;
+  ps->result_cb = result_cb;
+  ps->cb_cls = cb_cls;
+  ps->next = start;
+  ps->next_report = GNUNET_TIME_relative_to_absolute (PROGRESS_INTERVAL);
+  if (0 == num_threads)
+    num_threads = default_thread_count ();
+#if HAVE_PTHREAD_H
+  if (GNUNET_OK == start_workers (ps,
+                                  num_threads))
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Searching for proof of work with %u threads starting at %llu\n",
+         ps->num_workers,
+         (unsigned long long) start);
+    return ps;
+  }
+#endif
+  ps->task = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                 &scheduler_chunk,
+                                                 ps);
+  return ps;
+}
+
+
+/**
+ * Stop a proof-of-work search.  Must not be called after the
+ * result callback of the search was invoked.
+ *
+ * @param ps search to stop
+ * @return nonce up to which (exclusively) all nonces were
+ *         tested, to resume the search later
+ */
+uint64_t
+GNUNET_CRYPTO_pow_search_stop (struct GNUNET_CRYPTO_PowSearch *ps)
+{
+  uint64_t cp;
+
+  if (NULL != ps->task)
+  {
+    GNUNET_SCHEDULER_cancel (ps->task);
+    ps->task = NULL;
+  }
+  cp = ps->next;
+#if HAVE_PTHREAD_H
+  if (NULL != ps->wakeup)
+  {
+    /* workers finish the nonce they are testing, so the
+       checkpoint after joining is as good as it gets */
+    join_workers (ps);
+    cp = get_checkpoint (ps);
+    /* a proof we did not get to report yet is where to resume */
+    if (GNUNET_YES == ps->found)
+      cp = ps->proof;
+    GNUNET_free (ps->workers);
+    GNUNET_assert (0 == pthread_cond_destroy (&ps->stop_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&ps->lock));
+    GNUNET_DISK_pipe_close (ps->wakeup);
+  }
+#endif
+  GNUNET_free (ps->salt);
+  GNUNET_free (ps->data);
+  GNUNET_free (ps);
+  return cp;
+}
+
+/* end of crypto_pow.c */
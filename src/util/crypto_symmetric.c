@@ -49,62 +49,210 @@ GNUNET_CRYPTO_symmetric_create_session_key (struct GNUNET_CRYPTO_SymmetricSessio
 
 
 /**
- * Initialize AES cipher.
+ * Keyed context for symmetric encryption.  Holds the expanded
+ * key schedules of both ciphers so that they can be reused for
+ * many blocks encrypted with the same session key.
+ */
+struct GNUNET_CRYPTO_SymmetricContext
+{
+  /**
+   * AES-256 cipher in CFB mode, keyed.
+   */
+  gcry_cipher_hd_t aes;
+
+  /**
+   * Twofish cipher in CFB mode, keyed.
+   */
+  gcry_cipher_hd_t twofish;
+};
+
+
+/**
+ * Open a cipher in CFB mode and set its key.
  *
  * @param handle handle to initialize
- * @param sessionkey session key to use
- * @param iv initialization vector to use
- * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ * @param algo cipher to use
+ * @param key key material
+ * @param key_len number of bytes in @a key
  */
-static int
-setup_cipher_aes (gcry_cipher_hd_t *handle,
-                  const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey,
-                  const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv)
+static void
+setup_cipher (gcry_cipher_hd_t *handle,
+              int algo,
+              const void *key,
+              size_t key_len)
 {
   int rc;
 
   GNUNET_assert (0 ==
-                 gcry_cipher_open (handle, GCRY_CIPHER_AES256,
-                                   GCRY_CIPHER_MODE_CFB, 0));
+                 gcry_cipher_open (handle,
+                                   algo,
+                                   GCRY_CIPHER_MODE_CFB,
+                                   0));
   rc = gcry_cipher_setkey (*handle,
-                           sessionkey->aes_key,
-                           sizeof (sessionkey->aes_key));
+                           key,
+                           key_len);
   GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
-  rc = gcry_cipher_setiv (*handle,
-                          iv->aes_iv,
-                          sizeof (iv->aes_iv));
-  GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
-  return GNUNET_OK;
 }
 
 
 /**
- * Initialize TWOFISH cipher.
+ * Initialize both ciphers of @a ctx with @a sessionkey.
  *
- * @param handle handle to initialize
+ * @param ctx context to initialize
  * @param sessionkey session key to use
- * @param iv initialization vector to use
- * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
  */
-static int
-setup_cipher_twofish (gcry_cipher_hd_t *handle,
-                      const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey,
-                      const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv)
+static void
+setup_context (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+               const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  setup_cipher (&ctx->aes,
+                GCRY_CIPHER_AES256,
+                sessionkey->aes_key,
+                sizeof (sessionkey->aes_key));
+  setup_cipher (&ctx->twofish,
+                GCRY_CIPHER_TWOFISH,
+                sessionkey->twofish_key,
+                sizeof (sessionkey->twofish_key));
+}
+
+
+/**
+ * Release the ciphers of @a ctx.
+ *
+ * @param ctx context to clean up
+ */
+static void
+teardown_context (struct GNUNET_CRYPTO_SymmetricContext *ctx)
+{
+  gcry_cipher_close (ctx->aes);
+  gcry_cipher_close (ctx->twofish);
+}
+
+
+/**
+ * Set the IV of a cipher.
+ *
+ * @param handle cipher to reset
+ * @param iv initialization vector
+ * @param iv_len number of bytes in @a iv
+ */
+static void
+set_iv (gcry_cipher_hd_t handle,
+        const void *iv,
+        size_t iv_len)
 {
   int rc;
 
-  GNUNET_assert (0 ==
-                 gcry_cipher_open (handle, GCRY_CIPHER_TWOFISH,
-                                   GCRY_CIPHER_MODE_CFB, 0));
-  rc = gcry_cipher_setkey (*handle,
-                           sessionkey->twofish_key,
-                           sizeof (sessionkey->twofish_key));
-  GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
-  rc = gcry_cipher_setiv (*handle,
-                          iv->twofish_iv,
-                          sizeof (iv->twofish_iv));
+  rc = gcry_cipher_setiv (handle,
+                          iv,
+                          iv_len);
   GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
-  return GNUNET_OK;
+}
+
+
+/**
+ * Run one cipher over @a size bytes at @a buf, in place.
+ *
+ * @param handle cipher to use
+ * @param iv initialization vector
+ * @param iv_len number of bytes in @a iv
+ * @param buf data to process
+ * @param size number of bytes in @a buf
+ * @param encrypt #GNUNET_YES to encrypt, #GNUNET_NO to decrypt
+ */
+static void
+apply_cipher (gcry_cipher_hd_t handle,
+              const void *iv,
+              size_t iv_len,
+              void *buf,
+              size_t size,
+              int encrypt)
+{
+  set_iv (handle,
+          iv,
+          iv_len);
+  if (GNUNET_YES == encrypt)
+    GNUNET_assert (0 == gcry_cipher_encrypt (handle,
+                                             buf,
+                                             size,
+                                             NULL,
+                                             0));
+  else
+    GNUNET_assert (0 == gcry_cipher_decrypt (handle,
+                                             buf,
+                                             size,
+                                             NULL,
+                                             0));
+}
+
+
+/**
+ * Encrypt @a size bytes with AES and then Twofish.
+ *
+ * @param ctx keyed context to use
+ * @param block the block to encrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may overlap with @a block
+ */
+static void
+context_encrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                 const void *block,
+                 size_t size,
+                 const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                 void *result)
+{
+  if (result != block)
+    memmove (result,
+             block,
+             size);
+  apply_cipher (ctx->aes,
+                iv->aes_iv,
+                sizeof (iv->aes_iv),
+                result,
+                size,
+                GNUNET_YES);
+  apply_cipher (ctx->twofish,
+                iv->twofish_iv,
+                sizeof (iv->twofish_iv),
+                result,
+                size,
+                GNUNET_YES);
+}
+
+
+/**
+ * Decrypt @a size bytes with Twofish and then AES.
+ *
+ * @param ctx keyed context to use
+ * @param block the block to decrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may overlap with @a block
+ */
+static void
+context_decrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                 const void *block,
+                 size_t size,
+                 const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                 void *result)
+{
+  if (result != block)
+    memmove (result,
+             block,
+             size);
+  apply_cipher (ctx->twofish,
+                iv->twofish_iv,
+                sizeof (iv->twofish_iv),
+                result,
+                size,
+                GNUNET_NO);
+  apply_cipher (ctx->aes,
+                iv->aes_iv,
+                sizeof (iv->aes_iv),
+                result,
+                size,
+                GNUNET_NO);
 }
 
 
@@ -128,18 +276,16 @@ GNUNET_CRYPTO_symmetric_encrypt (const void *block,
                                  const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
                                  void *result)
 {
-  gcry_cipher_hd_t handle;
-  char tmp[size];
-
-  if (GNUNET_OK != setup_cipher_aes (&handle, sessionkey, iv))
-    return -1;
-  GNUNET_assert (0 == gcry_cipher_encrypt (handle, tmp, size, block, size));
-  gcry_cipher_close (handle);
-  if (GNUNET_OK != setup_cipher_twofish (&handle, sessionkey, iv))
-    return -1;
-  GNUNET_assert (0 == gcry_cipher_encrypt (handle, result, size, tmp, size));
-  gcry_cipher_close (handle);
-  memset (tmp, 0, sizeof (tmp));
+  struct GNUNET_CRYPTO_SymmetricContext ctx;
+
+  setup_context (&ctx,
+                 sessionkey);
+  context_encrypt (&ctx,
+                   block,
+                   size,
+                   iv,
+                   result);
+  teardown_context (&ctx);
   return size;
 }
 
@@ -164,22 +310,199 @@ GNUNET_CRYPTO_symmetric_decrypt (const void *block,
                                  const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
                                  void *result)
 {
-  gcry_cipher_hd_t handle;
-  char tmp[size];
-
-  if (GNUNET_OK != setup_cipher_twofish (&handle, sessionkey, iv))
-    return -1;
-  GNUNET_assert (0 == gcry_cipher_decrypt (handle, tmp, size, block, size));
-  gcry_cipher_close (handle);
-  if (GNUNET_OK != setup_cipher_aes (&handle, sessionkey, iv))
-    return -1;
-  GNUNET_assert (0 == gcry_cipher_decrypt (handle, result, size, tmp, size));
-  gcry_cipher_close (handle);
-  memset (tmp, 0, sizeof (tmp));
+  struct GNUNET_CRYPTO_SymmetricContext ctx;
+
+  setup_context (&ctx,
+                 sessionkey);
+  context_decrypt (&ctx,
+                   block,
+                   size,
+                   iv,
+                   result);
+  teardown_context (&ctx);
   return size;
 }
 
 
+/**
+ * Create a keyed context for encrypting and decrypting many blocks
+ * with the same session key.  The key schedules are computed once
+ * here; each operation on the context only sets the IVs.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free with #GNUNET_CRYPTO_symmetric_context_destroy()
+ */
+struct GNUNET_CRYPTO_SymmetricContext *
+GNUNET_CRYPTO_symmetric_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  struct GNUNET_CRYPTO_SymmetricContext *ctx;
+
+  ctx = GNUNET_new (struct GNUNET_CRYPTO_SymmetricContext);
+  setup_context (ctx,
+                 sessionkey);
+  return ctx;
+}
+
+
+/**
+ * Encrypt a block using a keyed context.  Produces the same
+ * output as #GNUNET_CRYPTO_symmetric_encrypt() with the context's
+ * session key.
+ *
+ * @param ctx the keyed context
+ * @param block the block to encrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same or
+ *               overlap with @a block
+ * @return the size of the encrypted block, -1 for errors
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_encrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result)
+{
+  context_encrypt (ctx,
+                   block,
+                   size,
+                   iv,
+                   result);
+  return size;
+}
+
+
+/**
+ * Decrypt a block using a keyed context.  Produces the same
+ * output as #GNUNET_CRYPTO_symmetric_decrypt() with the context's
+ * session key.
+ *
+ * @param ctx the keyed context
+ * @param block the data to decrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same or
+ *               overlap with @a block
+ * @return -1 on failure, size of decrypted block on success
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_decrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result)
+{
+  context_decrypt (ctx,
+                   block,
+                   size,
+                   iv,
+                   result);
+  return size;
+}
+
+
+/**
+ * Encrypt @a num independent blocks using a keyed context.  All
+ * blocks are first run through AES and then through Twofish, so
+ * each key schedule stays hot in the cache for the whole batch.
+ *
+ * @param ctx the keyed context
+ * @param num number of blocks
+ * @param blocks the blocks to encrypt
+ * @param sizes the size of each block
+ * @param ivs the initialization vector for each block
+ * @param results where to store the encrypted blocks, entries may be
+ *                the same as the respective entry in @a blocks, but
+ *                blocks must not overlap with other results
+ */
+void
+GNUNET_CRYPTO_symmetric_context_encrypt_bulk (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                              unsigned int num,
+                                              const void *const *blocks,
+                                              const size_t *sizes,
+                                              const struct GNUNET_CRYPTO_SymmetricInitializationVector *ivs,
+                                              void *const *results)
+{
+  for (unsigned int i = 0; i < num; i++)
+  {
+    if (results[i] != blocks[i])
+      memmove (results[i],
+               blocks[i],
+               sizes[i]);
+    apply_cipher (ctx->aes,
+                  ivs[i].aes_iv,
+                  sizeof (ivs[i].aes_iv),
+                  results[i],
+                  sizes[i],
+                  GNUNET_YES);
+  }
+  for (unsigned int i = 0; i < num; i++)
+    apply_cipher (ctx->twofish,
+                  ivs[i].twofish_iv,
+                  sizeof (ivs[i].twofish_iv),
+                  results[i],
+                  sizes[i],
+                  GNUNET_YES);
+}
+
+
+/**
+ * Decrypt @a num independent blocks using a keyed context.
+ *
+ * @param ctx the keyed context
+ * @param num number of blocks
+ * @param blocks the blocks to decrypt
+ * @param sizes the size of each block
+ * @param ivs the initialization vector for each block
+ * @param results where to store the decrypted blocks, entries may be
+ *                the same as the respective entry in @a blocks, but
+ *                blocks must not overlap with other results
+ */
+void
+GNUNET_CRYPTO_symmetric_context_decrypt_bulk (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                              unsigned int num,
+                                              const void *const *blocks,
+                                              const size_t *sizes,
+                                              const struct GNUNET_CRYPTO_SymmetricInitializationVector *ivs,
+                                              void *const *results)
+{
+  for (unsigned int i = 0; i < num; i++)
+  {
+    if (results[i] != blocks[i])
+      memmove (results[i],
+               blocks[i],
+               sizes[i]);
+    apply_cipher (ctx->twofish,
+                  ivs[i].twofish_iv,
+                  sizeof (ivs[i].twofish_iv),
+                  results[i],
+                  sizes[i],
+                  GNUNET_NO);
+  }
+  for (unsigned int i = 0; i < num; i++)
+    apply_cipher (ctx->aes,
+                  ivs[i].aes_iv,
+                  sizeof (ivs[i].aes_iv),
+                  results[i],
+                  sizes[i],
+                  GNUNET_NO);
+}
+
+
+/**
+ * Destroy a keyed context.  The expanded keys are wiped.
+ *
+ * @param ctx context to destroy
+ */
+void
+GNUNET_CRYPTO_symmetric_context_destroy (struct GNUNET_CRYPTO_SymmetricContext *ctx)
+{
+  teardown_context (ctx);
+  GNUNET_free (ctx);
+}
+
+
 /**
  * @brief Derive an IV
  *
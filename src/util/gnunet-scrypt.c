@@ -24,7 +24,6 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gcrypt.h>
 
 /**
  * Amount of work required (W-bit collisions) for NSE proofs, in collision-bits.
@@ -40,7 +39,17 @@ static struct GNUNET_CRYPTO_EddsaPublicKey pub;
 
 static uint64_t proof;
 
-static struct GNUNET_SCHEDULER_Task *proof_task;
+/**
+ * Number of threads to use, 0 for one per CPU.
+ */
+static unsigned int num_threads;
+
+static struct GNUNET_CRYPTO_PowSearch *proof_search;
+
+/**
+ * When did we last report progress?
+ */
+static struct GNUNET_TIME_Absolute last_progress;
 
 static const struct GNUNET_CONFIGURATION_Handle *cfg;
 
@@ -51,11 +60,9 @@ static char *pwfn;
 
 /**
  * Write our current proof to disk.
- *
- * @param cls closure
  */
 static void
-shutdown_task (void *cls)
+write_proof ()
 {
   if (sizeof (proof) !=
       GNUNET_DISK_fn_write (pwfn,
@@ -70,109 +77,64 @@ shutdown_task (void *cls)
 
 
 /**
- * Calculate the 'proof-of-work' hash (an expensive hash).
+ * Stop the search and write our current proof to disk.
  *
- * @param buf data to hash
- * @param buf_len number of bytes in @a buf
- * @param result where to write the resulting hash
+ * @param cls closure
  */
 static void
-pow_hash (const void *buf,
-          size_t buf_len,
-          struct GNUNET_HashCode *result)
+shutdown_task (void *cls)
 {
-  GNUNET_break (0 ==
-  gcry_kdf_derive (buf, buf_len,
-                   GCRY_KDF_SCRYPT,
-                   1 /* subalgo */,
-                   "gnunet-proof-of-work", strlen ("gnunet-proof-of-work"),
-                   2 /* iterations; keep cost of individual op small */,
-                   sizeof (struct GNUNET_HashCode), result));
+  if (NULL != proof_search)
+  {
+    proof = GNUNET_CRYPTO_pow_search_stop (proof_search);
+    proof_search = NULL;
+  }
+  write_proof ();
 }
 
 
 /**
- * Count the leading zeroes in hash.
+ * The search made progress, remember it.
  *
- * @param hash to count leading zeros in
- * @return the number of leading zero bits.
+ * @param cls closure (unused)
+ * @param checkpoint all values below have been tested
  */
-static unsigned int
-count_leading_zeroes (const struct GNUNET_HashCode *hash)
+static void
+proof_progress (void *cls,
+                uint64_t checkpoint)
 {
-  unsigned int hash_count;
+  struct GNUNET_TIME_Relative elapsed;
 
-  hash_count = 0;
-  while (0 == GNUNET_CRYPTO_hash_get_bit (hash, hash_count))
-    hash_count++;
-  return hash_count;
+  elapsed = GNUNET_TIME_absolute_get_duration (last_progress);
+  if (checkpoint > proof)
+    elapsed = GNUNET_TIME_relative_divide (elapsed,
+                                           checkpoint - proof);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Current: %llu [%s/proof]\n",
+              (unsigned long long) checkpoint,
+              GNUNET_STRINGS_relative_time_to_string (elapsed, 0));
+  last_progress = GNUNET_TIME_absolute_get ();
+  proof = checkpoint;
+  write_proof ();
 }
 
 
 /**
- * Find our proof of work.
+ * We found the proof of work.
  *
  * @param cls closure (unused)
- * @param tc task context
+ * @param result the proof
  */
 static void
-find_proof (void *cls)
+proof_found (void *cls,
+             uint64_t result)
 {
-  #define ROUND_SIZE 10
-  uint64_t counter;
-  char buf[sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
-           sizeof (uint64_t)] GNUNET_ALIGN;
-  struct GNUNET_HashCode result;
-  unsigned int i;
-  struct GNUNET_TIME_Absolute timestamp;
-  struct GNUNET_TIME_Relative elapsed;
-
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Got Proof of Work %llu\n",
-	      (unsigned long long) proof);
-  proof_task = NULL;
-  GNUNET_memcpy (&buf[sizeof (uint64_t)], &pub,
-          sizeof (struct GNUNET_CRYPTO_EddsaPublicKey));
-  i = 0;
-  counter = proof;
-  timestamp = GNUNET_TIME_absolute_get ();
-  while ((counter != UINT64_MAX) && (i < ROUND_SIZE))
-  {
-    GNUNET_memcpy (buf, &counter, sizeof (uint64_t));
-    pow_hash (buf, sizeof (buf), &result);
-    if (nse_work_required <= count_leading_zeroes (&result))
-    {
-      proof = counter;
-      FPRINTF (stdout, "Proof of work found: %llu!\n",
-               (unsigned long long) proof);
-      GNUNET_SCHEDULER_shutdown ();
-      return;
-    }
-    counter++;
-    i++;
-  }
-  elapsed = GNUNET_TIME_absolute_get_duration (timestamp);
-  elapsed = GNUNET_TIME_relative_divide (elapsed, ROUND_SIZE);
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-              "Current: %llu [%s/proof]\n",
-              (unsigned long long) counter,
-              GNUNET_STRINGS_relative_time_to_string (elapsed, 0));
-  if (proof / (100 * ROUND_SIZE) < counter / (100 * ROUND_SIZE))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Testing proofs currently at %llu\n",
-                (unsigned long long) counter);
-    /* remember progress every 100 rounds */
-    proof = counter;
-    shutdown_task (NULL);
-  }
-  else
-  {
-    proof = counter;
-  }
-  proof_task =
-    GNUNET_SCHEDULER_add_delayed_with_priority (proof_find_delay,
-						GNUNET_SCHEDULER_PRIORITY_IDLE,
-						&find_proof, NULL);
+  proof_search = NULL;
+  proof = result;
+  FPRINTF (stdout,
+           "Proof of work found: %llu!\n",
+           (unsigned long long) proof);
+  GNUNET_SCHEDULER_shutdown ();
 }
 
 
@@ -290,10 +252,18 @@ run (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Delay between tries: %s\n",
               GNUNET_STRINGS_relative_time_to_string (proof_find_delay, 1));
-  proof_task =
-    GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
-					&find_proof,
-					NULL);
+  last_progress = GNUNET_TIME_absolute_get ();
+  proof_search
+    = GNUNET_CRYPTO_pow_search_start ("gnunet-proof-of-work",
+                                      &pub,
+                                      sizeof (pub),
+                                      proof,
+                                      (unsigned int) nse_work_required,
+                                      num_threads,
+                                      proof_find_delay,
+                                      &proof_progress,
+                                      &proof_found,
+                                      NULL);
   GNUNET_SCHEDULER_add_shutdown (&shutdown_task,
 				 NULL);
 }
@@ -331,6 +301,11 @@ main (int argc,
                                             "TIME",
                                             gettext_noop ("time to wait between calculations"),
                                             &proof_find_delay),
+    GNUNET_GETOPT_option_uint ('T',
+                               "threads",
+                               "NUMBER",
+                               gettext_noop ("number of threads to use, 0 for one per CPU"),
+                               &num_threads),
     GNUNET_GETOPT_OPTION_END
   };
   int ret;
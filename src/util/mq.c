@@ -79,6 +79,18 @@ struct GNUNET_MQ_Envelope
    */
   const void *extra;
 
+  /**
+   * Envelope that owns @e mh if the message is shared with other
+   * envelopes (see #GNUNET_MQ_env_share()), NULL if we own @e mh.
+   */
+  struct GNUNET_MQ_Envelope *owner;
+
+  /**
+   * Number of other envelopes sharing our message.  Only used
+   * if @e owner is NULL.
+   */
+  unsigned int shares;
+
   /**
    * Did the application call #GNUNET_MQ_env_set_options()?
    */
@@ -297,6 +309,33 @@ GNUNET_MQ_inject_error (struct GNUNET_MQ_Handle *mq,
 }
 
 
+/**
+ * Free an envelope.  If the message of the envelope is shared with
+ * other envelopes, it is only freed together with the last of them.
+ *
+ * @param ev the envelope to free
+ */
+static void
+env_free (struct GNUNET_MQ_Envelope *ev)
+{
+  struct GNUNET_MQ_Envelope *owner;
+
+  owner = ev->owner;
+  if (NULL != owner)
+  {
+    GNUNET_free (ev);
+    ev = owner;
+  }
+  if (0 < ev->shares)
+  {
+    /* others still use the message, keep it around */
+    ev->shares--;
+    return;
+  }
+  GNUNET_free (ev);
+}
+
+
 /**
  * Discard the message queue message, free all
  * allocated resources. Must be called in the event
@@ -308,7 +347,7 @@ void
 GNUNET_MQ_discard (struct GNUNET_MQ_Envelope *ev)
 {
   GNUNET_assert (NULL == ev->parent_queue);
-  GNUNET_free (ev);
+  env_free (ev);
 }
 
 
@@ -409,6 +448,32 @@ GNUNET_MQ_env_copy (struct GNUNET_MQ_Envelope *env)
 }
 
 
+/**
+ * Create an envelope that shares the message of @a env instead of
+ * copying it, so that the same message can be queued with several
+ * message queues.  The message is freed once @a env and all
+ * envelopes sharing it were sent or discarded; it must not be
+ * modified after it was shared.  Options and callbacks of @a env
+ * are not shared.
+ *
+ * @param env envelope with the message to share
+ * @return new envelope with the same message
+ */
+struct GNUNET_MQ_Envelope *
+GNUNET_MQ_env_share (struct GNUNET_MQ_Envelope *env)
+{
+  struct GNUNET_MQ_Envelope *owner;
+  struct GNUNET_MQ_Envelope *share;
+
+  owner = (NULL != env->owner) ? env->owner : env;
+  owner->shares++;
+  share = GNUNET_new (struct GNUNET_MQ_Envelope);
+  share->mh = owner->mh;
+  share->owner = owner;
+  return share;
+}
+
+
 /**
  * Send a copy of a message with the given message queue.
  * Can be called repeatedly on the same envelope.
@@ -479,24 +544,148 @@ impl_send_continue (void *cls)
 void
 GNUNET_MQ_impl_send_continue (struct GNUNET_MQ_Handle *mq)
 {
-  struct GNUNET_MQ_Envelope *current_envelope;
+  GNUNET_MQ_impl_send_continue_multiple (mq,
+                                         1,
+                                         GNUNET_NO);
+}
+
+
+/**
+ * Obtain the current message and the messages queued behind it, so
+ * that the implementation can transmit several of them with a single
+ * system call.  The implementation must report the outcome with
+ * #GNUNET_MQ_impl_send_continue_multiple() before returning to the
+ * scheduler, as the queued messages may be cancelled afterwards.
+ *
+ * Only useful for implementing message queues, results in undefined
+ * behavior if not used carefully.
+ *
+ * @param mq message queue with the current message
+ * @param[out] msgs set to the current message followed by queued ones
+ * @param msgs_len length of the @a msgs array, at least 1
+ * @return number of messages stored in @a msgs, at least 1
+ */
+unsigned int
+GNUNET_MQ_impl_peek (struct GNUNET_MQ_Handle *mq,
+                     const struct GNUNET_MessageHeader **msgs,
+                     unsigned int msgs_len)
+{
+  struct GNUNET_MQ_Envelope *env;
+  unsigned int n;
+
+  GNUNET_assert (0 < msgs_len);
+  GNUNET_assert (NULL != mq->current_envelope);
+  msgs[0] = mq->current_envelope->mh;
+  n = 1;
+  for (env = mq->envelope_head;
+       (NULL != env) && (n < msgs_len);
+       env = env->next)
+    msgs[n++] = env->mh;
+  return n;
+}
+
+
+/**
+ * Tell the queue that the current message and the @a done - 1
+ * messages queued behind it (as returned by #GNUNET_MQ_impl_peek())
+ * were transmitted completely.  Calls the send notifications of
+ * these messages.
+ *
+ * If @a next_started is #GNUNET_YES, the implementation has already
+ * transmitted part of the next message.  It then becomes the current
+ * message, is treated as if #GNUNET_MQ_impl_send_in_flight() had
+ * been called for it, and the send implementation is NOT invoked for
+ * it.  Otherwise, the send implementation is called for the next
+ * queued message, if any, just like #GNUNET_MQ_impl_send_continue()
+ * does.
+ *
+ * As the notifications are called last, they may destroy the queue;
+ * the implementation must thus not touch @a mq (or its own state)
+ * after this call.
+ *
+ * Only useful for implementing message queues, results in undefined
+ * behavior if not used carefully.
+ *
+ * @param mq message queue to send the next message with
+ * @param done number of messages transmitted completely, at least 1
+ * @param next_started #GNUNET_YES if the message following these
+ *        was partially transmitted
+ */
+void
+GNUNET_MQ_impl_send_continue_multiple (struct GNUNET_MQ_Handle *mq,
+                                       unsigned int done,
+                                       int next_started)
+{
+  struct GNUNET_MQ_Envelope *done_head;
+  struct GNUNET_MQ_Envelope *done_tail;
+  struct GNUNET_MQ_Envelope *env;
   GNUNET_SCHEDULER_TaskCallback cb;
+  void *cb_cls;
 
-  GNUNET_assert (0 < mq->queue_length);
-  mq->queue_length--;
+  GNUNET_assert (0 < done);
+  GNUNET_assert (done <= mq->queue_length);
+  done_head = NULL;
+  done_tail = NULL;
+  cb = NULL;
+  cb_cls = NULL;
   mq->in_flight = GNUNET_NO;
-  current_envelope = mq->current_envelope;
-  current_envelope->parent_queue = NULL;
+  env = mq->current_envelope;
   mq->current_envelope = NULL;
+  for (unsigned int i = 0; i < done; i++)
+  {
+    if (0 != i)
+    {
+      env = mq->envelope_head;
+      GNUNET_assert (NULL != env);
+      GNUNET_CONTAINER_DLL_remove (mq->envelope_head,
+                                   mq->envelope_tail,
+                                   env);
+    }
+    GNUNET_assert (NULL != env);
+    env->parent_queue = NULL;
+    mq->queue_length--;
+    GNUNET_CONTAINER_DLL_insert_tail (done_head,
+                                      done_tail,
+                                      env);
+  }
   GNUNET_assert (NULL == mq->send_task);
-  mq->send_task = GNUNET_SCHEDULER_add_now (&impl_send_continue,
-					    mq);
-  if (NULL != (cb = current_envelope->sent_cb))
+  if (GNUNET_YES == next_started)
   {
-    current_envelope->sent_cb = NULL;
-    cb (current_envelope->sent_cls);
+    env = mq->envelope_head;
+    GNUNET_assert (NULL != env);
+    GNUNET_CONTAINER_DLL_remove (mq->envelope_head,
+                                 mq->envelope_tail,
+                                 env);
+    mq->current_envelope = env;
+    mq->in_flight = GNUNET_YES;
+    /* can't call cancel from now on anymore */
+    env->parent_queue = NULL;
+    cb = env->sent_cb;
+    cb_cls = env->sent_cls;
+    env->sent_cb = NULL;
+  }
+  else
+  {
+    mq->send_task = GNUNET_SCHEDULER_add_now (&impl_send_continue,
+                                              mq);
+  }
+  /* only notify now, as the callbacks may destroy @a mq */
+  while (NULL != (env = done_head))
+  {
+    GNUNET_SCHEDULER_TaskCallback sent_cb;
+
+    GNUNET_CONTAINER_DLL_remove (done_head,
+                                 done_tail,
+                                 env);
+    if (NULL != (sent_cb = env->sent_cb))
+    {
+      env->sent_cb = NULL;
+      sent_cb (env->sent_cls);
+    }
+    env_free (env);
   }
-  GNUNET_free (current_envelope);
+  if (NULL != cb)
+    cb (cb_cls);
 }
 
 
@@ -969,8 +1158,8 @@ GNUNET_MQ_send_cancel (struct GNUNET_MQ_Envelope *ev)
   {
     ev->parent_queue = NULL;
     ev->mh = NULL;
-    /* also frees ev */
-    GNUNET_free (ev);
+    /* also frees the message, unless it is shared */
+    env_free (ev);
   }
 }
 
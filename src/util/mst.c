@@ -36,6 +36,17 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util-mst", __VA_ARGS__)
 
+/**
+ * How big is the receive buffer initially when we read from a socket?
+ */
+#define MST_MIN_READ_BUFFER 1024
+
+/**
+ * Up to which size do we grow the receive buffer if reads keep
+ * filling it completely?
+ */
+#define MST_MAX_READ_BUFFER (64 * 1024)
+
 
 /**
  * Handle to a message stream tokenizer.
@@ -73,6 +84,17 @@ struct GNUNET_MessageStreamTokenizer
    */
   struct GNUNET_MessageHeader *hdr;
 
+  /**
+   * Buffer we copy messages to that are not properly aligned
+   * where they were received, NULL if we never needed it.
+   */
+  struct GNUNET_MessageHeader *align_buf;
+
+  /**
+   * Size of @e align_buf.
+   */
+  size_t align_size;
+
 };
 
 
@@ -98,10 +120,120 @@ GNUNET_MST_create (GNUNET_MessageTokenizerCallback cb,
 }
 
 
+/**
+ * Make sure the private buffer of @a mst can hold @a need bytes
+ * after the unprocessed data.  Moves the unprocessed data (at most
+ * one incomplete message) to the beginning of the buffer first.
+ *
+ * @param mst tokenizer to prepare
+ * @param need number of bytes that must fit after @e pos
+ */
+static void
+make_room (struct GNUNET_MessageStreamTokenizer *mst,
+           size_t need)
+{
+  if (mst->off > 0)
+  {
+    mst->pos -= mst->off;
+    memmove (mst->hdr,
+             &((char *) mst->hdr)[mst->off],
+             mst->pos);
+    mst->off = 0;
+  }
+  if (mst->curr_buf - mst->pos >= need)
+    return;
+  mst->curr_buf = mst->pos + need;
+  mst->hdr = GNUNET_realloc (mst->hdr,
+                             mst->curr_buf);
+}
+
+
+/**
+ * Pass one complete message to the callback of @a mst.  The
+ * message is passed in place if it is properly aligned, otherwise
+ * it is copied to the alignment buffer first.
+ *
+ * @param mst tokenizer to use
+ * @param msg start of the message, possibly unaligned
+ * @param size size of the message in bytes
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR to stop processing
+ */
+static int
+deliver (struct GNUNET_MessageStreamTokenizer *mst,
+         const char *msg,
+         uint16_t size)
+{
+  const struct GNUNET_MessageHeader *hdr;
+  int cbret;
+
+  if (0 == ((uintptr_t) msg) % ALIGN_FACTOR)
+  {
+    hdr = (const struct GNUNET_MessageHeader *) msg;
+  }
+  else
+  {
+    if (mst->align_size < size)
+    {
+      GNUNET_free_non_null (mst->align_buf);
+      mst->align_size = GNUNET_MAX (size,
+                                    GNUNET_MIN (2 * mst->align_size,
+                                                GNUNET_MAX_MESSAGE_SIZE));
+      mst->align_buf = GNUNET_malloc (mst->align_size);
+    }
+    GNUNET_memcpy (mst->align_buf,
+                   msg,
+                   size);
+    hdr = mst->align_buf;
+  }
+  if (GNUNET_OK !=
+      (cbret = mst->cb (mst->cb_cls,
+                        hdr)))
+  {
+    if (GNUNET_SYSERR == cbret)
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Failure processing message of type %u and size %u\n",
+                  ntohs (hdr->type),
+                  ntohs (hdr->size));
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Determine the size of the message starting at @a buf.
+ *
+ * @param buf beginning of a message header, possibly unaligned
+ * @return size of the message, 0 if the size is invalid
+ */
+static uint16_t
+message_size (const char *buf)
+{
+  struct GNUNET_MessageHeader hdr;
+  uint16_t want;
+
+  GNUNET_memcpy (&hdr,
+                 buf,
+                 sizeof (hdr));
+  want = ntohs (hdr.size);
+  if (want < sizeof (struct GNUNET_MessageHeader))
+  {
+    GNUNET_break_op (0);
+    return 0;
+  }
+  return want;
+}
+
+
 /**
  * Add incoming data to the receive buffer and call the
  * callback for all complete messages.
  *
+ * Complete messages are passed to the callback where they are,
+ * either in @a buf or in the private buffer of @a mst, as long
+ * as they are suitably aligned.  Only a message that is split
+ * across calls is assembled in the private buffer.
+ *
  * @param mst tokenizer to use
  * @param buf input data to add
  * @param size number of bytes in @a buf
@@ -119,14 +251,10 @@ GNUNET_MST_from_buffer (struct GNUNET_MessageStreamTokenizer *mst,
                         int purge,
                         int one_shot)
 {
-  const struct GNUNET_MessageHeader *hdr;
+  size_t avail;
   size_t delta;
   uint16_t want;
-  char *ibuf;
-  int need_align;
-  unsigned long offset;
   int ret;
-  int cbret;
 
   GNUNET_assert (mst->off <= mst->pos);
   GNUNET_assert (mst->pos <= mst->curr_buf);
@@ -135,112 +263,46 @@ GNUNET_MST_from_buffer (struct GNUNET_MessageStreamTokenizer *mst,
        (unsigned int) size,
        (unsigned int) (mst->pos - mst->off));
   ret = GNUNET_OK;
-  ibuf = (char *) mst->hdr;
-  while (mst->pos > 0)
+  /* first process whatever is in our private buffer */
+  while (mst->pos > mst->off)
   {
-do_align:
-    GNUNET_assert (mst->pos >= mst->off);
-    if ((mst->curr_buf - mst->off < sizeof (struct GNUNET_MessageHeader)) ||
-        (0 != (mst->off % ALIGN_FACTOR)))
-    {
-      /* need to align or need more space */
-      mst->pos -= mst->off;
-      memmove (ibuf,
-	       &ibuf[mst->off],
-	       mst->pos);
-      mst->off = 0;
-    }
-    if (mst->pos - mst->off < sizeof (struct GNUNET_MessageHeader))
-    {
-      delta
-	= GNUNET_MIN (sizeof (struct GNUNET_MessageHeader)
-		      - (mst->pos - mst->off),
-		      size);
-      GNUNET_memcpy (&ibuf[mst->pos],
-		     buf,
-		     delta);
-      mst->pos += delta;
-      buf += delta;
-      size -= delta;
-    }
-    if (mst->pos - mst->off < sizeof (struct GNUNET_MessageHeader))
-    {
-      if (purge)
-      {
-        mst->off = 0;
-        mst->pos = 0;
-      }
-      return GNUNET_OK;
-    }
-    hdr = (const struct GNUNET_MessageHeader *) &ibuf[mst->off];
-    want = ntohs (hdr->size);
-    if (want < sizeof (struct GNUNET_MessageHeader))
-    {
-      GNUNET_break_op (0);
+    avail = mst->pos - mst->off;
+    want = sizeof (struct GNUNET_MessageHeader);
+    if ( (avail >= want) &&
+         (0 == (want = message_size (&((char *) mst->hdr)[mst->off]))) )
       return GNUNET_SYSERR;
-    }
-    if ( (mst->curr_buf - mst->off < want) &&
-	 (mst->off > 0) )
+    if (avail < want)
     {
-      /* can get more space by moving */
-      mst->pos -= mst->off;
-      memmove (ibuf,
-	       &ibuf[mst->off],
-	       mst->pos);
-      mst->off = 0;
-    }
-    if (mst->curr_buf < want)
-    {
-      /* need to get more space by growing buffer */
-      GNUNET_assert (0 == mst->off);
-      mst->hdr = GNUNET_realloc (mst->hdr,
-				 want);
-      ibuf = (char *) mst->hdr;
-      mst->curr_buf = want;
-    }
-    hdr = (const struct GNUNET_MessageHeader *) &ibuf[mst->off];
-    if (mst->pos - mst->off < want)
-    {
-      delta = GNUNET_MIN (want - (mst->pos - mst->off),
-			  size);
-      GNUNET_assert (mst->pos + delta <= mst->curr_buf);
-      GNUNET_memcpy (&ibuf[mst->pos],
-		     buf,
-		     delta);
+      /* message straddles the end of the data we have */
+      make_room (mst,
+                 want - avail);
+      if (0 == size)
+        break;
+      delta = GNUNET_MIN (want - avail,
+                          size);
+      GNUNET_memcpy (&((char *) mst->hdr)[mst->pos],
+                     buf,
+                     delta);
       mst->pos += delta;
       buf += delta;
       size -= delta;
+      continue;
     }
-    if (mst->pos - mst->off < want)
-    {
-      if (purge)
-      {
-        mst->off = 0;
-        mst->pos = 0;
-      }
-      return GNUNET_OK;
-    }
-    if (one_shot == GNUNET_SYSERR)
+    if (GNUNET_SYSERR == one_shot)
     {
       /* cannot call callback again, but return value saying that
        * we have another full message in the buffer */
       ret = GNUNET_NO;
       goto copy;
     }
-    if (one_shot == GNUNET_YES)
+    if (GNUNET_YES == one_shot)
       one_shot = GNUNET_SYSERR;
     mst->off += want;
     if (GNUNET_OK !=
-        (cbret = mst->cb (mst->cb_cls,
-                           hdr)))
-    {
-      if (GNUNET_SYSERR == cbret)
-        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                    "Failure processing message of type %u and size %u\n",
-                    ntohs (hdr->type),
-                    ntohs (hdr->size));
+        deliver (mst,
+                 &((char *) mst->hdr)[mst->off - want],
+                 want))
       return GNUNET_SYSERR;
-    }
     if (mst->off == mst->pos)
     {
       /* reset to beginning of buffer, it's free right now! */
@@ -248,73 +310,45 @@ do_align:
       mst->pos = 0;
     }
   }
-  GNUNET_assert (0 == mst->pos);
-  while (size > 0)
+  /* then process complete messages directly from @a buf */
+  while ( (mst->pos == mst->off) &&
+          (size >= sizeof (struct GNUNET_MessageHeader)) )
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Server-mst has %u bytes left in inbound buffer\n",
          (unsigned int) size);
-    if (size < sizeof (struct GNUNET_MessageHeader))
-      break;
-    offset = (unsigned long) buf;
-    need_align = (0 != (offset % ALIGN_FACTOR)) ? GNUNET_YES : GNUNET_NO;
-    if (GNUNET_NO == need_align)
+    if (0 == (want = message_size (buf)))
     {
-      /* can try to do zero-copy and process directly from original buffer */
-      hdr = (const struct GNUNET_MessageHeader *) buf;
-      want = ntohs (hdr->size);
-      if (want < sizeof (struct GNUNET_MessageHeader))
-      {
-	GNUNET_break_op (0);
-        mst->off = 0;
-        return GNUNET_SYSERR;
-      }
-      if (size < want)
-        break;                  /* or not: buffer incomplete, so copy to private buffer... */
-      if (one_shot == GNUNET_SYSERR)
-      {
-        /* cannot call callback again, but return value saying that
-         * we have another full message in the buffer */
-        ret = GNUNET_NO;
-        goto copy;
-      }
-      if (one_shot == GNUNET_YES)
-        one_shot = GNUNET_SYSERR;
-      if (GNUNET_OK !=
-          (cbret = mst->cb (mst->cb_cls,
-                            hdr)))
-      {
-        if (GNUNET_SYSERR == cbret)
-          GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                      "Failure processing message of type %u and size %u\n",
-                      ntohs (hdr->type),
-                      ntohs (hdr->size));
-        return GNUNET_SYSERR;
-      }
-      buf += want;
-      size -= want;
+      mst->off = 0;
+      mst->pos = 0;
+      return GNUNET_SYSERR;
     }
-    else
+    if (size < want)
+      break;                  /* incomplete, copy to private buffer */
+    if (GNUNET_SYSERR == one_shot)
     {
-      /* need to copy to private buffer to align;
-       * yes, we go a bit more spagetti than usual here */
-      goto do_align;
+      ret = GNUNET_NO;
+      goto copy;
     }
+    if (GNUNET_YES == one_shot)
+      one_shot = GNUNET_SYSERR;
+    if (GNUNET_OK !=
+        deliver (mst,
+                 buf,
+                 want))
+      return GNUNET_SYSERR;
+    buf += want;
+    size -= want;
   }
 copy:
-  if ((size > 0) && (!purge))
+  if ( (size > 0) &&
+       (! purge) )
   {
-    if (size + mst->pos > mst->curr_buf)
-    {
-      mst->hdr = GNUNET_realloc (mst->hdr,
-				 size + mst->pos);
-      ibuf = (char *) mst->hdr;
-      mst->curr_buf = size + mst->pos;
-    }
-    GNUNET_assert (size + mst->pos <= mst->curr_buf);
-    GNUNET_memcpy (&ibuf[mst->pos],
-		   buf,
-		   size);
+    make_room (mst,
+               size);
+    GNUNET_memcpy (&((char *) mst->hdr)[mst->pos],
+                   buf,
+                   size);
     mst->pos += size;
   }
   if (purge)
@@ -333,6 +367,11 @@ copy:
  * Add incoming data to the receive buffer and call the
  * callback for all complete messages.
  *
+ * The private buffer grows (up to #MST_MAX_READ_BUFFER bytes, or
+ * the size of the largest message) whenever a read fills it
+ * completely, so that a busy connection is drained with few
+ * system calls.
+ *
  * @param mst tokenizer to use
  * @param buf input data to add
  * @param size number of bytes in @a buf
@@ -351,12 +390,16 @@ GNUNET_MST_read (struct GNUNET_MessageStreamTokenizer *mst,
 {
   ssize_t ret;
   size_t left;
-  char *buf;
 
+  if (mst->curr_buf < MST_MIN_READ_BUFFER)
+    make_room (mst,
+               MST_MIN_READ_BUFFER - (mst->pos - mst->off));
+  else if (mst->curr_buf - mst->pos < mst->curr_buf / 2)
+    make_room (mst,
+               mst->curr_buf / 2);
   left = mst->curr_buf - mst->pos;
-  buf = (char *) mst->hdr;
   ret = GNUNET_NETWORK_socket_recv (sock,
-				    &buf[mst->pos],
+				    &((char *) mst->hdr)[mst->pos],
 				    left);
   if (-1 == ret)
   {
@@ -373,6 +416,15 @@ GNUNET_MST_read (struct GNUNET_MessageStreamTokenizer *mst,
     return GNUNET_SYSERR;
   }
   mst->pos += ret;
+  if ( ((size_t) ret == left) &&
+       (mst->curr_buf < MST_MAX_READ_BUFFER) )
+  {
+    /* the kernel probably has more for us, read more next time */
+    mst->curr_buf = GNUNET_MIN (2 * mst->curr_buf,
+                                MST_MAX_READ_BUFFER);
+    mst->hdr = GNUNET_realloc (mst->hdr,
+                               mst->curr_buf);
+  }
   return GNUNET_MST_from_buffer (mst,
 				 NULL,
 				 0,
@@ -413,6 +465,7 @@ void
 GNUNET_MST_destroy (struct GNUNET_MessageStreamTokenizer *mst)
 {
   GNUNET_free (mst->hdr);
+  GNUNET_free_non_null (mst->align_buf);
   GNUNET_free (mst);
 }
 
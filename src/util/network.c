@@ -39,6 +39,12 @@
 #define INVALID_SOCKET -1
 #endif
 
+/**
+ * Maximum number of buffers #GNUNET_NETWORK_socket_sendv() passes
+ * to the kernel in one call.
+ */
+#define MAX_SENDV_BUFFERS 64
+
 
 /**
  * @brief handle to a socket
@@ -913,6 +919,64 @@ GNUNET_NETWORK_socket_send (const struct GNUNET_NETWORK_Handle *desc,
 }
 
 
+/**
+ * Send data from several buffers with a single system call
+ * (always non-blocking).
+ *
+ * @param desc socket
+ * @param buffers array of @a num buffers to send, in order
+ * @param lengths sizes of the respective @a buffers
+ * @param num number of entries in @a buffers and @a lengths
+ * @return number of bytes sent, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_NETWORK_socket_sendv (const struct GNUNET_NETWORK_Handle *desc,
+                             const void *const *buffers,
+                             const size_t *lengths,
+                             unsigned int num)
+{
+#ifndef MINGW
+  struct iovec iov[MAX_SENDV_BUFFERS];
+  struct msghdr mh;
+  int flags;
+
+  if (1 == num)
+    return GNUNET_NETWORK_socket_send (desc,
+                                       buffers[0],
+                                       lengths[0]);
+  /* sending only a prefix of the buffers is fine, the caller
+     has to deal with short writes anyway */
+  num = GNUNET_MIN (num, MAX_SENDV_BUFFERS);
+  for (unsigned int i = 0; i < num; i++)
+  {
+    iov[i].iov_base = (void *) buffers[i];
+    iov[i].iov_len = lengths[i];
+  }
+  memset (&mh,
+          0,
+          sizeof (mh));
+  mh.msg_iov = iov;
+  mh.msg_iovlen = num;
+  flags = 0;
+#ifdef MSG_DONTWAIT
+  flags |= MSG_DONTWAIT;
+#endif
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+  return sendmsg (desc->fd,
+                  &mh,
+                  flags);
+#else
+  /* no scatter/gather I/O, just send the first buffer */
+  (void) num;
+  return GNUNET_NETWORK_socket_send (desc,
+                                     buffers[0],
+                                     lengths[0]);
+#endif
+}
+
+
 /**
  * Send data to a particular destination (always non-blocking).
  * This function only works for UDP sockets.
@@ -0,0 +1,233 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_bloomfilter.c
+ * @brief measure add, test, batched test, or and file-backed
+ *        add/remove of the bloomfilter
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * Number of elements we use.
+ */
+#define NUM_ELEMENTS (256 * 1024)
+
+/**
+ * Size of the filter in bytes (about 8 bits per element).
+ */
+#define SIZE (256 * 1024)
+
+/**
+ * Number of hash functions.
+ */
+#define K 8
+
+/**
+ * How often do we or one filter into another.
+ */
+#define OR_ROUNDS 1024
+
+/**
+ * Number of elements added to and removed from the file-backed filter.
+ */
+#define FILE_ELEMENTS (32 * 1024)
+
+/**
+ * File for the file-backed filter.
+ */
+#define TESTFILE "/tmp/perf-bloomfilter.dat"
+
+/**
+ * Elements we add, precomputed so that we only measure the filter.
+ */
+static struct GNUNET_HashCode *present;
+
+/**
+ * Elements we never add.
+ */
+static struct GNUNET_HashCode *absent;
+
+
+/**
+ * Report one measurement.
+ *
+ * @param op name of the operation
+ * @param ops number of operations performed
+ * @param start when the operations started
+ */
+static void
+report (const char *op,
+        unsigned int ops,
+        struct GNUNET_TIME_Absolute start)
+{
+  struct GNUNET_TIME_Relative duration;
+  char gauger_name[64];
+  double rate;
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = ops * 1.0 / (1 + duration.rel_value_us / 1000LL);
+  printf ("%-16s %s (%.0f ops/ms)\n",
+          op,
+          GNUNET_STRINGS_relative_time_to_string (duration,
+                                                  GNUNET_YES),
+          rate);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "Bloomfilter %s",
+                   op);
+  GAUGER ("UTIL", gauger_name, rate, "ops/ms");
+}
+
+
+/**
+ * Measure the in-memory operations.
+ */
+static void
+perfMemory ()
+{
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  struct GNUNET_CONTAINER_BloomFilter *bf2;
+  struct GNUNET_TIME_Absolute start;
+  char *raw;
+  int results[64];
+  unsigned int hits;
+  unsigned int i;
+
+  bf = GNUNET_CONTAINER_bloomfilter_init (NULL, SIZE, K);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ELEMENTS; i++)
+    GNUNET_CONTAINER_bloomfilter_add (bf, &present[i]);
+  report ("add", NUM_ELEMENTS, start);
+
+  hits = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ELEMENTS; i++)
+    if (GNUNET_YES == GNUNET_CONTAINER_bloomfilter_test (bf, &present[i]))
+      hits++;
+  report ("test positive", NUM_ELEMENTS, start);
+  GNUNET_assert (NUM_ELEMENTS == hits);
+
+  hits = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ELEMENTS; i++)
+    if (GNUNET_YES == GNUNET_CONTAINER_bloomfilter_test (bf, &absent[i]))
+      hits++;
+  report ("test negative", NUM_ELEMENTS, start);
+  printf ("false positives: %u/%u\n", hits, NUM_ELEMENTS);
+
+  hits = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ELEMENTS; i += 64)
+    hits += GNUNET_CONTAINER_bloomfilter_test_batch (bf,
+                                                     &absent[i],
+                                                     64,
+                                                     results);
+  report ("test batch", NUM_ELEMENTS, start);
+  printf ("false positives: %u/%u\n", hits, NUM_ELEMENTS);
+
+  raw = GNUNET_malloc (SIZE);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_get_raw_data (bf,
+                                                            raw,
+                                                            SIZE));
+  bf2 = GNUNET_CONTAINER_bloomfilter_init (NULL, SIZE, K);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < OR_ROUNDS; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_bloomfilter_or (bf2,
+                                                    raw,
+                                                    SIZE));
+  report ("or (per MB)", OR_ROUNDS * (SIZE / 1024) / 1024, start);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < OR_ROUNDS; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_bloomfilter_or2 (bf2,
+                                                     bf));
+  report ("or2 (per MB)", OR_ROUNDS * (SIZE / 1024) / 1024, start);
+  GNUNET_free (raw);
+  GNUNET_CONTAINER_bloomfilter_free (bf2);
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+}
+
+
+/**
+ * Measure add and remove on a filter backed by a file.
+ */
+static void
+perfFile ()
+{
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  struct GNUNET_TIME_Absolute start;
+  unsigned int i;
+
+  if (GNUNET_YES == GNUNET_DISK_file_test (TESTFILE))
+    GNUNET_break (0 == UNLINK (TESTFILE));
+  bf = GNUNET_CONTAINER_bloomfilter_load (TESTFILE, SIZE, K);
+  GNUNET_assert (NULL != bf);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < FILE_ELEMENTS; i++)
+    GNUNET_CONTAINER_bloomfilter_add (bf, &present[i]);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_flush (bf));
+  report ("file add", FILE_ELEMENTS, start);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < FILE_ELEMENTS; i++)
+    GNUNET_CONTAINER_bloomfilter_remove (bf, &present[i]);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_flush (bf));
+  report ("file remove", FILE_ELEMENTS, start);
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+  GNUNET_break (0 == UNLINK (TESTFILE));
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int i;
+  unsigned int j;
+
+  GNUNET_log_setup ("perf-bloomfilter",
+                    "WARNING",
+                    NULL);
+  present = GNUNET_malloc_large (NUM_ELEMENTS * sizeof (struct GNUNET_HashCode));
+  absent = GNUNET_malloc_large (NUM_ELEMENTS * sizeof (struct GNUNET_HashCode));
+  GNUNET_assert ( (NULL != present) &&
+                  (NULL != absent) );
+  for (i = 0; i < NUM_ELEMENTS; i++)
+  {
+    GNUNET_CRYPTO_hash (&i,
+                        sizeof (i),
+                        &present[i]);
+    j = i + NUM_ELEMENTS;
+    GNUNET_CRYPTO_hash (&j,
+                        sizeof (j),
+                        &absent[i]);
+  }
+  perfMemory ();
+  perfFile ();
+  GNUNET_free (present);
+  GNUNET_free (absent);
+  return 0;
+}
+
+/* end of perf_bloomfilter.c */
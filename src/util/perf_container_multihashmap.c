@@ -0,0 +1,181 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_container_multihashmap.c
+ * @brief compare the chained and the open-addressing layout of the
+ *        multihashmap for put, get and iterate with many entries
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * Number of entries we store.
+ */
+#define NUM_ENTRIES (1024 * 1024)
+
+/**
+ * Keys we store, precomputed so that we only measure the map.
+ */
+static struct GNUNET_HashCode *keys;
+
+/**
+ * Random permutation of the key indices; lookups use this order,
+ * so that they do not profit from the allocation order of entries.
+ */
+static unsigned int *order;
+
+
+/**
+ * Report one measurement.
+ *
+ * @param layout_name name of the layout
+ * @param op name of the operation
+ * @param ops number of operations performed
+ * @param start when the operations started
+ */
+static void
+report (const char *layout_name,
+        const char *op,
+        unsigned int ops,
+        struct GNUNET_TIME_Absolute start)
+{
+  struct GNUNET_TIME_Relative duration;
+  char gauger_name[64];
+  double rate;
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = ops * 1.0 / (1 + duration.rel_value_us / 1000LL);
+  printf ("%-16s %-8s %s (%.0f ops/ms)\n",
+          layout_name,
+          op,
+          GNUNET_STRINGS_relative_time_to_string (duration,
+                                                  GNUNET_YES),
+          rate);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "Multihashmap %s %s",
+                   layout_name,
+                   op);
+  GAUGER ("UTIL", gauger_name, rate, "ops/ms");
+}
+
+
+static int
+count_cb (void *cls,
+          const struct GNUNET_HashCode *key,
+          void *value)
+{
+  uintptr_t *sum = cls;
+
+  *sum += (uintptr_t) value;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Run the workloads of test_container_multihashmap.c with
+ * #NUM_ENTRIES distinct keys on one layout.
+ *
+ * @param layout layout to measure
+ * @param layout_name name of the layout
+ */
+static void
+perfMap (enum GNUNET_CONTAINER_MultiHashMapLayout layout,
+         const char *layout_name)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m;
+  struct GNUNET_CONTAINER_MultiHashMapIterator *iter;
+  struct GNUNET_TIME_Absolute start;
+  uintptr_t sum;
+  unsigned int i;
+
+  m = GNUNET_CONTAINER_multihashmap_create_with_layout (16,
+                                                        GNUNET_NO,
+                                                        layout);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ENTRIES; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (m,
+                                                      &keys[i],
+                                                      (void *) (uintptr_t) (i + 1),
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE));
+  report (layout_name, "put", NUM_ENTRIES, start);
+
+  sum = 0;
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ENTRIES; i++)
+    sum += (uintptr_t) GNUNET_CONTAINER_multihashmap_get (m,
+                                                         &keys[order[i]]);
+  report (layout_name, "get", NUM_ENTRIES, start);
+  GNUNET_assert ((uintptr_t) NUM_ENTRIES * (NUM_ENTRIES + 1) / 2 == sum);
+
+  sum = 0;
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_assert (NUM_ENTRIES ==
+                 GNUNET_CONTAINER_multihashmap_iterate (m,
+                                                        &count_cb,
+                                                        &sum));
+  iter = GNUNET_CONTAINER_multihashmap_iterator_create (m);
+  while (GNUNET_YES ==
+         GNUNET_CONTAINER_multihashmap_iterator_next (iter,
+                                                      NULL,
+                                                      NULL))
+    sum++;
+  GNUNET_CONTAINER_multihashmap_iterator_destroy (iter);
+  report (layout_name, "iterate", 2 * NUM_ENTRIES, start);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_ENTRIES; i++)
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (m,
+                                                         &keys[order[i]],
+                                                         (void *) (uintptr_t) (order[i] + 1)));
+  report (layout_name, "remove", NUM_ENTRIES, start);
+  GNUNET_CONTAINER_multihashmap_destroy (m);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int i;
+
+  GNUNET_log_setup ("perf-container-multihashmap",
+                    "WARNING",
+                    NULL);
+  keys = GNUNET_malloc_large (NUM_ENTRIES * sizeof (struct GNUNET_HashCode));
+  GNUNET_assert (NULL != keys);
+  for (i = 0; i < NUM_ENTRIES; i++)
+    GNUNET_CRYPTO_hash (&i,
+                        sizeof (i),
+                        &keys[i]);
+  order = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_WEAK,
+                                        NUM_ENTRIES);
+  perfMap (GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_CHAINED,
+           "chained");
+  perfMap (GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING,
+           "open addressing");
+  GNUNET_free (order);
+  GNUNET_free (keys);
+  return 0;
+}
+
+/* end of perf_container_multihashmap.c */
@@ -58,6 +58,55 @@ log_duration (const char *cryptosystem,
 }
 
 
+/**
+ * Pool verifying the batch.
+ */
+static struct GNUNET_CRYPTO_VerifyPool *pool;
+
+/**
+ * Signatures to verify as a batch.
+ */
+static struct GNUNET_CRYPTO_VerifyItem items[l];
+
+
+/**
+ * The batch was verified.
+ *
+ * @param cls NULL
+ * @param num_items number of signatures in the batch
+ * @param results verification results
+ */
+static void
+batch_done (void *cls,
+            unsigned int num_items,
+            const int *results)
+{
+  for (unsigned int i = 0; i < num_items; i++)
+    GNUNET_assert (GNUNET_OK == results[i]);
+  log_duration ("EdDSA", "verify batch");
+  GNUNET_CRYPTO_verify_pool_destroy (pool);
+  pool = NULL;
+}
+
+
+/**
+ * Verify the signatures in #items as one batch.
+ *
+ * @param cls NULL
+ */
+static void
+verify_batch (void *cls)
+{
+  pool = GNUNET_CRYPTO_verify_pool_create (0);
+  start = GNUNET_TIME_absolute_get();
+  GNUNET_CRYPTO_verify_batch_start (pool,
+                                    items,
+                                    l,
+                                    &batch_done,
+                                    NULL);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -107,6 +156,17 @@ main (int argc, char *argv[])
                                                &dspub[i]));
   log_duration ("EdDSA", "verify HashCode");
 
+  for (i = 0; i < l; i++)
+  {
+    items[i].type = GNUNET_CRYPTO_VERIFY_EDDSA;
+    items[i].purpose = 0;
+    items[i].validate = &sig[i].purp;
+    items[i].sig.eddsa = &sig[i].sig;
+    items[i].pub.eddsa = &dspub[i];
+  }
+  GNUNET_SCHEDULER_run (&verify_batch,
+                        NULL);
+
   start = GNUNET_TIME_absolute_get();
   for (i = 0; i < l; i++)
     ecdhe[i] = GNUNET_CRYPTO_ecdhe_key_create();
@@ -38,14 +38,15 @@
 #define CURVE "Ed25519"
 
 /**
- * Maximum value we benchmark dlog for.
+ * Maximum value we benchmark dlog for, can be changed
+ * on the command line.
  */
-#define MAX_FACT (1024 * 1024)
+static unsigned int max_fact = 1024 * 1024;
 
 /**
- * Maximum memory to use, sqrt(MAX_FACT) is a good choice.
+ * Maximum memory to use, sqrt(max_fact) is a good choice.
  */
-#define MAX_MEM 1024
+static unsigned int max_mem = 1024;
 
 /**
  * How many values do we test?
@@ -87,7 +88,7 @@ test_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
   {
     fprintf (stderr, ".");
     x = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-				  MAX_FACT);
+				  max_fact);
     if (0 == GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
 				       2))
     {
@@ -121,12 +122,44 @@ test_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
 }
 
 
+/**
+ * Do the DLOG benchmark for the given context.
+ *
+ * @param edc context for ECC operations
+ * @param what description of how @a edc was obtained
+ */
+static void
+bench_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
+            const char *what)
+{
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative delta;
+
+  start = GNUNET_TIME_absolute_get ();
+  /* first do a baseline run without the DLOG */
+  test_dlog (edc, GNUNET_NO);
+  delta = GNUNET_TIME_absolute_get_duration (start);
+  start = GNUNET_TIME_absolute_get ();
+  test_dlog (edc, GNUNET_YES);
+  delta = GNUNET_TIME_relative_subtract (GNUNET_TIME_absolute_get_duration (start),
+					 delta);
+  printf ("%u DLOG calculations (%s) took %s\n",
+	  TEST_ITER,
+          what,
+          GNUNET_STRINGS_relative_time_to_string (delta,
+						  GNUNET_YES));
+  GAUGER ("UTIL", "ECC DLOG operations",
+	  delta.rel_value_us / 1000LL / TEST_ITER,
+	  "ms/op");
+}
+
+
 int
 main (int argc, char *argv[])
 {
   struct GNUNET_CRYPTO_EccDlogContext *edc;
   struct GNUNET_TIME_Absolute start;
-  struct GNUNET_TIME_Relative delta;
+  char *fn;
 
   if (! gcry_check_version ("1.6.0"))
   {
@@ -141,32 +174,63 @@ main (int argc, char *argv[])
   GNUNET_log_setup ("perf-crypto-ecc-dlog", 
 		    "WARNING", 
 		    NULL);
+  if (argc > 1)
+    max_fact = strtoul (argv[1], NULL, 10);
+  if (argc > 2)
+    max_mem = strtoul (argv[2], NULL, 10);
+  if ( (0 == max_fact) ||
+       (0 == max_mem) )
+  {
+    FPRINTF (stderr,
+             "Usage: %s [MAX [MEM]]\n",
+             argv[0]);
+    return 1;
+  }
   start = GNUNET_TIME_absolute_get ();
-  edc = GNUNET_CRYPTO_ecc_dlog_prepare (MAX_FACT,
-					MAX_MEM);
-  printf ("DLOG precomputation 1M/1K took %s\n",
+  edc = GNUNET_CRYPTO_ecc_dlog_prepare (max_fact,
+					max_mem);
+  printf ("DLOG precomputation %u/%u took %s\n",
+          max_fact,
+          max_mem,
           GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
 						  GNUNET_YES));
   GAUGER ("UTIL", "ECC DLOG initialization",
 	  GNUNET_TIME_absolute_get_duration
 	  (start).rel_value_us / 1000LL, "ms/op");
+  bench_dlog (edc,
+              "computed table");
+  GNUNET_CRYPTO_ecc_dlog_release (edc);
+
+  /* now the same with a table file, first creating it and then
+     mapping it like a restarted service would */
+  fn = GNUNET_DISK_mktemp ("perf-crypto-ecc-dlog");
+  GNUNET_assert (NULL != fn);
+  GNUNET_break (0 == UNLINK (fn));
   start = GNUNET_TIME_absolute_get ();
-  /* first do a baseline run without the DLOG */
-  test_dlog (edc, GNUNET_NO);
-  delta = GNUNET_TIME_absolute_get_duration (start);
+  edc = GNUNET_CRYPTO_ecc_dlog_prepare_file (max_fact,
+                                             max_mem,
+                                             fn);
+  GNUNET_assert (NULL != edc);
+  printf ("DLOG precomputation with writing the table took %s\n",
+          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+						  GNUNET_YES));
+  GNUNET_CRYPTO_ecc_dlog_release (edc);
   start = GNUNET_TIME_absolute_get ();
-  test_dlog (edc, GNUNET_YES);
-  delta = GNUNET_TIME_relative_subtract (GNUNET_TIME_absolute_get_duration (start),
-					 delta);
-  printf ("%u DLOG calculations took %s\n",
-	  TEST_ITER,
-          GNUNET_STRINGS_relative_time_to_string (delta,
+  edc = GNUNET_CRYPTO_ecc_dlog_prepare_file (max_fact,
+                                             max_mem,
+                                             fn);
+  GNUNET_assert (NULL != edc);
+  printf ("DLOG startup from the table file took %s\n",
+          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
 						  GNUNET_YES));
-  GAUGER ("UTIL", "ECC DLOG operations",
-	  delta.rel_value_us / 1000LL / TEST_ITER, 
-	  "ms/op");
-
+  GAUGER ("UTIL", "ECC DLOG startup from file",
+	  GNUNET_TIME_absolute_get_duration
+	  (start).rel_value_us / 1000LL, "ms/op");
+  bench_dlog (edc,
+              "mapped table");
   GNUNET_CRYPTO_ecc_dlog_release (edc);
+  GNUNET_break (0 == UNLINK (fn));
+  GNUNET_free (fn);
   return 0;
 }
 
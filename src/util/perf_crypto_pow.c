@@ -0,0 +1,131 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_crypto_pow.c
+ * @brief measure how many proof-of-work candidates per second the
+ *        parallel search tests, depending on the number of threads
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * How long do we run each measurement?
+ */
+#define RUN_TIME GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 3)
+
+/**
+ * More bits than any hash can have, so the search never ends.
+ */
+#define IMPOSSIBLE_BITS (8 * sizeof (struct GNUNET_HashCode) + 1)
+
+/**
+ * Number of threads in the current measurement.
+ */
+static unsigned int num_threads;
+
+/**
+ * The search we are measuring.
+ */
+static struct GNUNET_CRYPTO_PowSearch *ps;
+
+/**
+ * Number of nonces tested in the current measurement.
+ */
+static uint64_t tested;
+
+
+static void
+found_cb (void *cls,
+          uint64_t proof)
+{
+  GNUNET_break (0);
+  ps = NULL;
+}
+
+
+static void
+stop_cb (void *cls)
+{
+  if (NULL != ps)
+    tested = GNUNET_CRYPTO_pow_search_stop (ps);
+  ps = NULL;
+}
+
+
+static void
+run (void *cls)
+{
+  struct GNUNET_CRYPTO_EddsaPublicKey pub;
+
+  memset (&pub, 42, sizeof (pub));
+  ps = GNUNET_CRYPTO_pow_search_start ("gnunet-proof-of-work",
+                                       &pub,
+                                       sizeof (pub),
+                                       0,
+                                       IMPOSSIBLE_BITS,
+                                       num_threads,
+                                       GNUNET_TIME_UNIT_ZERO,
+                                       NULL,
+                                       &found_cb,
+                                       NULL);
+  GNUNET_SCHEDULER_add_delayed (RUN_TIME,
+                                &stop_cb,
+                                NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+  unsigned int max_threads = 1;
+  char gauger_name[64];
+  double rate;
+
+  GNUNET_log_setup ("perf-crypto-pow",
+                    "WARNING",
+                    NULL);
+#ifdef _SC_NPROCESSORS_ONLN
+  if (0 < sysconf (_SC_NPROCESSORS_ONLN))
+    max_threads = (unsigned int) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  for (num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+  {
+    tested = 0;
+    start = GNUNET_TIME_absolute_get ();
+    GNUNET_SCHEDULER_run (&run,
+                          NULL);
+    duration = GNUNET_TIME_absolute_get_duration (start);
+    rate = tested * 1000.0 * 1000.0 / (1 + duration.rel_value_us);
+    printf ("%3u threads: %8.1f proofs tested/s\n",
+            num_threads,
+            rate);
+    GNUNET_snprintf (gauger_name,
+                     sizeof (gauger_name),
+                     "Proof-of-work search %u threads",
+                     num_threads);
+    GAUGER ("UTIL", gauger_name, rate, "proofs/s");
+  }
+  return 0;
+}
+
+/* end of perf_crypto_pow.c */
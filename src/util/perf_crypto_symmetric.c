@@ -55,6 +55,119 @@ perfEncrypt ()
 }
 
 
+/**
+ * How many bytes do we process per measurement?
+ */
+#define TOTAL_BYTES (64 * 1024 * 1024)
+
+/**
+ * How many blocks do we pass to one bulk call?
+ */
+#define BULK_SIZE 16
+
+
+/**
+ * Print and report the throughput of one measurement.
+ *
+ * @param what name of the measurement
+ * @param block_size size of the blocks that were encrypted
+ * @param start when the measurement started
+ */
+static void
+report (const char *what,
+        size_t block_size,
+        struct GNUNET_TIME_Absolute start)
+{
+  struct GNUNET_TIME_Relative duration;
+  unsigned long long mbps;
+  char gauger_name[128];
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  mbps = TOTAL_BYTES / (1 + duration.rel_value_us);
+  printf ("%-8s %2u KiB blocks: %llu MB/s\n",
+          what,
+          (unsigned int) (block_size / 1024),
+          mbps);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "Symmetric encryption %s %u KiB",
+                   what,
+                   (unsigned int) (block_size / 1024));
+  GAUGER ("UTIL", gauger_name, mbps, "MB/s");
+}
+
+
+/**
+ * Measure encryption throughput with the stateless API, a keyed
+ * context and the bulk API.
+ *
+ * @param block_size size of the blocks to encrypt
+ */
+static void
+perfBlocks (size_t block_size)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector ivs[BULK_SIZE];
+  struct GNUNET_CRYPTO_SymmetricContext *ctx;
+  struct GNUNET_TIME_Absolute start;
+  char *buf;
+  const void *blocks[BULK_SIZE];
+  size_t sizes[BULK_SIZE];
+  void *results[BULK_SIZE];
+  unsigned int rounds = TOTAL_BYTES / block_size;
+
+  GNUNET_CRYPTO_symmetric_create_session_key (&sk);
+  buf = GNUNET_malloc (block_size * BULK_SIZE);
+  memset (buf, 1, block_size * BULK_SIZE);
+  for (unsigned int i = 0; i < BULK_SIZE; i++)
+  {
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                &ivs[i],
+                                sizeof (ivs[i]));
+    blocks[i] = &buf[i * block_size];
+    results[i] = &buf[i * block_size];
+    sizes[i] = block_size;
+  }
+
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < rounds; i++)
+    GNUNET_CRYPTO_symmetric_encrypt (buf,
+                                     block_size,
+                                     &sk,
+                                     &ivs[i % BULK_SIZE],
+                                     buf);
+  report ("oneshot",
+          block_size,
+          start);
+
+  start = GNUNET_TIME_absolute_get ();
+  ctx = GNUNET_CRYPTO_symmetric_context_create (&sk);
+  for (unsigned int i = 0; i < rounds; i++)
+    GNUNET_CRYPTO_symmetric_context_encrypt (ctx,
+                                             buf,
+                                             block_size,
+                                             &ivs[i % BULK_SIZE],
+                                             buf);
+  report ("context",
+          block_size,
+          start);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < rounds; i += BULK_SIZE)
+    GNUNET_CRYPTO_symmetric_context_encrypt_bulk (ctx,
+                                                  BULK_SIZE,
+                                                  blocks,
+                                                  sizes,
+                                                  ivs,
+                                                  results);
+  report ("bulk",
+          block_size,
+          start);
+  GNUNET_CRYPTO_symmetric_context_destroy (ctx);
+  GNUNET_free (buf);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -69,6 +182,8 @@ main (int argc, char *argv[])
           64 * 1024 / (1 +
 		       GNUNET_TIME_absolute_get_duration
 		       (start).rel_value_us / 1000LL), "kb/ms");
+  perfBlocks (1024);
+  perfBlocks (32 * 1024);
   return 0;
 }
 
@@ -0,0 +1,347 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_mq_ipc.c
+ * @brief measure how many small messages per second the client and
+ *        service message queues move over a UNIX domain socket
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * Message type we use for the benchmark.
+ */
+#define MY_TYPE 1234
+
+/**
+ * How many messages do we send in each direction?
+ */
+#define NUM_MESSAGES 200000
+
+/**
+ * How many messages do we keep queued at most?
+ */
+#define WINDOW 1024
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 60)
+
+
+/**
+ * Small message we send around.
+ */
+struct SmallMessage
+{
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Sequence number, in NBO.
+   */
+  uint32_t seq GNUNET_PACKED;
+};
+
+
+/**
+ * State of one sending side.
+ */
+struct Sender
+{
+  /**
+   * Queue we transmit on.
+   */
+  struct GNUNET_MQ_Handle *mq;
+
+  /**
+   * Number of messages queued so far.
+   */
+  unsigned int queued;
+
+  /**
+   * Number of messages whose transmission completed.
+   */
+  unsigned int sent;
+};
+
+
+static int global_ret = 1;
+
+/**
+ * Client-side message queue.
+ */
+static struct GNUNET_MQ_Handle *client_mq;
+
+/**
+ * Client to service traffic.
+ */
+static struct Sender upstream;
+
+/**
+ * Service to client traffic.
+ */
+static struct Sender downstream;
+
+/**
+ * Messages received by the service.
+ */
+static unsigned int service_received;
+
+/**
+ * Messages received by the client.
+ */
+static unsigned int client_received;
+
+/**
+ * When did the current direction start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Timeout task.
+ */
+static struct GNUNET_SCHEDULER_Task *tt;
+
+
+/**
+ * Report the rate for one direction.
+ *
+ * @param direction human-readable direction name
+ */
+static void
+report (const char *direction)
+{
+  struct GNUNET_TIME_Relative duration;
+  unsigned long long rate;
+  char gauger_name[128];
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = NUM_MESSAGES * 1000LL * 1000LL / (1 + duration.rel_value_us);
+  printf ("%s: %u messages of %u bytes in %s, %llu msg/s\n",
+          direction,
+          NUM_MESSAGES,
+          (unsigned int) sizeof (struct SmallMessage),
+          GNUNET_STRINGS_relative_time_to_string (duration,
+                                                  GNUNET_YES),
+          rate);
+  GNUNET_snprintf (gauger_name,
+                   sizeof (gauger_name),
+                   "IPC %s",
+                   direction);
+  GAUGER ("UTIL", gauger_name, rate, "msg/s");
+}
+
+
+static void
+fill_window (struct Sender *s);
+
+
+/**
+ * A message of @a cls left the queue, top it up again.
+ *
+ * @param cls the `struct Sender`
+ */
+static void
+sent_cb (void *cls)
+{
+  struct Sender *s = cls;
+
+  s->sent++;
+  fill_window (s);
+}
+
+
+/**
+ * Queue messages on @a s until the window is full or we are done.
+ *
+ * @param s sender to fill up
+ */
+static void
+fill_window (struct Sender *s)
+{
+  struct GNUNET_MQ_Envelope *env;
+  struct SmallMessage *sm;
+
+  while ( (s->queued < NUM_MESSAGES) &&
+          (s->queued - s->sent < WINDOW) )
+  {
+    env = GNUNET_MQ_msg (sm,
+                         MY_TYPE);
+    sm->seq = htonl (s->queued++);
+    GNUNET_MQ_notify_sent (env,
+                           &sent_cb,
+                           s);
+    GNUNET_MQ_send (s->mq,
+                    env);
+  }
+}
+
+
+static void
+handle_service_small (void *cls,
+                      const struct SmallMessage *sm)
+{
+  struct GNUNET_SERVICE_Client *client = cls;
+
+  GNUNET_break (ntohl (sm->seq) == service_received);
+  service_received++;
+  GNUNET_SERVICE_client_continue (client);
+  if (NUM_MESSAGES != service_received)
+    return;
+  report ("client to service");
+  start = GNUNET_TIME_absolute_get ();
+  downstream.mq = GNUNET_SERVICE_client_get_mq (client);
+  fill_window (&downstream);
+}
+
+
+static void
+handle_client_small (void *cls,
+                     const struct SmallMessage *sm)
+{
+  GNUNET_break (ntohl (sm->seq) == client_received);
+  client_received++;
+  if (NUM_MESSAGES != client_received)
+    return;
+  report ("service to client");
+  global_ret = 0;
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+static void *
+connect_cb (void *cls,
+            struct GNUNET_SERVICE_Client *c,
+            struct GNUNET_MQ_Handle *mq)
+{
+  return c;
+}
+
+
+static void
+disconnect_cb (void *cls,
+               struct GNUNET_SERVICE_Client *c,
+               void *internal_cls)
+{
+  GNUNET_assert (c == internal_cls);
+}
+
+
+static void
+do_shutdown (void *cls)
+{
+  if (NULL != tt)
+  {
+    GNUNET_SCHEDULER_cancel (tt);
+    tt = NULL;
+  }
+  if (NULL != client_mq)
+  {
+    GNUNET_MQ_destroy (client_mq);
+    client_mq = NULL;
+  }
+}
+
+
+static void
+timeout_task (void *cls)
+{
+  tt = NULL;
+  FPRINTF (stderr,
+           "Timeout after %u/%u messages\n",
+           service_received,
+           client_received);
+  global_ret = 2;
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Initialization function of the service.  Connects a client
+ * and starts sending.
+ *
+ * @param cls the name of the service (const char *)
+ * @param cfg the configuration we use
+ * @param sh handle to the service
+ */
+static void
+service_init (void *cls,
+              const struct GNUNET_CONFIGURATION_Handle *cfg,
+              struct GNUNET_SERVICE_Handle *sh)
+{
+  const char *service_name = cls;
+  struct GNUNET_MQ_MessageHandler chandlers[] = {
+    GNUNET_MQ_hd_fixed_size (client_small,
+                             MY_TYPE,
+                             struct SmallMessage,
+                             NULL),
+    GNUNET_MQ_handler_end ()
+  };
+
+  tt = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                     &timeout_task,
+                                     NULL);
+  GNUNET_SCHEDULER_add_shutdown (&do_shutdown,
+                                 NULL);
+  client_mq = GNUNET_CLIENT_connect (cfg,
+                                     service_name,
+                                     chandlers,
+                                     NULL,
+                                     NULL);
+  GNUNET_assert (NULL != client_mq);
+  upstream.mq = client_mq;
+  start = GNUNET_TIME_absolute_get ();
+  fill_window (&upstream);
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  struct GNUNET_MQ_MessageHandler shandlers[] = {
+    GNUNET_MQ_hd_fixed_size (service_small,
+                             MY_TYPE,
+                             struct SmallMessage,
+                             NULL),
+    GNUNET_MQ_handler_end ()
+  };
+  char *const sargv[] = {
+    (char *) "test_client",
+    "-c",
+    "test_client_unix.conf",
+    NULL
+  };
+
+  GNUNET_log_setup ("perf-mq-ipc",
+                    "WARNING",
+                    NULL);
+  GNUNET_assert (0 ==
+                 GNUNET_SERVICE_run_ (3,
+                                      sargv,
+                                      "test_client",
+                                      GNUNET_SERVICE_OPTION_NONE,
+                                      &service_init,
+                                      &connect_cb,
+                                      &disconnect_cb,
+                                      "test_client",
+                                      shandlers));
+  return global_ret;
+}
+
+/* end of perf_mq_ipc.c */
@@ -0,0 +1,198 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_scheduler.c
+ * @brief measure how fast the scheduler adds, cancels and runs
+ *        large numbers of timeout tasks
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * Number of timers we use.
+ */
+#define NUM_TIMERS 100000
+
+/**
+ * Timers are spread over this many microseconds.
+ */
+#define SPREAD_US (60LL * 60LL * 1000LL * 1000LL)
+
+
+/**
+ * Our timers.
+ */
+static struct GNUNET_SCHEDULER_Task *timers[NUM_TIMERS];
+
+/**
+ * Number of timers that ran.
+ */
+static unsigned int fired;
+
+/**
+ * Number of timers we expect to run.
+ */
+static unsigned int expected;
+
+/**
+ * When did the current measurement start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+
+/**
+ * Report the duration of a measurement.
+ *
+ * @param what what was measured
+ * @param ops number of operations measured
+ */
+static void
+report (const char *what,
+        unsigned int ops)
+{
+  struct GNUNET_TIME_Relative duration;
+  double rate;
+
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  rate = ops * 1000000.0 / GNUNET_MAX (1, duration.rel_value_us);
+  printf ("%6s %6u timers: %10.0f ops/s\n",
+          what,
+          ops,
+          rate);
+  GAUGER ("UTIL",
+          what,
+          rate,
+          "ops/s");
+}
+
+
+/**
+ * Pick a random time relative to @a base.
+ *
+ * @param base start of the interval
+ * @return random time in [base, base + #SPREAD_US)
+ */
+static struct GNUNET_TIME_Absolute
+random_time (struct GNUNET_TIME_Absolute base)
+{
+  base.abs_value_us += GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                                 SPREAD_US);
+  return base;
+}
+
+
+/**
+ * A timer ran.
+ *
+ * @param cls NULL
+ */
+static void
+timer_cb (void *cls)
+{
+  struct GNUNET_SCHEDULER_Task **slot = cls;
+
+  *slot = NULL;
+  if (expected != ++fired)
+    return;
+  report ("fire",
+          expected);
+}
+
+
+/**
+ * Run the measurements.
+ *
+ * @param cls NULL
+ */
+static void
+run (void *cls)
+{
+  struct GNUNET_TIME_Absolute future;
+  struct GNUNET_TIME_Absolute past;
+  unsigned int *perm;
+
+  future = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS);
+  past.abs_value_us = GNUNET_TIME_absolute_get ().abs_value_us - 2 * SPREAD_US;
+  perm = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_WEAK,
+                                       NUM_TIMERS);
+
+  /* timers at random times in the future */
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < NUM_TIMERS; i++)
+    timers[i] = GNUNET_SCHEDULER_add_at (random_time (future),
+                                         &timer_cb,
+                                         &timers[i]);
+  report ("insert",
+          NUM_TIMERS);
+
+  /* cancel a random half */
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = 0; i < NUM_TIMERS / 2; i++)
+  {
+    GNUNET_SCHEDULER_cancel (timers[perm[i]]);
+    timers[perm[i]] = NULL;
+  }
+  report ("cancel",
+          NUM_TIMERS / 2);
+
+  /* reset the other half to a new time, as done for timeouts
+     that are extended on activity */
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int i = NUM_TIMERS / 2; i < NUM_TIMERS; i++)
+  {
+    GNUNET_SCHEDULER_cancel (timers[perm[i]]);
+    timers[perm[i]] = GNUNET_SCHEDULER_add_at (random_time (future),
+                                               &timer_cb,
+                                               &timers[perm[i]]);
+  }
+  report ("reset",
+          NUM_TIMERS / 2);
+  for (unsigned int i = NUM_TIMERS / 2; i < NUM_TIMERS; i++)
+  {
+    GNUNET_SCHEDULER_cancel (timers[perm[i]]);
+    timers[perm[i]] = NULL;
+  }
+  GNUNET_free (perm);
+
+  /* timers that expired at random times, so that all of them run
+     in the next iterations of the scheduler */
+  for (unsigned int i = 0; i < NUM_TIMERS; i++)
+    timers[i] = GNUNET_SCHEDULER_add_at (random_time (past),
+                                         &timer_cb,
+                                         &timers[i]);
+  expected = NUM_TIMERS;
+  start = GNUNET_TIME_absolute_get ();
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  GNUNET_log_setup ("perf-scheduler",
+                    "WARNING",
+                    NULL);
+  GNUNET_SCHEDULER_run (&run,
+                        NULL);
+  return (expected == fired) ? 0 : 1;
+}
+
+/* end of perf_scheduler.c */
@@ -0,0 +1,278 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/perf_scheduler_driver.c
+ * @brief compare the task dispatch rate of the select() and epoll()
+ *        scheduler drivers with many idle and some active descriptors
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include <gauger.h>
+
+/**
+ * How long do we run each measurement?
+ */
+#define RUN_TIME GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 2)
+
+/**
+ * Idle descriptors: read ends of a pipe nobody ever writes to.
+ */
+static struct GNUNET_DISK_FileHandle **idle_fh;
+
+/**
+ * Tasks waiting on @e idle_fh.
+ */
+static struct GNUNET_SCHEDULER_Task **idle_tasks;
+
+/**
+ * Active descriptors: write ends of a pipe nobody ever fills,
+ * so they are always ready.
+ */
+static struct GNUNET_DISK_FileHandle **active_fh;
+
+/**
+ * Tasks waiting on @e active_fh.
+ */
+static struct GNUNET_SCHEDULER_Task **active_tasks;
+
+/**
+ * Number of idle descriptors in this run.
+ */
+static unsigned int num_idle;
+
+/**
+ * Number of active descriptors in this run.
+ */
+static unsigned int num_active;
+
+/**
+ * Number of times an active task was run.
+ */
+static unsigned long long dispatched;
+
+/**
+ * When did the measurement start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * How long did the measurement take?
+ */
+static struct GNUNET_TIME_Relative duration;
+
+
+static void
+idle_cb (void *cls)
+{
+  (void) cls;
+  GNUNET_break (0);
+}
+
+
+static void
+active_cb (void *cls)
+{
+  unsigned int i = (unsigned int) (uintptr_t) cls;
+
+  dispatched++;
+  active_tasks[i]
+    = GNUNET_SCHEDULER_add_write_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                       active_fh[i],
+                                       &active_cb,
+                                       cls);
+}
+
+
+static void
+end_cb (void *cls)
+{
+  (void) cls;
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  for (unsigned int i = 0; i < num_idle; i++)
+    GNUNET_SCHEDULER_cancel (idle_tasks[i]);
+  for (unsigned int i = 0; i < num_active; i++)
+    GNUNET_SCHEDULER_cancel (active_tasks[i]);
+}
+
+
+static void
+run (void *cls)
+{
+  (void) cls;
+  for (unsigned int i = 0; i < num_idle; i++)
+    idle_tasks[i]
+      = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                        idle_fh[i],
+                                        &idle_cb,
+                                        NULL);
+  for (unsigned int i = 0; i < num_active; i++)
+    active_tasks[i]
+      = GNUNET_SCHEDULER_add_write_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                         active_fh[i],
+                                         &active_cb,
+                                         (void *) (uintptr_t) i);
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_SCHEDULER_add_delayed (RUN_TIME,
+                                &end_cb,
+                                NULL);
+}
+
+
+/**
+ * Measure the dispatch rate of one driver.
+ *
+ * @param name name of the driver (for reporting)
+ * @param driver driver to measure
+ * @param idle number of idle descriptors
+ * @param active number of active descriptors
+ * @return 0 on success
+ */
+static int
+measure (const char *name,
+         struct GNUNET_SCHEDULER_Driver *driver,
+         unsigned int idle,
+         unsigned int active)
+{
+  struct GNUNET_DISK_PipeHandle *p;
+  const struct GNUNET_DISK_FileHandle *pr;
+  const struct GNUNET_DISK_FileHandle *pw;
+  char gauger_name[128];
+  unsigned long long rate;
+  int ret;
+
+  if (NULL == driver)
+  {
+    fprintf (stderr,
+             "%s driver not available, skipping\n",
+             name);
+    return 0;
+  }
+  p = GNUNET_DISK_pipe (GNUNET_NO, GNUNET_NO, GNUNET_NO, GNUNET_NO);
+  GNUNET_assert (NULL != p);
+  pr = GNUNET_DISK_pipe_handle (p, GNUNET_DISK_PIPE_END_READ);
+  pw = GNUNET_DISK_pipe_handle (p, GNUNET_DISK_PIPE_END_WRITE);
+  num_idle = idle;
+  num_active = active;
+  idle_fh = GNUNET_new_array (idle, struct GNUNET_DISK_FileHandle *);
+  idle_tasks = GNUNET_new_array (idle, struct GNUNET_SCHEDULER_Task *);
+  active_fh = GNUNET_new_array (active, struct GNUNET_DISK_FileHandle *);
+  active_tasks = GNUNET_new_array (active, struct GNUNET_SCHEDULER_Task *);
+  ret = 0;
+  /* distinct descriptors for the same pipe, so that each costs the
+     driver as much as a separate connection would */
+  for (unsigned int i = 0; i < idle; i++)
+    if (NULL == (idle_fh[i] = GNUNET_DISK_get_handle_from_int_fd (dup (pr->fd))))
+      ret = 1;
+  for (unsigned int i = 0; i < active; i++)
+    if (NULL == (active_fh[i] = GNUNET_DISK_get_handle_from_int_fd (dup (pw->fd))))
+      ret = 1;
+  if (0 == ret)
+  {
+    dispatched = 0;
+    GNUNET_SCHEDULER_run_with_driver (driver,
+                                      GNUNET_NO,
+                                      &run,
+                                      NULL);
+    rate = dispatched * 1000LL * 1000LL / (1 + duration.rel_value_us);
+    printf ("%6s driver, %5u idle, %4u active: %llu tasks/s\n",
+            name,
+            idle,
+            active,
+            rate);
+    GNUNET_snprintf (gauger_name,
+                     sizeof (gauger_name),
+                     "Scheduler %s %u idle %u active",
+                     name,
+                     idle,
+                     active);
+    GAUGER ("UTIL", gauger_name, rate, "tasks/s");
+  }
+  else
+  {
+    fprintf (stderr,
+             "Failed to create %u descriptors: %s\n",
+             idle + active,
+             STRERROR (errno));
+  }
+  for (unsigned int i = 0; i < idle; i++)
+    if (NULL != idle_fh[i])
+      GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (idle_fh[i]));
+  for (unsigned int i = 0; i < active; i++)
+    if (NULL != active_fh[i])
+      GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (active_fh[i]));
+  GNUNET_free (idle_fh);
+  GNUNET_free (idle_tasks);
+  GNUNET_free (active_fh);
+  GNUNET_free (active_tasks);
+  GNUNET_DISK_pipe_close (p);
+  GNUNET_free (driver);
+  return ret;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int idle = 10000;
+  unsigned int active = 1000;
+  int ret;
+
+  GNUNET_log_setup ("perf-scheduler-driver",
+                    "WARNING",
+                    NULL);
+#if HAVE_SETRLIMIT
+  {
+    struct rlimit rl;
+
+    if (0 == getrlimit (RLIMIT_NOFILE, &rl))
+    {
+      rl.rlim_cur = rl.rlim_max;
+      (void) setrlimit (RLIMIT_NOFILE, &rl);
+      if (rl.rlim_cur < idle + active + 64)
+      {
+        idle = rl.rlim_cur * 10 / 11 - 64;
+        active = idle / 10;
+      }
+    }
+  }
+#endif
+  ret = 0;
+  /* select() is limited to FD_SETSIZE descriptors, so we can only
+     compare the two drivers on small sets */
+  ret |= measure ("select",
+                  GNUNET_SCHEDULER_driver_select (),
+                  FD_SETSIZE / 2,
+                  FD_SETSIZE / 8);
+  ret |= measure ("epoll",
+                  GNUNET_SCHEDULER_driver_epoll (),
+                  FD_SETSIZE / 2,
+                  FD_SETSIZE / 8);
+  ret |= measure ("epoll",
+                  GNUNET_SCHEDULER_driver_epoll (),
+                  idle,
+                  FD_SETSIZE / 8);
+  ret |= measure ("epoll",
+                  GNUNET_SCHEDULER_driver_epoll (),
+                  idle,
+                  active);
+  return ret;
+}
+
+/* end of perf_scheduler_driver.c */
@@ -25,6 +25,9 @@
 #include "platform.h"
 #include "gnunet_util_lib.h"
 #include "disk.h"
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util-scheduler", __VA_ARGS__)
 
@@ -68,6 +71,25 @@
  */
 #define DELAY_THRESHOLD GNUNET_TIME_UNIT_SECONDS
 
+/**
+ * Maximum number of events the epoll driver fetches from the
+ * kernel per call to epoll_wait().  Remaining events are simply
+ * returned by the next call.
+ */
+#define MAX_EPOLL_EVENTS 256
+
+/**
+ * Number of children of each node in the heap of tasks waiting
+ * only for a timeout.  A 4-ary heap is shallower than a binary one
+ * and keeps the children of a node in one cache line.
+ */
+#define TIMEOUT_HEAP_ARITY 4
+
+/**
+ * How many destroyed tasks do we keep around for reuse?
+ */
+#define MAX_FREE_TASKS 1024
+
 
 /**
  * Argument to be passed from the driver to
@@ -159,6 +181,18 @@ struct GNUNET_SCHEDULER_Task
    */
   struct GNUNET_TIME_Absolute timeout;
 
+  /**
+   * Order in which tasks waiting only for a timeout were added,
+   * so that tasks with the same timeout run in that order.
+   */
+  uint64_t timeout_seq;
+
+  /**
+   * Position of the task in #timeout_heap, only valid while the
+   * task is waiting only for a timeout.
+   */
+  unsigned int heap_pos;
+
 #if PROFILE_DELAYS
   /**
    * When was the task scheduled?
@@ -273,6 +307,93 @@ struct DriverContext
 };
 
 
+#if HAVE_SYS_EPOLL_H
+/**
+ * State of the epoll driver for one native file descriptor.  All
+ * tasks waiting on the same descriptor share a single registration
+ * with the kernel, which covers the union of their event types.
+ */
+struct EpollSlot
+{
+  /**
+   * This is a DLL (only used for descriptors that cannot be polled).
+   */
+  struct EpollSlot *prev;
+
+  /**
+   * This is a DLL (only used for descriptors that cannot be polled).
+   */
+  struct EpollSlot *next;
+
+  /**
+   * Head of the DLL of events waiting on this descriptor.
+   */
+  struct Scheduled *scheduled_head;
+
+  /**
+   * Tail of the DLL of events waiting on this descriptor.
+   */
+  struct Scheduled *scheduled_tail;
+
+  /**
+   * Events currently registered with the kernel (`EPOLLIN` and/or
+   * `EPOLLOUT`), 0 if the descriptor is not registered.
+   */
+  uint32_t events;
+
+  /**
+   * #GNUNET_YES if epoll refused the descriptor (i.e. it is a regular
+   * file).  Like select(), we then consider it to be always ready.
+   */
+  int unpollable;
+};
+
+
+/**
+ * Driver context used by the epoll driver.
+ */
+struct EpollContext
+{
+  /**
+   * Slots indexed by native file descriptor, NULL for descriptors
+   * nobody is waiting on.
+   */
+  struct EpollSlot **slots;
+
+  /**
+   * Head of DLL of slots with descriptors that cannot be polled.
+   */
+  struct EpollSlot *unpollable_head;
+
+  /**
+   * Tail of DLL of slots with descriptors that cannot be polled.
+   */
+  struct EpollSlot *unpollable_tail;
+
+  /**
+   * The time until the epoll driver will wake up again (after
+   * calling epoll_wait()).
+   */
+  struct GNUNET_TIME_Relative timeout;
+
+  /**
+   * Length of the @e slots array.
+   */
+  unsigned int slots_len;
+
+  /**
+   * Total number of events the driver is waiting for.
+   */
+  unsigned int num_scheduled;
+
+  /**
+   * The epoll file descriptor, -1 if not open.
+   */
+  int epfd;
+};
+#endif
+
+
 /**
  * The driver used for the event loop. Will be handed over to
  * the scheduler in #GNUNET_SCHEDULER_run_from_driver(), peristed
@@ -303,28 +424,43 @@ static struct GNUNET_SCHEDULER_Task *shutdown_head;
 static struct GNUNET_SCHEDULER_Task *shutdown_tail;
 
 /**
- * List of tasks waiting ONLY for a timeout event.
- * Sorted by timeout (earliest first).  Used so that
- * we do not traverse the list of these tasks when
- * building select sets (we just look at the head
- * to determine the respective timeout ONCE).
+ * Tasks waiting ONLY for a timeout event, as a #TIMEOUT_HEAP_ARITY-ary
+ * min-heap ordered by timeout (earliest first, ties in the order the
+ * tasks were added).  Used so that we do not traverse these tasks
+ * when building select sets (we just look at the root to determine
+ * the respective timeout ONCE).
+ */
+static struct GNUNET_SCHEDULER_Task **timeout_heap;
+
+/**
+ * Number of tasks in #timeout_heap.
+ */
+static unsigned int timeout_heap_len;
+
+/**
+ * Allocated length of #timeout_heap.
+ */
+static unsigned int timeout_heap_size;
+
+/**
+ * Number of tasks in #timeout_heap that have lifeness.
+ */
+static unsigned int timeout_heap_lifeness;
+
+/**
+ * Sequence number for the next task added to #timeout_heap.
  */
-static struct GNUNET_SCHEDULER_Task *pending_timeout_head;
+static uint64_t timeout_seq;
 
 /**
- * List of tasks waiting ONLY for a timeout event.
- * Sorted by timeout (earliest first).  Used so that
- * we do not traverse the list of these tasks when
- * building select sets (we just look at the head
- * to determine the respective timeout ONCE).
+ * Destroyed tasks kept for reuse, linked via their `next` field.
  */
-static struct GNUNET_SCHEDULER_Task *pending_timeout_tail;
+static struct GNUNET_SCHEDULER_Task *free_tasks;
 
 /**
- * Last inserted task waiting ONLY for a timeout event.
- * Used to (heuristically) speed up insertion.
+ * Number of tasks in #free_tasks.
  */
-static struct GNUNET_SCHEDULER_Task *pending_timeout_last;
+static unsigned int free_tasks_len;
 
 /**
  * ID of the task that is running right now.
@@ -434,7 +570,7 @@ get_timeout ()
   struct GNUNET_TIME_Absolute now;
   struct GNUNET_TIME_Absolute timeout;
 
-  pos = pending_timeout_head;
+  pos = (0 == timeout_heap_len) ? NULL : timeout_heap[0];
   now = GNUNET_TIME_absolute_get ();
   timeout = GNUNET_TIME_UNIT_FOREVER_ABS;
   if (NULL != pos)
@@ -525,6 +661,177 @@ dump_backtrace (struct GNUNET_SCHEDULER_Task *t)
 }
 
 
+/**
+ * Allocate a task, reusing a destroyed one if possible.
+ *
+ * @return zero-initialized task
+ */
+static struct GNUNET_SCHEDULER_Task *
+new_task ()
+{
+  struct GNUNET_SCHEDULER_Task *t;
+
+  t = free_tasks;
+  if (NULL == t)
+    return GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  free_tasks = t->next;
+  free_tasks_len--;
+  memset (t,
+          0,
+          sizeof (*t));
+  return t;
+}
+
+
+/**
+ * Check if task @a a must run before task @a b.
+ *
+ * @param a first task
+ * @param b second task
+ * @return #GNUNET_YES if @a a times out first
+ */
+static int
+timeout_before (const struct GNUNET_SCHEDULER_Task *a,
+                const struct GNUNET_SCHEDULER_Task *b)
+{
+  if (a->timeout.abs_value_us != b->timeout.abs_value_us)
+    return (a->timeout.abs_value_us < b->timeout.abs_value_us)
+      ? GNUNET_YES
+      : GNUNET_NO;
+  return (a->timeout_seq < b->timeout_seq) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Store task @a t at position @a pos of #timeout_heap.
+ *
+ * @param pos position to use
+ * @param t task to store
+ */
+static void
+timeout_heap_set (unsigned int pos,
+                  struct GNUNET_SCHEDULER_Task *t)
+{
+  timeout_heap[pos] = t;
+  t->heap_pos = pos;
+}
+
+
+/**
+ * Move the task at @a pos of #timeout_heap towards the root
+ * until its parent times out before it.
+ *
+ * @param pos position of the task
+ */
+static void
+timeout_heap_sift_up (unsigned int pos)
+{
+  struct GNUNET_SCHEDULER_Task *t = timeout_heap[pos];
+  unsigned int parent;
+
+  while (0 < pos)
+  {
+    parent = (pos - 1) / TIMEOUT_HEAP_ARITY;
+    if (GNUNET_YES != timeout_before (t,
+                                      timeout_heap[parent]))
+      break;
+    timeout_heap_set (pos,
+                      timeout_heap[parent]);
+    pos = parent;
+  }
+  timeout_heap_set (pos,
+                    t);
+}
+
+
+/**
+ * Move the task at @a pos of #timeout_heap towards the leaves
+ * until it times out before all of its children.
+ *
+ * @param pos position of the task
+ */
+static void
+timeout_heap_sift_down (unsigned int pos)
+{
+  struct GNUNET_SCHEDULER_Task *t = timeout_heap[pos];
+  unsigned int child;
+  unsigned int min;
+
+  while (1)
+  {
+    child = pos * TIMEOUT_HEAP_ARITY + 1;
+    if (child >= timeout_heap_len)
+      break;
+    min = child;
+    for (unsigned int i = child + 1;
+         (i < child + TIMEOUT_HEAP_ARITY) && (i < timeout_heap_len);
+         i++)
+      if (GNUNET_YES == timeout_before (timeout_heap[i],
+                                        timeout_heap[min]))
+        min = i;
+    if (GNUNET_YES != timeout_before (timeout_heap[min],
+                                      t))
+      break;
+    timeout_heap_set (pos,
+                      timeout_heap[min]);
+    pos = min;
+  }
+  timeout_heap_set (pos,
+                    t);
+}
+
+
+/**
+ * Add a task that waits only for a timeout to #timeout_heap.
+ *
+ * @param t task to add
+ */
+static void
+timeout_heap_insert (struct GNUNET_SCHEDULER_Task *t)
+{
+  if (timeout_heap_len == timeout_heap_size)
+    GNUNET_array_grow (timeout_heap,
+                       timeout_heap_size,
+                       GNUNET_MAX (64,
+                                   2 * timeout_heap_size));
+  t->timeout_seq = timeout_seq++;
+  timeout_heap_set (timeout_heap_len++,
+                    t);
+  timeout_heap_sift_up (t->heap_pos);
+  if (GNUNET_YES == t->lifeness)
+    timeout_heap_lifeness++;
+}
+
+
+/**
+ * Remove a task from #timeout_heap.
+ *
+ * @param t task to remove
+ */
+static void
+timeout_heap_remove (struct GNUNET_SCHEDULER_Task *t)
+{
+  unsigned int pos = t->heap_pos;
+  struct GNUNET_SCHEDULER_Task *last;
+
+  GNUNET_assert (timeout_heap[pos] == t);
+  if (GNUNET_YES == t->lifeness)
+    timeout_heap_lifeness--;
+  last = timeout_heap[--timeout_heap_len];
+  if (last == t)
+    return;
+  /* fill the hole with the last task and restore the heap order */
+  timeout_heap_set (pos,
+                    last);
+  if ( (0 < pos) &&
+       (GNUNET_YES == timeout_before (last,
+                                      timeout_heap[(pos - 1) / TIMEOUT_HEAP_ARITY])) )
+    timeout_heap_sift_up (pos);
+  else
+    timeout_heap_sift_down (pos);
+}
+
+
 /**
  * Destroy a task (release associated resources)
  *
@@ -568,7 +875,14 @@ destroy_task (struct GNUNET_SCHEDULER_Task *t)
 #if EXECINFO
   GNUNET_free (t->backtrace_strings);
 #endif
-  GNUNET_free (t);
+  if (free_tasks_len >= MAX_FREE_TASKS)
+  {
+    GNUNET_free (t);
+    return;
+  }
+  t->next = free_tasks;
+  free_tasks = t;
+  free_tasks_len++;
 }
 
 
@@ -645,9 +959,8 @@ shutdown_if_no_lifeness ()
   for (t = shutdown_head; NULL != t; t = t->next)
     if (GNUNET_YES == t->lifeness)
       return;
-  for (t = pending_timeout_head; NULL != t; t = t->next)
-    if (GNUNET_YES == t->lifeness)
-      return;
+  if (0 < timeout_heap_lifeness)
+    return;
   /* No lifeness! Cancel all pending tasks the driver knows about and shutdown */
   t = pending_head;
   while (NULL != t)
@@ -699,15 +1012,17 @@ GNUNET_SCHEDULER_run_with_optional_signals (int install_signals,
                                             void *task_cls)
 {
   struct GNUNET_SCHEDULER_Driver *driver;
-  struct DriverContext context = {.scheduled_head = NULL,
-                                  .scheduled_tail = NULL,
-                                  .timeout = GNUNET_TIME_UNIT_FOREVER_REL};
-  
-  driver = GNUNET_SCHEDULER_driver_select ();
-  driver->cls = &context;
 
+  driver = NULL;
+#if HAVE_SYS_EPOLL_H
+  /* a custom select() function only makes sense with the select driver */
+  if (NULL == scheduler_select)
+    driver = GNUNET_SCHEDULER_driver_epoll ();
+#endif
+  if (NULL == driver)
+    driver = GNUNET_SCHEDULER_driver_select ();
+  GNUNET_assert (NULL != driver);
   GNUNET_SCHEDULER_run_with_driver (driver, install_signals, task, task_cls);
-  
   GNUNET_free (driver);
 }
 
@@ -960,11 +1275,7 @@ GNUNET_SCHEDULER_cancel (struct GNUNET_SCHEDULER_Task *task)
     }
     else
     {
-      GNUNET_CONTAINER_DLL_remove (pending_timeout_head,
-                                   pending_timeout_tail,
-                                   task);
-      if (pending_timeout_last == task)
-        pending_timeout_last = NULL;
+      timeout_heap_remove (task);
     }
   }
   else
@@ -1025,7 +1336,7 @@ GNUNET_SCHEDULER_add_with_reason_and_priority (GNUNET_SCHEDULER_TaskCallback tas
   GNUNET_assert (NULL != task);
   GNUNET_assert ((NULL != active_task) ||
                  (GNUNET_SCHEDULER_REASON_STARTUP == reason));
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = new_task ();
   t->read_fd = -1;
   t->write_fd = -1;
   t->callback = task;
@@ -1062,12 +1373,10 @@ GNUNET_SCHEDULER_add_at_with_priority (struct GNUNET_TIME_Absolute at,
                                        void *task_cls)
 {
   struct GNUNET_SCHEDULER_Task *t;
-  struct GNUNET_SCHEDULER_Task *pos;
-  struct GNUNET_SCHEDULER_Task *prev;
 
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = new_task ();
   t->callback = task;
   t->callback_cls = task_cls;
   t->read_fd = -1;
@@ -1078,41 +1387,7 @@ GNUNET_SCHEDULER_add_at_with_priority (struct GNUNET_TIME_Absolute at,
   t->timeout = at;
   t->priority = priority;
   t->lifeness = current_lifeness;
-  /* try tail first (optimization in case we are
-   * appending to a long list of tasks with timeouts) */
-  if ( (NULL == pending_timeout_head) ||
-       (at.abs_value_us < pending_timeout_head->timeout.abs_value_us) )
-  {
-    GNUNET_CONTAINER_DLL_insert (pending_timeout_head,
-                                 pending_timeout_tail,
-                                 t);
-  }
-  else
-  {
-    /* first move from heuristic start backwards to before start time */
-    prev = pending_timeout_last;
-    while ( (NULL != prev) &&
-            (prev->timeout.abs_value_us > t->timeout.abs_value_us) )
-      prev = prev->prev;
-    /* now, move from heuristic start (or head of list) forward to insertion point */
-    if (NULL == prev)
-      pos = pending_timeout_head;
-    else
-      pos = prev->next;
-    while ( (NULL != pos) &&
-            ( (pos->timeout.abs_value_us <= t->timeout.abs_value_us) ||
-              (0 != pos->reason) ) )
-    {
-      prev = pos;
-      pos = pos->next;
-    }
-    GNUNET_CONTAINER_DLL_insert_after (pending_timeout_head,
-                                       pending_timeout_tail,
-                                       prev,
-                                       t);
-  }
-  /* finally, update heuristic insertion point to last insertion... */
-  pending_timeout_last = t;
+  timeout_heap_insert (t);
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Adding task %p\n",
@@ -1256,7 +1531,7 @@ GNUNET_SCHEDULER_add_shutdown (GNUNET_SCHEDULER_TaskCallback task,
 
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = new_task ();
   t->callback = task;
   t->callback_cls = task_cls;
   t->read_fd = -1;
@@ -1299,9 +1574,14 @@ GNUNET_SCHEDULER_add_now_with_lifeness (int lifeness,
                                         void *task_cls)
 {
   struct GNUNET_SCHEDULER_Task *ret;
+  int old_lifeness;
 
+  /* the timeout heap counts tasks with lifeness, so the task
+     must have the right lifeness when it is added */
+  old_lifeness = current_lifeness;
+  current_lifeness = lifeness;
   ret = GNUNET_SCHEDULER_add_now (task, task_cls);
-  ret->lifeness = lifeness;
+  current_lifeness = old_lifeness;
   return ret;
 }
 
@@ -1373,7 +1653,7 @@ add_without_sets (struct GNUNET_TIME_Relative delay,
 
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = new_task ();
   init_fd_info (t,
                 &read_nh,
                 read_nh ? 1 : 0,
@@ -1821,7 +2101,7 @@ GNUNET_SCHEDULER_add_select (enum GNUNET_SCHEDULER_Priority prio,
                                                        prio,
                                                        task,
                                                        task_cls);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = new_task ();
   init_fd_info (t,
                 read_nhandles,
                 read_nhandles_len,
@@ -1929,17 +2209,14 @@ GNUNET_SCHEDULER_run_from_driver (struct GNUNET_SCHEDULER_Handle *sh)
 
   /* check for tasks that reached the timeout! */
   now = GNUNET_TIME_absolute_get ();
-  while (NULL != (pos = pending_timeout_head))
+  while (0 < timeout_heap_len)
   {
+    pos = timeout_heap[0];
     if (now.abs_value_us >= pos->timeout.abs_value_us)
       pos->reason |= GNUNET_SCHEDULER_REASON_TIMEOUT;
     if (0 == pos->reason)
       break;
-    GNUNET_CONTAINER_DLL_remove (pending_timeout_head,
-                                 pending_timeout_tail,
-                                 pos);
-    if (pending_timeout_last == pos)
-      pending_timeout_last = NULL;
+    timeout_heap_remove (pos);
     queue_ready_task (pos);
   }
   pos = pending_head;
@@ -2008,6 +2285,10 @@ GNUNET_SCHEDULER_run_from_driver (struct GNUNET_SCHEDULER_Handle *sh)
     for (unsigned int i = 0; i != pos->fds_len; ++i)
     {
       struct GNUNET_SCHEDULER_FdInfo *fdi = &pos->fds[i];
+      /* descriptors beyond FD_SETSIZE (only possible with drivers
+         other than select) are only reported via `tc.fds` */
+      if (fdi->sock >= FD_SETSIZE)
+        continue;
       if (0 != (GNUNET_SCHEDULER_ET_IN & fdi->et))
       {
         GNUNET_NETWORK_fdset_set_native (sh->rs,
@@ -2088,6 +2369,7 @@ GNUNET_SCHEDULER_run_with_driver (const struct GNUNET_SCHEDULER_Driver *driver,
   struct GNUNET_SIGNAL_Context *shc_pipe;
 #endif
   struct GNUNET_SCHEDULER_Task tsk;
+  struct GNUNET_SCHEDULER_Task *t;
   const struct GNUNET_DISK_FileHandle *pr;
 
   /* general set-up */
@@ -2174,6 +2456,16 @@ GNUNET_SCHEDULER_run_with_driver (const struct GNUNET_SCHEDULER_Driver *driver,
   GNUNET_DISK_pipe_close (shutdown_pipe_handle);
   shutdown_pipe_handle = NULL;
   scheduler_driver = NULL;
+  while (NULL != (t = free_tasks))
+  {
+    free_tasks = t->next;
+    GNUNET_free (t);
+  }
+  free_tasks_len = 0;
+  if (0 == timeout_heap_len)
+    GNUNET_array_grow (timeout_heap,
+                       timeout_heap_size,
+                       0);
   return ret;
 }
 
@@ -2374,8 +2666,15 @@ struct GNUNET_SCHEDULER_Driver *
 GNUNET_SCHEDULER_driver_select ()
 {
   struct GNUNET_SCHEDULER_Driver *select_driver;
-  select_driver = GNUNET_new (struct GNUNET_SCHEDULER_Driver);
+  struct DriverContext *context;
 
+  /* the context is allocated together with the driver, so
+     the caller only needs to free the driver */
+  select_driver = GNUNET_malloc (sizeof (struct GNUNET_SCHEDULER_Driver) +
+                                 sizeof (struct DriverContext));
+  context = (struct DriverContext *) &select_driver[1];
+  context->timeout = GNUNET_TIME_UNIT_FOREVER_REL;
+  select_driver->cls = context;
   select_driver->loop = &select_loop;
   select_driver->add = &select_add;
   select_driver->del = &select_del;
@@ -2385,4 +2684,384 @@ GNUNET_SCHEDULER_driver_select ()
 }
 
 
+#if HAVE_SYS_EPOLL_H
+/**
+ * Make sure the epoll file descriptor of @a context is open.
+ *
+ * @param context the epoll driver context
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on failure
+ */
+static int
+epoll_open (struct EpollContext *context)
+{
+  if (-1 != context->epfd)
+    return GNUNET_OK;
+  context->epfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (-1 == context->epfd)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_ERROR,
+                  "epoll_create1");
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Synchronize the kernel registration of descriptor @a sock with the
+ * events the tasks in its @a slot are waiting for.  Releases the
+ * slot if nobody is waiting on @a sock anymore.
+ *
+ * @param context the epoll driver context
+ * @param sock native descriptor
+ * @param slot slot of @a sock
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the kernel
+ *         refused the descriptor
+ */
+static int
+epoll_update_slot (struct EpollContext *context,
+                   int sock,
+                   struct EpollSlot *slot)
+{
+  struct epoll_event ev;
+  struct Scheduled *pos;
+  uint32_t events;
+  int op;
+
+  events = 0;
+  for (pos = slot->scheduled_head; NULL != pos; pos = pos->next)
+  {
+    if (0 != (GNUNET_SCHEDULER_ET_IN & pos->et))
+      events |= EPOLLIN;
+    if (0 != (GNUNET_SCHEDULER_ET_OUT & pos->et))
+      events |= EPOLLOUT;
+  }
+  if ( (events != slot->events) &&
+       (GNUNET_NO == slot->unpollable) )
+  {
+    if (0 == events)
+    {
+      /* the descriptor may have been closed already, in which
+         case the kernel has dropped the registration by itself */
+      if ( (0 != epoll_ctl (context->epfd,
+                            EPOLL_CTL_DEL,
+                            sock,
+                            NULL)) &&
+           (ENOENT != errno) &&
+           (EBADF != errno) )
+        LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING,
+                      "epoll_ctl");
+    }
+    else
+    {
+      memset (&ev,
+              0,
+              sizeof (ev));
+      ev.events = events;
+      ev.data.fd = sock;
+      op = (0 == slot->events) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+      if (0 != epoll_ctl (context->epfd,
+                          op,
+                          sock,
+                          &ev))
+      {
+        /* our view of the registration can be stale if the
+           descriptor was closed and re-used in the meantime */
+        if ( (EPOLL_CTL_ADD == op) &&
+             (EEXIST == errno) )
+          op = EPOLL_CTL_MOD;
+        else if ( (EPOLL_CTL_MOD == op) &&
+                  (ENOENT == errno) )
+          op = EPOLL_CTL_ADD;
+        else
+          op = -1;
+        if ( (-1 != op) &&
+             (0 == epoll_ctl (context->epfd,
+                              op,
+                              sock,
+                              &ev)) )
+        {
+          /* recovered */
+        }
+        else if (EPERM == errno)
+        {
+          slot->unpollable = GNUNET_YES;
+          GNUNET_CONTAINER_DLL_insert (context->unpollable_head,
+                                       context->unpollable_tail,
+                                       slot);
+        }
+        else
+        {
+          LOG_STRERROR (GNUNET_ERROR_TYPE_ERROR,
+                        "epoll_ctl");
+          return GNUNET_SYSERR;
+        }
+      }
+    }
+    slot->events = events;
+  }
+  if (NULL == slot->scheduled_head)
+  {
+    if (GNUNET_YES == slot->unpollable)
+      GNUNET_CONTAINER_DLL_remove (context->unpollable_head,
+                                   context->unpollable_tail,
+                                   slot);
+    context->slots[sock] = NULL;
+    GNUNET_free (slot);
+  }
+  return GNUNET_OK;
+}
+
+
+static int
+epoll_add (void *cls,
+           struct GNUNET_SCHEDULER_Task *task,
+           struct GNUNET_SCHEDULER_FdInfo *fdi)
+{
+  struct EpollContext *context = cls;
+  struct EpollSlot *slot;
+  struct Scheduled *scheduled;
+
+  GNUNET_assert (NULL != context);
+  GNUNET_assert (NULL != task);
+  GNUNET_assert (NULL != fdi);
+  GNUNET_assert (0 != (GNUNET_SCHEDULER_ET_IN & fdi->et) ||
+                 0 != (GNUNET_SCHEDULER_ET_OUT & fdi->et));
+
+  if (!((NULL != fdi->fd) ^ (NULL != fdi->fh)) || (fdi->sock < 0))
+  {
+    /* exactly one out of {fd, hf} must be != NULL and the OS handle must be valid */
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != epoll_open (context))
+    return GNUNET_SYSERR;
+  if ((unsigned int) fdi->sock >= context->slots_len)
+    GNUNET_array_grow (context->slots,
+                       context->slots_len,
+                       GNUNET_MAX ((unsigned int) fdi->sock + 1,
+                                   2 * context->slots_len));
+  slot = context->slots[fdi->sock];
+  if (NULL == slot)
+  {
+    slot = GNUNET_new (struct EpollSlot);
+    context->slots[fdi->sock] = slot;
+  }
+  scheduled = GNUNET_new (struct Scheduled);
+  scheduled->task = task;
+  scheduled->fdi = fdi;
+  scheduled->et = fdi->et;
+  GNUNET_CONTAINER_DLL_insert (slot->scheduled_head,
+                               slot->scheduled_tail,
+                               scheduled);
+  if (GNUNET_OK !=
+      epoll_update_slot (context,
+                         fdi->sock,
+                         slot))
+  {
+    GNUNET_CONTAINER_DLL_remove (slot->scheduled_head,
+                                 slot->scheduled_tail,
+                                 scheduled);
+    GNUNET_free (scheduled);
+    (void) epoll_update_slot (context,
+                              fdi->sock,
+                              slot);
+    return GNUNET_SYSERR;
+  }
+  context->num_scheduled++;
+  return GNUNET_OK;
+}
+
+
+static int
+epoll_del (void *cls,
+           struct GNUNET_SCHEDULER_Task *task)
+{
+  struct EpollContext *context = cls;
+  struct EpollSlot *slot;
+  struct Scheduled *pos;
+  int sock;
+  int ret;
+
+  GNUNET_assert (NULL != context);
+  ret = GNUNET_SYSERR;
+  for (unsigned int i = 0; i != task->fds_len; ++i)
+  {
+    sock = task->fds[i].sock;
+    if ( (sock < 0) ||
+         ((unsigned int) sock >= context->slots_len) ||
+         (NULL == (slot = context->slots[sock])) )
+      continue;
+    pos = slot->scheduled_head;
+    while (NULL != pos)
+    {
+      struct Scheduled *next = pos->next;
+      if (pos->task == task)
+      {
+        GNUNET_CONTAINER_DLL_remove (slot->scheduled_head,
+                                     slot->scheduled_tail,
+                                     pos);
+        GNUNET_free (pos);
+        context->num_scheduled--;
+        ret = GNUNET_OK;
+      }
+      pos = next;
+    }
+    (void) epoll_update_slot (context,
+                              sock,
+                              slot);
+  }
+  return ret;
+}
+
+
+/**
+ * Tell the scheduler about the tasks in @a slot that are ready
+ * due to @a events.
+ *
+ * @param slot slot of the descriptor the events happened on
+ * @param events epoll events that were reported
+ */
+static void
+epoll_dispatch (struct EpollSlot *slot,
+                uint32_t events)
+{
+  struct Scheduled *pos;
+  int is_ready;
+
+  for (pos = slot->scheduled_head; NULL != pos; pos = pos->next)
+  {
+    is_ready = GNUNET_NO;
+    if ( (0 != (GNUNET_SCHEDULER_ET_IN & pos->et)) &&
+         (0 != (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) )
+    {
+      pos->fdi->et |= GNUNET_SCHEDULER_ET_IN;
+      is_ready = GNUNET_YES;
+    }
+    if ( (0 != (GNUNET_SCHEDULER_ET_OUT & pos->et)) &&
+         (0 != (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) )
+    {
+      pos->fdi->et |= GNUNET_SCHEDULER_ET_OUT;
+      is_ready = GNUNET_YES;
+    }
+    if (GNUNET_YES == is_ready)
+      GNUNET_SCHEDULER_task_ready (pos->task,
+                                   pos->fdi);
+  }
+}
+
+
+static int
+epoll_loop (void *cls,
+            struct GNUNET_SCHEDULER_Handle *sh)
+{
+  struct EpollContext *context = cls;
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  struct EpollSlot *slot;
+  int timeout_ms;
+  int nfds;
+  int tasks_ready;
+
+  GNUNET_assert (NULL != context);
+  if (GNUNET_OK != epoll_open (context))
+    return GNUNET_SYSERR;
+  while ( (0 != context->num_scheduled) ||
+          (GNUNET_TIME_UNIT_FOREVER_REL.rel_value_us != context->timeout.rel_value_us) )
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "epoll timeout = %s\n",
+         GNUNET_STRINGS_relative_time_to_string (context->timeout, GNUNET_NO));
+    if (NULL != context->unpollable_head)
+      timeout_ms = 0;
+    else if (GNUNET_TIME_UNIT_FOREVER_REL.rel_value_us == context->timeout.rel_value_us)
+      timeout_ms = -1;
+    else
+      /* round up, waking up early would find no task ready */
+      timeout_ms = (int) GNUNET_MIN ((context->timeout.rel_value_us + 999LL) / 1000LL,
+                                     (uint64_t) INT_MAX);
+    nfds = epoll_wait (context->epfd,
+                       events,
+                       MAX_EPOLL_EVENTS,
+                       timeout_ms);
+    if (-1 == nfds)
+    {
+      if (EINTR == errno)
+        continue;
+      LOG_STRERROR (GNUNET_ERROR_TYPE_ERROR,
+                    "epoll_wait");
+      GNUNET_assert (0);
+      return GNUNET_SYSERR;
+    }
+    for (int i = 0; i < nfds; i++)
+    {
+      int sock = events[i].data.fd;
+
+      if ( ((unsigned int) sock >= context->slots_len) ||
+           (NULL == (slot = context->slots[sock])) )
+        continue;
+      epoll_dispatch (slot,
+                      events[i].events);
+    }
+    for (slot = context->unpollable_head; NULL != slot; slot = slot->next)
+      epoll_dispatch (slot,
+                      EPOLLIN | EPOLLOUT);
+    tasks_ready = GNUNET_SCHEDULER_run_from_driver (sh);
+    GNUNET_assert (GNUNET_SYSERR != tasks_ready);
+  }
+  GNUNET_break (0 == close (context->epfd));
+  context->epfd = -1;
+  GNUNET_array_grow (context->slots,
+                     context->slots_len,
+                     0);
+  return GNUNET_OK;
+}
+
+
+static void
+epoll_set_wakeup (void *cls,
+                  struct GNUNET_TIME_Absolute dt)
+{
+  struct EpollContext *context = cls;
+
+  GNUNET_assert (NULL != context);
+  context->timeout = GNUNET_TIME_absolute_get_remaining (dt);
+}
+#endif
+
+
+/**
+ * Obtain the driver for using epoll() as the event loop.  Unlike
+ * the select() driver, it registers descriptors incrementally and
+ * only dispatches the descriptors that are actually ready.
+ *
+ * @return NULL on error (or if epoll is not supported on this platform)
+ */
+struct GNUNET_SCHEDULER_Driver *
+GNUNET_SCHEDULER_driver_epoll ()
+{
+#if HAVE_SYS_EPOLL_H
+  struct GNUNET_SCHEDULER_Driver *epoll_driver;
+  struct EpollContext *context;
+
+  epoll_driver = GNUNET_malloc (sizeof (struct GNUNET_SCHEDULER_Driver) +
+                                sizeof (struct EpollContext));
+  context = (struct EpollContext *) &epoll_driver[1];
+  context->timeout = GNUNET_TIME_UNIT_FOREVER_REL;
+  context->epfd = -1;
+  if (GNUNET_OK != epoll_open (context))
+  {
+    GNUNET_free (epoll_driver);
+    return NULL;
+  }
+  epoll_driver->cls = context;
+  epoll_driver->loop = &epoll_loop;
+  epoll_driver->add = &epoll_add;
+  epoll_driver->del = &epoll_del;
+  epoll_driver->set_wakeup = &epoll_set_wakeup;
+  return epoll_driver;
+#else
+  return NULL;
+#endif
+}
+
+
 /* end of scheduler.c */
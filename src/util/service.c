@@ -43,6 +43,12 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util-service", syscall, filename)
 
+/**
+ * Maximum number of queued messages we try to transmit
+ * to a client with a single system call.
+ */
+#define MAX_COALESCED_MESSAGES 32
+
 
 /**
  * Information the service tracks per listen operation.
@@ -1920,7 +1926,8 @@ GNUNET_SERVICE_suspend (struct GNUNET_SERVICE_Handle *sh)
 
 /**
  * Task run when we are ready to transmit data to the
- * client.
+ * client.  Transmits as many of the queued messages as the
+ * socket accepts with a single system call.
  *
  * @param cls the `struct GNUNET_SERVICE_Client *` to send to
  */
@@ -1928,9 +1935,13 @@ static void
 do_send (void *cls)
 {
   struct GNUNET_SERVICE_Client *client = cls;
+  const struct GNUNET_MessageHeader *msgs[MAX_COALESCED_MESSAGES];
+  const void *bufs[MAX_COALESCED_MESSAGES];
+  size_t lens[MAX_COALESCED_MESSAGES];
+  unsigned int num;
+  unsigned int done;
   ssize_t ret;
   size_t left;
-  const char *buf;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "service: sending message with type %u",
@@ -1938,11 +1949,23 @@ do_send (void *cls)
 
 
   client->send_task = NULL;
-  buf = (const char *) client->msg;
-  left = ntohs (client->msg->size) - client->msg_pos;
-  ret = GNUNET_NETWORK_socket_send (client->sock,
-				    &buf[client->msg_pos],
-				    left);
+  num = GNUNET_MQ_impl_peek (client->mq,
+                             msgs,
+                             MAX_COALESCED_MESSAGES);
+  GNUNET_assert (msgs[0] == client->msg);
+  bufs[0] = &((const char *) client->msg)[client->msg_pos];
+  lens[0] = ntohs (client->msg->size) - client->msg_pos;
+  left = lens[0];
+  for (unsigned int i = 1; i < num; i++)
+  {
+    bufs[i] = msgs[i];
+    lens[i] = ntohs (msgs[i]->size);
+    left += lens[i];
+  }
+  ret = GNUNET_NETWORK_socket_sendv (client->sock,
+                                     bufs,
+                                     lens,
+                                     num);
   GNUNET_assert (ret <= (ssize_t) left);
   if (0 == ret)
   {
@@ -1973,22 +1996,46 @@ do_send (void *cls)
       return;
     }
   }
-  if (0 == client->msg_pos)
+  /* how many messages went out completely? */
+  done = 0;
+  left = ret;
+  while ( (done < num) &&
+          (left >= lens[done]) )
+    left -= lens[done++];
+  if (0 == done)
   {
-    GNUNET_MQ_impl_send_in_flight (client->mq);
+    if (0 == client->msg_pos)
+    {
+      GNUNET_MQ_impl_send_in_flight (client->mq);
+    }
+    client->msg_pos += ret;
+    GNUNET_assert (NULL == client->drop_task);
+    client->send_task
+      = GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+					client->sock,
+					&do_send,
+					client);
+    return;
   }
-  client->msg_pos += ret;
-  if (left > (size_t) ret)
+  if (0 != left)
   {
+    /* we are in the middle of the next message */
+    client->msg = msgs[done];
+    client->msg_pos = left;
     GNUNET_assert (NULL == client->drop_task);
     client->send_task
       = GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
 					client->sock,
 					&do_send,
 					client);
+    GNUNET_MQ_impl_send_continue_multiple (client->mq,
+                                           done,
+                                           GNUNET_YES);
     return;
   }
-  GNUNET_MQ_impl_send_continue (client->mq);
+  GNUNET_MQ_impl_send_continue_multiple (client->mq,
+                                         done,
+                                         GNUNET_NO);
 }
 
 
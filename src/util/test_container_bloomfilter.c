@@ -59,6 +59,8 @@ main (int argc, char *argv[])
   struct GNUNET_CONTAINER_BloomFilter *bf;
   struct GNUNET_CONTAINER_BloomFilter *bfi;
   struct GNUNET_HashCode tmp;
+  struct GNUNET_HashCode batch[200];
+  int results[200];
   int i;
   int ok1;
   int ok2;
@@ -92,6 +94,48 @@ main (int argc, char *argv[])
     GNUNET_CONTAINER_bloomfilter_free (bf);
     return -1;
   }
+  GNUNET_CRYPTO_seed_weak_random (1);
+  for (i = 0; i < 200; i++)
+    nextHC (&batch[i]);
+  if (200 != GNUNET_CONTAINER_bloomfilter_test_batch (bf, batch, 200, results))
+  {
+    printf ("Batch test did not find all 200 elements.\n");
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    return -1;
+  }
+  for (i = 0; i < 200; i++)
+    nextHC (&batch[i]);
+  GNUNET_CONTAINER_bloomfilter_test_batch (bf, batch, 200, results);
+  for (i = 0; i < 200; i++)
+    GNUNET_assert (results[i] ==
+                   GNUNET_CONTAINER_bloomfilter_test (bf, &batch[i]));
+
+  /* while updates are pending, the file must not be trusted */
+  if (NULL != GNUNET_CONTAINER_bloomfilter_load (TESTFILE, SIZE, K))
+  {
+    printf ("Loaded file with pending updates.\n");
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    return -1;
+  }
+  /* a second filter on the same file must see the flushed counters */
+  if (GNUNET_OK != GNUNET_CONTAINER_bloomfilter_flush (bf))
+  {
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    return -1;
+  }
+  bfi = GNUNET_CONTAINER_bloomfilter_load (TESTFILE, SIZE, K);
+  GNUNET_assert (bfi != NULL);
+  GNUNET_CRYPTO_seed_weak_random (1);
+  for (i = 0; i < 200; i++)
+    nextHC (&batch[i]);
+  ok1 = GNUNET_CONTAINER_bloomfilter_test_batch (bfi, batch, 200, results);
+  GNUNET_CONTAINER_bloomfilter_free (bfi);
+  if (ok1 != 200)
+  {
+    printf ("Got %d elements out of 200 " "expected after flushing.\n", ok1);
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    return -1;
+  }
   if (GNUNET_OK != GNUNET_CONTAINER_bloomfilter_get_raw_data (bf, buf, SIZE))
   {
     GNUNET_CONTAINER_bloomfilter_free (bf);
@@ -31,7 +31,8 @@
 #define CHECK(c) { if (! (c)) ABORT(); }
 
 static int
-testMap (int i)
+testMap (int i,
+         enum GNUNET_CONTAINER_MultiHashMapLayout layout)
 {
   struct GNUNET_CONTAINER_MultiHashMap *m;
   struct GNUNET_HashCode k1;
@@ -41,7 +42,9 @@ testMap (int i)
   const char *ret;
   int j;
 
-  CHECK (NULL != (m = GNUNET_CONTAINER_multihashmap_create (i, GNUNET_NO)));
+  CHECK (NULL != (m = GNUNET_CONTAINER_multihashmap_create_with_layout (i,
+                                                                        GNUNET_NO,
+                                                                        layout)));
   memset (&k1, 0, sizeof (k1));
   memset (&k2, 1, sizeof (k2));
   CHECK (GNUNET_NO == GNUNET_CONTAINER_multihashmap_contains (m, &k1));
@@ -103,6 +106,86 @@ testMap (int i)
   return 0;
 }
 
+/**
+ * Iterator that removes every other entry.
+ *
+ * @param cls the map
+ * @param key current key
+ * @param value current value
+ * @return #GNUNET_OK
+ */
+static int
+remove_odd (void *cls,
+            const struct GNUNET_HashCode *key,
+            void *value)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m = cls;
+
+  if (1 == ((uintptr_t) value) % 2)
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (m,
+                                                         key,
+                                                         value));
+  return GNUNET_OK;
+}
+
+
+/**
+ * Store many distinct keys, so that the map has to grow, and remove
+ * entries from within an iteration.
+ */
+static int
+testMany (enum GNUNET_CONTAINER_MultiHashMapLayout layout)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m;
+  struct GNUNET_CONTAINER_MultiHashMapIterator *iter = NULL;
+  struct GNUNET_HashCode *keys;
+  uintptr_t j;
+  const unsigned int n = 10000;
+
+  keys = GNUNET_new_array (n,
+                           struct GNUNET_HashCode);
+  CHECK (NULL != (m = GNUNET_CONTAINER_multihashmap_create_with_layout (4,
+                                                                        GNUNET_YES,
+                                                                        layout)));
+  for (j = 0; j < n; j++)
+  {
+    GNUNET_CRYPTO_hash (&j,
+                        sizeof (j),
+                        &keys[j]);
+    CHECK (GNUNET_OK ==
+           GNUNET_CONTAINER_multihashmap_put (m,
+                                              &keys[j],
+                                              (void *) (j + 1),
+                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  CHECK (n == GNUNET_CONTAINER_multihashmap_size (m));
+  for (j = 0; j < n; j++)
+    CHECK ((void *) (j + 1) == GNUNET_CONTAINER_multihashmap_get (m,
+                                                                  &keys[j]));
+  CHECK (n == GNUNET_CONTAINER_multihashmap_iterate (m,
+                                                     &remove_odd,
+                                                     m));
+  CHECK (n / 2 == GNUNET_CONTAINER_multihashmap_size (m));
+  for (j = 0; j < n; j++)
+    CHECK ( (1 == j % 2) ==
+            GNUNET_CONTAINER_multihashmap_contains (m,
+                                                    &keys[j]));
+  for (j = 0; j < n; j += 2)
+    CHECK (GNUNET_OK ==
+           GNUNET_CONTAINER_multihashmap_put (m,
+                                              &keys[j],
+                                              (void *) (j + 1),
+                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  CHECK (n == GNUNET_CONTAINER_multihashmap_size (m));
+  CHECK (n == GNUNET_CONTAINER_multihashmap_clear (m));
+  CHECK (0 == GNUNET_CONTAINER_multihashmap_iterate (m, NULL, NULL));
+  GNUNET_CONTAINER_multihashmap_destroy (m);
+  GNUNET_free (keys);
+  return 0;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -111,7 +194,14 @@ main (int argc, char *argv[])
 
   GNUNET_log_setup ("test-container-multihashmap", "WARNING", NULL);
   for (i = 1; i < 255; i++)
-    failureCount += testMap (i);
+  {
+    failureCount += testMap (i,
+                             GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_CHAINED);
+    failureCount += testMap (i,
+                             GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING);
+  }
+  failureCount += testMany (GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_CHAINED);
+  failureCount += testMany (GNUNET_CONTAINER_MULTIHASHMAPLAYOUT_OPEN_ADDRESSING);
   if (failureCount != 0)
     return 1;
   return 0;
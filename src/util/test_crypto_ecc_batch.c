@@ -0,0 +1,224 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_crypto_ecc_batch.c
+ * @brief test for verifying batches of signatures on a thread pool
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+#define ITEMS 16
+
+/**
+ * Item whose signature we break.
+ */
+#define BAD_SIG 4
+
+/**
+ * Item whose purpose we break.
+ */
+#define BAD_PURPOSE 9
+
+struct TestSig
+{
+  struct GNUNET_CRYPTO_EccSignaturePurpose purp;
+  struct GNUNET_HashCode h;
+};
+
+static struct TestSig data[ITEMS];
+
+static struct GNUNET_CRYPTO_EddsaSignature eddsa_sig[ITEMS];
+
+static struct GNUNET_CRYPTO_EddsaPublicKey eddsa_pub;
+
+static struct GNUNET_CRYPTO_EcdsaSignature ecdsa_sig[ITEMS];
+
+static struct GNUNET_CRYPTO_EcdsaPublicKey ecdsa_pub;
+
+static struct GNUNET_CRYPTO_VerifyItem items[ITEMS];
+
+static struct GNUNET_CRYPTO_VerifyPool *pool;
+
+static struct GNUNET_SCHEDULER_Task *tt;
+
+static unsigned int batches_done;
+
+static int ret;
+
+
+static void
+batch_cb (void *cls,
+          unsigned int num_items,
+          const int *results)
+{
+  if (ITEMS != num_items)
+  {
+    GNUNET_break (0);
+    ret = 1;
+  }
+  for (unsigned int i = 0; i < num_items; i++)
+    if (results[i] !=
+        ( ( (BAD_SIG == i) || (BAD_PURPOSE == i) )
+          ? GNUNET_SYSERR
+          : GNUNET_OK) )
+    {
+      GNUNET_break (0);
+      ret = 1;
+    }
+  if (2 > ++batches_done)
+    return;
+  /* leave one batch running to check that destroying the
+     pool cancels it */
+  GNUNET_CRYPTO_verify_batch_start (pool,
+                                    items,
+                                    ITEMS,
+                                    &batch_cb,
+                                    NULL);
+  GNUNET_CRYPTO_verify_pool_destroy (pool);
+  pool = NULL;
+  GNUNET_SCHEDULER_cancel (tt);
+  tt = NULL;
+}
+
+
+static void
+cancelled_cb (void *cls,
+              unsigned int num_items,
+              const int *results)
+{
+  GNUNET_break (0);
+  ret = 1;
+}
+
+
+static void
+timeout_cb (void *cls)
+{
+  tt = NULL;
+  GNUNET_break (0);
+  ret = 1;
+  GNUNET_CRYPTO_verify_pool_destroy (pool);
+  pool = NULL;
+}
+
+
+static void
+run (void *cls)
+{
+  struct GNUNET_CRYPTO_VerifyBatch *vb;
+  struct GNUNET_CRYPTO_VerifyItem short_item;
+  struct GNUNET_CRYPTO_EccSignaturePurpose short_purp;
+
+  batches_done = 0;
+  pool = GNUNET_CRYPTO_verify_pool_create ((unsigned int) (uintptr_t) cls);
+  GNUNET_CRYPTO_verify_batch_start (pool,
+                                    items,
+                                    ITEMS,
+                                    &batch_cb,
+                                    NULL);
+  vb = GNUNET_CRYPTO_verify_batch_start (pool,
+                                         items,
+                                         ITEMS,
+                                         &cancelled_cb,
+                                         NULL);
+  GNUNET_CRYPTO_verify_batch_start (pool,
+                                    items,
+                                    ITEMS,
+                                    &batch_cb,
+                                    NULL);
+  GNUNET_CRYPTO_verify_batch_cancel (vb);
+  /* signed data shorter than the purpose header is refused */
+  short_item = items[0];
+  short_purp = *items[0].validate;
+  short_purp.size = htonl (sizeof (short_purp) - 1);
+  short_item.validate = &short_purp;
+  if (NULL !=
+      GNUNET_CRYPTO_verify_batch_start (pool,
+                                        &short_item,
+                                        1,
+                                        &cancelled_cb,
+                                        NULL))
+  {
+    GNUNET_break (0);
+    ret = 1;
+  }
+  tt = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                     &timeout_cb,
+                                     NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_CRYPTO_EddsaPrivateKey *eddsa;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey *ecdsa;
+
+  GNUNET_log_setup ("test-crypto-ecc-batch",
+                    "WARNING",
+                    NULL);
+  eddsa = GNUNET_CRYPTO_eddsa_key_create ();
+  ecdsa = GNUNET_CRYPTO_ecdsa_key_create ();
+  GNUNET_CRYPTO_eddsa_key_get_public (eddsa,
+                                      &eddsa_pub);
+  GNUNET_CRYPTO_ecdsa_key_get_public (ecdsa,
+                                      &ecdsa_pub);
+  for (unsigned int i = 0; i < ITEMS; i++)
+  {
+    data[i].purp.purpose = htonl (i % 2);
+    data[i].purp.size = htonl (sizeof (struct TestSig));
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                &data[i].h,
+                                sizeof (data[i].h));
+    items[i].purpose = i % 2;
+    items[i].validate = &data[i].purp;
+    if (0 == i % 2)
+    {
+      GNUNET_assert (GNUNET_OK ==
+                     GNUNET_CRYPTO_eddsa_sign (eddsa,
+                                               &data[i].purp,
+                                               &eddsa_sig[i]));
+      items[i].type = GNUNET_CRYPTO_VERIFY_EDDSA;
+      items[i].sig.eddsa = &eddsa_sig[i];
+      items[i].pub.eddsa = &eddsa_pub;
+    }
+    else
+    {
+      GNUNET_assert (GNUNET_OK ==
+                     GNUNET_CRYPTO_ecdsa_sign (ecdsa,
+                                               &data[i].purp,
+                                               &ecdsa_sig[i]));
+      items[i].type = GNUNET_CRYPTO_VERIFY_ECDSA;
+      items[i].sig.ecdsa = &ecdsa_sig[i];
+      items[i].pub.ecdsa = &ecdsa_pub;
+    }
+  }
+  GNUNET_free (eddsa);
+  GNUNET_free (ecdsa);
+  eddsa_sig[BAD_SIG].s[0] ^= 1;
+  items[BAD_PURPOSE].purpose = 42;
+  GNUNET_SCHEDULER_run (&run,
+                        (void *) (uintptr_t) 1);
+  GNUNET_SCHEDULER_run (&run,
+                        (void *) (uintptr_t) 4);
+  return ret;
+}
+
+/* end of test_crypto_ecc_batch.c */
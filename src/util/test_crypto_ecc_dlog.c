@@ -169,6 +169,7 @@ int
 main (int argc, char *argv[])
 {
   struct GNUNET_CRYPTO_EccDlogContext *edc;
+  char *fn;
 
   if (! gcry_check_version ("1.6.0"))
   {
@@ -188,6 +189,21 @@ main (int argc, char *argv[])
   test_dlog (edc);
   test_math (edc);
   GNUNET_CRYPTO_ecc_dlog_release (edc);
+  /* once writing the table, once mapping it */
+  fn = GNUNET_DISK_mktemp ("test-crypto-ecc-dlog");
+  GNUNET_assert (NULL != fn);
+  GNUNET_break (0 == UNLINK (fn));
+  for (unsigned int i=0;i<2;i++)
+  {
+    edc = GNUNET_CRYPTO_ecc_dlog_prepare_file (MAX_FACT,
+                                               MAX_MEM,
+                                               fn);
+    GNUNET_assert (NULL != edc);
+    test_dlog (edc);
+    GNUNET_CRYPTO_ecc_dlog_release (edc);
+  }
+  GNUNET_break (0 == UNLINK (fn));
+  GNUNET_free (fn);
   return 0;
 }
 
@@ -0,0 +1,127 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_crypto_pow.c
+ * @brief test for the parallel proof-of-work search
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+#define SALT "test-proof-of-work"
+
+#define BITS 6
+
+static const char data[] = "some data to prove work for";
+
+static struct GNUNET_CRYPTO_PowSearch *ps;
+
+static struct GNUNET_SCHEDULER_Task *tt;
+
+static uint64_t first_proof;
+
+static int ret = 1;
+
+
+static void
+found_cb (void *cls,
+          uint64_t proof)
+{
+  ps = NULL;
+  GNUNET_SCHEDULER_cancel (tt);
+  tt = NULL;
+  if (GNUNET_YES !=
+      GNUNET_CRYPTO_pow_check (SALT,
+                               data,
+                               sizeof (data),
+                               proof,
+                               BITS))
+  {
+    GNUNET_break (0);
+    return;
+  }
+  /* with a single thread, we must find the smallest proof */
+  if ( (0 == first_proof) &&
+       (1 == (uintptr_t) cls) )
+  {
+    for (uint64_t i = 0; i < proof; i++)
+      if (GNUNET_YES ==
+          GNUNET_CRYPTO_pow_check (SALT,
+                                   data,
+                                   sizeof (data),
+                                   i,
+                                   BITS))
+      {
+        GNUNET_break (0);
+        return;
+      }
+  }
+  first_proof = proof;
+  ret = 0;
+}
+
+
+static void
+timeout_cb (void *cls)
+{
+  tt = NULL;
+  GNUNET_break (0);
+  if (NULL != ps)
+    GNUNET_CRYPTO_pow_search_stop (ps);
+  ps = NULL;
+}
+
+
+static void
+run (void *cls)
+{
+  ps = GNUNET_CRYPTO_pow_search_start (SALT,
+                                       data,
+                                       sizeof (data),
+                                       0,
+                                       BITS,
+                                       (unsigned int) (uintptr_t) cls,
+                                       GNUNET_TIME_UNIT_ZERO,
+                                       NULL,
+                                       &found_cb,
+                                       cls);
+  GNUNET_assert (NULL != ps);
+  tt = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                     &timeout_cb,
+                                     NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GNUNET_log_setup ("test-crypto-pow",
+                    "WARNING",
+                    NULL);
+  GNUNET_SCHEDULER_run (&run,
+                        (void *) (uintptr_t) 1);
+  if (0 != ret)
+    return ret;
+  ret = 1;
+  GNUNET_SCHEDULER_run (&run,
+                        (void *) (uintptr_t) 4);
+  return ret;
+}
+
+/* end of test_crypto_pow.c */
@@ -149,6 +149,112 @@ error:
 }
 
 
+static int
+testContext ()
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey key;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector ivs[3];
+  struct GNUNET_CRYPTO_SymmetricContext *ctx;
+  char plain[3][1000];
+  char expect[3][1000];
+  char bulk[3][1000];
+  const void *blocks[3];
+  size_t sizes[3];
+  void *results[3];
+  int ret;
+
+  ret = 0;
+  GNUNET_CRYPTO_symmetric_create_session_key (&key);
+  ctx = GNUNET_CRYPTO_symmetric_context_create (&key);
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                plain[i],
+                                sizeof (plain[i]));
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                &ivs[i],
+                                sizeof (ivs[i]));
+    sizes[i] = sizeof (plain[i]) - i;
+    blocks[i] = plain[i];
+    results[i] = bulk[i];
+    GNUNET_CRYPTO_symmetric_encrypt (plain[i],
+                                     sizes[i],
+                                     &key,
+                                     &ivs[i],
+                                     expect[i]);
+  }
+  /* context must produce the same output as the stateless API,
+     also when re-used and when working in place */
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    GNUNET_memcpy (bulk[i],
+                   plain[i],
+                   sizes[i]);
+    GNUNET_CRYPTO_symmetric_context_encrypt (ctx,
+                                             bulk[i],
+                                             sizes[i],
+                                             &ivs[i],
+                                             bulk[i]);
+    if (0 != memcmp (bulk[i],
+                     expect[i],
+                     sizes[i]))
+    {
+      printf ("Context encryption of block %u differs.\n",
+              i);
+      ret = 1;
+    }
+  }
+  memset (bulk, 0, sizeof (bulk));
+  GNUNET_CRYPTO_symmetric_context_encrypt_bulk (ctx,
+                                                3,
+                                                blocks,
+                                                sizes,
+                                                ivs,
+                                                results);
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    if (0 != memcmp (bulk[i],
+                     expect[i],
+                     sizes[i]))
+    {
+      printf ("Bulk encryption of block %u differs.\n",
+              i);
+      ret = 1;
+    }
+    blocks[i] = bulk[i];
+  }
+  GNUNET_CRYPTO_symmetric_context_decrypt_bulk (ctx,
+                                                3,
+                                                blocks,
+                                                sizes,
+                                                ivs,
+                                                results);
+  for (unsigned int i = 0; i < 3; i++)
+    if (0 != memcmp (bulk[i],
+                     plain[i],
+                     sizes[i]))
+    {
+      printf ("Bulk decryption of block %u differs.\n",
+              i);
+      ret = 1;
+    }
+  GNUNET_CRYPTO_symmetric_context_decrypt (ctx,
+                                           expect[0],
+                                           sizes[0],
+                                           &ivs[0],
+                                           bulk[0]);
+  if (0 != memcmp (bulk[0],
+                   plain[0],
+                   sizes[0]))
+  {
+    printf ("Context decryption differs.\n");
+    ret = 1;
+  }
+  GNUNET_CRYPTO_symmetric_context_destroy (ctx);
+  return ret;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -159,6 +265,7 @@ main (int argc, char *argv[])
                  sizeof (struct GNUNET_CRYPTO_SymmetricInitializationVector));
   failureCount += testSymcipher ();
   failureCount += verifyCrypto ();
+  failureCount += testContext ();
 
   if (failureCount != 0)
   {
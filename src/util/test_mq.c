@@ -73,12 +73,100 @@ test2 ()
 }
 
 
+/**
+ * Messages passed to #share_send() so far.
+ */
+static const struct GNUNET_MessageHeader *sent[2];
+
+/**
+ * Values of the messages passed to #share_send() so far.
+ */
+static uint32_t sent_x[2];
+
+/**
+ * Number of entries in #sent.
+ */
+static unsigned int sent_count;
+
+
+static void
+share_send (struct GNUNET_MQ_Handle *mq,
+            const struct GNUNET_MessageHeader *msg,
+            void *impl_state)
+{
+  GNUNET_assert (sent_count < 2);
+  GNUNET_assert (42 == ntohs (msg->type));
+  sent_x[sent_count] = ntohl (((const struct MyMessage *) msg)->x);
+  sent[sent_count++] = msg;
+  GNUNET_MQ_impl_send_continue (mq);
+}
+
+
+static void
+share_destroy (struct GNUNET_MQ_Handle *mq,
+               void *impl_state)
+{
+  /* nothing to do */
+}
+
+
+static void
+share_cancel (struct GNUNET_MQ_Handle *mq,
+              void *impl_state)
+{
+  GNUNET_assert (0);
+}
+
+
+static void
+share_run (void *cls)
+{
+  struct GNUNET_MQ_Handle *mq[2];
+  struct GNUNET_MQ_Envelope *env;
+  struct GNUNET_MQ_Envelope *share;
+  struct MyMessage *mm;
+
+  for (unsigned int i = 0; i < 2; i++)
+    mq[i] = GNUNET_MQ_queue_for_callbacks (&share_send,
+                                           &share_destroy,
+                                           &share_cancel,
+                                           NULL,
+                                           NULL,
+                                           NULL,
+                                           NULL);
+  env = GNUNET_MQ_msg (mm, 42);
+  mm->x = htonl (23);
+  share = GNUNET_MQ_env_share (env);
+  GNUNET_MQ_send (mq[0],
+                  GNUNET_MQ_env_share (env));
+  /* the message must survive the envelope it was created with */
+  GNUNET_MQ_discard (env);
+  GNUNET_MQ_send (mq[1],
+                  share);
+  GNUNET_assert (2 == sent_count);
+  GNUNET_assert (sent[0] == sent[1]);
+  GNUNET_assert (23 == sent_x[0]);
+  GNUNET_assert (23 == sent_x[1]);
+  for (unsigned int i = 0; i < 2; i++)
+    GNUNET_MQ_destroy (mq[i]);
+}
+
+
+static void
+test3 ()
+{
+  GNUNET_SCHEDULER_run (&share_run,
+                        NULL);
+}
+
+
 int
 main (int argc, char **argv)
 {
   GNUNET_log_setup ("test-mq", "INFO", NULL);
   test1 ();
   test2 ();
+  test3 ();
   return 0;
 }
 
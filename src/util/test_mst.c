@@ -0,0 +1,270 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_mst.c
+ * @brief tests for the message stream tokenizer
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+/**
+ * Number of messages in the test stream.
+ */
+#define NUM_MESSAGES 2000
+
+/**
+ * Largest message we generate.
+ */
+#define MAX_SIZE 3000
+
+/**
+ * The stream we tokenize.
+ */
+static char *stream;
+
+/**
+ * Size of @e stream.
+ */
+static size_t stream_size;
+
+/**
+ * Offset of each message in @e stream.
+ */
+static size_t offsets[NUM_MESSAGES];
+
+/**
+ * Number of messages received so far.
+ */
+static unsigned int received;
+
+/**
+ * Set to 1 on errors.
+ */
+static int fail;
+
+
+/**
+ * Build a stream of messages with odd sizes, so that most of
+ * them are misaligned.
+ */
+static void
+make_stream ()
+{
+  struct GNUNET_MessageHeader hdr;
+  uint16_t size;
+
+  stream = GNUNET_malloc (NUM_MESSAGES * MAX_SIZE);
+  stream_size = 0;
+  for (unsigned int i = 0; i < NUM_MESSAGES; i++)
+  {
+    if (0 == i % 100)
+      size = MAX_SIZE;
+    else
+      size = sizeof (hdr)
+        + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, 64);
+    hdr.size = htons (size);
+    hdr.type = htons ((uint16_t) i);
+    offsets[i] = stream_size;
+    GNUNET_memcpy (&stream[stream_size],
+                   &hdr,
+                   sizeof (hdr));
+    for (unsigned int j = sizeof (hdr); j < size; j++)
+      stream[stream_size + j] = (char) (i + j);
+    stream_size += size;
+  }
+}
+
+
+static int
+check_cb (void *cls,
+          const struct GNUNET_MessageHeader *message)
+{
+  uint16_t size = ntohs (message->size);
+
+  if ( (received >= NUM_MESSAGES) ||
+       (0 != ((uintptr_t) message) % sizeof (uint32_t)) ||
+       (ntohs (message->type) != (uint16_t) received) ||
+       (0 != memcmp (message,
+                     &stream[offsets[received]],
+                     size)) )
+  {
+    GNUNET_break (0);
+    fail = 1;
+    return GNUNET_SYSERR;
+  }
+  received++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Feed the stream in random chunks to #GNUNET_MST_from_buffer(),
+ * starting at odd offsets in the input.
+ */
+static void
+test_from_buffer ()
+{
+  struct GNUNET_MessageStreamTokenizer *mst;
+  size_t off;
+  size_t chunk;
+
+  received = 0;
+  mst = GNUNET_MST_create (&check_cb,
+                           NULL);
+  off = 0;
+  while (off < stream_size)
+  {
+    chunk = 1 + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                          2 * MAX_SIZE);
+    chunk = GNUNET_MIN (chunk,
+                        stream_size - off);
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_MST_from_buffer (mst,
+                                           &stream[off],
+                                           chunk,
+                                           GNUNET_NO,
+                                           GNUNET_NO));
+    off += chunk;
+  }
+  GNUNET_MST_destroy (mst);
+  if (NUM_MESSAGES != received)
+  {
+    GNUNET_break (0);
+    fail = 1;
+  }
+}
+
+
+/**
+ * Check that @a one_shot delivers exactly one message per call.
+ */
+static void
+test_one_shot ()
+{
+  struct GNUNET_MessageStreamTokenizer *mst;
+  int ret;
+
+  received = 0;
+  mst = GNUNET_MST_create (&check_cb,
+                           NULL);
+  ret = GNUNET_MST_from_buffer (mst,
+                                stream,
+                                offsets[3] + 1,
+                                GNUNET_NO,
+                                GNUNET_YES);
+  GNUNET_assert (GNUNET_NO == ret);
+  GNUNET_assert (1 == received);
+  GNUNET_assert (GNUNET_NO == GNUNET_MST_next (mst,
+                                               GNUNET_YES));
+  GNUNET_assert (2 == received);
+  GNUNET_assert (GNUNET_OK == GNUNET_MST_next (mst,
+                                               GNUNET_YES));
+  GNUNET_assert (3 == received);
+  GNUNET_assert (GNUNET_OK == GNUNET_MST_next (mst,
+                                               GNUNET_YES));
+  GNUNET_assert (3 == received);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_MST_from_buffer (mst,
+                                         &stream[offsets[3] + 1],
+                                         offsets[4] - offsets[3] - 1,
+                                         GNUNET_NO,
+                                         GNUNET_YES));
+  GNUNET_assert (4 == received);
+  GNUNET_MST_destroy (mst);
+}
+
+
+/**
+ * Write the stream to a socket and tokenize it with
+ * #GNUNET_MST_read().
+ */
+static void
+test_read ()
+{
+#ifndef MINGW
+  struct GNUNET_MessageStreamTokenizer *mst;
+  struct GNUNET_NETWORK_Handle *rsock;
+  int sp[2];
+  size_t off;
+  ssize_t wret;
+
+  if (0 != socketpair (AF_UNIX,
+                       SOCK_STREAM,
+                       0,
+                       sp))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "socketpair");
+    return;
+  }
+  rsock = GNUNET_NETWORK_socket_box_native (sp[0]);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_NETWORK_socket_set_blocking (rsock,
+                                                     GNUNET_NO));
+  received = 0;
+  mst = GNUNET_MST_create (&check_cb,
+                           NULL);
+  off = 0;
+  while (received < NUM_MESSAGES)
+  {
+    if (off < stream_size)
+    {
+      wret = write (sp[1],
+                    &stream[off],
+                    GNUNET_MIN (stream_size - off,
+                                16 * 1024));
+      GNUNET_assert (wret > 0);
+      off += wret;
+    }
+    if (GNUNET_OK !=
+        GNUNET_MST_read (mst,
+                         rsock,
+                         GNUNET_NO,
+                         GNUNET_NO))
+    {
+      GNUNET_break (0);
+      fail = 1;
+      break;
+    }
+  }
+  GNUNET_MST_destroy (mst);
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_NETWORK_socket_close (rsock));
+  GNUNET_break (0 == close (sp[1]));
+#endif
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  GNUNET_log_setup ("test-mst",
+                    "WARNING",
+                    NULL);
+  make_stream ();
+  test_from_buffer ();
+  test_one_shot ();
+  test_read ();
+  GNUNET_free (stream);
+  return fail;
+}
+
+/* end of test_mst.c */
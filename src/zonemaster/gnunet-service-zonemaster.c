@@ -22,6 +22,14 @@
  * @file zonemaster/gnunet-service-zonemaster.c
  * @brief publish records from namestore to GNUnet name system
  * @author Christian Grothoff
+ *
+ * Every record set we publish becomes a `struct PublishJob`.  Unless
+ * we find a block for the same record set in our cache, the job is
+ * signed by a pool of worker threads and then handed back to the
+ * main thread (through a pipe) to be PUT into the DHT.  The zone
+ * iteration requests records from the namestore in batches, paced
+ * to publish the zone within the publish time window, and never has
+ * more than a configurable number of jobs in flight.
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
@@ -31,6 +39,9 @@
 #include "gnunet_statistics_service.h"
 #include "gnunet_namestore_plugin.h"
 #include "gnunet_signatures.h"
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
@@ -44,7 +55,8 @@
 #define INITIAL_PUT_INTERVAL GNUNET_TIME_UNIT_MILLISECONDS
 
 /**
- * The lower bound for the zone iteration interval
+ * The lower bound for the interval between two requests for
+ * records from the namestore during a zone iteration
  */
 #define MINIMUM_ZONE_ITERATION_INTERVAL GNUNET_TIME_UNIT_SECONDS
 
@@ -75,26 +87,136 @@
  */
 #define DHT_GNS_REPLICATION_LEVEL 5
 
+/**
+ * Maximum number of records we ask the namestore for at once.
+ */
+#define NS_BLOCK_SIZE 1000
+
+/**
+ * Default for the maximum number of record sets of the zone
+ * iteration that are being signed or PUT into the DHT at the same
+ * time.
+ */
+#define DEFAULT_MAX_PARALLEL_PUTS 64
+
+/**
+ * Default for the maximum number of signed blocks we cache.
+ */
+#define DEFAULT_BLOCK_CACHE_SIZE (64 * 1024)
 
 /**
- * Handle for DHT PUT activity triggered from the namestore monitor.
+ * How often do we update the statistics on the publication rate?
  */
-struct MonitorActivity
+#define RATE_STATISTICS_INTERVAL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10)
+
+
+/**
+ * A record set to be signed and PUT into the DHT.
+ */
+struct PublishJob
 {
   /**
-   * Kept in a DLL.
+   * Kept in the DLL of the stage the job is in.
    */
-  struct MonitorActivity *next;
+  struct PublishJob *next;
 
   /**
-   * Kept in a DLL.
+   * Kept in the DLL of the stage the job is in.
    */
-  struct MonitorActivity *prev;
+  struct PublishJob *prev;
+
+  /**
+   * Private key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+
+  /**
+   * Label of the record set.
+   */
+  char *label;
+
+  /**
+   * Serialized public records.
+   */
+  char *rd_ser;
+
+  /**
+   * Number of bytes in @e rd_ser.
+   */
+  size_t rd_ser_len;
+
+  /**
+   * Number of records in @e rd_ser.
+   */
+  unsigned int rd_count;
+
+  /**
+   * Expiration time of the block.
+   */
+  struct GNUNET_TIME_Absolute expire;
+
+  /**
+   * Key of the block in the #block_cache.
+   */
+  struct GNUNET_HashCode cache_key;
+
+  /**
+   * DHT key for the block, set by #sign_job.
+   */
+  struct GNUNET_HashCode query;
+
+  /**
+   * The signed block, set by #sign_job, NULL on error.
+   */
+  struct GNUNET_GNSRECORD_Block *block;
 
   /**
    * Handle for the DHT PUT operation.
    */
   struct GNUNET_DHT_PutHandle *ph;
+
+  /**
+   * #GNUNET_YES if the job was triggered by the namestore monitor
+   * and thus does not count against #max_parallel_puts.
+   */
+  int from_monitor;
+};
+
+
+/**
+ * A signed block in the #block_cache.
+ */
+struct CacheEntry
+{
+  /**
+   * Kept in a DLL, most recently used first.
+   */
+  struct CacheEntry *next;
+
+  /**
+   * Kept in a DLL, most recently used first.
+   */
+  struct CacheEntry *prev;
+
+  /**
+   * Hash over zone, label, records and expiration bucket.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * DHT key for the block.
+   */
+  struct GNUNET_HashCode query;
+
+  /**
+   * Expiration time of the block.
+   */
+  struct GNUNET_TIME_Absolute expire;
+
+  /**
+   * The signed block.
+   */
+  struct GNUNET_GNSRECORD_Block *block;
 };
 
 
@@ -109,34 +231,159 @@ static struct GNUNET_STATISTICS_Handle *statistics;
 static struct GNUNET_DHT_Handle *dht_handle;
 
 /**
- * Active DHT put operation (or NULL)
+ * Head of jobs with an active DHT put operation.
  */
-static struct GNUNET_DHT_PutHandle *active_put;
+static struct PublishJob *put_head;
 
 /**
- * Our handle to the namestore service
+ * Tail of jobs with an active DHT put operation.
  */
-static struct GNUNET_NAMESTORE_Handle *namestore_handle;
+static struct PublishJob *put_tail;
 
 /**
- * Handle to iterate over our authoritative zone in namestore
+ * Head of jobs waiting for a worker, protected by #jobs_lock.
  */
-static struct GNUNET_NAMESTORE_ZoneIterator *namestore_iter;
+static struct PublishJob *sign_head;
 
 /**
- * Handle to monitor namestore changes to instant propagation.
+ * Tail of jobs waiting for a worker, protected by #jobs_lock.
  */
-static struct GNUNET_NAMESTORE_ZoneMonitor *zmon;
+static struct PublishJob *sign_tail;
+
+/**
+ * Head of jobs signed by a worker and waiting for the main thread,
+ * protected by #jobs_lock.
+ */
+static struct PublishJob *signed_head;
+
+/**
+ * Tail of jobs signed by a worker and waiting for the main thread,
+ * protected by #jobs_lock.
+ */
+static struct PublishJob *signed_tail;
+
+#if HAVE_PTHREAD_H
+/**
+ * Lock for the queues shared with the workers.
+ */
+static pthread_mutex_t jobs_lock;
+
+/**
+ * Signalled when a job was queued or the workers should stop.
+ */
+static pthread_cond_t jobs_cond;
+
+/**
+ * Array of #num_workers worker threads.
+ */
+static pthread_t *workers;
+
+/**
+ * #GNUNET_YES if the workers should terminate.
+ */
+static int workers_stop;
+#endif
+
+/**
+ * Number of worker threads we started, 0 to sign in the main thread.
+ */
+static unsigned int num_workers;
+
+/**
+ * Pipe the workers use to wake up the main thread.
+ */
+static struct GNUNET_DISK_PipeHandle *notify_pipe;
+
+/**
+ * Task reading from #notify_pipe.
+ */
+static struct GNUNET_SCHEDULER_Task *notify_task;
 
 /**
- * Head of monitor activities; kept in a DLL.
+ * Maps cache keys to `struct CacheEntry`.
  */
-static struct MonitorActivity *ma_head;
+static struct GNUNET_CONTAINER_MultiHashMap *block_cache;
 
 /**
- * Tail of monitor activities; kept in a DLL.
+ * Most recently used entry of the #block_cache.
  */
-static struct MonitorActivity *ma_tail;
+static struct CacheEntry *cache_head;
+
+/**
+ * Least recently used entry of the #block_cache.
+ */
+static struct CacheEntry *cache_tail;
+
+/**
+ * Maximum number of entries in the #block_cache, 0 to disable it.
+ */
+static unsigned long long block_cache_size;
+
+/**
+ * Maximum number of jobs of the zone iteration in flight.
+ */
+static unsigned long long max_parallel_puts;
+
+/**
+ * Number of jobs of the zone iteration that are being signed or PUT.
+ */
+static unsigned int iteration_jobs;
+
+/**
+ * Number of records we requested from the namestore and did not
+ * receive yet.
+ */
+static uint64_t ns_iteration_left;
+
+/**
+ * When did we last request records from the namestore?
+ */
+static struct GNUNET_TIME_Absolute last_request_time;
+
+/**
+ * How many records did we request then?
+ */
+static uint64_t last_request_size;
+
+/**
+ * When did the current zone iteration start?
+ */
+static struct GNUNET_TIME_Absolute iteration_start_time;
+
+/**
+ * When did we last update the statistics on the publication rate?
+ */
+static struct GNUNET_TIME_Absolute rate_time;
+
+/**
+ * Number of DHT PUTs completed since #rate_time.
+ */
+static unsigned long long rate_puts;
+
+/**
+ * Number of blocks we signed.
+ */
+static unsigned long long blocks_signed;
+
+/**
+ * Number of blocks we took from the #block_cache.
+ */
+static unsigned long long blocks_cached;
+
+/**
+ * Our handle to the namestore service
+ */
+static struct GNUNET_NAMESTORE_Handle *namestore_handle;
+
+/**
+ * Handle to iterate over our authoritative zone in namestore
+ */
+static struct GNUNET_NAMESTORE_ZoneIterator *namestore_iter;
+
+/**
+ * Handle to monitor namestore changes to instant propagation.
+ */
+static struct GNUNET_NAMESTORE_ZoneMonitor *zmon;
 
 /**
  * Useful for zone update for DHT put
@@ -180,6 +427,126 @@ static struct GNUNET_SCHEDULER_Task *zone_publish_task;
  */
 static int first_zone_iteration;
 
+
+/**
+ * Free a job.
+ *
+ * @param job job to free
+ */
+static void
+free_job (struct PublishJob *job)
+{
+  if (NULL != job->ph)
+    GNUNET_DHT_put_cancel (job->ph);
+  GNUNET_free_non_null (job->block);
+  GNUNET_free (job->label);
+  GNUNET_free (job->rd_ser);
+  GNUNET_free (job);
+}
+
+
+/**
+ * Free all jobs in a DLL.
+ *
+ * @param head head of the DLL
+ * @param tail tail of the DLL
+ */
+static void
+free_jobs (struct PublishJob **head,
+           struct PublishJob **tail)
+{
+  struct PublishJob *job;
+
+  while (NULL != (job = *head))
+  {
+    GNUNET_CONTAINER_DLL_remove (*head,
+                                 *tail,
+                                 job);
+    free_job (job);
+  }
+}
+
+
+/**
+ * Remove an entry from the #block_cache and free it.
+ *
+ * @param ce entry to remove
+ */
+static void
+cache_remove (struct CacheEntry *ce)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (block_cache,
+                                                       &ce->key,
+                                                       ce));
+  GNUNET_CONTAINER_DLL_remove (cache_head,
+                               cache_tail,
+                               ce);
+  GNUNET_free (ce->block);
+  GNUNET_free (ce);
+}
+
+
+/**
+ * Update the statistics on our publication rate.
+ *
+ * @param force #GNUNET_YES to update even if the last update
+ *        was recent
+ */
+static void
+update_rate_statistics (int force)
+{
+  struct GNUNET_TIME_Relative delta;
+
+  delta = GNUNET_TIME_absolute_get_duration (rate_time);
+  if ( (GNUNET_YES != force) &&
+       (delta.rel_value_us < RATE_STATISTICS_INTERVAL.rel_value_us) )
+    return;
+  if (delta.rel_value_us > 0)
+    GNUNET_STATISTICS_set (statistics,
+                           "Records published per second",
+                           rate_puts * 1000LL * 1000LL / delta.rel_value_us,
+                           GNUNET_NO);
+  GNUNET_STATISTICS_set (statistics,
+                         "Blocks signed",
+                         blocks_signed,
+                         GNUNET_NO);
+  GNUNET_STATISTICS_set (statistics,
+                         "Blocks taken from cache",
+                         blocks_cached,
+                         GNUNET_NO);
+  rate_time = GNUNET_TIME_absolute_get ();
+  rate_puts = 0;
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Stop and join the worker threads.
+ */
+static void
+stop_workers ()
+{
+  unsigned int i;
+
+  if (0 == num_workers)
+    return;
+  GNUNET_assert (0 == pthread_mutex_lock (&jobs_lock));
+  workers_stop = GNUNET_YES;
+  GNUNET_assert (0 == pthread_cond_broadcast (&jobs_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&jobs_lock));
+  for (i = 0; i < num_workers; i++)
+    GNUNET_assert (0 == pthread_join (workers[i],
+                                      NULL));
+  num_workers = 0;
+  GNUNET_free (workers);
+  workers = NULL;
+  GNUNET_assert (0 == pthread_cond_destroy (&jobs_cond));
+  GNUNET_assert (0 == pthread_mutex_destroy (&jobs_lock));
+}
+#endif
+
+
 /**
  * Task run during shutdown.
  *
@@ -189,17 +556,34 @@ static int first_zone_iteration;
 static void
 shutdown_task (void *cls)
 {
-  struct MonitorActivity *ma;
-
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Shutting down!\n");
-  while (NULL != (ma = ma_head))
+#if HAVE_PTHREAD_H
+  stop_workers ();
+#endif
+  if (NULL != notify_task)
+  {
+    GNUNET_SCHEDULER_cancel (notify_task);
+    notify_task = NULL;
+  }
+  if (NULL != notify_pipe)
   {
-    GNUNET_DHT_put_cancel (ma->ph);
-    GNUNET_CONTAINER_DLL_remove (ma_head,
-                                 ma_tail,
-                                 ma);
-    GNUNET_free (ma);
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_pipe_close (notify_pipe));
+    notify_pipe = NULL;
+  }
+  free_jobs (&sign_head,
+             &sign_tail);
+  free_jobs (&signed_head,
+             &signed_tail);
+  free_jobs (&put_head,
+             &put_tail);
+  if (NULL != block_cache)
+  {
+    while (NULL != cache_head)
+      cache_remove (cache_head);
+    GNUNET_CONTAINER_multihashmap_destroy (block_cache);
+    block_cache = NULL;
   }
   if (NULL != statistics)
   {
@@ -227,11 +611,6 @@ shutdown_task (void *cls)
     GNUNET_NAMESTORE_disconnect (namestore_handle);
     namestore_handle = NULL;
   }
-  if (NULL != active_put)
-  {
-    GNUNET_DHT_put_cancel (active_put);
-    active_put = NULL;
-  }
   if (NULL != dht_handle)
   {
     GNUNET_DHT_disconnect (dht_handle);
@@ -248,9 +627,74 @@ shutdown_task (void *cls)
 static void
 publish_zone_dht_next (void *cls)
 {
+  uint64_t limit;
+
   zone_publish_task = NULL;
   GNUNET_assert (NULL != namestore_iter);
-  GNUNET_NAMESTORE_zone_iterator_next (namestore_iter);
+  GNUNET_assert (0 == ns_iteration_left);
+  /* ask for as many records as we should publish in
+     #MINIMUM_ZONE_ITERATION_INTERVAL, bounded by the free window */
+  limit = MINIMUM_ZONE_ITERATION_INTERVAL.rel_value_us
+    / GNUNET_MAX (1, put_interval.rel_value_us);
+  limit = GNUNET_MAX (1, limit);
+  limit = GNUNET_MIN (limit, NS_BLOCK_SIZE);
+  if (max_parallel_puts > iteration_jobs)
+    limit = GNUNET_MIN (limit, max_parallel_puts - iteration_jobs);
+  else
+    limit = 1;
+  ns_iteration_left = limit;
+  last_request_time = GNUNET_TIME_absolute_get ();
+  last_request_size = limit;
+  GNUNET_NAMESTORE_zone_iterator_next (namestore_iter,
+                                       limit);
+}
+
+
+/**
+ * We received all records we asked the namestore for.  Ask for the
+ * next batch once we are due to publish it and have room for it.
+ */
+static void
+schedule_next_request ()
+{
+  struct GNUNET_TIME_Relative next_put_interval;
+  struct GNUNET_TIME_Relative delay;
+
+  if ( (NULL == namestore_iter) ||
+       (0 != ns_iteration_left) ||
+       (NULL != zone_publish_task) )
+    return;
+  if (iteration_jobs >= max_parallel_puts)
+    return; /* continued once a job completes */
+  if ( (num_public_records > last_num_public_records) &&
+       (GNUNET_NO == first_zone_iteration) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Last record count was lower than current record count.  Reducing interval.\n");
+    put_interval = GNUNET_TIME_relative_divide (zone_publish_time_window,
+                                                num_public_records);
+    next_put_interval = GNUNET_TIME_relative_divide (put_interval,
+                                                     LATE_ITERATION_SPEEDUP_FACTOR);
+  }
+  else
+    next_put_interval = put_interval;
+  next_put_interval = GNUNET_TIME_relative_min (next_put_interval,
+                                                MAXIMUM_ZONE_ITERATION_INTERVAL);
+  GNUNET_STATISTICS_set (statistics,
+                         "Current zone iteration interval (ms)",
+                         next_put_interval.rel_value_us / 1000LL,
+                         GNUNET_NO);
+  delay = GNUNET_TIME_absolute_get_remaining
+    (GNUNET_TIME_absolute_add (last_request_time,
+                               GNUNET_TIME_relative_multiply (next_put_interval,
+                                                              (unsigned int) last_request_size)));
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Requesting next records in %s!\n",
+              GNUNET_STRINGS_relative_time_to_string (delay,
+                                                      GNUNET_YES));
+  zone_publish_task = GNUNET_SCHEDULER_add_delayed (delay,
+                                                    &publish_zone_dht_next,
+                                                    NULL);
 }
 
 
@@ -266,56 +710,49 @@ publish_zone_dht_start (void *cls);
 /**
  * Continuation called from DHT once the PUT operation is done.
  *
- * @param cls closure, NULL if called from regular iteration,
- *        `struct MonitorActivity` if called from #handle_monitor_event.
+ * @param cls the `struct PublishJob`
  * @param success #GNUNET_OK on success
  */
 static void
 dht_put_continuation (void *cls,
                       int success)
 {
-  struct MonitorActivity *ma = cls;
-  struct GNUNET_TIME_Relative next_put_interval;
+  struct PublishJob *job = cls;
+  int from_monitor;
+
+  job->ph = NULL;
+  from_monitor = job->from_monitor;
+  GNUNET_CONTAINER_DLL_remove (put_head,
+                               put_tail,
+                               job);
+  free_job (job);
+  rate_puts++;
+  update_rate_statistics (GNUNET_NO);
+  if (GNUNET_YES == from_monitor)
+    return;
+  GNUNET_assert (iteration_jobs > 0);
+  iteration_jobs--;
+  schedule_next_request ();
+}
 
-  num_public_records++;
-  if (NULL == ma)
-  {
-    active_put = NULL;
-    if ( (num_public_records > last_num_public_records) &&
-         (GNUNET_NO == first_zone_iteration) )
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                  "Last record count was lower than current record count.  Reducing interval.\n");
-      put_interval = GNUNET_TIME_relative_divide (zone_publish_time_window,
-                                                  num_public_records);
-      next_put_interval = GNUNET_TIME_relative_divide (put_interval,
-                                                       LATE_ITERATION_SPEEDUP_FACTOR);
-    }
-    else
-      next_put_interval = put_interval;
-    next_put_interval = GNUNET_TIME_relative_min (next_put_interval,
-                                                  MAXIMUM_ZONE_ITERATION_INTERVAL);
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "PUT complete, next PUT in %s!\n",
-                GNUNET_STRINGS_relative_time_to_string (next_put_interval,
-                                                        GNUNET_YES));
 
-    GNUNET_STATISTICS_set (statistics,
-                           "Current zone iteration interval (ms)",
-                           next_put_interval.rel_value_us / 1000LL,
-                           GNUNET_NO);
-    GNUNET_assert (NULL == zone_publish_task);
-    zone_publish_task = GNUNET_SCHEDULER_add_delayed (next_put_interval,
-                                                      &publish_zone_dht_next,
-                                                      NULL);
-  }
-  else
-  {
-    GNUNET_CONTAINER_DLL_remove (ma_head,
-                                 ma_tail,
-                                 ma);
-    GNUNET_free (ma);
-  }
+/**
+ * A job is done without a DHT PUT.
+ *
+ * @param job the job
+ */
+static void
+job_failed (struct PublishJob *job)
+{
+  int from_monitor;
+
+  from_monitor = job->from_monitor;
+  free_job (job);
+  if (GNUNET_YES == from_monitor)
+    return;
+  GNUNET_assert (iteration_jobs > 0);
+  iteration_jobs--;
+  schedule_next_request ();
 }
 
 
@@ -364,61 +801,427 @@ convert_records_for_export (const struct GNUNET_GNSRECORD_Data *rd,
 
 
 /**
- * Store GNS records in the DHT.
+ * Sign the records of a job.  Called by the workers without holding
+ * #jobs_lock, must not use the scheduler.
  *
- * @param key key of the zone
- * @param label label to store under
- * @param rd_public public record data
- * @param rd_public_count number of records in @a rd_public
- * @param pc_arg closure argument to pass to the #dht_put_continuation
- * @return DHT PUT handle, NULL on error
+ * @param job job to sign
  */
-static struct GNUNET_DHT_PutHandle *
-perform_dht_put (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
-                 const char *label,
-                 const struct GNUNET_GNSRECORD_Data *rd_public,
-                 unsigned int rd_public_count,
-                 void *pc_arg)
+static void
+sign_job (struct PublishJob *job)
+{
+  struct GNUNET_GNSRECORD_Data rd[job->rd_count];
+
+  if (GNUNET_OK !=
+      GNUNET_GNSRECORD_records_deserialize (job->rd_ser_len,
+                                            job->rd_ser,
+                                            job->rd_count,
+                                            rd))
+    return;
+  job->block = GNUNET_GNSRECORD_block_create (&job->zone,
+                                              job->expire,
+                                              job->label,
+                                              rd,
+                                              job->rd_count);
+  GNUNET_GNSRECORD_query_from_private_key (&job->zone,
+                                           job->label,
+                                           &job->query);
+}
+
+
+/**
+ * Store a signed block in the DHT.
+ *
+ * @param job job to store the block for
+ * @param block the block
+ * @param query DHT key for the block
+ * @param expire expiration time of the block
+ */
+static void
+start_put (struct PublishJob *job,
+           const struct GNUNET_GNSRECORD_Block *block,
+           const struct GNUNET_HashCode *query,
+           struct GNUNET_TIME_Absolute expire)
 {
-  struct GNUNET_GNSRECORD_Block *block;
-  struct GNUNET_HashCode query;
-  struct GNUNET_TIME_Absolute expire;
   size_t block_size;
-  struct GNUNET_DHT_PutHandle *ret;
-
-  expire = GNUNET_GNSRECORD_record_get_expiration_time (rd_public_count,
-                                                        rd_public);
-  block = GNUNET_GNSRECORD_block_create (key,
-                                         expire,
-                                         label,
-                                         rd_public,
-                                         rd_public_count);
-  if (NULL == block)
-    return NULL; /* whoops */
+
   block_size = ntohl (block->purpose.size)
     + sizeof (struct GNUNET_CRYPTO_EcdsaSignature)
     + sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey);
-  GNUNET_GNSRECORD_query_from_private_key (key,
-                                           label,
-                                           &query);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Storing %u record(s) for label `%s' in DHT with expiration `%s' under key %s\n",
-              rd_public_count,
-              label,
+              job->rd_count,
+              job->label,
               GNUNET_STRINGS_absolute_time_to_string (expire),
-              GNUNET_h2s (&query));
-  ret = GNUNET_DHT_put (dht_handle,
-                        &query,
-                        DHT_GNS_REPLICATION_LEVEL,
-                        GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
-                        GNUNET_BLOCK_TYPE_GNS_NAMERECORD,
-                        block_size,
-                        block,
-                        expire,
-                        &dht_put_continuation,
-                        pc_arg);
-  GNUNET_free (block);
-  return ret;
+              GNUNET_h2s (query));
+  job->ph = GNUNET_DHT_put (dht_handle,
+                            query,
+                            DHT_GNS_REPLICATION_LEVEL,
+                            GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
+                            GNUNET_BLOCK_TYPE_GNS_NAMERECORD,
+                            block_size,
+                            block,
+                            expire,
+                            &dht_put_continuation,
+                            job);
+  if (NULL == job->ph)
+  {
+    GNUNET_break (0);
+    job_failed (job);
+    return;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (put_head,
+                                    put_tail,
+                                    job);
+}
+
+
+/**
+ * A job was signed, remember the block and store it in the DHT.
+ *
+ * @param job the signed job
+ */
+static void
+finish_signing (struct PublishJob *job)
+{
+  struct CacheEntry *ce;
+
+  if (NULL == job->block)
+  {
+    GNUNET_break (0);
+    job_failed (job);
+    return;
+  }
+  blocks_signed++;
+  if (0 != block_cache_size)
+  {
+    if (GNUNET_CONTAINER_multihashmap_size (block_cache) >= block_cache_size)
+      cache_remove (cache_tail);
+    ce = GNUNET_new (struct CacheEntry);
+    ce->key = job->cache_key;
+    ce->query = job->query;
+    ce->expire = job->expire;
+    ce->block = job->block;
+    job->block = NULL;
+    if (GNUNET_OK !=
+        GNUNET_CONTAINER_multihashmap_put (block_cache,
+                                           &ce->key,
+                                           ce,
+                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
+    {
+      /* the same record set was signed twice at the same time */
+      job->block = ce->block;
+      GNUNET_free (ce);
+    }
+    else
+    {
+      GNUNET_CONTAINER_DLL_insert (cache_head,
+                                   cache_tail,
+                                   ce);
+      start_put (job,
+                 ce->block,
+                 &ce->query,
+                 ce->expire);
+      return;
+    }
+  }
+  start_put (job,
+             job->block,
+             &job->query,
+             job->expire);
+}
+
+
+#if HAVE_PTHREAD_H
+/**
+ * Main function of a worker thread: sign jobs until we shut down.
+ *
+ * @param cls NULL
+ * @return NULL
+ */
+static void *
+worker_main (void *cls)
+{
+  const struct GNUNET_DISK_FileHandle *wh;
+  struct PublishJob *job;
+  int notify;
+  char c;
+
+  wh = GNUNET_DISK_pipe_handle (notify_pipe,
+                                GNUNET_DISK_PIPE_END_WRITE);
+  GNUNET_assert (0 == pthread_mutex_lock (&jobs_lock));
+  while (GNUNET_NO == workers_stop)
+  {
+    job = sign_head;
+    if (NULL == job)
+    {
+      GNUNET_assert (0 == pthread_cond_wait (&jobs_cond,
+                                             &jobs_lock));
+      continue;
+    }
+    GNUNET_CONTAINER_DLL_remove (sign_head,
+                                 sign_tail,
+                                 job);
+    GNUNET_assert (0 == pthread_mutex_unlock (&jobs_lock));
+    sign_job (job);
+    GNUNET_assert (0 == pthread_mutex_lock (&jobs_lock));
+    /* only wake up the main thread for the first job of a batch */
+    notify = (NULL == signed_head);
+    GNUNET_CONTAINER_DLL_insert_tail (signed_head,
+                                      signed_tail,
+                                      job);
+    if (notify)
+    {
+      c = 0;
+      (void) GNUNET_DISK_file_write (wh,
+                                     &c,
+                                     sizeof (c));
+    }
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&jobs_lock));
+  return NULL;
+}
+
+
+/**
+ * The workers signed some jobs, store them in the DHT.
+ *
+ * @param cls NULL
+ */
+static void
+process_signed_jobs (void *cls)
+{
+  const struct GNUNET_DISK_FileHandle *rh;
+  struct PublishJob *head;
+  struct PublishJob *job;
+  char buf[64];
+
+  rh = GNUNET_DISK_pipe_handle (notify_pipe,
+                                GNUNET_DISK_PIPE_END_READ);
+  notify_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                rh,
+                                                &process_signed_jobs,
+                                                NULL);
+  /* drain the pipe before taking the jobs, so that we do not miss
+     a notification for jobs queued after we took them */
+  (void) GNUNET_DISK_file_read_non_blocking (rh,
+                                             buf,
+                                             sizeof (buf));
+  GNUNET_assert (0 == pthread_mutex_lock (&jobs_lock));
+  head = signed_head;
+  signed_head = NULL;
+  signed_tail = NULL;
+  GNUNET_assert (0 == pthread_mutex_unlock (&jobs_lock));
+  while (NULL != (job = head))
+  {
+    head = job->next;
+    job->next = NULL;
+    job->prev = NULL;
+    finish_signing (job);
+  }
+}
+
+
+/**
+ * Start the worker threads and the task waiting for their results.
+ * If no thread can be started, we sign in the main thread.
+ *
+ * @param num_threads number of threads to start
+ */
+static void
+start_workers (unsigned int num_threads)
+{
+  if (0 == num_threads)
+    return;
+  notify_pipe = GNUNET_DISK_pipe (GNUNET_NO,
+                                  GNUNET_NO,
+                                  GNUNET_NO,
+                                  GNUNET_NO);
+  if (NULL == notify_pipe)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "pipe");
+    return;
+  }
+  GNUNET_assert (0 == pthread_mutex_init (&jobs_lock,
+                                          NULL));
+  GNUNET_assert (0 == pthread_cond_init (&jobs_cond,
+                                         NULL));
+  workers = GNUNET_new_array (num_threads,
+                              pthread_t);
+  while (num_workers < num_threads)
+  {
+    if (0 != pthread_create (&workers[num_workers],
+                             NULL,
+                             &worker_main,
+                             NULL))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "pthread_create");
+      break;
+    }
+    num_workers++;
+  }
+  if (0 == num_workers)
+  {
+    GNUNET_free (workers);
+    workers = NULL;
+    GNUNET_assert (0 == pthread_cond_destroy (&jobs_cond));
+    GNUNET_assert (0 == pthread_mutex_destroy (&jobs_lock));
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_pipe_close (notify_pipe));
+    notify_pipe = NULL;
+    return;
+  }
+  notify_task
+    = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                      GNUNET_DISK_pipe_handle (notify_pipe,
+                                                               GNUNET_DISK_PIPE_END_READ),
+                                      &process_signed_jobs,
+                                      NULL);
+}
+#endif
+
+
+/**
+ * Compute the key of a record set in the #block_cache.  Record sets
+ * with relative expiration times map to a new key once a quarter of
+ * their shortest lifetime has passed, so that we never publish a
+ * cached block with less than three quarters of its lifetime left.
+ *
+ * @param zone private key of the zone
+ * @param label label of the records
+ * @param rd_ser serialized records
+ * @param rd_ser_len number of bytes in @a rd_ser
+ * @param rd the records
+ * @param rd_count number of records in @a rd
+ * @param[out] key set to the cache key
+ */
+static void
+get_cache_key (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+               const char *label,
+               const char *rd_ser,
+               size_t rd_ser_len,
+               const struct GNUNET_GNSRECORD_Data *rd,
+               unsigned int rd_count,
+               struct GNUNET_HashCode *key)
+{
+  struct GNUNET_HashContext *hc;
+  uint64_t bucket_size;
+  uint64_t bucket;
+  unsigned int i;
+
+  bucket_size = UINT64_MAX;
+  for (i = 0; i < rd_count; i++)
+    if (0 != (rd[i].flags & GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION))
+      bucket_size = GNUNET_MIN (bucket_size,
+                                rd[i].expiration_time / 4);
+  if (UINT64_MAX == bucket_size)
+    bucket = 0;
+  else
+    bucket = GNUNET_htonll (GNUNET_TIME_absolute_get ().abs_value_us
+                            / GNUNET_MAX (1, bucket_size));
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   zone,
+                                   sizeof (*zone));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   label,
+                                   strlen (label) + 1);
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   &bucket,
+                                   sizeof (bucket));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   rd_ser,
+                                   rd_ser_len);
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     key);
+}
+
+
+/**
+ * Publish a record set: take the block from the cache or have it
+ * signed, then store it in the DHT.
+ *
+ * @param zone private key of the zone
+ * @param label label of the records
+ * @param rd_public public record data
+ * @param rd_public_count number of records in @a rd_public
+ * @param from_monitor #GNUNET_YES if the records come from the monitor
+ */
+static void
+publish_records (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                 const char *label,
+                 const struct GNUNET_GNSRECORD_Data *rd_public,
+                 unsigned int rd_public_count,
+                 int from_monitor)
+{
+  struct PublishJob *job;
+  struct CacheEntry *ce;
+  ssize_t len;
+
+  job = GNUNET_new (struct PublishJob);
+  job->zone = *zone;
+  job->label = GNUNET_strdup (label);
+  job->rd_count = rd_public_count;
+  job->from_monitor = from_monitor;
+  if (GNUNET_NO == from_monitor)
+    iteration_jobs++;
+  len = GNUNET_GNSRECORD_records_get_size (rd_public_count,
+                                           rd_public);
+  job->rd_ser_len = (size_t) len;
+  job->rd_ser = GNUNET_malloc (job->rd_ser_len);
+  if (len !=
+      GNUNET_GNSRECORD_records_serialize (rd_public_count,
+                                          rd_public,
+                                          job->rd_ser_len,
+                                          job->rd_ser))
+  {
+    GNUNET_break (0);
+    job_failed (job);
+    return;
+  }
+  job->expire = GNUNET_GNSRECORD_record_get_expiration_time (rd_public_count,
+                                                             rd_public);
+  get_cache_key (zone,
+                 label,
+                 job->rd_ser,
+                 job->rd_ser_len,
+                 rd_public,
+                 rd_public_count,
+                 &job->cache_key);
+  ce = (NULL == block_cache)
+    ? NULL
+    : GNUNET_CONTAINER_multihashmap_get (block_cache,
+                                         &job->cache_key);
+  if (NULL != ce)
+  {
+    blocks_cached++;
+    GNUNET_CONTAINER_DLL_remove (cache_head,
+                                 cache_tail,
+                                 ce);
+    GNUNET_CONTAINER_DLL_insert (cache_head,
+                                 cache_tail,
+                                 ce);
+    start_put (job,
+               ce->block,
+               &ce->query,
+               ce->expire);
+    return;
+  }
+#if HAVE_PTHREAD_H
+  if (0 != num_workers)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&jobs_lock));
+    GNUNET_CONTAINER_DLL_insert_tail (sign_head,
+                                      sign_tail,
+                                      job);
+    GNUNET_assert (0 == pthread_cond_signal (&jobs_cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&jobs_lock));
+    return;
+  }
+#endif
+  sign_job (job);
+  finish_signing (job);
 }
 
 
@@ -431,19 +1234,15 @@ zone_iteration_error (void *cls)
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Got disconnected from namestore database, retrying.\n");
   namestore_iter = NULL;
+  ns_iteration_left = 0;
   /* We end up here on error/disconnect/shutdown, so potentially
-     while a zone publish task or a DHT put is still running; hence
-     we need to cancel those. */
+     while a zone publish task is still running; hence we need to
+     cancel it.  Jobs in flight are completed. */
   if (NULL != zone_publish_task)
   {
     GNUNET_SCHEDULER_cancel (zone_publish_task);
     zone_publish_task = NULL;
   }
-  if (NULL != active_put)
-  {
-    GNUNET_DHT_put_cancel (active_put);
-    active_put = NULL;
-  }
   zone_publish_task = GNUNET_SCHEDULER_add_now (&publish_zone_dht_start,
                                                 NULL);
 }
@@ -455,8 +1254,17 @@ zone_iteration_error (void *cls)
 static void
 zone_iteration_finished (void *cls)
 {
+  struct GNUNET_TIME_Relative duration;
+
   /* we're done with one iteration, calculate when to do the next one */
   namestore_iter = NULL;
+  ns_iteration_left = 0;
+  if (NULL != zone_publish_task)
+  {
+    /* waiting to request more records */
+    GNUNET_SCHEDULER_cancel (zone_publish_task);
+    zone_publish_task = NULL;
+  }
   last_num_public_records = num_public_records;
   first_zone_iteration = GNUNET_NO;
   if (0 == num_public_records)
@@ -483,8 +1291,6 @@ zone_iteration_finished (void *cls)
   }
   /* reset for next iteration */
   min_relative_record_time = GNUNET_TIME_UNIT_FOREVER_REL;
-  put_interval = GNUNET_TIME_relative_max (MINIMUM_ZONE_ITERATION_INTERVAL,
-                                           put_interval);
   put_interval = GNUNET_TIME_relative_min (put_interval,
                                            MAXIMUM_ZONE_ITERATION_INTERVAL);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -503,6 +1309,13 @@ zone_iteration_finished (void *cls)
                          "Number of public records in DHT",
                          last_num_public_records,
                          GNUNET_NO);
+  duration = GNUNET_TIME_absolute_get_duration (iteration_start_time);
+  if (duration.rel_value_us > 0)
+    GNUNET_STATISTICS_set (statistics,
+                           "Records per second in last zone iteration",
+                           last_num_public_records * 1000LL * 1000LL / duration.rel_value_us,
+                           GNUNET_NO);
+  update_rate_statistics (GNUNET_YES);
   GNUNET_assert (NULL == zone_publish_task);
   if (0 == num_public_records)
     zone_publish_task = GNUNET_SCHEDULER_add_delayed (put_interval,
@@ -533,32 +1346,28 @@ put_gns_record (void *cls,
   struct GNUNET_GNSRECORD_Data rd_public[rd_count];
   unsigned int rd_public_count;
 
+  GNUNET_break (ns_iteration_left > 0);
+  if (ns_iteration_left > 0)
+    ns_iteration_left--;
   rd_public_count = convert_records_for_export (rd,
                                                 rd_count,
                                                 rd_public);
-
   if (0 == rd_public_count)
   {
-    GNUNET_assert (NULL == zone_publish_task);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Record set empty, moving to next record set\n");
-    zone_publish_task = GNUNET_SCHEDULER_add_now (&publish_zone_dht_next,
-                                                  NULL);
-    return;
   }
-  /* We got a set of records to publish */
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Starting DHT PUT\n");
-  active_put = perform_dht_put (key,
-                                label,
-                                rd_public,
-                                rd_public_count,
-                                NULL);
-  if (NULL == active_put)
+  else
   {
-    GNUNET_break (0);
-    dht_put_continuation (NULL, GNUNET_NO);
+    /* We got a set of records to publish */
+    num_public_records++;
+    publish_records (key,
+                     label,
+                     rd_public,
+                     rd_public_count,
+                     GNUNET_NO);
   }
+  schedule_next_request ();
 }
 
 
@@ -576,6 +1385,11 @@ publish_zone_dht_start (void *cls)
               "Starting DHT zone update!\n");
   /* start counting again */
   num_public_records = 0;
+  iteration_start_time = GNUNET_TIME_absolute_get ();
+  /* the namestore returns the first record right away */
+  ns_iteration_left = 1;
+  last_request_time = iteration_start_time;
+  last_request_size = 1;
   GNUNET_assert (NULL == namestore_iter);
   namestore_iter
     = GNUNET_NAMESTORE_zone_iteration_start (namestore_handle,
@@ -608,7 +1422,6 @@ handle_monitor_event (void *cls,
 {
   struct GNUNET_GNSRECORD_Data rd_public[rd_count];
   unsigned int rd_public_count;
-  struct MonitorActivity *ma;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received %u records for label `%s' via namestore monitor\n",
@@ -621,21 +1434,11 @@ handle_monitor_event (void *cls,
                                                 rd_public);
   if (0 == rd_public_count)
     return; /* nothing to do */
-  ma = GNUNET_new (struct MonitorActivity);
-  ma->ph = perform_dht_put (zone,
-                            label,
-                            rd,
-                            rd_count,
-                            ma);
-  if (NULL == ma->ph)
-  {
-    /* PUT failed, do not remember operation */
-    GNUNET_free (ma);
-    return;
-  }
-  GNUNET_CONTAINER_DLL_insert (ma_head,
-                               ma_tail,
-                               ma);
+  publish_records (zone,
+                   label,
+                   rd_public,
+                   rd_public_count,
+                   GNUNET_YES);
 }
 
 
@@ -674,16 +1477,30 @@ handle_monitor_error (void *cls)
     GNUNET_NAMESTORE_zone_iteration_stop (namestore_iter);
     namestore_iter = NULL;
   }
-  if (NULL != active_put)
-  {
-    GNUNET_DHT_put_cancel (active_put);
-    active_put = NULL;
-  }
+  ns_iteration_left = 0;
   zone_publish_task = GNUNET_SCHEDULER_add_now (&publish_zone_dht_start,
                                                 NULL);
 }
 
 
+/**
+ * Determine how many signing threads to use by default.
+ *
+ * @return number of online CPUs minus one
+ */
+static unsigned int
+default_thread_count ()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 1)
+    return (unsigned int) (n - 1);
+#endif
+  return 0;
+}
+
+
 /**
  * Performe zonemaster duties: watch namestore, publish records.
  *
@@ -697,6 +1514,7 @@ run (void *cls,
      struct GNUNET_SERVICE_Handle *service)
 {
   unsigned long long max_parallel_bg_queries = 128;
+  unsigned long long num_threads;
 
   min_relative_record_time = GNUNET_TIME_UNIT_FOREVER_REL;
   namestore_handle = GNUNET_NAMESTORE_connect (c);
@@ -733,7 +1551,27 @@ run (void *cls,
                 max_parallel_bg_queries);
   }
   if (0 == max_parallel_bg_queries)
-    max_parallel_bg_queries = 1;	  
+    max_parallel_bg_queries = 1;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (c,
+                                             "zonemaster",
+                                             "MAX_PARALLEL_PUTS",
+                                             &max_parallel_puts))
+    max_parallel_puts = DEFAULT_MAX_PARALLEL_PUTS;
+  if (0 == max_parallel_puts)
+    max_parallel_puts = 1;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (c,
+                                             "zonemaster",
+                                             "BLOCK_CACHE_SIZE",
+                                             &block_cache_size))
+    block_cache_size = DEFAULT_BLOCK_CACHE_SIZE;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (c,
+                                             "zonemaster",
+                                             "SIGNING_THREADS",
+                                             &num_threads))
+    num_threads = default_thread_count ();
   dht_handle = GNUNET_DHT_connect (c,
                                    (unsigned int) max_parallel_bg_queries);
   if (NULL == dht_handle)
@@ -743,6 +1581,19 @@ run (void *cls,
     GNUNET_SCHEDULER_add_now (&shutdown_task, NULL);
     return;
   }
+  if (0 != block_cache_size)
+    block_cache = GNUNET_CONTAINER_multihashmap_create (GNUNET_MIN (block_cache_size,
+                                                                    1024),
+                                                        GNUNET_NO);
+#if HAVE_PTHREAD_H
+  start_workers ((unsigned int) GNUNET_MIN (num_threads,
+                                            1024));
+#endif
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Signing blocks with %u worker threads, up to %llu PUTs in parallel\n",
+              num_workers,
+              max_parallel_puts);
+  rate_time = GNUNET_TIME_absolute_get ();
 
   /* Schedule periodic put for our records. */
   first_zone_iteration = GNUNET_YES;\
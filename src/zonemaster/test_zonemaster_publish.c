@@ -0,0 +1,454 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2018 GNUnet e.V.
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file zonemaster/test_zonemaster_publish.c
+ * @brief testcase for the zone publication of gnunet-service-zonemaster:
+ *        blocks are signed by the worker threads once and then taken
+ *        from the cache, unless the expiration bucket of a record set
+ *        with relative expiration time changed
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_arm_service.h"
+#include "gnunet_namestore_service.h"
+#include "gnunet_statistics_service.h"
+#include "gnunet_testing_lib.h"
+#include <gauger.h>
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 60)
+
+#define TEST_RECORD_TYPE 1234
+
+/**
+ * Number of record sets with an absolute expiration time.
+ */
+#define NUM_ABSOLUTE 500
+
+/**
+ * Relative expiration time of our one record set with a relative
+ * expiration time.  A quarter of it is the size of its expiration
+ * bucket and the time window for publishing the zone.
+ */
+#define RELATIVE_EXPIRATION GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 4)
+
+/**
+ * Number of zone iterations we watch.
+ */
+#define NUM_ITERATIONS 4
+
+
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+static struct GNUNET_NAMESTORE_Handle *nsh;
+
+static struct GNUNET_NAMESTORE_QueueEntry *nsqe;
+
+static struct GNUNET_STATISTICS_Handle *stats;
+
+static struct GNUNET_ARM_Handle *arm;
+
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+static struct GNUNET_SCHEDULER_Task *check_task;
+
+static struct GNUNET_CRYPTO_EcdsaPrivateKey *privkey;
+
+/**
+ * Number of record sets we stored so far.
+ */
+static unsigned int records_stored;
+
+/**
+ * Latest value of "Number of zone iterations".
+ */
+static uint64_t iterations;
+
+/**
+ * Latest value of "Blocks signed".
+ */
+static uint64_t blocks_signed;
+
+/**
+ * Latest value of "Blocks taken from cache".
+ */
+static uint64_t blocks_cached;
+
+/**
+ * Records per second in the first zone iteration.
+ */
+static uint64_t first_rate;
+
+static int res;
+
+
+static void
+cleanup ()
+{
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  if (NULL != check_task)
+  {
+    GNUNET_SCHEDULER_cancel (check_task);
+    check_task = NULL;
+  }
+  if (NULL != nsqe)
+  {
+    GNUNET_NAMESTORE_cancel (nsqe);
+    nsqe = NULL;
+  }
+  if (NULL != nsh)
+  {
+    GNUNET_NAMESTORE_disconnect (nsh);
+    nsh = NULL;
+  }
+  if (NULL != stats)
+  {
+    GNUNET_STATISTICS_destroy (stats,
+                               GNUNET_NO);
+    stats = NULL;
+  }
+  if (NULL != arm)
+  {
+    GNUNET_ARM_disconnect (arm);
+    arm = NULL;
+  }
+  if (NULL != privkey)
+  {
+    GNUNET_free (privkey);
+    privkey = NULL;
+  }
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+static void
+endbadly (void *cls)
+{
+  timeout_task = NULL;
+  fprintf (stderr,
+           "Timeout after %llu zone iterations, %llu blocks signed, %llu taken from cache\n",
+           (unsigned long long) iterations,
+           (unsigned long long) blocks_signed,
+           (unsigned long long) blocks_cached);
+  res = 1;
+  cleanup ();
+}
+
+
+/**
+ * We watched #NUM_ITERATIONS zone iterations, check the statistics.
+ *
+ * @param cls NULL
+ */
+static void
+check_statistics (void *cls)
+{
+  check_task = NULL;
+  res = 0;
+  /* each record set with absolute expiration was signed once, the
+     one with relative expiration at most once per iteration */
+  if (blocks_signed > NUM_ABSOLUTE + iterations + 1)
+  {
+    fprintf (stderr,
+             "%llu blocks signed, unchanged record sets were signed again\n",
+             (unsigned long long) blocks_signed);
+    res = 2;
+  }
+  /* the iterations span more than one expiration bucket */
+  if (blocks_signed < NUM_ABSOLUTE + 2)
+  {
+    fprintf (stderr,
+             "%llu blocks signed, block was reused in a new expiration bucket\n",
+             (unsigned long long) blocks_signed);
+    res = 3;
+  }
+  if (blocks_cached < NUM_ABSOLUTE * (iterations - 1))
+  {
+    fprintf (stderr,
+             "Only %llu blocks taken from cache\n",
+             (unsigned long long) blocks_cached);
+    res = 4;
+  }
+  if (0 == first_rate)
+  {
+    fprintf (stderr,
+             "No publication rate reported\n");
+    res = 5;
+  }
+  cleanup ();
+}
+
+
+static int
+watch_iterations (void *cls,
+                  const char *subsystem,
+                  const char *name,
+                  uint64_t value,
+                  int is_persistent)
+{
+  iterations = value;
+  return GNUNET_OK;
+}
+
+
+static int
+watch_rate (void *cls,
+            const char *subsystem,
+            const char *name,
+            uint64_t value,
+            int is_persistent)
+{
+  /* set right after the number of iterations was updated */
+  if (1 == iterations)
+    first_rate = value;
+  return GNUNET_OK;
+}
+
+
+static int
+watch_signed (void *cls,
+              const char *subsystem,
+              const char *name,
+              uint64_t value,
+              int is_persistent)
+{
+  blocks_signed = value;
+  return GNUNET_OK;
+}
+
+
+static int
+watch_cached (void *cls,
+              const char *subsystem,
+              const char *name,
+              uint64_t value,
+              int is_persistent)
+{
+  /* set last when an iteration finishes */
+  blocks_cached = value;
+  if ( (iterations >= NUM_ITERATIONS) &&
+       (NULL == check_task) )
+    check_task = GNUNET_SCHEDULER_add_now (&check_statistics,
+                                           NULL);
+  return GNUNET_OK;
+}
+
+
+static void
+arm_cont (void *cls,
+          enum GNUNET_ARM_RequestStatus rs,
+          enum GNUNET_ARM_Result result)
+{
+  if ( (GNUNET_ARM_REQUEST_SENT_OK != rs) ||
+       ( (GNUNET_ARM_RESULT_STARTING != result) &&
+         (GNUNET_ARM_RESULT_IS_STARTING_ALREADY != result) &&
+         (GNUNET_ARM_RESULT_IS_STARTED_ALREADY != result) ) )
+  {
+    fprintf (stderr,
+             "Failed to start zonemaster\n");
+    res = 1;
+    cleanup ();
+  }
+}
+
+
+/**
+ * The zone is stored, start the zonemaster to publish it.
+ */
+static void
+start_zonemaster ()
+{
+  stats = GNUNET_STATISTICS_create ("test-zonemaster",
+                                    cfg);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (stats,
+                                          "zonemaster",
+                                          "Number of zone iterations",
+                                          &watch_iterations,
+                                          NULL));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (stats,
+                                          "zonemaster",
+                                          "Records per second in last zone iteration",
+                                          &watch_rate,
+                                          NULL));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (stats,
+                                          "zonemaster",
+                                          "Blocks signed",
+                                          &watch_signed,
+                                          NULL));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_STATISTICS_watch (stats,
+                                          "zonemaster",
+                                          "Blocks taken from cache",
+                                          &watch_cached,
+                                          NULL));
+  arm = GNUNET_ARM_connect (cfg,
+                            NULL,
+                            NULL);
+  GNUNET_assert (NULL != arm);
+  GNUNET_ARM_request_service_start (arm,
+                                    "zonemaster",
+                                    GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
+                                    &arm_cont,
+                                    NULL);
+}
+
+
+static void
+store_next ();
+
+
+static void
+put_cont (void *cls,
+          int32_t success,
+          const char *emsg)
+{
+  nsqe = NULL;
+  if (GNUNET_OK != success)
+  {
+    fprintf (stderr,
+             "Failed to store records: %s\n",
+             emsg);
+    res = 1;
+    cleanup ();
+    return;
+  }
+  records_stored++;
+  store_next ();
+}
+
+
+/**
+ * Store the next record set of our zone: first the one with a
+ * relative expiration time, then those with an absolute one.
+ */
+static void
+store_next ()
+{
+  struct GNUNET_GNSRECORD_Data rd;
+  uint32_t data;
+  char label[16];
+
+  if (NUM_ABSOLUTE + 1 == records_stored)
+  {
+    start_zonemaster ();
+    return;
+  }
+  memset (&rd, 0, sizeof (rd));
+  data = htonl (records_stored);
+  rd.data = &data;
+  rd.data_size = sizeof (data);
+  rd.record_type = TEST_RECORD_TYPE;
+  if (0 == records_stored)
+  {
+    rd.expiration_time = RELATIVE_EXPIRATION.rel_value_us;
+    rd.flags = GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION;
+    strcpy (label, "relative");
+  }
+  else
+  {
+    rd.expiration_time
+      = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_WEEKS).abs_value_us;
+    rd.flags = GNUNET_GNSRECORD_RF_NONE;
+    GNUNET_snprintf (label,
+                     sizeof (label),
+                     "absolute%u",
+                     records_stored);
+  }
+  nsqe = GNUNET_NAMESTORE_records_store (nsh,
+                                         privkey,
+                                         label,
+                                         1,
+                                         &rd,
+                                         &put_cont,
+                                         NULL);
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *c,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  cfg = c;
+  timeout_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                               &endbadly,
+                                               NULL);
+  privkey = GNUNET_CRYPTO_ecdsa_key_create ();
+  GNUNET_assert (NULL != privkey);
+  nsh = GNUNET_NAMESTORE_connect (cfg);
+  GNUNET_break (NULL != nsh);
+  store_next ();
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  const char *cfg_name = "test_zonemaster_publish.conf";
+  struct GNUNET_CONFIGURATION_Handle *c;
+  char *directory;
+
+  c = GNUNET_CONFIGURATION_create ();
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_load (c,
+                                   cfg_name)) ||
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_filename (c,
+                                                 "PATHS",
+                                                 "GNUNET_TEST_HOME",
+                                                 &directory)) )
+  {
+    GNUNET_CONFIGURATION_destroy (c);
+    return 1;
+  }
+  GNUNET_CONFIGURATION_destroy (c);
+  /* start from an empty zone */
+  GNUNET_DISK_directory_remove (directory);
+  res = 1;
+  if (0 !=
+      GNUNET_TESTING_peer_run ("test-zonemaster-publish",
+                               cfg_name,
+                               &run,
+                               NULL))
+    res = 1;
+  GNUNET_DISK_directory_remove (directory);
+  GNUNET_free (directory);
+  if (0 == res)
+  {
+    FPRINTF (stderr,
+             "Published %u record sets at %llu records/s\n",
+             NUM_ABSOLUTE + 1,
+             (unsigned long long) first_rate);
+    GAUGER ("ZONEMASTER",
+            "Records published in first zone iteration",
+            first_rate,
+            "records/s");
+  }
+  return res;
+}
+
+/* end of test_zonemaster_publish.c */